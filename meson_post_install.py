@@ -20,7 +20,8 @@ bindir = destdir_path(sys.argv[1])
 pkgdatadir = destdir_path(sys.argv[2])
 pkglibdir = destdir_path(sys.argv[3])
 pkgsysconfdir = destdir_path(sys.argv[4])
-polkitd_user = sys.argv[5]
+pkgcachedir = destdir_path(sys.argv[5])
+polkitd_user = sys.argv[6]
 
 try:
     polkitd_uid = pwd.getpwnam(polkitd_user).pw_uid
@@ -42,7 +43,8 @@ else:
 
 dst_dirs = [
     os.path.join(pkgsysconfdir, 'rules.d'),
-    os.path.join(pkgdatadir, 'rules.d')
+    os.path.join(pkgdatadir, 'rules.d'),
+    pkgcachedir,
 ]
 
 for dst in dst_dirs:
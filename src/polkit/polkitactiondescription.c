@@ -56,6 +56,11 @@ struct _PolkitActionDescription
   PolkitImplicitAuthorization implicit_active;
   GHashTable *annotations;
   gchar **annotation_keys;
+
+  /* all fields serialised, built on first use as nothing changes after
+   * construction
+   */
+  GVariant *variant;
 };
 
 struct _PolkitActionDescriptionClass
@@ -89,6 +94,8 @@ polkit_action_description_finalize (GObject *object)
   g_free (action_description->icon_name);
   g_hash_table_unref (action_description->annotations);
   g_strfreev (action_description->annotation_keys);
+  if (action_description->variant != NULL)
+    g_variant_unref (action_description->variant);
 
   if (G_OBJECT_CLASS (polkit_action_description_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (polkit_action_description_parent_class)->finalize (object);
@@ -352,31 +359,89 @@ polkit_action_description_new_for_gvariant (GVariant *value)
   return action_description;
 }
 
-/* Note that this returns a floating value. */
-GVariant *
-polkit_action_description_to_gvariant (PolkitActionDescription *action_description)
+static GVariant *
+build_gvariant (PolkitActionDescription       *action_description,
+                PolkitActionDescriptionFields  fields)
 {
   GVariantBuilder builder;
   GHashTableIter iter;
   const gchar *a_key;
   const gchar *a_value;
+  PolkitImplicitAuthorization implicit_any;
+  PolkitImplicitAuthorization implicit_inactive;
+  PolkitImplicitAuthorization implicit_active;
 
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
 
-  g_hash_table_iter_init (&iter, action_description->annotations);
-  while (g_hash_table_iter_next (&iter, (gpointer) &a_key, (gpointer) &a_value))
-    g_variant_builder_add (&builder, "{ss}", a_key, a_value);
+  if (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_ANNOTATIONS)
+    {
+      g_hash_table_iter_init (&iter, action_description->annotations);
+      while (g_hash_table_iter_next (&iter, (gpointer) &a_key, (gpointer) &a_value))
+        g_variant_builder_add (&builder, "{ss}", a_key, a_value);
+    }
+
+  implicit_any = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  implicit_inactive = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  implicit_active = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  if (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_IMPLICIT)
+    {
+      implicit_any = action_description->implicit_any;
+      implicit_inactive = action_description->implicit_inactive;
+      implicit_active = action_description->implicit_active;
+    }
 
   /* TODO: note 'foo ? : ""' is a gcc specific extension (it's a short-hand for 'foo ? foo : ""') */
   return g_variant_new ("(ssssssuuua{ss})",
                         action_description->action_id ? : "",
-                        action_description->description ? : "",
-                        action_description->message ? : "",
-                        action_description->vendor_name ? : "",
-                        action_description->vendor_url ? : "",
-                        action_description->icon_name ? : "",
-                        action_description->implicit_any,
-                        action_description->implicit_inactive,
-                        action_description->implicit_active,
+                        (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_DESCRIPTION) ? action_description->description ? : "" : "",
+                        (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_MESSAGE) ? action_description->message ? : "" : "",
+                        (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_VENDOR) ? action_description->vendor_name ? : "" : "",
+                        (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_VENDOR) ? action_description->vendor_url ? : "" : "",
+                        (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_ICON_NAME) ? action_description->icon_name ? : "" : "",
+                        implicit_any,
+                        implicit_inactive,
+                        implicit_active,
                         &builder);
 }
+
+/* Note that this returns a floating value. */
+GVariant *
+polkit_action_description_to_gvariant (PolkitActionDescription *action_description)
+{
+  GVariant *variant;
+
+  variant = g_atomic_pointer_get (&action_description->variant);
+  if (variant == NULL)
+    {
+      variant = g_variant_ref_sink (build_gvariant (action_description, POLKIT_ACTION_DESCRIPTION_FIELDS_ALL));
+      /* whoever serialised it first wins, the result is the same */
+      if (!g_atomic_pointer_compare_and_exchange (&action_description->variant, NULL, variant))
+        {
+          g_variant_unref (variant);
+          variant = g_atomic_pointer_get (&action_description->variant);
+        }
+    }
+
+  /* a new floating value sharing the serialised data, which stays
+   * valid for as long as @variant is referenced
+   */
+  return g_variant_new_from_data (G_VARIANT_TYPE ("(ssssssuuua{ss})"),
+                                  g_variant_get_data (variant),
+                                  g_variant_get_size (variant),
+                                  FALSE,
+                                  (GDestroyNotify) g_variant_unref,
+                                  g_variant_ref (variant));
+}
+
+/* Like polkit_action_description_to_gvariant() but with only @fields filled in,
+ * the others are blank. Note that this returns a floating value.
+ */
+GVariant *
+polkit_action_description_to_gvariant_with_fields (PolkitActionDescription       *action_description,
+                                                   PolkitActionDescriptionFields  fields)
+{
+  if ((fields & POLKIT_ACTION_DESCRIPTION_FIELDS_ALL) == POLKIT_ACTION_DESCRIPTION_FIELDS_ALL)
+    return polkit_action_description_to_gvariant (action_description);
+
+  return build_gvariant (action_description, fields);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined (_POLKIT_COMPILATION) && !defined(_POLKIT_INSIDE_POLKIT_H)
+#error "Only <polkit/polkit.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_ACTION_DESCRIPTION_FIELDS_H
+#define __POLKIT_ACTION_DESCRIPTION_FIELDS_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PolkitActionDescriptionFields:
+ * @POLKIT_ACTION_DESCRIPTION_FIELDS_NONE: Only the action identifier.
+ * @POLKIT_ACTION_DESCRIPTION_FIELDS_DESCRIPTION: The localized description.
+ * @POLKIT_ACTION_DESCRIPTION_FIELDS_MESSAGE: The localized message.
+ * @POLKIT_ACTION_DESCRIPTION_FIELDS_VENDOR: The vendor name and URL.
+ * @POLKIT_ACTION_DESCRIPTION_FIELDS_ICON_NAME: The icon name.
+ * @POLKIT_ACTION_DESCRIPTION_FIELDS_IMPLICIT: The implicit authorizations.
+ * @POLKIT_ACTION_DESCRIPTION_FIELDS_ANNOTATIONS: The annotations.
+ * @POLKIT_ACTION_DESCRIPTION_FIELDS_ALL: Every field.
+ *
+ * Flags selecting which fields of a #PolkitActionDescription to
+ * retrieve. Strings that are not retrieved are blank, implicit
+ * authorizations that are not retrieved are
+ * %POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN and annotations that are not
+ * retrieved are empty.
+ */
+typedef enum
+{
+  POLKIT_ACTION_DESCRIPTION_FIELDS_NONE        = 0,
+  POLKIT_ACTION_DESCRIPTION_FIELDS_DESCRIPTION = (1<<0),
+  POLKIT_ACTION_DESCRIPTION_FIELDS_MESSAGE     = (1<<1),
+  POLKIT_ACTION_DESCRIPTION_FIELDS_VENDOR      = (1<<2),
+  POLKIT_ACTION_DESCRIPTION_FIELDS_ICON_NAME   = (1<<3),
+  POLKIT_ACTION_DESCRIPTION_FIELDS_IMPLICIT    = (1<<4),
+  POLKIT_ACTION_DESCRIPTION_FIELDS_ANNOTATIONS = (1<<5),
+  POLKIT_ACTION_DESCRIPTION_FIELDS_ALL         = 0x3f,
+} PolkitActionDescriptionFields;
+
+G_END_DECLS
+
+#endif /* __POLKIT_ACTION_DESCRIPTION_FIELDS_H */
@@ -23,6 +23,8 @@
 #  include "config.h"
 #endif
 
+#include <stdlib.h>
+
 #include "polkitauthorizationresult.h"
 #include "polkitcheckauthorizationflags.h"
 #include "polkitauthority.h"
@@ -70,8 +72,26 @@ struct _PolkitAuthority
 
   gboolean initialized;
   GError *initialization_error;
+
+  /* protects everything below */
+  GMutex result_cache_lock;
+  /* in seconds, 0 if results aren't cached */
+  guint result_cache_ttl;
+  /* result_cache_key() -> CachedResult */
+  GHashTable *result_cache;
+  /* bumped on every change, so that checks racing with one aren't stored */
+  guint result_cache_generation;
 };
 
+/* Results remembered, at most */
+#define RESULT_CACHE_SIZE 256
+
+typedef struct
+{
+  PolkitAuthorizationResult *result;
+  gint64 expires; /* in monotonic time */
+} CachedResult;
+
 struct _PolkitAuthorityClass
 {
   GObjectClass parent_class;
@@ -84,6 +104,8 @@ static PolkitAuthority *the_authority = NULL;
 enum
 {
   CHANGED_SIGNAL,
+  ACTIONS_CHANGED_SIGNAL,
+  TEMPORARY_AUTHORIZATIONS_CHANGED_SIGNAL,
   LAST_SIGNAL,
 };
 
@@ -105,6 +127,22 @@ G_DEFINE_TYPE_WITH_CODE (PolkitAuthority, polkit_authority, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init)
                          G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE, async_initable_iface_init))
 
+static void
+cached_result_free (CachedResult *cached)
+{
+  g_object_unref (cached->result);
+  g_free (cached);
+}
+
+static void
+result_cache_clear (PolkitAuthority *authority)
+{
+  g_mutex_lock (&authority->result_cache_lock);
+  g_hash_table_remove_all (authority->result_cache);
+  authority->result_cache_generation++;
+  g_mutex_unlock (&authority->result_cache_lock);
+}
+
 static void
 on_proxy_signal (GDBusProxy   *proxy,
                  const gchar  *sender_name,
@@ -115,8 +153,39 @@ on_proxy_signal (GDBusProxy   *proxy,
   PolkitAuthority *authority = POLKIT_AUTHORITY (user_data);
   if (g_strcmp0 (signal_name, "Changed") == 0)
     {
+      result_cache_clear (authority);
       g_signal_emit_by_name (authority, "changed");
     }
+  else if (g_strcmp0 (signal_name, "ActionsChanged") == 0 &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(as)")))
+    {
+      const gchar **action_ids;
+
+      /* Changed follows right away, but nothing cached may be used before */
+      result_cache_clear (authority);
+      g_variant_get (parameters, "(^a&s)", &action_ids);
+      g_signal_emit (authority, signals[ACTIONS_CHANGED_SIGNAL], 0, action_ids);
+      g_free (action_ids);
+    }
+  else if (g_strcmp0 (signal_name, "TemporaryAuthorizationsChanged") == 0 &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("((sa{sv})ss)")))
+    {
+      GVariant *session_gvariant;
+      PolkitSubject *session;
+      const gchar *id;
+      const gchar *change;
+
+      /* Changed follows right away, but nothing cached may be used before */
+      result_cache_clear (authority);
+      g_variant_get (parameters, "(@(sa{sv})&s&s)", &session_gvariant, &id, &change);
+      session = polkit_subject_new_for_gvariant (session_gvariant, NULL);
+      if (session != NULL)
+        {
+          g_signal_emit (authority, signals[TEMPORARY_AUTHORIZATIONS_CHANGED_SIGNAL], 0, session, id, change);
+          g_object_unref (session);
+        }
+      g_variant_unref (session_gvariant);
+    }
 }
 
 static void
@@ -125,12 +194,19 @@ on_notify_g_name_owner (GObject    *object,
                         gpointer    user_data)
 {
   PolkitAuthority *authority = POLKIT_AUTHORITY (user_data);
+  /* whatever the old authority said may not hold for the new one */
+  result_cache_clear (authority);
   g_object_notify (G_OBJECT (authority), "owner");
 }
 
 static void
 polkit_authority_init (PolkitAuthority *authority)
 {
+  g_mutex_init (&authority->result_cache_lock);
+  authority->result_cache = g_hash_table_new_full (g_str_hash,
+                                                   g_str_equal,
+                                                   g_free,
+                                                   (GDestroyNotify) cached_result_free);
 }
 
 static void
@@ -160,6 +236,9 @@ polkit_authority_finalize (GObject *object)
   if (authority->proxy != NULL)
     g_object_unref (authority->proxy);
 
+  g_hash_table_unref (authority->result_cache);
+  g_mutex_clear (&authority->result_cache_lock);
+
   if (G_OBJECT_CLASS (polkit_authority_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (polkit_authority_parent_class)->finalize (object);
 }
@@ -287,6 +366,58 @@ polkit_authority_class_init (PolkitAuthorityClass *klass)
                                           g_cclosure_marshal_VOID__VOID,
                                           G_TYPE_NONE,
                                           0);
+
+  /**
+   * PolkitAuthority::actions-changed:
+   * @authority: A #PolkitAuthority.
+   * @action_ids: (array zero-terminated=1) (element-type utf8): The actions whose authorizations may have changed.
+   *
+   * Emitted right before #PolkitAuthority::changed when the authority
+   * knows that the change only concerns @action_ids. Checks for other
+   * actions keep their result, so handlers of the ::changed signal that
+   * follows may skip them.
+   *
+   * Since: 0.121
+   */
+  signals[ACTIONS_CHANGED_SIGNAL] = g_signal_new ("actions-changed",
+                                                  POLKIT_TYPE_AUTHORITY,
+                                                  G_SIGNAL_RUN_LAST,
+                                                  0,                      /* class offset     */
+                                                  NULL,                   /* accumulator      */
+                                                  NULL,                   /* accumulator data */
+                                                  g_cclosure_marshal_VOID__BOXED,
+                                                  G_TYPE_NONE,
+                                                  1,
+                                                  G_TYPE_STRV);
+
+  /**
+   * PolkitAuthority::temporary-authorizations-changed:
+   * @authority: A #PolkitAuthority.
+   * @session: The #PolkitSubject of the session the temporary authorization was obtained in.
+   * @id: The opaque identifier of the temporary authorization.
+   * @change: One of <literal>added</literal>, <literal>expired</literal> or <literal>revoked</literal>.
+   *
+   * Emitted right before #PolkitAuthority::changed for every temporary
+   * authorization that is added, expires or is revoked, including when
+   * its subject or session goes away. Clients showing the temporary
+   * authorizations of @session can update them from this instead of
+   * calling polkit_authority_enumerate_temporary_authorizations() on
+   * every #PolkitAuthority::changed signal.
+   *
+   * Since: 0.121
+   */
+  signals[TEMPORARY_AUTHORIZATIONS_CHANGED_SIGNAL] = g_signal_new ("temporary-authorizations-changed",
+                                                                   POLKIT_TYPE_AUTHORITY,
+                                                                   G_SIGNAL_RUN_LAST,
+                                                                   0,                      /* class offset     */
+                                                                   NULL,                   /* accumulator      */
+                                                                   NULL,                   /* accumulator data */
+                                                                   NULL,                   /* generic marshaller */
+                                                                   G_TYPE_NONE,
+                                                                   3,
+                                                                   POLKIT_TYPE_SUBJECT,
+                                                                   G_TYPE_STRING,
+                                                                   G_TYPE_STRING);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -581,15 +712,37 @@ typedef struct
   GAsyncResult *res;
   GMainContext *context;
   GMainLoop *loop;
+  gboolean in_use;
 } CallSyncData;
 
+static void
+call_sync_data_free (CallSyncData *data)
+{
+  g_main_context_unref (data->context);
+  g_main_loop_unref (data->loop);
+  g_free (data);
+}
+
+/* Every thread keeps the context it last waited on, so that a run of
+ * synchronous calls doesn't set up and tear down one each time */
+static GPrivate call_sync_private = G_PRIVATE_INIT ((GDestroyNotify) call_sync_data_free);
+
 static CallSyncData *
 call_sync_new (void)
 {
   CallSyncData *data;
-  data = g_new0 (CallSyncData, 1);
-  data->context = g_main_context_new ();
-  data->loop = g_main_loop_new (data->context, FALSE);
+
+  data = g_private_get (&call_sync_private);
+  if (data == NULL || data->in_use)
+    {
+      data = g_new0 (CallSyncData, 1);
+      data->context = g_main_context_new ();
+      data->loop = g_main_loop_new (data->context, FALSE);
+      /* a call made while waiting for another gets a context of its own */
+      if (g_private_get (&call_sync_private) == NULL)
+        g_private_set (&call_sync_private, data);
+    }
+  data->in_use = TRUE;
   g_main_context_push_thread_default (data->context);
   return data;
 }
@@ -614,10 +767,11 @@ static void
 call_sync_free (CallSyncData *data)
 {
   g_main_context_pop_thread_default (data->context);
-  g_main_context_unref (data->context);
-  g_main_loop_unref (data->loop);
   g_object_unref (data->res);
-  g_free (data);
+  data->res = NULL;
+  data->in_use = FALSE;
+  if (data != g_private_get (&call_sync_private))
+    call_sync_data_free (data);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -763,232 +917,697 @@ polkit_authority_enumerate_actions_sync (PolkitAuthority *authority,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-typedef struct
-{
-  PolkitAuthority *authority;
-  GSimpleAsyncResult *simple;
-  gchar *cancellation_id;
-} CheckAuthData;
-
-static void
-cancel_check_authorization_cb (GDBusProxy    *proxy,
-                               GAsyncResult  *res,
-                               gpointer       user_data)
-{
-  GVariant *value;
-  GError *error;
-
-  error = NULL;
-  value = g_dbus_proxy_call_finish (proxy, res, &error);
-  if (value == NULL)
-    {
-      g_warning ("Error cancelling authorization check: %s", error->message);
-      g_error_free (error);
-    }
-  else
-    {
-      g_variant_unref (value);
-    }
-}
-
-static void
-check_authorization_cb (GDBusProxy    *proxy,
-                        GAsyncResult  *res,
-                        gpointer       user_data)
-{
-  CheckAuthData *data = user_data;
-  GVariant *value;
-  GError *error;
-
-  error = NULL;
-  value = g_dbus_proxy_call_finish (proxy, res, &error);
-  if (value == NULL)
-    {
-      if (data->cancellation_id != NULL &&
-          (!g_dbus_error_is_remote_error (error) &&
-           error->domain == G_IO_ERROR &&
-           error->code == G_IO_ERROR_CANCELLED))
-        {
-          g_dbus_proxy_call (data->authority->proxy,
-                             "CancelCheckAuthorization",
-                             g_variant_new ("(s)", data->cancellation_id),
-                             G_DBUS_CALL_FLAGS_NONE,
-                             -1,
-                             NULL, /* GCancellable */
-                             (GAsyncReadyCallback) cancel_check_authorization_cb,
-                             NULL);
-        }
-      g_simple_async_result_set_from_error (data->simple, error);
-      g_error_free (error);
-    }
-  else
-    {
-      GVariant *result_value;
-      PolkitAuthorizationResult *result;
-      result_value = g_variant_get_child_value (value, 0);
-      result = polkit_authorization_result_new_for_gvariant (result_value);
-      g_variant_unref (result_value);
-      g_variant_unref (value);
-      g_simple_async_result_set_op_res_gpointer (data->simple, result, g_object_unref);
-    }
-
-  g_simple_async_result_complete (data->simple);
-
-  g_object_unref (data->authority);
-  g_object_unref (data->simple);
-  g_free (data->cancellation_id);
-  g_free (data);
-}
-
 /**
- * polkit_authority_check_authorization:
+ * polkit_authority_enumerate_actions_paged:
  * @authority: A #PolkitAuthority.
- * @subject: A #PolkitSubject.
- * @action_id: The action to check for.
- * @details: (allow-none): Details about the action or %NULL.
- * @flags: A set of #PolkitCheckAuthorizationFlags.
+ * @prefix: (allow-none): Only retrieve actions whose identifier starts with this or %NULL.
+ * @fields: The fields to retrieve, the action identifier is always retrieved.
+ * @cursor: (allow-none): The cursor returned for the previous page or %NULL to retrieve the first page.
+ * @limit: The maximum number of actions to retrieve or 0 to let the authority pick.
  * @cancellable: (allow-none): A #GCancellable or %NULL.
  * @callback: A #GAsyncReadyCallback to call when the request is satisfied.
  * @user_data: The data to pass to @callback.
  *
- * Asynchronously checks if @subject is authorized to perform the action represented
- * by @action_id.
+ * Asynchronously retrieves a page of registered actions, sorted by
+ * action identifier. The authority may return fewer than @limit
+ * actions so that replies stay small; keep passing the returned
+ * cursor until there are no more pages.
  *
- * Note that %POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION
- * <emphasis>SHOULD</emphasis> be passed <emphasis>ONLY</emphasis> if
- * the event that triggered the authorization check is stemming from
- * an user action, e.g. the user pressing a button or attaching a
- * device.
+ * Fields not in @fields are left blank, which saves transferring
+ * e.g. every annotation when only the identifiers are needed.
  *
  * When the operation is finished, @callback will be invoked in the
  * <link linkend="g-main-context-push-thread-default">thread-default
  * main loop</link> of the thread you are calling this method
- * from. You can then call
- * polkit_authority_check_authorization_finish() to get the result of
- * the operation.
- *
- * Known keys in @details include <literal>polkit.message</literal>
- * and <literal>polkit.gettext_domain</literal> that can be used to
- * override the message shown to the user. See the documentation for
- * the <link linkend="eggdbus-method-org.freedesktop.PolicyKit1.Authority.CheckAuthorization">D-Bus method</link> for more details.
- *
- * If @details is non-empty then the request will fail with
- * #POLKIT_ERROR_FAILED unless the process doing the check itsef is
- * sufficiently authorized (e.g. running as uid 0).
+ * from. You can then call polkit_authority_enumerate_actions_paged_finish()
+ * to get the result of the operation.
  **/
 void
-polkit_authority_check_authorization (PolkitAuthority               *authority,
-                                      PolkitSubject                 *subject,
-                                      const gchar                   *action_id,
-                                      PolkitDetails                 *details,
-                                      PolkitCheckAuthorizationFlags  flags,
-                                      GCancellable                  *cancellable,
-                                      GAsyncReadyCallback            callback,
-                                      gpointer                       user_data)
+polkit_authority_enumerate_actions_paged (PolkitAuthority                *authority,
+                                          const gchar                    *prefix,
+                                          PolkitActionDescriptionFields   fields,
+                                          const gchar                    *cursor,
+                                          guint                           limit,
+                                          GCancellable                   *cancellable,
+                                          GAsyncReadyCallback             callback,
+                                          gpointer                        user_data)
 {
-  CheckAuthData *data;
-
   g_return_if_fail (POLKIT_IS_AUTHORITY (authority));
-  g_return_if_fail (POLKIT_IS_SUBJECT (subject));
-  g_return_if_fail (action_id != NULL);
-  g_return_if_fail (details == NULL || POLKIT_IS_DETAILS (details));
   g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
-
-  data = g_new0 (CheckAuthData, 1);
-  data->authority = g_object_ref (authority);
-  data->simple = g_simple_async_result_new (G_OBJECT (authority),
-                                            callback,
-                                            user_data,
-                                            polkit_authority_check_authorization);
-  G_LOCK (the_lock);
-  if (cancellable != NULL)
-    data->cancellation_id = g_strdup_printf ("cancellation-id-%d", authority->cancellation_id_counter++);
-  G_UNLOCK (the_lock);
-
   g_dbus_proxy_call (authority->proxy,
-                     "CheckAuthorization",
-                     g_variant_new ("(@(sa{sv})s@a{ss}us)",
-                                    polkit_subject_to_gvariant (subject), /* A floating value */
-                                    action_id,
-                                    polkit_details_to_gvariant (details), /* A floating value */
-                                    flags,
-                                    data->cancellation_id != NULL ? data->cancellation_id : ""),
+                     "EnumerateActionsPaged",
+                     g_variant_new ("(ssusu)",
+                                    "", /* TODO: use system locale */
+                                    prefix != NULL ? prefix : "",
+                                    fields,
+                                    cursor != NULL ? cursor : "",
+                                    limit),
                      G_DBUS_CALL_FLAGS_NONE,
-                     G_MAXINT, /* no timeout */
+                     -1,
                      cancellable,
-                     (GAsyncReadyCallback) check_authorization_cb,
-                     data);
+                     generic_async_cb,
+                     g_simple_async_result_new (G_OBJECT (authority),
+                                                callback,
+                                                user_data,
+                                                polkit_authority_enumerate_actions_paged));
 }
 
 /**
- * polkit_authority_check_authorization_finish:
+ * polkit_authority_enumerate_actions_paged_finish:
  * @authority: A #PolkitAuthority.
  * @res: A #GAsyncResult obtained from the callback.
+ * @out_next_cursor: (out) (allow-none): Return location for the cursor of the next page or %NULL.
  * @error: (allow-none): Return location for error or %NULL.
  *
- * Finishes checking if a subject is authorized for an action.
+ * Finishes retrieving a page of registered actions. If there are more
+ * actions, @out_next_cursor is set to a cursor to pass to
+ * polkit_authority_enumerate_actions_paged() for the next page
+ * (free with g_free()), otherwise it is set to %NULL.
  *
- * Returns: (transfer full): A #PolkitAuthorizationResult or %NULL if
- * @error is set. Free with g_object_unref().
+ * Returns: (element-type Polkit.ActionDescription) (transfer full): A list of
+ * #PolkitActionDescription objects or %NULL if @error is set. The returned
+ * list should be freed with g_list_free() after each element have been freed
+ * with g_object_unref().
  **/
-PolkitAuthorizationResult *
-polkit_authority_check_authorization_finish (PolkitAuthority          *authority,
-                                             GAsyncResult             *res,
-                                             GError                  **error)
+GList *
+polkit_authority_enumerate_actions_paged_finish (PolkitAuthority  *authority,
+                                                 GAsyncResult     *res,
+                                                 gchar           **out_next_cursor,
+                                                 GError          **error)
 {
-  PolkitAuthorizationResult *ret;
+  GList *ret;
+  GVariant *value;
+  GVariantIter iter;
+  GVariant *child;
+  GVariant *array;
+  const gchar *next_cursor;
+  GAsyncResult *_res;
 
   g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
   g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res), NULL);
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
   ret = NULL;
+  if (out_next_cursor != NULL)
+    *out_next_cursor = NULL;
 
-  if (g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (res), error))
+  g_warn_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) == polkit_authority_enumerate_actions_paged);
+  _res = G_ASYNC_RESULT (g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res)));
+
+  value = g_dbus_proxy_call_finish (authority->proxy, _res, error);
+  if (value == NULL)
     goto out;
 
-  ret = g_object_ref (g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res)));
+  g_variant_get (value, "(@a(ssssssuuua{ss})&s)", &array, &next_cursor);
+  g_variant_iter_init (&iter, array);
+  while ((child = g_variant_iter_next_value (&iter)) != NULL)
+    {
+      ret = g_list_prepend (ret, polkit_action_description_new_for_gvariant (child));
+      g_variant_unref (child);
+    }
+  ret = g_list_reverse (ret);
+  g_variant_unref (array);
+
+  if (out_next_cursor != NULL && *next_cursor != '\0')
+    *out_next_cursor = g_strdup (next_cursor);
+  g_variant_unref (value);
 
  out:
   return ret;
 }
 
 /**
- * polkit_authority_check_authorization_sync:
+ * polkit_authority_enumerate_actions_paged_sync:
  * @authority: A #PolkitAuthority.
- * @subject: A #PolkitSubject.
- * @action_id: The action to check for.
- * @details: (allow-none): Details about the action or %NULL.
- * @flags: A set of #PolkitCheckAuthorizationFlags.
+ * @prefix: (allow-none): Only retrieve actions whose identifier starts with this or %NULL.
+ * @fields: The fields to retrieve, the action identifier is always retrieved.
+ * @cursor: (allow-none): The cursor returned for the previous page or %NULL to retrieve the first page.
+ * @limit: The maximum number of actions to retrieve or 0 to let the authority pick.
+ * @out_next_cursor: (out) (allow-none): Return location for the cursor of the next page or %NULL.
  * @cancellable: (allow-none): A #GCancellable or %NULL.
  * @error: (allow-none): Return location for error or %NULL.
  *
- * Checks if @subject is authorized to perform the action represented
- * by @action_id.
- *
- * Note that %POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION
- * <emphasis>SHOULD</emphasis> be passed <emphasis>ONLY</emphasis> if
- * the event that triggered the authorization check is stemming from
- * an user action, e.g. the user pressing a button or attaching a
- * device.
- *
- * Note the calling thread is blocked until a reply is received. You
- * should therefore <emphasis>NEVER</emphasis> do this from a GUI
- * thread or a daemon service thread when using the
- * %POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION flag. This
- * is because it may potentially take minutes (or even hours) for the
- * operation to complete because it involves waiting for the user to
- * authenticate.
- *
- * Known keys in @details include <literal>polkit.message</literal>
- * and <literal>polkit.gettext_domain</literal> that can be used to
- * override the message shown to the user. See the documentation for
- * the <link linkend="eggdbus-method-org.freedesktop.PolicyKit1.Authority.CheckAuthorization">D-Bus method</link> for more details.
+ * Synchronously retrieves a page of registered actions - the calling
+ * thread is blocked until a reply is received. See
+ * polkit_authority_enumerate_actions_paged() for the asynchronous
+ * version.
  *
- * Returns: (transfer full): A #PolkitAuthorizationResult or %NULL if @error is set. Free with g_object_unref().
- */
-PolkitAuthorizationResult *
-polkit_authority_check_authorization_sync (PolkitAuthority               *authority,
+ * Returns: (element-type Polkit.ActionDescription) (transfer full): A list of
+ * #PolkitActionDescription or %NULL if @error is set. The returned list should
+ * be freed with g_list_free() after each element have been freed with
+ * g_object_unref().
+ **/
+GList *
+polkit_authority_enumerate_actions_paged_sync (PolkitAuthority                *authority,
+                                               const gchar                    *prefix,
+                                               PolkitActionDescriptionFields   fields,
+                                               const gchar                    *cursor,
+                                               guint                           limit,
+                                               gchar                         **out_next_cursor,
+                                               GCancellable                   *cancellable,
+                                               GError                        **error)
+{
+  GList *ret;
+  CallSyncData *data;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  data = call_sync_new ();
+  polkit_authority_enumerate_actions_paged (authority, prefix, fields, cursor, limit, cancellable, call_sync_cb, data);
+  call_sync_block (data);
+  ret = polkit_authority_enumerate_actions_paged_finish (authority, data->res, out_next_cursor, error);
+  call_sync_free (data);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * polkit_authority_get_action_for_exec_path:
+ * @authority: A #PolkitAuthority.
+ * @path: The absolute path of a program.
+ * @argv1: (allow-none): The first argument the program is run with or %NULL.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied.
+ * @user_data: The data to pass to @callback.
+ *
+ * Asynchronously looks up the action that <command>pkexec</command>
+ * checks for when running @path, that is the one whose
+ * <literal>org.freedesktop.policykit.exec.path</literal> annotation
+ * is @path. Actions with an
+ * <literal>org.freedesktop.policykit.exec.argv1</literal> annotation
+ * only match if it is @argv1, and are preferred over those without.
+ *
+ * This only transfers the matching action, unlike searching the
+ * result of polkit_authority_enumerate_actions().
+ *
+ * When the operation is finished, @callback will be invoked in the
+ * <link linkend="g-main-context-push-thread-default">thread-default
+ * main loop</link> of the thread you are calling this method
+ * from. You can then call polkit_authority_get_action_for_exec_path_finish()
+ * to get the result of the operation.
+ *
+ * Since: 0.121
+ **/
+void
+polkit_authority_get_action_for_exec_path (PolkitAuthority     *authority,
+                                           const gchar         *path,
+                                           const gchar         *argv1,
+                                           GCancellable        *cancellable,
+                                           GAsyncReadyCallback  callback,
+                                           gpointer             user_data)
+{
+  g_return_if_fail (POLKIT_IS_AUTHORITY (authority));
+  g_return_if_fail (path != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+  g_dbus_proxy_call (authority->proxy,
+                     "GetActionForExecPath",
+                     g_variant_new ("(sss)",
+                                    "", /* TODO: use system locale */
+                                    path,
+                                    argv1 != NULL ? argv1 : ""),
+                     G_DBUS_CALL_FLAGS_NONE,
+                     -1,
+                     cancellable,
+                     generic_async_cb,
+                     g_simple_async_result_new (G_OBJECT (authority),
+                                                callback,
+                                                user_data,
+                                                polkit_authority_get_action_for_exec_path));
+}
+
+/**
+ * polkit_authority_get_action_for_exec_path_finish:
+ * @authority: A #PolkitAuthority.
+ * @res: A #GAsyncResult obtained from the callback.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Finishes looking up the action for running a program.
+ *
+ * Returns: (transfer full) (allow-none): A #PolkitActionDescription
+ * (free with g_object_unref()) or %NULL if no action matches or
+ * @error is set.
+ *
+ * Since: 0.121
+ **/
+PolkitActionDescription *
+polkit_authority_get_action_for_exec_path_finish (PolkitAuthority  *authority,
+                                                  GAsyncResult     *res,
+                                                  GError          **error)
+{
+  PolkitActionDescription *ret;
+  GVariant *value;
+  GVariant *array;
+  GAsyncResult *_res;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  ret = NULL;
+
+  g_warn_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) == polkit_authority_get_action_for_exec_path);
+  _res = G_ASYNC_RESULT (g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res)));
+
+  value = g_dbus_proxy_call_finish (authority->proxy, _res, error);
+  if (value == NULL)
+    goto out;
+
+  array = g_variant_get_child_value (value, 0);
+  if (g_variant_n_children (array) > 0)
+    {
+      GVariant *child;
+
+      child = g_variant_get_child_value (array, 0);
+      ret = polkit_action_description_new_for_gvariant (child);
+      g_variant_unref (child);
+    }
+  g_variant_unref (array);
+  g_variant_unref (value);
+
+ out:
+  return ret;
+}
+
+/**
+ * polkit_authority_get_action_for_exec_path_sync:
+ * @authority: A #PolkitAuthority.
+ * @path: The absolute path of a program.
+ * @argv1: (allow-none): The first argument the program is run with or %NULL.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Synchronously looks up the action for running a program - the
+ * calling thread is blocked until a reply is received. See
+ * polkit_authority_get_action_for_exec_path() for the asynchronous
+ * version.
+ *
+ * Returns: (transfer full) (allow-none): A #PolkitActionDescription
+ * (free with g_object_unref()) or %NULL if no action matches or
+ * @error is set.
+ *
+ * Since: 0.121
+ **/
+PolkitActionDescription *
+polkit_authority_get_action_for_exec_path_sync (PolkitAuthority *authority,
+                                                const gchar     *path,
+                                                const gchar     *argv1,
+                                                GCancellable    *cancellable,
+                                                GError         **error)
+{
+  PolkitActionDescription *ret;
+  CallSyncData *data;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  data = call_sync_new ();
+  polkit_authority_get_action_for_exec_path (authority, path, argv1, cancellable, call_sync_cb, data);
+  call_sync_block (data);
+  ret = polkit_authority_get_action_for_exec_path_finish (authority, data->res, error);
+  call_sync_free (data);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  PolkitAuthority *authority;
+  GSimpleAsyncResult *simple;
+  gchar *cancellation_id;
+
+  /* set if the result may be remembered */
+  gchar *cache_key;
+  guint cache_generation;
+} CheckAuthData;
+
+/* Compares two elements of a strv, for qsort() */
+static gint
+compare_strv_elements (gconstpointer a,
+                       gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+/* Gets what identifies a check whose result may be remembered, or %NULL
+ * if it must always go to the authority. Checks that may interact with
+ * the user are never remembered: an authorized result might stem from
+ * a one-time authentication, and neither are explained ones: their
+ * details describe one particular check. */
+static gchar *
+result_cache_key (PolkitAuthority               *authority,
+                  PolkitSubject                 *subject,
+                  const gchar                   *action_id,
+                  PolkitDetails                 *details,
+                  PolkitCheckAuthorizationFlags  flags)
+{
+  GString *key;
+  gchar *subject_str;
+  gchar **keys;
+  guint ttl;
+  guint n;
+
+  g_mutex_lock (&authority->result_cache_lock);
+  ttl = authority->result_cache_ttl;
+  g_mutex_unlock (&authority->result_cache_lock);
+
+  if (ttl == 0 || (flags & (POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION |
+                            POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN)) != 0)
+    return NULL;
+
+  key = g_string_new (NULL);
+  subject_str = polkit_subject_to_string (subject);
+  g_string_append_printf (key, "%s\n%s\n%u", subject_str, action_id, (guint) flags);
+  g_free (subject_str);
+
+  if (details != NULL)
+    {
+      keys = polkit_details_get_keys (details);
+      if (keys != NULL)
+        {
+          /* the same details in any order make the same check */
+          qsort (keys, g_strv_length (keys), sizeof (gchar *), compare_strv_elements);
+          for (n = 0; keys[n] != NULL; n++)
+            g_string_append_printf (key, "\n%s=%s", keys[n], polkit_details_lookup (details, keys[n]));
+          g_strfreev (keys);
+        }
+    }
+
+  return g_string_free (key, FALSE);
+}
+
+static PolkitAuthorizationResult *
+result_cache_lookup (PolkitAuthority *authority,
+                     const gchar     *key,
+                     guint           *out_generation)
+{
+  PolkitAuthorizationResult *result;
+  CachedResult *cached;
+
+  result = NULL;
+
+  g_mutex_lock (&authority->result_cache_lock);
+  cached = g_hash_table_lookup (authority->result_cache, key);
+  if (cached != NULL)
+    {
+      if (cached->expires > g_get_monotonic_time ())
+        result = g_object_ref (cached->result);
+      else
+        g_hash_table_remove (authority->result_cache, key);
+    }
+  *out_generation = authority->result_cache_generation;
+  g_mutex_unlock (&authority->result_cache_lock);
+
+  return result;
+}
+
+/* Remembers @result for @key, if it is definitive and nothing changed
+ * since the check was started */
+static void
+result_cache_store (PolkitAuthority           *authority,
+                    const gchar               *key,
+                    guint                      generation,
+                    PolkitAuthorizationResult *result)
+{
+  CachedResult *cached;
+
+  /* a challenge depends on the agent, and a temporary authorization
+   * may be revoked without the authority saying so */
+  if (polkit_authorization_result_get_is_challenge (result) ||
+      polkit_authorization_result_get_temporary_authorization_id (result) != NULL)
+    return;
+
+  g_mutex_lock (&authority->result_cache_lock);
+  if (generation == authority->result_cache_generation && authority->result_cache_ttl > 0)
+    {
+      if (g_hash_table_size (authority->result_cache) >= RESULT_CACHE_SIZE)
+        g_hash_table_remove_all (authority->result_cache);
+      cached = g_new0 (CachedResult, 1);
+      cached->result = g_object_ref (result);
+      cached->expires = g_get_monotonic_time () + (gint64) authority->result_cache_ttl * G_USEC_PER_SEC;
+      g_hash_table_replace (authority->result_cache, g_strdup (key), cached);
+    }
+  g_mutex_unlock (&authority->result_cache_lock);
+}
+
+static void
+authorization_result_list_free (GList *results)
+{
+  g_list_foreach (results, (GFunc) g_object_unref, NULL);
+  g_list_free (results);
+}
+
+static void
+cancel_check_authorization_cb (GDBusProxy    *proxy,
+                               GAsyncResult  *res,
+                               gpointer       user_data)
+{
+  GVariant *value;
+  GError *error;
+
+  error = NULL;
+  value = g_dbus_proxy_call_finish (proxy, res, &error);
+  if (value == NULL)
+    {
+      g_warning ("Error cancelling authorization check: %s", error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      g_variant_unref (value);
+    }
+}
+
+static void
+check_authorization_cb (GDBusProxy    *proxy,
+                        GAsyncResult  *res,
+                        gpointer       user_data)
+{
+  CheckAuthData *data = user_data;
+  GVariant *value;
+  GError *error;
+
+  error = NULL;
+  value = g_dbus_proxy_call_finish (proxy, res, &error);
+  if (value == NULL)
+    {
+      if (data->cancellation_id != NULL &&
+          (!g_dbus_error_is_remote_error (error) &&
+           error->domain == G_IO_ERROR &&
+           error->code == G_IO_ERROR_CANCELLED))
+        {
+          g_dbus_proxy_call (data->authority->proxy,
+                             "CancelCheckAuthorization",
+                             g_variant_new ("(s)", data->cancellation_id),
+                             G_DBUS_CALL_FLAGS_NONE,
+                             -1,
+                             NULL, /* GCancellable */
+                             (GAsyncReadyCallback) cancel_check_authorization_cb,
+                             NULL);
+        }
+      g_simple_async_result_set_from_error (data->simple, error);
+      g_error_free (error);
+    }
+  else
+    {
+      GVariant *result_value;
+      PolkitAuthorizationResult *result;
+      result_value = g_variant_get_child_value (value, 0);
+      result = polkit_authorization_result_new_for_gvariant (result_value);
+      g_variant_unref (result_value);
+      g_variant_unref (value);
+      if (data->cache_key != NULL)
+        result_cache_store (data->authority, data->cache_key, data->cache_generation, result);
+      g_simple_async_result_set_op_res_gpointer (data->simple, result, g_object_unref);
+    }
+
+  g_simple_async_result_complete (data->simple);
+
+  g_object_unref (data->authority);
+  g_object_unref (data->simple);
+  g_free (data->cancellation_id);
+  g_free (data->cache_key);
+  g_free (data);
+}
+
+/**
+ * polkit_authority_check_authorization:
+ * @authority: A #PolkitAuthority.
+ * @subject: A #PolkitSubject.
+ * @action_id: The action to check for.
+ * @details: (allow-none): Details about the action or %NULL.
+ * @flags: A set of #PolkitCheckAuthorizationFlags.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied.
+ * @user_data: The data to pass to @callback.
+ *
+ * Asynchronously checks if @subject is authorized to perform the action represented
+ * by @action_id.
+ *
+ * Note that %POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION
+ * <emphasis>SHOULD</emphasis> be passed <emphasis>ONLY</emphasis> if
+ * the event that triggered the authorization check is stemming from
+ * an user action, e.g. the user pressing a button or attaching a
+ * device.
+ *
+ * When the operation is finished, @callback will be invoked in the
+ * <link linkend="g-main-context-push-thread-default">thread-default
+ * main loop</link> of the thread you are calling this method
+ * from. You can then call
+ * polkit_authority_check_authorization_finish() to get the result of
+ * the operation.
+ *
+ * Known keys in @details include <literal>polkit.message</literal>
+ * and <literal>polkit.gettext_domain</literal> that can be used to
+ * override the message shown to the user. See the documentation for
+ * the <link linkend="eggdbus-method-org.freedesktop.PolicyKit1.Authority.CheckAuthorization">D-Bus method</link> for more details.
+ *
+ * If @details is non-empty then the request will fail with
+ * #POLKIT_ERROR_FAILED unless the process doing the check itsef is
+ * sufficiently authorized (e.g. running as uid 0).
+ *
+ * If results are cached (see polkit_authority_set_result_cache_ttl())
+ * and the same check was answered recently, @callback is invoked with
+ * that answer without asking the authority again.
+ **/
+void
+polkit_authority_check_authorization (PolkitAuthority               *authority,
+                                      PolkitSubject                 *subject,
+                                      const gchar                   *action_id,
+                                      PolkitDetails                 *details,
+                                      PolkitCheckAuthorizationFlags  flags,
+                                      GCancellable                  *cancellable,
+                                      GAsyncReadyCallback            callback,
+                                      gpointer                       user_data)
+{
+  CheckAuthData *data;
+  PolkitAuthorizationResult *cached;
+
+  g_return_if_fail (POLKIT_IS_AUTHORITY (authority));
+  g_return_if_fail (POLKIT_IS_SUBJECT (subject));
+  g_return_if_fail (action_id != NULL);
+  g_return_if_fail (details == NULL || POLKIT_IS_DETAILS (details));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  data = g_new0 (CheckAuthData, 1);
+  data->authority = g_object_ref (authority);
+  data->simple = g_simple_async_result_new (G_OBJECT (authority),
+                                            callback,
+                                            user_data,
+                                            polkit_authority_check_authorization);
+
+  data->cache_key = result_cache_key (authority, subject, action_id, details, flags);
+  if (data->cache_key != NULL)
+    {
+      cached = result_cache_lookup (authority, data->cache_key, &data->cache_generation);
+      if (cached != NULL)
+        {
+          g_simple_async_result_set_op_res_gpointer (data->simple, cached, g_object_unref);
+          g_simple_async_result_complete_in_idle (data->simple);
+          g_object_unref (data->authority);
+          g_object_unref (data->simple);
+          g_free (data->cache_key);
+          g_free (data);
+          return;
+        }
+    }
+
+  G_LOCK (the_lock);
+  if (cancellable != NULL)
+    data->cancellation_id = g_strdup_printf ("cancellation-id-%d", authority->cancellation_id_counter++);
+  G_UNLOCK (the_lock);
+
+  g_dbus_proxy_call (authority->proxy,
+                     "CheckAuthorization",
+                     g_variant_new ("(@(sa{sv})s@a{ss}us)",
+                                    polkit_subject_to_gvariant (subject), /* A floating value */
+                                    action_id,
+                                    polkit_details_to_gvariant (details), /* A floating value */
+                                    flags,
+                                    data->cancellation_id != NULL ? data->cancellation_id : ""),
+                     G_DBUS_CALL_FLAGS_NONE,
+                     G_MAXINT, /* no timeout */
+                     cancellable,
+                     (GAsyncReadyCallback) check_authorization_cb,
+                     data);
+}
+
+/**
+ * polkit_authority_check_authorization_finish:
+ * @authority: A #PolkitAuthority.
+ * @res: A #GAsyncResult obtained from the callback.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Finishes checking if a subject is authorized for an action.
+ *
+ * Returns: (transfer full): A #PolkitAuthorizationResult or %NULL if
+ * @error is set. Free with g_object_unref().
+ **/
+PolkitAuthorizationResult *
+polkit_authority_check_authorization_finish (PolkitAuthority          *authority,
+                                             GAsyncResult             *res,
+                                             GError                  **error)
+{
+  PolkitAuthorizationResult *ret;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  ret = NULL;
+
+  if (g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (res), error))
+    goto out;
+
+  ret = g_object_ref (g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res)));
+
+ out:
+  return ret;
+}
+
+/**
+ * polkit_authority_check_authorization_sync:
+ * @authority: A #PolkitAuthority.
+ * @subject: A #PolkitSubject.
+ * @action_id: The action to check for.
+ * @details: (allow-none): Details about the action or %NULL.
+ * @flags: A set of #PolkitCheckAuthorizationFlags.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Checks if @subject is authorized to perform the action represented
+ * by @action_id.
+ *
+ * Note that %POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION
+ * <emphasis>SHOULD</emphasis> be passed <emphasis>ONLY</emphasis> if
+ * the event that triggered the authorization check is stemming from
+ * an user action, e.g. the user pressing a button or attaching a
+ * device.
+ *
+ * Note the calling thread is blocked until a reply is received. You
+ * should therefore <emphasis>NEVER</emphasis> do this from a GUI
+ * thread or a daemon service thread when using the
+ * %POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION flag. This
+ * is because it may potentially take minutes (or even hours) for the
+ * operation to complete because it involves waiting for the user to
+ * authenticate.
+ *
+ * Known keys in @details include <literal>polkit.message</literal>
+ * and <literal>polkit.gettext_domain</literal> that can be used to
+ * override the message shown to the user. See the documentation for
+ * the <link linkend="eggdbus-method-org.freedesktop.PolicyKit1.Authority.CheckAuthorization">D-Bus method</link> for more details.
+ *
+ * Returns: (transfer full): A #PolkitAuthorizationResult or %NULL if @error is set. Free with g_object_unref().
+ */
+PolkitAuthorizationResult *
+polkit_authority_check_authorization_sync (PolkitAuthority               *authority,
                                            PolkitSubject                 *subject,
                                            const gchar                   *action_id,
                                            PolkitDetails                 *details,
@@ -996,20 +1615,327 @@ polkit_authority_check_authorization_sync (PolkitAuthority               *author
                                            GCancellable                  *cancellable,
                                            GError                       **error)
 {
-  PolkitAuthorizationResult *ret;
+  PolkitAuthorizationResult *ret;
+  CallSyncData *data;
+  gchar *cache_key;
+  guint cache_generation;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), NULL);
+  g_return_val_if_fail (action_id != NULL, NULL);
+  g_return_val_if_fail (details == NULL || POLKIT_IS_DETAILS (details), NULL);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  /* spare setting up a main loop when the answer is known already */
+  cache_key = result_cache_key (authority, subject, action_id, details, flags);
+  if (cache_key != NULL)
+    {
+      ret = result_cache_lookup (authority, cache_key, &cache_generation);
+      g_free (cache_key);
+      if (ret != NULL)
+        return ret;
+    }
+
+  data = call_sync_new ();
+  polkit_authority_check_authorization (authority, subject, action_id, details, flags, cancellable, call_sync_cb, data);
+  call_sync_block (data);
+  ret = polkit_authority_check_authorization_finish (authority, data->res, error);
+  call_sync_free (data);
+
+  return ret;
+}
+
+/**
+ * polkit_authority_set_result_cache_ttl:
+ * @authority: A #PolkitAuthority.
+ * @ttl: For how many seconds a result is remembered, or 0 to never remember results.
+ *
+ * Makes polkit_authority_check_authorization() and
+ * polkit_authority_check_authorization_sync() remember what the
+ * authority answered, and answer the same check from memory for up to
+ * @ttl seconds. This is meant for services that check the same
+ * subjects over and over. Results aren't cached by default. As the
+ * #PolkitAuthority is shared within a process, this applies to every
+ * part of the process that uses it.
+ *
+ * Only definitive answers are remembered: challenges, answers that
+ * rest on a temporary authorization and checks that may interact with
+ * the user always go to the authority. Everything remembered is
+ * forgotten when the authority emits #PolkitAuthority::changed or the
+ * authority is restarted.
+ *
+ * Since: 0.121
+ */
+void
+polkit_authority_set_result_cache_ttl (PolkitAuthority *authority,
+                                       guint            ttl)
+{
+  g_return_if_fail (POLKIT_IS_AUTHORITY (authority));
+
+  g_mutex_lock (&authority->result_cache_lock);
+  authority->result_cache_ttl = ttl;
+  g_hash_table_remove_all (authority->result_cache);
+  authority->result_cache_generation++;
+  g_mutex_unlock (&authority->result_cache_lock);
+}
+
+/**
+ * polkit_authority_get_result_cache_ttl:
+ * @authority: A #PolkitAuthority.
+ *
+ * Gets for how long results of authorization checks are remembered.
+ *
+ * Returns: The time in seconds, 0 if results aren't remembered.
+ *
+ * Since: 0.121
+ */
+guint
+polkit_authority_get_result_cache_ttl (PolkitAuthority *authority)
+{
+  guint ret;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), 0);
+
+  g_mutex_lock (&authority->result_cache_lock);
+  ret = authority->result_cache_ttl;
+  g_mutex_unlock (&authority->result_cache_lock);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+check_authorizations_cb (GDBusProxy    *proxy,
+                         GAsyncResult  *res,
+                         gpointer       user_data)
+{
+  CheckAuthData *data = user_data;
+  GVariant *value;
+  GError *error;
+
+  error = NULL;
+  value = g_dbus_proxy_call_finish (proxy, res, &error);
+  if (value == NULL)
+    {
+      if (data->cancellation_id != NULL &&
+          (!g_dbus_error_is_remote_error (error) &&
+           error->domain == G_IO_ERROR &&
+           error->code == G_IO_ERROR_CANCELLED))
+        {
+          g_dbus_proxy_call (data->authority->proxy,
+                             "CancelCheckAuthorization",
+                             g_variant_new ("(s)", data->cancellation_id),
+                             G_DBUS_CALL_FLAGS_NONE,
+                             -1,
+                             NULL, /* GCancellable */
+                             (GAsyncReadyCallback) cancel_check_authorization_cb,
+                             NULL);
+        }
+      g_simple_async_result_set_from_error (data->simple, error);
+      g_error_free (error);
+    }
+  else
+    {
+      GVariantIter iter;
+      GVariant *array;
+      GVariant *child;
+      GList *results;
+
+      results = NULL;
+      array = g_variant_get_child_value (value, 0);
+      g_variant_iter_init (&iter, array);
+      while ((child = g_variant_iter_next_value (&iter)) != NULL)
+        {
+          results = g_list_prepend (results, polkit_authorization_result_new_for_gvariant (child));
+          g_variant_unref (child);
+        }
+      results = g_list_reverse (results);
+      g_variant_unref (array);
+      g_variant_unref (value);
+      g_simple_async_result_set_op_res_gpointer (data->simple,
+                                                 results,
+                                                 (GDestroyNotify) authorization_result_list_free);
+    }
+
+  g_simple_async_result_complete (data->simple);
+
+  g_object_unref (data->authority);
+  g_object_unref (data->simple);
+  g_free (data->cancellation_id);
+  g_free (data);
+}
+
+/**
+ * polkit_authority_check_authorizations:
+ * @authority: A #PolkitAuthority.
+ * @subject: A #PolkitSubject.
+ * @action_ids: (array zero-terminated=1): A %NULL-terminated array of actions to check for.
+ * @details: (allow-none): An array with details about every action in @action_ids, or %NULL. Elements may be %NULL.
+ * @flags: A set of #PolkitCheckAuthorizationFlags.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied.
+ * @user_data: The data to pass to @callback.
+ *
+ * Asynchronously checks if @subject is authorized to perform each of
+ * the actions in @action_ids. This costs a single round-trip to the
+ * authority, and the subject is only looked up once, which makes it
+ * a lot cheaper than checking every action on its own.
+ *
+ * Every action is checked as with
+ * polkit_authority_check_authorization(), including the restrictions
+ * on passing details. If any of the checks fails, the whole request
+ * fails with the first error.
+ *
+ * When the operation is finished, @callback will be invoked in the
+ * <link linkend="g-main-context-push-thread-default">thread-default
+ * main loop</link> of the thread you are calling this method
+ * from. You can then call
+ * polkit_authority_check_authorizations_finish() to get the result of
+ * the operation.
+ **/
+void
+polkit_authority_check_authorizations (PolkitAuthority               *authority,
+                                       PolkitSubject                 *subject,
+                                       const gchar * const           *action_ids,
+                                       PolkitDetails * const         *details,
+                                       PolkitCheckAuthorizationFlags  flags,
+                                       GCancellable                  *cancellable,
+                                       GAsyncReadyCallback            callback,
+                                       gpointer                       user_data)
+{
+  CheckAuthData *data;
+  GVariantBuilder builder;
+  guint n;
+
+  g_return_if_fail (POLKIT_IS_AUTHORITY (authority));
+  g_return_if_fail (POLKIT_IS_SUBJECT (subject));
+  g_return_if_fail (action_ids != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{ss})"));
+  for (n = 0; action_ids[n] != NULL; n++)
+    {
+      PolkitDetails *action_details;
+
+      action_details = details != NULL ? details[n] : NULL;
+      g_variant_builder_add (&builder,
+                             "(s@a{ss})",
+                             action_ids[n],
+                             polkit_details_to_gvariant (action_details)); /* A floating value */
+    }
+
+  data = g_new0 (CheckAuthData, 1);
+  data->authority = g_object_ref (authority);
+  data->simple = g_simple_async_result_new (G_OBJECT (authority),
+                                            callback,
+                                            user_data,
+                                            polkit_authority_check_authorizations);
+  G_LOCK (the_lock);
+  if (cancellable != NULL)
+    data->cancellation_id = g_strdup_printf ("cancellation-id-%d", authority->cancellation_id_counter++);
+  G_UNLOCK (the_lock);
+
+  g_dbus_proxy_call (authority->proxy,
+                     "CheckAuthorizations",
+                     g_variant_new ("(@(sa{sv})a(sa{ss})us)",
+                                    polkit_subject_to_gvariant (subject), /* A floating value */
+                                    &builder,
+                                    flags,
+                                    data->cancellation_id != NULL ? data->cancellation_id : ""),
+                     G_DBUS_CALL_FLAGS_NONE,
+                     G_MAXINT, /* no timeout */
+                     cancellable,
+                     (GAsyncReadyCallback) check_authorizations_cb,
+                     data);
+}
+
+/**
+ * polkit_authority_check_authorizations_finish:
+ * @authority: A #PolkitAuthority.
+ * @res: A #GAsyncResult obtained from the callback.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Finishes checking if a subject is authorized for several actions.
+ *
+ * Returns: (element-type Polkit.AuthorizationResult) (transfer full): A
+ * list of #PolkitAuthorizationResult objects, in the same order as the
+ * actions were passed, or %NULL if @error is set. The returned list
+ * should be freed with g_list_free() after each element have been
+ * freed with g_object_unref().
+ **/
+GList *
+polkit_authority_check_authorizations_finish (PolkitAuthority  *authority,
+                                              GAsyncResult     *res,
+                                              GError          **error)
+{
+  GList *ret;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  ret = NULL;
+
+  g_warn_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) == polkit_authority_check_authorizations);
+
+  if (g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (res), error))
+    goto out;
+
+  ret = g_list_copy (g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res)));
+  g_list_foreach (ret, (GFunc) g_object_ref, NULL);
+
+ out:
+  return ret;
+}
+
+/**
+ * polkit_authority_check_authorizations_sync:
+ * @authority: A #PolkitAuthority.
+ * @subject: A #PolkitSubject.
+ * @action_ids: (array zero-terminated=1): A %NULL-terminated array of actions to check for.
+ * @details: (allow-none): An array with details about every action in @action_ids, or %NULL. Elements may be %NULL.
+ * @flags: A set of #PolkitCheckAuthorizationFlags.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Checks if @subject is authorized to perform each of the actions in
+ * @action_ids. See polkit_authority_check_authorizations() for the
+ * asynchronous version.
+ *
+ * Note the calling thread is blocked until a reply is received, so
+ * the same caveats as for polkit_authority_check_authorization_sync()
+ * apply.
+ *
+ * Returns: (element-type Polkit.AuthorizationResult) (transfer full): A
+ * list of #PolkitAuthorizationResult objects, in the same order as the
+ * actions were passed, or %NULL if @error is set. The returned list
+ * should be freed with g_list_free() after each element have been
+ * freed with g_object_unref().
+ */
+GList *
+polkit_authority_check_authorizations_sync (PolkitAuthority               *authority,
+                                            PolkitSubject                 *subject,
+                                            const gchar * const           *action_ids,
+                                            PolkitDetails * const         *details,
+                                            PolkitCheckAuthorizationFlags  flags,
+                                            GCancellable                  *cancellable,
+                                            GError                       **error)
+{
+  GList *ret;
   CallSyncData *data;
 
   g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
   g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), NULL);
-  g_return_val_if_fail (action_id != NULL, NULL);
-  g_return_val_if_fail (details == NULL || POLKIT_IS_DETAILS (details), NULL);
+  g_return_val_if_fail (action_ids != NULL, NULL);
   g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
   data = call_sync_new ();
-  polkit_authority_check_authorization (authority, subject, action_id, details, flags, cancellable, call_sync_cb, data);
+  polkit_authority_check_authorizations (authority, subject, action_ids, details, flags, cancellable, call_sync_cb, data);
   call_sync_block (data);
-  ret = polkit_authority_check_authorization_finish (authority, data->res, error);
+  ret = polkit_authority_check_authorizations_finish (authority, data->res, error);
   call_sync_free (data);
 
   return ret;
@@ -1335,6 +2261,162 @@ polkit_authority_register_authentication_agent_with_options_sync (PolkitAuthorit
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/**
+ * polkit_authority_register_authentication_agent_for_subjects:
+ * @authority: A #PolkitAuthority.
+ * @subjects: (element-type Polkit.Subject): The subjects the authentication agent is for, typically #PolkitUnixSession objects.
+ * @locale: The locale of the authentication agent.
+ * @object_path: The object path for the authentication agent.
+ * @options: (allow-none): A #GVariant with options or %NULL.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied.
+ * @user_data: The data to pass to @callback.
+ *
+ * Asynchronously registers a single authentication agent for all of
+ * @subjects, for system-wide agents serving many sessions at once.
+ * Either all of @subjects are registered or none is. If the caller
+ * already registered an agent at @object_path, @subjects are added to
+ * it. Each subject is unregistered on its own with
+ * polkit_authority_unregister_authentication_agent().
+ *
+ * See polkit_authority_register_authentication_agent_with_options() for
+ * @options.
+ *
+ * When the operation is finished, @callback will be invoked in the
+ * <link linkend="g-main-context-push-thread-default">thread-default
+ * main loop</link> of the thread you are calling this method
+ * from. You can then call
+ * polkit_authority_register_authentication_agent_for_subjects_finish() to get the
+ * result of the operation.
+ **/
+void
+polkit_authority_register_authentication_agent_for_subjects (PolkitAuthority      *authority,
+                                                             GList                *subjects,
+                                                             const gchar          *locale,
+                                                             const gchar          *object_path,
+                                                             GVariant             *options,
+                                                             GCancellable         *cancellable,
+                                                             GAsyncReadyCallback   callback,
+                                                             gpointer              user_data)
+{
+  GVariantBuilder subjects_builder;
+  GList *l;
+
+  g_return_if_fail (POLKIT_IS_AUTHORITY (authority));
+  g_return_if_fail (subjects != NULL);
+  g_return_if_fail (locale != NULL);
+  g_return_if_fail (g_variant_is_object_path (object_path));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  g_variant_builder_init (&subjects_builder, G_VARIANT_TYPE ("a(sa{sv})"));
+  for (l = subjects; l != NULL; l = l->next)
+    g_variant_builder_add_value (&subjects_builder,
+                                 polkit_subject_to_gvariant (POLKIT_SUBJECT (l->data))); /* A floating value */
+
+  g_dbus_proxy_call (authority->proxy,
+                     "RegisterAuthenticationAgentForSubjects",
+                     g_variant_new ("(a(sa{sv})ss@a{sv})",
+                                    &subjects_builder,
+                                    locale,
+                                    object_path,
+                                    options != NULL ? options : g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0)),
+                     G_DBUS_CALL_FLAGS_NONE,
+                     -1,
+                     cancellable,
+                     generic_async_cb,
+                     g_simple_async_result_new (G_OBJECT (authority),
+                                                callback,
+                                                user_data,
+                                                polkit_authority_register_authentication_agent_for_subjects));
+}
+
+/**
+ * polkit_authority_register_authentication_agent_for_subjects_finish:
+ * @authority: A #PolkitAuthority.
+ * @res: A #GAsyncResult obtained from the callback.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Finishes registering an authentication agent for several subjects.
+ *
+ * Returns: %TRUE if the authentication agent was successfully registered, %FALSE if @error is set.
+ **/
+gboolean
+polkit_authority_register_authentication_agent_for_subjects_finish (PolkitAuthority *authority,
+                                                                    GAsyncResult    *res,
+                                                                    GError         **error)
+{
+  gboolean ret;
+  GVariant *value;
+  GAsyncResult *_res;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), FALSE);
+  g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  ret = FALSE;
+
+  g_warn_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) == polkit_authority_register_authentication_agent_for_subjects);
+  _res = G_ASYNC_RESULT (g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res)));
+
+  value = g_dbus_proxy_call_finish (authority->proxy, _res, error);
+  if (value == NULL)
+    goto out;
+  ret = TRUE;
+  g_variant_unref (value);
+
+ out:
+  return ret;
+}
+
+/**
+ * polkit_authority_register_authentication_agent_for_subjects_sync:
+ * @authority: A #PolkitAuthority.
+ * @subjects: (element-type Polkit.Subject): The subjects the authentication agent is for, typically #PolkitUnixSession objects.
+ * @locale: The locale of the authentication agent.
+ * @object_path: The object path for the authentication agent.
+ * @options: (allow-none): A #GVariant with options or %NULL.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Registers a single authentication agent for all of @subjects.
+ *
+ * The calling thread is blocked
+ * until a reply is received. See
+ * polkit_authority_register_authentication_agent_for_subjects() for the
+ * asynchronous version.
+ *
+ * Returns: %TRUE if the authentication agent was successfully registered, %FALSE if @error is set.
+ **/
+gboolean
+polkit_authority_register_authentication_agent_for_subjects_sync (PolkitAuthority     *authority,
+                                                                  GList               *subjects,
+                                                                  const gchar         *locale,
+                                                                  const gchar         *object_path,
+                                                                  GVariant            *options,
+                                                                  GCancellable        *cancellable,
+                                                                  GError             **error)
+{
+  gboolean ret;
+  CallSyncData *data;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), FALSE);
+  g_return_val_if_fail (subjects != NULL, FALSE);
+  g_return_val_if_fail (locale != NULL, FALSE);
+  g_return_val_if_fail (g_variant_is_object_path (object_path), FALSE);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  data = call_sync_new ();
+  polkit_authority_register_authentication_agent_for_subjects (authority, subjects, locale, object_path, options, cancellable, call_sync_cb, data);
+  call_sync_block (data);
+  ret = polkit_authority_register_authentication_agent_for_subjects_finish (authority, data->res, error);
+  call_sync_free (data);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 /**
  * polkit_authority_unregister_authentication_agent:
  * @authority: A #PolkitAuthority.
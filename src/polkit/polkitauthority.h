@@ -29,6 +29,7 @@
 #include <glib-object.h>
 #include <gio/gio.h>
 #include <polkit/polkittypes.h>
+#include <polkit/polkitactiondescriptionfields.h>
 #include <polkit/polkitauthorityfeatures.h>
 
 G_BEGIN_DECLS
@@ -62,12 +63,31 @@ const gchar             *polkit_authority_get_backend_name     (PolkitAuthority
 const gchar             *polkit_authority_get_backend_version  (PolkitAuthority *authority);
 PolkitAuthorityFeatures  polkit_authority_get_backend_features (PolkitAuthority *authority);
 
+void                     polkit_authority_set_result_cache_ttl (PolkitAuthority *authority,
+                                                                guint            ttl);
+guint                    polkit_authority_get_result_cache_ttl (PolkitAuthority *authority);
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 GList                     *polkit_authority_enumerate_actions_sync (PolkitAuthority *authority,
                                                                     GCancellable    *cancellable,
                                                                     GError         **error);
 
+GList                     *polkit_authority_enumerate_actions_paged_sync (PolkitAuthority                *authority,
+                                                                          const gchar                    *prefix,
+                                                                          PolkitActionDescriptionFields   fields,
+                                                                          const gchar                    *cursor,
+                                                                          guint                           limit,
+                                                                          gchar                         **out_next_cursor,
+                                                                          GCancellable                   *cancellable,
+                                                                          GError                        **error);
+
+PolkitActionDescription   *polkit_authority_get_action_for_exec_path_sync (PolkitAuthority *authority,
+                                                                           const gchar     *path,
+                                                                           const gchar     *argv1,
+                                                                           GCancellable    *cancellable,
+                                                                           GError         **error);
+
 PolkitAuthorizationResult *polkit_authority_check_authorization_sync (PolkitAuthority               *authority,
                                                                       PolkitSubject                 *subject,
                                                                       const gchar                   *action_id,
@@ -76,6 +96,14 @@ PolkitAuthorizationResult *polkit_authority_check_authorization_sync (PolkitAuth
                                                                       GCancellable                  *cancellable,
                                                                       GError                       **error);
 
+GList                     *polkit_authority_check_authorizations_sync (PolkitAuthority               *authority,
+                                                                        PolkitSubject                 *subject,
+                                                                        const gchar * const           *action_ids,
+                                                                        PolkitDetails * const         *details,
+                                                                        PolkitCheckAuthorizationFlags  flags,
+                                                                        GCancellable                  *cancellable,
+                                                                        GError                       **error);
+
 gboolean                   polkit_authority_register_authentication_agent_sync (PolkitAuthority     *authority,
                                                                                 PolkitSubject       *subject,
                                                                                 const gchar         *locale,
@@ -91,6 +119,14 @@ gboolean                   polkit_authority_register_authentication_agent_with_o
                                                                                              GCancellable        *cancellable,
                                                                                              GError             **error);
 
+gboolean                   polkit_authority_register_authentication_agent_for_subjects_sync (PolkitAuthority     *authority,
+                                                                                             GList               *subjects,
+                                                                                             const gchar         *locale,
+                                                                                             const gchar         *object_path,
+                                                                                             GVariant            *options,
+                                                                                             GCancellable        *cancellable,
+                                                                                             GError             **error);
+
 gboolean                   polkit_authority_unregister_authentication_agent_sync (PolkitAuthority     *authority,
                                                                                   PolkitSubject       *subject,
                                                                                   const gchar         *object_path,
@@ -129,6 +165,31 @@ GList *                    polkit_authority_enumerate_actions_finish (PolkitAuth
                                                                       GAsyncResult    *res,
                                                                       GError         **error);
 
+void                       polkit_authority_enumerate_actions_paged (PolkitAuthority                *authority,
+                                                                     const gchar                    *prefix,
+                                                                     PolkitActionDescriptionFields   fields,
+                                                                     const gchar                    *cursor,
+                                                                     guint                           limit,
+                                                                     GCancellable                   *cancellable,
+                                                                     GAsyncReadyCallback             callback,
+                                                                     gpointer                        user_data);
+
+GList *                    polkit_authority_enumerate_actions_paged_finish (PolkitAuthority  *authority,
+                                                                            GAsyncResult     *res,
+                                                                            gchar           **out_next_cursor,
+                                                                            GError          **error);
+
+void                       polkit_authority_get_action_for_exec_path (PolkitAuthority     *authority,
+                                                                      const gchar         *path,
+                                                                      const gchar         *argv1,
+                                                                      GCancellable        *cancellable,
+                                                                      GAsyncReadyCallback  callback,
+                                                                      gpointer             user_data);
+
+PolkitActionDescription   *polkit_authority_get_action_for_exec_path_finish (PolkitAuthority  *authority,
+                                                                             GAsyncResult     *res,
+                                                                             GError          **error);
+
 void                       polkit_authority_check_authorization (PolkitAuthority               *authority,
                                                                  PolkitSubject                 *subject,
                                                                  const gchar                   *action_id,
@@ -142,6 +203,19 @@ PolkitAuthorizationResult *polkit_authority_check_authorization_finish (PolkitAu
                                                                         GAsyncResult             *res,
                                                                         GError                  **error);
 
+void                       polkit_authority_check_authorizations (PolkitAuthority               *authority,
+                                                                  PolkitSubject                 *subject,
+                                                                  const gchar * const           *action_ids,
+                                                                  PolkitDetails * const         *details,
+                                                                  PolkitCheckAuthorizationFlags  flags,
+                                                                  GCancellable                  *cancellable,
+                                                                  GAsyncReadyCallback            callback,
+                                                                  gpointer                       user_data);
+
+GList                     *polkit_authority_check_authorizations_finish (PolkitAuthority  *authority,
+                                                                         GAsyncResult     *res,
+                                                                         GError          **error);
+
 void                       polkit_authority_register_authentication_agent (PolkitAuthority     *authority,
                                                                            PolkitSubject       *subject,
                                                                            const gchar         *locale,
@@ -168,6 +242,19 @@ void                       polkit_authority_register_authentication_agent_with_o
                                                                                         GAsyncReadyCallback  callback,
                                                                                         gpointer             user_data);
 
+gboolean                   polkit_authority_register_authentication_agent_for_subjects_finish (PolkitAuthority *authority,
+                                                                                               GAsyncResult    *res,
+                                                                                               GError         **error);
+
+void                       polkit_authority_register_authentication_agent_for_subjects (PolkitAuthority     *authority,
+                                                                                        GList               *subjects,
+                                                                                        const gchar         *locale,
+                                                                                        const gchar         *object_path,
+                                                                                        GVariant            *options,
+                                                                                        GCancellable        *cancellable,
+                                                                                        GAsyncReadyCallback  callback,
+                                                                                        gpointer             user_data);
+
 void                       polkit_authority_unregister_authentication_agent (PolkitAuthority     *authority,
                                                                              PolkitSubject       *subject,
                                                                              const gchar         *object_path,
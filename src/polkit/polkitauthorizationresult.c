@@ -290,6 +290,31 @@ polkit_authorization_result_new_for_gvariant (GVariant *value)
   return ret;
 }
 
+/* Results without details, indexed by is_authorized and is_challenge.
+ * These are most of them, so they are serialised only once.
+ */
+static GVariant *
+get_shared_gvariant (gboolean is_authorized,
+                     gboolean is_challenge)
+{
+  static GVariant *shared[4] = { NULL, };
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      guint n;
+
+      for (n = 0; n < G_N_ELEMENTS (shared); n++)
+        shared[n] = g_variant_ref_sink (g_variant_new ("(bb@a{ss})",
+                                                       (n & 2) != 0,
+                                                       (n & 1) != 0,
+                                                       g_variant_new_array (G_VARIANT_TYPE ("{ss}"), NULL, 0)));
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return shared[(is_authorized ? 2 : 0) | (is_challenge ? 1 : 0)];
+}
+
 /* Note that this returns a floating value. */
 GVariant *
 polkit_authorization_result_to_gvariant (PolkitAuthorizationResult *authorization_result)
@@ -297,6 +322,21 @@ polkit_authorization_result_to_gvariant (PolkitAuthorizationResult *authorizatio
   PolkitDetails *details;
 
   details = polkit_authorization_result_get_details (authorization_result);
+  if (polkit_details_is_empty (details))
+    {
+      GVariant *variant;
+
+      /* a new floating value sharing the serialised data */
+      variant = get_shared_gvariant (polkit_authorization_result_get_is_authorized (authorization_result),
+                                     polkit_authorization_result_get_is_challenge (authorization_result));
+      return g_variant_new_from_data (G_VARIANT_TYPE ("(bba{ss})"),
+                                      g_variant_get_data (variant),
+                                      g_variant_get_size (variant),
+                                      FALSE,
+                                      NULL, /* shared ones are never freed */
+                                      NULL);
+    }
+
   return g_variant_new ("(bb@a{ss})",
                         polkit_authorization_result_get_is_authorized (authorization_result),
                         polkit_authorization_result_get_is_challenge (authorization_result),
@@ -38,6 +38,15 @@
  * An object used for passing details around.
  */
 
+/* Entries that fit in the object itself before anything is allocated */
+#define DETAILS_N_INLINE 4
+
+typedef struct
+{
+  gchar *key;
+  gchar *value;
+} DetailsEntry;
+
 /**
  * PolkitDetails:
  *
@@ -47,7 +56,17 @@ struct _PolkitDetails
 {
   GObject parent_instance;
 
-  GHashTable *hash;
+  /* Details received as an a{ss} are read from it in place, and only
+   * copied into @entries once they are changed. Once copied, @variant
+   * is just the last serialisation of @entries, if still current.
+   */
+  GVariant *variant;
+
+  gboolean has_entries;
+  DetailsEntry *entries;
+  guint n_entries;
+  guint n_allocated;
+  DetailsEntry inline_entries[DETAILS_N_INLINE];
 };
 
 struct _PolkitDetailsClass
@@ -60,17 +79,28 @@ G_DEFINE_TYPE (PolkitDetails, polkit_details, G_TYPE_OBJECT);
 static void
 polkit_details_init (PolkitDetails *details)
 {
+  details->entries = details->inline_entries;
+  details->n_allocated = DETAILS_N_INLINE;
 }
 
 static void
 polkit_details_finalize (GObject *object)
 {
   PolkitDetails *details;
+  guint n;
 
   details = POLKIT_DETAILS (object);
 
-  if (details->hash != NULL)
-    g_hash_table_unref (details->hash);
+  if (details->variant != NULL)
+    g_variant_unref (details->variant);
+
+  for (n = 0; n < details->n_entries; n++)
+    {
+      g_free (details->entries[n].key);
+      g_free (details->entries[n].value);
+    }
+  if (details->entries != details->inline_entries)
+    g_free (details->entries);
 
   if (G_OBJECT_CLASS (polkit_details_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (polkit_details_parent_class)->finalize (object);
@@ -101,17 +131,85 @@ polkit_details_new (void)
   return details;
 }
 
-/* private */
-static PolkitDetails *
-polkit_details_new_for_hash (GHashTable *hash)
+static DetailsEntry *
+find_entry (PolkitDetails *details,
+            const gchar   *key)
 {
-  PolkitDetails *details;
+  guint n;
 
-  details = POLKIT_DETAILS (g_object_new (POLKIT_TYPE_DETAILS, NULL));
-  if (hash != NULL)
-    details->hash = g_hash_table_ref (hash);
+  for (n = 0; n < details->n_entries; n++)
+    {
+      if (strcmp (details->entries[n].key, key) == 0)
+        return &details->entries[n];
+    }
+  return NULL;
+}
 
-  return details;
+static void
+set_entry (PolkitDetails *details,
+           const gchar   *key,
+           const gchar   *value)
+{
+  DetailsEntry *entry;
+
+  entry = find_entry (details, key);
+  if (entry != NULL)
+    {
+      if (value != NULL)
+        {
+          g_free (entry->value);
+          entry->value = g_strdup (value);
+        }
+      else
+        {
+          g_free (entry->key);
+          g_free (entry->value);
+          details->n_entries--;
+          memmove (entry, entry + 1,
+                   (details->entries + details->n_entries - entry) * sizeof (DetailsEntry));
+        }
+      return;
+    }
+
+  if (value == NULL)
+    return;
+
+  if (details->n_entries == details->n_allocated)
+    {
+      details->n_allocated *= 2;
+      if (details->entries == details->inline_entries)
+        {
+          details->entries = g_new (DetailsEntry, details->n_allocated);
+          memcpy (details->entries, details->inline_entries, sizeof (details->inline_entries));
+        }
+      else
+        {
+          details->entries = g_renew (DetailsEntry, details->entries, details->n_allocated);
+        }
+    }
+  entry = &details->entries[details->n_entries++];
+  entry->key = g_strdup (key);
+  entry->value = g_strdup (value);
+}
+
+/* Copies what was received into @entries, so it can be changed */
+static void
+ensure_entries (PolkitDetails *details)
+{
+  if (details->has_entries)
+    return;
+
+  details->has_entries = TRUE;
+  if (details->variant != NULL)
+    {
+      GVariantIter iter;
+      const gchar *key;
+      const gchar *value;
+
+      g_variant_iter_init (&iter, details->variant);
+      while (g_variant_iter_next (&iter, "{&s&s}", &key, &value))
+        set_entry (details, key, value);
+    }
 }
 
 /**
@@ -129,10 +227,35 @@ polkit_details_lookup (PolkitDetails *details,
 {
   g_return_val_if_fail (POLKIT_IS_DETAILS (details), NULL);
   g_return_val_if_fail (key != NULL, NULL);
-  if (details->hash == NULL)
-    return NULL;
+
+  if (details->has_entries)
+    {
+      DetailsEntry *entry;
+
+      entry = find_entry (details, key);
+      return entry != NULL ? entry->value : NULL;
+    }
+  else if (details->variant != NULL)
+    {
+      GVariantIter iter;
+      const gchar *entry_key;
+      const gchar *entry_value;
+      const gchar *ret;
+
+      /* the strings point into @variant; the last one of a key wins */
+      ret = NULL;
+      g_variant_iter_init (&iter, details->variant);
+      while (g_variant_iter_next (&iter, "{&s&s}", &entry_key, &entry_value))
+        {
+          if (strcmp (entry_key, key) == 0)
+            ret = entry_value;
+        }
+      return ret;
+    }
   else
-    return g_hash_table_lookup (details->hash, key);
+    {
+      return NULL;
+    }
 }
 
 /**
@@ -152,15 +275,15 @@ polkit_details_insert (PolkitDetails *details,
 {
   g_return_if_fail (POLKIT_IS_DETAILS (details));
   g_return_if_fail (key != NULL);
-  if (details->hash == NULL)
-    details->hash = g_hash_table_new_full (g_str_hash,
-                                           g_str_equal,
-                                           g_free,
-                                           g_free);
-  if (value != NULL)
-    g_hash_table_insert (details->hash, g_strdup (key), g_strdup (value));
-  else
-    g_hash_table_remove (details->hash, key);
+
+  ensure_entries (details);
+  set_entry (details, key, value);
+
+  if (details->variant != NULL)
+    {
+      g_variant_unref (details->variant);
+      details->variant = NULL;
+    }
 }
 
 /**
@@ -176,60 +299,85 @@ polkit_details_insert (PolkitDetails *details,
 gchar **
 polkit_details_get_keys (PolkitDetails *details)
 {
-  GList *keys, *l;
   gchar **ret;
   guint n;
 
   g_return_val_if_fail (POLKIT_IS_DETAILS (details), NULL);
 
-  if (details->hash == NULL)
+  if (!details->has_entries && details->variant == NULL)
     return NULL;
 
-  keys = g_hash_table_get_keys (details->hash);
-  ret = g_new0 (gchar*, g_list_length (keys) + 1);
-  for (l = keys, n = 0; l != NULL; l = l->next, n++)
-    ret[n] = g_strdup (l->data);
+  /* duplicate keys are only dropped when copying */
+  ensure_entries (details);
+
+  if (details->n_entries == 0)
+    return NULL;
 
-  g_list_free (keys);
+  ret = g_new0 (gchar*, details->n_entries + 1);
+  for (n = 0; n < details->n_entries; n++)
+    ret[n] = g_strdup (details->entries[n].key);
 
   return ret;
 }
 
+/* Whether @details, which may be %NULL, has no entries at all */
+gboolean
+polkit_details_is_empty (PolkitDetails *details)
+{
+  if (details == NULL)
+    return TRUE;
+  if (details->has_entries)
+    return details->n_entries == 0;
+  if (details->variant != NULL)
+    return g_variant_n_children (details->variant) == 0;
+  return TRUE;
+}
+
 /* Note that this returns a floating value. */
 GVariant *
 polkit_details_to_gvariant (PolkitDetails *details)
 {
-  GVariantBuilder builder;
+  GVariant *variant;
 
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
-  if (details != NULL && details->hash != NULL)
-    {
-      GHashTableIter hash_iter;
-      const gchar *key;
-      const gchar *value;
+  if (details == NULL || (details->variant == NULL && details->n_entries == 0))
+    return g_variant_new_array (G_VARIANT_TYPE ("{ss}"), NULL, 0);
 
-      g_hash_table_iter_init (&hash_iter, details->hash);
-      while (g_hash_table_iter_next (&hash_iter, (gpointer) &key, (gpointer) &value))
-        g_variant_builder_add (&builder, "{ss}", key, value);
+  if (details->variant == NULL)
+    {
+      GVariant **children;
+      guint n;
+
+      children = g_new (GVariant *, details->n_entries);
+      for (n = 0; n < details->n_entries; n++)
+        children[n] = g_variant_new_dict_entry (g_variant_new_string (details->entries[n].key),
+                                                g_variant_new_string (details->entries[n].value));
+      details->variant = g_variant_ref_sink (g_variant_new_array (G_VARIANT_TYPE ("{ss}"),
+                                                                  children,
+                                                                  details->n_entries));
+      g_free (children);
     }
-  return g_variant_builder_end (&builder);
+
+  /* a new floating value sharing the serialised data, which stays
+   * valid for as long as @variant is referenced
+   */
+  variant = details->variant;
+  if (g_variant_get_size (variant) == 0)
+    return g_variant_new_array (G_VARIANT_TYPE ("{ss}"), NULL, 0);
+  return g_variant_new_from_data (G_VARIANT_TYPE ("a{ss}"),
+                                  g_variant_get_data (variant),
+                                  g_variant_get_size (variant),
+                                  FALSE,
+                                  (GDestroyNotify) g_variant_unref,
+                                  g_variant_ref (variant));
 }
 
 PolkitDetails *
 polkit_details_new_for_gvariant (GVariant *value)
 {
   PolkitDetails *ret;
-  GHashTable *hash;
-  GVariantIter iter;
-  gchar *hash_key;
-  gchar *hash_value;
-
-  hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-  g_variant_iter_init (&iter, value);
-  while (g_variant_iter_next (&iter, "{ss}", &hash_key, &hash_value))
-    g_hash_table_insert (hash, hash_key, hash_value);
-  ret = polkit_details_new_for_hash (hash);
-  g_hash_table_unref (hash);
+
+  ret = POLKIT_DETAILS (g_object_new (POLKIT_TYPE_DETAILS, NULL));
+  /* kept as it is, until something is inserted */
+  ret->variant = g_variant_ref_sink (value);
   return ret;
 }
-
@@ -40,6 +40,7 @@ static const GDBusErrorEntry polkit_error_entries[] =
   {POLKIT_ERROR_CANCELLED,      "org.freedesktop.PolicyKit1.Error.Cancelled"},
   {POLKIT_ERROR_NOT_SUPPORTED,  "org.freedesktop.PolicyKit1.Error.NotSupported"},
   {POLKIT_ERROR_NOT_AUTHORIZED, "org.freedesktop.PolicyKit1.Error.NotAuthorized"},
+  {POLKIT_ERROR_TOO_MANY_REQUESTS, "org.freedesktop.PolicyKit1.Error.TooManyRequests"},
 };
 
 GQuark
@@ -50,6 +51,6 @@ polkit_error_quark (void)
                                       &quark_volatile,
                                       polkit_error_entries,
                                       G_N_ELEMENTS (polkit_error_entries));
-  G_STATIC_ASSERT (G_N_ELEMENTS (polkit_error_entries) - 1 == POLKIT_ERROR_NOT_AUTHORIZED);
+  G_STATIC_ASSERT (G_N_ELEMENTS (polkit_error_entries) - 1 == POLKIT_ERROR_TOO_MANY_REQUESTS);
   return (GQuark) quark_volatile;
 }
@@ -46,6 +46,7 @@ GQuark polkit_error_quark (void);
  * @POLKIT_ERROR_CANCELLED: The operation was cancelled.
  * @POLKIT_ERROR_NOT_SUPPORTED: Operation is not supported.
  * @POLKIT_ERROR_NOT_AUTHORIZED: Not authorized to perform operation.
+ * @POLKIT_ERROR_TOO_MANY_REQUESTS: Too many requests are pending, try again later.
  *
  * Possible error when using PolicyKit.
  */
@@ -55,6 +56,7 @@ typedef enum
   POLKIT_ERROR_CANCELLED = 1,
   POLKIT_ERROR_NOT_SUPPORTED = 2,
   POLKIT_ERROR_NOT_AUTHORIZED = 3,
+  POLKIT_ERROR_TOO_MANY_REQUESTS = 4,
 } PolkitError;
 
 G_END_DECLS
@@ -42,8 +42,16 @@
  * #PolkitPermission is a #GPermission implementation. It can be used
  * with e.g. #GtkLockButton. See the #GPermission documentation for
  * more information.
+ *
+ * When the authority changes, all permissions sharing a subject are
+ * checked again with a single polkit_authority_check_authorizations()
+ * call. The calls are held back for a random moment, so that the
+ * processes of a session don't all hit the authority at once.
  */
 
+/* Longest time to hold back checking again after a change, in milliseconds */
+#define PERMISSION_RECHECK_JITTER_MS 1000
+
 typedef GPermissionClass PolkitPermissionClass;
 
 /**
@@ -74,8 +82,8 @@ enum
 static void process_result (PolkitPermission          *permission,
                             PolkitAuthorizationResult *result);
 
-static void on_authority_changed (PolkitAuthority *authority,
-                                  gpointer         user_data);
+static void permission_group_add    (PolkitPermission *permission);
+static void permission_group_remove (PolkitPermission *permission);
 
 static gboolean acquire        (GPermission          *permission,
                                 GCancellable         *cancellable,
@@ -106,6 +114,15 @@ static gboolean polkit_permission_initable_init (GInitable     *initable,
                                                  GCancellable  *cancellable,
                                                  GError       **error);
 
+static void     polkit_permission_init_async  (GAsyncInitable       *initable,
+                                               gint                  io_priority,
+                                               GCancellable         *cancellable,
+                                               GAsyncReadyCallback   callback,
+                                               gpointer              user_data);
+static gboolean polkit_permission_init_finish (GAsyncInitable       *initable,
+                                               GAsyncResult         *res,
+                                               GError              **error);
+
 G_DEFINE_TYPE_WITH_CODE (PolkitPermission, polkit_permission, G_TYPE_PERMISSION,
                          G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init)
                          G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE, async_initable_iface_init))
@@ -139,9 +156,7 @@ polkit_permission_finalize (GObject *object)
 
   if (permission->authority != NULL)
     {
-      g_signal_handlers_disconnect_by_func (permission->authority,
-                                            on_authority_changed,
-                                            permission);
+      permission_group_remove (permission);
       g_object_unref (permission->authority);
     }
 
@@ -360,10 +375,8 @@ initable_iface_init (GInitableIface *initable_iface)
 static void
 async_initable_iface_init (GAsyncInitableIface *async_initable_iface)
 {
-  /* for now, we use default implementation to run GInitable code in a
-   * thread - would probably be nice to have real async version to
-   * avoid the thread-overhead
-   */
+  async_initable_iface->init_async = polkit_permission_init_async;
+  async_initable_iface->init_finish = polkit_permission_init_finish;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -415,10 +428,7 @@ polkit_permission_initable_init (GInitable     *initable,
   if (permission->authority == NULL)
     goto out;
 
-  g_signal_connect (permission->authority,
-                    "changed",
-                    G_CALLBACK (on_authority_changed),
-                    permission);
+  permission_group_add (permission);
 
   result = polkit_authority_check_authorization_sync (permission->authority,
                                                       permission->subject,
@@ -441,23 +451,182 @@ polkit_permission_initable_init (GInitable     *initable,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* The asynchronous constructor goes through the authority's own
+ * asynchronous calls rather than running polkit_permission_initable_init()
+ * in a thread
+ */
+typedef struct
+{
+  PolkitPermission *permission;
+  GSimpleAsyncResult *simple;
+  GCancellable *cancellable;
+} InitData;
+
 static void
-changed_check_cb (GObject       *source_object,
-                  GAsyncResult  *res,
-                  gpointer       user_data)
+init_data_free (InitData *data)
 {
-  PolkitPermission *permission = POLKIT_PERMISSION (user_data);
+  g_object_unref (data->permission);
+  g_object_unref (data->simple);
+  if (data->cancellable != NULL)
+    g_object_unref (data->cancellable);
+  g_free (data);
+}
+
+static void
+init_check_cb (GObject      *source_object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+  InitData *data = user_data;
   PolkitAuthorizationResult *result;
   GError *error;
 
   error = NULL;
-  result = polkit_authority_check_authorization_finish (permission->authority,
+  result = polkit_authority_check_authorization_finish (data->permission->authority,
                                                         res,
                                                         &error);
-  if (result != NULL)
+  if (result == NULL)
     {
-      process_result (permission, result);
+      g_simple_async_result_take_error (data->simple, error);
+    }
+  else
+    {
+      process_result (data->permission, result);
       g_object_unref (result);
+      g_simple_async_result_set_op_res_gboolean (data->simple, TRUE);
+    }
+  g_simple_async_result_complete (data->simple);
+  init_data_free (data);
+}
+
+static void
+init_authority_cb (GObject      *source_object,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+  InitData *data = user_data;
+  GError *error;
+
+  error = NULL;
+  data->permission->authority = polkit_authority_get_finish (res, &error);
+  if (data->permission->authority == NULL)
+    {
+      g_simple_async_result_take_error (data->simple, error);
+      g_simple_async_result_complete (data->simple);
+      init_data_free (data);
+      return;
+    }
+
+  permission_group_add (data->permission);
+
+  polkit_authority_check_authorization (data->permission->authority,
+                                        data->permission->subject,
+                                        data->permission->action_id,
+                                        NULL, /* PolkitDetails */
+                                        POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE,
+                                        data->cancellable,
+                                        init_check_cb,
+                                        data);
+}
+
+static void
+polkit_permission_init_async (GAsyncInitable      *initable,
+                              gint                 io_priority,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
+{
+  InitData *data;
+
+  data = g_new0 (InitData, 1);
+  data->permission = g_object_ref (POLKIT_PERMISSION (initable));
+  data->simple = g_simple_async_result_new (G_OBJECT (initable),
+                                            callback,
+                                            user_data,
+                                            polkit_permission_init_async);
+  data->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+  polkit_authority_get_async (cancellable, init_authority_cb, data);
+}
+
+static gboolean
+polkit_permission_init_finish (GAsyncInitable  *initable,
+                               GAsyncResult    *res,
+                               GError         **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (res);
+
+  g_warn_if_fail (g_simple_async_result_get_source_tag (simple) == polkit_permission_init_async);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return FALSE;
+
+  return g_simple_async_result_get_op_res_gboolean (simple);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* All permissions of a process using the same authority, so they can
+ * share the work when it changes
+ */
+typedef struct
+{
+  PolkitAuthority *authority; /* not owned, every permission holds a ref */
+  GList *permissions;
+  gulong changed_id;
+  gulong actions_changed_id;
+  GSource *recheck_source;
+  /* what the pending recheck covers */
+  gboolean recheck_all;
+  GHashTable *recheck_actions;
+  /* the Changed signal that follows ActionsChanged is already accounted for */
+  gboolean skip_changed;
+} PermissionGroup;
+
+typedef struct
+{
+  /* in the same order as the actions checked */
+  GList *permissions;
+} RecheckData;
+
+G_LOCK_DEFINE_STATIC (permission_groups_lock);
+
+static GQuark
+permission_group_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (G_UNLIKELY (quark == 0))
+    quark = g_quark_from_static_string ("polkit-permission-group");
+  return quark;
+}
+
+static void
+recheck_data_free (RecheckData *data)
+{
+  g_list_free_full (data->permissions, g_object_unref);
+  g_free (data);
+}
+
+static void
+recheck_cb (GObject       *source_object,
+            GAsyncResult  *res,
+            gpointer       user_data)
+{
+  RecheckData *data = user_data;
+  GList *results;
+  GList *l;
+  GList *ll;
+  GError *error;
+
+  error = NULL;
+  results = polkit_authority_check_authorizations_finish (POLKIT_AUTHORITY (source_object),
+                                                          res,
+                                                          &error);
+  if (results != NULL)
+    {
+      for (l = data->permissions, ll = results; l != NULL && ll != NULL; l = l->next, ll = ll->next)
+        process_result (POLKIT_PERMISSION (l->data), POLKIT_AUTHORIZATION_RESULT (ll->data));
+      g_list_free_full (results, g_object_unref);
     }
   else
     {
@@ -465,29 +634,219 @@ changed_check_cb (GObject       *source_object,
        * details) so log to stderr if it happens
        */
       g_warning ("Error checking authorization for action id %s: %s",
-                 permission->action_id,
+                 POLKIT_PERMISSION (data->permissions->data)->action_id,
                  error->message);
       g_error_free (error);
     }
-  g_object_unref (permission);
+  recheck_data_free (data);
+}
+
+/* Checks every permission in @permissions again, one call per subject */
+static void
+recheck_permissions (PolkitAuthority *authority,
+                     GList           *permissions)
+{
+  while (permissions != NULL)
+    {
+      PolkitSubject *subject;
+      RecheckData *data;
+      GPtrArray *action_ids;
+      GList *rest;
+      GList *l;
+
+      subject = POLKIT_PERMISSION (permissions->data)->subject;
+      data = g_new0 (RecheckData, 1);
+      action_ids = g_ptr_array_new ();
+      rest = NULL;
+      for (l = permissions; l != NULL; l = l->next)
+        {
+          PolkitPermission *permission = POLKIT_PERMISSION (l->data);
+
+          if (polkit_subject_equal (permission->subject, subject))
+            {
+              data->permissions = g_list_prepend (data->permissions, permission);
+              g_ptr_array_add (action_ids, permission->action_id);
+            }
+          else
+            {
+              rest = g_list_prepend (rest, permission);
+            }
+        }
+      g_ptr_array_add (action_ids, NULL);
+      data->permissions = g_list_reverse (data->permissions);
+
+      polkit_authority_check_authorizations (authority,
+                                             subject,
+                                             (const gchar * const *) action_ids->pdata,
+                                             NULL, /* PolkitDetails */
+                                             POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE,
+                                             NULL /* cancellable */,
+                                             recheck_cb,
+                                             data);
+      g_ptr_array_free (action_ids, TRUE);
+
+      g_list_free (permissions);
+      permissions = g_list_reverse (rest);
+    }
+}
+
+static gboolean
+on_recheck_timeout (gpointer user_data)
+{
+  PolkitAuthority *authority = POLKIT_AUTHORITY (user_data);
+  PermissionGroup *group;
+  GList *permissions;
+
+  permissions = NULL;
+  G_LOCK (permission_groups_lock);
+  group = g_object_get_qdata (G_OBJECT (authority), permission_group_quark ());
+  /* the group may have gone away, or been started over, in the meantime */
+  if (group != NULL && group->recheck_source == g_main_current_source ())
+    {
+      GList *l;
+
+      g_source_unref (group->recheck_source);
+      group->recheck_source = NULL;
+      for (l = group->permissions; l != NULL; l = l->next)
+        {
+          PolkitPermission *permission = POLKIT_PERMISSION (l->data);
+
+          if (group->recheck_all || g_hash_table_contains (group->recheck_actions, permission->action_id))
+            permissions = g_list_prepend (permissions, g_object_ref (permission));
+        }
+      permissions = g_list_reverse (permissions);
+      group->recheck_all = FALSE;
+      g_hash_table_remove_all (group->recheck_actions);
+    }
+  G_UNLOCK (permission_groups_lock);
+
+  recheck_permissions (authority, permissions);
+
+  return FALSE;
+}
+
+/* must be called with permission_groups_lock held */
+static void
+permission_group_schedule_recheck (PermissionGroup *group,
+                                   PolkitAuthority *authority)
+{
+  if (group->recheck_source == NULL)
+    {
+      group->recheck_source = g_timeout_source_new (g_random_int_range (0, PERMISSION_RECHECK_JITTER_MS + 1));
+      g_source_set_callback (group->recheck_source,
+                             on_recheck_timeout,
+                             g_object_ref (authority),
+                             g_object_unref);
+      g_source_attach (group->recheck_source, g_main_context_get_thread_default ());
+    }
+}
+
+static void
+on_authority_actions_changed (PolkitAuthority     *authority,
+                              const gchar * const *action_ids,
+                              gpointer             user_data)
+{
+  PermissionGroup *group = user_data;
+  gboolean affected;
+  GList *l;
+  guint n;
+
+  G_LOCK (permission_groups_lock);
+  group->skip_changed = TRUE;
+  affected = FALSE;
+  for (l = group->permissions; l != NULL; l = l->next)
+    {
+      PolkitPermission *permission = POLKIT_PERMISSION (l->data);
+
+      for (n = 0; action_ids[n] != NULL; n++)
+        {
+          if (g_strcmp0 (action_ids[n], permission->action_id) == 0)
+            {
+              g_hash_table_add (group->recheck_actions, g_strdup (permission->action_id));
+              affected = TRUE;
+              break;
+            }
+        }
+    }
+  if (affected)
+    permission_group_schedule_recheck (group, authority);
+  G_UNLOCK (permission_groups_lock);
 }
 
 static void
 on_authority_changed (PolkitAuthority *authority,
                       gpointer         user_data)
 {
-  PolkitPermission *permission = POLKIT_PERMISSION (user_data);
+  PermissionGroup *group = user_data;
 
-  polkit_authority_check_authorization (permission->authority,
-                                        permission->subject,
-                                        permission->action_id,
-                                        NULL, /* PolkitDetails */
-                                        POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE,
-                                        NULL /* cancellable */,
-                                        changed_check_cb,
-                                        g_object_ref (permission));
+  G_LOCK (permission_groups_lock);
+  if (group->skip_changed)
+    {
+      group->skip_changed = FALSE;
+    }
+  else
+    {
+      group->recheck_all = TRUE;
+      permission_group_schedule_recheck (group, authority);
+    }
+  G_UNLOCK (permission_groups_lock);
 }
 
+static void
+permission_group_add (PolkitPermission *permission)
+{
+  PermissionGroup *group;
+
+  G_LOCK (permission_groups_lock);
+  group = g_object_get_qdata (G_OBJECT (permission->authority), permission_group_quark ());
+  if (group == NULL)
+    {
+      group = g_new0 (PermissionGroup, 1);
+      group->authority = permission->authority;
+      group->changed_id = g_signal_connect (permission->authority,
+                                            "changed",
+                                            G_CALLBACK (on_authority_changed),
+                                            group);
+      group->actions_changed_id = g_signal_connect (permission->authority,
+                                                    "actions-changed",
+                                                    G_CALLBACK (on_authority_actions_changed),
+                                                    group);
+      group->recheck_actions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+      g_object_set_qdata (G_OBJECT (permission->authority), permission_group_quark (), group);
+    }
+  group->permissions = g_list_prepend (group->permissions, permission);
+  G_UNLOCK (permission_groups_lock);
+}
+
+static void
+permission_group_remove (PolkitPermission *permission)
+{
+  PermissionGroup *group;
+
+  G_LOCK (permission_groups_lock);
+  group = g_object_get_qdata (G_OBJECT (permission->authority), permission_group_quark ());
+  if (group != NULL)
+    {
+      group->permissions = g_list_remove (group->permissions, permission);
+      if (group->permissions == NULL)
+        {
+          g_signal_handler_disconnect (group->authority, group->changed_id);
+          g_signal_handler_disconnect (group->authority, group->actions_changed_id);
+          if (group->recheck_source != NULL)
+            {
+              g_source_destroy (group->recheck_source);
+              g_source_unref (group->recheck_source);
+            }
+          g_object_set_qdata (G_OBJECT (permission->authority), permission_group_quark (), NULL);
+          g_hash_table_unref (group->recheck_actions);
+          g_free (group);
+        }
+    }
+  G_UNLOCK (permission_groups_lock);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 process_result (PolkitPermission          *permission,
                 PolkitAuthorizationResult *result)
@@ -24,6 +24,7 @@
 
 #include "polkitimplicitauthorization.h"
 #include "polkitactiondescription.h"
+#include "polkitactiondescriptionfields.h"
 #include "polkitsubject.h"
 #include "polkitauthorizationresult.h"
 #include "polkittemporaryauthorization.h"
@@ -40,11 +41,17 @@
 
 PolkitActionDescription  *polkit_action_description_new_for_gvariant (GVariant *value);
 GVariant *polkit_action_description_to_gvariant (PolkitActionDescription *action_description);
+GVariant *polkit_action_description_to_gvariant_with_fields (PolkitActionDescription       *action_description,
+                                                             PolkitActionDescriptionFields  fields);
 
 GVariant *polkit_subject_to_gvariant (PolkitSubject *subject);
 GVariant *polkit_identity_to_gvariant (PolkitIdentity *identity);
 
 gint polkit_unix_process_get_racy_uid__ (PolkitUnixProcess *process, GError **error);
+void polkit_unix_process_enable_start_time_cache (void);
+
+PolkitIdentity *polkit_unix_user_new_shared  (gint uid);
+PolkitIdentity *polkit_unix_group_new_shared (gint gid);
 
 PolkitSubject  *polkit_subject_new_for_gvariant (GVariant *variant, GError **error);
 PolkitIdentity *polkit_identity_new_for_gvariant (GVariant *variant, GError **error);
@@ -62,6 +69,7 @@ PolkitTemporaryAuthorization *polkit_temporary_authorization_new_for_gvariant (G
 GVariant *polkit_temporary_authorization_to_gvariant (PolkitTemporaryAuthorization *authorization);
 
 GVariant *polkit_details_to_gvariant (PolkitDetails *details);
+gboolean polkit_details_is_empty (PolkitDetails *details);
 PolkitDetails *polkit_details_new_for_gvariant (GVariant *value);
 
 PolkitActionDescription *
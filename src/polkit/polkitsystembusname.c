@@ -30,6 +30,7 @@
 #include "polkitprivate.h"
 
 #include "polkitunixprocess.h"
+#include "polkiterror.h"
 
 /**
  * SECTION:polkitsystembusname
@@ -270,41 +271,102 @@ polkit_system_bus_name_exists_sync (PolkitSubject   *subject,
   return ret;
 }
 
+typedef struct
+{
+  GSimpleAsyncResult *simple;
+  GCancellable *cancellable;
+  gchar *name;
+} ExistsData;
+
+static void
+exists_data_free (ExistsData *data)
+{
+  g_object_unref (data->simple);
+  if (data->cancellable != NULL)
+    g_object_unref (data->cancellable);
+  g_free (data->name);
+  g_free (data);
+}
+
+static void
+exists_name_has_owner_cb (GObject      *source_object,
+                          GAsyncResult *res,
+                          gpointer      user_data)
+{
+  ExistsData *data = user_data;
+  GVariant *result;
+  GError *error;
+  gboolean has_owner;
+
+  error = NULL;
+  result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+  if (result == NULL)
+    {
+      g_simple_async_result_take_error (data->simple, error);
+    }
+  else
+    {
+      g_variant_get (result, "(b)", &has_owner);
+      g_simple_async_result_set_op_res_gboolean (data->simple, has_owner);
+      g_variant_unref (result);
+    }
+  g_simple_async_result_complete (data->simple);
+  exists_data_free (data);
+}
+
 static void
-exists_in_thread_func (GSimpleAsyncResult *res,
-                       GObject            *object,
-                       GCancellable       *cancellable)
+exists_bus_get_cb (GObject      *source_object,
+                   GAsyncResult *res,
+                   gpointer      user_data)
 {
+  ExistsData *data = user_data;
+  GDBusConnection *connection;
   GError *error;
+
   error = NULL;
-  if (!polkit_system_bus_name_exists_sync (POLKIT_SUBJECT (object),
-                                           cancellable,
-                                           &error))
+  connection = g_bus_get_finish (res, &error);
+  if (connection == NULL)
     {
-      g_simple_async_result_set_from_error (res, error);
-      g_error_free (error);
+      g_simple_async_result_take_error (data->simple, error);
+      g_simple_async_result_complete (data->simple);
+      exists_data_free (data);
+      return;
     }
+
+  g_dbus_connection_call (connection,
+                          "org.freedesktop.DBus",   /* name */
+                          "/org/freedesktop/DBus",  /* object path */
+                          "org.freedesktop.DBus",   /* interface name */
+                          "NameHasOwner",           /* method */
+                          g_variant_new ("(s)", data->name),
+                          G_VARIANT_TYPE ("(b)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          data->cancellable,
+                          exists_name_has_owner_cb,
+                          data);
+  g_object_unref (connection);
 }
 
+/* Asks the bus right away instead of blocking a thread on it */
 static void
 polkit_system_bus_name_exists (PolkitSubject       *subject,
                                GCancellable        *cancellable,
                                GAsyncReadyCallback  callback,
                                gpointer             user_data)
 {
-  GSimpleAsyncResult *simple;
+  ExistsData *data;
 
   g_return_if_fail (POLKIT_IS_SYSTEM_BUS_NAME (subject));
 
-  simple = g_simple_async_result_new (G_OBJECT (subject),
-                                      callback,
-                                      user_data,
-                                      polkit_system_bus_name_exists);
-  g_simple_async_result_run_in_thread (simple,
-                                       exists_in_thread_func,
-                                       G_PRIORITY_DEFAULT,
-                                       cancellable);
-  g_object_unref (simple);
+  data = g_new0 (ExistsData, 1);
+  data->simple = g_simple_async_result_new (G_OBJECT (subject),
+                                            callback,
+                                            user_data,
+                                            polkit_system_bus_name_exists);
+  data->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+  data->name = g_strdup (POLKIT_SYSTEM_BUS_NAME (subject)->name);
+  g_bus_get (G_BUS_TYPE_SYSTEM, cancellable, exists_bus_get_cb, data);
 }
 
 static gboolean
@@ -341,49 +403,6 @@ subject_iface_init (PolkitSubjectIface *subject_iface)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-typedef struct {
-  GError **error;
-  guint retrieved_uid : 1;
-  guint retrieved_pid : 1;
-  guint caught_error : 1;
-
-  guint32 uid;
-  guint32 pid;
-} AsyncGetBusNameCredsData;
-
-static void
-on_retrieved_unix_uid_pid (GObject              *src,
-			   GAsyncResult         *res,
-			   gpointer              user_data)
-{
-  AsyncGetBusNameCredsData *data = user_data;
-  GVariant *v;
-
-  v = g_dbus_connection_call_finish ((GDBusConnection*)src, res,
-				     data->caught_error ? NULL : data->error);
-  if (!v)
-    {
-      data->caught_error = TRUE;
-    }
-  else
-    {
-      guint32 value;
-      g_variant_get (v, "(u)", &value);
-      g_variant_unref (v);
-      if (!data->retrieved_uid)
-	{
-	  data->retrieved_uid = TRUE;
-	  data->uid = value;
-	}
-      else
-	{
-	  g_assert (!data->retrieved_pid);
-	  data->retrieved_pid = TRUE;
-	  data->pid = value;
-	}
-    }
-}
-
 static gboolean
 polkit_system_bus_name_get_creds_sync (PolkitSystemBusName           *system_bus_name,
 				       guint32                       *out_uid,
@@ -392,63 +411,53 @@ polkit_system_bus_name_get_creds_sync (PolkitSystemBusName           *system_bus
 				       GError                       **error)
 {
   gboolean ret = FALSE;
-  AsyncGetBusNameCredsData data = { 0, };
   GDBusConnection *connection = NULL;
-  GMainContext *tmp_context = NULL;
+  GVariant *result = NULL;
+  GVariant *creds = NULL;
+  guint32 uid;
+  guint32 pid;
 
   connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, cancellable, error);
   if (connection == NULL)
     goto out;
 
-  data.error = error;
-
-  tmp_context = g_main_context_new ();
-  g_main_context_push_thread_default (tmp_context);
-
-  /* Do two async calls as it's basically as fast as one sync call.
-   */
-  g_dbus_connection_call (connection,
-			  "org.freedesktop.DBus",       /* name */
-			  "/org/freedesktop/DBus",      /* object path */
-			  "org.freedesktop.DBus",       /* interface name */
-			  "GetConnectionUnixUser",      /* method */
-			  g_variant_new ("(s)", system_bus_name->name),
-			  G_VARIANT_TYPE ("(u)"),
-			  G_DBUS_CALL_FLAGS_NONE,
-			  -1,
-			  cancellable,
-			  on_retrieved_unix_uid_pid,
-			  &data);
-  g_dbus_connection_call (connection,
-			  "org.freedesktop.DBus",       /* name */
-			  "/org/freedesktop/DBus",      /* object path */
-			  "org.freedesktop.DBus",       /* interface name */
-			  "GetConnectionUnixProcessID", /* method */
-			  g_variant_new ("(s)", system_bus_name->name),
-			  G_VARIANT_TYPE ("(u)"),
-			  G_DBUS_CALL_FLAGS_NONE,
-			  -1,
-			  cancellable,
-			  on_retrieved_unix_uid_pid,
-			  &data);
-
-  while (!((data.retrieved_uid && data.retrieved_pid) || data.caught_error))
-    g_main_context_iteration (tmp_context, TRUE);
-
-  if (data.caught_error)
+  /* Both the uid and the pid in a single round trip */
+  result = g_dbus_connection_call_sync (connection,
+					"org.freedesktop.DBus",       /* name */
+					"/org/freedesktop/DBus",      /* object path */
+					"org.freedesktop.DBus",       /* interface name */
+					"GetConnectionCredentials",   /* method */
+					g_variant_new ("(s)", system_bus_name->name),
+					G_VARIANT_TYPE ("(a{sv})"),
+					G_DBUS_CALL_FLAGS_NONE,
+					-1,
+					cancellable,
+					error);
+  if (result == NULL)
     goto out;
 
+  creds = g_variant_get_child_value (result, 0);
+  if (!g_variant_lookup (creds, "UnixUserID", "u", &uid) ||
+      !g_variant_lookup (creds, "ProcessID", "u", &pid))
+    {
+      g_set_error (error,
+		   POLKIT_ERROR,
+		   POLKIT_ERROR_FAILED,
+		   "The bus didn't report the user and process of %s",
+		   system_bus_name->name);
+      goto out;
+    }
+
   if (out_uid)
-    *out_uid = data.uid;
+    *out_uid = uid;
   if (out_pid)
-    *out_pid = data.pid;
+    *out_pid = pid;
   ret = TRUE;
  out:
-  if (tmp_context)
-    {
-      g_main_context_pop_thread_default (tmp_context);
-      g_main_context_unref (tmp_context);
-    }
+  if (creds != NULL)
+    g_variant_unref (creds);
+  if (result != NULL)
+    g_variant_unref (result);
   if (connection != NULL)
     g_object_unref (connection);
   return ret;
@@ -195,6 +195,88 @@ polkit_unix_group_new (gint gid)
                                        NULL));
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* gid -> GWeakRef on the shared #PolkitUnixGroup */
+static GHashTable *shared_groups = NULL;
+G_LOCK_DEFINE_STATIC (shared_groups);
+
+static void
+shared_group_ref_free (GWeakRef *ref)
+{
+  g_weak_ref_clear (ref);
+  g_free (ref);
+}
+
+static void
+on_shared_group_finalized (gpointer  data,
+                          GObject  *where_the_object_was)
+{
+  GWeakRef *ref;
+  GObject *replacement;
+
+  replacement = NULL;
+
+  G_LOCK (shared_groups);
+  ref = g_hash_table_lookup (shared_groups, data);
+  if (ref != NULL)
+    {
+      /* another instance may have taken its place in the meantime */
+      replacement = g_weak_ref_get (ref);
+      if (replacement == NULL)
+        g_hash_table_remove (shared_groups, data);
+    }
+  G_UNLOCK (shared_groups);
+
+  if (replacement != NULL)
+    g_object_unref (replacement);
+}
+
+/*
+ * Private: Gets the one #PolkitUnixGroup for @gid that everybody
+ * asking for it shares, creating it if there is none right now. It is
+ * forgotten again once the last reference to it is dropped.
+ *
+ * This is meant for the authority, which would otherwise create and
+ * throw away identities for the same few groups on every check, and lets
+ * polkit_identity_equal() get away with comparing pointers. The
+ * returned object must not be changed.
+ */
+PolkitIdentity *
+polkit_unix_group_new_shared (gint gid)
+{
+  PolkitIdentity *group;
+  GWeakRef *ref;
+
+  g_return_val_if_fail (gid != -1, NULL);
+
+  G_LOCK (shared_groups);
+  if (shared_groups == NULL)
+    shared_groups = g_hash_table_new_full (g_direct_hash,
+                                          g_direct_equal,
+                                          NULL,
+                                          (GDestroyNotify) shared_group_ref_free);
+
+  ref = g_hash_table_lookup (shared_groups, GINT_TO_POINTER (gid));
+  group = ref != NULL ? g_weak_ref_get (ref) : NULL;
+  if (group == NULL)
+    {
+      group = polkit_unix_group_new (gid);
+      if (ref == NULL)
+        {
+          ref = g_new0 (GWeakRef, 1);
+          g_hash_table_insert (shared_groups, GINT_TO_POINTER (gid), ref);
+        }
+      g_weak_ref_set (ref, group);
+      g_object_weak_ref (G_OBJECT (group), on_shared_group_finalized, GINT_TO_POINTER (gid));
+    }
+  G_UNLOCK (shared_groups);
+
+  return group;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 /**
  * polkit_unix_group_new_for_name:
  * @name: A UNIX group name.
@@ -256,6 +338,10 @@ polkit_unix_group_equal (PolkitIdentity *a,
   group_a = POLKIT_UNIX_GROUP (a);
   group_b = POLKIT_UNIX_GROUP (b);
 
+  /* shared instances are the only ones for their id */
+  if (group_a == group_b)
+    return TRUE;
+
   return group_a->gid == group_b->gid;
 }
 
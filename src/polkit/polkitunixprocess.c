@@ -36,6 +36,12 @@
 #ifdef HAVE_OPENBSD
 #include <sys/sysctl.h>
 #endif
+#if !defined(HAVE_FREEBSD) && !defined(HAVE_NETBSD) && !defined(HAVE_OPENBSD)
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -167,6 +173,18 @@ static void subject_iface_init (PolkitSubjectIface *subject_iface);
 static guint64 get_start_time_for_pid (gint    pid,
                                        GError **error);
 
+static gboolean get_proc_info_for_pid (gint      pid,
+                                       guint64  *out_start_time,
+                                       gint     *out_uid,
+                                       GError  **error);
+
+static gboolean start_time_cache_lookup (gint     pid,
+                                         guint64 *out_start_time);
+static gint     start_time_cache_open   (gint     pid);
+static void     start_time_cache_store  (gint     pid,
+                                         gint     pidfd,
+                                         guint64  start_time);
+
 #if defined(HAVE_FREEBSD) || defined(HAVE_NETBSD) || defined(HAVE_OPENBSD)
 static gboolean get_kinfo_proc (gint pid,
 #if defined(HAVE_NETBSD)
@@ -249,6 +267,25 @@ polkit_unix_process_constructed (GObject *object)
 
   /* sets start_time and uid in case they are unset */
 
+  if (process->start_time == 0 && process->uid == -1 &&
+      !start_time_cache_lookup (process->pid, &process->start_time))
+    {
+      gint pidfd;
+
+      /* both at once, so they are known to be of the same process */
+      pidfd = start_time_cache_open (process->pid);
+      if (get_proc_info_for_pid (process->pid, &process->start_time, &process->uid, NULL))
+        {
+          start_time_cache_store (process->pid, pidfd, process->start_time);
+        }
+      else
+        {
+          start_time_cache_store (process->pid, pidfd, 0);
+          process->start_time = 0;
+          process->uid = -1;
+        }
+    }
+
   if (process->start_time == 0)
     process->start_time = get_start_time_for_pid (process->pid, NULL);
 
@@ -678,83 +715,198 @@ get_kinfo_proc (gint pid,
 }
 #endif
 
-static guint64
-get_start_time_for_pid (pid_t    pid,
-                        GError **error)
-{
-  guint64 start_time;
 #if !defined(HAVE_FREEBSD) && !defined(HAVE_NETBSD) && !defined(HAVE_OPENBSD)
-  gchar *filename;
-  gchar *contents;
-  size_t length;
-  gchar **tokens;
-  guint num_tokens;
-  gchar *p;
-  gchar *endp;
+/* Reads the start of @name in the /proc directory @dir_fd of @pid into
+ * @buf, which is always nul-terminated */
+static gboolean
+read_proc_file (gint          dir_fd,
+                pid_t         pid,
+                const gchar  *name,
+                gchar        *buf,
+                gsize         size,
+                GError      **error)
+{
+  gint fd;
+  gsize length;
+  gssize n;
+
+  fd = openat (dir_fd, name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    {
+      g_set_error (error,
+                   G_FILE_ERROR,
+                   g_file_error_from_errno (errno),
+                   "Failed to open file /proc/%d/%s: %s",
+                   (gint) pid,
+                   name,
+                   g_strerror (errno));
+      return FALSE;
+    }
 
-  start_time = 0;
-  contents = NULL;
+  length = 0;
+  while (length < size - 1)
+    {
+      n = read (fd, buf + length, size - 1 - length);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        {
+          g_set_error (error,
+                       G_FILE_ERROR,
+                       g_file_error_from_errno (errno),
+                       "Failed to read from file /proc/%d/%s: %s",
+                       (gint) pid,
+                       name,
+                       g_strerror (errno));
+          close (fd);
+          return FALSE;
+        }
+      if (n == 0)
+        break;
+      length += n;
+    }
+  buf[length] = '\0';
 
-  filename = g_strdup_printf ("/proc/%d/stat", pid);
+  close (fd);
+  return TRUE;
+}
 
-  if (!g_file_get_contents (filename, &contents, &length, error))
-    goto out;
+static gboolean
+parse_start_time (pid_t        pid,
+                  const gchar *stat,
+                  guint64     *out_start_time,
+                  GError     **error)
+{
+  const gchar *p;
+  gchar *endp;
+  guint n;
 
   /* start time is the token at index 19 after the '(process name)' entry - since only this
    * field can contain the ')' character, search backwards for this to avoid malicious
    * processes trying to fool us
    */
-  p = strrchr (contents, ')');
-  if (p == NULL)
-    {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Error parsing file %s",
-                   filename);
-      goto out;
-    }
+  p = strrchr (stat, ')');
+  if (p == NULL || p[1] != ' ')
+    goto fail;
   p += 2; /* skip ') ' */
-  if (p - contents >= (int) length)
+
+  for (n = 0; n < 19; n++)
     {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Error parsing file %s",
-                   filename);
-      goto out;
+      p = strchr (p, ' ');
+      if (p == NULL)
+        goto fail;
+      p++;
     }
 
-  tokens = g_strsplit (p, " ", 0);
+  *out_start_time = g_ascii_strtoull (p, &endp, 10);
+  if (endp == p)
+    goto fail;
 
-  num_tokens = g_strv_length (tokens);
+  return TRUE;
 
-  if (num_tokens < 20)
+ fail:
+  g_set_error (error,
+               POLKIT_ERROR,
+               POLKIT_ERROR_FAILED,
+               "Error parsing file /proc/%d/stat",
+               (gint) pid);
+  return FALSE;
+}
+
+static gboolean
+parse_uid (pid_t        pid,
+           const gchar *status,
+           gint        *out_uid,
+           GError     **error)
+{
+  const gchar *line;
+  gint real_uid, effective_uid;
+
+  /* see 'man proc' for layout of the status file
+   *
+   * Uid, Gid: Real, effective, saved set,  and  file  system  UIDs (GIDs).
+   */
+  line = strstr (status, "\nUid:");
+  if (line == NULL)
     {
       g_set_error (error,
                    POLKIT_ERROR,
                    POLKIT_ERROR_FAILED,
-                   "Error parsing file %s",
-                   filename);
-      goto out;
+                   "Didn't find any line starting with `Uid:' in file /proc/%d/status",
+                   (gint) pid);
+      return FALSE;
     }
+  line++;
 
-  start_time = strtoull (tokens[19], &endp, 10);
-  if (endp == tokens[19])
+  if (sscanf (line + 4, "%d %d", &real_uid, &effective_uid) != 2)
     {
       g_set_error (error,
                    POLKIT_ERROR,
                    POLKIT_ERROR_FAILED,
-                   "Error parsing file %s",
-                   filename);
-      goto out;
+                   "Unexpected line `%.*s' in file /proc/%d/status",
+                   (gint) strcspn (line, "\n"),
+                   line,
+                   (gint) pid);
+      return FALSE;
     }
 
-  g_strfreev (tokens);
+  *out_uid = real_uid;
+  return TRUE;
+}
+#endif
+
+/* Gets the start time of @pid and, unless @out_uid is %NULL, its uid in
+ * one go, so that both are known to belong to the same process.
+ *
+ * On Linux both files are opened through a single handle on
+ * /proc/<pid>, which stops working once the process is gone rather than
+ * referring to whatever reuses the pid. Only the beginning of each file
+ * is read, into buffers on the stack.
+ */
+static gboolean
+get_proc_info_for_pid (pid_t     pid,
+                       guint64  *out_start_time,
+                       gint     *out_uid,
+                       GError  **error)
+{
+#if !defined(HAVE_FREEBSD) && !defined(HAVE_NETBSD) && !defined(HAVE_OPENBSD)
+  gchar dirname[32];
+  /* the process name is at most 16 bytes, and the start time comes early */
+  gchar stat[512];
+  /* Uid: follows a handful of short lines */
+  gchar status[1024];
+  gint dir_fd;
+  gboolean ret;
+
+  ret = FALSE;
+
+  g_snprintf (dirname, sizeof dirname, "/proc/%d", (gint) pid);
+  dir_fd = open (dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0)
+    {
+      g_set_error (error,
+                   G_FILE_ERROR,
+                   g_file_error_from_errno (errno),
+                   "Failed to open directory %s: %s",
+                   dirname,
+                   g_strerror (errno));
+      return FALSE;
+    }
+
+  if (!read_proc_file (dir_fd, pid, "stat", stat, sizeof stat, error) ||
+      !parse_start_time (pid, stat, out_start_time, error))
+    goto out;
+
+  if (out_uid != NULL &&
+      (!read_proc_file (dir_fd, pid, "status", status, sizeof status, error) ||
+       !parse_uid (pid, status, out_uid, error)))
+    goto out;
+
+  ret = TRUE;
 
  out:
-  g_free (filename);
-  g_free (contents);
+  close (dir_fd);
+  return ret;
 #else
 #ifdef HAVE_NETBSD
   struct kinfo_proc2 p;
@@ -762,8 +914,6 @@ get_start_time_for_pid (pid_t    pid,
   struct kinfo_proc p;
 #endif
 
-  start_time = 0;
-
   if (! get_kinfo_proc (pid, &p))
     {
       g_set_error (error,
@@ -772,138 +922,269 @@ get_start_time_for_pid (pid_t    pid,
                    "Error obtaining start time for %d (%s)",
                    (gint) pid,
                    g_strerror (errno));
-      goto out;
+      return FALSE;
     }
 
 #ifdef HAVE_FREEBSD
-  start_time = (guint64) p.ki_start.tv_sec;
+  *out_start_time = (guint64) p.ki_start.tv_sec;
+  if (out_uid != NULL)
+    *out_uid = p.ki_uid;
 #else
-  start_time = (guint64) p.p_ustart_sec;
+  *out_start_time = (guint64) p.p_ustart_sec;
+  if (out_uid != NULL)
+    *out_uid = p.p_uid;
 #endif
 
-out:
+  return TRUE;
 #endif
+}
+
+static guint64
+get_start_time_for_pid (pid_t    pid,
+                        GError **error)
+{
+  guint64 start_time;
+  gint pidfd;
+
+  if (start_time_cache_lookup (pid, &start_time))
+    return start_time;
+
+  pidfd = start_time_cache_open (pid);
+  if (!get_proc_info_for_pid (pid, &start_time, NULL, error))
+    start_time = 0;
+  start_time_cache_store (pid, pidfd, start_time);
 
   return start_time;
 }
 
-/*
- * Private: Return the "current" UID.  Note that this is inherently racy,
- * and the value may already be obsolete by the time this function returns;
- * this function only guarantees that the UID was valid at some point during
- * its execution.
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Most entries the start time cache holds. Every entry keeps a pidfd
+ * open, so this stays far below the default limit of 1024 open files.
  */
-gint
-polkit_unix_process_get_racy_uid__ (PolkitUnixProcess  *process,
-                                    GError            **error)
+#define START_TIME_CACHE_SIZE 64
+
+typedef struct
 {
-  gint result;
-  gchar *contents;
-  gchar **lines;
+  gint pidfd;
   guint64 start_time;
-#if defined(HAVE_FREEBSD) || defined(HAVE_OPENBSD)
-  struct kinfo_proc p;
-#elif defined(HAVE_NETBSD)
-  struct kinfo_proc2 p;
+  guint64 last_used;
+} StartTimeEntry;
+
+/* pid -> StartTimeEntry, NULL unless enabled */
+static GHashTable *start_time_cache = NULL;
+/* bumped on every use of an entry, to find the least recently used one */
+static guint64 start_time_cache_clock = 0;
+G_LOCK_DEFINE_STATIC (start_time_cache);
+
+static void
+start_time_entry_free (StartTimeEntry *entry)
+{
+#if !defined(HAVE_FREEBSD) && !defined(HAVE_NETBSD) && !defined(HAVE_OPENBSD)
+  close (entry->pidfd);
+#endif
+  g_free (entry);
+}
+
+/* A pidfd becomes readable once its process has exited */
+static gboolean
+start_time_cache_pidfd_is_alive (gint pidfd)
+{
+#if !defined(HAVE_FREEBSD) && !defined(HAVE_NETBSD) && !defined(HAVE_OPENBSD)
+  struct pollfd pollfd;
+
+  pollfd.fd = pidfd;
+  pollfd.events = POLLIN;
+  pollfd.revents = 0;
+  return poll (&pollfd, 1, 0) == 0;
 #else
-  gchar filename[64];
-  guint n;
-  GError *local_error;
+  return FALSE;
 #endif
+}
 
-  g_return_val_if_fail (POLKIT_IS_UNIX_PROCESS (process), 0);
-  g_return_val_if_fail (error == NULL || *error == NULL, 0);
+/*
+ * Private: Makes the start times of processes looked up from now on be
+ * remembered for as long as the process is alive, for the most recently
+ * used few of them. Every remembered process is held on to through a
+ * pidfd, which tells whether its pid still refers to it without reading
+ * it again.
+ *
+ * This is meant for the authority, which looks at the same few
+ * processes over and over. It does nothing on systems without
+ * pidfds.
+ */
+void
+polkit_unix_process_enable_start_time_cache (void)
+{
+#ifdef SYS_pidfd_open
+  G_LOCK (start_time_cache);
+  if (start_time_cache == NULL)
+    start_time_cache = g_hash_table_new_full (g_direct_hash,
+                                              g_direct_equal,
+                                              NULL,
+                                              (GDestroyNotify) start_time_entry_free);
+  G_UNLOCK (start_time_cache);
+#endif
+}
 
-  result = 0;
-  lines = NULL;
-  contents = NULL;
+static gboolean
+start_time_cache_lookup (gint     pid,
+                         guint64 *out_start_time)
+{
+  StartTimeEntry *entry;
+  gboolean ret;
 
-#if defined(HAVE_FREEBSD) || defined(HAVE_NETBSD) || defined(HAVE_OPENBSD)
-  if (get_kinfo_proc (process->pid, &p) == 0)
+  ret = FALSE;
+
+  G_LOCK (start_time_cache);
+  if (start_time_cache == NULL)
+    goto out;
+
+  entry = g_hash_table_lookup (start_time_cache, GINT_TO_POINTER (pid));
+  if (entry == NULL)
+    goto out;
+
+  if (!start_time_cache_pidfd_is_alive (entry->pidfd))
     {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "get_kinfo_proc() failed for pid %d: %s",
-                   process->pid,
-                   g_strerror (errno));
+      /* whatever has the pid now is another process */
+      g_hash_table_remove (start_time_cache, GINT_TO_POINTER (pid));
       goto out;
     }
 
-#if defined(HAVE_FREEBSD)
-  result = p.ki_uid;
-  start_time = (guint64) p.ki_start.tv_sec;
-#else
-  result = p.p_uid;
-  start_time = (guint64) p.p_ustart_sec;
+  *out_start_time = entry->start_time;
+  entry->last_used = ++start_time_cache_clock;
+  ret = TRUE;
+
+ out:
+  G_UNLOCK (start_time_cache);
+  return ret;
+}
+
+/* Opens a pidfd for @pid before its start time is read, or returns -1
+ * if there is nowhere to remember it
+ */
+static gint
+start_time_cache_open (gint pid)
+{
+  gint pidfd;
+
+  pidfd = -1;
+#ifdef SYS_pidfd_open
+  G_LOCK (start_time_cache);
+  if (start_time_cache != NULL)
+    pidfd = syscall (SYS_pidfd_open, pid, 0);
+  G_UNLOCK (start_time_cache);
 #endif
-#else
+  return pidfd;
+}
 
-  /* see 'man proc' for layout of the status file
-   *
-   * Uid, Gid: Real, effective, saved set,  and  file  system  UIDs (GIDs).
-   */
-  g_snprintf (filename, sizeof filename, "/proc/%d/status", process->pid);
-  if (!g_file_get_contents (filename,
-                            &contents,
-                            NULL,
-                            error))
-    {
-      goto out;
-    }
-  lines = g_strsplit (contents, "\n", -1);
-  for (n = 0; lines != NULL && lines[n] != NULL; n++)
+static gboolean
+start_time_cache_entry_is_dead (gpointer key,
+                                gpointer value,
+                                gpointer user_data)
+{
+  StartTimeEntry *entry = value;
+
+  return !start_time_cache_pidfd_is_alive (entry->pidfd);
+}
+
+/* Makes room for one more entry: processes that exited are dropped
+ * first, and only if all of them are still alive is the least recently
+ * used one dropped. Must be called with the lock held.
+ */
+static void
+start_time_cache_make_room (void)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  gpointer oldest_key;
+  guint64 oldest;
+
+  if (g_hash_table_size (start_time_cache) < START_TIME_CACHE_SIZE)
+    return;
+
+  g_hash_table_foreach_remove (start_time_cache, start_time_cache_entry_is_dead, NULL);
+  if (g_hash_table_size (start_time_cache) < START_TIME_CACHE_SIZE)
+    return;
+
+  oldest_key = NULL;
+  oldest = G_MAXUINT64;
+  g_hash_table_iter_init (&iter, start_time_cache);
+  while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      gint real_uid, effective_uid;
-      if (!g_str_has_prefix (lines[n], "Uid:"))
-        continue;
-      if (sscanf (lines[n] + 4, "%d %d", &real_uid, &effective_uid) != 2)
-        {
-          g_set_error (error,
-                       POLKIT_ERROR,
-                       POLKIT_ERROR_FAILED,
-                       "Unexpected line `%s' in file %s",
-                       lines[n],
-                       filename);
-          goto out;
-        }
-      else
+      StartTimeEntry *entry = value;
+
+      if (entry->last_used < oldest)
         {
-          result = real_uid;
-          goto found;
+          oldest = entry->last_used;
+          oldest_key = key;
         }
     }
-  g_set_error (error,
-               POLKIT_ERROR,
-               POLKIT_ERROR_FAILED,
-               "Didn't find any line starting with `Uid:' in file %s",
-               filename);
-  goto out;
-
-found:
-  /* The UID and start time are, sadly, not available in a single file.  So,
-   * read the UID first, and then the start time; if the start time is the same
-   * before and after reading the UID, it couldn't have changed.
-   */
-  local_error = NULL;
-  start_time = get_start_time_for_pid (process->pid, &local_error);
-  if (local_error != NULL)
+  g_hash_table_remove (start_time_cache, oldest_key);
+}
+
+/* Remembers @start_time for @pid, taking over @pidfd. It is only kept
+ * if the process behind @pidfd is still alive after the start time was
+ * read, as only then was it the one the start time was read from.
+ */
+static void
+start_time_cache_store (gint    pid,
+                        gint    pidfd,
+                        guint64 start_time)
+{
+  StartTimeEntry *entry;
+
+  if (pidfd < 0)
+    return;
+
+  if (start_time == 0 || !start_time_cache_pidfd_is_alive (pidfd))
     {
-      g_propagate_error (error, local_error);
-      goto out;
-    }
+#if !defined(HAVE_FREEBSD) && !defined(HAVE_NETBSD) && !defined(HAVE_OPENBSD)
+      close (pidfd);
 #endif
+      return;
+    }
+
+  entry = g_new0 (StartTimeEntry, 1);
+  entry->pidfd = pidfd;
+  entry->start_time = start_time;
+
+  G_LOCK (start_time_cache);
+  /* replacing the entry of @pid needs no room */
+  if (!g_hash_table_contains (start_time_cache, GINT_TO_POINTER (pid)))
+    start_time_cache_make_room ();
+  entry->last_used = ++start_time_cache_clock;
+  g_hash_table_insert (start_time_cache, GINT_TO_POINTER (pid), entry);
+  G_UNLOCK (start_time_cache);
+}
+
+/*
+ * Private: Return the "current" UID.  Note that this is inherently racy,
+ * and the value may already be obsolete by the time this function returns;
+ * this function only guarantees that the UID was valid at some point during
+ * its execution.
+ */
+gint
+polkit_unix_process_get_racy_uid__ (PolkitUnixProcess  *process,
+                                    GError            **error)
+{
+  gint result;
+  guint64 start_time;
+
+  g_return_val_if_fail (POLKIT_IS_UNIX_PROCESS (process), 0);
+  g_return_val_if_fail (error == NULL || *error == NULL, 0);
+
+  if (!get_proc_info_for_pid (process->pid, &start_time, &result, error))
+    return 0;
 
   if (process->start_time != start_time)
     {
       g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
 		   "process with PID %d has been replaced", process->pid);
-      goto out;
+      return 0;
     }
 
-out:
-  g_strfreev (lines);
-  g_free (contents);
   return result;
 }
 
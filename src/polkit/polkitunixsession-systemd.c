@@ -374,22 +374,9 @@ polkit_unix_session_exists_sync (PolkitSubject   *subject,
   return ret;
 }
 
-static void
-exists_in_thread_func (GSimpleAsyncResult *res,
-                       GObject            *object,
-                       GCancellable       *cancellable)
-{
-  GError *error;
-  error = NULL;
-  if (!polkit_unix_session_exists_sync (POLKIT_SUBJECT (object),
-                                        cancellable,
-                                        &error))
-    {
-      g_simple_async_result_set_from_error (res, error);
-      g_error_free (error);
-    }
-}
-
+/* Looking the session up only reads a file below /run, so there is no
+ * point in a thread for it
+ */
 static void
 polkit_unix_session_exists (PolkitSubject       *subject,
                             GCancellable        *cancellable,
@@ -397,6 +384,7 @@ polkit_unix_session_exists (PolkitSubject       *subject,
                             gpointer             user_data)
 {
   GSimpleAsyncResult *simple;
+  GError *error;
 
   g_return_if_fail (POLKIT_IS_UNIX_SESSION (subject));
 
@@ -404,10 +392,13 @@ polkit_unix_session_exists (PolkitSubject       *subject,
                                       callback,
                                       user_data,
                                       polkit_unix_session_exists);
-  g_simple_async_result_run_in_thread (simple,
-                                       exists_in_thread_func,
-                                       G_PRIORITY_DEFAULT,
-                                       cancellable);
+  error = NULL;
+  if (g_cancellable_set_error_if_cancelled (cancellable, &error))
+    g_simple_async_result_take_error (simple, error);
+  else
+    g_simple_async_result_set_op_res_gboolean (simple,
+                                               polkit_unix_session_exists_sync (subject, cancellable, NULL));
+  g_simple_async_result_complete_in_idle (simple);
   g_object_unref (simple);
 }
 
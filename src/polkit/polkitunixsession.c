@@ -395,41 +395,100 @@ polkit_unix_session_exists_sync (PolkitSubject   *subject,
   return ret;
 }
 
+typedef struct
+{
+  GSimpleAsyncResult *simple;
+  GCancellable *cancellable;
+  gchar *session_id;
+} ExistsData;
+
+static void
+exists_data_free (ExistsData *data)
+{
+  g_object_unref (data->simple);
+  if (data->cancellable != NULL)
+    g_object_unref (data->cancellable);
+  g_free (data->session_id);
+  g_free (data);
+}
+
 static void
-exists_in_thread_func (GSimpleAsyncResult *res,
-                       GObject            *object,
-                       GCancellable       *cancellable)
+exists_get_user_cb (GObject      *source_object,
+                    GAsyncResult *res,
+                    gpointer      user_data)
 {
+  ExistsData *data = user_data;
+  GVariant *result;
   GError *error;
+
   error = NULL;
-  if (!polkit_unix_session_exists_sync (POLKIT_SUBJECT (object),
-                                        cancellable,
-                                        &error))
+  result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+  if (result == NULL)
+    {
+      g_simple_async_result_take_error (data->simple, error);
+    }
+  else
+    {
+      g_simple_async_result_set_op_res_gboolean (data->simple, TRUE);
+      g_variant_unref (result);
+    }
+  g_simple_async_result_complete (data->simple);
+  exists_data_free (data);
+}
+
+static void
+exists_bus_get_cb (GObject      *source_object,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+  ExistsData *data = user_data;
+  GDBusConnection *connection;
+  GError *error;
+
+  error = NULL;
+  connection = g_bus_get_finish (res, &error);
+  if (connection == NULL)
     {
-      g_simple_async_result_set_from_error (res, error);
-      g_error_free (error);
+      g_simple_async_result_take_error (data->simple, error);
+      g_simple_async_result_complete (data->simple);
+      exists_data_free (data);
+      return;
     }
+
+  g_dbus_connection_call (connection,
+                          "org.freedesktop.ConsoleKit",           /* name */
+                          data->session_id,                       /* object path */
+                          "org.freedesktop.ConsoleKit.Session",   /* interface name */
+                          "GetUser",                              /* method */
+                          NULL, /* parameters */
+                          G_VARIANT_TYPE ("(u)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          data->cancellable,
+                          exists_get_user_cb,
+                          data);
+  g_object_unref (connection);
 }
 
+/* Asks ConsoleKit right away instead of blocking a thread on it */
 static void
 polkit_unix_session_exists (PolkitSubject       *subject,
                             GCancellable        *cancellable,
                             GAsyncReadyCallback  callback,
                             gpointer             user_data)
 {
-  GSimpleAsyncResult *simple;
+  ExistsData *data;
 
   g_return_if_fail (POLKIT_IS_UNIX_SESSION (subject));
 
-  simple = g_simple_async_result_new (G_OBJECT (subject),
-                                      callback,
-                                      user_data,
-                                      polkit_unix_session_exists);
-  g_simple_async_result_run_in_thread (simple,
-                                       exists_in_thread_func,
-                                       G_PRIORITY_DEFAULT,
-                                       cancellable);
-  g_object_unref (simple);
+  data = g_new0 (ExistsData, 1);
+  data->simple = g_simple_async_result_new (G_OBJECT (subject),
+                                            callback,
+                                            user_data,
+                                            polkit_unix_session_exists);
+  data->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+  data->session_id = g_strdup (POLKIT_UNIX_SESSION (subject)->session_id);
+  g_bus_get (G_BUS_TYPE_SYSTEM, cancellable, exists_bus_get_cb, data);
 }
 
 static gboolean
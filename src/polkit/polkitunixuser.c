@@ -208,6 +208,88 @@ polkit_unix_user_new (gint uid)
                                         NULL));
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* uid -> GWeakRef on the shared #PolkitUnixUser */
+static GHashTable *shared_users = NULL;
+G_LOCK_DEFINE_STATIC (shared_users);
+
+static void
+shared_user_ref_free (GWeakRef *ref)
+{
+  g_weak_ref_clear (ref);
+  g_free (ref);
+}
+
+static void
+on_shared_user_finalized (gpointer  data,
+                          GObject  *where_the_object_was)
+{
+  GWeakRef *ref;
+  GObject *replacement;
+
+  replacement = NULL;
+
+  G_LOCK (shared_users);
+  ref = g_hash_table_lookup (shared_users, data);
+  if (ref != NULL)
+    {
+      /* another instance may have taken its place in the meantime */
+      replacement = g_weak_ref_get (ref);
+      if (replacement == NULL)
+        g_hash_table_remove (shared_users, data);
+    }
+  G_UNLOCK (shared_users);
+
+  if (replacement != NULL)
+    g_object_unref (replacement);
+}
+
+/*
+ * Private: Gets the one #PolkitUnixUser for @uid that everybody
+ * asking for it shares, creating it if there is none right now. It is
+ * forgotten again once the last reference to it is dropped.
+ *
+ * This is meant for the authority, which would otherwise create and
+ * throw away identities for the same few users on every check, and lets
+ * polkit_identity_equal() get away with comparing pointers. The
+ * returned object must not be changed.
+ */
+PolkitIdentity *
+polkit_unix_user_new_shared (gint uid)
+{
+  PolkitIdentity *user;
+  GWeakRef *ref;
+
+  g_return_val_if_fail (uid != -1, NULL);
+
+  G_LOCK (shared_users);
+  if (shared_users == NULL)
+    shared_users = g_hash_table_new_full (g_direct_hash,
+                                          g_direct_equal,
+                                          NULL,
+                                          (GDestroyNotify) shared_user_ref_free);
+
+  ref = g_hash_table_lookup (shared_users, GINT_TO_POINTER (uid));
+  user = ref != NULL ? g_weak_ref_get (ref) : NULL;
+  if (user == NULL)
+    {
+      user = polkit_unix_user_new (uid);
+      if (ref == NULL)
+        {
+          ref = g_new0 (GWeakRef, 1);
+          g_hash_table_insert (shared_users, GINT_TO_POINTER (uid), ref);
+        }
+      g_weak_ref_set (ref, user);
+      g_object_weak_ref (G_OBJECT (user), on_shared_user_finalized, GINT_TO_POINTER (uid));
+    }
+  G_UNLOCK (shared_users);
+
+  return user;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 /**
  * polkit_unix_user_new_for_name:
  * @name: A UNIX user name.
@@ -281,6 +363,10 @@ polkit_unix_user_equal (PolkitIdentity *a,
   user_a = POLKIT_UNIX_USER (a);
   user_b = POLKIT_UNIX_USER (b);
 
+  /* shared instances are the only ones for their id */
+  if (user_a == user_b)
+    return TRUE;
+
   return user_a->uid == user_b->uid;
 }
 
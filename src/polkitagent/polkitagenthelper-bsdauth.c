@@ -44,7 +44,7 @@ int
 main (int argc, char *argv[])
 {
   struct passwd *pw;
-  const char *user_to_auth;
+  char *user_to_auth = NULL;
   char *cookie = NULL;
 
   /* clear the entire environment to avoid attacks with
@@ -65,7 +65,7 @@ main (int argc, char *argv[])
   openlog ("polkit-agent-helper-1", LOG_CONS | LOG_PID, LOG_AUTHPRIV);
 
   /* check for correct invocation */
-  if (!(argc == 2 || argc == 3))
+  if (argc < 1 || argc > 3)
     {
       syslog (LOG_NOTICE, "inappropriate use of helper, wrong number of arguments [uid=%d]", getuid ());
       fprintf (stderr, "polkit-agent-helper-1: wrong number of arguments. This incident has been logged.\n");
@@ -83,7 +83,9 @@ main (int argc, char *argv[])
       }
     }
 
-  user_to_auth = argv[1];
+  user_to_auth = read_user (argc, argv);
+  if (!user_to_auth)
+    goto error;
   cookie = read_cookie (argc, argv);
   if (!cookie)
     goto error;
@@ -124,6 +126,7 @@ main (int argc, char *argv[])
     }
 
   free (cookie);
+  free (user_to_auth);
 
 #ifdef PAH_DEBUG
   fprintf (stderr, "polkit-agent-helper-1: successfully sent D-Bus message to polkit daemon\n");
@@ -135,6 +138,7 @@ main (int argc, char *argv[])
 
 error:
   free (cookie);
+  free (user_to_auth);
   fprintf (stdout, "FAILURE\n");
   flush_and_wait ();
   return 1;
@@ -74,7 +74,7 @@ int
 main (int argc, char *argv[])
 {
   int rc;
-  const char *user_to_auth;
+  char *user_to_auth = NULL;
   char *cookie = NULL;
   struct pam_conv pam_conversation;
   pam_handle_t *pam_h;
@@ -107,14 +107,35 @@ main (int argc, char *argv[])
   openlog ("polkit-agent-helper-1", LOG_CONS | LOG_PID, LOG_AUTHPRIV);
 
   /* check for correct invocation */
-  if (!(argc == 2 || argc == 3))
+  if (argc < 1 || argc > 3)
     {
       syslog (LOG_NOTICE, "inappropriate use of helper, wrong number of arguments [uid=%d]", getuid ());
       fprintf (stderr, "polkit-agent-helper-1: wrong number of arguments. This incident has been logged.\n");
       goto error;
     }
 
-  user_to_auth = argv[1];
+  pam_conversation.conv        = conversation_function;
+  pam_conversation.appdata_ptr = NULL;
+
+  /* Started ahead of time, without a user: get the pam stack going
+   * while waiting to be told whom to authenticate
+   */
+  if (argc == 1)
+    {
+      rc = pam_start ("polkit-1",
+                      NULL,
+                      &pam_conversation,
+                      &pam_h);
+      if (rc != PAM_SUCCESS)
+        {
+          fprintf (stderr, "polkit-agent-helper-1: pam_start failed: %s\n", pam_strerror (pam_h, rc));
+          goto error;
+        }
+    }
+
+  user_to_auth = read_user (argc, argv);
+  if (!user_to_auth)
+    goto error;
 
   cookie = read_cookie (argc, argv);
   if (!cookie)
@@ -135,18 +156,27 @@ main (int argc, char *argv[])
   fprintf (stderr, "polkit-agent-helper-1: user to auth is '%s'.\n", user_to_auth);
 #endif /* PAH_DEBUG */
 
-  pam_conversation.conv        = conversation_function;
-  pam_conversation.appdata_ptr = NULL;
-
-  /* start the pam stack */
-  rc = pam_start ("polkit-1",
-                  user_to_auth,
-                  &pam_conversation,
-                  &pam_h);
-  if (rc != PAM_SUCCESS)
+  /* start the pam stack, unless it was started already */
+  if (pam_h == NULL)
     {
-      fprintf (stderr, "polkit-agent-helper-1: pam_start failed: %s\n", pam_strerror (pam_h, rc));
-      goto error;
+      rc = pam_start ("polkit-1",
+                      user_to_auth,
+                      &pam_conversation,
+                      &pam_h);
+      if (rc != PAM_SUCCESS)
+        {
+          fprintf (stderr, "polkit-agent-helper-1: pam_start failed: %s\n", pam_strerror (pam_h, rc));
+          goto error;
+        }
+    }
+  else
+    {
+      rc = pam_set_item (pam_h, PAM_USER, user_to_auth);
+      if (rc != PAM_SUCCESS)
+        {
+          fprintf (stderr, "polkit-agent-helper-1: pam_set_item failed: %s\n", pam_strerror (pam_h, rc));
+          goto error;
+        }
     }
 
   /* set the requesting user */
@@ -217,6 +247,7 @@ main (int argc, char *argv[])
     }
 
   free (cookie);
+  free (user_to_auth);
 
 #ifdef PAH_DEBUG
   fprintf (stderr, "polkit-agent-helper-1: successfully sent D-Bus message to PolicyKit daemon\n");
@@ -228,6 +259,7 @@ main (int argc, char *argv[])
 
 error:
   free (cookie);
+  free (user_to_auth);
   if (pam_h != NULL)
     pam_end (pam_h, rc);
 
@@ -45,7 +45,7 @@ int
 main (int argc, char *argv[])
 {
   struct spwd *shadow;
-  const char *user_to_auth;
+  char *user_to_auth = NULL;
   char *cookie = NULL;
   time_t now;
 
@@ -67,7 +67,7 @@ main (int argc, char *argv[])
   openlog ("polkit-agent-helper-1", LOG_CONS | LOG_PID, LOG_AUTHPRIV);
 
   /* check for correct invocation */
-  if (!(argc == 2 || argc == 3))
+  if (argc < 1 || argc > 3)
     {
       syslog (LOG_NOTICE, "inappropriate use of helper, wrong number of arguments [uid=%d]", getuid ());
       fprintf (stderr, "polkit-agent-helper-1: wrong number of arguments. This incident has been logged.\n");
@@ -85,7 +85,9 @@ main (int argc, char *argv[])
       }
     }
 
-  user_to_auth = argv[1];
+  user_to_auth = read_user (argc, argv);
+  if (!user_to_auth)
+    goto error;
 
   cookie = read_cookie (argc, argv);
   if (!cookie)
@@ -157,6 +159,7 @@ main (int argc, char *argv[])
     }
 
   free (cookie);
+  free (user_to_auth);
 
 #ifdef PAH_DEBUG
   fprintf (stderr, "polkit-agent-helper-1: successfully sent D-Bus message to PolicyKit daemon\n");
@@ -168,6 +171,7 @@ main (int argc, char *argv[])
 
 error:
   free (cookie);
+  free (user_to_auth);
   fprintf (stdout, "FAILURE\n");
   flush_and_wait ();
   return 1;
@@ -46,6 +46,38 @@ _polkit_clearenv (void)
 #endif
 
 
+static char *
+read_line (void)
+{
+  char *ret = NULL;
+  size_t n = 0;
+  ssize_t r = getline (&ret, &n, stdin);
+  if (r == -1)
+    {
+      if (!feof (stdin))
+        perror ("getline");
+      free (ret);
+      return NULL;
+    }
+  else
+    {
+      g_strchomp (ret);
+      return ret;
+    }
+}
+
+char *
+read_user (int argc, char **argv)
+{
+  /* A helper started ahead of time, before anybody needed it, is
+   * told the user on standard input, just before the cookie.
+   */
+  if (argc >= 2)
+    return strdup (argv[1]);
+  else
+    return read_line ();
+}
+
 char *
 read_cookie (int argc, char **argv)
 {
@@ -59,23 +91,7 @@ read_cookie (int argc, char **argv)
   if (argc == 3)
     return strdup (argv[2]);
   else
-    {
-      char *ret = NULL;
-      size_t n = 0;
-      ssize_t r = getline (&ret, &n, stdin);
-      if (r == -1)
-        {
-          if (!feof (stdin))
-            perror ("getline");
-          free (ret);
-          return NULL;
-        }
-      else
-        {
-          g_strchomp (ret);
-          return ret;
-        }
-    }
+    return read_line ();
 }
 
 gboolean
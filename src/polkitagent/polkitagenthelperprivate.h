@@ -37,6 +37,8 @@
 
 int _polkit_clearenv (void);
 
+char *read_user (int argc, char **argv);
+
 char *read_cookie (int argc, char **argv);
 
 gboolean send_dbus_message (const char *cookie, const char *user);
@@ -42,8 +42,82 @@
  * To register a #PolkitAgentListener with the PolicyKit daemon, use
  * polkit_agent_listener_register() or
  * polkit_agent_listener_register_with_options().
+ *
+ * Every authentication request is tracked by its cookie, so any number
+ * of them may be outstanding at once. By default they are all passed
+ * on to @initiate_authentication as soon as they arrive; agents that
+ * can only handle a few at a time (such as one prompting on a
+ * terminal) set the #PolkitAgentListener:max-sessions property and the
+ * rest wait, in the order they arrived, until a running one is over.
+ * Requests cancelled while still waiting never reach the agent.
  */
 
+typedef struct
+{
+  guint max_sessions;
+} PolkitAgentListenerPrivate;
+
+#define POLKIT_AGENT_LISTENER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), POLKIT_AGENT_TYPE_LISTENER, PolkitAgentListenerPrivate))
+
+enum
+{
+  PROP_0,
+  PROP_MAX_SESSIONS,
+};
+
+/* Authentication requests of a registration, shared with the requests
+ * themselves since they may outlive it
+ */
+typedef struct
+{
+  volatile gint ref_count;
+
+  PolkitAgentListener *listener;
+
+  /* cookie -> AuthData, for every request either running or waiting */
+  GHashTable *cookie_to_auth;
+
+  /* requests not yet passed on to the listener, oldest first */
+  GQueue waiting;
+
+  guint n_running;
+} PendingAuths;
+
+static PendingAuths *
+pending_auths_new (PolkitAgentListener *listener)
+{
+  PendingAuths *pending;
+
+  pending = g_new0 (PendingAuths, 1);
+  pending->ref_count = 1;
+  pending->listener = g_object_ref (listener);
+  pending->cookie_to_auth = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&pending->waiting);
+
+  return pending;
+}
+
+static PendingAuths *
+pending_auths_ref (PendingAuths *pending)
+{
+  g_atomic_int_inc (&pending->ref_count);
+  return pending;
+}
+
+static void
+pending_auths_unref (PendingAuths *pending)
+{
+  if (!g_atomic_int_dec_and_test (&pending->ref_count))
+    return;
+
+  g_warn_if_fail (g_queue_is_empty (&pending->waiting));
+  g_hash_table_unref (pending->cookie_to_auth);
+  g_object_unref (pending->listener);
+  g_free (pending);
+}
+
+static void pending_auths_cancel_waiting (PendingAuths *pending);
+
 typedef struct
 {
   GObject parent_instance;
@@ -62,10 +136,10 @@ typedef struct
 
   GVariant *registration_options;
 
-  PolkitSubject *subject;
+  GList *subjects; /* PolkitSubject, registered in one call if several */
   gchar *object_path;
 
-  GHashTable *cookie_to_pending_auth;
+  PendingAuths *pending;
 
   GThread *thread;
   GError *thread_initialization_error;
@@ -79,16 +153,21 @@ server_free (Server *server)
 {
   if (server->is_registered)
     {
-      GError *error;
-      error = NULL;
-      if (!polkit_authority_unregister_authentication_agent_sync (server->authority,
-                                                                  server->subject,
-                                                                  server->object_path,
-                                                                  NULL,
-                                                                  &error))
+      GList *l;
+
+      for (l = server->subjects; l != NULL; l = l->next)
         {
-          g_warning ("Error unregistering authentication agent: %s", error->message);
-          g_error_free (error);
+          GError *error;
+          error = NULL;
+          if (!polkit_authority_unregister_authentication_agent_sync (server->authority,
+                                                                      POLKIT_SUBJECT (l->data),
+                                                                      server->object_path,
+                                                                      NULL,
+                                                                      &error))
+            {
+              g_warning ("Error unregistering authentication agent: %s", error->message);
+              g_error_free (error);
+            }
         }
     }
 
@@ -122,11 +201,14 @@ server_free (Server *server)
   if (server->system_bus != NULL)
     g_object_unref (server->system_bus);
 
-  if (server->cookie_to_pending_auth != NULL)
-    g_hash_table_unref (server->cookie_to_pending_auth);
+  if (server->pending != NULL)
+    {
+      /* nobody is going to start these any more */
+      pending_auths_cancel_waiting (server->pending);
+      pending_auths_unref (server->pending);
+    }
 
-  if (server->subject != NULL)
-    g_object_unref (server->subject);
+  g_list_free_full (server->subjects, g_object_unref);
 
   g_free (server->object_path);
 
@@ -148,13 +230,27 @@ server_register (Server   *server,
     locale = "en_US.UTF-8";
 
   local_error = NULL;
-  if (!polkit_authority_register_authentication_agent_with_options_sync (server->authority,
-                                                                         server->subject,
-                                                                         locale,
-                                                                         server->object_path,
-                                                                         server->registration_options,
-                                                                         NULL,
-                                                                         &local_error))
+  if (server->subjects->next != NULL)
+    {
+      ret = polkit_authority_register_authentication_agent_for_subjects_sync (server->authority,
+                                                                              server->subjects,
+                                                                              locale,
+                                                                              server->object_path,
+                                                                              server->registration_options,
+                                                                              NULL,
+                                                                              &local_error);
+    }
+  else
+    {
+      ret = polkit_authority_register_authentication_agent_with_options_sync (server->authority,
+                                                                              POLKIT_SUBJECT (server->subjects->data),
+                                                                              locale,
+                                                                              server->object_path,
+                                                                              server->registration_options,
+                                                                              NULL,
+                                                                              &local_error);
+    }
+  if (!ret)
     {
       g_propagate_error (error, local_error);
     }
@@ -242,7 +338,7 @@ server_init_sync (Server        *server,
 }
 
 static Server *
-server_new (PolkitSubject  *subject,
+server_new (GList          *subjects,
             const gchar    *object_path,
             GCancellable   *cancellable,
             GError        **error)
@@ -250,10 +346,10 @@ server_new (PolkitSubject  *subject,
   Server *server;
 
   server = g_new0 (Server, 1);
-  server->subject = g_object_ref (subject);
+  server->subjects = g_list_copy (subjects);
+  g_list_foreach (server->subjects, (GFunc) g_object_ref, NULL);
   server->object_path = object_path != NULL ? g_strdup (object_path) :
                                               g_strdup ("/org/freedesktop/PolicyKit1/AuthenticationAgent");
-  server->cookie_to_pending_auth = g_hash_table_new (g_str_hash, g_str_equal);
 
   if (!server_init_sync (server, cancellable, error))
     {
@@ -363,45 +459,22 @@ server_thread_func (gpointer user_data)
   return NULL;
 }
 
-/**
- * polkit_agent_listener_register_with_options:
- * @listener: A #PolkitAgentListener.
- * @flags: A set of flags from the #PolkitAgentRegisterFlags enumeration.
- * @subject: The subject to become an authentication agent for, typically a #PolkitUnixSession object.
- * @object_path: The D-Bus object path to use for the authentication agent or %NULL for the default object path.
- * @options: (allow-none): A #GVariant with options or %NULL.
- * @cancellable: A #GCancellable or %NULL.
- * @error: Return location for error.
- *
- * Like polkit_agent_listener_register() but takes options to influence registration. See the
- * <link linkend="eggdbus-method-org.freedesktop.PolicyKit1.Authority.RegisterAuthenticationAgentWithOptions">RegisterAuthenticationAgentWithOptions()</link> D-Bus method for details.
- *
- * Returns: (transfer full): %NULL if @error is set, otherwise a
- * registration handle that can be used with
- * polkit_agent_listener_unregister().
- */
-gpointer
-polkit_agent_listener_register_with_options (PolkitAgentListener      *listener,
-                                             PolkitAgentRegisterFlags  flags,
-                                             PolkitSubject            *subject,
-                                             const gchar              *object_path,
-                                             GVariant                 *options,
-                                             GCancellable             *cancellable,
-                                             GError                  **error)
+static Server *
+listener_register (PolkitAgentListener      *listener,
+                   PolkitAgentRegisterFlags  flags,
+                   GList                    *subjects,
+                   const gchar              *object_path,
+                   GVariant                 *options,
+                   GCancellable             *cancellable,
+                   GError                  **error)
 {
   Server *server;
   GDBusNodeInfo *node_info;
 
-  g_return_val_if_fail (POLKIT_AGENT_IS_LISTENER (listener), NULL);
-  g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), NULL);
-  g_return_val_if_fail (object_path == NULL || g_variant_is_object_path (object_path), NULL);
-  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
-  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
-
   if (object_path == NULL)
     object_path = "/org/freedesktop/PolicyKit1/AuthenticationAgent";
 
-  server = server_new (subject, object_path, cancellable, error);
+  server = server_new (subjects, object_path, cancellable, error);
   if (server == NULL)
     goto out;
 
@@ -416,6 +489,7 @@ polkit_agent_listener_register_with_options (PolkitAgentListener      *listener,
   g_dbus_node_info_unref (node_info);
 
   server->listener = g_object_ref (listener);
+  server->pending = pending_auths_new (listener);
 
   server->registration_options = options != NULL ? g_variant_ref_sink (options) : NULL;
 
@@ -464,6 +538,84 @@ polkit_agent_listener_register_with_options (PolkitAgentListener      *listener,
   return server;
 }
 
+/**
+ * polkit_agent_listener_register_with_options:
+ * @listener: A #PolkitAgentListener.
+ * @flags: A set of flags from the #PolkitAgentRegisterFlags enumeration.
+ * @subject: The subject to become an authentication agent for, typically a #PolkitUnixSession object.
+ * @object_path: The D-Bus object path to use for the authentication agent or %NULL for the default object path.
+ * @options: (allow-none): A #GVariant with options or %NULL.
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error.
+ *
+ * Like polkit_agent_listener_register() but takes options to influence registration. See the
+ * <link linkend="eggdbus-method-org.freedesktop.PolicyKit1.Authority.RegisterAuthenticationAgentWithOptions">RegisterAuthenticationAgentWithOptions()</link> D-Bus method for details.
+ *
+ * Returns: (transfer full): %NULL if @error is set, otherwise a
+ * registration handle that can be used with
+ * polkit_agent_listener_unregister().
+ */
+gpointer
+polkit_agent_listener_register_with_options (PolkitAgentListener      *listener,
+                                             PolkitAgentRegisterFlags  flags,
+                                             PolkitSubject            *subject,
+                                             const gchar              *object_path,
+                                             GVariant                 *options,
+                                             GCancellable             *cancellable,
+                                             GError                  **error)
+{
+  GList subjects = { subject, NULL, NULL };
+
+  g_return_val_if_fail (POLKIT_AGENT_IS_LISTENER (listener), NULL);
+  g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), NULL);
+  g_return_val_if_fail (object_path == NULL || g_variant_is_object_path (object_path), NULL);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  return listener_register (listener, flags, &subjects, object_path, options, cancellable, error);
+}
+
+/**
+ * polkit_agent_listener_register_for_subjects:
+ * @listener: A #PolkitAgentListener.
+ * @flags: A set of flags from the #PolkitAgentRegisterFlags enumeration.
+ * @subjects: (element-type Polkit.Subject): The subjects to become an authentication agent for, typically #PolkitUnixSession objects.
+ * @object_path: The D-Bus object path to use for the authentication agent or %NULL for the default object path.
+ * @options: (allow-none): A #GVariant with options or %NULL.
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error.
+ *
+ * Like polkit_agent_listener_register_with_options() but registers
+ * @listener as the authentication agent for all of @subjects in a
+ * single call, for system-wide agents serving many sessions. See the
+ * <link linkend="eggdbus-method-org.freedesktop.PolicyKit1.Authority.RegisterAuthenticationAgentForSubjects">RegisterAuthenticationAgentForSubjects()</link> D-Bus method for details.
+ *
+ * Returns: (transfer full): %NULL if @error is set, otherwise a
+ * registration handle that can be used with
+ * polkit_agent_listener_unregister().
+ */
+gpointer
+polkit_agent_listener_register_for_subjects (PolkitAgentListener      *listener,
+                                             PolkitAgentRegisterFlags  flags,
+                                             GList                    *subjects,
+                                             const gchar              *object_path,
+                                             GVariant                 *options,
+                                             GCancellable             *cancellable,
+                                             GError                  **error)
+{
+  GList *l;
+
+  g_return_val_if_fail (POLKIT_AGENT_IS_LISTENER (listener), NULL);
+  g_return_val_if_fail (subjects != NULL, NULL);
+  for (l = subjects; l != NULL; l = l->next)
+    g_return_val_if_fail (POLKIT_IS_SUBJECT (l->data), NULL);
+  g_return_val_if_fail (object_path == NULL || g_variant_is_object_path (object_path), NULL);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  return listener_register (listener, flags, subjects, object_path, options, cancellable, error);
+}
+
 /**
  * polkit_agent_listener_register:
  * @listener: A #PolkitAgentListener.
@@ -570,29 +722,105 @@ polkit_agent_register_listener (PolkitAgentListener  *listener,
 typedef struct
 {
   gchar *cookie;
-  GHashTable *cookie_to_pending_auth;
+  PendingAuths *pending;
   GDBusMethodInvocation *invocation;
   GCancellable *cancellable;
+
+  /* the request itself, only kept while it is waiting */
+  gchar *action_id;
+  gchar *message;
+  gchar *icon_name;
+  PolkitDetails *details;
+  GList *identities;
 } AuthData;
 
+static void
+auth_data_clear_request (AuthData *data)
+{
+  g_free (data->action_id);
+  g_free (data->message);
+  g_free (data->icon_name);
+  if (data->details != NULL)
+    g_object_unref (data->details);
+  g_list_free_full (data->identities, g_object_unref);
+
+  data->action_id = NULL;
+  data->message = NULL;
+  data->icon_name = NULL;
+  data->details = NULL;
+  data->identities = NULL;
+}
+
 static void
 auth_data_free (AuthData *data)
 {
+  auth_data_clear_request (data);
   g_free (data->cookie);
   g_object_unref (data->invocation);
   g_object_unref (data->cancellable);
-  g_hash_table_unref (data->cookie_to_pending_auth);
+  pending_auths_unref (data->pending);
   g_free (data);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void auth_cb (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data);
+
+/* Passes waiting requests on to the listener for as long as it may take more */
+static void
+pending_auths_dispatch (PendingAuths *pending)
+{
+  PolkitAgentListenerPrivate *priv = POLKIT_AGENT_LISTENER_GET_PRIVATE (pending->listener);
+
+  while (!g_queue_is_empty (&pending->waiting) &&
+         (priv->max_sessions == 0 || pending->n_running < priv->max_sessions))
+    {
+      AuthData *data;
+
+      data = g_queue_pop_head (&pending->waiting);
+      pending->n_running++;
+
+      polkit_agent_listener_initiate_authentication (pending->listener,
+                                                     data->action_id,
+                                                     data->message,
+                                                     data->icon_name,
+                                                     data->details,
+                                                     data->cookie,
+                                                     data->identities,
+                                                     data->cancellable,
+                                                     auth_cb,
+                                                     data);
+
+      auth_data_clear_request (data);
+    }
+}
+
+/* Fails every request that is still waiting, the listener never sees them */
+static void
+pending_auths_cancel_waiting (PendingAuths *pending)
+{
+  AuthData *data;
+
+  while ((data = g_queue_pop_head (&pending->waiting)) != NULL)
+    {
+      g_dbus_method_invocation_return_error (data->invocation,
+                                             POLKIT_ERROR,
+                                             POLKIT_ERROR_CANCELLED,
+                                             "The authentication agent is no longer registered");
+      g_hash_table_remove (pending->cookie_to_auth, data->cookie);
+      auth_data_free (data);
+    }
+}
+
 static void
 auth_cb (GObject      *source_object,
          GAsyncResult *res,
          gpointer      user_data)
 {
   AuthData *data = user_data;
+  PendingAuths *pending = data->pending;
   GError *error;
 
   error = NULL;
@@ -608,7 +836,11 @@ auth_cb (GObject      *source_object,
       g_dbus_method_invocation_return_value (data->invocation, NULL);
     }
 
-  g_hash_table_remove (data->cookie_to_pending_auth, data->cookie);
+  g_hash_table_remove (pending->cookie_to_auth, data->cookie);
+  pending->n_running--;
+
+  /* make room for the next one before letting go of @pending */
+  pending_auths_dispatch (pending);
 
   auth_data_free (data);
 }
@@ -669,23 +901,21 @@ auth_agent_handle_begin_authentication (Server                 *server,
   identities = g_list_reverse (identities);
 
   data = g_new0 (AuthData, 1);
-  data->cookie_to_pending_auth = g_hash_table_ref (server->cookie_to_pending_auth);
+  data->pending = pending_auths_ref (server->pending);
   data->cookie = g_strdup (cookie);
   data->invocation = g_object_ref (invocation);
   data->cancellable = g_cancellable_new ();
+  data->action_id = g_strdup (action_id);
+  data->message = g_strdup (message);
+  data->icon_name = g_strdup (icon_name);
+  data->details = g_object_ref (details);
+  data->identities = identities;
+  identities = NULL;
 
-  g_hash_table_insert (server->cookie_to_pending_auth, (gpointer) cookie, data);
+  g_hash_table_insert (server->pending->cookie_to_auth, data->cookie, data);
+  g_queue_push_tail (&server->pending->waiting, data);
 
-  polkit_agent_listener_initiate_authentication (server->listener,
-                                                 action_id,
-                                                 message,
-                                                 icon_name,
-                                                 details,
-                                                 cookie,
-                                                 identities,
-                                                 data->cancellable,
-                                                 auth_cb,
-                                                 data);
+  pending_auths_dispatch (server->pending);
 
  out:
   g_list_foreach (identities, (GFunc) g_object_unref, NULL);
@@ -709,7 +939,7 @@ auth_agent_handle_cancel_authentication (Server                 *server,
                  "(&s)",
                  &cookie);
 
-  data = g_hash_table_lookup (server->cookie_to_pending_auth, cookie);
+  data = g_hash_table_lookup (server->pending->cookie_to_auth, cookie);
   if (data == NULL)
     {
       g_dbus_method_invocation_return_error (invocation,
@@ -718,6 +948,17 @@ auth_agent_handle_cancel_authentication (Server                 *server,
                                              "No pending authentication request for cookie '%s'",
                                              cookie);
     }
+  else if (g_queue_remove (&server->pending->waiting, data))
+    {
+      /* it never got to the listener */
+      g_dbus_method_invocation_return_error (data->invocation,
+                                             POLKIT_ERROR,
+                                             POLKIT_ERROR_CANCELLED,
+                                             "The authentication request was cancelled");
+      g_hash_table_remove (server->pending->cookie_to_auth, cookie);
+      auth_data_free (data);
+      g_dbus_method_invocation_return_value (invocation, NULL);
+    }
   else
     {
       g_cancellable_cancel (data->cancellable);
@@ -734,9 +975,72 @@ polkit_agent_listener_init (PolkitAgentListener *listener)
 {
 }
 
+static void
+polkit_agent_listener_set_property (GObject      *object,
+                                    guint         prop_id,
+                                    const GValue *value,
+                                    GParamSpec   *pspec)
+{
+  PolkitAgentListenerPrivate *priv = POLKIT_AGENT_LISTENER_GET_PRIVATE (object);
+
+  switch (prop_id)
+    {
+    case PROP_MAX_SESSIONS:
+      priv->max_sessions = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+polkit_agent_listener_get_property (GObject    *object,
+                                    guint       prop_id,
+                                    GValue     *value,
+                                    GParamSpec *pspec)
+{
+  PolkitAgentListenerPrivate *priv = POLKIT_AGENT_LISTENER_GET_PRIVATE (object);
+
+  switch (prop_id)
+    {
+    case PROP_MAX_SESSIONS:
+      g_value_set_uint (value, priv->max_sessions);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
 static void
 polkit_agent_listener_class_init (PolkitAgentListenerClass *klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->set_property = polkit_agent_listener_set_property;
+  gobject_class->get_property = polkit_agent_listener_get_property;
+
+  /**
+   * PolkitAgentListener:max-sessions:
+   *
+   * How many authentication requests of a registration are passed on
+   * to @initiate_authentication at once, or 0 for no limit. Requests
+   * beyond it wait until a running one is over.
+   *
+   * Since: 0.121
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_MAX_SESSIONS,
+                                   g_param_spec_uint ("max-sessions",
+                                                      "Maximum sessions",
+                                                      "How many authentication requests may run at once",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+                                                      G_PARAM_READWRITE));
+
+  g_type_class_add_private (klass, sizeof (PolkitAgentListenerPrivate));
 }
 
 /**
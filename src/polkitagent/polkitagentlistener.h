@@ -142,6 +142,14 @@ gpointer  polkit_agent_listener_register_with_options           (PolkitAgentList
                                                                  GCancellable             *cancellable,
                                                                  GError                  **error);
 
+gpointer  polkit_agent_listener_register_for_subjects           (PolkitAgentListener      *listener,
+                                                                 PolkitAgentRegisterFlags  flags,
+                                                                 GList                    *subjects,
+                                                                 const gchar              *object_path,
+                                                                 GVariant                 *options,
+                                                                 GCancellable             *cancellable,
+                                                                 GError                  **error);
+
 void      polkit_agent_listener_unregister                      (gpointer                  registration_handle);
 
 G_END_DECLS
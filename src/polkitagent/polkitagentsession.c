@@ -47,6 +47,10 @@
  *
  * If the user is unable to authenticate, the #PolkitAgentSession::completed signal will
  * be emitted with the @gained_authorization paramter set to %FALSE.
+ *
+ * Once a session has started its helper, another one is started and left
+ * waiting, so that the next session only has to tell it the user and the
+ * cookie rather than wait for the helper to start up.
  */
 
 #include "config.h"
@@ -55,6 +59,11 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include <gio/gunixoutputstream.h>
 #include <pwd.h>
 
@@ -547,6 +556,164 @@ polkit_agent_session_response (PolkitAgentSession *session,
     (void) g_output_stream_write_all (session->child_stdin, newline, 1, NULL, NULL, NULL);
 }
 
+#define HELPER_PATH PACKAGE_PREFIX "/lib/polkit-1/polkit-agent-helper-1"
+
+typedef struct
+{
+  GPid pid;
+  gint stdin_fd;
+  gint stdout_fd;
+} Helper;
+
+/* A helper started ahead of time, waiting to be told the user */
+G_LOCK_DEFINE_STATIC (spare_helper);
+static Helper spare_helper = { 0, -1, -1 };
+/* set once a spare helper gave up before it was used, e.g. when it is
+ * older than this library and wants the user on its command line
+ */
+static gboolean spare_helper_unsupported = FALSE;
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+/* Whether the kernel can mark a range of descriptors close-on-exec at
+ * once, which costs the same whatever the descriptor limit is
+ */
+static gboolean
+have_close_range_cloexec (void)
+{
+  static volatile gsize probed = 0;
+  static gboolean supported = FALSE;
+
+  if (g_once_init_enter (&probed))
+    {
+#ifdef SYS_close_range
+      /* an empty range, but kernels without the flag reject it */
+      supported = (syscall (SYS_close_range, (unsigned int) G_MAXINT, (unsigned int) G_MAXINT,
+                            CLOSE_RANGE_CLOEXEC) == 0);
+#endif
+      g_once_init_leave (&probed, 1);
+    }
+  return supported;
+}
+
+/* Runs in the child, after the pipes were moved to stdin and stdout */
+static void
+helper_child_setup (gpointer user_data)
+{
+  gint fd;
+  gint max_fd;
+
+#ifdef SYS_close_range
+  if (syscall (SYS_close_range, 3U, ~0U, CLOSE_RANGE_CLOEXEC) == 0)
+    return;
+#endif
+
+  max_fd = sysconf (_SC_OPEN_MAX);
+  for (fd = 3; fd < max_fd; fd++)
+    fcntl (fd, F_SETFD, FD_CLOEXEC);
+}
+
+/* Starts a helper for @user_name, or a spare one if %NULL */
+static gboolean
+spawn_helper (const gchar  *user_name,
+              Helper       *helper,
+              GError      **error)
+{
+  gchar *helper_argv[3];
+  GSpawnFlags flags;
+  GSpawnChildSetupFunc child_setup;
+
+  helper_argv[0] = HELPER_PATH;
+  helper_argv[1] = (gchar *) user_name;
+  helper_argv[2] = NULL;
+
+  /* rather than have every descriptor up to the limit closed one by one */
+  flags = G_SPAWN_DO_NOT_REAP_CHILD;
+  child_setup = NULL;
+  if (have_close_range_cloexec ())
+    {
+      flags |= G_SPAWN_LEAVE_DESCRIPTORS_OPEN;
+      child_setup = helper_child_setup;
+    }
+
+  helper->stdin_fd = -1;
+  helper->stdout_fd = -1;
+  return g_spawn_async_with_pipes (NULL,
+                                   (char **) helper_argv,
+                                   NULL,
+                                   flags |
+                                   0,//G_SPAWN_STDERR_TO_DEV_NULL,
+                                   child_setup,
+                                   NULL,
+                                   &helper->pid,
+                                   &helper->stdin_fd,
+                                   &helper->stdout_fd,
+                                   NULL,
+                                   error);
+}
+
+static void
+start_spare_helper (void)
+{
+  GError *error;
+
+  G_LOCK (spare_helper);
+  if (spare_helper.pid == 0 && !spare_helper_unsupported)
+    {
+      error = NULL;
+      if (!spawn_helper (NULL, &spare_helper, &error))
+        {
+          if (G_UNLIKELY (_show_debug ()))
+            g_print ("PolkitAgentSession: cannot spawn spare helper: %s\n", error->message);
+          g_error_free (error);
+          spare_helper.pid = 0;
+        }
+      else if (G_UNLIKELY (_show_debug ()))
+        {
+          g_print ("PolkitAgentSession: spawned spare helper with pid %d\n", (gint) spare_helper.pid);
+        }
+    }
+  G_UNLOCK (spare_helper);
+}
+
+/* Takes the spare helper, if there is one and it is still waiting */
+static gboolean
+take_spare_helper (Helper *helper)
+{
+  gboolean ret;
+  gint status;
+
+  ret = FALSE;
+
+  G_LOCK (spare_helper);
+  if (spare_helper.pid == 0)
+    goto out;
+
+  if (waitpid (spare_helper.pid, &status, WNOHANG) != 0)
+    {
+      if (G_UNLIKELY (_show_debug ()))
+        g_print ("PolkitAgentSession: spare helper with pid %d went away, not using spare helpers\n",
+                 (gint) spare_helper.pid);
+      close (spare_helper.stdin_fd);
+      close (spare_helper.stdout_fd);
+      spare_helper_unsupported = TRUE;
+    }
+  else
+    {
+      *helper = spare_helper;
+      ret = TRUE;
+    }
+  spare_helper.pid = 0;
+  spare_helper.stdin_fd = -1;
+  spare_helper.stdout_fd = -1;
+
+ out:
+  G_UNLOCK (spare_helper);
+  return ret;
+}
+
 /**
  * polkit_agent_session_initiate:
  * @session: A #PolkitAgentSession.
@@ -564,9 +731,9 @@ polkit_agent_session_initiate (PolkitAgentSession *session)
 {
   uid_t uid;
   GError *error;
-  gchar *helper_argv[3];
   struct passwd *passwd;
-  int stdin_fd = -1;
+  Helper helper;
+  gboolean is_spare = TRUE;
 
   g_return_if_fail (POLKIT_AGENT_IS_SESSION (session));
 
@@ -596,35 +763,38 @@ polkit_agent_session_initiate (PolkitAgentSession *session)
       goto error;
     }
 
-  helper_argv[0] = PACKAGE_PREFIX "/lib/polkit-1/polkit-agent-helper-1";
-  helper_argv[1] = passwd->pw_name;
-  helper_argv[2] = NULL;
+  if (take_spare_helper (&helper))
+    {
+      if (G_UNLIKELY (_show_debug ()))
+        g_print ("PolkitAgentSession: using spare helper with pid %d\n", (gint) helper.pid);
+    }
+  else
+    {
+      error = NULL;
+      if (!spawn_helper (passwd->pw_name, &helper, &error))
+        {
+          g_warning ("Cannot spawn helper: %s\n", error->message);
+          g_error_free (error);
+          goto error;
+        }
 
-  session->child_stdout = -1;
+      if (G_UNLIKELY (_show_debug ()))
+        g_print ("PolkitAgentSession: spawned helper with pid %d\n", (gint) helper.pid);
 
-  error = NULL;
-  if (!g_spawn_async_with_pipes (NULL,
-                                 (char **) helper_argv,
-                                 NULL,
-                                 G_SPAWN_DO_NOT_REAP_CHILD |
-                                 0,//G_SPAWN_STDERR_TO_DEV_NULL,
-                                 NULL,
-                                 NULL,
-                                 &session->child_pid,
-                                 &stdin_fd,
-                                 &session->child_stdout,
-                                 NULL,
-                                 &error))
-    {
-      g_warning ("Cannot spawn helper: %s\n", error->message);
-      g_error_free (error);
-      goto error;
+      is_spare = FALSE;
     }
 
-  if (G_UNLIKELY (_show_debug ()))
-    g_print ("PolkitAgentSession: spawned helper with pid %d\n", (gint) session->child_pid);
+  session->child_pid = helper.pid;
+  session->child_stdout = helper.stdout_fd;
+  session->child_stdin = (GOutputStream*)g_unix_output_stream_new (helper.stdin_fd, TRUE);
 
-  session->child_stdin = (GOutputStream*)g_unix_output_stream_new (stdin_fd, TRUE);
+  /* A spare helper doesn't know whom to authenticate yet */
+  if (is_spare)
+    {
+      (void) g_output_stream_write_all (session->child_stdin, passwd->pw_name, strlen (passwd->pw_name),
+                                        NULL, NULL, NULL);
+      (void) g_output_stream_write_all (session->child_stdin, "\n", 1, NULL, NULL, NULL);
+    }
 
   /* Write the cookie on stdin so it can't be seen by other processes */
   (void) g_output_stream_write_all (session->child_stdin, session->cookie, strlen (session->cookie),
@@ -642,6 +812,9 @@ polkit_agent_session_initiate (PolkitAgentSession *session)
 
   session->helper_is_running = TRUE;
 
+  /* ready for the next session */
+  start_spare_helper ();
+
   return;
 
 error:
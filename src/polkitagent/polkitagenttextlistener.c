@@ -45,6 +45,10 @@
  *
  * #PolkitAgentTextListener is an #PolkitAgentListener implementation
  * that interacts with the user using a textual interface.
+ *
+ * Since there is only one terminal to prompt on, it runs one
+ * authentication session at a time and further requests wait for
+ * their turn, see #PolkitAgentListener:max-sessions.
  */
 
 /**
@@ -106,6 +110,9 @@ polkit_agent_text_listener_init (PolkitAgentTextListener *listener)
   listener->use_color = TRUE;
   listener->use_alternate_buffer = FALSE;
   listener->delay = 1;
+
+  /* one prompt at a time, the others are queued by the base class */
+  g_object_set (listener, "max-sessions", 1, NULL);
 }
 
 static void
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+/**
+ * Build helper: compile the given .keyrules files into a precompiled image,
+ * and write it out as a C header for polkitd to embed, see
+ * policy_loader_set_builtin(). Any error in the rules fails the build.
+ *
+ *   mkbuiltinrules OUTPUT FILE...
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "polkitbackendpolicyimage.h"
+#include "polkitbackendpolicyloader.h"
+
+/**
+ * Write @image as an array of guint64, so that it is aligned as
+ * policy_image_read_data() wants it
+ */
+static gboolean
+write_header (const gchar *output, GBytes *image, GError **error)
+{
+  g_autoptr (GString) str = NULL;
+  gsize length = 0;
+  const guint8 *data = g_bytes_get_data (image, &length);
+
+  str = g_string_new ("/* Generated by mkbuiltinrules, do not edit */\n\n"
+                      "static const guint64 builtin_rules_image[] = {");
+  for (gsize offset = 0; offset < length; offset += sizeof (guint64))
+    {
+      guint64 word = 0;
+
+      memcpy (&word, data + offset, MIN (sizeof (word), length - offset));
+      g_string_append_printf (str, "%s0x%016" G_GINT64_MODIFIER "xULL,",
+                              offset % 32 == 0 ? "\n  " : " ", word);
+    }
+  g_string_append (str, "\n};\n");
+
+  return g_file_set_contents (output, str->str, str->len, error);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr (GArray) entries = NULL;
+  g_autoptr (GBytes) image = NULL;
+  g_autoptr (GError) err = NULL;
+  int ret = 1;
+
+  if (argc < 3)
+    {
+      g_printerr ("Usage: %s OUTPUT FILE...\n", argv[0]);
+      return 1;
+    }
+
+  entries = g_array_new (FALSE, TRUE, sizeof (PolicyImageEntry));
+  for (int n = 2; n < argc; n++)
+    {
+      g_autofree gchar *name = g_path_get_basename (argv[n]);
+      PolicyImageEntry entry = { 0 };
+
+      entry.file = policy_file_new_from_path (argv[n], &err);
+      if (!entry.file)
+        {
+          g_printerr ("Error compiling %s: %s\n", argv[n], err->message);
+          goto out;
+        }
+      /* Named for where it came from, and the name that replaces it */
+      entry.path = g_strdup_printf ("%s/%s", POLICY_LOADER_BUILTIN_RULES_DIR,
+                                    name);
+      g_array_append_val (entries, entry);
+    }
+
+  image = policy_image_serialize ((PolicyImageEntry *)entries->data,
+                                  entries->len);
+  if (!write_header (argv[1], image, &err))
+    {
+      g_printerr ("Error writing %s: %s\n", argv[1], err->message);
+      goto out;
+    }
+  ret = 0;
+
+out:
+  for (guint n = 0; n < entries->len; n++)
+    {
+      PolicyImageEntry *entry
+          = &g_array_index (entries, PolicyImageEntry, n);
+
+      g_free (entry->path);
+      policy_file_free (entry->file);
+    }
+  return ret;
+}
@@ -0,0 +1,608 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "polkitbackendactionimage.h"
+
+/**
+ * The image is laid out as a header, followed by the file, action and
+ * pair tables and then a pool of NUL terminated strings. Strings are
+ * referenced by their offset in the pool, and everything is in native
+ * byte order like the rules image.
+ */
+#define ACTION_IMAGE_MAGIC 0x49414b50 /* "PKAI" */
+#define ACTION_IMAGE_ALIGN 8
+#define ACTION_IMAGE_NO_STRING G_MAXUINT32
+
+typedef struct ActionImageHeader
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_files;
+  guint32 n_actions;
+  guint32 n_pairs;
+  guint32 directory; /**<String */
+  guint64 files;
+  guint64 actions;
+  guint64 pairs;
+  guint64 pool;
+  guint64 pool_size;
+  guint64 size; /**<Length of the whole image */
+} ActionImageHeader;
+
+typedef struct ActionImageFileRecord
+{
+  ActionImageStamp stamp;
+  guint32 name;
+  guint32 first_action;
+  guint32 n_actions;
+  guint32 reserved;
+} ActionImageFileRecord;
+
+/**
+ * The pairs of an action are its localized descriptions, then its
+ * localized messages and then its annotations
+ */
+typedef struct ActionImageActionRecord
+{
+  guint32 action_id;
+  guint32 vendor_name;
+  guint32 vendor_url;
+  guint32 icon_name;
+  guint32 description;
+  guint32 message;
+  gint32 implicit_authorization_any;
+  gint32 implicit_authorization_inactive;
+  gint32 implicit_authorization_active;
+  guint32 first_pair;
+  guint32 n_descriptions;
+  guint32 n_messages;
+  guint32 n_annotations;
+} ActionImageActionRecord;
+
+typedef struct ActionImagePair
+{
+  guint32 key;
+  guint32 value;
+} ActionImagePair;
+
+struct ActionImage
+{
+  volatile gint ref_count;
+  GMappedFile *mapped;
+  const ActionImageHeader *header;
+  const ActionImageFileRecord *files;
+  const ActionImageActionRecord *actions;
+  const ActionImagePair *pairs;
+  const gchar *pool;
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct ActionImageWriter
+{
+  GByteArray *pool;
+  GHashTable *strings; /**<Interns the pool, many actions share a vendor */
+  GArray *actions;
+  GArray *pairs;
+} ActionImageWriter;
+
+static guint32
+action_image_writer_add_string (ActionImageWriter *writer, const gchar *str)
+{
+  gpointer offset = NULL;
+
+  if (!str)
+    {
+      return ACTION_IMAGE_NO_STRING;
+    }
+  if (g_hash_table_lookup_extended (writer->strings, str, NULL, &offset))
+    {
+      return GPOINTER_TO_UINT (offset);
+    }
+
+  offset = GUINT_TO_POINTER (writer->pool->len);
+  g_byte_array_append (writer->pool, (const guint8 *)str, strlen (str) + 1);
+  g_hash_table_insert (writer->strings, (gpointer)str, offset);
+  return GPOINTER_TO_UINT (offset);
+}
+
+static guint32
+action_image_writer_add_pairs (ActionImageWriter *writer, GHashTable *table)
+{
+  GHashTableIter iter;
+  const gchar *key = NULL;
+  const gchar *value = NULL;
+
+  if (!table)
+    {
+      return 0;
+    }
+
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&value))
+    {
+      ActionImagePair pair = {
+        .key = action_image_writer_add_string (writer, key),
+        .value = action_image_writer_add_string (writer, value),
+      };
+      g_array_append_val (writer->pairs, pair);
+    }
+  return g_hash_table_size (table);
+}
+
+static void
+action_image_writer_add_action (ActionImageWriter *writer,
+                                const ActionImageAction *action)
+{
+  ActionImageActionRecord record = { 0 };
+
+  record.action_id = action_image_writer_add_string (writer, action->action_id);
+  record.vendor_name
+      = action_image_writer_add_string (writer, action->vendor_name);
+  record.vendor_url = action_image_writer_add_string (writer, action->vendor_url);
+  record.icon_name = action_image_writer_add_string (writer, action->icon_name);
+  record.description
+      = action_image_writer_add_string (writer, action->description);
+  record.message = action_image_writer_add_string (writer, action->message);
+  record.implicit_authorization_any = action->implicit_authorization_any;
+  record.implicit_authorization_inactive
+      = action->implicit_authorization_inactive;
+  record.implicit_authorization_active = action->implicit_authorization_active;
+
+  record.first_pair = writer->pairs->len;
+  record.n_descriptions
+      = action_image_writer_add_pairs (writer, action->localized_description);
+  record.n_messages
+      = action_image_writer_add_pairs (writer, action->localized_message);
+  record.n_annotations
+      = action_image_writer_add_pairs (writer, action->annotations);
+
+  g_array_append_val (writer->actions, record);
+}
+
+/**
+ * Append @size bytes at the next aligned offset, returning that offset
+ */
+static guint64
+action_image_append (GByteArray *image, gconstpointer data, gsize size)
+{
+  static const guint8 padding[ACTION_IMAGE_ALIGN] = { 0 };
+  guint64 offset;
+
+  if (image->len % ACTION_IMAGE_ALIGN != 0)
+    {
+      g_byte_array_append (image, padding,
+                           ACTION_IMAGE_ALIGN
+                               - (image->len % ACTION_IMAGE_ALIGN));
+    }
+  offset = image->len;
+  if (size > 0)
+    {
+      g_byte_array_append (image, data, size);
+    }
+
+  return offset;
+}
+
+gboolean
+action_image_write (const gchar *path, const gchar *directory,
+                    const ActionImageFile *files, guint n_files,
+                    GError **error)
+{
+  ActionImageWriter writer = { 0 };
+  ActionImageHeader header = { 0 };
+  ActionImageFileRecord *records = NULL;
+  GByteArray *image = NULL;
+  gchar *dir = NULL;
+  gboolean ret = FALSE;
+  guint n;
+
+  writer.pool = g_byte_array_new ();
+  writer.strings = g_hash_table_new (g_str_hash, g_str_equal);
+  writer.actions = g_array_new (FALSE, TRUE, sizeof (ActionImageActionRecord));
+  writer.pairs = g_array_new (FALSE, TRUE, sizeof (ActionImagePair));
+  records = g_new0 (ActionImageFileRecord, MAX (n_files, 1));
+
+  header.directory = action_image_writer_add_string (&writer, directory);
+  for (n = 0; n < n_files; n++)
+    {
+      const ActionImageFile *file = &files[n];
+      guint i;
+
+      records[n].stamp = file->stamp;
+      records[n].name = action_image_writer_add_string (&writer, file->name);
+      records[n].first_action = writer.actions->len;
+      records[n].n_actions = file->n_actions;
+      for (i = 0; i < file->n_actions; i++)
+        {
+          action_image_writer_add_action (&writer, &file->actions[i]);
+        }
+    }
+
+  /* Offsets are 32-bit, which is plenty for any sane actions directory */
+  if (writer.pool->len >= ACTION_IMAGE_NO_STRING)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   "Too many actions for an image");
+      goto out;
+    }
+
+  image = g_byte_array_new ();
+  action_image_append (image, &header, sizeof (header));
+  header.magic = ACTION_IMAGE_MAGIC;
+  header.version = ACTION_IMAGE_VERSION;
+  header.n_files = n_files;
+  header.n_actions = writer.actions->len;
+  header.n_pairs = writer.pairs->len;
+  header.files = action_image_append (image, records,
+                                      n_files * sizeof (*records));
+  header.actions = action_image_append (
+      image, writer.actions->data,
+      writer.actions->len * sizeof (ActionImageActionRecord));
+  header.pairs = action_image_append (
+      image, writer.pairs->data, writer.pairs->len * sizeof (ActionImagePair));
+  header.pool_size = writer.pool->len;
+  header.pool
+      = action_image_append (image, writer.pool->data, writer.pool->len);
+  header.size = image->len;
+  memcpy (image->data, &header, sizeof (header));
+
+  dir = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      int errsv = errno;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "Failed to create %s: %s", dir, g_strerror (errsv));
+      goto out;
+    }
+
+  /* Written to a temporary file and renamed over, so that a running
+   * polkitd keeps its mapping of the old image */
+  ret = g_file_set_contents (path, (const gchar *)image->data, image->len,
+                             error);
+
+out:
+  g_free (dir);
+  g_free (records);
+  if (image)
+    {
+      g_byte_array_unref (image);
+    }
+  g_array_unref (writer.pairs);
+  g_array_unref (writer.actions);
+  g_hash_table_unref (writer.strings);
+  g_byte_array_unref (writer.pool);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * Ensure [offset, offset + n * size) lies within the image
+ */
+static gboolean
+action_image_check_range (gsize length, guint64 offset, guint64 n,
+                          guint64 size)
+{
+  if (offset > length || offset % ACTION_IMAGE_ALIGN != 0)
+    {
+      return FALSE;
+    }
+  if (size != 0 && n > (length - offset) / size)
+    {
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/**
+ * The pool ends in a NUL, so any offset within it is a terminated string
+ */
+static gboolean
+action_image_check_string (const ActionImageHeader *header, guint32 str,
+                           gboolean nullable)
+{
+  if (str == ACTION_IMAGE_NO_STRING)
+    {
+      return nullable;
+    }
+  return str < header->pool_size;
+}
+
+static gboolean
+action_image_check_implicit (gint32 value)
+{
+  return value >= POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN
+         && value <= POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED;
+}
+
+/**
+ * Lookups index the tables without any further checks, so make sure none
+ * of the records can point outside of them
+ */
+static gboolean
+action_image_check (const ActionImage *image)
+{
+  const ActionImageHeader *header = image->header;
+  guint n;
+
+  if (header->pool_size > 0 && image->pool[header->pool_size - 1] != '\0')
+    {
+      return FALSE;
+    }
+  if (!action_image_check_string (header, header->directory, FALSE))
+    {
+      return FALSE;
+    }
+
+  for (n = 0; n < header->n_files; n++)
+    {
+      const ActionImageFileRecord *file = &image->files[n];
+
+      if (!action_image_check_string (header, file->name, FALSE)
+          || file->first_action > header->n_actions
+          || file->n_actions > header->n_actions - file->first_action)
+        {
+          return FALSE;
+        }
+    }
+
+  for (n = 0; n < header->n_actions; n++)
+    {
+      const ActionImageActionRecord *action = &image->actions[n];
+      guint64 n_pairs = (guint64)action->n_descriptions + action->n_messages
+                        + action->n_annotations;
+
+      if (!action_image_check_string (header, action->action_id, FALSE)
+          || !action_image_check_string (header, action->vendor_name, TRUE)
+          || !action_image_check_string (header, action->vendor_url, TRUE)
+          || !action_image_check_string (header, action->icon_name, TRUE)
+          || !action_image_check_string (header, action->description, TRUE)
+          || !action_image_check_string (header, action->message, TRUE)
+          || !action_image_check_implicit (action->implicit_authorization_any)
+          || !action_image_check_implicit (
+                 action->implicit_authorization_inactive)
+          || !action_image_check_implicit (
+                 action->implicit_authorization_active)
+          || action->first_pair > header->n_pairs
+          || n_pairs > header->n_pairs - action->first_pair)
+        {
+          return FALSE;
+        }
+    }
+
+  for (n = 0; n < header->n_pairs; n++)
+    {
+      if (!action_image_check_string (header, image->pairs[n].key, FALSE)
+          || !action_image_check_string (header, image->pairs[n].value, FALSE))
+        {
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+ActionImage *
+action_image_read (const gchar *path, const gchar *directory, GError **error)
+{
+  ActionImage *image = NULL;
+  GMappedFile *mapped = NULL;
+  const gchar *data = NULL;
+  const ActionImageHeader *header = NULL;
+  gsize length;
+
+  mapped = g_mapped_file_new (path, FALSE, error);
+  if (!mapped)
+    {
+      return NULL;
+    }
+  data = g_mapped_file_get_contents (mapped);
+  length = g_mapped_file_get_length (mapped);
+
+  /* Mappings are page aligned, so the tables may be used in place */
+  if (length < sizeof (*header))
+    {
+      goto corrupt;
+    }
+  header = (const ActionImageHeader *)data;
+  if (header->magic != ACTION_IMAGE_MAGIC || header->size != length)
+    {
+      goto corrupt;
+    }
+  if (header->version != ACTION_IMAGE_VERSION)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Image %s is from another version", path);
+      goto fail;
+    }
+  if (!action_image_check_range (length, header->files, header->n_files,
+                                 sizeof (ActionImageFileRecord))
+      || !action_image_check_range (length, header->actions, header->n_actions,
+                                    sizeof (ActionImageActionRecord))
+      || !action_image_check_range (length, header->pairs, header->n_pairs,
+                                    sizeof (ActionImagePair))
+      || !action_image_check_range (length, header->pool, header->pool_size,
+                                    1))
+    {
+      goto corrupt;
+    }
+
+  image = g_new0 (ActionImage, 1);
+  image->ref_count = 1;
+  image->mapped = mapped;
+  image->header = header;
+  image->files = (const ActionImageFileRecord *)(data + header->files);
+  image->actions = (const ActionImageActionRecord *)(data + header->actions);
+  image->pairs = (const ActionImagePair *)(data + header->pairs);
+  image->pool = data + header->pool;
+
+  if (!action_image_check (image))
+    {
+      g_free (image);
+      image = NULL;
+      goto corrupt;
+    }
+
+  if (g_strcmp0 (image->pool + header->directory, directory) != 0)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Image %s is of another directory", path);
+      action_image_unref (image);
+      return NULL;
+    }
+
+  return image;
+
+corrupt:
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Image %s is corrupt",
+               path);
+fail:
+  g_mapped_file_unref (mapped);
+  return NULL;
+}
+
+ActionImage *
+action_image_ref (ActionImage *image)
+{
+  g_atomic_int_inc (&image->ref_count);
+  return image;
+}
+
+void
+action_image_unref (ActionImage *image)
+{
+  if (!g_atomic_int_dec_and_test (&image->ref_count))
+    {
+      return;
+    }
+  g_mapped_file_unref (image->mapped);
+  g_free (image);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static const gchar *
+action_image_string (ActionImage *image, guint32 str)
+{
+  if (str == ACTION_IMAGE_NO_STRING)
+    {
+      return NULL;
+    }
+  return image->pool + str;
+}
+
+static const ActionImageActionRecord *
+action_image_action (ActionImage *image, guint file, guint n)
+{
+  g_assert (file < image->header->n_files);
+  g_assert (n < image->files[file].n_actions);
+  return &image->actions[image->files[file].first_action + n];
+}
+
+guint
+action_image_get_n_files (ActionImage *image)
+{
+  return image->header->n_files;
+}
+
+const gchar *
+action_image_get_file_name (ActionImage *image, guint file)
+{
+  g_assert (file < image->header->n_files);
+  return action_image_string (image, image->files[file].name);
+}
+
+void
+action_image_get_file_stamp (ActionImage *image, guint file,
+                             ActionImageStamp *stamp)
+{
+  g_assert (file < image->header->n_files);
+  *stamp = image->files[file].stamp;
+}
+
+guint
+action_image_get_n_actions (ActionImage *image, guint file)
+{
+  g_assert (file < image->header->n_files);
+  return image->files[file].n_actions;
+}
+
+const gchar *
+action_image_get_action_id (ActionImage *image, guint file, guint n)
+{
+  return action_image_string (image,
+                              action_image_action (image, file, n)->action_id);
+}
+
+static GHashTable *
+action_image_get_pairs (ActionImage *image, guint first, guint n_pairs)
+{
+  GHashTable *table = NULL;
+  guint n;
+
+  table = g_hash_table_new (g_str_hash, g_str_equal);
+  for (n = first; n < first + n_pairs; n++)
+    {
+      g_hash_table_insert (
+          table, (gpointer)action_image_string (image, image->pairs[n].key),
+          (gpointer)action_image_string (image, image->pairs[n].value));
+    }
+  return table;
+}
+
+void
+action_image_get_action (ActionImage *image, guint file, guint n,
+                         ActionImageAction *action)
+{
+  const ActionImageActionRecord *record = NULL;
+  guint first;
+
+  record = action_image_action (image, file, n);
+
+  action->action_id = action_image_string (image, record->action_id);
+  action->vendor_name = action_image_string (image, record->vendor_name);
+  action->vendor_url = action_image_string (image, record->vendor_url);
+  action->icon_name = action_image_string (image, record->icon_name);
+  action->description = action_image_string (image, record->description);
+  action->message = action_image_string (image, record->message);
+  action->implicit_authorization_any = record->implicit_authorization_any;
+  action->implicit_authorization_inactive
+      = record->implicit_authorization_inactive;
+  action->implicit_authorization_active
+      = record->implicit_authorization_active;
+
+  first = record->first_pair;
+  action->localized_description
+      = action_image_get_pairs (image, first, record->n_descriptions);
+  first += record->n_descriptions;
+  action->localized_message
+      = action_image_get_pairs (image, first, record->n_messages);
+  first += record->n_messages;
+  action->annotations
+      = action_image_get_pairs (image, first, record->n_annotations);
+}
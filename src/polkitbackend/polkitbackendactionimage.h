@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_ACTION_IMAGE_H
+#define __POLKIT_BACKEND_ACTION_IMAGE_H
+
+#include <glib.h>
+#include <polkit/polkit.h>
+
+/**
+ * Bump whenever the layout of the image changes
+ */
+#define ACTION_IMAGE_VERSION 1
+
+/**
+ * ActionImage is a mapped, validated image of parsed .policy files
+ */
+typedef struct ActionImage ActionImage;
+
+/**
+ * ActionImageStamp identifies the version of a .policy file an image
+ * record was parsed from
+ */
+typedef struct ActionImageStamp
+{
+  guint64 inode;
+  guint64 size;
+  guint64 mtime;
+} ActionImageStamp;
+
+/**
+ * A single action, as handed to or read back from an image
+ */
+typedef struct ActionImageAction
+{
+  const gchar *action_id;
+  const gchar *vendor_name;
+  const gchar *vendor_url;
+  const gchar *icon_name;
+  const gchar *description;
+  const gchar *message;
+
+  PolkitImplicitAuthorization implicit_authorization_any;
+  PolkitImplicitAuthorization implicit_authorization_inactive;
+  PolkitImplicitAuthorization implicit_authorization_active;
+
+  GHashTable *localized_description; /**<Locale to string */
+  GHashTable *localized_message;     /**<Locale to string */
+  GHashTable *annotations;           /**<Key to value */
+} ActionImageAction;
+
+/**
+ * A .policy file and the actions parsed from it
+ */
+typedef struct ActionImageFile
+{
+  const gchar *name; /**<Basename within the image's directory */
+  ActionImageStamp stamp;
+  const ActionImageAction *actions;
+  guint n_actions;
+} ActionImageFile;
+
+/**
+ * Atomically replace the image at @path with the given files of
+ * @directory
+ */
+gboolean action_image_write (const gchar *path, const gchar *directory,
+                             const ActionImageFile *files, guint n_files,
+                             GError **error);
+
+/**
+ * Map and validate the image at @path, or return NULL if it is missing,
+ * corrupt, from another version or of another directory than @directory.
+ */
+ActionImage *action_image_read (const gchar *path, const gchar *directory,
+                                GError **error);
+
+ActionImage *action_image_ref (ActionImage *image);
+void action_image_unref (ActionImage *image);
+
+guint action_image_get_n_files (ActionImage *image);
+const gchar *action_image_get_file_name (ActionImage *image, guint file);
+void action_image_get_file_stamp (ActionImage *image, guint file,
+                                  ActionImageStamp *stamp);
+
+guint action_image_get_n_actions (ActionImage *image, guint file);
+const gchar *action_image_get_action_id (ActionImage *image, guint file,
+                                         guint n);
+
+/**
+ * Read back action @n of @file. The tables are built on demand and owned
+ * by the caller, but all of the strings, including those in the tables,
+ * point into @image.
+ */
+void action_image_get_action (ActionImage *image, guint file, guint n,
+                              ActionImageAction *action);
+
+#endif /* __POLKIT_BACKEND_ACTION_IMAGE_H */
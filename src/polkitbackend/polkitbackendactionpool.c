@@ -29,6 +29,7 @@
 #include <polkit/polkitprivate.h>
 
 #include "polkitbackendactionpool.h"
+#include "polkitbackendactionimage.h"
 
 /* <internal>
  * SECTION:polkitbackendactionpool
@@ -38,13 +39,81 @@
  * The #PolkitBackendActionPool class is a utility class to look up registered PolicyKit actions.
  */
 
+/* Owns the strings of a generation of actions: those parsed from the same
+ * file, interned so that e.g. the vendor is only stored once, or those read
+ * back from the same cache image. The strings are all freed at once, when
+ * the last action (or description handed out for one) goes away.
+ */
+typedef struct
+{
+  volatile gint ref_count;
+
+  GStringChunk *chunk;
+  gsize chunk_size; /* bytes interned into the chunk, duplicates included */
+
+  /* the image the strings point into, instead of the chunk */
+  ActionImage *image;
+} ActionStrings;
+
+/* Big enough for the strings of a typical .policy file */
+#define ACTION_STRINGS_CHUNK_SIZE 4096
+
+static ActionStrings *
+action_strings_new (ActionImage *image)
+{
+  ActionStrings *strings;
+
+  strings = g_new0 (ActionStrings, 1);
+  strings->ref_count = 1;
+  if (image != NULL)
+    strings->image = action_image_ref (image);
+  else
+    strings->chunk = g_string_chunk_new (ACTION_STRINGS_CHUNK_SIZE);
+
+  return strings;
+}
+
+static ActionStrings *
+action_strings_ref (ActionStrings *strings)
+{
+  g_atomic_int_inc (&strings->ref_count);
+  return strings;
+}
+
+static void
+action_strings_unref (ActionStrings *strings)
+{
+  if (!g_atomic_int_dec_and_test (&strings->ref_count))
+    return;
+
+  if (strings->chunk != NULL)
+    g_string_chunk_free (strings->chunk);
+  if (strings->image != NULL)
+    action_image_unref (strings->image);
+  g_free (strings);
+}
+
+static const gchar *
+action_strings_intern (ActionStrings *strings,
+                       const gchar   *str)
+{
+  if (str == NULL)
+    return NULL;
+
+  strings->chunk_size += strlen (str) + 1;
+  return g_string_chunk_insert_const (strings->chunk, str);
+}
+
 typedef struct
 {
-  gchar *vendor_name;
-  gchar *vendor_url;
-  gchar *icon_name;
-  gchar *description;
-  gchar *message;
+  /* all strings, including those in the tables, belong to this */
+  ActionStrings *strings;
+
+  const gchar *vendor_name;
+  const gchar *vendor_url;
+  const gchar *icon_name;
+  const gchar *description;
+  const gchar *message;
 
   PolkitImplicitAuthorization implicit_authorization_any;
   PolkitImplicitAuthorization implicit_authorization_inactive;
@@ -61,28 +130,84 @@ typedef struct
 static void
 parsed_action_free (ParsedAction *action)
 {
-  g_free (action->vendor_name);
-  g_free (action->vendor_url);
-  g_free (action->icon_name);
-  g_free (action->description);
-  g_free (action->message);
-
   g_hash_table_unref (action->localized_description);
   g_hash_table_unref (action->localized_message);
 
   g_hash_table_unref (action->annotations);
-  g_free (action);
+
+  action_strings_unref (action->strings);
+  g_slice_free (ParsedAction, action);
+}
+
+/* The actions of a single file, parsed without touching the pool so that
+ * several files can be parsed at once
+ */
+typedef struct
+{
+  GFile *file;
+
+  /* the strings of the actions below */
+  ActionStrings *strings;
+
+  /* in the order they appear in the file */
+  GPtrArray *action_ids;
+  GPtrArray *actions;
+
+  /* is TRUE only if the whole file was parsed */
+  gboolean complete;
+} ParsedFile;
+
+static ParsedFile *
+parsed_file_new (GFile *file)
+{
+  ParsedFile *parsed;
+
+  parsed = g_new0 (ParsedFile, 1);
+  parsed->file = g_object_ref (file);
+  parsed->strings = action_strings_new (NULL);
+  parsed->action_ids = g_ptr_array_new_with_free_func (g_free);
+  parsed->actions = g_ptr_array_new ();
+
+  return parsed;
+}
+
+static void
+parsed_file_free (ParsedFile *parsed)
+{
+  guint n;
+
+  /* actions that were added to the pool are NULL */
+  for (n = 0; n < parsed->actions->len; n++)
+    {
+      if (parsed->actions->pdata[n] != NULL)
+        parsed_action_free (parsed->actions->pdata[n]);
+    }
+
+  g_object_unref (parsed->file);
+  action_strings_unref (parsed->strings);
+  g_ptr_array_free (parsed->action_ids, TRUE);
+  g_ptr_array_free (parsed->actions, TRUE);
+  g_free (parsed);
 }
 
-static gboolean process_policy_file (PolkitBackendActionPool *pool,
+/* Files are parsed on at most this many threads at once */
+#define ACTION_POOL_MAX_PARSER_THREADS 8
+
+static gboolean process_policy_file (ParsedFile *parsed,
                                      const gchar *xml,
                                      GError **error);
 
-static void ensure_file (PolkitBackendActionPool *pool,
-                         GFile *file);
+static gchar **ensure_file (PolkitBackendActionPool *pool,
+                            GFile *file);
 
 static void ensure_all_files (PolkitBackendActionPool *pool);
 
+static void ensure_index (PolkitBackendActionPool *pool);
+
+static void ensure_exec_paths (PolkitBackendActionPool *pool);
+
+static void save_cache (PolkitBackendActionPool *pool);
+
 static const gchar *_localize (GHashTable *translations,
                                const gchar *untranslated,
                                const gchar *lang);
@@ -97,18 +222,135 @@ typedef struct
   /* maps from action_id to a ParsedAction struct */
   GHashTable *parsed_actions;
 
-  /* maps from URI of parsed file to nothing */
+  /* maps from URI of parsed file to a NULL-terminated array of the action ids it defines */
   GHashTable *parsed_files;
 
   /* is TRUE only when we've read all files */
   gboolean has_loaded_all_files;
 
+  /* where the parsed files are saved between runs, or NULL */
+  gchar *cache_file;
+
+  /* maps from basename of a .policy file to an IndexedFile struct */
+  GHashTable *indexed_files;
+
+  /* maps from action_id to the basename of the file defining it */
+  GHashTable *action_files;
+
+  /* is TRUE only when the index matches the directory */
+  gboolean has_index;
+
+  /* maps from locale ("" for the system locale) to a hash table mapping
+   * from action_id to the PolkitActionDescription handed out for it
+   */
+  GHashTable *descriptions;
+
+  /* maps from action_id to a NULL-terminated array of the ids of the
+   * actions implying it, or NULL when it needs to be rebuilt
+   */
+  GHashTable *implied_by;
+
+  /* maps from the value of the org.freedesktop.policykit.exec.path
+   * annotation to a sorted NULL-terminated array of the ids of the
+   * actions carrying it, or NULL when it needs to be rebuilt
+   */
+  GHashTable *exec_paths;
+
+  /* set of action ids looked up but not registered, until a file in
+   * the directory changes
+   */
+  GHashTable *unknown_actions;
+
+  /* when a lookup of an unknown action was last warned about, and how
+   * many weren't since
+   */
+  gint64 unknown_warned;
+  guint n_unknown_unwarned;
+
 } PolkitBackendActionPoolPrivate;
 
+/* Descriptions are only kept for this many locales; callers pick the
+ * locale so this bounds how much memory they can make us hold on to
+ */
+#define ACTION_POOL_MAX_LOCALES 16
+
+/* Callers pick the action ids too, so at most this many unknown ones
+ * are remembered before starting over
+ */
+#define ACTION_POOL_MAX_UNKNOWN_ACTIONS 256
+
+/* Lookups of unknown actions are warned about at most this often, in
+ * microseconds, so that a client asking for one in a loop doesn't flood
+ * the journal
+ */
+#define ACTION_POOL_UNKNOWN_WARN_INTERVAL (60 * G_USEC_PER_SEC)
+
+typedef struct
+{
+  /* identifies the contents the action ids were read from */
+  ActionImageStamp stamp;
+
+  gchar **action_ids;
+
+  /* the cache the actions can be read back from instead of parsing
+   * the file, or NULL
+   */
+  ActionStrings *cached;
+  guint image_file;
+} IndexedFile;
+
+static void
+indexed_file_free (IndexedFile *indexed)
+{
+  g_strfreev (indexed->action_ids);
+  if (indexed->cached != NULL)
+    action_strings_unref (indexed->cached);
+  g_free (indexed);
+}
+
+static ParsedAction *
+parsed_action_new_from_image (ActionStrings *strings,
+                              guint          file,
+                              guint          n)
+{
+  ParsedAction *action;
+  ActionImageAction cached;
+
+  action_image_get_action (strings->image, file, n, &cached);
+
+  action = g_slice_new0 (ParsedAction);
+  action->strings = action_strings_ref (strings);
+  action->vendor_name = cached.vendor_name;
+  action->vendor_url = cached.vendor_url;
+  action->icon_name = cached.icon_name;
+  action->description = cached.description;
+  action->message = cached.message;
+
+  action->localized_description = cached.localized_description;
+  action->localized_message     = cached.localized_message;
+  action->annotations           = cached.annotations;
+
+  action->implicit_authorization_any = cached.implicit_authorization_any;
+  action->implicit_authorization_inactive = cached.implicit_authorization_inactive;
+  action->implicit_authorization_active = cached.implicit_authorization_active;
+
+  return action;
+}
+
+static void
+stamp_from_file_info (GFileInfo        *file_info,
+                      ActionImageStamp *stamp)
+{
+  stamp->inode = g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_UNIX_INODE);
+  stamp->size = g_file_info_get_size (file_info);
+  stamp->mtime = g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+}
+
 enum
 {
   PROP_0,
   PROP_DIRECTORY,
+  PROP_CACHE_FILE,
 };
 
 #define POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), POLKIT_BACKEND_TYPE_ACTION_POOL, PolkitBackendActionPoolPrivate))
@@ -138,7 +380,27 @@ polkit_backend_action_pool_init (PolkitBackendActionPool *pool)
   priv->parsed_files = g_hash_table_new_full (g_str_hash,
                                               g_str_equal,
                                               g_free,
-                                              NULL);
+                                              (GDestroyNotify) g_strfreev);
+
+  priv->indexed_files = g_hash_table_new_full (g_str_hash,
+                                               g_str_equal,
+                                               g_free,
+                                               (GDestroyNotify) indexed_file_free);
+
+  priv->action_files = g_hash_table_new_full (g_str_hash,
+                                              g_str_equal,
+                                              g_free,
+                                              g_free);
+
+  priv->descriptions = g_hash_table_new_full (g_str_hash,
+                                              g_str_equal,
+                                              g_free,
+                                              (GDestroyNotify) g_hash_table_unref);
+
+  priv->unknown_actions = g_hash_table_new_full (g_str_hash,
+                                                 g_str_equal,
+                                                 g_free,
+                                                 NULL);
 }
 
 static void
@@ -162,6 +424,26 @@ polkit_backend_action_pool_finalize (GObject *object)
   if (priv->parsed_files != NULL)
     g_hash_table_unref (priv->parsed_files);
 
+  if (priv->indexed_files != NULL)
+    g_hash_table_unref (priv->indexed_files);
+
+  if (priv->action_files != NULL)
+    g_hash_table_unref (priv->action_files);
+
+  if (priv->descriptions != NULL)
+    g_hash_table_unref (priv->descriptions);
+
+  if (priv->implied_by != NULL)
+    g_hash_table_unref (priv->implied_by);
+
+  if (priv->exec_paths != NULL)
+    g_hash_table_unref (priv->exec_paths);
+
+  if (priv->unknown_actions != NULL)
+    g_hash_table_unref (priv->unknown_actions);
+
+  g_free (priv->cache_file);
+
   G_OBJECT_CLASS (polkit_backend_action_pool_parent_class)->finalize (object);
 }
 
@@ -183,12 +465,289 @@ polkit_backend_action_pool_get_property (GObject     *object,
       g_value_set_object (value, priv->directory);
       break;
 
+    case PROP_CACHE_FILE:
+      g_value_set_string (value, priv->cache_file);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
     }
 }
 
+static void
+add_affected (GPtrArray   *affected,
+              const gchar *action_id)
+{
+  guint n;
+
+  for (n = 0; n < affected->len; n++)
+    {
+      if (strcmp (affected->pdata[n], action_id) == 0)
+        return;
+    }
+  g_ptr_array_add (affected, g_strdup (action_id));
+}
+
+/* Drops the parsed form of @action_id and the descriptions handed out for it */
+static void
+forget_action (PolkitBackendActionPool *pool,
+               const gchar             *action_id,
+               GPtrArray               *affected)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTableIter hash_iter;
+  GHashTable *descriptions;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  g_hash_table_remove (priv->parsed_actions, action_id);
+
+  g_hash_table_iter_init (&hash_iter, priv->descriptions);
+  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &descriptions))
+    g_hash_table_remove (descriptions, action_id);
+
+  add_affected (affected, action_id);
+}
+
+/* Drops everything known about the actions @name used to define, but for
+ * those another file wins
+ */
+static void
+forget_actions (PolkitBackendActionPool *pool,
+                gchar                  **action_ids,
+                const gchar             *name,
+                GPtrArray               *affected)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  const gchar *owner;
+  guint n;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  for (n = 0; action_ids != NULL && action_ids[n] != NULL; n++)
+    {
+      owner = g_hash_table_lookup (priv->action_files, action_ids[n]);
+      if (owner != NULL && strcmp (owner, name) != 0)
+        continue;
+
+      g_hash_table_remove (priv->action_files, action_ids[n]);
+      forget_action (pool, action_ids[n], affected);
+    }
+}
+
+static gboolean
+strv_contains (gchar       **strv,
+               const gchar  *str)
+{
+  guint n;
+
+  for (n = 0; strv != NULL && strv[n] != NULL; n++)
+    {
+      if (strcmp (strv[n], str) == 0)
+        return TRUE;
+    }
+  return FALSE;
+}
+
+/* Forgets the actions in @action_ids that files other than @name define
+ * as well, along with what was parsed of every file defining them. Which
+ * file wins depends on the order the directory lists them in, so they
+ * are only looked up again once it has been listed anew.
+ */
+static void
+forget_shared_actions (PolkitBackendActionPool *pool,
+                       gchar                  **action_ids,
+                       const gchar             *name,
+                       GPtrArray               *affected)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTableIter hash_iter;
+  const gchar *other_name;
+  IndexedFile *indexed;
+  GPtrArray *files;
+  gchar *uri;
+  gchar **ids;
+  guint n;
+  guint m;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  files = g_ptr_array_new_with_free_func (g_free);
+
+  for (n = 0; action_ids != NULL && action_ids[n] != NULL; n++)
+    {
+      gboolean shared;
+
+      shared = FALSE;
+      g_ptr_array_set_size (files, 0);
+
+      g_hash_table_iter_init (&hash_iter, priv->indexed_files);
+      while (g_hash_table_iter_next (&hash_iter, (gpointer) &other_name, (gpointer) &indexed))
+        {
+          if (!strv_contains (indexed->action_ids, action_ids[n]))
+            continue;
+          if (strcmp (other_name, name) != 0)
+            shared = TRUE;
+          g_ptr_array_add (files, g_strdup (other_name));
+        }
+
+      g_hash_table_iter_init (&hash_iter, priv->parsed_files);
+      while (g_hash_table_iter_next (&hash_iter, (gpointer) &uri, (gpointer) &ids))
+        {
+          GFile *file;
+          gchar *basename;
+
+          if (!strv_contains (ids, action_ids[n]))
+            continue;
+          file = g_file_new_for_uri (uri);
+          basename = g_file_get_basename (file);
+          g_object_unref (file);
+          if (strcmp (basename, name) != 0)
+            shared = TRUE;
+          g_ptr_array_add (files, basename);
+        }
+
+      if (!shared)
+        continue;
+
+      /* so that the file winning it is parsed again when it's looked up */
+      for (m = 0; m < files->len; m++)
+        {
+          GFile *file;
+
+          file = g_file_get_child (priv->directory, files->pdata[m]);
+          uri = g_file_get_uri (file);
+          g_hash_table_remove (priv->parsed_files, uri);
+          g_free (uri);
+          g_object_unref (file);
+        }
+
+      g_hash_table_remove (priv->action_files, action_ids[n]);
+      forget_action (pool, action_ids[n], affected);
+
+      priv->has_index = FALSE;
+      priv->has_loaded_all_files = FALSE;
+    }
+
+  g_ptr_array_free (files, TRUE);
+}
+
+/* Drops the indexes built from annotations, they are rebuilt on demand */
+static void
+forget_annotation_indexes (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  if (priv->implied_by != NULL)
+    {
+      g_hash_table_unref (priv->implied_by);
+      priv->implied_by = NULL;
+    }
+
+  if (priv->exec_paths != NULL)
+    {
+      g_hash_table_unref (priv->exec_paths);
+      priv->exec_paths = NULL;
+    }
+}
+
+/* Brings the pool up to date with @file having been created, changed
+ * or deleted; the other files are only read again for the actions they
+ * share with it
+ */
+static void
+update_file (PolkitBackendActionPool *pool,
+             GFile                   *file,
+             const gchar             *name,
+             gboolean                 deleted,
+             GPtrArray               *affected)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  IndexedFile *indexed;
+  gchar **parsed_ids;
+  gchar **indexed_ids;
+  gchar **action_ids;
+  gchar *uri;
+  guint n;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  action_ids = NULL;
+  uri = g_file_get_uri (file);
+
+  /* copied, as shared actions take the parsed files defining them along */
+  parsed_ids = g_strdupv (g_hash_table_lookup (priv->parsed_files, uri));
+  indexed = g_hash_table_lookup (priv->indexed_files, name);
+  indexed_ids = indexed != NULL ? g_strdupv (indexed->action_ids) : NULL;
+
+  /* what the file used to define may fall back to another file */
+  forget_shared_actions (pool, parsed_ids, name, affected);
+  forget_shared_actions (pool, indexed_ids, name, affected);
+  forget_actions (pool, parsed_ids, name, affected);
+  forget_actions (pool, indexed_ids, name, affected);
+
+  g_hash_table_remove (priv->parsed_files, uri);
+  g_hash_table_remove (priv->indexed_files, name);
+
+  forget_annotation_indexes (pool);
+
+  /* the file may define any of them now */
+  g_hash_table_remove_all (priv->unknown_actions);
+
+  /* nothing needs the file parsed until it is looked up or indexed */
+  if (deleted || !(priv->has_loaded_all_files || priv->has_index))
+    goto out;
+
+  action_ids = g_strdupv (ensure_file (pool, file));
+  for (n = 0; action_ids != NULL && action_ids[n] != NULL; n++)
+    add_affected (affected, action_ids[n]);
+
+  /* and what it defines now may be defined elsewhere as well */
+  forget_shared_actions (pool, action_ids, name, affected);
+
+  if (priv->has_index)
+    {
+      GFileInfo *file_info;
+
+      file_info = g_file_query_info (file,
+                                     "standard::size,time::modified,unix::inode",
+                                     G_FILE_QUERY_INFO_NONE,
+                                     NULL,
+                                     NULL);
+      if (file_info == NULL)
+        {
+          /* gone again already; the next lookup will find out */
+          priv->has_index = FALSE;
+          goto out;
+        }
+
+      indexed = g_new0 (IndexedFile, 1);
+      stamp_from_file_info (file_info, &indexed->stamp);
+      indexed->action_ids = action_ids != NULL ? g_strdupv (action_ids) : g_new0 (gchar *, 1);
+      g_hash_table_insert (priv->indexed_files, g_strdup (name), indexed);
+      g_object_unref (file_info);
+
+      for (n = 0; indexed->action_ids[n] != NULL; n++)
+        {
+          g_hash_table_insert (priv->action_files,
+                               g_strdup (indexed->action_ids[n]),
+                               g_strdup (name));
+        }
+    }
+
+ out:
+  if (priv->has_index && priv->cache_file != NULL)
+    save_cache (pool);
+
+  g_strfreev (action_ids);
+  g_strfreev (parsed_ids);
+  g_strfreev (indexed_ids);
+  g_free (uri);
+}
+
 static void
 dir_monitor_changed (GFileMonitor     *monitor,
                      GFile            *file,
@@ -197,10 +756,8 @@ dir_monitor_changed (GFileMonitor     *monitor,
                      gpointer          user_data)
 {
   PolkitBackendActionPool *pool;
-  PolkitBackendActionPoolPrivate *priv;
 
   pool = POLKIT_BACKEND_ACTION_POOL (user_data);
-  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
 
   /* TODO: maybe rate-limit so storms of events are collapsed into one with a 500ms resolution?
    *       Because when editing a file with emacs we get 4-8 events..
@@ -221,22 +778,28 @@ dir_monitor_changed (GFileMonitor     *monitor,
            event_type == G_FILE_MONITOR_EVENT_DELETED ||
            event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT))
         {
+          GPtrArray *affected;
 
           //g_debug ("match");
 
-          /* now throw away all caches */
-          g_hash_table_remove_all (priv->parsed_files);
-          g_hash_table_remove_all (priv->parsed_actions);
-          priv->has_loaded_all_files = FALSE;
+          /* only the actions of this file are thrown away */
+          affected = g_ptr_array_new ();
+          update_file (pool,
+                       file,
+                       name,
+                       event_type == G_FILE_MONITOR_EVENT_DELETED,
+                       affected);
+          g_ptr_array_add (affected, NULL);
+
+          g_signal_emit_by_name (pool, "changed", affected->pdata);
 
-          g_signal_emit_by_name (pool, "changed");
+          g_strfreev ((gchar **) g_ptr_array_free (affected, FALSE));
         }
 
       g_free (name);
     }
 }
 
-
 static void
 polkit_backend_action_pool_set_property (GObject       *object,
                                          guint          prop_id,
@@ -274,6 +837,10 @@ polkit_backend_action_pool_set_property (GObject       *object,
         }
       break;
 
+    case PROP_CACHE_FILE:
+      priv->cache_file = g_value_dup_string (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -308,9 +875,30 @@ polkit_backend_action_pool_class_init (PolkitBackendActionPoolClass *klass)
                                                         G_PARAM_STATIC_NICK |
                                                         G_PARAM_STATIC_BLURB));
 
+  /**
+   * PolkitBackendActionPool:cache-file:
+   *
+   * The file to save the parsed action description files to, so that
+   * unchanged files need not be parsed again, or %NULL to parse every
+   * file that is used.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_CACHE_FILE,
+                                   g_param_spec_string ("cache-file",
+                                                        "Cache file",
+                                                        "File to save the parsed action description files to",
+                                                        NULL,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_NAME |
+                                                        G_PARAM_STATIC_NICK |
+                                                        G_PARAM_STATIC_BLURB));
+
   /**
    * PolkitBackendActionPool::changed:
    * @action_pool: A #PolkitBackendActionPool.
+   * @action_ids: A %NULL-terminated array of the identifiers of the
+   *   actions that were added, changed or removed.
    *
    * Emitted when action files in the supplied directory changes.
    */
@@ -320,9 +908,10 @@ polkit_backend_action_pool_class_init (PolkitBackendActionPoolClass *klass)
                                           0,                      /* class offset     */
                                           NULL,                   /* accumulator      */
                                           NULL,                   /* accumulator data */
-                                          g_cclosure_marshal_VOID__VOID,
+                                          g_cclosure_marshal_VOID__BOXED,
                                           G_TYPE_NONE,
-                                          0);
+                                          1,
+                                          G_TYPE_STRV);
 }
 
 /**
@@ -345,7 +934,99 @@ polkit_backend_action_pool_new (GFile *directory)
   return pool;
 }
 
-/**
+/* Finds the parsed form of @action_id, reading just the file that defines it if need be */
+static ParsedAction *
+lookup_parsed_action (PolkitBackendActionPool *pool,
+                      const gchar             *action_id)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  ParsedAction *parsed_action;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  parsed_action = g_hash_table_lookup (priv->parsed_actions, action_id);
+  if (parsed_action != NULL || g_hash_table_contains (priv->unknown_actions, action_id))
+    goto out;
+
+  if (!priv->has_loaded_all_files)
+    {
+      const gchar *name;
+      IndexedFile *indexed;
+
+      /* only read the file that defines the action, from the cache if it's unchanged */
+      ensure_index (pool);
+      name = g_hash_table_lookup (priv->action_files, action_id);
+      indexed = name != NULL ? g_hash_table_lookup (priv->indexed_files, name) : NULL;
+      if (indexed != NULL && indexed->cached != NULL)
+        {
+          guint n;
+
+          for (n = 0; indexed->action_ids[n] != NULL; n++)
+            {
+              if (strcmp (indexed->action_ids[n], action_id) == 0)
+                {
+                  parsed_action = parsed_action_new_from_image (indexed->cached, indexed->image_file, n);
+                  g_hash_table_insert (priv->parsed_actions, g_strdup (action_id), parsed_action);
+                  break;
+                }
+            }
+        }
+      else if (name != NULL)
+        {
+          GFile *file;
+
+          file = g_file_get_child (priv->directory, name);
+          ensure_file (pool, file);
+          g_object_unref (file);
+
+          parsed_action = g_hash_table_lookup (priv->parsed_actions, action_id);
+        }
+    }
+
+  /* unless the index couldn't be built, the action isn't registered
+   * until a file changes
+   */
+  if (parsed_action == NULL && (priv->has_index || priv->has_loaded_all_files))
+    {
+      if (g_hash_table_size (priv->unknown_actions) >= ACTION_POOL_MAX_UNKNOWN_ACTIONS)
+        g_hash_table_remove_all (priv->unknown_actions);
+      g_hash_table_add (priv->unknown_actions, g_strdup (action_id));
+    }
+
+ out:
+  return parsed_action;
+}
+
+/* Warns about a lookup of the unknown action @action_id, or counts it
+ * to be mentioned with the next warning if one was given recently
+ */
+static void
+warn_unknown_action (PolkitBackendActionPool *pool,
+                     const gchar             *action_id)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  gint64 now;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  now = g_get_monotonic_time ();
+  if (priv->unknown_warned != 0 && now - priv->unknown_warned < ACTION_POOL_UNKNOWN_WARN_INTERVAL)
+    {
+      priv->n_unknown_unwarned++;
+      return;
+    }
+
+  if (priv->n_unknown_unwarned > 0)
+    g_warning ("Unknown action_id '%s' (%u more lookups of unknown actions since the last warning)",
+               action_id, priv->n_unknown_unwarned);
+  else
+    g_warning ("Unknown action_id '%s'", action_id);
+
+  priv->unknown_warned = now;
+  priv->n_unknown_unwarned = 0;
+}
+
+/**
  * polkit_backend_action_pool_get_action:
  * @pool: A #PolkitBackendActionPool.
  * @action_id: A PolicyKit action identifier.
@@ -353,6 +1034,9 @@ polkit_backend_action_pool_new (GFile *directory)
  *
  * Gets a #PolkitActionDescription object describing the action with identifier @action_id.
  *
+ * The returned object is shared with other callers asking for the
+ * same action and locale, until the actions in @pool change.
+ *
  * Returns: A #PolkitActionDescription (free with g_object_unref()) or %NULL
  *          if @action_id isn't registered or valid.
  **/
@@ -364,6 +1048,7 @@ polkit_backend_action_pool_get_action (PolkitBackendActionPool *pool,
   PolkitBackendActionPoolPrivate *priv;
   PolkitActionDescription *ret;
   ParsedAction *parsed_action;
+  GHashTable *descriptions;
   const gchar *description;
   const gchar *message;
 
@@ -371,15 +1056,24 @@ polkit_backend_action_pool_get_action (PolkitBackendActionPool *pool,
 
   priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
 
-  /* TODO: just compute the name of the expected file and ensure it's parsed */
-  ensure_all_files (pool);
-
   ret = NULL;
 
-  parsed_action = g_hash_table_lookup (priv->parsed_actions, action_id);
+  /* descriptions are immutable, so the same one is handed out until the directory changes */
+  descriptions = g_hash_table_lookup (priv->descriptions, locale != NULL ? locale : "");
+  if (descriptions != NULL)
+    {
+      ret = g_hash_table_lookup (descriptions, action_id);
+      if (ret != NULL)
+        {
+          g_object_ref (ret);
+          goto out;
+        }
+    }
+
+  parsed_action = lookup_parsed_action (pool, action_id);
   if (parsed_action == NULL)
     {
-      g_warning ("Unknown action_id '%s'", action_id);
+      warn_unknown_action (pool, action_id);
       goto out;
     }
 
@@ -401,76 +1095,577 @@ polkit_backend_action_pool_get_action (PolkitBackendActionPool *pool,
                                        parsed_action->implicit_authorization_active,
                                        parsed_action->annotations);
 
- out:
-  return ret;
+  /* the description shares the annotations, and with them our strings */
+  g_object_set_data_full (G_OBJECT (ret),
+                          "polkit-backend-action-strings",
+                          action_strings_ref (parsed_action->strings),
+                          (GDestroyNotify) action_strings_unref);
+
+  if (descriptions == NULL &&
+      g_hash_table_size (priv->descriptions) < ACTION_POOL_MAX_LOCALES)
+    {
+      descriptions = g_hash_table_new_full (g_str_hash,
+                                            g_str_equal,
+                                            g_free,
+                                            g_object_unref);
+      g_hash_table_insert (priv->descriptions,
+                           g_strdup (locale != NULL ? locale : ""),
+                           descriptions);
+    }
+
+  if (descriptions != NULL)
+    g_hash_table_insert (descriptions, g_strdup (action_id), g_object_ref (ret));
+
+ out:
+  return ret;
+}
+
+/**
+ * polkit_backend_action_pool_get_all_actions:
+ * @pool: A #PolkitBackendActionPool.
+ * @locale: The locale to get descriptions for or %NULL for system locale.
+ *
+ * Gets all registered PolicyKit action descriptions from @pool with strings for @locale.
+ *
+ * Returns: A #GList of #PolkitActionDescription objects. This list
+ *          should be freed with g_list_free() after each element have
+ *          been unreffed with g_object_unref().
+ **/
+GList *
+polkit_backend_action_pool_get_all_actions (PolkitBackendActionPool *pool,
+                                            const gchar             *locale)
+{
+  GList *ret;
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTableIter hash_iter;
+  const gchar *action_id;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool), NULL);
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  ensure_all_files (pool);
+
+  ret = NULL;
+
+  g_hash_table_iter_init (&hash_iter, priv->parsed_actions);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &action_id, NULL))
+    {
+      PolkitActionDescription *action_desc;
+
+      action_desc = polkit_backend_action_pool_get_action (pool,
+                                                           action_id,
+                                                           locale);
+
+      if (action_desc != NULL)
+        ret = g_list_prepend (ret, action_desc);
+    }
+
+  ret = g_list_reverse (ret);
+
+  return ret;
+}
+
+static gint
+compare_action_ids (gconstpointer a,
+                    gconstpointer b)
+{
+  return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+/**
+ * polkit_backend_action_pool_get_actions_page:
+ * @pool: A #PolkitBackendActionPool.
+ * @locale: The locale to get descriptions for or %NULL for system locale.
+ * @prefix: (allow-none): Only return actions whose id starts with this, or %NULL.
+ * @cursor: (allow-none): The cursor returned for the previous page, or %NULL for the first page.
+ * @limit: The maximum number of actions to return, must be greater than 0.
+ * @out_next_cursor: (out): Return location for the cursor of the next page, set to %NULL if this is the last page.
+ *
+ * Gets a page of registered actions, sorted by action id. Only the
+ * actions on the page are loaded, so this is cheaper than
+ * polkit_backend_action_pool_get_all_actions() for callers that don't
+ * need every action at once.
+ *
+ * Returns: A list of #PolkitActionDescription objects that must be
+ * freed by the caller.
+ */
+GList *
+polkit_backend_action_pool_get_actions_page (PolkitBackendActionPool  *pool,
+                                             const gchar              *locale,
+                                             const gchar              *prefix,
+                                             const gchar              *cursor,
+                                             guint                     limit,
+                                             gchar                   **out_next_cursor)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTableIter hash_iter;
+  const gchar *action_id;
+  GPtrArray *action_ids;
+  GList *ret;
+  guint n;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool), NULL);
+  g_return_val_if_fail (limit > 0, NULL);
+  g_return_val_if_fail (out_next_cursor != NULL, NULL);
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  ret = NULL;
+  *out_next_cursor = NULL;
+
+  if (prefix != NULL && *prefix == '\0')
+    prefix = NULL;
+  if (cursor != NULL && *cursor == '\0')
+    cursor = NULL;
+
+  /* the index knows every action id without loading any of the actions */
+  ensure_index (pool);
+  if (!priv->has_index)
+    ensure_all_files (pool);
+
+  /* copied, as looking the actions up may update the tables */
+  action_ids = g_ptr_array_new_with_free_func (g_free);
+  g_hash_table_iter_init (&hash_iter, priv->has_index ? priv->action_files : priv->parsed_actions);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &action_id, NULL))
+    {
+      if (prefix != NULL && !g_str_has_prefix (action_id, prefix))
+        continue;
+      if (cursor != NULL && strcmp (action_id, cursor) <= 0)
+        continue;
+      g_ptr_array_add (action_ids, g_strdup (action_id));
+    }
+  g_ptr_array_sort (action_ids, compare_action_ids);
+
+  for (n = 0; n < action_ids->len && n < limit; n++)
+    {
+      PolkitActionDescription *action_desc;
+
+      action_desc = polkit_backend_action_pool_get_action (pool,
+                                                           action_ids->pdata[n],
+                                                           locale);
+
+      if (action_desc != NULL)
+        ret = g_list_prepend (ret, action_desc);
+    }
+
+  /* the cursor is the last id handed out, so the next page starts after it */
+  if (n < action_ids->len)
+    *out_next_cursor = g_strdup (action_ids->pdata[n - 1]);
+
+  g_ptr_array_free (action_ids, TRUE);
+
+  ret = g_list_reverse (ret);
+
+  return ret;
+}
+
+static void
+free_ptr_array (GPtrArray *array)
+{
+  g_ptr_array_free (array, TRUE);
+}
+
+static void
+ensure_implied_by (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTable *implying;
+  GHashTableIter hash_iter;
+  const gchar *action_id;
+  ParsedAction *parsed_action;
+  GPtrArray *array;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  ensure_all_files (pool);
+
+  if (priv->implied_by != NULL)
+    return;
+
+  /* first collect the implying action ids for every implied action... */
+  implying = g_hash_table_new_full (g_str_hash,
+                                    g_str_equal,
+                                    g_free,
+                                    (GDestroyNotify) free_ptr_array);
+  g_hash_table_iter_init (&hash_iter, priv->parsed_actions);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &action_id, (gpointer) &parsed_action))
+    {
+      const gchar *imply;
+      gchar **tokens;
+      guint n;
+
+      imply = g_hash_table_lookup (parsed_action->annotations, "org.freedesktop.policykit.imply");
+      if (imply == NULL)
+        continue;
+
+      tokens = g_strsplit (imply, " ", 0);
+      for (n = 0; tokens[n] != NULL; n++)
+        {
+          if (tokens[n][0] == '\0')
+            continue;
+
+          array = g_hash_table_lookup (implying, tokens[n]);
+          if (array == NULL)
+            {
+              array = g_ptr_array_new_with_free_func (g_free);
+              g_hash_table_insert (implying, g_strdup (tokens[n]), array);
+            }
+          g_ptr_array_add (array, g_strdup (action_id));
+        }
+      g_strfreev (tokens);
+    }
+
+  /* ...then turn them into arrays that can be handed out as is */
+  priv->implied_by = g_hash_table_new_full (g_str_hash,
+                                            g_str_equal,
+                                            g_free,
+                                            (GDestroyNotify) g_strfreev);
+  g_hash_table_iter_init (&hash_iter, implying);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &action_id, (gpointer) &array))
+    {
+      /* steal both the key and the strings in the array */
+      g_hash_table_iter_steal (&hash_iter);
+      g_ptr_array_set_free_func (array, NULL);
+      g_ptr_array_add (array, NULL);
+      g_hash_table_insert (priv->implied_by,
+                           (gchar *) action_id,
+                           g_ptr_array_free (array, FALSE));
+    }
+  g_hash_table_unref (implying);
+}
+
+/**
+ * polkit_backend_action_pool_warm_up:
+ * @pool: A #PolkitBackendActionPool.
+ *
+ * Reads every action file and builds the indexes that are otherwise only
+ * built the first time they are needed, so that the first check doesn't
+ * have to. Everything is built again lazily after the actions change.
+ **/
+void
+polkit_backend_action_pool_warm_up (PolkitBackendActionPool *pool)
+{
+  g_return_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool));
+
+  /* this reads all files, too */
+  ensure_implied_by (pool);
+  ensure_exec_paths (pool);
+}
+
+/* What a hash table entry costs, besides the key and value themselves */
+#define ACTION_POOL_HASH_ENTRY_SIZE (2 * sizeof (gpointer) + sizeof (guint))
+
+static gsize
+action_pool_string_size (const gchar *str)
+{
+  return str != NULL ? strlen (str) + 1 : 0;
+}
+
+/**
+ * polkit_backend_action_pool_get_memory_usage:
+ * @pool: A #PolkitBackendActionPool.
+ * @bytes: Return location for the number of bytes, added to.
+ * @objects: Return location for the number of objects, added to.
+ *
+ * Estimates the memory taken by the parsed actions and the descriptions
+ * kept for them, from the size of the structures and strings @pool
+ * holds, and adds it to @bytes and @objects. Strings read from the
+ * cache image are mapped from the file and aren't counted.
+ **/
+void
+polkit_backend_action_pool_get_memory_usage (PolkitBackendActionPool *pool,
+                                             guint64                 *bytes,
+                                             guint64                 *objects)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTable *seen_strings;
+  GHashTableIter hash_iter;
+  GHashTableIter locale_iter;
+  ParsedAction *action;
+  GHashTable *descriptions;
+  PolkitActionDescription *description;
+  const gchar *action_id;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool));
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  /* the strings of a file are shared by all of its actions */
+  seen_strings = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_hash_table_iter_init (&hash_iter, priv->parsed_actions);
+  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &action))
+    {
+      *bytes += sizeof (ParsedAction) + ACTION_POOL_HASH_ENTRY_SIZE;
+      *bytes += (g_hash_table_size (action->localized_description) +
+                 g_hash_table_size (action->localized_message) +
+                 g_hash_table_size (action->annotations)) * ACTION_POOL_HASH_ENTRY_SIZE;
+      *objects += 1;
+
+      if (!g_hash_table_contains (seen_strings, action->strings))
+        {
+          g_hash_table_add (seen_strings, action->strings);
+          *bytes += sizeof (ActionStrings) + action->strings->chunk_size;
+        }
+    }
+  g_hash_table_unref (seen_strings);
+
+  /* descriptions copy their strings */
+  g_hash_table_iter_init (&locale_iter, priv->descriptions);
+  while (g_hash_table_iter_next (&locale_iter, NULL, (gpointer) &descriptions))
+    {
+      g_hash_table_iter_init (&hash_iter, descriptions);
+      while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &description))
+        {
+          *bytes += ACTION_POOL_HASH_ENTRY_SIZE;
+          *bytes += action_pool_string_size (polkit_action_description_get_action_id (description));
+          *bytes += action_pool_string_size (polkit_action_description_get_description (description));
+          *bytes += action_pool_string_size (polkit_action_description_get_message (description));
+          *bytes += action_pool_string_size (polkit_action_description_get_vendor_name (description));
+          *bytes += action_pool_string_size (polkit_action_description_get_vendor_url (description));
+          *bytes += action_pool_string_size (polkit_action_description_get_icon_name (description));
+          *objects += 1;
+        }
+    }
+
+  g_hash_table_iter_init (&hash_iter, priv->unknown_actions);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &action_id, NULL))
+    *bytes += ACTION_POOL_HASH_ENTRY_SIZE + action_pool_string_size (action_id);
+}
+
+/**
+ * polkit_backend_action_pool_trim:
+ * @pool: A #PolkitBackendActionPool.
+ *
+ * Forgets the descriptions kept for every locale, and which action ids
+ * were found not to be registered. Both are found out again the next
+ * time they are asked for.
+ **/
+void
+polkit_backend_action_pool_trim (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool));
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  g_hash_table_remove_all (priv->descriptions);
+  g_hash_table_remove_all (priv->unknown_actions);
+}
+
+/**
+ * polkit_backend_action_pool_get_defaults:
+ * @pool: A #PolkitBackendActionPool.
+ * @action_id: A PolicyKit action identifier.
+ * @out_defaults: (out): Return location for the defaults of @action_id.
+ *
+ * Gets the implicit authorizations of the action with identifier
+ * @action_id, along with what its annotations say about it, without
+ * building a #PolkitActionDescription. This is all that evaluating a
+ * check needs to know about the action.
+ *
+ * Returns: %TRUE if @out_defaults was set, %FALSE if @action_id isn't
+ *          registered or valid.
+ **/
+gboolean
+polkit_backend_action_pool_get_defaults (PolkitBackendActionPool     *pool,
+                                         const gchar                 *action_id,
+                                         PolkitBackendActionDefaults *out_defaults)
+{
+  ParsedAction *parsed_action;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool), FALSE);
+  g_return_val_if_fail (out_defaults != NULL, FALSE);
+
+  parsed_action = lookup_parsed_action (pool, action_id);
+  if (parsed_action == NULL)
+    return FALSE;
+
+  out_defaults->implicit_any = parsed_action->implicit_authorization_any;
+  out_defaults->implicit_inactive = parsed_action->implicit_authorization_inactive;
+  out_defaults->implicit_active = parsed_action->implicit_authorization_active;
+
+  out_defaults->flags = POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_NONE;
+  if (g_hash_table_lookup (parsed_action->annotations, "org.freedesktop.policykit.imply") != NULL)
+    out_defaults->flags |= POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_IMPLIES;
+  if (g_hash_table_lookup (parsed_action->annotations, "org.freedesktop.policykit.owner") != NULL)
+    out_defaults->flags |= POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_HAS_OWNER;
+
+  return TRUE;
+}
+
+/**
+ * polkit_backend_action_pool_get_implied_by:
+ * @pool: A #PolkitBackendActionPool.
+ * @action_id: A PolicyKit action identifier.
+ *
+ * Gets the identifiers of the actions whose
+ * <literal>org.freedesktop.policykit.imply</literal> annotation names
+ * @action_id.
+ *
+ * Returns: A %NULL-terminated array owned by @pool, valid until the
+ *          #PolkitBackendActionPool::changed signal is emitted, or %NULL
+ *          if no action implies @action_id.
+ **/
+const gchar * const *
+polkit_backend_action_pool_get_implied_by (PolkitBackendActionPool *pool,
+                                           const gchar             *action_id)
+{
+  PolkitBackendActionPoolPrivate *priv;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool), NULL);
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  ensure_implied_by (pool);
+
+  return g_hash_table_lookup (priv->implied_by, action_id);
+}
+
+static void
+ensure_exec_paths (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTable *actions_for_path;
+  GHashTableIter hash_iter;
+  const gchar *action_id;
+  const gchar *path;
+  ParsedAction *parsed_action;
+  GPtrArray *array;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  ensure_all_files (pool);
+
+  if (priv->exec_paths != NULL)
+    return;
+
+  actions_for_path = g_hash_table_new_full (g_str_hash,
+                                            g_str_equal,
+                                            g_free,
+                                            (GDestroyNotify) free_ptr_array);
+  g_hash_table_iter_init (&hash_iter, priv->parsed_actions);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &action_id, (gpointer) &parsed_action))
+    {
+      path = g_hash_table_lookup (parsed_action->annotations, "org.freedesktop.policykit.exec.path");
+      if (path == NULL)
+        continue;
+
+      array = g_hash_table_lookup (actions_for_path, path);
+      if (array == NULL)
+        {
+          array = g_ptr_array_new_with_free_func (g_free);
+          g_hash_table_insert (actions_for_path, g_strdup (path), array);
+        }
+      g_ptr_array_add (array, g_strdup (action_id));
+    }
+
+  /* sorted, so that the same action wins every time */
+  priv->exec_paths = g_hash_table_new_full (g_str_hash,
+                                            g_str_equal,
+                                            g_free,
+                                            (GDestroyNotify) g_strfreev);
+  g_hash_table_iter_init (&hash_iter, actions_for_path);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &path, (gpointer) &array))
+    {
+      g_hash_table_iter_steal (&hash_iter);
+      g_ptr_array_sort (array, compare_action_ids);
+      g_ptr_array_set_free_func (array, NULL);
+      g_ptr_array_add (array, NULL);
+      g_hash_table_insert (priv->exec_paths,
+                           (gchar *) path,
+                           g_ptr_array_free (array, FALSE));
+    }
+  g_hash_table_unref (actions_for_path);
 }
 
 /**
- * polkit_backend_action_pool_get_all_actions:
+ * polkit_backend_action_pool_get_action_for_exec_path:
  * @pool: A #PolkitBackendActionPool.
+ * @path: The absolute path of a program.
+ * @argv1: (allow-none): The first argument the program is run with or %NULL.
  * @locale: The locale to get descriptions for or %NULL for system locale.
  *
- * Gets all registered PolicyKit action descriptions from @pool with strings for @locale.
+ * Gets the action that <command>pkexec</command> checks for when
+ * running @path, that is the one whose
+ * <literal>org.freedesktop.policykit.exec.path</literal> annotation
+ * is @path. Actions with an
+ * <literal>org.freedesktop.policykit.exec.argv1</literal> annotation
+ * only match if it is @argv1, and are preferred over those without.
  *
- * Returns: A #GList of #PolkitActionDescription objects. This list
- *          should be freed with g_list_free() after each element have
- *          been unreffed with g_object_unref().
+ * Returns: A #PolkitActionDescription (free with g_object_unref()) or
+ *          %NULL if no action matches.
  **/
-GList *
-polkit_backend_action_pool_get_all_actions (PolkitBackendActionPool *pool,
-                                            const gchar             *locale)
+PolkitActionDescription *
+polkit_backend_action_pool_get_action_for_exec_path (PolkitBackendActionPool *pool,
+                                                     const gchar             *path,
+                                                     const gchar             *argv1,
+                                                     const gchar             *locale)
 {
-  GList *ret;
   PolkitBackendActionPoolPrivate *priv;
-  GHashTableIter hash_iter;
+  const gchar * const *action_ids;
+  const gchar *fallback_id;
   const gchar *action_id;
+  guint n;
 
   g_return_val_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
 
   priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
 
-  ensure_all_files (pool);
+  ensure_exec_paths (pool);
 
-  ret = NULL;
+  action_ids = g_hash_table_lookup (priv->exec_paths, path);
+  if (action_ids == NULL)
+    return NULL;
 
-  g_hash_table_iter_init (&hash_iter, priv->parsed_actions);
-  while (g_hash_table_iter_next (&hash_iter, (gpointer) &action_id, NULL))
+  action_id = NULL;
+  fallback_id = NULL;
+  for (n = 0; action_ids[n] != NULL; n++)
     {
-      PolkitActionDescription *action_desc;
+      ParsedAction *parsed_action;
+      const gchar *argv1_for_action;
 
-      action_desc = polkit_backend_action_pool_get_action (pool,
-                                                           action_id,
-                                                           locale);
+      parsed_action = g_hash_table_lookup (priv->parsed_actions, action_ids[n]);
+      if (parsed_action == NULL)
+        continue;
 
-      if (action_desc != NULL)
-        ret = g_list_prepend (ret, action_desc);
+      argv1_for_action = g_hash_table_lookup (parsed_action->annotations, "org.freedesktop.policykit.exec.argv1");
+      if (argv1_for_action == NULL)
+        {
+          if (fallback_id == NULL)
+            fallback_id = action_ids[n];
+        }
+      else if (g_strcmp0 (argv1, argv1_for_action) == 0)
+        {
+          action_id = action_ids[n];
+          break;
+        }
     }
 
-  ret = g_list_reverse (ret);
+  if (action_id == NULL)
+    action_id = fallback_id;
+  if (action_id == NULL)
+    return NULL;
 
-  return ret;
+  return polkit_backend_action_pool_get_action (pool, action_id, locale);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Loads and parses a file; safe to call from any thread */
 static void
-ensure_file (PolkitBackendActionPool *pool,
-             GFile *file)
+parse_file (ParsedFile *parsed)
 {
-  PolkitBackendActionPoolPrivate *priv;
   gchar *contents;
   GError *error;
   gchar *uri;
 
-  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
-
-  uri = g_file_get_uri (file);
-
-  if (g_hash_table_lookup (priv->parsed_files, uri) != NULL)
-    goto out;
+  uri = g_file_get_uri (parsed->file);
 
   error = NULL;
-  if (!g_file_load_contents (file,
+  if (!g_file_load_contents (parsed->file,
                              NULL,
                              &contents,
                              NULL,
@@ -478,69 +1673,496 @@ ensure_file (PolkitBackendActionPool *pool,
                              &error))
     {
       g_warning ("Error loading file with URI '%s': %s", uri, error->message);
+      g_error_free (error);
       goto out;
     }
 
-  if (!process_policy_file (pool,
+  if (!process_policy_file (parsed,
                             contents,
                             &error))
     {
       g_warning ("Error parsing file with URI '%s': %s", uri, error->message);
+      g_error_free (error);
       g_free (contents);
       goto out;
     }
 
   g_free (contents);
 
-  /* steal uri */
-  g_hash_table_insert (priv->parsed_files, uri, NULL);
-  uri = NULL;
+  parsed->complete = TRUE;
 
  out:
   g_free (uri);
 }
 
+static void
+parse_file_thread_func (gpointer data,
+                        gpointer user_data)
+{
+  parse_file (data);
+}
+
+/* Parses every file in @files, spreading them over a few threads */
+static void
+parse_files (GPtrArray *files)
+{
+  GThreadPool *thread_pool;
+  GError *error;
+  guint n;
+
+  thread_pool = NULL;
+  if (files->len > 1)
+    {
+      error = NULL;
+      thread_pool = g_thread_pool_new (parse_file_thread_func,
+                                       NULL,
+                                       MIN (MIN (g_get_num_processors (), files->len),
+                                            ACTION_POOL_MAX_PARSER_THREADS),
+                                       FALSE,
+                                       &error);
+      if (thread_pool == NULL)
+        {
+          g_warning ("Error creating parser threads: %s", error->message);
+          g_error_free (error);
+        }
+    }
+
+  for (n = 0; n < files->len; n++)
+    {
+      if (thread_pool == NULL)
+        parse_file (files->pdata[n]);
+      else
+        g_thread_pool_push (thread_pool, files->pdata[n], NULL);
+    }
+
+  /* wait for all of them */
+  if (thread_pool != NULL)
+    g_thread_pool_free (thread_pool, FALSE, TRUE);
+}
+
+/* Returns a copy of the action ids @parsed defines, or %NULL if it
+ * couldn't be parsed
+ */
+static gchar **
+parsed_file_dup_action_ids (ParsedFile *parsed)
+{
+  gchar **ret;
+  guint n;
+
+  if (!parsed->complete)
+    return NULL;
+
+  ret = g_new0 (gchar *, parsed->action_ids->len + 1);
+  for (n = 0; n < parsed->action_ids->len; n++)
+    ret[n] = g_strdup (parsed->action_ids->pdata[n]);
+
+  return ret;
+}
+
+/* Adds the actions of @parsed to the pool, as if the file had just been
+ * parsed, but for those the index says a later file wins. Returns the
+ * action ids it defines, or %NULL if it couldn't be parsed.
+ */
+static gchar **
+add_parsed_file (PolkitBackendActionPool *pool,
+                 ParsedFile              *parsed)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTableIter hash_iter;
+  GHashTable *descriptions;
+  gchar *name;
+  gchar **ret;
+  guint n;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  name = g_file_get_basename (parsed->file);
+
+  /* a file that failed half way still defines the actions before the error */
+  for (n = 0; n < parsed->actions->len; n++)
+    {
+      const gchar *action_id = parsed->action_ids->pdata[n];
+      const gchar *owner;
+
+      owner = g_hash_table_lookup (priv->action_files, action_id);
+      if (owner != NULL && strcmp (owner, name) != 0)
+        continue;
+
+      g_hash_table_insert (priv->parsed_actions,
+                           g_strdup (action_id),
+                           parsed->actions->pdata[n]);
+      parsed->actions->pdata[n] = NULL;
+
+      /* a later file may redefine the action, so forget what was handed out for it */
+      g_hash_table_iter_init (&hash_iter, priv->descriptions);
+      while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &descriptions))
+        g_hash_table_remove (descriptions, action_id);
+    }
+
+  g_free (name);
+
+  if (parsed->actions->len > 0)
+    forget_annotation_indexes (pool);
+
+  ret = parsed_file_dup_action_ids (parsed);
+  if (ret != NULL)
+    g_hash_table_insert (priv->parsed_files, g_file_get_uri (parsed->file), ret);
+
+  return ret;
+}
+
+/* Returns the action ids defined by @file, or %NULL if it can't be parsed */
+static gchar **
+ensure_file (PolkitBackendActionPool *pool,
+             GFile *file)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  ParsedFile *parsed;
+  gchar *uri;
+  gchar **ret;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  uri = g_file_get_uri (file);
+  ret = g_hash_table_lookup (priv->parsed_files, uri);
+  g_free (uri);
+  if (ret != NULL)
+    goto out;
+
+  parsed = parsed_file_new (file);
+  parse_file (parsed);
+  ret = add_parsed_file (pool, parsed);
+  parsed_file_free (parsed);
+
+ out:
+  return ret;
+}
+
 static void
 ensure_all_files (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTableIter hash_iter;
+  const gchar *name;
+  IndexedFile *indexed;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  if (priv->has_loaded_all_files)
+    return;
+
+  /* the index lists every file, and has parsed all those that changed */
+  ensure_index (pool);
+  if (!priv->has_index)
+    return;
+
+  g_hash_table_iter_init (&hash_iter, priv->indexed_files);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &name, (gpointer) &indexed))
+    {
+      GFile *file;
+      gchar *uri;
+      guint n;
+
+      file = g_file_get_child (priv->directory, name);
+
+      if (indexed->cached == NULL)
+        {
+          ensure_file (pool, file);
+          g_object_unref (file);
+          continue;
+        }
+
+      uri = g_file_get_uri (file);
+      g_object_unref (file);
+      if (g_hash_table_contains (priv->parsed_files, uri))
+        {
+          g_free (uri);
+          continue;
+        }
+
+      for (n = 0; indexed->action_ids[n] != NULL; n++)
+        {
+          const gchar *owner;
+
+          /* a later file may win it, and some may have been looked up already */
+          owner = g_hash_table_lookup (priv->action_files, indexed->action_ids[n]);
+          if (owner != NULL && strcmp (owner, name) != 0)
+            continue;
+          if (g_hash_table_contains (priv->parsed_actions, indexed->action_ids[n]))
+            continue;
+
+          g_hash_table_insert (priv->parsed_actions,
+                               g_strdup (indexed->action_ids[n]),
+                               parsed_action_new_from_image (indexed->cached, indexed->image_file, n));
+        }
+
+      /* steal uri */
+      g_hash_table_insert (priv->parsed_files, uri, g_strdupv (indexed->action_ids));
+    }
+
+  priv->has_loaded_all_files = TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+load_cache (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  ActionImage *image;
+  ActionStrings *strings;
+  GError *error;
+  gchar *directory;
+  guint file;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  directory = g_file_get_path (priv->directory);
+  error = NULL;
+  image = action_image_read (priv->cache_file, directory, &error);
+  g_free (directory);
+  if (image == NULL)
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Ignoring action cache: %s", error->message);
+      g_error_free (error);
+      return;
+    }
+
+  /* every file read back from the image shares the mapping */
+  strings = action_strings_new (image);
+
+  for (file = 0; file < action_image_get_n_files (image); file++)
+    {
+      IndexedFile *indexed;
+      guint n_actions;
+      guint n;
+
+      n_actions = action_image_get_n_actions (image, file);
+
+      indexed = g_new0 (IndexedFile, 1);
+      action_image_get_file_stamp (image, file, &indexed->stamp);
+      indexed->action_ids = g_new0 (gchar *, n_actions + 1);
+      for (n = 0; n < n_actions; n++)
+        indexed->action_ids[n] = g_strdup (action_image_get_action_id (image, file, n));
+      indexed->cached = action_strings_ref (strings);
+      indexed->image_file = file;
+
+      g_hash_table_insert (priv->indexed_files,
+                           g_strdup (action_image_get_file_name (image, file)),
+                           indexed);
+    }
+
+  action_strings_unref (strings);
+  action_image_unref (image);
+}
+
+static void
+save_cache (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTableIter hash_iter;
+  const gchar *name;
+  IndexedFile *indexed;
+  GArray *files;
+  GArray *actions;
+  GPtrArray *tables;
+  gchar *directory;
+  GError *error;
+  guint n;
+
+  priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
+
+  files = g_array_new (FALSE, TRUE, sizeof (ActionImageFile));
+  actions = g_array_new (FALSE, TRUE, sizeof (ActionImageAction));
+  tables = g_ptr_array_new_with_free_func ((GDestroyNotify) g_hash_table_unref);
+
+  g_hash_table_iter_init (&hash_iter, priv->indexed_files);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &name, (gpointer) &indexed))
+    {
+      ActionImageFile file = { 0 };
+
+      file.name = name;
+      file.stamp = indexed->stamp;
+      /* point into actions once it has stopped growing */
+      file.actions = GUINT_TO_POINTER (actions->len);
+
+      for (n = 0; indexed->action_ids[n] != NULL; n++)
+        {
+          ActionImageAction action = { 0 };
+
+          if (indexed->cached != NULL)
+            {
+              action_image_get_action (indexed->cached->image, indexed->image_file, n, &action);
+              g_ptr_array_add (tables, action.localized_description);
+              g_ptr_array_add (tables, action.localized_message);
+              g_ptr_array_add (tables, action.annotations);
+            }
+          else
+            {
+              ParsedAction *parsed_action;
+
+              parsed_action = g_hash_table_lookup (priv->parsed_actions, indexed->action_ids[n]);
+              if (parsed_action == NULL)
+                continue;
+
+              action.action_id = indexed->action_ids[n];
+              action.vendor_name = parsed_action->vendor_name;
+              action.vendor_url = parsed_action->vendor_url;
+              action.icon_name = parsed_action->icon_name;
+              action.description = parsed_action->description;
+              action.message = parsed_action->message;
+              action.implicit_authorization_any = parsed_action->implicit_authorization_any;
+              action.implicit_authorization_inactive = parsed_action->implicit_authorization_inactive;
+              action.implicit_authorization_active = parsed_action->implicit_authorization_active;
+              action.localized_description = parsed_action->localized_description;
+              action.localized_message = parsed_action->localized_message;
+              action.annotations = parsed_action->annotations;
+            }
+
+          g_array_append_val (actions, action);
+          file.n_actions++;
+        }
+
+      g_array_append_val (files, file);
+    }
+
+  for (n = 0; n < files->len; n++)
+    {
+      ActionImageFile *file = &g_array_index (files, ActionImageFile, n);
+
+      file->actions = &g_array_index (actions, ActionImageAction, GPOINTER_TO_UINT (file->actions));
+    }
+
+  directory = g_file_get_path (priv->directory);
+  error = NULL;
+  if (!action_image_write (priv->cache_file,
+                           directory,
+                           (const ActionImageFile *) files->data,
+                           files->len,
+                           &error))
+    {
+      g_warning ("Error writing action cache: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_free (directory);
+  g_ptr_array_free (tables, TRUE);
+  g_array_free (actions, TRUE);
+  g_array_free (files, TRUE);
+}
+
+/* A file found while listing the directory */
+typedef struct
+{
+  gchar *name;
+  ActionImageStamp stamp;
+
+  /* is TRUE if the file is new or changed since it was indexed */
+  gboolean stale;
+
+  /* the actions of a stale file, if it was parsed already... */
+  gchar **action_ids;
+
+  /* ...or the file being parsed */
+  ParsedFile *parsed;
+} ListedFile;
+
+static void
+listed_file_free (ListedFile *listed_file)
+{
+  if (listed_file->parsed != NULL)
+    parsed_file_free (listed_file->parsed);
+  g_free (listed_file->name);
+  g_free (listed_file);
+}
+
+/* Makes sure action_files has an entry for every action defined in the
+ * directory. Only files that are new or changed since they were last
+ * indexed are parsed; for the rest the directory listing is enough.
+ */
+static void
+ensure_index (PolkitBackendActionPool *pool)
 {
   PolkitBackendActionPoolPrivate *priv;
   GFileEnumerator *e;
   GFileInfo *file_info;
+  GPtrArray *listed;
+  GPtrArray *to_parse;
+  GHashTable *seen;
+  GHashTableIter hash_iter;
+  const gchar *name;
+  gboolean changed;
   GError *error;
+  guint i;
 
   priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pool);
 
   e = NULL;
+  listed = NULL;
+  to_parse = NULL;
+  seen = NULL;
+  changed = FALSE;
 
-  if (priv->has_loaded_all_files)
+  if (priv->has_index)
     goto out;
 
+  if (priv->cache_file != NULL && g_hash_table_size (priv->indexed_files) == 0)
+    load_cache (pool);
+
   error = NULL;
   e = g_file_enumerate_children (priv->directory,
-                                 "standard::name",
+                                 "standard::name,standard::size,time::modified,unix::inode",
                                  G_FILE_QUERY_INFO_NONE,
                                  NULL,
                                  &error);
   if (error != NULL)
     {
       g_warning ("Error enumerating files: %s", error->message);
+      g_error_free (error);
       goto out;
     }
 
+  listed = g_ptr_array_new_with_free_func ((GDestroyNotify) listed_file_free);
+  to_parse = g_ptr_array_new ();
+
   while ((file_info = g_file_enumerator_next_file (e, NULL, &error)) != NULL)
     {
-      const gchar *name;
+      ListedFile *listed_file;
+      IndexedFile *indexed;
 
       name = g_file_info_get_name (file_info);
       /* only consider files with the right suffix */
-      if (g_str_has_suffix (name, ".policy"))
+      if (!g_str_has_suffix (name, ".policy"))
         {
-          GFile *file;
+          g_object_unref (file_info);
+          continue;
+        }
 
-          file = g_file_get_child (priv->directory, name);
+      listed_file = g_new0 (ListedFile, 1);
+      listed_file->name = g_strdup (name);
+      stamp_from_file_info (file_info, &listed_file->stamp);
+      g_ptr_array_add (listed, listed_file);
 
-          ensure_file (pool, file);
+      indexed = g_hash_table_lookup (priv->indexed_files, name);
+      if (indexed == NULL ||
+          indexed->stamp.inode != listed_file->stamp.inode ||
+          indexed->stamp.size != listed_file->stamp.size ||
+          indexed->stamp.mtime != listed_file->stamp.mtime)
+        {
+          GFile *file;
+          gchar *uri;
 
+          file = g_file_get_child (priv->directory, name);
+          uri = g_file_get_uri (file);
+          listed_file->stale = TRUE;
+          listed_file->action_ids = g_hash_table_lookup (priv->parsed_files, uri);
+          if (listed_file->action_ids == NULL)
+            {
+              listed_file->parsed = parsed_file_new (file);
+              g_ptr_array_add (to_parse, listed_file->parsed);
+            }
+          g_free (uri);
           g_object_unref (file);
         }
 
@@ -548,9 +2170,84 @@ ensure_all_files (PolkitBackendActionPool *pool)
 
     } /* for all files */
 
-  priv->has_loaded_all_files = TRUE;
+  /* only the parsing is spread over threads; the files are indexed in
+   * the order they were listed, so that a later one wins an action that
+   * several define, just like when they used to be parsed one by one
+   */
+  parse_files (to_parse);
+
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_remove_all (priv->action_files);
+
+  for (i = 0; i < listed->len; i++)
+    {
+      ListedFile *listed_file = listed->pdata[i];
+      IndexedFile *indexed;
+      guint n;
+
+      if (listed_file->stale)
+        {
+          indexed = g_new0 (IndexedFile, 1);
+          indexed->stamp = listed_file->stamp;
+          if (listed_file->parsed != NULL)
+            indexed->action_ids = parsed_file_dup_action_ids (listed_file->parsed);
+          else
+            indexed->action_ids = g_strdupv (listed_file->action_ids);
+          /* a file that fails to parse is remembered as defining nothing */
+          if (indexed->action_ids == NULL)
+            indexed->action_ids = g_new0 (gchar *, 1);
+          g_hash_table_insert (priv->indexed_files, g_strdup (listed_file->name), indexed);
+          changed = TRUE;
+        }
+      else
+        {
+          indexed = g_hash_table_lookup (priv->indexed_files, listed_file->name);
+        }
+
+      for (n = 0; indexed->action_ids[n] != NULL; n++)
+        {
+          g_hash_table_insert (priv->action_files,
+                               g_strdup (indexed->action_ids[n]),
+                               g_strdup (listed_file->name));
+        }
+
+      g_hash_table_add (seen, listed_file->name);
+    }
+
+  /* with the winners known, the files just parsed only add those */
+  for (i = 0; i < listed->len; i++)
+    {
+      ListedFile *listed_file = listed->pdata[i];
+
+      if (listed_file->parsed != NULL)
+        add_parsed_file (pool, listed_file->parsed);
+    }
+
+  /* forget files that have been removed */
+  g_hash_table_iter_init (&hash_iter, priv->indexed_files);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &name, NULL))
+    {
+      if (!g_hash_table_contains (seen, name))
+        {
+          g_hash_table_iter_remove (&hash_iter);
+          changed = TRUE;
+        }
+    }
+
+  priv->has_index = TRUE;
+
+  if (changed && priv->cache_file != NULL)
+    save_cache (pool);
 
  out:
+  if (seen != NULL)
+    g_hash_table_unref (seen);
+
+  if (to_parse != NULL)
+    g_ptr_array_free (to_parse, TRUE);
+
+  if (listed != NULL)
+    g_ptr_array_free (listed, TRUE);
 
   if (e != NULL)
     g_object_unref (e);
@@ -611,7 +2308,8 @@ typedef struct {
   char *annotate_key;
   GHashTable *annotations;
 
-  PolkitBackendActionPool *pool;
+  /* collects the actions in the file */
+  ParsedFile *parsed;
 } ParserData;
 
 static void
@@ -698,15 +2396,10 @@ _start (void *data, const char *el, const char **attr)
 
           pd_unref_action_data (pd);
           pd->action_id = g_strdup (attr[1]);
-          pd->policy_descriptions = g_hash_table_new_full (g_str_hash,
-                                                           g_str_equal,
-                                                           g_free,
-                                                           g_free);
-          pd->policy_messages = g_hash_table_new_full (g_str_hash,
-                                                       g_str_equal,
-                                                       g_free,
-                                                       g_free);
-          pd->annotations = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+          /* the keys and values are interned */
+          pd->policy_descriptions = g_hash_table_new (g_str_hash, g_str_equal);
+          pd->policy_messages = g_hash_table_new (g_str_hash, g_str_equal);
+          pd->annotations = g_hash_table_new (g_str_hash, g_str_equal);
           /* initialize defaults */
           pd->implicit_authorization_any = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
           pd->implicit_authorization_inactive = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
@@ -852,9 +2545,8 @@ _cdata (void *data, const char *s, int len)
       else
         {
           g_hash_table_insert (pd->policy_descriptions,
-                               g_strdup (pd->elem_lang),
-                               str);
-          str = NULL;
+                               (gpointer) action_strings_intern (pd->parsed->strings, pd->elem_lang),
+                               (gpointer) action_strings_intern (pd->parsed->strings, str));
         }
       break;
 
@@ -868,9 +2560,8 @@ _cdata (void *data, const char *s, int len)
       else
         {
           g_hash_table_insert (pd->policy_messages,
-                               g_strdup (pd->elem_lang),
-                               str);
-          str = NULL;
+                               (gpointer) action_strings_intern (pd->parsed->strings, pd->elem_lang),
+                               (gpointer) action_strings_intern (pd->parsed->strings, str));
         }
       break;
 
@@ -937,8 +2628,9 @@ _cdata (void *data, const char *s, int len)
       break;
 
     case STATE_IN_ANNOTATE:
-      g_hash_table_insert (pd->annotations, g_strdup (pd->annotate_key), str);
-      str = NULL;
+      g_hash_table_insert (pd->annotations,
+                           (gpointer) action_strings_intern (pd->parsed->strings, pd->annotate_key),
+                           (gpointer) action_strings_intern (pd->parsed->strings, str));
       break;
 
     default:
@@ -969,9 +2661,6 @@ _end (void *data, const char *el)
         gchar *vendor_url;
         gchar *icon_name;
         ParsedAction *action;
-        PolkitBackendActionPoolPrivate *priv;
-
-        priv = POLKIT_BACKEND_ACTION_POOL_GET_PRIVATE (pd->pool);
 
         vendor = pd->vendor;
         if (vendor == NULL)
@@ -985,12 +2674,13 @@ _end (void *data, const char *el)
         if (icon_name == NULL)
           icon_name = pd->global_icon_name;
 
-        action = g_new0 (ParsedAction, 1);
-        action->vendor_name = g_strdup (vendor);
-        action->vendor_url = g_strdup (vendor_url);
-        action->icon_name = g_strdup (icon_name);
-        action->description = g_strdup (pd->policy_description_nolang);
-        action->message = g_strdup (pd->policy_message_nolang);
+        action = g_slice_new0 (ParsedAction);
+        action->strings = action_strings_ref (pd->parsed->strings);
+        action->vendor_name = action_strings_intern (action->strings, vendor);
+        action->vendor_url = action_strings_intern (action->strings, vendor_url);
+        action->icon_name = action_strings_intern (action->strings, icon_name);
+        action->description = action_strings_intern (action->strings, pd->policy_description_nolang);
+        action->message = action_strings_intern (action->strings, pd->policy_message_nolang);
 
         action->localized_description = pd->policy_descriptions;
         action->localized_message     = pd->policy_messages;
@@ -1000,8 +2690,8 @@ _end (void *data, const char *el)
         action->implicit_authorization_inactive = pd->implicit_authorization_inactive;
         action->implicit_authorization_active = pd->implicit_authorization_active;
 
-        g_hash_table_insert (priv->parsed_actions, g_strdup (pd->action_id),
-                             action);
+        g_ptr_array_add (pd->parsed->action_ids, g_strdup (pd->action_id));
+        g_ptr_array_add (pd->parsed->actions, action);
 
         /* we steal these hash tables */
         pd->annotations = NULL;
@@ -1037,7 +2727,7 @@ error:
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gboolean
-process_policy_file (PolkitBackendActionPool *pool,
+process_policy_file (ParsedFile *parsed,
                      const gchar *xml,
                      GError **error)
 {
@@ -1047,7 +2737,7 @@ process_policy_file (PolkitBackendActionPool *pool,
   /* clear parser data */
   memset (&pd, 0, sizeof (ParserData));
 
-  pd.pool = pool;
+  pd.parsed = parsed;
 
   pd.parser = XML_ParserCreate (NULL);
   pd.stack_depth = 0;
@@ -40,6 +40,40 @@ G_BEGIN_DECLS
 typedef struct _PolkitBackendActionPool         PolkitBackendActionPool;
 typedef struct _PolkitBackendActionPoolClass    PolkitBackendActionPoolClass;
 
+/**
+ * PolkitBackendActionDefaultsFlags:
+ * @POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_NONE: No flags set.
+ * @POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_IMPLIES: The action has the
+ *   <literal>org.freedesktop.policykit.imply</literal> annotation.
+ * @POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_HAS_OWNER: The action has the
+ *   <literal>org.freedesktop.policykit.owner</literal> annotation.
+ *
+ * What the annotations of an action say about it.
+ */
+typedef enum
+{
+  POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_NONE      = 0,
+  POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_IMPLIES   = (1<<0),
+  POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_HAS_OWNER = (1<<1)
+} PolkitBackendActionDefaultsFlags;
+
+/**
+ * PolkitBackendActionDefaults:
+ * @implicit_any: The implicit authorization for any subject.
+ * @implicit_inactive: The implicit authorization for subjects in inactive local sessions.
+ * @implicit_active: The implicit authorization for subjects in active local sessions.
+ * @flags: What the annotations of the action say about it.
+ *
+ * What evaluating a check needs to know about an action.
+ */
+typedef struct
+{
+  PolkitImplicitAuthorization      implicit_any;
+  PolkitImplicitAuthorization      implicit_inactive;
+  PolkitImplicitAuthorization      implicit_active;
+  PolkitBackendActionDefaultsFlags flags;
+} PolkitBackendActionDefaults;
+
 struct _PolkitBackendActionPool
 {
   GObject parent_instance;
@@ -72,6 +106,31 @@ PolkitActionDescription *polkit_backend_action_pool_get_action       (PolkitBack
                                                                       const gchar              *action_id,
                                                                       const gchar              *locale);
 
+gboolean                 polkit_backend_action_pool_get_defaults     (PolkitBackendActionPool     *pool,
+                                                                      const gchar                 *action_id,
+                                                                      PolkitBackendActionDefaults *out_defaults);
+
+const gchar * const     *polkit_backend_action_pool_get_implied_by   (PolkitBackendActionPool  *pool,
+                                                                      const gchar              *action_id);
+
+void                     polkit_backend_action_pool_warm_up          (PolkitBackendActionPool  *pool);
+void                     polkit_backend_action_pool_trim             (PolkitBackendActionPool  *pool);
+void                     polkit_backend_action_pool_get_memory_usage (PolkitBackendActionPool  *pool,
+                                                                      guint64                  *bytes,
+                                                                      guint64                  *objects);
+
+GList                   *polkit_backend_action_pool_get_actions_page (PolkitBackendActionPool  *pool,
+                                                                      const gchar              *locale,
+                                                                      const gchar              *prefix,
+                                                                      const gchar              *cursor,
+                                                                      guint                     limit,
+                                                                      gchar                   **out_next_cursor);
+
+PolkitActionDescription *polkit_backend_action_pool_get_action_for_exec_path (PolkitBackendActionPool  *pool,
+                                                                              const gchar              *path,
+                                                                              const gchar              *argv1,
+                                                                              const gchar              *locale);
+
 G_END_DECLS
 
 #endif /* __POLKIT_BACKEND_ACTION_POOL_H */
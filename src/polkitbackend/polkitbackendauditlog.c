@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "polkitbackendauthority.h"
+#include "polkitbackendauditlog.h"
+#include "polkitbackendsubjectinfo.h"
+
+/**
+ * SECTION:polkitbackendauditlog
+ * @title: PolkitBackendAuditLog
+ * @short_description: Logging of authorization checks off the main loop
+ * @stability: Unstable
+ *
+ * A #PolkitBackendAuditLog takes a record of every completed check and
+ * writes it to the system log from a thread of its own, so that neither
+ * formatting nor reading command lines from /proc holds up the daemon.
+ *
+ * Records only hold references to what the check already resolved. They
+ * go through a bounded single producer, single consumer ring: the main
+ * loop never waits for the writer, and when the ring is full the record
+ * is dropped and counted instead. The writer wakes up for the first
+ * record after having been idle, waits a little for more to arrive and
+ * then drains everything in one go.
+ */
+
+/* How long the writer waits for a batch to fill up, in microseconds */
+#define AUDIT_LOG_BATCH_DELAY (50 * 1000)
+
+typedef struct
+{
+  gchar *action_id;
+  PolkitSubject *subject;
+  PolkitIdentity *user_of_subject;
+  PolkitSubject *caller;
+  gboolean is_authorized;
+  gboolean with_cmdlines;
+} AuditRecord;
+
+struct _PolkitBackendAuditLog
+{
+  PolkitBackendAuthority *authority; /* not owned, outlives the log */
+  PolkitBackendAuditLogLevel level;
+
+  /* capacity is a power of two, so head and tail are free to wrap */
+  AuditRecord *records;
+  guint capacity;
+  volatile gint head; /* written by the producer only */
+  volatile gint tail; /* written by the writer only */
+
+  volatile gint dropped;
+  guint dropped_reported; /* writer only */
+
+  GThread *writer;
+  GMutex lock;
+  GCond cond;
+  volatile gint writer_sleeping;
+  volatile gint quit;
+};
+
+static void
+audit_record_clear (AuditRecord *record)
+{
+  g_free (record->action_id);
+  g_object_unref (record->subject);
+  if (record->user_of_subject != NULL)
+    g_object_unref (record->user_of_subject);
+  g_object_unref (record->caller);
+  memset (record, 0, sizeof (AuditRecord));
+}
+
+static void
+audit_record_write (PolkitBackendAuditLog *log,
+                    AuditRecord           *record)
+{
+  gchar *subject_str;
+  gchar *user_of_subject_str;
+  gchar *caller_str;
+  gchar *subject_cmdline;
+  gchar *caller_cmdline;
+
+  subject_str = polkit_subject_to_string (record->subject);
+  if (record->user_of_subject != NULL)
+    user_of_subject_str = polkit_identity_to_string (record->user_of_subject);
+  else
+    user_of_subject_str = g_strdup ("<unknown>");
+  caller_str = polkit_subject_to_string (record->caller);
+
+  subject_cmdline = NULL;
+  caller_cmdline = NULL;
+  if (record->with_cmdlines)
+    {
+      subject_cmdline = polkit_backend_subject_get_cmdline (record->subject);
+      caller_cmdline = polkit_backend_subject_get_cmdline (record->caller);
+    }
+
+  polkit_backend_authority_log (log->authority,
+                                "%s action %s for %s [%s] owned by %s (check requested by %s [%s])",
+                                record->is_authorized ? "ALLOWING" : "DENYING",
+                                record->action_id,
+                                subject_str,
+                                subject_cmdline != NULL ? subject_cmdline : "<unknown>",
+                                user_of_subject_str,
+                                caller_str,
+                                caller_cmdline != NULL ? caller_cmdline : "<unknown>");
+
+  g_free (subject_str);
+  g_free (user_of_subject_str);
+  g_free (caller_str);
+  g_free (subject_cmdline);
+  g_free (caller_cmdline);
+}
+
+/* Writes out and releases every record published so far */
+static void
+audit_log_drain (PolkitBackendAuditLog *log)
+{
+  guint head;
+  guint tail;
+  guint dropped;
+
+  head = (guint) g_atomic_int_get (&log->head);
+  tail = (guint) g_atomic_int_get (&log->tail);
+
+  for (; tail != head; tail++)
+    {
+      AuditRecord *record = &log->records[tail & (log->capacity - 1)];
+
+      audit_record_write (log, record);
+      audit_record_clear (record);
+      /* hand the slot back to the producer */
+      g_atomic_int_set (&log->tail, (gint) (tail + 1));
+    }
+
+  dropped = (guint) g_atomic_int_get (&log->dropped);
+  if (dropped != log->dropped_reported)
+    {
+      polkit_backend_authority_log (log->authority,
+                                    "Dropped %u authorization check records, the log can't keep up",
+                                    dropped - log->dropped_reported);
+      log->dropped_reported = dropped;
+    }
+}
+
+static gpointer
+audit_log_writer_thread (gpointer user_data)
+{
+  PolkitBackendAuditLog *log = user_data;
+
+  for (;;)
+    {
+      g_mutex_lock (&log->lock);
+      /* The producer checks writer_sleeping after publishing a record, so
+       * either it sees the flag set or we see the record here
+       */
+      g_atomic_int_set (&log->writer_sleeping, 1);
+      while (g_atomic_int_get (&log->head) == g_atomic_int_get (&log->tail) &&
+             !g_atomic_int_get (&log->quit))
+        g_cond_wait (&log->cond, &log->lock);
+      g_atomic_int_set (&log->writer_sleeping, 0);
+      g_mutex_unlock (&log->lock);
+
+      if (g_atomic_int_get (&log->quit))
+        break;
+
+      /* let a burst of checks end up in one batch */
+      g_usleep (AUDIT_LOG_BATCH_DELAY);
+      audit_log_drain (log);
+    }
+
+  audit_log_drain (log);
+
+  return NULL;
+}
+
+/**
+ * polkit_backend_audit_log_new:
+ * @authority: The authority to log through.
+ * @capacity: How many records may be waiting for the writer, at most.
+ *
+ * Creates a new #PolkitBackendAuditLog, initially at
+ * %POLKIT_BACKEND_AUDIT_LOG_LEVEL_NONE. The writer thread is only
+ * started once the first record is pushed.
+ *
+ * Returns: A #PolkitBackendAuditLog. Free with polkit_backend_audit_log_free().
+ */
+PolkitBackendAuditLog *
+polkit_backend_audit_log_new (PolkitBackendAuthority *authority,
+                              guint                   capacity)
+{
+  PolkitBackendAuditLog *log;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (capacity > 0 && capacity <= G_MAXINT / 2, NULL);
+
+  log = g_new0 (PolkitBackendAuditLog, 1);
+  log->authority = authority;
+  log->level = POLKIT_BACKEND_AUDIT_LOG_LEVEL_NONE;
+  log->capacity = 1;
+  while (log->capacity < capacity)
+    log->capacity *= 2;
+  log->records = g_new0 (AuditRecord, log->capacity);
+  g_mutex_init (&log->lock);
+  g_cond_init (&log->cond);
+
+  return log;
+}
+
+/**
+ * polkit_backend_audit_log_free:
+ * @log: A #PolkitBackendAuditLog.
+ *
+ * Writes out the records still waiting, stops the writer thread and
+ * frees @log.
+ */
+void
+polkit_backend_audit_log_free (PolkitBackendAuditLog *log)
+{
+  if (log->writer != NULL)
+    {
+      g_mutex_lock (&log->lock);
+      g_atomic_int_set (&log->quit, 1);
+      g_cond_signal (&log->cond);
+      g_mutex_unlock (&log->lock);
+      g_thread_join (log->writer);
+    }
+
+  g_mutex_clear (&log->lock);
+  g_cond_clear (&log->cond);
+  g_free (log->records);
+  g_free (log);
+}
+
+/**
+ * polkit_backend_audit_log_get_level:
+ * @log: A #PolkitBackendAuditLog.
+ *
+ * Gets how much of every check is logged.
+ *
+ * Returns: A #PolkitBackendAuditLogLevel.
+ */
+PolkitBackendAuditLogLevel
+polkit_backend_audit_log_get_level (PolkitBackendAuditLog *log)
+{
+  return log->level;
+}
+
+/**
+ * polkit_backend_audit_log_set_level:
+ * @log: A #PolkitBackendAuditLog.
+ * @level: A #PolkitBackendAuditLogLevel.
+ *
+ * Sets how much of every check is logged from now on. Records already
+ * pushed are written as they were.
+ */
+void
+polkit_backend_audit_log_set_level (PolkitBackendAuditLog      *log,
+                                    PolkitBackendAuditLogLevel  level)
+{
+  log->level = level;
+}
+
+/**
+ * polkit_backend_audit_log_push_check:
+ * @log: A #PolkitBackendAuditLog.
+ * @action_id: The action that was checked.
+ * @subject: The subject that was checked.
+ * @user_of_subject: (allow-none): The user of @subject, or %NULL if not known.
+ * @caller: The subject that asked for the check.
+ * @is_authorized: Whether @subject is authorized for @action_id.
+ *
+ * Queues a record of a completed check for the writer thread, unless
+ * checks aren't being logged. Never blocks; if the ring is full the
+ * record is dropped and counted.
+ *
+ * This must always be called from the same thread.
+ *
+ * Returns: %TRUE if the record was queued.
+ */
+gboolean
+polkit_backend_audit_log_push_check (PolkitBackendAuditLog *log,
+                                     const gchar           *action_id,
+                                     PolkitSubject         *subject,
+                                     PolkitIdentity        *user_of_subject,
+                                     PolkitSubject         *caller,
+                                     gboolean               is_authorized)
+{
+  AuditRecord *record;
+  guint head;
+  guint tail;
+
+  g_return_val_if_fail (action_id != NULL, FALSE);
+  g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), FALSE);
+  g_return_val_if_fail (POLKIT_IS_SUBJECT (caller), FALSE);
+
+  if (log->level == POLKIT_BACKEND_AUDIT_LOG_LEVEL_NONE)
+    return FALSE;
+
+  if (log->writer == NULL)
+    log->writer = g_thread_new ("polkitd-audit", audit_log_writer_thread, log);
+
+  head = (guint) g_atomic_int_get (&log->head);
+  tail = (guint) g_atomic_int_get (&log->tail);
+  if (head - tail >= log->capacity)
+    {
+      g_atomic_int_inc (&log->dropped);
+      return FALSE;
+    }
+
+  record = &log->records[head & (log->capacity - 1)];
+  record->action_id = g_strdup (action_id);
+  record->subject = g_object_ref (subject);
+  record->user_of_subject = user_of_subject != NULL ? g_object_ref (user_of_subject) : NULL;
+  record->caller = g_object_ref (caller);
+  record->is_authorized = is_authorized;
+  record->with_cmdlines = log->level >= POLKIT_BACKEND_AUDIT_LOG_LEVEL_CMDLINES;
+
+  /* publish the record */
+  g_atomic_int_set (&log->head, (gint) (head + 1));
+
+  if (g_atomic_int_get (&log->writer_sleeping))
+    {
+      g_mutex_lock (&log->lock);
+      g_cond_signal (&log->cond);
+      g_mutex_unlock (&log->lock);
+    }
+
+  return TRUE;
+}
+
+/**
+ * polkit_backend_audit_log_get_dropped:
+ * @log: A #PolkitBackendAuditLog.
+ *
+ * Gets how many records were dropped because the writer couldn't keep up.
+ *
+ * Returns: The number of records dropped so far.
+ */
+guint
+polkit_backend_audit_log_get_dropped (PolkitBackendAuditLog *log)
+{
+  return (guint) g_atomic_int_get (&log->dropped);
+}
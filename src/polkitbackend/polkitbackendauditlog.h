@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined (_POLKIT_BACKEND_COMPILATION) || defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error "This is a private header file."
+#endif
+
+#ifndef __POLKIT_BACKEND_AUDIT_LOG_H
+#define __POLKIT_BACKEND_AUDIT_LOG_H
+
+#include <glib-object.h>
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendtypes.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PolkitBackendAuditLogLevel:
+ * @POLKIT_BACKEND_AUDIT_LOG_LEVEL_NONE: Checks are not logged.
+ * @POLKIT_BACKEND_AUDIT_LOG_LEVEL_DECISIONS: Every decision is logged along with its subject and caller.
+ * @POLKIT_BACKEND_AUDIT_LOG_LEVEL_CMDLINES: Like @POLKIT_BACKEND_AUDIT_LOG_LEVEL_DECISIONS, with the command lines of the subject and caller.
+ *
+ * How much of every authorization check goes to the system log.
+ */
+typedef enum
+{
+  POLKIT_BACKEND_AUDIT_LOG_LEVEL_NONE      = 0,
+  POLKIT_BACKEND_AUDIT_LOG_LEVEL_DECISIONS = 1,
+  POLKIT_BACKEND_AUDIT_LOG_LEVEL_CMDLINES  = 2,
+} PolkitBackendAuditLogLevel;
+
+/* Records that fit in the ring before new ones are dropped */
+#define POLKIT_BACKEND_AUDIT_LOG_CAPACITY 1024
+
+PolkitBackendAuditLog      *polkit_backend_audit_log_new         (PolkitBackendAuthority     *authority,
+                                                                  guint                       capacity);
+void                        polkit_backend_audit_log_free        (PolkitBackendAuditLog      *log);
+
+PolkitBackendAuditLogLevel  polkit_backend_audit_log_get_level   (PolkitBackendAuditLog      *log);
+void                        polkit_backend_audit_log_set_level   (PolkitBackendAuditLog      *log,
+                                                                  PolkitBackendAuditLogLevel  level);
+
+gboolean                    polkit_backend_audit_log_push_check  (PolkitBackendAuditLog      *log,
+                                                                  const gchar                *action_id,
+                                                                  PolkitSubject              *subject,
+                                                                  PolkitIdentity             *user_of_subject,
+                                                                  PolkitSubject              *caller,
+                                                                  gboolean                    is_authorized);
+
+guint                       polkit_backend_audit_log_get_dropped (PolkitBackendAuditLog      *log);
+
+G_END_DECLS
+
+#endif /* __POLKIT_BACKEND_AUDIT_LOG_H */
@@ -95,6 +95,24 @@ struct _PolkitBackendAuthority
  * authorization identified by id or %NULL if the backend doesn't support
  * the operation. See polkit_backend_authority_revoke_temporary_authorization_by_id()
  * for details.
+ * @enumerate_actions_paged: Enumerates a page of registered actions or
+ * %NULL if the backend doesn't support the operation. See
+ * polkit_backend_authority_enumerate_actions_paged() for details.
+ * @check_authorizations: Called to initiate checking several actions
+ * for one subject at once or %NULL if the backend doesn't support the
+ * operation. See polkit_backend_authority_check_authorizations() for
+ * details.
+ * @check_authorizations_finish: Called when finishing checking several
+ * actions or %NULL if the backend doesn't support the operation. See
+ * polkit_backend_authority_check_authorizations_finish() for details.
+ * @get_action_for_exec_path: Looks up the action for running a program
+ * with pkexec or %NULL if the backend doesn't support the operation. See
+ * polkit_backend_authority_get_action_for_exec_path() for details.
+ * @register_authentication_agent_for_subjects: Called when an
+ * authentication agent is attempting to register for several subjects
+ * at once or %NULL if the backend doesn't support the operation. See
+ * polkit_backend_authority_register_authentication_agent_for_subjects()
+ * for details.
  *
  * Class structure for #PolkitBackendAuthority.
  */
@@ -167,13 +185,46 @@ struct _PolkitBackendAuthorityClass
                                                     const gchar              *id,
                                                     GError                  **error);
 
+  GList *(*enumerate_actions_paged) (PolkitBackendAuthority   *authority,
+                                     PolkitSubject            *caller,
+                                     const gchar              *locale,
+                                     const gchar              *prefix,
+                                     const gchar              *cursor,
+                                     guint                     limit,
+                                     gchar                   **out_next_cursor,
+                                     GError                  **error);
+
+  void (*check_authorizations) (PolkitBackendAuthority        *authority,
+                                PolkitSubject                 *caller,
+                                PolkitSubject                 *subject,
+                                const gchar * const           *action_ids,
+                                PolkitDetails * const         *details,
+                                PolkitCheckAuthorizationFlags  flags,
+                                GCancellable                  *cancellable,
+                                GAsyncReadyCallback            callback,
+                                gpointer                       user_data);
+
+  GList * (*check_authorizations_finish) (PolkitBackendAuthority  *authority,
+                                          GAsyncResult            *res,
+                                          GError                 **error);
+
+  PolkitActionDescription *(*get_action_for_exec_path) (PolkitBackendAuthority   *authority,
+                                                        PolkitSubject            *caller,
+                                                        const gchar              *locale,
+                                                        const gchar              *path,
+                                                        const gchar              *argv1,
+                                                        GError                  **error);
+
+  gboolean (*register_authentication_agent_for_subjects) (PolkitBackendAuthority   *authority,
+                                                          PolkitSubject            *caller,
+                                                          GList                    *subjects,
+                                                          const gchar              *locale,
+                                                          const gchar              *object_path,
+                                                          GVariant                 *options,
+                                                          GError                  **error);
+
   /*< private >*/
   /* Padding for future expansion */
-  void (*_polkit_reserved1) (void);
-  void (*_polkit_reserved2) (void);
-  void (*_polkit_reserved3) (void);
-  void (*_polkit_reserved4) (void);
-  void (*_polkit_reserved5) (void);
   void (*_polkit_reserved6) (void);
   void (*_polkit_reserved7) (void);
   void (*_polkit_reserved8) (void);
@@ -220,6 +271,22 @@ GList   *polkit_backend_authority_enumerate_actions         (PolkitBackendAuthor
                                                              const gchar               *locale,
                                                              GError                   **error);
 
+GList   *polkit_backend_authority_enumerate_actions_paged   (PolkitBackendAuthority    *authority,
+                                                             PolkitSubject             *caller,
+                                                             const gchar               *locale,
+                                                             const gchar               *prefix,
+                                                             const gchar               *cursor,
+                                                             guint                      limit,
+                                                             gchar                    **out_next_cursor,
+                                                             GError                   **error);
+
+PolkitActionDescription *polkit_backend_authority_get_action_for_exec_path (PolkitBackendAuthority    *authority,
+                                                                            PolkitSubject             *caller,
+                                                                            const gchar               *locale,
+                                                                            const gchar               *path,
+                                                                            const gchar               *argv1,
+                                                                            GError                   **error);
+
 void     polkit_backend_authority_check_authorization       (PolkitBackendAuthority        *authority,
                                                              PolkitSubject                 *caller,
                                                              PolkitSubject                 *subject,
@@ -234,6 +301,20 @@ PolkitAuthorizationResult *polkit_backend_authority_check_authorization_finish (
                                                                                 GAsyncResult            *res,
                                                                                 GError                 **error);
 
+void     polkit_backend_authority_check_authorizations      (PolkitBackendAuthority        *authority,
+                                                             PolkitSubject                 *caller,
+                                                             PolkitSubject                 *subject,
+                                                             const gchar * const           *action_ids,
+                                                             PolkitDetails * const         *details,
+                                                             PolkitCheckAuthorizationFlags  flags,
+                                                             GCancellable                  *cancellable,
+                                                             GAsyncReadyCallback            callback,
+                                                             gpointer                       user_data);
+
+GList   *polkit_backend_authority_check_authorizations_finish (PolkitBackendAuthority  *authority,
+                                                               GAsyncResult            *res,
+                                                               GError                 **error);
+
 gboolean polkit_backend_authority_register_authentication_agent (PolkitBackendAuthority    *authority,
                                                                  PolkitSubject             *caller,
                                                                  PolkitSubject             *subject,
@@ -242,6 +323,14 @@ gboolean polkit_backend_authority_register_authentication_agent (PolkitBackendAu
                                                                  GVariant                  *options,
                                                                  GError                   **error);
 
+gboolean polkit_backend_authority_register_authentication_agent_for_subjects (PolkitBackendAuthority    *authority,
+                                                                              PolkitSubject             *caller,
+                                                                              GList                     *subjects,
+                                                                              const gchar               *locale,
+                                                                              const gchar               *object_path,
+                                                                              GVariant                  *options,
+                                                                              GError                   **error);
+
 gboolean polkit_backend_authority_unregister_authentication_agent (PolkitBackendAuthority    *authority,
                                                                    PolkitSubject             *caller,
                                                                    PolkitSubject             *subject,
@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "polkitbackendauthorizationjournal.h"
+
+/**
+ * SECTION:polkitbackendauthorizationjournal
+ * @title: PolkitBackendAuthorizationJournal
+ * @short_description: Temporary authorizations that outlive the daemon
+ * @stability: Unstable
+ *
+ * A #PolkitBackendAuthorizationJournal keeps a copy of every temporary
+ * authorization held by a unix process in a small file mapped into
+ * memory, so that a restarted daemon can pick them up again instead of
+ * asking everybody to authenticate once more.
+ *
+ * The file is a header followed by fixed size slots. A slot is marked
+ * as used only once everything else in it is written, and marked as
+ * free before anything else is touched, so a daemon that dies halfway
+ * never leaves a torn authorization behind. Nothing is ever synced to
+ * disk: the file is meant to live on a tmpfs like /run.
+ *
+ * Expiry times are in g_get_monotonic_time() terms, which only hold
+ * until the next boot; the header records the boot id, and a journal
+ * from another boot is thrown away.
+ */
+
+#define JOURNAL_MAGIC      0x41544b50 /* "PKTA" */
+#define JOURNAL_VERSION    1
+#define JOURNAL_BOOT_ID    "/proc/sys/kernel/random/boot_id"
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_slots;
+  guint32 slot_size;
+  gchar boot_id[48];
+} JournalHeader;
+
+typedef struct
+{
+  gint in_use; /* set last, cleared first */
+  gint32 pid;
+  gint32 uid;
+  guint32 reserved;
+  guint64 start_time;
+  gint64 time_granted;
+  gint64 time_expires;
+  gchar scope[128];
+  gchar action_id[256];
+} JournalSlot;
+
+struct _PolkitBackendAuthorizationJournal
+{
+  gchar *path;
+  gint fd;
+  gpointer data;
+  gsize size;
+  JournalHeader *header;
+  JournalSlot *slots;
+  guint next_free;
+};
+
+/* Reads the id of the running boot, or returns %NULL if there is none */
+static gchar *
+journal_read_boot_id (void)
+{
+  gchar *contents;
+
+  if (!g_file_get_contents (JOURNAL_BOOT_ID, &contents, NULL, NULL))
+    return NULL;
+
+  g_strstrip (contents);
+  if (contents[0] == '\0' || strlen (contents) >= sizeof (((JournalHeader *) NULL)->boot_id))
+    {
+      g_free (contents);
+      return NULL;
+    }
+
+  return contents;
+}
+
+/* Whether the header in the file describes this layout and this boot */
+static gboolean
+journal_header_is_current (const JournalHeader *header,
+                           const gchar         *boot_id)
+{
+  return header->magic == JOURNAL_MAGIC &&
+         header->version == JOURNAL_VERSION &&
+         header->n_slots == POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS &&
+         header->slot_size == sizeof (JournalSlot) &&
+         boot_id != NULL &&
+         strncmp (header->boot_id, boot_id, sizeof (header->boot_id)) == 0;
+}
+
+/**
+ * polkit_backend_authorization_journal_open:
+ * @path: The file to keep the journal in.
+ * @error: Return location for error or %NULL.
+ *
+ * Opens the journal at @path, creating it if needed. A journal that was
+ * written by another version or during another boot is emptied.
+ *
+ * Returns: A #PolkitBackendAuthorizationJournal, or %NULL if @error is
+ * set. Free with polkit_backend_authorization_journal_free().
+ */
+PolkitBackendAuthorizationJournal *
+polkit_backend_authorization_journal_open (const gchar  *path,
+                                           GError      **error)
+{
+  PolkitBackendAuthorizationJournal *journal;
+  struct stat st;
+  gchar *boot_id;
+  gsize size;
+  gint fd;
+
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  journal = NULL;
+  boot_id = NULL;
+  size = sizeof (JournalHeader) + POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS * sizeof (JournalSlot);
+
+  fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+  if (fd < 0)
+    {
+      int errsv = errno;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "Error opening %s: %s", path, g_strerror (errsv));
+      goto out;
+    }
+
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode) || st.st_uid != geteuid ())
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "%s is not a regular file owned by us", path);
+      close (fd);
+      goto out;
+    }
+
+  /* a file of the wrong size can't be trusted at all, start over */
+  if ((gsize) st.st_size != size &&
+      (ftruncate (fd, 0) != 0 || ftruncate (fd, size) != 0))
+    {
+      int errsv = errno;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "Error resizing %s: %s", path, g_strerror (errsv));
+      close (fd);
+      goto out;
+    }
+
+  journal = g_new0 (PolkitBackendAuthorizationJournal, 1);
+  journal->path = g_strdup (path);
+  journal->fd = fd;
+  journal->size = size;
+  journal->data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (journal->data == MAP_FAILED)
+    {
+      int errsv = errno;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "Error mapping %s: %s", path, g_strerror (errsv));
+      journal->data = NULL;
+      polkit_backend_authorization_journal_free (journal);
+      journal = NULL;
+      goto out;
+    }
+  journal->header = journal->data;
+  journal->slots = (JournalSlot *) ((guint8 *) journal->data + sizeof (JournalHeader));
+
+  /* Without a boot id, expiry times can't be told apart from those of an
+   * earlier boot; nothing is restored then, but the journal still works
+   * for the next restart within this boot
+   */
+  boot_id = journal_read_boot_id ();
+  if (!journal_header_is_current (journal->header, boot_id))
+    {
+      memset (journal->data, 0, size);
+      journal->header->magic = JOURNAL_MAGIC;
+      journal->header->version = JOURNAL_VERSION;
+      journal->header->n_slots = POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS;
+      journal->header->slot_size = sizeof (JournalSlot);
+      if (boot_id != NULL)
+        strncpy (journal->header->boot_id, boot_id, sizeof (journal->header->boot_id) - 1);
+    }
+
+ out:
+  g_free (boot_id);
+  return journal;
+}
+
+/**
+ * polkit_backend_authorization_journal_free:
+ * @journal: A #PolkitBackendAuthorizationJournal.
+ *
+ * Closes @journal. The authorizations in it are kept, for the next
+ * daemon to open it.
+ */
+void
+polkit_backend_authorization_journal_free (PolkitBackendAuthorizationJournal *journal)
+{
+  if (journal->data != NULL)
+    munmap (journal->data, journal->size);
+  close (journal->fd);
+  g_free (journal->path);
+  g_free (journal);
+}
+
+/**
+ * polkit_backend_authorization_journal_add:
+ * @journal: A #PolkitBackendAuthorizationJournal.
+ * @subject: The subject that was authorized.
+ * @scope: The subject the authorization was obtained in.
+ * @action_id: The action that was authorized.
+ * @time_granted: When the authorization was obtained, in g_get_monotonic_time() terms.
+ * @time_expires: When the authorization expires, in g_get_monotonic_time() terms.
+ *
+ * Records a temporary authorization. Only authorizations of a
+ * #PolkitUnixProcess with a known uid are recorded, and only while
+ * there is a free slot and the scope and action fit into it.
+ *
+ * Returns: The slot the authorization went into, or -1 if it wasn't recorded.
+ */
+gint
+polkit_backend_authorization_journal_add (PolkitBackendAuthorizationJournal *journal,
+                                          PolkitSubject                     *subject,
+                                          PolkitSubject                     *scope,
+                                          const gchar                       *action_id,
+                                          gint64                             time_granted,
+                                          gint64                             time_expires)
+{
+  JournalSlot *slot;
+  gchar *scope_str;
+  guint n;
+  gint ret;
+
+  g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), -1);
+  g_return_val_if_fail (POLKIT_IS_SUBJECT (scope), -1);
+  g_return_val_if_fail (action_id != NULL, -1);
+
+  ret = -1;
+  scope_str = NULL;
+
+  if (!POLKIT_IS_UNIX_PROCESS (subject) ||
+      polkit_unix_process_get_uid (POLKIT_UNIX_PROCESS (subject)) == -1)
+    goto out;
+
+  scope_str = polkit_subject_to_string (scope);
+  if (scope_str == NULL ||
+      strlen (scope_str) >= sizeof (slot->scope) ||
+      strlen (action_id) >= sizeof (slot->action_id))
+    goto out;
+
+  for (n = 0; n < POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS; n++)
+    {
+      guint index = (journal->next_free + n) % POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS;
+
+      if (g_atomic_int_get (&journal->slots[index].in_use) == 0)
+        {
+          ret = index;
+          break;
+        }
+    }
+  if (ret == -1)
+    goto out;
+
+  slot = &journal->slots[ret];
+  slot->pid = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (subject));
+  slot->uid = polkit_unix_process_get_uid (POLKIT_UNIX_PROCESS (subject));
+  slot->start_time = polkit_unix_process_get_start_time (POLKIT_UNIX_PROCESS (subject));
+  slot->time_granted = time_granted;
+  slot->time_expires = time_expires;
+  memset (slot->scope, 0, sizeof (slot->scope));
+  strcpy (slot->scope, scope_str);
+  memset (slot->action_id, 0, sizeof (slot->action_id));
+  strcpy (slot->action_id, action_id);
+  g_atomic_int_set (&slot->in_use, 1);
+
+  journal->next_free = (ret + 1) % POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS;
+
+ out:
+  g_free (scope_str);
+  return ret;
+}
+
+/**
+ * polkit_backend_authorization_journal_remove:
+ * @journal: A #PolkitBackendAuthorizationJournal.
+ * @slot: A slot returned by polkit_backend_authorization_journal_add().
+ *
+ * Forgets the authorization in @slot.
+ */
+void
+polkit_backend_authorization_journal_remove (PolkitBackendAuthorizationJournal *journal,
+                                             gint                               slot)
+{
+  g_return_if_fail (slot >= 0 && slot < POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS);
+
+  g_atomic_int_set (&journal->slots[slot].in_use, 0);
+}
+
+/**
+ * polkit_backend_authorization_journal_foreach:
+ * @journal: A #PolkitBackendAuthorizationJournal.
+ * @func: The function to call for every authorization.
+ * @user_data: User data to pass to @func.
+ *
+ * Calls @func for every authorization in @journal. Slots that can't be
+ * made sense of are removed instead.
+ */
+void
+polkit_backend_authorization_journal_foreach (PolkitBackendAuthorizationJournal     *journal,
+                                              PolkitBackendAuthorizationJournalFunc  func,
+                                              gpointer                               user_data)
+{
+  guint n;
+
+  g_return_if_fail (func != NULL);
+
+  for (n = 0; n < POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS; n++)
+    {
+      JournalSlot *slot = &journal->slots[n];
+      PolkitSubject *subject;
+      PolkitSubject *scope;
+
+      if (g_atomic_int_get (&slot->in_use) == 0)
+        continue;
+
+      scope = NULL;
+      if (slot->scope[sizeof (slot->scope) - 1] == '\0' &&
+          slot->action_id[sizeof (slot->action_id) - 1] == '\0' &&
+          slot->pid > 0 && slot->uid >= 0)
+        scope = polkit_subject_from_string (slot->scope, NULL);
+
+      if (scope == NULL)
+        {
+          polkit_backend_authorization_journal_remove (journal, n);
+          continue;
+        }
+
+      subject = polkit_unix_process_new_for_owner (slot->pid, slot->start_time, slot->uid);
+      func (journal,
+            n,
+            subject,
+            scope,
+            slot->action_id,
+            slot->time_granted,
+            slot->time_expires,
+            user_data);
+      g_object_unref (subject);
+      g_object_unref (scope);
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined (_POLKIT_BACKEND_COMPILATION) || defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error "This is a private header file."
+#endif
+
+#ifndef __POLKIT_BACKEND_AUTHORIZATION_JOURNAL_H
+#define __POLKIT_BACKEND_AUTHORIZATION_JOURNAL_H
+
+#include <glib-object.h>
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendtypes.h>
+
+G_BEGIN_DECLS
+
+/* Authorizations the journal has room for; the others aren't persisted */
+#define POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS 256
+
+/**
+ * PolkitBackendAuthorizationJournalFunc:
+ * @journal: The #PolkitBackendAuthorizationJournal.
+ * @slot: The slot the authorization is kept in.
+ * @subject: The #PolkitUnixProcess that was authorized.
+ * @scope: The subject the authorization was obtained in.
+ * @action_id: The action that was authorized.
+ * @time_granted: When the authorization was obtained, in g_get_monotonic_time() terms.
+ * @time_expires: When the authorization expires, in g_get_monotonic_time() terms.
+ * @user_data: The user data passed to polkit_backend_authorization_journal_foreach().
+ *
+ * Called for every authorization found in the journal. The callback
+ * may remove @slot.
+ */
+typedef void (*PolkitBackendAuthorizationJournalFunc) (PolkitBackendAuthorizationJournal *journal,
+                                                       gint                               slot,
+                                                       PolkitSubject                     *subject,
+                                                       PolkitSubject                     *scope,
+                                                       const gchar                       *action_id,
+                                                       gint64                             time_granted,
+                                                       gint64                             time_expires,
+                                                       gpointer                           user_data);
+
+PolkitBackendAuthorizationJournal *polkit_backend_authorization_journal_open    (const gchar                            *path,
+                                                                                 GError                                **error);
+void                               polkit_backend_authorization_journal_free    (PolkitBackendAuthorizationJournal      *journal);
+
+gint                               polkit_backend_authorization_journal_add     (PolkitBackendAuthorizationJournal      *journal,
+                                                                                 PolkitSubject                          *subject,
+                                                                                 PolkitSubject                          *scope,
+                                                                                 const gchar                            *action_id,
+                                                                                 gint64                                  time_granted,
+                                                                                 gint64                                  time_expires);
+void                               polkit_backend_authorization_journal_remove  (PolkitBackendAuthorizationJournal      *journal,
+                                                                                 gint                                    slot);
+
+void                               polkit_backend_authorization_journal_foreach (PolkitBackendAuthorizationJournal      *journal,
+                                                                                 PolkitBackendAuthorizationJournalFunc   func,
+                                                                                 gpointer                                user_data);
+
+G_END_DECLS
+
+#endif /* __POLKIT_BACKEND_AUTHORIZATION_JOURNAL_H */
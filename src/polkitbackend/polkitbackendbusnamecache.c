@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include "polkitbackendbusnamecache.h"
+#include <polkit/polkitprivate.h>
+
+/**
+ * SECTION:polkitbackendbusnamecache
+ * @title: PolkitBackendBusNameCache
+ * @short_description: Credentials of unique system bus names
+ * @stability: Unstable
+ *
+ * A #PolkitBackendBusNameCache remembers the process and user behind
+ * unique names on the system bus. A unique name is never handed out
+ * twice and the credentials of a connection never change, so an entry
+ * stays valid until the name goes away, which the owner of the cache
+ * reports with polkit_backend_bus_name_cache_remove().
+ *
+ * Well-known names can change hands at any time and are never
+ * remembered. Lookups may happen from any thread.
+ */
+
+struct _PolkitBackendBusNameCache
+{
+  GMutex lock;
+  /* unique name -> PolkitUnixProcess, with its uid set */
+  GHashTable *processes;
+  /* bumped whenever a name goes away, so that a lookup racing with that
+   * doesn't bring it back */
+  guint generation;
+};
+
+/**
+ * polkit_backend_bus_name_cache_new:
+ *
+ * Creates a new, empty #PolkitBackendBusNameCache.
+ *
+ * Returns: A #PolkitBackendBusNameCache. Free with polkit_backend_bus_name_cache_free().
+ */
+PolkitBackendBusNameCache *
+polkit_backend_bus_name_cache_new (void)
+{
+  PolkitBackendBusNameCache *cache;
+
+  cache = g_new0 (PolkitBackendBusNameCache, 1);
+  g_mutex_init (&cache->lock);
+  cache->processes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+
+  return cache;
+}
+
+/**
+ * polkit_backend_bus_name_cache_free:
+ * @cache: A #PolkitBackendBusNameCache.
+ *
+ * Frees @cache.
+ */
+void
+polkit_backend_bus_name_cache_free (PolkitBackendBusNameCache *cache)
+{
+  g_hash_table_unref (cache->processes);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
+
+/**
+ * polkit_backend_bus_name_cache_get_process:
+ * @cache: A #PolkitBackendBusNameCache.
+ * @system_bus_name: A #PolkitSystemBusName.
+ * @error: Return location for error or %NULL.
+ *
+ * Gets the process behind @system_bus_name, asking the bus only if it
+ * isn't known yet.
+ *
+ * Returns: (transfer full): A #PolkitUnixProcess or %NULL if @error is set.
+ */
+PolkitSubject *
+polkit_backend_bus_name_cache_get_process (PolkitBackendBusNameCache  *cache,
+                                           PolkitSystemBusName        *system_bus_name,
+                                           GError                    **error)
+{
+  const gchar *name;
+  PolkitSubject *process;
+  guint generation;
+
+  g_return_val_if_fail (POLKIT_IS_SYSTEM_BUS_NAME (system_bus_name), NULL);
+
+  name = polkit_system_bus_name_get_name (system_bus_name);
+  if (name[0] != ':')
+    return polkit_system_bus_name_get_process_sync (system_bus_name, NULL, error);
+
+  g_mutex_lock (&cache->lock);
+  process = g_hash_table_lookup (cache->processes, name);
+  if (process != NULL)
+    g_object_ref (process);
+  generation = cache->generation;
+  g_mutex_unlock (&cache->lock);
+
+  if (process != NULL)
+    return process;
+
+  process = polkit_system_bus_name_get_process_sync (system_bus_name, NULL, error);
+  if (process == NULL)
+    return NULL;
+
+  g_mutex_lock (&cache->lock);
+  if (generation == cache->generation)
+    {
+      if (g_hash_table_size (cache->processes) >= POLKIT_BACKEND_BUS_NAME_CACHE_SIZE)
+        g_hash_table_remove_all (cache->processes);
+      g_hash_table_replace (cache->processes, g_strdup (name), g_object_ref (process));
+    }
+  g_mutex_unlock (&cache->lock);
+
+  return process;
+}
+
+/**
+ * polkit_backend_bus_name_cache_get_user:
+ * @cache: A #PolkitBackendBusNameCache.
+ * @system_bus_name: A #PolkitSystemBusName.
+ * @error: Return location for error or %NULL.
+ *
+ * Gets the user behind @system_bus_name, asking the bus only if it
+ * isn't known yet.
+ *
+ * Returns: (transfer full): A #PolkitUnixUser or %NULL if @error is set.
+ */
+PolkitIdentity *
+polkit_backend_bus_name_cache_get_user (PolkitBackendBusNameCache  *cache,
+                                        PolkitSystemBusName        *system_bus_name,
+                                        GError                    **error)
+{
+  PolkitSubject *process;
+  PolkitIdentity *user;
+
+  process = polkit_backend_bus_name_cache_get_process (cache, system_bus_name, error);
+  if (process == NULL)
+    return NULL;
+
+  user = polkit_unix_user_new_shared (polkit_unix_process_get_uid (POLKIT_UNIX_PROCESS (process)));
+  g_object_unref (process);
+
+  return user;
+}
+
+/**
+ * polkit_backend_bus_name_cache_remove:
+ * @cache: A #PolkitBackendBusNameCache.
+ * @name: A unique name that went away.
+ *
+ * Forgets about @name.
+ */
+void
+polkit_backend_bus_name_cache_remove (PolkitBackendBusNameCache *cache,
+                                      const gchar               *name)
+{
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove (cache->processes, name);
+  cache->generation++;
+  g_mutex_unlock (&cache->lock);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined (_POLKIT_BACKEND_COMPILATION) || defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error "This is a private header file."
+#endif
+
+#ifndef __POLKIT_BACKEND_BUS_NAME_CACHE_H
+#define __POLKIT_BACKEND_BUS_NAME_CACHE_H
+
+#include <glib-object.h>
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendtypes.h>
+
+G_BEGIN_DECLS
+
+/* Unique names remembered, at most */
+#define POLKIT_BACKEND_BUS_NAME_CACHE_SIZE 1024
+
+PolkitBackendBusNameCache *polkit_backend_bus_name_cache_new         (void);
+void                       polkit_backend_bus_name_cache_free        (PolkitBackendBusNameCache  *cache);
+
+PolkitSubject             *polkit_backend_bus_name_cache_get_process (PolkitBackendBusNameCache  *cache,
+                                                                      PolkitSystemBusName        *system_bus_name,
+                                                                      GError                    **error);
+PolkitIdentity            *polkit_backend_bus_name_cache_get_user    (PolkitBackendBusNameCache  *cache,
+                                                                      PolkitSystemBusName        *system_bus_name,
+                                                                      GError                    **error);
+
+void                       polkit_backend_bus_name_cache_remove      (PolkitBackendBusNameCache  *cache,
+                                                                      const gchar                *name);
+
+G_END_DECLS
+
+#endif /* __POLKIT_BACKEND_BUS_NAME_CACHE_H */
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include "polkitbackendcheckqueue.h"
+
+/**
+ * SECTION:polkitbackendcheckqueue
+ * @title: PolkitBackendCheckQueue
+ * @short_description: Fair admission of authorization checks
+ * @stability: Unstable
+ *
+ * A #PolkitBackendCheckQueue decides which check runs next when more of
+ * them are pending than may run at once, so that a single busy caller
+ * can't starve everybody else.
+ *
+ * Every caller has a queue of its own. Callers take turns in round
+ * robin order, and a caller may start as many checks in a row as its
+ * weight says before it is the next one's turn. A caller also never
+ * has more than a set number of checks running at once.
+ *
+ * Checks that would make the queue of their caller, or all queues
+ * together, grow beyond their limit are refused right away with
+ * %POLKIT_ERROR_TOO_MANY_REQUESTS rather than waiting.
+ *
+ * The queue is not thread safe and is meant to be used from the main
+ * loop only.
+ */
+
+typedef struct
+{
+  gchar *name;
+  guint weight;
+  guint credit;          /* checks it may still start this turn */
+  GQueue items;          /* waiting to run */
+  guint n_running;
+  gboolean in_ring;
+} CheckQueueCaller;
+
+struct _PolkitBackendCheckQueue
+{
+  PolkitBackendCheckQueueFunc func;
+  gpointer user_data;
+
+  guint max_running;
+  guint max_queued;             /* 0 for no limit */
+  guint max_queued_per_caller;  /* 0 for no limit */
+  guint max_running_per_caller;
+
+  /* name -> CheckQueueCaller, for every caller with checks waiting or running */
+  GHashTable *callers;
+
+  /* callers with checks waiting that may start one, in turn order */
+  GQueue ring;
+
+  guint n_queued;
+  guint n_running;
+  guint n_rejected;
+};
+
+static void
+check_queue_caller_free (CheckQueueCaller *caller)
+{
+  g_warn_if_fail (g_queue_is_empty (&caller->items));
+  g_free (caller->name);
+  g_free (caller);
+}
+
+static gboolean
+check_queue_caller_is_ready (PolkitBackendCheckQueue *queue,
+                             CheckQueueCaller        *caller)
+{
+  return !g_queue_is_empty (&caller->items) && caller->n_running < queue->max_running_per_caller;
+}
+
+/* Gives @caller a turn, unless it has one already or can't use it */
+static void
+check_queue_caller_enqueue (PolkitBackendCheckQueue *queue,
+                            CheckQueueCaller        *caller)
+{
+  if (caller->in_ring || !check_queue_caller_is_ready (queue, caller))
+    return;
+
+  caller->credit = caller->weight;
+  caller->in_ring = TRUE;
+  g_queue_push_tail (&queue->ring, caller);
+}
+
+/* Forgets about @caller once it has nothing left waiting or running */
+static void
+check_queue_caller_maybe_remove (PolkitBackendCheckQueue *queue,
+                                 CheckQueueCaller        *caller)
+{
+  if (!g_queue_is_empty (&caller->items) || caller->n_running > 0)
+    return;
+
+  g_warn_if_fail (!caller->in_ring);
+  g_hash_table_remove (queue->callers, caller->name);
+}
+
+/* Starts checks, in turn, for as long as there is room for more */
+static void
+check_queue_dispatch (PolkitBackendCheckQueue *queue)
+{
+  while (queue->n_running < queue->max_running && !g_queue_is_empty (&queue->ring))
+    {
+      CheckQueueCaller *caller;
+      gpointer item;
+
+      caller = g_queue_peek_head (&queue->ring);
+      if (!check_queue_caller_is_ready (queue, caller))
+        {
+          /* the limits were lowered since it got its turn */
+          g_queue_pop_head (&queue->ring);
+          caller->in_ring = FALSE;
+          continue;
+        }
+
+      item = g_queue_pop_head (&caller->items);
+      queue->n_queued--;
+      queue->n_running++;
+      caller->n_running++;
+      caller->credit--;
+
+      if (!check_queue_caller_is_ready (queue, caller))
+        {
+          /* it gets a new turn when a check finishes or is pushed */
+          g_queue_pop_head (&queue->ring);
+          caller->in_ring = FALSE;
+        }
+      else if (caller->credit == 0)
+        {
+          g_queue_pop_head (&queue->ring);
+          caller->credit = caller->weight;
+          g_queue_push_tail (&queue->ring, caller);
+        }
+
+      queue->func (item, queue->user_data);
+    }
+}
+
+/**
+ * polkit_backend_check_queue_new:
+ * @max_running: How many checks may be running at once, at most.
+ * @func: Function to start a check with.
+ * @user_data: User data to pass to @func.
+ *
+ * Creates a new #PolkitBackendCheckQueue without any limit on how many
+ * checks may be waiting, and allowing every caller a single running
+ * check.
+ *
+ * Returns: A #PolkitBackendCheckQueue. Free with polkit_backend_check_queue_free().
+ */
+PolkitBackendCheckQueue *
+polkit_backend_check_queue_new (guint                        max_running,
+                                PolkitBackendCheckQueueFunc  func,
+                                gpointer                     user_data)
+{
+  PolkitBackendCheckQueue *queue;
+
+  g_return_val_if_fail (max_running > 0, NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+
+  queue = g_new0 (PolkitBackendCheckQueue, 1);
+  queue->func = func;
+  queue->user_data = user_data;
+  queue->max_running = max_running;
+  queue->max_running_per_caller = 1;
+  queue->callers = g_hash_table_new_full (g_str_hash,
+                                          g_str_equal,
+                                          NULL,
+                                          (GDestroyNotify) check_queue_caller_free);
+  g_queue_init (&queue->ring);
+
+  return queue;
+}
+
+/**
+ * polkit_backend_check_queue_free:
+ * @queue: A #PolkitBackendCheckQueue.
+ *
+ * Frees @queue. No check may be waiting or running.
+ */
+void
+polkit_backend_check_queue_free (PolkitBackendCheckQueue *queue)
+{
+  g_warn_if_fail (queue->n_queued == 0 && queue->n_running == 0);
+
+  g_queue_clear (&queue->ring);
+  g_hash_table_unref (queue->callers);
+  g_free (queue);
+}
+
+/**
+ * polkit_backend_check_queue_set_limits:
+ * @queue: A #PolkitBackendCheckQueue.
+ * @max_queued: How many checks may be waiting in all, or 0 for no limit.
+ * @max_queued_per_caller: How many checks a single caller may have waiting, or 0 for no limit.
+ * @max_running_per_caller: How many checks of a single caller may be running at once.
+ *
+ * Sets the limits that apply from now on. Checks already waiting are
+ * kept even if there are more of them than the new limits allow.
+ */
+void
+polkit_backend_check_queue_set_limits (PolkitBackendCheckQueue *queue,
+                                       guint                    max_queued,
+                                       guint                    max_queued_per_caller,
+                                       guint                    max_running_per_caller)
+{
+  GHashTableIter iter;
+  CheckQueueCaller *caller;
+
+  g_return_if_fail (max_running_per_caller > 0);
+
+  queue->max_queued = max_queued;
+  queue->max_queued_per_caller = max_queued_per_caller;
+  queue->max_running_per_caller = max_running_per_caller;
+
+  /* a higher limit may let callers run again */
+  g_hash_table_iter_init (&iter, queue->callers);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &caller))
+    check_queue_caller_enqueue (queue, caller);
+  check_queue_dispatch (queue);
+}
+
+/**
+ * polkit_backend_check_queue_set_max_running:
+ * @queue: A #PolkitBackendCheckQueue.
+ * @max_running: How many checks may be running at once, at most.
+ *
+ * Changes how many checks may run at once. Raising it starts waiting
+ * checks right away, lowering it lets the checks already running
+ * finish.
+ */
+void
+polkit_backend_check_queue_set_max_running (PolkitBackendCheckQueue *queue,
+                                            guint                    max_running)
+{
+  g_return_if_fail (max_running > 0);
+
+  queue->max_running = max_running;
+  check_queue_dispatch (queue);
+}
+
+/**
+ * polkit_backend_check_queue_push:
+ * @queue: A #PolkitBackendCheckQueue.
+ * @caller: The name of whoever asked for the check.
+ * @weight: How many checks in a row @caller may start when it is its turn.
+ * @item: The check.
+ * @error: Return location for error or %NULL.
+ *
+ * Queues @item for @caller, and starts it right away if there is room.
+ *
+ * Returns: %TRUE if @item was queued, %FALSE if @error is set because
+ *   too many checks are waiting already.
+ */
+gboolean
+polkit_backend_check_queue_push (PolkitBackendCheckQueue  *queue,
+                                 const gchar              *caller,
+                                 guint                     weight,
+                                 gpointer                  item,
+                                 GError                  **error)
+{
+  CheckQueueCaller *queue_caller;
+
+  g_return_val_if_fail (caller != NULL, FALSE);
+  g_return_val_if_fail (weight > 0, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  queue_caller = g_hash_table_lookup (queue->callers, caller);
+
+  if (queue->max_queued > 0 && queue->n_queued >= queue->max_queued)
+    {
+      queue->n_rejected++;
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_TOO_MANY_REQUESTS,
+                   "Too many authorization checks are pending, try again later");
+      return FALSE;
+    }
+
+  if (queue->max_queued_per_caller > 0 &&
+      queue_caller != NULL &&
+      g_queue_get_length (&queue_caller->items) >= queue->max_queued_per_caller)
+    {
+      queue->n_rejected++;
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_TOO_MANY_REQUESTS,
+                   "Too many authorization checks are pending for %s, try again later",
+                   caller);
+      return FALSE;
+    }
+
+  if (queue_caller == NULL)
+    {
+      queue_caller = g_new0 (CheckQueueCaller, 1);
+      queue_caller->name = g_strdup (caller);
+      g_queue_init (&queue_caller->items);
+      g_hash_table_insert (queue->callers, queue_caller->name, queue_caller);
+    }
+  queue_caller->weight = weight;
+
+  g_queue_push_tail (&queue_caller->items, item);
+  queue->n_queued++;
+
+  check_queue_caller_enqueue (queue, queue_caller);
+  check_queue_dispatch (queue);
+
+  return TRUE;
+}
+
+/**
+ * polkit_backend_check_queue_done:
+ * @queue: A #PolkitBackendCheckQueue.
+ * @caller: The name @item was pushed with.
+ *
+ * Tells @queue that a running check of @caller is over, making room
+ * for the next one.
+ */
+void
+polkit_backend_check_queue_done (PolkitBackendCheckQueue *queue,
+                                 const gchar             *caller)
+{
+  CheckQueueCaller *queue_caller;
+
+  queue_caller = g_hash_table_lookup (queue->callers, caller);
+  g_return_if_fail (queue_caller != NULL && queue_caller->n_running > 0);
+
+  queue_caller->n_running--;
+  queue->n_running--;
+
+  check_queue_caller_enqueue (queue, queue_caller);
+  check_queue_caller_maybe_remove (queue, queue_caller);
+  check_queue_dispatch (queue);
+}
+
+/**
+ * polkit_backend_check_queue_get_n_queued:
+ * @queue: A #PolkitBackendCheckQueue.
+ *
+ * Gets how many checks are waiting to run.
+ *
+ * Returns: The number of checks waiting.
+ */
+guint
+polkit_backend_check_queue_get_n_queued (PolkitBackendCheckQueue *queue)
+{
+  return queue->n_queued;
+}
+
+/**
+ * polkit_backend_check_queue_get_n_running:
+ * @queue: A #PolkitBackendCheckQueue.
+ *
+ * Gets how many checks are running.
+ *
+ * Returns: The number of checks running.
+ */
+guint
+polkit_backend_check_queue_get_n_running (PolkitBackendCheckQueue *queue)
+{
+  return queue->n_running;
+}
+
+/**
+ * polkit_backend_check_queue_get_n_rejected:
+ * @queue: A #PolkitBackendCheckQueue.
+ *
+ * Gets how many checks were refused because too many were waiting.
+ *
+ * Returns: The number of checks refused so far.
+ */
+guint
+polkit_backend_check_queue_get_n_rejected (PolkitBackendCheckQueue *queue)
+{
+  return queue->n_rejected;
+}
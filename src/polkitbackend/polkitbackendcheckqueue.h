@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined (_POLKIT_BACKEND_COMPILATION) || defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error "This is a private header file."
+#endif
+
+#ifndef __POLKIT_BACKEND_CHECK_QUEUE_H
+#define __POLKIT_BACKEND_CHECK_QUEUE_H
+
+#include <glib-object.h>
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendtypes.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PolkitBackendCheckQueueFunc:
+ * @item: The item that may run now.
+ * @user_data: The user data passed to polkit_backend_check_queue_new().
+ *
+ * Starts work on @item. This must not call back into the queue; once
+ * the work is over, polkit_backend_check_queue_done() is to be called.
+ */
+typedef void (*PolkitBackendCheckQueueFunc) (gpointer item,
+                                             gpointer user_data);
+
+PolkitBackendCheckQueue *polkit_backend_check_queue_new            (guint                        max_running,
+                                                                   PolkitBackendCheckQueueFunc  func,
+                                                                   gpointer                     user_data);
+void                     polkit_backend_check_queue_free           (PolkitBackendCheckQueue     *queue);
+
+void                     polkit_backend_check_queue_set_limits     (PolkitBackendCheckQueue     *queue,
+                                                                   guint                        max_queued,
+                                                                   guint                        max_queued_per_caller,
+                                                                   guint                        max_running_per_caller);
+void                     polkit_backend_check_queue_set_max_running (PolkitBackendCheckQueue    *queue,
+                                                                    guint                       max_running);
+
+gboolean                 polkit_backend_check_queue_push           (PolkitBackendCheckQueue     *queue,
+                                                                   const gchar                 *caller,
+                                                                   guint                        weight,
+                                                                   gpointer                     item,
+                                                                   GError                     **error);
+void                     polkit_backend_check_queue_done           (PolkitBackendCheckQueue     *queue,
+                                                                   const gchar                 *caller);
+
+guint                    polkit_backend_check_queue_get_n_queued   (PolkitBackendCheckQueue     *queue);
+guint                    polkit_backend_check_queue_get_n_running  (PolkitBackendCheckQueue     *queue);
+guint                    polkit_backend_check_queue_get_n_rejected (PolkitBackendCheckQueue     *queue);
+
+G_END_DECLS
+
+#endif /* __POLKIT_BACKEND_CHECK_QUEUE_H */
@@ -21,21 +21,28 @@
 
 #include "config.h"
 #include <errno.h>
-#include <pwd.h>
-#include <grp.h>
-#ifdef HAVE_NETGROUP_H
-#include <netgroup.h>
-#else
-#include <netdb.h>
-#endif
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
 #include <locale.h>
+#ifdef HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
 
 #include <polkit/polkit.h>
 #include "polkitbackendinteractiveauthority.h"
 #include "polkitbackendactionpool.h"
 #include "polkitbackendsessionmonitor.h"
+#include "polkitbackendpolicyidentity.h"
+#include "polkitbackendsubjectinfo.h"
+#include "polkitbackendauditlog.h"
+#include "polkitbackendauthorizationjournal.h"
+#include "polkitbackendcheckqueue.h"
+#include "polkitbackendmetrics.h"
+#include "polkitbackendprobes.h"
 
 #include <polkit/polkitprivate.h>
 
@@ -69,6 +76,26 @@ static const gchar *temporary_authorization_store_add_authorization (TemporaryAu
 static void temporary_authorization_store_remove_authorizations_for_system_bus_name (TemporaryAuthorizationStore *store,
                                                                                      const gchar *name);
 
+static guint temporary_authorization_store_remove_authorizations_for_scope (TemporaryAuthorizationStore *store,
+                                                                           PolkitSubject               *scope);
+static void  temporary_authorization_store_remove_authorizations_for_ended_sessions (TemporaryAuthorizationStore *store);
+
+static void         temporary_authorization_store_set_journal (TemporaryAuthorizationStore *store,
+                                                               const gchar                 *path);
+static const gchar *temporary_authorization_store_get_journal (TemporaryAuthorizationStore *store);
+
+static gboolean temporary_authorization_store_is_empty (TemporaryAuthorizationStore *store);
+
+static void temporary_authorization_store_get_memory_usage (TemporaryAuthorizationStore *store,
+                                                            guint64                     *bytes,
+                                                            guint64                     *objects);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct LocalizedChallengeData LocalizedChallengeData;
+
+static void localized_challenge_data_free (LocalizedChallengeData *data);
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 struct AuthenticationAgent;
@@ -94,8 +121,8 @@ static AuthenticationAgent *authentication_agent_ref   (AuthenticationAgent *age
 static void                 authentication_agent_unref (AuthenticationAgent *agent);
 
 static void                authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
-                                                                    PolkitSubject               *subject,
-                                                                    PolkitIdentity              *user_of_subject,
+                                                                    PolkitBackendSubjectInfo    *subject_info,
+                                                                    PolkitSubject               *scope,
                                                                     PolkitBackendInteractiveAuthority *authority,
                                                                     const gchar                 *action_id,
                                                                     PolkitDetails               *details,
@@ -105,10 +132,12 @@ static void                authentication_agent_initiate_challenge (Authenticati
                                                                     AuthenticationAgentCallback  callback,
                                                                     gpointer                     user_data);
 
-static PolkitSubject *authentication_agent_get_scope (AuthenticationAgent *agent);
+static PolkitSubject *authentication_agent_get_scope_for_subject (PolkitBackendInteractiveAuthority *authority,
+                                                                  AuthenticationAgent               *agent,
+                                                                  PolkitBackendSubjectInfo          *subject_info);
 
 static AuthenticationAgent *get_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authority,
-                                                                  PolkitSubject *subject);
+                                                                  PolkitBackendSubjectInfo *subject_info);
 
 
 static AuthenticationSession *get_authentication_session_for_uid_and_cookie (PolkitBackendInteractiveAuthority *authority,
@@ -132,6 +161,22 @@ static GList *polkit_backend_interactive_authority_enumerate_actions  (PolkitBac
                                                                  const gchar              *locale,
                                                                  GError                  **error);
 
+static GList *polkit_backend_interactive_authority_enumerate_actions_paged (PolkitBackendAuthority   *authority,
+                                                                      PolkitSubject            *caller,
+                                                                      const gchar              *locale,
+                                                                      const gchar              *prefix,
+                                                                      const gchar              *cursor,
+                                                                      guint                     limit,
+                                                                      gchar                   **out_next_cursor,
+                                                                      GError                  **error);
+
+static PolkitActionDescription *polkit_backend_interactive_authority_get_action_for_exec_path (PolkitBackendAuthority   *authority,
+                                                                                               PolkitSubject            *caller,
+                                                                                               const gchar              *locale,
+                                                                                               const gchar              *path,
+                                                                                               const gchar              *argv1,
+                                                                                               GError                  **error);
+
 static void polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority        *authority,
                                                                 PolkitSubject                 *caller,
                                                                 PolkitSubject                 *subject,
@@ -147,15 +192,25 @@ static PolkitAuthorizationResult *polkit_backend_interactive_authority_check_aut
                                                                  GAsyncResult            *res,
                                                                  GError                 **error);
 
-static PolkitAuthorizationResult *check_authorization_sync (PolkitBackendAuthority         *authority,
-                                                            PolkitSubject                  *caller,
-                                                            PolkitSubject                  *subject,
-                                                            const gchar                    *action_id,
-                                                            PolkitDetails                  *details,
-                                                            PolkitCheckAuthorizationFlags   flags,
-                                                            PolkitImplicitAuthorization    *out_implicit_authorization,
-                                                            gboolean                        checking_imply,
-                                                            GError                        **error);
+static void polkit_backend_interactive_authority_check_authorizations (PolkitBackendAuthority        *authority,
+                                                                  PolkitSubject                 *caller,
+                                                                  PolkitSubject                 *subject,
+                                                                  const gchar * const           *action_ids,
+                                                                  PolkitDetails * const         *details,
+                                                                  PolkitCheckAuthorizationFlags  flags,
+                                                                  GCancellable                  *cancellable,
+                                                                  GAsyncReadyCallback            callback,
+                                                                  gpointer                       user_data);
+
+static GList *polkit_backend_interactive_authority_check_authorizations_finish (PolkitBackendAuthority  *authority,
+                                                                           GAsyncResult            *res,
+                                                                           GError                 **error);
+
+static void check_authorization_thread_func (gpointer data,
+                                             gpointer user_data);
+
+static void check_authorization_queue_func (gpointer item,
+                                            gpointer user_data);
 
 static gboolean polkit_backend_interactive_authority_register_authentication_agent (PolkitBackendAuthority   *authority,
                                                                                     PolkitSubject            *caller,
@@ -165,6 +220,14 @@ static gboolean polkit_backend_interactive_authority_register_authentication_age
                                                                                     GVariant                 *options,
                                                                                     GError                  **error);
 
+static gboolean polkit_backend_interactive_authority_register_authentication_agent_for_subjects (PolkitBackendAuthority   *authority,
+                                                                                                 PolkitSubject            *caller,
+                                                                                                 GList                    *subjects,
+                                                                                                 const gchar              *locale,
+                                                                                                 const gchar              *object_path,
+                                                                                                 GVariant                 *options,
+                                                                                                 GError                  **error);
+
 static gboolean polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBackendAuthority   *authority,
                                                                                       PolkitSubject            *caller,
                                                                                       PolkitSubject            *subject,
@@ -217,12 +280,111 @@ typedef struct
    */
   GHashTable *hash_scope_to_authentication_agent;
 
+  /* cookie -> AuthenticationSession, for every session of a registered agent */
+  GHashTable *hash_cookie_to_authentication_session;
+
+  /* unique name -> GQueue of AuthenticationAgent, for the agents owned by that name */
+  GHashTable *hash_name_to_authentication_agents;
+
+  /* unique name -> GQueue of AuthenticationSession, for the sessions initiated
+   * by that name and for the sessions whose subject is that name
+   */
+  GHashTable *hash_initiator_to_authentication_sessions;
+  GHashTable *hash_subject_name_to_authentication_sessions;
+
+  /* unique name -> AuthenticationAgent (not referenced) or NULL, the agent
+   * resolved for a subject that is that name; emptied whenever an agent
+   * comes or goes, so it never outlives the agents it points to
+   */
+  GHashTable *hash_name_to_resolved_agent;
+
   GDBusConnection *system_bus_connection;
   guint name_owner_changed_signal_id;
 
   guint64 agent_serial;
+
+  /* NSS lookups for the subject and for admin group expansion */
+  PolicyIdentityCache *identities;
+  guint identity_ttl;
+  guint identity_negative_ttl;
+
+  /* groups and netgroups whose members are kept cached for challenges */
+  GList *admin_identities;
+  guint admin_identities_refresh_id;
+
+  /* session id -> NULL, for the sessions whose users have been prefetched */
+  GHashTable *known_sessions;
+
+  /* records of completed checks, written out off the main loop */
+  PolkitBackendAuditLog *audit_log;
+
+  /* check key -> PendingChallenge, for challenges still waiting on an agent */
+  GHashTable *hash_key_to_pending_challenge;
+
+  /* action id and locale -> LocalizedChallengeData, until the actions change */
+  GHashTable *hash_key_to_localized_challenge_data;
+
+  /* evaluates checks off the main loop, or NULL to do it inline */
+  GThreadPool *check_pool;
+
+  /* decides which caller's check goes to the pool next, or NULL without a pool */
+  PolkitBackendCheckQueue *check_queue;
+
+  /* checks not concluded yet, and when the last one was started or concluded */
+  guint n_pending_checks;
+  gint64 last_check_activity;
+  guint check_max_queued;
+  guint check_max_queued_per_caller;
+  guint check_max_running_per_caller;
+  guint check_threads; /* 0 for the default */
+
+  /* counters and histograms, or NULL until someone asks for them */
+  PolkitBackendMetrics *metrics;
+  gpointer metrics_registration;
 } PolkitBackendInteractiveAuthorityPrivate;
 
+/* Checks evaluated at the same time by default, at most */
+#define CHECK_AUTHORIZATION_MAX_THREADS 4
+
+/* Checks waiting for a worker before new ones are refused, in all and per caller */
+#define CHECK_QUEUE_MAX_QUEUED 1024
+#define CHECK_QUEUE_MAX_QUEUED_PER_CALLER 64
+/* Checks of a single caller evaluated at the same time, at most */
+#define CHECK_QUEUE_MAX_RUNNING_PER_CALLER 2
+/* Checks a uid 0 caller may start in a row, where everybody else gets one */
+#define CHECK_QUEUE_ROOT_WEIGHT 4
+
+/* (action, locale) pairs whose challenge data is remembered, at most */
+#define LOCALIZED_CHALLENGE_DATA_CACHE_SIZE 512
+
+/* Actions a single CheckAuthorizations() request may ask about */
+#define CHECK_AUTHORIZATIONS_MAX_CHECKS 256
+
+/* How long NSS answers are trusted, in seconds */
+#define IDENTITY_CACHE_SIZE 1024
+#define IDENTITY_CACHE_TTL 60
+#define IDENTITY_CACHE_NEGATIVE_TTL 10
+/* How long past that a stale answer is served while it is refreshed; the
+ * records decide checks, so a user removed from a group mustn't keep
+ * passing for long
+ */
+#define IDENTITY_CACHE_MAX_STALE 5
+
+enum
+{
+  PROP_0,
+  PROP_IDENTITY_TTL,
+  PROP_IDENTITY_NEGATIVE_TTL,
+  PROP_AUDIT_LOG_LEVEL,
+  PROP_MAX_QUEUED_CHECKS,
+  PROP_MAX_QUEUED_CHECKS_PER_CALLER,
+  PROP_MAX_RUNNING_CHECKS_PER_CALLER,
+  PROP_QUEUED_CHECKS,
+  PROP_REJECTED_CHECKS,
+  PROP_CHECK_THREADS,
+  PROP_TEMPORARY_AUTHORIZATION_JOURNAL,
+};
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 G_DEFINE_TYPE (PolkitBackendInteractiveAuthority,
@@ -243,9 +405,18 @@ identity_is_root_user (PolkitIdentity *user)
 
 static void
 action_pool_changed (PolkitBackendActionPool *action_pool,
+                     const gchar * const *action_ids,
                      PolkitBackendInteractiveAuthority *authority)
 {
-  g_signal_emit_by_name (authority, "changed");
+  PolkitBackendInteractiveAuthorityPrivate *priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  /* messages and icons may have changed along with the actions */
+  g_hash_table_remove_all (priv->hash_key_to_localized_challenge_data);
+
+  /* the old actions are gone now, give their memory back */
+  polkit_backend_interactive_authority_trim_memory (authority);
+
+  polkit_backend_interactive_authority_actions_changed (authority, action_ids);
 }
 
 
@@ -279,20 +450,265 @@ on_name_owner_changed_signal (GDBusConnection *connection,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Remembers the current sessions and returns the uids of their users. If
+ * @prefetch is %TRUE, the users of sessions that weren't there last time
+ * are looked up in the background, so that their first check after login
+ * doesn't wait on NSS.
+ */
+static GArray *
+update_known_sessions (PolkitBackendInteractiveAuthority *authority,
+                       gboolean                           prefetch)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+  GHashTable *known_sessions;
+  GList *sessions;
+  GList *l;
+  GArray *uids;
+
+  uids = g_array_new (FALSE, FALSE, sizeof (uid_t));
+  known_sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  sessions = polkit_backend_session_monitor_get_sessions (priv->session_monitor);
+  for (l = sessions; l != NULL; l = l->next)
+    {
+      const gchar *session_id;
+      PolkitIdentity *user;
+      uid_t uid;
+      guint n;
+
+      session_id = polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (l->data));
+      user = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
+                                                                  POLKIT_SUBJECT (l->data),
+                                                                  NULL,
+                                                                  NULL);
+      g_hash_table_insert (known_sessions, g_strdup (session_id), NULL);
+      if (user == NULL)
+        continue;
+
+      if (POLKIT_IS_UNIX_USER (user))
+        {
+          uid = polkit_unix_user_get_uid (POLKIT_UNIX_USER (user));
+          for (n = 0; n < uids->len; n++)
+            {
+              if (g_array_index (uids, uid_t, n) == uid)
+                break;
+            }
+          if (n == uids->len)
+            g_array_append_val (uids, uid);
+
+          /* the user record carries the groups, so those come along */
+          if (prefetch && !g_hash_table_lookup_extended (priv->known_sessions, session_id, NULL, NULL))
+            policy_identity_cache_prefetch_user (priv->identities, uid);
+        }
+      g_object_unref (user);
+    }
+  g_list_free_full (sessions, g_object_unref);
+
+  g_hash_table_unref (priv->known_sessions);
+  priv->known_sessions = known_sessions;
+
+  return uids;
+}
+
 static void
 on_session_monitor_changed (PolkitBackendSessionMonitor *monitor,
                             gpointer                     user_data)
 {
   PolkitBackendInteractiveAuthority *authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (user_data);
+  PolkitBackendInteractiveAuthorityPrivate *priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  /* agents are told through the signal below as well */
+  temporary_authorization_store_remove_authorizations_for_ended_sessions (priv->temporary_authorization_store);
+  g_array_unref (update_known_sessions (authority, TRUE));
   g_signal_emit_by_name (authority, "changed");
 }
 
+/* A multimap from unique system bus names to whatever they own */
+static GHashTable *
+name_index_new (void)
+{
+  return g_hash_table_new_full (g_str_hash,
+                                g_str_equal,
+                                g_free,
+                                (GDestroyNotify) g_queue_free);
+}
+
+static void
+name_index_add (GHashTable  *index,
+                const gchar *name,
+                gpointer     data)
+{
+  GQueue *queue;
+
+  queue = g_hash_table_lookup (index, name);
+  if (queue == NULL)
+    {
+      queue = g_queue_new ();
+      g_hash_table_insert (index, g_strdup (name), queue);
+    }
+  g_queue_push_tail (queue, data);
+}
+
+static void
+name_index_remove (GHashTable  *index,
+                   const gchar *name,
+                   gpointer     data)
+{
+  GQueue *queue;
+
+  queue = g_hash_table_lookup (index, name);
+  if (queue == NULL)
+    return;
+
+  g_queue_remove (queue, data);
+  if (g_queue_is_empty (queue))
+    g_hash_table_remove (index, name);
+}
+
+/* Returns the entries for @name, the list is owned by @index */
+static GList *
+name_index_lookup (GHashTable  *index,
+                   const gchar *name)
+{
+  GQueue *queue;
+
+  queue = g_hash_table_lookup (index, name);
+  return queue != NULL ? queue->head : NULL;
+}
+
+/* Nothing is recorded until polkit_backend_interactive_authority_register_metrics()
+ * is called; these are safe to use from the workers of the check pool
+ */
+static gint64
+metrics_now (PolkitBackendInteractiveAuthorityPrivate *priv)
+{
+  return g_atomic_pointer_get (&priv->metrics) != NULL ? g_get_monotonic_time () : 0;
+}
+
+/* Returns how long the phase took, or 0 if it wasn't timed */
+static gint64
+metrics_add_latency (PolkitBackendInteractiveAuthorityPrivate *priv,
+                     PolkitBackendMetricsPhase                 phase,
+                     gint64                                    start)
+{
+  PolkitBackendMetrics *metrics = g_atomic_pointer_get (&priv->metrics);
+  gint64 usec;
+
+  /* started before metrics were turned on */
+  if (start == 0)
+    return 0;
+
+  usec = g_get_monotonic_time () - start;
+  if (metrics != NULL)
+    polkit_backend_metrics_add_latency (metrics, phase, usec);
+  return usec;
+}
+
+static void
+metrics_count_call (PolkitBackendInteractiveAuthorityPrivate *priv,
+                    PolkitBackendMetricsMethod                method)
+{
+  PolkitBackendMetrics *metrics = g_atomic_pointer_get (&priv->metrics);
+
+  if (metrics != NULL)
+    polkit_backend_metrics_count_call (metrics, method);
+}
+
+static void
+metrics_count (PolkitBackendInteractiveAuthorityPrivate *priv,
+               PolkitBackendMetricsCounter               counter)
+{
+  PolkitBackendMetrics *metrics = g_atomic_pointer_get (&priv->metrics);
+
+  if (metrics != NULL)
+    polkit_backend_metrics_count (metrics, counter);
+}
+
+static void
+update_check_queue_limits (PolkitBackendInteractiveAuthorityPrivate *priv)
+{
+  if (priv->check_queue != NULL)
+    polkit_backend_check_queue_set_limits (priv->check_queue,
+                                           priv->check_max_queued,
+                                           priv->check_max_queued_per_caller,
+                                           priv->check_max_running_per_caller);
+}
+
+static guint
+get_check_threads (PolkitBackendInteractiveAuthorityPrivate *priv)
+{
+  if (priv->check_threads > 0)
+    return priv->check_threads;
+  return MIN (g_get_num_processors (), CHECK_AUTHORIZATION_MAX_THREADS);
+}
+
+static void
+update_check_threads (PolkitBackendInteractiveAuthorityPrivate *priv)
+{
+  GError *error;
+  guint max_threads;
+
+  if (priv->check_pool == NULL)
+    return;
+
+  max_threads = get_check_threads (priv);
+  error = NULL;
+  if (!g_thread_pool_set_max_threads (priv->check_pool, max_threads, &error))
+    {
+      g_warning ("Error starting threads for authorization checks: %s", error->message);
+      g_error_free (error);
+      return;
+    }
+  /* keep the queue from handing out more checks than there are threads */
+  polkit_backend_check_queue_set_max_running (priv->check_queue, max_threads);
+}
+
+static void
+prefetch_admin_identities (PolkitBackendInteractiveAuthorityPrivate *priv)
+{
+  GList *l;
+
+  for (l = priv->admin_identities; l != NULL; l = l->next)
+    {
+      PolkitIdentity *identity = POLKIT_IDENTITY (l->data);
+
+      if (POLKIT_IS_UNIX_GROUP (identity))
+        policy_identity_cache_prefetch_group (priv->identities,
+                                              polkit_unix_group_get_gid (POLKIT_UNIX_GROUP (identity)));
+      else if (POLKIT_IS_UNIX_NETGROUP (identity))
+        policy_identity_cache_prefetch_netgroup (priv->identities,
+                                                 polkit_unix_netgroup_get_name (POLKIT_UNIX_NETGROUP (identity)));
+    }
+}
+
+static gboolean
+on_admin_identities_refresh (gpointer user_data)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (user_data);
+
+  prefetch_admin_identities (priv);
+
+  return TRUE; /* keep source */
+}
+
+static void
+schedule_admin_identities_refresh (PolkitBackendInteractiveAuthority *authority)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  if (priv->admin_identities_refresh_id > 0)
+    g_source_remove (priv->admin_identities_refresh_id);
+  priv->admin_identities_refresh_id = g_timeout_add_seconds (MAX (priv->identity_ttl, 1),
+                                                             on_admin_identities_refresh,
+                                                             authority);
+}
+
 static void
 polkit_backend_interactive_authority_init (PolkitBackendInteractiveAuthority *authority)
 {
   PolkitBackendInteractiveAuthorityPrivate *priv;
   GFile *directory;
   GError *error;
+  guint max_threads;
 
   /* Force registering error domain */
   (void)POLKIT_ERROR;
@@ -300,7 +716,10 @@ polkit_backend_interactive_authority_init (PolkitBackendInteractiveAuthority *au
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
   directory = g_file_new_for_path (PACKAGE_DATA_DIR "/polkit-1/actions");
-  priv->action_pool = polkit_backend_action_pool_new (directory);
+  priv->action_pool = POLKIT_BACKEND_ACTION_POOL (g_object_new (POLKIT_BACKEND_TYPE_ACTION_POOL,
+                                                                "directory", directory,
+                                                                "cache-file", PACKAGE_LOCALSTATE_DIR "/cache/polkit-1/actions.cache",
+                                                                NULL));
   g_object_unref (directory);
   g_signal_connect (priv->action_pool,
                     "changed",
@@ -309,11 +728,60 @@ polkit_backend_interactive_authority_init (PolkitBackendInteractiveAuthority *au
 
   priv->temporary_authorization_store = temporary_authorization_store_new (authority);
 
+  priv->identity_ttl = IDENTITY_CACHE_TTL;
+  priv->identity_negative_ttl = IDENTITY_CACHE_NEGATIVE_TTL;
+  priv->known_sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  priv->identities = policy_identity_cache_new (IDENTITY_CACHE_SIZE,
+                                                priv->identity_ttl * G_USEC_PER_SEC,
+                                                priv->identity_negative_ttl * G_USEC_PER_SEC,
+                                                IDENTITY_CACHE_MAX_STALE * G_USEC_PER_SEC);
+
+  priv->audit_log = polkit_backend_audit_log_new (POLKIT_BACKEND_AUTHORITY (authority),
+                                                  POLKIT_BACKEND_AUDIT_LOG_CAPACITY);
+
+  priv->check_max_queued = CHECK_QUEUE_MAX_QUEUED;
+  priv->check_max_queued_per_caller = CHECK_QUEUE_MAX_QUEUED_PER_CALLER;
+  priv->check_max_running_per_caller = CHECK_QUEUE_MAX_RUNNING_PER_CALLER;
+
+  error = NULL;
+  max_threads = get_check_threads (priv);
+  priv->check_pool = g_thread_pool_new (check_authorization_thread_func,
+                                        NULL,
+                                        max_threads,
+                                        FALSE,
+                                        &error);
+  if (priv->check_pool == NULL)
+    {
+      g_warning ("Error creating threads for authorization checks: %s", error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      /* never more checks in the pool than it has threads, so that the
+       * queue rather than the pool decides what runs next */
+      priv->check_queue = polkit_backend_check_queue_new (max_threads,
+                                                          check_authorization_queue_func,
+                                                          authority);
+      update_check_queue_limits (priv);
+    }
+
   priv->hash_scope_to_authentication_agent = g_hash_table_new_full ((GHashFunc) polkit_subject_hash,
                                                                     (GEqualFunc) polkit_subject_equal,
                                                                     (GDestroyNotify) g_object_unref,
                                                                     (GDestroyNotify) authentication_agent_unref);
 
+  priv->hash_cookie_to_authentication_session = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->hash_key_to_pending_challenge = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->hash_key_to_localized_challenge_data = g_hash_table_new_full (g_str_hash,
+                                                                      g_str_equal,
+                                                                      g_free,
+                                                                      (GDestroyNotify) localized_challenge_data_free);
+  priv->hash_name_to_authentication_agents = name_index_new ();
+  priv->hash_name_to_resolved_agent = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  priv->last_check_activity = g_get_monotonic_time ();
+  priv->hash_initiator_to_authentication_sessions = name_index_new ();
+  priv->hash_subject_name_to_authentication_sessions = name_index_new ();
+
   priv->session_monitor = polkit_backend_session_monitor_new ();
   g_signal_connect (priv->session_monitor,
                     "changed",
@@ -359,6 +827,21 @@ polkit_backend_interactive_authority_finalize (GObject *object)
   if (priv->system_bus_connection != NULL)
     g_object_unref (priv->system_bus_connection);
 
+  /* every queued check holds a reference, so the pool is idle by now */
+  if (priv->check_pool != NULL)
+    g_thread_pool_free (priv->check_pool, FALSE, TRUE);
+
+  if (priv->check_queue != NULL)
+    polkit_backend_check_queue_free (priv->check_queue);
+
+  /* writes out what is still queued, so do it while everything is around */
+  polkit_backend_audit_log_free (priv->audit_log);
+
+  if (priv->metrics_registration != NULL)
+    polkit_backend_interactive_authority_unregister_metrics (priv->metrics_registration);
+  if (priv->metrics != NULL)
+    polkit_backend_metrics_free (priv->metrics);
+
   if (priv->action_pool != NULL)
     g_object_unref (priv->action_pool);
 
@@ -368,10 +851,145 @@ polkit_backend_interactive_authority_finalize (GObject *object)
   temporary_authorization_store_free (priv->temporary_authorization_store);
 
   g_hash_table_unref (priv->hash_scope_to_authentication_agent);
+  g_hash_table_unref (priv->hash_cookie_to_authentication_session);
+  g_hash_table_unref (priv->hash_key_to_pending_challenge);
+  g_hash_table_unref (priv->hash_key_to_localized_challenge_data);
+  g_hash_table_unref (priv->hash_name_to_authentication_agents);
+  g_hash_table_unref (priv->hash_name_to_resolved_agent);
+  g_hash_table_unref (priv->hash_initiator_to_authentication_sessions);
+  g_hash_table_unref (priv->hash_subject_name_to_authentication_sessions);
+
+  if (priv->admin_identities_refresh_id > 0)
+    g_source_remove (priv->admin_identities_refresh_id);
+  g_list_free_full (priv->admin_identities, g_object_unref);
+
+  g_hash_table_unref (priv->known_sessions);
+  policy_identity_cache_free (priv->identities);
 
   G_OBJECT_CLASS (polkit_backend_interactive_authority_parent_class)->finalize (object);
 }
 
+static void
+polkit_backend_interactive_authority_set_property (GObject      *object,
+                                                   guint         prop_id,
+                                                   const GValue *value,
+                                                   GParamSpec   *pspec)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (object);
+
+  switch (prop_id)
+    {
+    case PROP_IDENTITY_TTL:
+      priv->identity_ttl = g_value_get_uint (value);
+      break;
+
+    case PROP_IDENTITY_NEGATIVE_TTL:
+      priv->identity_negative_ttl = g_value_get_uint (value);
+      break;
+
+    case PROP_AUDIT_LOG_LEVEL:
+      polkit_backend_audit_log_set_level (priv->audit_log, g_value_get_uint (value));
+      return;
+
+    case PROP_MAX_QUEUED_CHECKS:
+      priv->check_max_queued = g_value_get_uint (value);
+      update_check_queue_limits (priv);
+      return;
+
+    case PROP_MAX_QUEUED_CHECKS_PER_CALLER:
+      priv->check_max_queued_per_caller = g_value_get_uint (value);
+      update_check_queue_limits (priv);
+      return;
+
+    case PROP_MAX_RUNNING_CHECKS_PER_CALLER:
+      priv->check_max_running_per_caller = g_value_get_uint (value);
+      update_check_queue_limits (priv);
+      return;
+
+    case PROP_CHECK_THREADS:
+      priv->check_threads = g_value_get_uint (value);
+      update_check_threads (priv);
+      return;
+
+    case PROP_TEMPORARY_AUTHORIZATION_JOURNAL:
+      temporary_authorization_store_set_journal (priv->temporary_authorization_store,
+                                                 g_value_get_string (value));
+      return;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      return;
+    }
+
+  policy_identity_cache_set_ttl (priv->identities,
+                                 priv->identity_ttl * G_USEC_PER_SEC,
+                                 priv->identity_negative_ttl * G_USEC_PER_SEC);
+
+  /* refresh the admin groups as often as their members expire */
+  if (priv->admin_identities_refresh_id > 0)
+    schedule_admin_identities_refresh (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (object));
+}
+
+static void
+polkit_backend_interactive_authority_get_property (GObject    *object,
+                                                   guint       prop_id,
+                                                   GValue     *value,
+                                                   GParamSpec *pspec)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (object);
+
+  switch (prop_id)
+    {
+    case PROP_IDENTITY_TTL:
+      g_value_set_uint (value, priv->identity_ttl);
+      break;
+
+    case PROP_IDENTITY_NEGATIVE_TTL:
+      g_value_set_uint (value, priv->identity_negative_ttl);
+      break;
+
+    case PROP_AUDIT_LOG_LEVEL:
+      g_value_set_uint (value, polkit_backend_audit_log_get_level (priv->audit_log));
+      break;
+
+    case PROP_MAX_QUEUED_CHECKS:
+      g_value_set_uint (value, priv->check_max_queued);
+      break;
+
+    case PROP_MAX_QUEUED_CHECKS_PER_CALLER:
+      g_value_set_uint (value, priv->check_max_queued_per_caller);
+      break;
+
+    case PROP_MAX_RUNNING_CHECKS_PER_CALLER:
+      g_value_set_uint (value, priv->check_max_running_per_caller);
+      break;
+
+    case PROP_QUEUED_CHECKS:
+      g_value_set_uint (value, priv->check_queue != NULL ? polkit_backend_check_queue_get_n_queued (priv->check_queue) : 0);
+      break;
+
+    case PROP_REJECTED_CHECKS:
+      g_value_set_uint (value, priv->check_queue != NULL ? polkit_backend_check_queue_get_n_rejected (priv->check_queue) : 0);
+      break;
+
+    case PROP_CHECK_THREADS:
+      g_value_set_uint (value, priv->check_pool != NULL ? get_check_threads (priv) : 0);
+      break;
+
+    case PROP_TEMPORARY_AUTHORIZATION_JOURNAL:
+      g_value_set_string (value, temporary_authorization_store_get_journal (priv->temporary_authorization_store));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
 static const gchar *
 polkit_backend_interactive_authority_get_name (PolkitBackendAuthority *authority)
 {
@@ -399,22 +1017,195 @@ polkit_backend_interactive_authority_class_init (PolkitBackendInteractiveAuthori
   gobject_class = G_OBJECT_CLASS (klass);
   authority_class = POLKIT_BACKEND_AUTHORITY_CLASS (klass);
 
-  gobject_class->finalize = polkit_backend_interactive_authority_finalize;
+  gobject_class->finalize     = polkit_backend_interactive_authority_finalize;
+  gobject_class->set_property = polkit_backend_interactive_authority_set_property;
+  gobject_class->get_property = polkit_backend_interactive_authority_get_property;
 
   authority_class->get_name                        = polkit_backend_interactive_authority_get_name;
   authority_class->get_version                     = polkit_backend_interactive_authority_get_version;
   authority_class->get_features                    = polkit_backend_interactive_authority_get_features;
   authority_class->enumerate_actions               = polkit_backend_interactive_authority_enumerate_actions;
+  authority_class->enumerate_actions_paged         = polkit_backend_interactive_authority_enumerate_actions_paged;
+  authority_class->get_action_for_exec_path        = polkit_backend_interactive_authority_get_action_for_exec_path;
   authority_class->check_authorization             = polkit_backend_interactive_authority_check_authorization;
   authority_class->check_authorization_finish      = polkit_backend_interactive_authority_check_authorization_finish;
+  authority_class->check_authorizations            = polkit_backend_interactive_authority_check_authorizations;
+  authority_class->check_authorizations_finish     = polkit_backend_interactive_authority_check_authorizations_finish;
   authority_class->register_authentication_agent   = polkit_backend_interactive_authority_register_authentication_agent;
+  authority_class->register_authentication_agent_for_subjects = polkit_backend_interactive_authority_register_authentication_agent_for_subjects;
   authority_class->unregister_authentication_agent = polkit_backend_interactive_authority_unregister_authentication_agent;
   authority_class->authentication_agent_response   = polkit_backend_interactive_authority_authentication_agent_response;
   authority_class->enumerate_temporary_authorizations = polkit_backend_interactive_authority_enumerate_temporary_authorizations;
   authority_class->revoke_temporary_authorizations = polkit_backend_interactive_authority_revoke_temporary_authorizations;
   authority_class->revoke_temporary_authorization_by_id = polkit_backend_interactive_authority_revoke_temporary_authorization_by_id;
 
-
+  /**
+   * PolkitBackendInteractiveAuthority:identity-ttl:
+   *
+   * How long, in seconds, a user or group looked up via NSS is trusted
+   * before it is refreshed in the background.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_IDENTITY_TTL,
+                                   g_param_spec_uint ("identity-ttl",
+                                                      "Identity TTL",
+                                                      "Seconds an NSS lookup is trusted for",
+                                                      0, G_MAXUINT / G_USEC_PER_SEC,
+                                                      IDENTITY_CACHE_TTL,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_CONSTRUCT |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PolkitBackendInteractiveAuthority:identity-negative-ttl:
+   *
+   * How long, in seconds, an unknown user or group is remembered as such.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_IDENTITY_NEGATIVE_TTL,
+                                   g_param_spec_uint ("identity-negative-ttl",
+                                                      "Identity negative TTL",
+                                                      "Seconds an unknown identity is remembered for",
+                                                      0, G_MAXUINT / G_USEC_PER_SEC,
+                                                      IDENTITY_CACHE_NEGATIVE_TTL,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_CONSTRUCT |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PolkitBackendInteractiveAuthority:audit-log-level:
+   *
+   * A #PolkitBackendAuditLogLevel saying how much of every completed
+   * check is written to the system log.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_AUDIT_LOG_LEVEL,
+                                   g_param_spec_uint ("audit-log-level",
+                                                      "Audit log level",
+                                                      "How much of every check is logged",
+                                                      POLKIT_BACKEND_AUDIT_LOG_LEVEL_NONE,
+                                                      POLKIT_BACKEND_AUDIT_LOG_LEVEL_CMDLINES,
+                                                      POLKIT_BACKEND_AUDIT_LOG_LEVEL_NONE,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_CONSTRUCT |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PolkitBackendInteractiveAuthority:max-queued-checks:
+   *
+   * How many checks may be waiting for a worker thread in all before
+   * new ones are refused with %POLKIT_ERROR_TOO_MANY_REQUESTS, or 0
+   * for no limit.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_MAX_QUEUED_CHECKS,
+                                   g_param_spec_uint ("max-queued-checks",
+                                                      "Max queued checks",
+                                                      "Checks that may be waiting in all",
+                                                      0, G_MAXUINT,
+                                                      CHECK_QUEUE_MAX_QUEUED,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_CONSTRUCT |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PolkitBackendInteractiveAuthority:max-queued-checks-per-caller:
+   *
+   * How many checks of a single caller may be waiting for a worker
+   * thread before new ones are refused with
+   * %POLKIT_ERROR_TOO_MANY_REQUESTS, or 0 for no limit.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_MAX_QUEUED_CHECKS_PER_CALLER,
+                                   g_param_spec_uint ("max-queued-checks-per-caller",
+                                                      "Max queued checks per caller",
+                                                      "Checks a single caller may have waiting",
+                                                      0, G_MAXUINT,
+                                                      CHECK_QUEUE_MAX_QUEUED_PER_CALLER,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_CONSTRUCT |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PolkitBackendInteractiveAuthority:max-running-checks-per-caller:
+   *
+   * How many checks of a single caller may be evaluated at the same
+   * time. The others wait their turn.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_MAX_RUNNING_CHECKS_PER_CALLER,
+                                   g_param_spec_uint ("max-running-checks-per-caller",
+                                                      "Max running checks per caller",
+                                                      "Checks of a single caller evaluated at once",
+                                                      1, G_MAXUINT,
+                                                      CHECK_QUEUE_MAX_RUNNING_PER_CALLER,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_CONSTRUCT |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PolkitBackendInteractiveAuthority:queued-checks:
+   *
+   * How many checks are waiting for a worker thread.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_QUEUED_CHECKS,
+                                   g_param_spec_uint ("queued-checks",
+                                                      "Queued checks",
+                                                      "Checks waiting for a worker",
+                                                      0, G_MAXUINT,
+                                                      0,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PolkitBackendInteractiveAuthority:rejected-checks:
+   *
+   * How many checks were refused so far because too many were waiting.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_REJECTED_CHECKS,
+                                   g_param_spec_uint ("rejected-checks",
+                                                      "Rejected checks",
+                                                      "Checks refused because too many were waiting",
+                                                      0, G_MAXUINT,
+                                                      0,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PolkitBackendInteractiveAuthority:check-threads:
+   *
+   * How many worker threads evaluate checks at the same time, off the
+   * main loop. Setting it to 0 picks one per processor, but no more
+   * than four. Reads as 0 if checks are evaluated on the main loop.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_CHECK_THREADS,
+                                   g_param_spec_uint ("check-threads",
+                                                      "Check threads",
+                                                      "Worker threads evaluating checks, 0 for the default",
+                                                      0, G_MAXINT,
+                                                      0,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PolkitBackendInteractiveAuthority:temporary-authorization-journal:
+   *
+   * The file temporary authorizations of processes are kept in, so that
+   * they survive a restart of the daemon, or %NULL to keep them in
+   * memory only. Setting it picks up the authorizations that are still
+   * valid from the file.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_TEMPORARY_AUTHORIZATION_JOURNAL,
+                                   g_param_spec_string ("temporary-authorization-journal",
+                                                        "Temporary authorization journal",
+                                                        "File temporary authorizations are kept in across restarts",
+                                                        NULL,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_STATIC_STRINGS));
 
   g_type_class_add_private (klass, sizeof (PolkitBackendInteractiveAuthorityPrivate));
 }
@@ -433,12 +1224,67 @@ polkit_backend_interactive_authority_enumerate_actions (PolkitBackendAuthority
 
   interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_ENUMERATE_ACTIONS);
 
   actions = polkit_backend_action_pool_get_all_actions (priv->action_pool, interactivee);
 
   return actions;
 }
 
+/* Pages are capped so that a single reply stays reasonably small whatever the caller asks for */
+#define ENUMERATE_ACTIONS_MAX_PAGE_SIZE 256
+
+static GList *
+polkit_backend_interactive_authority_enumerate_actions_paged (PolkitBackendAuthority   *authority,
+                                                              PolkitSubject            *caller,
+                                                              const gchar              *locale,
+                                                              const gchar              *prefix,
+                                                              const gchar              *cursor,
+                                                              guint                     limit,
+                                                              gchar                   **out_next_cursor,
+                                                              GError                  **error)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GList *actions;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_ENUMERATE_ACTIONS);
+
+  if (limit == 0 || limit > ENUMERATE_ACTIONS_MAX_PAGE_SIZE)
+    limit = ENUMERATE_ACTIONS_MAX_PAGE_SIZE;
+
+  actions = polkit_backend_action_pool_get_actions_page (priv->action_pool,
+                                                         locale,
+                                                         prefix,
+                                                         cursor,
+                                                         limit,
+                                                         out_next_cursor);
+
+  return actions;
+}
+
+static PolkitActionDescription *
+polkit_backend_interactive_authority_get_action_for_exec_path (PolkitBackendAuthority   *authority,
+                                                               PolkitSubject            *caller,
+                                                               const gchar              *locale,
+                                                               const gchar              *path,
+                                                               const gchar              *argv1,
+                                                               GError                  **error)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+
+  return polkit_backend_action_pool_get_action_for_exec_path (priv->action_pool,
+                                                              path,
+                                                              argv1,
+                                                              locale);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 struct AuthenticationAgent
@@ -446,7 +1292,9 @@ struct AuthenticationAgent
   volatile gint ref_count;
 
   uid_t creator_uid;
-  PolkitSubject *scope;
+  /* one agent may be registered for many subjects at once, each of which
+   * holds a reference in hash_scope_to_authentication_agent */
+  GPtrArray *scopes;
   guint64 serial;
 
   gchar *locale;
@@ -457,159 +1305,267 @@ struct AuthenticationAgent
   gchar *cookie_prefix;
   guint64  cookie_serial;
 
-  GDBusProxy *proxy;
+  /* the agent is called on the daemon's own connection rather than through
+   * a GDBusProxy, so that registering needs no bus round-trip */
+  GDBusConnection *connection;
 
   GList *active_sessions;
 };
 
-/* TODO: should probably move to PolkitSubject
- * (also see copy in src/programs/pkcheck.c)
- *
- * Also, can't really trust the cmdline... but might be useful in the logs anyway.
- */
-static gchar *
-_polkit_subject_get_cmdline (PolkitSubject *subject)
+static void
+log_result (PolkitBackendInteractiveAuthority    *authority,
+            const gchar                          *action_id,
+            PolkitSubject                        *subject,
+            PolkitIdentity                       *user_of_subject,
+            PolkitSubject                        *caller,
+            PolkitAuthorizationResult            *result)
 {
-  PolkitSubject *process;
-  gchar *ret;
-  gint pid;
-  gchar *filename;
-  gchar *contents;
-  gsize contents_len;
-  GError *error;
-  guint n;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
 
-  g_return_val_if_fail (subject != NULL, NULL);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
-  error = NULL;
+  /* everything is formatted by the writer thread, this only takes references */
+  polkit_backend_audit_log_push_check (priv->audit_log,
+                                       action_id,
+                                       subject,
+                                       user_of_subject,
+                                       caller,
+                                       polkit_authorization_result_get_is_authorized (result));
+}
 
-  ret = NULL;
-  process = NULL;
-  filename = NULL;
-  contents = NULL;
+/* Checks that would prompt the same user through the same agent for the
+ * same action with the same details share a challenge: the first one
+ * starts it and the others wait along, and one authentication completes
+ * all of them. Every waiter may still be cancelled on its own; the
+ * challenge itself is only cancelled once nobody is waiting anymore.
+ */
+typedef struct
+{
+  PolkitBackendInteractiveAuthority *authority;
+  gchar *key;
+  PolkitSubject *scope;      /* the agent was registered for */
+  GCancellable *cancellable; /* passed to the authentication session */
+  GList *waiters;            /* ChallengeWaiter, in arrival order */
+} PendingChallenge;
 
-  if (POLKIT_IS_UNIX_PROCESS (subject))
-    {
-      process = g_object_ref (subject);
-    }
-  else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
+typedef struct
+{
+  PendingChallenge *challenge;
+  GSimpleAsyncResult *simple;
+  PolkitSubject *caller;
+  PolkitSubject *subject;
+  PolkitDetails *details;
+  GCancellable *cancellable;
+  gulong cancelled_signal_handler_id;
+} ChallengeWaiter;
+
+static gint
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+  return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* Checks only share a challenge if the agent would ask the same: the
+ * implicit authorization tells which identities may authenticate and
+ * whether the authorization is retained, and the details decide the
+ * message and what else the agent shows, such as the command line for
+ * pkexec. The user approves what the agent shows them, so checks with
+ * other details never join, even if only their message differs. The
+ * subjects and callers of the checks may differ.
+ */
+static gchar *
+pending_challenge_key_new (PolkitSubject               *scope,
+                           PolkitIdentity              *user_of_subject,
+                           const gchar                 *action_id,
+                           PolkitDetails               *details,
+                           PolkitImplicitAuthorization  implicit_authorization)
+{
+  GChecksum *checksum;
+  gchar **keys;
+  gchar *scope_str;
+  gchar *user_of_subject_str;
+  gchar *ret;
+  guint n;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  keys = details != NULL ? polkit_details_get_keys (details) : NULL;
+  if (keys != NULL)
     {
-      process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject),
-                                                         NULL,
-                                                         &error);
-      if (process == NULL)
+      qsort (keys, g_strv_length (keys), sizeof (gchar *), compare_strings);
+      for (n = 0; keys[n] != NULL; n++)
         {
-          g_printerr ("Error getting process for system bus name `%s': %s\n",
-                      polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (subject)),
-                      error->message);
-          g_error_free (error);
-          goto out;
+          const gchar *value = polkit_details_lookup (details, keys[n]);
+
+          /* include the terminators so that keys and values can't run into each other */
+          g_checksum_update (checksum, (const guchar *) keys[n], strlen (keys[n]) + 1);
+          g_checksum_update (checksum, (const guchar *) value, strlen (value) + 1);
         }
-    }
-  else
-    {
-      g_warning ("Unknown subject type passed to _polkit_subject_get_cmdline()");
-      goto out;
+      g_strfreev (keys);
     }
 
-  pid = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
+  scope_str = polkit_subject_to_string (scope);
+  user_of_subject_str = user_of_subject != NULL ? polkit_identity_to_string (user_of_subject) : g_strdup ("");
+  ret = g_strdup_printf ("%s %s %s %u %s",
+                         scope_str,
+                         user_of_subject_str,
+                         action_id,
+                         (guint) implicit_authorization,
+                         g_checksum_get_string (checksum));
 
-  filename = g_strdup_printf ("/proc/%d/cmdline", pid);
+  g_free (scope_str);
+  g_free (user_of_subject_str);
+  g_checksum_free (checksum);
+  return ret;
+}
 
-  if (!g_file_get_contents (filename,
-                            &contents,
-                            &contents_len,
-                            &error))
-    {
-      g_printerr ("Error opening `%s': %s\n",
-                  filename,
-                  error->message);
-      g_error_free (error);
-      goto out;
-    }
+static void
+challenge_waiter_free (ChallengeWaiter *waiter)
+{
+  if (waiter->cancelled_signal_handler_id > 0)
+    g_signal_handler_disconnect (waiter->cancellable, waiter->cancelled_signal_handler_id);
+  if (waiter->cancellable != NULL)
+    g_object_unref (waiter->cancellable);
+  g_object_unref (waiter->details);
+  g_object_unref (waiter->subject);
+  g_object_unref (waiter->caller);
+  g_object_unref (waiter->simple);
+  g_free (waiter);
+}
 
-  if (contents == NULL || contents_len == 0)
-    {
-      goto out;
-    }
-  else
+/* Stops @challenge from taking new waiters */
+static void
+pending_challenge_unpublish (PendingChallenge *challenge)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (challenge->authority);
+  if (g_hash_table_lookup (priv->hash_key_to_pending_challenge, challenge->key) == challenge)
+    g_hash_table_remove (priv->hash_key_to_pending_challenge, challenge->key);
+}
+
+static void
+pending_challenge_free (PendingChallenge *challenge)
+{
+  g_assert (challenge->waiters == NULL);
+  pending_challenge_unpublish (challenge);
+  g_object_unref (challenge->authority);
+  g_object_unref (challenge->scope);
+  g_object_unref (challenge->cancellable);
+  g_free (challenge->key);
+  g_free (challenge);
+}
+
+/* Completes @waiter as if it had been dismissed, and frees it */
+static void
+challenge_waiter_dismiss (ChallengeWaiter *waiter)
+{
+  PendingChallenge *challenge = waiter->challenge;
+  PolkitAuthorizationResult *result;
+  PolkitDetails *details;
+
+  challenge->waiters = g_list_remove (challenge->waiters, waiter);
+
+  /* what a cancelled challenge would have told this waiter */
+  details = polkit_details_new ();
+  polkit_details_insert (details, "polkit.dismissed", "true");
+  result = polkit_authorization_result_new (FALSE, FALSE, details);
+  g_simple_async_result_set_op_res_gpointer (waiter->simple, result, g_object_unref);
+  g_simple_async_result_complete_in_idle (waiter->simple);
+  g_object_unref (details);
+
+  challenge_waiter_free (waiter);
+
+  if (challenge->waiters == NULL)
     {
-      /* The kernel uses '\0' to separate arguments - replace those with a space. */
-      for (n = 0; n < contents_len - 1; n++)
-        {
-          if (contents[n] == '\0')
-            contents[n] = ' ';
-        }
-      ret = g_strdup (contents);
-      g_strstrip (ret);
+      /* nobody cares about the answer anymore, dismiss the agent */
+      pending_challenge_unpublish (challenge);
+      g_cancellable_cancel (challenge->cancellable);
     }
+}
 
- out:
-  g_free (filename);
-  g_free (contents);
-  if (process != NULL)
-    g_object_unref (process);
-  return ret;
+static void
+challenge_waiter_cancelled_cb (GCancellable    *cancellable,
+                               ChallengeWaiter *waiter)
+{
+  challenge_waiter_dismiss (waiter);
 }
 
-/* TODO: possibly remove this function altogether */
-G_GNUC_UNUSED static void
-log_result (PolkitBackendInteractiveAuthority    *authority,
-            const gchar                          *action_id,
-            PolkitSubject                        *subject,
-            PolkitSubject                        *caller,
-            PolkitAuthorizationResult            *result)
+static gboolean
+subject_is_system_bus_name (PolkitSubject *subject,
+                            const gchar   *name)
+{
+  return POLKIT_IS_SYSTEM_BUS_NAME (subject) &&
+         strcmp (polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (subject)), name) == 0;
+}
+
+/* Dismisses the waiters whose caller or subject is the vanished @name. A
+ * challenge is only cancelled once all of its waiters are gone, even if
+ * it was started on behalf of @name.
+ */
+static void
+pending_challenges_forget_name (PolkitBackendInteractiveAuthority *authority,
+                                const gchar                       *name)
 {
   PolkitBackendInteractiveAuthorityPrivate *priv;
-  PolkitIdentity *user_of_subject;
-  const gchar *log_result_str;
-  gchar *subject_str;
-  gchar *user_of_subject_str;
-  gchar *caller_str;
-  gchar *subject_cmdline;
-  gchar *caller_cmdline;
+  GList *challenges;
+  GList *l;
 
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
-  log_result_str = "DENYING";
-  if (polkit_authorization_result_get_is_authorized (result))
-    log_result_str = "ALLOWING";
-
-  user_of_subject = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor, subject, NULL, NULL);
-
-  subject_str = polkit_subject_to_string (subject);
+  /* copy, dismissing the last waiter unpublishes the challenge */
+  challenges = g_hash_table_get_values (priv->hash_key_to_pending_challenge);
+  for (l = challenges; l != NULL; l = l->next)
+    {
+      PendingChallenge *challenge = l->data;
+      GList *waiters;
+      GList *ll;
 
-  if (user_of_subject != NULL)
-    user_of_subject_str = polkit_identity_to_string (user_of_subject);
-  else
-    user_of_subject_str = g_strdup ("<unknown>");
-  caller_str = polkit_subject_to_string (caller);
+      waiters = g_list_copy (challenge->waiters);
+      for (ll = waiters; ll != NULL; ll = ll->next)
+        {
+          ChallengeWaiter *waiter = ll->data;
 
-  subject_cmdline = _polkit_subject_get_cmdline (subject);
-  if (subject_cmdline == NULL)
-    subject_cmdline = g_strdup ("<unknown>");
+          if (subject_is_system_bus_name (waiter->caller, name) ||
+              subject_is_system_bus_name (waiter->subject, name))
+            challenge_waiter_dismiss (waiter);
+        }
+      g_list_free (waiters);
+    }
+  g_list_free (challenges);
+}
 
-  caller_cmdline = _polkit_subject_get_cmdline (caller);
-  if (caller_cmdline == NULL)
-    caller_cmdline = g_strdup ("<unknown>");
+static void
+pending_challenge_add_waiter (PendingChallenge   *challenge,
+                              GSimpleAsyncResult *simple,
+                              PolkitSubject      *caller,
+                              PolkitSubject      *subject,
+                              PolkitDetails      *details,
+                              GCancellable       *cancellable)
+{
+  ChallengeWaiter *waiter;
 
-  polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                "%s action %s for %s [%s] owned by %s (check requested by %s [%s])",
-                                log_result_str,
-                                action_id,
-                                subject_str,
-                                subject_cmdline,
-                                user_of_subject_str,
-                                caller_str,
-                                caller_cmdline);
+  waiter = g_new0 (ChallengeWaiter, 1);
+  waiter->challenge = challenge;
+  waiter->simple = g_object_ref (simple);
+  waiter->caller = g_object_ref (caller);
+  waiter->subject = g_object_ref (subject);
+  waiter->details = details != NULL ? g_object_ref (details) : polkit_details_new ();
+  challenge->waiters = g_list_append (challenge->waiters, waiter);
 
-  if (user_of_subject != NULL)
-    g_object_unref (user_of_subject);
-  g_free (subject_str);
-  g_free (user_of_subject_str);
-  g_free (caller_str);
-  g_free (subject_cmdline);
-  g_free (caller_cmdline);
+  if (cancellable != NULL)
+    {
+      waiter->cancellable = g_object_ref (cancellable);
+      if (g_cancellable_is_cancelled (cancellable))
+        {
+          challenge_waiter_dismiss (waiter);
+          return;
+        }
+      waiter->cancelled_signal_handler_id = g_signal_connect (cancellable,
+                                                              "cancelled",
+                                                              G_CALLBACK (challenge_waiter_cancelled_cb),
+                                                              waiter);
+    }
 }
 
 static void
@@ -626,28 +1582,28 @@ check_authorization_challenge_cb (AuthenticationAgent         *agent,
                                   PolkitIdentity              *authenticated_identity,
                                   gpointer                     user_data)
 {
-  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (user_data);
+  PendingChallenge *challenge = user_data;
   PolkitBackendInteractiveAuthorityPrivate *priv;
-  PolkitAuthorizationResult *result;
+  GList *waiters;
+  GList *l;
   gchar *scope_str;
   gchar *subject_str;
   gchar *user_of_subject_str;
   gchar *authenticated_identity_str;
   gchar *subject_cmdline;
   gboolean is_temp;
+  gboolean added_temp;
 
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
-  result = NULL;
-
-  scope_str = polkit_subject_to_string (agent->scope);
+  scope_str = polkit_subject_to_string (challenge->scope);
   subject_str = polkit_subject_to_string (subject);
   user_of_subject_str = polkit_identity_to_string (user_of_subject);
   authenticated_identity_str = NULL;
   if (authenticated_identity != NULL)
     authenticated_identity_str = polkit_identity_to_string (authenticated_identity);
 
-  subject_cmdline = _polkit_subject_get_cmdline (subject);
+  subject_cmdline = polkit_backend_subject_get_cmdline (subject);
   if (subject_cmdline == NULL)
     subject_cmdline = g_strdup ("<unknown>");
 
@@ -661,40 +1617,9 @@ check_authorization_challenge_cb (AuthenticationAgent         *agent,
            was_dismissed,
            authentication_success);
 
-  if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED_RETAINED ||
-      implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
-    polkit_details_insert (details, "polkit.retains_authorization_after_challenge", "true");
-
-  is_temp = FALSE;
-  if (authentication_success)
-    {
-      /* store temporary authorization depending on value of implicit_authorization */
-      if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED_RETAINED ||
-          implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
-        {
-          const gchar *id;
-
-          is_temp = TRUE;
-
-          id = temporary_authorization_store_add_authorization (priv->temporary_authorization_store,
-                                                                subject,
-                                                                authentication_agent_get_scope (agent),
-                                                                action_id);
-
-          polkit_details_insert (details, "polkit.temporary_authorization_id", id);
-
-          /* we've added a temporary authorization, let the user know */
-          g_signal_emit_by_name (authority, "changed");
-        }
-      result = polkit_authorization_result_new (TRUE, FALSE, details);
-    }
-  else
-    {
-      /* TODO: maybe return set is_challenge? */
-      if (was_dismissed)
-        polkit_details_insert (details, "polkit.dismissed", "true");
-      result = polkit_authorization_result_new (FALSE, FALSE, details);
-    }
+  /* store temporary authorization depending on value of implicit_authorization */
+  is_temp = (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED_RETAINED ||
+             implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED);
 
   /* Log the event */
   if (authentication_success)
@@ -736,13 +1661,64 @@ check_authorization_challenge_cb (AuthenticationAgent         *agent,
                                     user_of_subject_str);
     }
 
-  /* log_result (authority, action_id, subject, caller, result); */
+  /* similar checks from now on need a challenge of their own */
+  pending_challenge_unpublish (challenge);
+  waiters = challenge->waiters;
+  challenge->waiters = NULL;
 
-  g_simple_async_result_set_op_res_gpointer (simple,
-                                             result,
-                                             g_object_unref);
-  g_simple_async_result_complete (simple);
-  g_object_unref (simple);
+  added_temp = FALSE;
+  for (l = waiters; l != NULL; l = l->next)
+    {
+      ChallengeWaiter *waiter = l->data;
+      PolkitAuthorizationResult *result;
+
+      if (is_temp)
+        polkit_details_insert (waiter->details, "polkit.retains_authorization_after_challenge", "true");
+
+      if (authentication_success)
+        {
+          if (is_temp)
+            {
+              const gchar *id;
+
+              /* waiters with the same subject share the authorization */
+              if (!temporary_authorization_store_has_authorization (priv->temporary_authorization_store,
+                                                                   waiter->subject,
+                                                                   action_id,
+                                                                   &id))
+                {
+                  id = temporary_authorization_store_add_authorization (priv->temporary_authorization_store,
+                                                                        waiter->subject,
+                                                                        challenge->scope,
+                                                                        action_id);
+                  added_temp = TRUE;
+                }
+
+              polkit_details_insert (waiter->details, "polkit.temporary_authorization_id", id);
+            }
+          result = polkit_authorization_result_new (TRUE, FALSE, waiter->details);
+        }
+      else
+        {
+          /* TODO: maybe return set is_challenge? */
+          if (was_dismissed)
+            polkit_details_insert (waiter->details, "polkit.dismissed", "true");
+          result = polkit_authorization_result_new (FALSE, FALSE, waiter->details);
+        }
+
+      log_result (authority, action_id, waiter->subject, user_of_subject, waiter->caller, result);
+
+      g_simple_async_result_set_op_res_gpointer (waiter->simple, result, g_object_unref);
+      g_simple_async_result_complete (waiter->simple);
+      challenge_waiter_free (waiter);
+    }
+  g_list_free (waiters);
+
+  /* we've added temporary authorizations, let the user know */
+  if (added_temp)
+    g_signal_emit_by_name (authority, "changed");
+
+  pending_challenge_free (challenge);
 
   g_free (subject_cmdline);
   g_free (authenticated_identity_str);
@@ -781,6 +1757,7 @@ may_identity_check_authorization (PolkitBackendInteractiveAuthority   *interacti
 {
   PolkitBackendInteractiveAuthorityPrivate *priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
   gboolean ret = FALSE;
+  PolkitBackendActionDefaults defaults;
   PolkitActionDescription *action_desc = NULL;
   const gchar *owners = NULL;
   gchar **tokens = NULL;
@@ -793,6 +1770,11 @@ may_identity_check_authorization (PolkitBackendInteractiveAuthority   *interacti
       goto out;
     }
 
+  /* most actions have no owners, and that is known without describing them */
+  if (!polkit_backend_action_pool_get_defaults (priv->action_pool, action_id, &defaults) ||
+      (defaults.flags & POLKIT_BACKEND_ACTION_DEFAULTS_FLAGS_HAS_OWNER) == 0)
+    goto out;
+
   action_desc = polkit_backend_action_pool_get_action (priv->action_pool, action_id, NULL);
   if (action_desc == NULL)
     goto out;
@@ -830,99 +1812,887 @@ may_identity_check_authorization (PolkitBackendInteractiveAuthority   *interacti
   return ret;
 }
 
+/* Set on the details the subclass is asked with when the caller wants
+ * the check explained, where no D-Bus caller can put it */
+#define EXPLAIN_DATA_KEY "polkit-backend-explain"
+
+/* A copy of @details for the subclass to say in what decided a check */
+static PolkitDetails *
+explain_details_new (PolkitDetails *details)
+{
+  PolkitDetails *ret;
+  gchar **keys;
+  guint n;
+
+  ret = polkit_details_new ();
+  keys = polkit_details_get_keys (details);
+  for (n = 0; keys != NULL && keys[n] != NULL; n++)
+    polkit_details_insert (ret, keys[n], polkit_details_lookup (details, keys[n]));
+  g_strfreev (keys);
+  g_object_set_data (G_OBJECT (ret), EXPLAIN_DATA_KEY, GINT_TO_POINTER (TRUE));
+
+  return ret;
+}
+
 static void
-polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority         *authority,
-                                                          PolkitSubject                  *caller,
-                                                          PolkitSubject                  *subject,
-                                                          const gchar                    *action_id,
-                                                          PolkitDetails                  *details,
-                                                          PolkitCheckAuthorizationFlags   flags,
-                                                          GCancellable                   *cancellable,
-                                                          GAsyncReadyCallback             callback,
-                                                          gpointer                        user_data)
+explain_insert_usec (PolkitDetails *details,
+                     const gchar   *key,
+                     gint64         usec)
 {
-  PolkitBackendInteractiveAuthority *interactive_authority;
-  PolkitBackendInteractiveAuthorityPrivate *priv;
-  gchar *caller_str;
-  gchar *subject_str;
-  PolkitIdentity *user_of_caller;
-  PolkitIdentity *user_of_subject;
-  gboolean user_of_subject_matches;
-  gchar *user_of_caller_str;
-  gchar *user_of_subject_str;
-  PolkitAuthorizationResult *result;
-  PolkitImplicitAuthorization implicit_authorization;
-  GError *error;
-  GSimpleAsyncResult *simple;
-  gboolean has_details;
-  gchar **detail_keys;
+  gchar *value;
 
-  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
-  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  value = g_strdup_printf ("%" G_GINT64_FORMAT, usec);
+  polkit_details_insert (details, key, value);
+  g_free (value);
+}
 
-  error = NULL;
-  caller_str = NULL;
-  subject_str = NULL;
-  user_of_caller = NULL;
-  user_of_subject = NULL;
-  user_of_caller_str = NULL;
-  user_of_subject_str = NULL;
-  result = NULL;
+/* What is known about one action of a check; the first is the action
+ * checked, the rest are the registered actions implying it
+ */
+typedef struct
+{
+  gchar *action_id;
+  PolkitBackendActionDefaults defaults;
+  PolkitImplicitAuthorization implicit_authorization; /* as rewritten by the subclass */
 
-  simple = g_simple_async_result_new (G_OBJECT (authority),
-                                      callback,
-                                      user_data,
-                                      polkit_backend_interactive_authority_check_authorization);
+  /* what the subclass is asked with when explaining, so that it can
+   * say which rule decided, see polkit_backend_interactive_authority_explain() */
+  PolkitDetails *explain_details;
+} CheckEvaluation;
 
-  /* handle being called from ourselves */
-  if (caller == NULL)
-    {
-      /* TODO: this is kind of a hack */
-      GDBusConnection *system_bus;
-      system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
-      caller = polkit_system_bus_name_new (g_dbus_connection_get_unique_name (system_bus));
-      g_object_unref (system_bus);
-    }
+typedef struct PendingCheck PendingCheck;
 
-  caller_str = polkit_subject_to_string (caller);
-  subject_str = polkit_subject_to_string (subject);
+/* A check between the main loop handing it to a worker and the result
+ * being delivered back. Nothing the worker touches is used by the main
+ * loop until then.
+ */
+struct PendingCheck
+{
+  PolkitBackendInteractiveAuthority *authority;
+  GMainContext *context;
+  GSimpleAsyncResult *simple;
+  PolkitSubject *caller;
+  PolkitBackendSubjectInfo *subject_info;
+  PolkitDetails *details;
+  PolkitCheckAuthorizationFlags flags;
+  GCancellable *cancellable;
 
-  g_debug ("%s is inquiring whether %s is authorized for %s",
-           caller_str,
-           subject_str,
-           action_id);
+  CheckEvaluation *evaluations;
+  guint n_evaluations;
 
-  user_of_caller = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
-                                                                        caller, NULL,
-                                                                        &error);
-  if (error != NULL)
-    {
-      g_simple_async_result_set_from_error (simple, error);
-      g_simple_async_result_complete (simple);
-      g_object_unref (simple);
-      g_error_free (error);
-      goto out;
-    }
+  /* the next check for the same subject, evaluated by the same worker */
+  PendingCheck *next;
 
-  user_of_caller_str = polkit_identity_to_string (user_of_caller);
-  g_debug (" user of caller is %s", user_of_caller_str);
+  /* set on the first check of a chain that went through the check queue */
+  gchar *queue_caller;
 
-  user_of_subject = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
-                                                                         subject, &user_of_subject_matches,
-                                                                         &error);
-  if (error != NULL)
-    {
-      g_simple_async_result_set_from_error (simple, error);
-      g_simple_async_result_complete (simple);
-      g_object_unref (simple);
-      g_error_free (error);
-      goto out;
-    }
+  /* when the request came in, for the metrics */
+  gint64 started;
 
-  user_of_subject_str = polkit_identity_to_string (user_of_subject);
-  g_debug (" user of subject is %s", user_of_subject_str);
+  /* how long each phase took, when explaining or collecting metrics */
+  gint64 usec[POLKIT_BACKEND_METRICS_N_PHASES];
+  gint64 nss_usec;
 
-  has_details = FALSE;
+  /* the session of the subject, once pending_check_evaluate() found it */
+  gboolean session_is_local;
+  gboolean session_is_active;
+
+  /* set on the first check of a chain the subclass evaluates
+   * asynchronously: the check and action it is at, and since when */
+  PendingCheck *evaluating;
+  guint evaluating_n;
+  gint64 evaluating_started;
+};
+
+static PendingCheck *
+pending_check_new (PolkitBackendInteractiveAuthority *authority,
+                   GSimpleAsyncResult                *simple,
+                   PolkitSubject                     *caller,
+                   PolkitBackendSubjectInfo          *subject_info,
+                   const gchar                       *action_id,
+                   const PolkitBackendActionDefaults *defaults,
+                   PolkitDetails                     *details,
+                   PolkitCheckAuthorizationFlags      flags,
+                   GCancellable                      *cancellable,
+                   gint64                             started)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PendingCheck *check;
+  const gchar * const *implied_by;
+  guint n;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  priv->n_pending_checks++;
+  priv->last_check_activity = g_get_monotonic_time ();
+
+  check = g_new0 (PendingCheck, 1);
+  check->authority = g_object_ref (authority);
+  check->context = g_main_context_ref_thread_default ();
+  check->simple = g_object_ref (simple);
+  check->caller = g_object_ref (caller);
+  check->subject_info = polkit_backend_subject_info_ref (subject_info);
+  check->details = details != NULL ? g_object_ref (details) : NULL;
+  check->flags = flags;
+  check->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+  check->started = started;
+
+  /* the action pool is not to be used from workers, so look up all the
+   * actions that may be needed now; implying actions that are not
+   * registered can't authorize anything and are left out
+   */
+  implied_by = polkit_backend_action_pool_get_implied_by (priv->action_pool, action_id);
+  check->evaluations = g_new0 (CheckEvaluation, 1 + (implied_by != NULL ? g_strv_length ((gchar **) implied_by) : 0));
+  check->evaluations[check->n_evaluations].action_id = g_strdup (action_id);
+  check->evaluations[check->n_evaluations++].defaults = *defaults;
+  for (n = 0; implied_by != NULL && implied_by[n] != NULL; n++)
+    {
+      CheckEvaluation *evaluation = &check->evaluations[check->n_evaluations];
+
+      if (polkit_backend_action_pool_get_defaults (priv->action_pool, implied_by[n], &evaluation->defaults))
+        {
+          evaluation->action_id = g_strdup (implied_by[n]);
+          check->n_evaluations++;
+        }
+    }
+
+  for (n = 0; n < check->n_evaluations; n++)
+    check->evaluations[n].implicit_authorization = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
+
+  if (flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN)
+    {
+      if (check->details == NULL)
+        check->details = polkit_details_new ();
+      for (n = 0; n < check->n_evaluations; n++)
+        check->evaluations[n].explain_details = explain_details_new (check->details);
+    }
+
+  return check;
+}
+
+static void
+pending_check_free (PendingCheck *check)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  guint n;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (check->authority);
+  priv->n_pending_checks--;
+  priv->last_check_activity = g_get_monotonic_time ();
+
+  for (n = 0; n < check->n_evaluations; n++)
+    {
+      g_free (check->evaluations[n].action_id);
+      if (check->evaluations[n].explain_details != NULL)
+        g_object_unref (check->evaluations[n].explain_details);
+    }
+  g_free (check->evaluations);
+  g_free (check->queue_caller);
+
+  if (check->cancellable != NULL)
+    g_object_unref (check->cancellable);
+  if (check->details != NULL)
+    g_object_unref (check->details);
+  polkit_backend_subject_info_unref (check->subject_info);
+  g_object_unref (check->caller);
+  g_object_unref (check->simple);
+  g_main_context_unref (check->context);
+  g_object_unref (check->authority);
+  g_free (check);
+}
+
+/* When a phase of @check starts, or 0 if neither the caller nor the
+ * metrics want to know how long it takes */
+static gint64
+pending_check_now (PendingCheck *check)
+{
+  if (check->flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN)
+    return g_get_monotonic_time ();
+  else
+    return metrics_now (POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (check->authority));
+}
+
+static void
+pending_check_add_latency (PendingCheck              *check,
+                           PolkitBackendMetricsPhase  phase,
+                           gint64                     start)
+{
+  check->usec[phase] += metrics_add_latency (POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (check->authority),
+                                             phase,
+                                             start);
+}
+
+/* The details the subclass is asked about @evaluation with */
+static PolkitDetails *
+pending_check_get_details (PendingCheck    *check,
+                           CheckEvaluation *evaluation)
+{
+  return evaluation->explain_details != NULL ? evaluation->explain_details : check->details;
+}
+
+/* Tells the caller of an explained @check that @source decided it, for
+ * @evaluation if not %NULL. A %NULL @source is whatever the subclass
+ * said decided @evaluation, or else the implicit authorization.
+ */
+static void
+pending_check_explain (PendingCheck    *check,
+                       const gchar     *source,
+                       CheckEvaluation *evaluation)
+{
+  const gchar *value;
+
+  if (!(check->flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN))
+    return;
+
+  if (source == NULL)
+    {
+      source = polkit_details_lookup (evaluation->explain_details, "polkit.explain.source");
+      if (source == NULL)
+        source = "implicit";
+
+      value = polkit_details_lookup (evaluation->explain_details, "polkit.explain.rule");
+      if (value != NULL)
+        polkit_details_insert (check->details, "polkit.explain.rule", value);
+      value = polkit_details_lookup (evaluation->explain_details, "polkit.explain.file");
+      if (value != NULL)
+        polkit_details_insert (check->details, "polkit.explain.file", value);
+    }
+  polkit_details_insert (check->details, "polkit.explain.source", source);
+
+  if (evaluation != NULL && evaluation != &check->evaluations[0])
+    polkit_details_insert (check->details, "polkit.explain.implied-by", evaluation->action_id);
+}
+
+/* Tells the caller of an explained @check how long each phase took */
+static void
+pending_check_explain_timings (PendingCheck *check)
+{
+  if (!(check->flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN))
+    return;
+
+  explain_insert_usec (check->details, "polkit.explain.subject-usec", check->usec[POLKIT_BACKEND_METRICS_PHASE_SUBJECT]);
+  explain_insert_usec (check->details, "polkit.explain.session-usec", check->usec[POLKIT_BACKEND_METRICS_PHASE_SESSION]);
+  explain_insert_usec (check->details, "polkit.explain.nss-usec", check->nss_usec);
+  explain_insert_usec (check->details, "polkit.explain.rules-usec", check->usec[POLKIT_BACKEND_METRICS_PHASE_RULES]);
+  explain_insert_usec (check->details, "polkit.explain.temporary-usec", check->usec[POLKIT_BACKEND_METRICS_PHASE_TEMPORARY]);
+  explain_insert_usec (check->details, "polkit.explain.check-usec", check->usec[POLKIT_BACKEND_METRICS_PHASE_CHECK]);
+}
+
+/* Whether the subclass has its say on checks without blocking, from the
+ * main loop, rather than in the check pool */
+static gboolean
+evaluates_asynchronously (PolkitBackendInteractiveAuthority *authority)
+{
+  return POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority)->check_authorization_async != NULL;
+}
+
+/* The implicit authorization of @evaluation before the subclass had its
+ * say; it depends on is_local and is_active
+ */
+static PolkitImplicitAuthorization
+pending_check_get_implicit (PendingCheck    *check,
+                            CheckEvaluation *evaluation)
+{
+  if (!check->session_is_local)
+    return evaluation->defaults.implicit_any;
+  else if (check->session_is_active)
+    return evaluation->defaults.implicit_active;
+  else
+    return evaluation->defaults.implicit_inactive;
+}
+
+/* Resolves the facts about the subject and lets the subclass have its
+ * say on every action of @check, unless it does so asynchronously; see
+ * pending_checks_evaluate_next(). This blocks, so unless no worker
+ * could be started it runs in a thread of the check pool.
+ */
+static void
+pending_check_evaluate (PendingCheck *check)
+{
+  PolkitSubject *subject;
+  PolkitIdentity *user_of_subject;
+  PolkitSubject *session_for_subject;
+  gint64 start;
+  guint n;
+
+  start = pending_check_now (check);
+  subject = polkit_backend_subject_info_get_subject (check->subject_info);
+  user_of_subject = polkit_backend_subject_info_get_user (check->subject_info);
+
+  /* the temporary authorization store keys on the process, so have it
+   * ready for the main loop too */
+  polkit_backend_subject_info_get_process (check->subject_info);
+  pending_check_add_latency (check, POLKIT_BACKEND_METRICS_PHASE_SUBJECT, start);
+
+  /* a subject *may* be in a session */
+  start = pending_check_now (check);
+  session_for_subject = polkit_backend_subject_info_get_session (check->subject_info);
+  check->session_is_local = polkit_backend_subject_info_get_is_local (check->subject_info);
+  check->session_is_active = polkit_backend_subject_info_get_is_active (check->subject_info);
+  pending_check_add_latency (check, POLKIT_BACKEND_METRICS_PHASE_SESSION, start);
+  if (session_for_subject != NULL)
+    {
+      g_debug (" subject is in session %s (local=%d active=%d)",
+               polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session_for_subject)),
+               check->session_is_local,
+               check->session_is_active);
+    }
+
+  /* the rules would look the user up as needed; when explaining, do it
+   * first so that what NSS takes is told apart from evaluating them */
+  if (check->flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN)
+    {
+      start = g_get_monotonic_time ();
+      polkit_backend_subject_info_get_user_record (check->subject_info);
+      check->nss_usec = g_get_monotonic_time () - start;
+    }
+
+  if (evaluates_asynchronously (check->authority))
+    return;
+
+  start = pending_check_now (check);
+  for (n = 0; n < check->n_evaluations; n++)
+    {
+      CheckEvaluation *evaluation = &check->evaluations[n];
+
+      /* allow subclasses to rewrite implicit_authorization */
+      evaluation->implicit_authorization =
+        polkit_backend_interactive_authority_check_authorization_sync (check->authority,
+                                                                       check->caller,
+                                                                       subject,
+                                                                       user_of_subject,
+                                                                       check->session_is_local,
+                                                                       check->session_is_active,
+                                                                       evaluation->action_id,
+                                                                       pending_check_get_details (check, evaluation),
+                                                                       pending_check_get_implicit (check, evaluation),
+                                                                       check->subject_info);
+
+      /* the first action authorized decides, see pending_check_get_result() */
+      if (evaluation->implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED)
+        break;
+    }
+  pending_check_add_latency (check, POLKIT_BACKEND_METRICS_PHASE_RULES, start);
+}
+
+static gboolean
+pending_check_has_temporary_authorization (PendingCheck  *check,
+                                           PolkitSubject *process,
+                                           const gchar   *action_id,
+                                           const gchar  **out_tmp_authz_id)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  gboolean ret;
+  gint64 start;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (check->authority);
+
+  /* the usual case, which spares a lookup for every implying action */
+  if (temporary_authorization_store_is_empty (priv->temporary_authorization_store))
+    return FALSE;
+
+  start = pending_check_now (check);
+  ret = temporary_authorization_store_has_authorization (priv->temporary_authorization_store,
+                                                         process,
+                                                         action_id,
+                                                         out_tmp_authz_id);
+  pending_check_add_latency (check, POLKIT_BACKEND_METRICS_PHASE_TEMPORARY, start);
+
+  return ret;
+}
+
+/* Combines what the subclass decided with the temporary authorizations
+ * of the subject; main loop only.
+ */
+static PolkitAuthorizationResult *
+pending_check_get_result (PendingCheck                *check,
+                          PolkitImplicitAuthorization *out_implicit_authorization)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitSubject *subject;
+  PolkitSubject *process;
+  PolkitImplicitAuthorization implicit_authorization;
+  const gchar *action_id;
+  const gchar *tmp_authz_id;
+  guint n;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (check->authority);
+
+  /* special case: uid 0, root, is _always_ authorized for anything */
+  if (identity_is_root_user (polkit_backend_subject_info_get_user (check->subject_info)))
+    {
+      pending_check_explain (check, "root", NULL);
+      return polkit_authorization_result_new (TRUE,
+                                              FALSE,
+                                              (check->flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN) ? check->details : NULL);
+    }
+
+  action_id = check->evaluations[0].action_id;
+  implicit_authorization = check->evaluations[0].implicit_authorization;
+
+  /* first see if there's an implicit authorization for subject available */
+  if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED)
+    {
+      g_debug (" is authorized (has implicit authorization local=%d active=%d)",
+               polkit_backend_subject_info_get_is_local (check->subject_info),
+               polkit_backend_subject_info_get_is_active (check->subject_info));
+      pending_check_explain (check, NULL, &check->evaluations[0]);
+      return polkit_authorization_result_new (TRUE, FALSE, check->details);
+    }
+
+  /* then see if there's a temporary authorization for the subject; the
+   * store keys on the process, which we may already know */
+  subject = polkit_backend_subject_info_get_subject (check->subject_info);
+  process = polkit_backend_subject_info_get_process (check->subject_info);
+  if (process == NULL)
+    process = subject;
+  if (pending_check_has_temporary_authorization (check,
+                                                 process,
+                                                 action_id,
+                                                 &tmp_authz_id))
+    {
+      g_debug (" is authorized (has temporary authorization)");
+      polkit_details_insert (check->details, "polkit.temporary_authorization_id", tmp_authz_id);
+      pending_check_explain (check, "temporary", &check->evaluations[0]);
+      return polkit_authorization_result_new (TRUE, FALSE, check->details);
+    }
+
+  /* then see if implied by another action that the subject is authorized for
+   * (but only one level deep to avoid infinite recursion)
+   */
+  for (n = 1; n < check->n_evaluations; n++)
+    {
+      const gchar *imply_action_id;
+
+      imply_action_id = check->evaluations[n].action_id;
+      if (check->evaluations[n].implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED)
+        {
+          g_debug (" is authorized (implied by %s)", imply_action_id);
+          pending_check_explain (check, NULL, &check->evaluations[n]);
+          return polkit_authorization_result_new (TRUE, FALSE, check->details);
+        }
+      if (pending_check_has_temporary_authorization (check,
+                                                     process,
+                                                     imply_action_id,
+                                                     &tmp_authz_id))
+        {
+          g_debug (" is authorized (implied by %s)", imply_action_id);
+          polkit_details_insert (check->details, "polkit.temporary_authorization_id", tmp_authz_id);
+          pending_check_explain (check, "temporary", &check->evaluations[n]);
+          return polkit_authorization_result_new (TRUE, FALSE, check->details);
+        }
+    }
+
+  pending_check_explain (check, NULL, &check->evaluations[0]);
+
+  if (implicit_authorization != POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED)
+    {
+      if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED_RETAINED ||
+          implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
+        {
+          polkit_details_insert (check->details, "polkit.retains_authorization_after_challenge", "1");
+        }
+
+      /* return implicit_authorization so the caller can use an authentication agent if applicable */
+      if (out_implicit_authorization != NULL)
+        *out_implicit_authorization = implicit_authorization;
+
+      g_debug (" challenge (implicit_authorization = %s)",
+               polkit_implicit_authorization_to_string (implicit_authorization));
+
+      return polkit_authorization_result_new (FALSE, TRUE, check->details);
+    }
+
+  g_debug (" not authorized");
+  return polkit_authorization_result_new (FALSE, FALSE, check->details);
+}
+
+/* Delivers the result of @check, or hands it on to an authentication
+ * agent; main loop only.
+ */
+static void
+pending_check_conclude (PendingCheck *check)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitAuthorizationResult *result;
+  PolkitImplicitAuthorization implicit_authorization;
+  PolkitSubject *subject;
+  const gchar *action_id;
+
+  interactive_authority = check->authority;
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+
+  subject = polkit_backend_subject_info_get_subject (check->subject_info);
+  action_id = check->evaluations[0].action_id;
+
+  implicit_authorization = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
+  result = pending_check_get_result (check, &implicit_authorization);
+
+  if (polkit_authorization_result_get_is_authorized (result))
+    metrics_count (priv, POLKIT_BACKEND_METRICS_COUNTER_CHECKS_AUTHORIZED);
+  else if (polkit_authorization_result_get_is_challenge (result))
+    metrics_count (priv, POLKIT_BACKEND_METRICS_COUNTER_CHECKS_CHALLENGED);
+  else
+    metrics_count (priv, POLKIT_BACKEND_METRICS_COUNTER_CHECKS_NOT_AUTHORIZED);
+  pending_check_add_latency (check, POLKIT_BACKEND_METRICS_PHASE_CHECK, check->started);
+  pending_check_explain_timings (check);
+  POLKIT_BACKEND_PROBE3 (check__authorization__return,
+                         action_id,
+                         polkit_authorization_result_get_is_authorized (result),
+                         polkit_authorization_result_get_is_challenge (result));
+
+  /* Caller is up for a challenge! With light sabers! Use an authentication agent if one exists... */
+  if (polkit_authorization_result_get_is_challenge (result) &&
+      (check->flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION))
+    {
+      AuthenticationAgent *agent;
+
+      agent = get_authentication_agent_for_subject (interactive_authority, check->subject_info);
+      if (agent != NULL)
+        {
+          PendingChallenge *challenge;
+          PolkitSubject *scope;
+          gchar *key;
+
+          scope = authentication_agent_get_scope_for_subject (interactive_authority, agent, check->subject_info);
+          key = pending_challenge_key_new (scope,
+                                           polkit_backend_subject_info_get_user (check->subject_info),
+                                           action_id,
+                                           check->details,
+                                           implicit_authorization);
+          challenge = g_hash_table_lookup (priv->hash_key_to_pending_challenge, key);
+          if (challenge != NULL)
+            {
+              g_debug (" joining challenge already in progress");
+              g_free (key);
+              pending_challenge_add_waiter (challenge,
+                                            check->simple,
+                                            check->caller,
+                                            subject,
+                                            check->details,
+                                            check->cancellable);
+              goto out;
+            }
+
+          g_debug (" using authentication agent for challenge");
+
+          challenge = g_new0 (PendingChallenge, 1);
+          challenge->authority = g_object_ref (interactive_authority);
+          challenge->key = key;
+          challenge->scope = g_object_ref (scope);
+          challenge->cancellable = g_cancellable_new ();
+          g_hash_table_insert (priv->hash_key_to_pending_challenge, challenge->key, challenge);
+          pending_challenge_add_waiter (challenge,
+                                        check->simple,
+                                        check->caller,
+                                        subject,
+                                        check->details,
+                                        check->cancellable);
+          if (challenge->waiters == NULL)
+            {
+              /* cancelled already, don't bother the agent */
+              pending_challenge_free (challenge);
+              goto out;
+            }
+
+          authentication_agent_initiate_challenge (agent,
+                                                   check->subject_info,
+                                                   challenge->scope,
+                                                   interactive_authority,
+                                                   action_id,
+                                                   check->details,
+                                                   check->caller,
+                                                   implicit_authorization,
+                                                   challenge->cancellable,
+                                                   check_authorization_challenge_cb,
+                                                   challenge);
+
+          /* keep going */
+          goto out;
+        }
+    }
+
+  log_result (interactive_authority,
+              action_id,
+              subject,
+              polkit_backend_subject_info_get_user (check->subject_info),
+              check->caller,
+              result);
+
+  /* Otherwise just return the result */
+  g_simple_async_result_set_op_res_gpointer (check->simple,
+                                             g_object_ref (result),
+                                             g_object_unref);
+  g_simple_async_result_complete (check->simple);
+
+ out:
+  g_object_unref (result);
+}
+
+/* Concludes and frees every check of the chain @checks, in order */
+static void
+pending_checks_conclude (PendingCheck *checks)
+{
+  PendingCheck *next;
+
+  for (; checks != NULL; checks = next)
+    {
+      next = checks->next;
+      pending_check_conclude (checks);
+      pending_check_free (checks);
+    }
+}
+
+/* Fails and frees every check of the chain @checks, in order */
+static void
+pending_checks_fail (PendingCheck *checks,
+                     const GError *error)
+{
+  PendingCheck *next;
+
+  for (; checks != NULL; checks = next)
+    {
+      next = checks->next;
+      metrics_count (POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (checks->authority),
+                     POLKIT_BACKEND_METRICS_COUNTER_CHECKS_FAILED);
+      POLKIT_BACKEND_PROBE1 (check__authorization__failed, error->code);
+      g_simple_async_result_set_from_error (checks->simple, error);
+      g_simple_async_result_complete (checks->simple);
+      pending_check_free (checks);
+    }
+}
+
+/* Concludes the chain @checks once every check of it was evaluated */
+static void
+pending_checks_finish (PendingCheck *checks)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (checks->authority);
+
+  /* let the next check have the worker while this one is concluded */
+  if (checks->queue_caller != NULL)
+    polkit_backend_check_queue_done (priv->check_queue, checks->queue_caller);
+
+  pending_checks_conclude (checks);
+}
+
+static void pending_checks_evaluate_cb (GObject      *source_object,
+                                        GAsyncResult *res,
+                                        gpointer      user_data);
+
+/* Lets the subclass have its say on the next action of the chain
+ * @checks, one at a time, and finishes the chain after the last one;
+ * main loop only.
+ */
+static void
+pending_checks_evaluate_next (PendingCheck *checks)
+{
+  PendingCheck *check;
+  CheckEvaluation *evaluation;
+
+  /* the first action authorized decides, see pending_check_get_result() */
+  check = checks->evaluating;
+  while (check != NULL &&
+         (checks->evaluating_n == check->n_evaluations ||
+          (checks->evaluating_n > 0 &&
+           check->evaluations[checks->evaluating_n - 1].implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED)))
+    {
+      pending_check_add_latency (check, POLKIT_BACKEND_METRICS_PHASE_RULES, checks->evaluating_started);
+      check = checks->evaluating = check->next;
+      checks->evaluating_n = 0;
+      checks->evaluating_started = pending_check_now (checks);
+    }
+
+  if (check == NULL)
+    {
+      pending_checks_finish (checks);
+      return;
+    }
+
+  evaluation = &check->evaluations[checks->evaluating_n];
+  polkit_backend_interactive_authority_check_authorization_async (check->authority,
+                                                                  check->caller,
+                                                                  polkit_backend_subject_info_get_subject (check->subject_info),
+                                                                  polkit_backend_subject_info_get_user (check->subject_info),
+                                                                  check->session_is_local,
+                                                                  check->session_is_active,
+                                                                  evaluation->action_id,
+                                                                  pending_check_get_details (check, evaluation),
+                                                                  pending_check_get_implicit (check, evaluation),
+                                                                  check->subject_info,
+                                                                  check->cancellable,
+                                                                  pending_checks_evaluate_cb,
+                                                                  checks);
+}
+
+static void
+pending_checks_evaluate_cb (GObject      *source_object,
+                            GAsyncResult *res,
+                            gpointer      user_data)
+{
+  PendingCheck *checks = user_data;
+  PendingCheck *check = checks->evaluating;
+
+  check->evaluations[checks->evaluating_n++].implicit_authorization =
+    polkit_backend_interactive_authority_check_authorization_async_finish (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (source_object),
+                                                                           res);
+  pending_checks_evaluate_next (checks);
+}
+
+static gboolean
+pending_checks_evaluated_cb (gpointer user_data)
+{
+  PendingCheck *checks = user_data;
+
+  /* the worker only found out about the subject, see pending_check_evaluate() */
+  if (evaluates_asynchronously (checks->authority))
+    {
+      checks->evaluating = checks;
+      checks->evaluating_n = 0;
+      checks->evaluating_started = pending_check_now (checks);
+      pending_checks_evaluate_next (checks);
+    }
+  else
+    {
+      pending_checks_finish (checks);
+    }
+
+  return FALSE; /* remove source */
+}
+
+static void
+check_authorization_thread_func (gpointer data,
+                                 gpointer user_data)
+{
+  PendingCheck *checks = data;
+  PendingCheck *check;
+
+  for (check = checks; check != NULL; check = check->next)
+    pending_check_evaluate (check);
+
+  /* everything else happens where the checks came from */
+  g_main_context_invoke (checks->context, pending_checks_evaluated_cb, checks);
+}
+
+/* Called by the check queue once it is the turn of @item */
+static void
+check_authorization_queue_func (gpointer item,
+                                gpointer user_data)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (user_data);
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+
+  /* the results are delivered back in this thread, see check_authorization_thread_func() */
+  g_thread_pool_push (priv->check_pool, item, NULL);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Finds out who is behind @caller and @subject, which every check of a
+ * request shares. Returns %FALSE if @error is set.
+ */
+static gboolean
+check_authorization_get_users (PolkitBackendInteractiveAuthority  *interactive_authority,
+                               PolkitSubject                      *caller,
+                               PolkitSubject                      *subject,
+                               PolkitIdentity                    **out_user_of_caller,
+                               PolkitIdentity                    **out_user_of_subject,
+                               gboolean                           *out_user_of_subject_matches,
+                               GError                            **error)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  gchar *caller_str;
+  gchar *subject_str;
+  gchar *user_of_caller_str;
+  gchar *user_of_subject_str;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+
+  *out_user_of_caller = NULL;
+  *out_user_of_subject = NULL;
+
+  caller_str = polkit_subject_to_string (caller);
+  subject_str = polkit_subject_to_string (subject);
+
+  g_debug ("%s is inquiring whether %s is authorized",
+           caller_str,
+           subject_str);
+
+  g_free (caller_str);
+  g_free (subject_str);
+
+  *out_user_of_caller = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
+                                                                             caller, NULL,
+                                                                             error);
+  if (*out_user_of_caller == NULL)
+    return FALSE;
+
+  user_of_caller_str = polkit_identity_to_string (*out_user_of_caller);
+  g_debug (" user of caller is %s", user_of_caller_str);
+  g_free (user_of_caller_str);
+
+  *out_user_of_subject = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
+                                                                              subject, out_user_of_subject_matches,
+                                                                              error);
+  if (*out_user_of_subject == NULL)
+    {
+      g_object_unref (*out_user_of_caller);
+      *out_user_of_caller = NULL;
+      return FALSE;
+    }
+
+  user_of_subject_str = polkit_identity_to_string (*out_user_of_subject);
+  g_debug (" user of subject is %s", user_of_subject_str);
+  g_free (user_of_subject_str);
+
+  return TRUE;
+}
+
+/* Checks that the caller may pass @flags. Explaining a check tells which
+ * rules exist and who they apply to, so only uid 0 may ask for that.
+ * Returns %FALSE if @error is set.
+ */
+static gboolean
+check_authorization_check_flags (PolkitIdentity                 *user_of_caller,
+                                 PolkitCheckAuthorizationFlags   flags,
+                                 GError                        **error)
+{
+  if ((flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN) && !identity_is_root_user (user_of_caller))
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_NOT_AUTHORIZED,
+                   "Only trusted callers (e.g. uid 0) can use CheckAuthorization() to explain a check");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Checks that the caller may ask about @action_id at all and looks up its
+ * defaults. Returns %FALSE if @error is set.
+ */
+static gboolean
+check_authorization_get_defaults (PolkitBackendInteractiveAuthority  *interactive_authority,
+                                  const gchar                        *action_id,
+                                  PolkitDetails                      *details,
+                                  PolkitIdentity                     *user_of_caller,
+                                  PolkitIdentity                     *user_of_subject,
+                                  gboolean                            user_of_subject_matches,
+                                  PolkitBackendActionDefaults        *out_defaults,
+                                  GError                            **error)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  gboolean has_details;
+  gchar **detail_keys;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+
+  has_details = FALSE;
   if (details != NULL)
     {
       detail_keys = polkit_details_get_keys (details);
@@ -957,86 +2727,193 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
         {
           if (has_details)
             {
-              g_simple_async_result_set_error (simple,
-                                               POLKIT_ERROR,
-                                               POLKIT_ERROR_NOT_AUTHORIZED,
-                                               "Only trusted callers (e.g. uid 0 or an action owner) can use CheckAuthorization() and "
-                                               "pass details");
+              g_set_error (error,
+                           POLKIT_ERROR,
+                           POLKIT_ERROR_NOT_AUTHORIZED,
+                           "Only trusted callers (e.g. uid 0 or an action owner) can use CheckAuthorization() and "
+                           "pass details");
             }
           else
             {
-              g_simple_async_result_set_error (simple,
-                                               POLKIT_ERROR,
-                                               POLKIT_ERROR_NOT_AUTHORIZED,
-                                               "Only trusted callers (e.g. uid 0 or an action owner) can use CheckAuthorization() for "
-                                               "subjects belonging to other identities");
+              g_set_error (error,
+                           POLKIT_ERROR,
+                           POLKIT_ERROR_NOT_AUTHORIZED,
+                           "Only trusted callers (e.g. uid 0 or an action owner) can use CheckAuthorization() for "
+                           "subjects belonging to other identities");
             }
-          g_simple_async_result_complete (simple);
-          g_object_unref (simple);
-          goto out;
+          return FALSE;
         }
     }
 
-  implicit_authorization = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
-  result = check_authorization_sync (authority,
-                                     caller,
-                                     subject,
-                                     action_id,
-                                     details,
-                                     flags,
-                                     &implicit_authorization,
-                                     FALSE, /* checking_imply */
-                                     &error);
-  if (error != NULL)
+  if (!polkit_backend_action_pool_get_defaults (priv->action_pool, action_id, out_defaults))
     {
-      g_simple_async_result_set_from_error (simple, error);
-      g_simple_async_result_complete (simple);
-      g_object_unref (simple);
-      g_error_free (error);
-      goto out;
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Action %s is not registered",
+                   action_id);
+      return FALSE;
     }
 
-  /* Caller is up for a challenge! With light sabers! Use an authentication agent if one exists... */
-  if (polkit_authorization_result_get_is_challenge (result) &&
-      (flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION))
-    {
-      AuthenticationAgent *agent;
+  return TRUE;
+}
 
-      agent = get_authentication_agent_for_subject (interactive_authority, subject);
-      if (agent != NULL)
+/* Evaluates @checks, a chain of checks all for the same subject asked
+ * for by @user_of_caller, and delivers their results; takes ownership
+ * of @checks.
+ */
+static void
+check_authorization_dispatch (PolkitBackendInteractiveAuthority *interactive_authority,
+                              PolkitIdentity                    *user_of_caller,
+                              PendingCheck                      *checks)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PendingCheck *check;
+  GError *error;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+
+  /* special case: uid 0, root, is _always_ authorized for anything, so
+   * there is nothing to evaluate
+   */
+  if (identity_is_root_user (polkit_backend_subject_info_get_user (checks->subject_info)))
+    {
+      pending_checks_conclude (checks);
+    }
+  else if (priv->check_queue != NULL)
+    {
+      /* Callers are told apart by user rather than by bus name, as
+       * anybody may open as many connections as they like. System
+       * services, running as uid 0, get more turns than everybody else.
+       */
+      checks->queue_caller = polkit_identity_to_string (user_of_caller);
+      error = NULL;
+      if (!polkit_backend_check_queue_push (priv->check_queue,
+                                            checks->queue_caller,
+                                            identity_is_root_user (user_of_caller) ? CHECK_QUEUE_ROOT_WEIGHT : 1,
+                                            checks,
+                                            &error))
         {
-          g_object_unref (result);
-          result = NULL;
+          g_debug (" refusing check for %s: %s", checks->queue_caller, error->message);
+          pending_checks_fail (checks, error);
+          g_error_free (error);
+        }
+    }
+  else
+    {
+      for (check = checks; check != NULL; check = check->next)
+        pending_check_evaluate (check);
+      pending_checks_evaluated_cb (checks);
+    }
+}
 
-          g_debug (" using authentication agent for challenge");
+static void
+polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority         *authority,
+                                                          PolkitSubject                  *caller,
+                                                          PolkitSubject                  *subject,
+                                                          const gchar                    *action_id,
+                                                          PolkitDetails                  *details,
+                                                          PolkitCheckAuthorizationFlags   flags,
+                                                          GCancellable                   *cancellable,
+                                                          GAsyncReadyCallback             callback,
+                                                          gpointer                        user_data)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitIdentity *user_of_caller;
+  PolkitIdentity *user_of_subject;
+  gboolean user_of_subject_matches;
+  PolkitBackendSubjectInfo *subject_info;
+  PolkitBackendActionDefaults defaults;
+  PendingCheck *check;
+  GError *error;
+  GSimpleAsyncResult *simple;
+  gint64 started;
+  gint64 subject_usec;
 
-          authentication_agent_initiate_challenge (agent,
-                                                   subject,
-                                                   user_of_subject,
-                                                   interactive_authority,
-                                                   action_id,
-                                                   details,
-                                                   caller,
-                                                   implicit_authorization,
-                                                   cancellable,
-                                                   check_authorization_challenge_cb,
-                                                   simple);
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_CHECK_AUTHORIZATION);
+  if (flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN)
+    started = g_get_monotonic_time ();
+  else
+    started = metrics_now (priv);
+  POLKIT_BACKEND_PROBE2 (check__authorization__entry, action_id, flags);
 
-          /* keep going */
-          goto out;
-        }
+  error = NULL;
+  user_of_caller = NULL;
+  user_of_subject = NULL;
+  subject_info = NULL;
+
+  simple = g_simple_async_result_new (G_OBJECT (authority),
+                                      callback,
+                                      user_data,
+                                      polkit_backend_interactive_authority_check_authorization);
+
+  /* handle being called from ourselves */
+  if (caller == NULL)
+    {
+      /* TODO: this is kind of a hack */
+      GDBusConnection *system_bus;
+      system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
+      caller = polkit_system_bus_name_new (g_dbus_connection_get_unique_name (system_bus));
+      g_object_unref (system_bus);
     }
 
-  /* log_result (interactive_authority, action_id, subject, caller, result); */
+  g_debug (" checking %s", action_id);
 
-  /* Otherwise just return the result */
-  g_simple_async_result_set_op_res_gpointer (simple,
-                                             g_object_ref (result),
-                                             g_object_unref);
-  g_simple_async_result_complete (simple);
-  g_object_unref (simple);
+  if (!check_authorization_get_users (interactive_authority,
+                                      caller,
+                                      subject,
+                                      &user_of_caller,
+                                      &user_of_subject,
+                                      &user_of_subject_matches,
+                                      &error))
+    goto out;
+  subject_usec = metrics_add_latency (priv, POLKIT_BACKEND_METRICS_PHASE_SUBJECT, started);
+
+  if (!check_authorization_check_flags (user_of_caller, flags, &error))
+    goto out;
+
+  if (!check_authorization_get_defaults (interactive_authority,
+                                         action_id,
+                                         details,
+                                         user_of_caller,
+                                         user_of_subject,
+                                         user_of_subject_matches,
+                                         &defaults,
+                                         &error))
+    goto out;
+
+  /* Everything else we learn about the subject during this request is
+   * looked up at most once, and shared from here on */
+  subject_info = polkit_backend_subject_info_new (priv->session_monitor,
+                                                  priv->identities,
+                                                  subject,
+                                                  user_of_subject);
+
+  check = pending_check_new (interactive_authority,
+                             simple,
+                             caller,
+                             subject_info,
+                             action_id,
+                             &defaults,
+                             details,
+                             flags,
+                             cancellable,
+                             started);
+  check->usec[POLKIT_BACKEND_METRICS_PHASE_SUBJECT] = subject_usec;
+  check_authorization_dispatch (interactive_authority, user_of_caller, check);
 
  out:
+  if (error != NULL)
+    {
+      metrics_count (priv, POLKIT_BACKEND_METRICS_COUNTER_CHECKS_FAILED);
+      POLKIT_BACKEND_PROBE1 (check__authorization__failed, error->code);
+      g_simple_async_result_take_error (simple, error);
+      g_simple_async_result_complete (simple);
+    }
+  g_object_unref (simple);
 
   if (user_of_caller != NULL)
     g_object_unref (user_of_caller);
@@ -1044,257 +2921,293 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
   if (user_of_subject != NULL)
     g_object_unref (user_of_subject);
 
-  g_free (caller_str);
-  g_free (subject_str);
-  g_free (user_of_caller_str);
-  g_free (user_of_subject_str);
-
-  if (result != NULL)
-    g_object_unref (result);
+  if (subject_info != NULL)
+    polkit_backend_subject_info_unref (subject_info);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static PolkitAuthorizationResult *
-check_authorization_sync (PolkitBackendAuthority         *authority,
-                          PolkitSubject                  *caller,
-                          PolkitSubject                  *subject,
-                          const gchar                    *action_id,
-                          PolkitDetails                  *details,
-                          PolkitCheckAuthorizationFlags   flags,
-                          PolkitImplicitAuthorization    *out_implicit_authorization,
-                          gboolean                        checking_imply,
-                          GError                        **error)
-{
-  PolkitBackendInteractiveAuthority *interactive_authority;
-  PolkitBackendInteractiveAuthorityPrivate *priv;
-  PolkitAuthorizationResult *result;
-  PolkitIdentity *user_of_subject;
-  PolkitSubject *session_for_subject;
-  gchar *subject_str;
-  GList *groups_of_user;
-  PolkitActionDescription *action_desc;
-  gboolean session_is_local;
-  gboolean session_is_active;
-  PolkitImplicitAuthorization implicit_authorization;
-  const gchar *tmp_authz_id;
-  GList *actions;
-  GList *l;
-
-  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
-  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
-
-  result = NULL;
-
-  actions = NULL;
-  user_of_subject = NULL;
-  groups_of_user = NULL;
-  subject_str = NULL;
-  session_for_subject = NULL;
+/* The checks of one CheckAuthorizations() request, waiting for each
+ * of them to deliver its result
+ */
+typedef struct PendingBatch PendingBatch;
 
-  session_is_local = FALSE;
-  session_is_active = FALSE;
+typedef struct
+{
+  PendingBatch *batch;
+  guint index;
+} PendingBatchSlot;
 
-  subject_str = polkit_subject_to_string (subject);
+struct PendingBatch
+{
+  GSimpleAsyncResult *simple;
+  PendingBatchSlot *slots;
+  PolkitAuthorizationResult **results;
+  guint n_checks;
+  guint n_pending;
+  GError *error; /* the first check that failed */
+};
 
-  g_debug ("checking whether %s is authorized for %s",
-           subject_str,
-           action_id);
+static void
+authorization_result_list_free (GList *results)
+{
+  g_list_free_full (results, g_object_unref);
+}
 
-  /* get the action description */
-  action_desc = polkit_backend_action_pool_get_action (priv->action_pool,
-                                                       action_id,
-                                                       NULL);
+static void
+pending_batch_free (PendingBatch *batch)
+{
+  guint n;
 
-  if (action_desc == NULL)
+  for (n = 0; n < batch->n_checks; n++)
     {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Action %s is not registered",
-                   action_id);
-      goto out;
+      if (batch->results[n] != NULL)
+        g_object_unref (batch->results[n]);
     }
+  g_free (batch->results);
+  g_free (batch->slots);
+  if (batch->error != NULL)
+    g_error_free (batch->error);
+  g_object_unref (batch->simple);
+  g_free (batch);
+}
 
-  /* every subject has a user; this is supplied by the client, so we rely
-   * on the caller to validate its acceptability. */
-  user_of_subject = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
-                                                                         subject, NULL,
-                                                                         error);
-  if (user_of_subject == NULL)
-      goto out;
+static void
+pending_batch_check_cb (GObject      *source_object,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+  PendingBatchSlot *slot = user_data;
+  PendingBatch *batch = slot->batch;
+  GList *results;
+  GError *error;
+  guint n;
 
-  /* special case: uid 0, root, is _always_ authorized for anything */
-  if (identity_is_root_user (user_of_subject))
+  error = NULL;
+  batch->results[slot->index] =
+    polkit_backend_interactive_authority_check_authorization_finish (POLKIT_BACKEND_AUTHORITY (source_object),
+                                                                     res,
+                                                                     &error);
+  if (error != NULL)
     {
-      result = polkit_authorization_result_new (TRUE, FALSE, NULL);
-      goto out;
+      if (batch->error == NULL)
+        batch->error = error;
+      else
+        g_error_free (error);
     }
 
-  /* a subject *may* be in a session */
-  session_for_subject = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
-                                                                                subject,
-                                                                                NULL);
-  g_debug ("  %p", session_for_subject);
-  if (session_for_subject != NULL)
-    {
-      session_is_local = polkit_backend_session_monitor_is_session_local (priv->session_monitor, session_for_subject);
-      session_is_active = polkit_backend_session_monitor_is_session_active (priv->session_monitor, session_for_subject);
-
-      g_debug (" subject is in session %s (local=%d active=%d)",
-               polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session_for_subject)),
-               session_is_local,
-               session_is_active);
-    }
+  if (--batch->n_pending > 0)
+    return;
 
-  /* find the implicit authorization to use; it depends on is_local and is_active */
-  if (session_is_local)
+  if (batch->error != NULL)
     {
-      if (session_is_active)
-        implicit_authorization = polkit_action_description_get_implicit_active (action_desc);
-      else
-        implicit_authorization = polkit_action_description_get_implicit_inactive (action_desc);
+      g_simple_async_result_take_error (batch->simple, batch->error);
+      batch->error = NULL;
     }
   else
     {
-      implicit_authorization = polkit_action_description_get_implicit_any (action_desc);
+      results = NULL;
+      for (n = batch->n_checks; n > 0; n--)
+        results = g_list_prepend (results, g_object_ref (batch->results[n - 1]));
+      g_simple_async_result_set_op_res_gpointer (batch->simple,
+                                                 results,
+                                                 (GDestroyNotify) authorization_result_list_free);
     }
+  g_simple_async_result_complete (batch->simple);
 
-  /* allow subclasses to rewrite implicit_authorization */
-  implicit_authorization = polkit_backend_interactive_authority_check_authorization_sync (interactive_authority,
-                                                                                          caller,
-                                                                                          subject,
-                                                                                          user_of_subject,
-                                                                                          session_is_local,
-                                                                                          session_is_active,
-                                                                                          action_id,
-                                                                                          details,
-                                                                                          implicit_authorization);
-  /* first see if there's an implicit authorization for subject available */
-  if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED)
+  pending_batch_free (batch);
+}
+
+static void
+polkit_backend_interactive_authority_check_authorizations (PolkitBackendAuthority         *authority,
+                                                           PolkitSubject                  *caller,
+                                                           PolkitSubject                  *subject,
+                                                           const gchar * const            *action_ids,
+                                                           PolkitDetails * const          *details,
+                                                           PolkitCheckAuthorizationFlags   flags,
+                                                           GCancellable                   *cancellable,
+                                                           GAsyncReadyCallback             callback,
+                                                           gpointer                        user_data)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitIdentity *user_of_caller;
+  PolkitIdentity *user_of_subject;
+  gboolean user_of_subject_matches;
+  PolkitBackendSubjectInfo *subject_info;
+  PendingBatch *batch;
+  PendingCheck *checks;
+  PendingCheck **tail;
+  GSimpleAsyncResult *simple;
+  GError *error;
+  guint n_checks;
+  guint n;
+  gint64 started;
+  gint64 subject_usec;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_CHECK_AUTHORIZATIONS);
+  if (flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN)
+    started = g_get_monotonic_time ();
+  else
+    started = metrics_now (priv);
+
+  error = NULL;
+  user_of_caller = NULL;
+  user_of_subject = NULL;
+  subject_info = NULL;
+  checks = NULL;
+  tail = &checks;
+
+  simple = g_simple_async_result_new (G_OBJECT (authority),
+                                      callback,
+                                      user_data,
+                                      polkit_backend_interactive_authority_check_authorizations);
+
+  n_checks = g_strv_length ((gchar **) action_ids);
+  POLKIT_BACKEND_PROBE2 (check__authorizations__entry, n_checks, flags);
+  if (n_checks > CHECK_AUTHORIZATIONS_MAX_CHECKS)
     {
-      g_debug (" is authorized (has implicit authorization local=%d active=%d)",
-               session_is_local,
-               session_is_active);
-      result = polkit_authorization_result_new (TRUE, FALSE, details);
+      g_set_error (&error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "At most %d actions can be checked at once",
+                   CHECK_AUTHORIZATIONS_MAX_CHECKS);
       goto out;
     }
-
-  /* then see if there's a temporary authorization for the subject */
-  if (temporary_authorization_store_has_authorization (priv->temporary_authorization_store,
-                                                       subject,
-                                                       action_id,
-                                                       &tmp_authz_id))
+  if (n_checks == 0)
     {
-
-      g_debug (" is authorized (has temporary authorization)");
-      polkit_details_insert (details, "polkit.temporary_authorization_id", tmp_authz_id);
-      result = polkit_authorization_result_new (TRUE, FALSE, details);
+      /* nothing to check, the result is an empty list */
+      g_simple_async_result_complete_in_idle (simple);
       goto out;
     }
 
-  /* then see if implied by another action that the subject is authorized for
-   * (but only one level deep to avoid infinite recursion)
-   *
-   * TODO: if this is slow, we can maintain a hash table for looking up what
-   * actions implies a given action
-   */
-  if (!checking_imply)
-    {
-      actions = polkit_backend_action_pool_get_all_actions (priv->action_pool, NULL);
-      for (l = actions; l != NULL; l = l->next)
-        {
-          PolkitActionDescription *imply_ad = POLKIT_ACTION_DESCRIPTION (l->data);
-          const gchar *imply;
-          imply = polkit_action_description_get_annotation (imply_ad, "org.freedesktop.policykit.imply");
-          if (imply != NULL)
-            {
-              gchar **tokens;
-              guint n;
-              tokens = g_strsplit (imply, " ", 0);
-              for (n = 0; tokens[n] != NULL; n++)
-                {
-                  if (g_strcmp0 (tokens[n], action_id) == 0)
-                    {
-                      PolkitAuthorizationResult *implied_result = NULL;
-                      PolkitImplicitAuthorization implied_implicit_authorization;
-                      GError *implied_error = NULL;
-                      const gchar *imply_action_id;
-
-                      imply_action_id = polkit_action_description_get_action_id (imply_ad);
-
-                      /* g_debug ("%s is implied by %s, checking", action_id, imply_action_id); */
-                      implied_result = check_authorization_sync (authority, caller, subject,
-                                                                 imply_action_id,
-                                                                 details, flags,
-                                                                 &implied_implicit_authorization, TRUE,
-                                                                 &implied_error);
-                      if (implied_result != NULL)
-                        {
-                          if (polkit_authorization_result_get_is_authorized (implied_result))
-                            {
-                              g_debug (" is authorized (implied by %s)", imply_action_id);
-                              result = implied_result;
-                              /* cleanup */
-                              g_strfreev (tokens);
-                              goto out;
-                            }
-                          g_object_unref (implied_result);
-                        }
-                      if (implied_error != NULL)
-                        g_error_free (implied_error);
-                    }
-                }
-              g_strfreev (tokens);
-            }
-        }
-    }
+  g_debug (" checking %u actions", n_checks);
+
+  if (!check_authorization_get_users (interactive_authority,
+                                      caller,
+                                      subject,
+                                      &user_of_caller,
+                                      &user_of_subject,
+                                      &user_of_subject_matches,
+                                      &error))
+    goto out;
+  subject_usec = metrics_add_latency (priv, POLKIT_BACKEND_METRICS_PHASE_SUBJECT, started);
 
-  if (implicit_authorization != POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED)
+  if (!check_authorization_check_flags (user_of_caller, flags, &error))
+    goto out;
+
+  /* Every check shares what is learnt about the subject. The checks
+   * are evaluated one after another in the same worker, so they never
+   * use it at the same time. */
+  subject_info = polkit_backend_subject_info_new (priv->session_monitor,
+                                                  priv->identities,
+                                                  subject,
+                                                  user_of_subject);
+
+  batch = g_new0 (PendingBatch, 1);
+  batch->simple = g_object_ref (simple);
+  batch->slots = g_new0 (PendingBatchSlot, n_checks);
+  batch->results = g_new0 (PolkitAuthorizationResult *, n_checks);
+  batch->n_checks = n_checks;
+  batch->n_pending = n_checks;
+
+  for (n = 0; n < n_checks; n++)
     {
-      if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED_RETAINED ||
-          implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
+      PolkitDetails *check_details;
+      PolkitBackendActionDefaults defaults;
+      GSimpleAsyncResult *check_simple;
+      GError *check_error;
+
+      check_details = details != NULL ? details[n] : NULL;
+
+      batch->slots[n].batch = batch;
+      batch->slots[n].index = n;
+      check_simple = g_simple_async_result_new (G_OBJECT (authority),
+                                                pending_batch_check_cb,
+                                                &batch->slots[n],
+                                                polkit_backend_interactive_authority_check_authorization);
+
+      check_error = NULL;
+      if (!check_authorization_get_defaults (interactive_authority,
+                                             action_ids[n],
+                                             check_details,
+                                             user_of_caller,
+                                             user_of_subject,
+                                             user_of_subject_matches,
+                                             &defaults,
+                                             &check_error))
         {
-          polkit_details_insert (details, "polkit.retains_authorization_after_challenge", "1");
+          /* completed in idle, so the batch outlives the loop */
+          metrics_count (priv, POLKIT_BACKEND_METRICS_COUNTER_CHECKS_FAILED);
+          POLKIT_BACKEND_PROBE1 (check__authorization__failed, check_error->code);
+          g_simple_async_result_take_error (check_simple, check_error);
+          g_simple_async_result_complete_in_idle (check_simple);
         }
+      else
+        {
+          *tail = pending_check_new (interactive_authority,
+                                     check_simple,
+                                     caller,
+                                     subject_info,
+                                     action_ids[n],
+                                     &defaults,
+                                     check_details,
+                                     flags,
+                                     cancellable,
+                                     started);
+          (*tail)->usec[POLKIT_BACKEND_METRICS_PHASE_SUBJECT] = subject_usec;
+          tail = &(*tail)->next;
+        }
+      g_object_unref (check_simple);
+    }
 
-      result = polkit_authorization_result_new (FALSE, TRUE, details);
-
-      /* return implicit_authorization so the caller can use an authentication agent if applicable */
-      if (out_implicit_authorization != NULL)
-        *out_implicit_authorization = implicit_authorization;
+  if (checks != NULL)
+    check_authorization_dispatch (interactive_authority, user_of_caller, checks);
 
-      g_debug (" challenge (implicit_authorization = %s)",
-               polkit_implicit_authorization_to_string (implicit_authorization));
-    }
-  else
+ out:
+  if (error != NULL)
     {
-      result = polkit_authorization_result_new (FALSE, FALSE, details);
-      g_debug (" not authorized");
+      metrics_count (priv, POLKIT_BACKEND_METRICS_COUNTER_CHECKS_FAILED);
+      POLKIT_BACKEND_PROBE1 (check__authorization__failed, error->code);
+      g_simple_async_result_take_error (simple, error);
+      g_simple_async_result_complete (simple);
     }
- out:
-  g_list_foreach (actions, (GFunc) g_object_unref, NULL);
-  g_list_free (actions);
-
-  g_free (subject_str);
+  g_object_unref (simple);
 
-  g_list_foreach (groups_of_user, (GFunc) g_object_unref, NULL);
-  g_list_free (groups_of_user);
+  if (user_of_caller != NULL)
+    g_object_unref (user_of_caller);
 
   if (user_of_subject != NULL)
     g_object_unref (user_of_subject);
 
-  if (session_for_subject != NULL)
-    g_object_unref (session_for_subject);
+  if (subject_info != NULL)
+    polkit_backend_subject_info_unref (subject_info);
+}
+
+static GList *
+polkit_backend_interactive_authority_check_authorizations_finish (PolkitBackendAuthority  *authority,
+                                                                  GAsyncResult            *res,
+                                                                  GError                 **error)
+{
+  GSimpleAsyncResult *simple;
+  GList *results;
 
-  if (action_desc != NULL)
-    g_object_unref (action_desc);
+  simple = G_SIMPLE_ASYNC_RESULT (res);
 
-  g_debug (" ");
+  g_warn_if_fail (g_simple_async_result_get_source_tag (simple) == polkit_backend_interactive_authority_check_authorizations);
 
-  return result;
+  if (g_simple_async_result_propagate_error (simple, error))
+    return NULL;
+
+  results = g_simple_async_result_get_op_res_gpointer (simple);
+  return g_list_copy_deep (results, (GCopyFunc) g_object_ref, NULL);
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 /**
@@ -1307,6 +3220,7 @@ check_authorization_sync (PolkitBackendAuthority         *authority,
  * @subject_is_active: %TRUE if the session for @subject is active.
  * @action_id: The action we are about to authenticate for.
  * @details: Details about the action.
+ * @subject_info: (allow-none): Facts about @subject already resolved for this request, or %NULL.
  *
  * Gets a list of identities to use for administrator authentication.
  *
@@ -1323,7 +3237,8 @@ polkit_backend_interactive_authority_get_admin_identities (PolkitBackendInteract
                                                            gboolean                           subject_is_local,
                                                            gboolean                           subject_is_active,
                                                            const gchar                       *action_id,
-                                                           PolkitDetails                     *details)
+                                                           PolkitDetails                     *details,
+                                                           PolkitBackendSubjectInfo          *subject_info)
 {
   PolkitBackendInteractiveAuthorityClass *klass;
   GList *ret = NULL;
@@ -1339,12 +3254,327 @@ polkit_backend_interactive_authority_get_admin_identities (PolkitBackendInteract
                                          subject_is_local,
                                          subject_is_active,
                                          action_id,
-                                         details);
+                                         details,
+                                         subject_info);
     }
 
   return ret;
 }
 
+/**
+ * polkit_backend_interactive_authority_get_admin_identities_async:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @caller: The subject that is inquiring whether @subject is authorized.
+ * @subject: The subject we are about to authenticate for.
+ * @user_for_subject: The user of the subject we are about to authenticate for.
+ * @subject_is_local: %TRUE if the session for @subject is local.
+ * @subject_is_active: %TRUE if the session for @subject is active.
+ * @action_id: The action we are about to authenticate for.
+ * @details: Details about the action.
+ * @subject_info: (allow-none): Facts about @subject already resolved for this request, or %NULL.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the identities are known.
+ * @user_data: The data to pass to @callback.
+ *
+ * Like polkit_backend_interactive_authority_get_admin_identities() but
+ * without blocking. Subclasses implementing this method have it used
+ * for starting every challenge that needs an administrator.
+ *
+ * The default implementation calls
+ * polkit_backend_interactive_authority_get_admin_identities() right
+ * away, as the subclass may expect it to run in the main loop, and
+ * completes in an idle handler.
+ *
+ * When done, @callback is invoked in the thread-default main loop of
+ * the thread you are calling this from. You can then call
+ * polkit_backend_interactive_authority_get_admin_identities_async_finish().
+ */
+void
+polkit_backend_interactive_authority_get_admin_identities_async (PolkitBackendInteractiveAuthority *authority,
+                                                                 PolkitSubject                     *caller,
+                                                                 PolkitSubject                     *subject,
+                                                                 PolkitIdentity                    *user_for_subject,
+                                                                 gboolean                           subject_is_local,
+                                                                 gboolean                           subject_is_active,
+                                                                 const gchar                       *action_id,
+                                                                 PolkitDetails                     *details,
+                                                                 PolkitBackendSubjectInfo          *subject_info,
+                                                                 GCancellable                      *cancellable,
+                                                                 GAsyncReadyCallback                callback,
+                                                                 gpointer                           user_data)
+{
+  PolkitBackendInteractiveAuthorityClass *klass;
+  GSimpleAsyncResult *simple;
+  GList *identities;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+
+  klass = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority);
+
+  if (klass->get_admin_identities_async != NULL)
+    {
+      klass->get_admin_identities_async (authority,
+                                         caller,
+                                         subject,
+                                         user_for_subject,
+                                         subject_is_local,
+                                         subject_is_active,
+                                         action_id,
+                                         details,
+                                         subject_info,
+                                         cancellable,
+                                         callback,
+                                         user_data);
+      return;
+    }
+
+  identities = polkit_backend_interactive_authority_get_admin_identities (authority,
+                                                                          caller,
+                                                                          subject,
+                                                                          user_for_subject,
+                                                                          subject_is_local,
+                                                                          subject_is_active,
+                                                                          action_id,
+                                                                          details,
+                                                                          subject_info);
+
+  simple = g_simple_async_result_new (G_OBJECT (authority),
+                                      callback,
+                                      user_data,
+                                      polkit_backend_interactive_authority_get_admin_identities_async);
+  g_simple_async_result_set_op_res_gpointer (simple, identities, NULL);
+  g_simple_async_result_complete_in_idle (simple);
+  g_object_unref (simple);
+}
+
+/**
+ * polkit_backend_interactive_authority_get_admin_identities_async_finish:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @res: A #GAsyncResult obtained from the #GAsyncReadyCallback passed to polkit_backend_interactive_authority_get_admin_identities_async().
+ *
+ * Finishes getting the identities for administrator authentication.
+ *
+ * Returns: A list of #PolkitIdentity objects. Free each element
+ *     g_object_unref(), then free the list with g_list_free().
+ */
+GList *
+polkit_backend_interactive_authority_get_admin_identities_async_finish (PolkitBackendInteractiveAuthority *authority,
+                                                                        GAsyncResult                      *res)
+{
+  PolkitBackendInteractiveAuthorityClass *klass;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority), NULL);
+
+  klass = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority);
+
+  if (klass->get_admin_identities_async != NULL)
+    return klass->get_admin_identities_async_finish (authority, res);
+
+  g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res), NULL);
+  g_warn_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) == polkit_backend_interactive_authority_get_admin_identities_async);
+
+  return g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
+}
+
+static void
+warm_up_thread_func (GSimpleAsyncResult *simple,
+                     GObject            *object,
+                     GCancellable       *cancellable)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (object);
+  GArray *uids;
+  guint n;
+
+  uids = g_simple_async_result_get_op_res_gpointer (simple);
+  for (n = 0; n < uids->len; n++)
+    policy_user_record_unref (policy_identity_cache_lookup_user (priv->identities,
+                                                                 g_array_index (uids, uid_t, n)));
+
+  /* the admin groups may well still be on their way, too */
+  policy_identity_cache_sync (priv->identities);
+}
+
+/**
+ * polkit_backend_interactive_authority_warm_up:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @callback: A #GAsyncReadyCallback to call when the warm-up is done.
+ * @user_data: The data to pass to @callback.
+ *
+ * Does ahead of time what the first checks would otherwise have to do:
+ * every action is read and indexed right away, then the users of the
+ * current sessions are looked up in a worker thread, so that the first
+ * checks neither parse action files nor wait for a directory server.
+ *
+ * When done, @callback is invoked in the thread-default main loop of
+ * the thread you are calling this from. You can then call
+ * polkit_backend_interactive_authority_warm_up_finish().
+ */
+void
+polkit_backend_interactive_authority_warm_up (PolkitBackendInteractiveAuthority *authority,
+                                              GAsyncReadyCallback                callback,
+                                              gpointer                           user_data)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GSimpleAsyncResult *simple;
+  GArray *uids;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  /* the action pool belongs to the main loop, so this can't be in the thread */
+  polkit_backend_action_pool_warm_up (priv->action_pool);
+
+  /* these are looked up in the thread below, rather than prefetched */
+  uids = update_known_sessions (authority, FALSE);
+
+  simple = g_simple_async_result_new (G_OBJECT (authority),
+                                      callback,
+                                      user_data,
+                                      polkit_backend_interactive_authority_warm_up);
+  g_simple_async_result_set_op_res_gpointer (simple, uids, (GDestroyNotify) g_array_unref);
+  g_simple_async_result_run_in_thread (simple,
+                                       warm_up_thread_func,
+                                       G_PRIORITY_DEFAULT,
+                                       NULL);
+  g_object_unref (simple);
+}
+
+/**
+ * polkit_backend_interactive_authority_warm_up_finish:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @res: A #GAsyncResult obtained from the #GAsyncReadyCallback passed to polkit_backend_interactive_authority_warm_up().
+ *
+ * Finishes warming up @authority.
+ */
+void
+polkit_backend_interactive_authority_warm_up_finish (PolkitBackendInteractiveAuthority *authority,
+                                                     GAsyncResult                      *res)
+{
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+  g_return_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res));
+
+  g_warn_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) == polkit_backend_interactive_authority_warm_up);
+}
+
+/**
+ * polkit_backend_interactive_authority_get_idle_time:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ *
+ * Gets for how long @authority has had nothing that would be lost if
+ * the daemon exited: no checks waiting for an answer, no authentication
+ * agents, no authentication in progress and no temporary authorizations
+ * that haven't expired yet.
+ *
+ * Returns: The time in microseconds since a check was last started or
+ * concluded, or 0 if @authority isn't idle.
+ */
+gint64
+polkit_backend_interactive_authority_get_idle_time (PolkitBackendInteractiveAuthority *authority)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority), 0);
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  if (priv->n_pending_checks > 0 ||
+      g_hash_table_size (priv->hash_scope_to_authentication_agent) > 0 ||
+      g_hash_table_size (priv->hash_cookie_to_authentication_session) > 0 ||
+      g_hash_table_size (priv->hash_key_to_pending_challenge) > 0 ||
+      !temporary_authorization_store_is_empty (priv->temporary_authorization_store))
+    return 0;
+
+  return MAX (g_get_monotonic_time () - priv->last_check_activity, 1);
+}
+
+/**
+ * polkit_backend_interactive_authority_actions_changed:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @action_ids: (allow-none): A %NULL-terminated array of the actions
+ *   whose rules or descriptions changed, or %NULL if any may have.
+ *
+ * Lets clients know that authorizations may have changed. Unless
+ * @action_ids is %NULL, the <literal>ActionsChanged</literal> D-Bus
+ * signal names them first, so that clients that know it only check
+ * those actions again on the <literal>Changed</literal> signal that
+ * always follows.
+ */
+void
+polkit_backend_interactive_authority_actions_changed (PolkitBackendInteractiveAuthority *authority,
+                                                      const gchar * const               *action_ids)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GError *error;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  /* Changed goes out on the same connection, so it can't overtake this */
+  if (action_ids != NULL && priv->system_bus_connection != NULL)
+    {
+      error = NULL;
+      if (!g_dbus_connection_emit_signal (priv->system_bus_connection,
+                                          NULL, /* destination_bus_name */
+                                          "/org/freedesktop/PolicyKit1/Authority",
+                                          "org.freedesktop.PolicyKit1.Authority",
+                                          "ActionsChanged",
+                                          g_variant_new ("(^as)", action_ids),
+                                          &error))
+        {
+          g_warning ("Error emitting ActionsChanged: %s", error->message);
+          g_error_free (error);
+        }
+    }
+
+  g_signal_emit_by_name (authority, "changed");
+}
+
+/**
+ * polkit_backend_interactive_authority_prefetch_admin_identities:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @identities: (element-type PolkitIdentity): The identities administrators are picked from.
+ *
+ * Tells @authority which groups and netgroups are likely to be returned by
+ * polkit_backend_interactive_authority_get_admin_identities(), replacing
+ * what it was told before. Their members are looked up right away in the
+ * background, and refreshed whenever they expire, so that starting a
+ * challenge doesn't have to wait for a directory server.
+ */
+void
+polkit_backend_interactive_authority_prefetch_admin_identities (PolkitBackendInteractiveAuthority *authority,
+                                                                GList                             *identities)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GList *l;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  g_list_free_full (priv->admin_identities, g_object_unref);
+  priv->admin_identities = NULL;
+  for (l = identities; l != NULL; l = l->next)
+    {
+      if (POLKIT_IS_UNIX_GROUP (l->data) || POLKIT_IS_UNIX_NETGROUP (l->data))
+        priv->admin_identities = g_list_prepend (priv->admin_identities, g_object_ref (l->data));
+    }
+  priv->admin_identities = g_list_reverse (priv->admin_identities);
+
+  prefetch_admin_identities (priv);
+
+  if (priv->admin_identities != NULL)
+    {
+      schedule_admin_identities_refresh (authority);
+    }
+  else if (priv->admin_identities_refresh_id > 0)
+    {
+      g_source_remove (priv->admin_identities_refresh_id);
+      priv->admin_identities_refresh_id = 0;
+    }
+}
+
 /**
  * polkit_backend_interactive_authority_check_authorization_sync:
  * @authority: A #PolkitBackendInteractiveAuthority.
@@ -1356,6 +3586,7 @@ polkit_backend_interactive_authority_get_admin_identities (PolkitBackendInteract
  * @action_id: The action we are checking an authorization for.
  * @details: Details about the action.
  * @implicit: A #PolkitImplicitAuthorization value computed from the policy file and @subject.
+ * @subject_info: (allow-none): Facts about @subject already resolved for this request, or %NULL.
  *
  * Checks whether @subject is authorized to perform the action
  * specified by @action_id and @details. The implementation may append
@@ -1363,6 +3594,12 @@ polkit_backend_interactive_authority_get_admin_identities (PolkitBackendInteract
  *
  * The default implementation of this method simply returns @implicit.
  *
+ * For CheckAuthorization() requests this is called from a worker
+ * thread, possibly for several requests at once, so implementations
+ * must not touch state owned by the main loop. Subclasses that
+ * implement polkit_backend_interactive_authority_check_authorization_async()
+ * have that called instead.
+ *
  * Returns: A #PolkitImplicitAuthorization that specifies if the subject is authorized or whether
  *     authentication is required.
  */
@@ -1375,7 +3612,8 @@ polkit_backend_interactive_authority_check_authorization_sync (PolkitBackendInte
                                                                gboolean                           subject_is_active,
                                                                const gchar                       *action_id,
                                                                PolkitDetails                     *details,
-                                                               PolkitImplicitAuthorization        implicit)
+                                                               PolkitImplicitAuthorization        implicit,
+                                                               PolkitBackendSubjectInfo          *subject_info)
 {
   PolkitBackendInteractiveAuthorityClass *klass;
   PolkitImplicitAuthorization ret;
@@ -1396,10 +3634,210 @@ polkit_backend_interactive_authority_check_authorization_sync (PolkitBackendInte
                                              subject_is_active,
                                              action_id,
                                              details,
-                                             implicit);
+                                             implicit,
+                                             subject_info);
+    }
+
+  return ret;
+}
+
+/* What the default asynchronous methods hand to the synchronous ones */
+typedef struct
+{
+  PolkitSubject *caller;
+  PolkitSubject *subject;
+  PolkitIdentity *user_for_subject;
+  gboolean subject_is_local;
+  gboolean subject_is_active;
+  gchar *action_id;
+  PolkitDetails *details;
+  PolkitImplicitAuthorization implicit;
+  PolkitBackendSubjectInfo *subject_info;
+} SubclassCall;
+
+static SubclassCall *
+subclass_call_new (PolkitSubject                     *caller,
+                   PolkitSubject                     *subject,
+                   PolkitIdentity                    *user_for_subject,
+                   gboolean                           subject_is_local,
+                   gboolean                           subject_is_active,
+                   const gchar                       *action_id,
+                   PolkitDetails                     *details,
+                   PolkitImplicitAuthorization        implicit,
+                   PolkitBackendSubjectInfo          *subject_info)
+{
+  SubclassCall *call;
+
+  call = g_new0 (SubclassCall, 1);
+  call->caller = caller != NULL ? g_object_ref (caller) : NULL;
+  call->subject = g_object_ref (subject);
+  call->user_for_subject = g_object_ref (user_for_subject);
+  call->subject_is_local = subject_is_local;
+  call->subject_is_active = subject_is_active;
+  call->action_id = g_strdup (action_id);
+  call->details = details != NULL ? g_object_ref (details) : NULL;
+  call->implicit = implicit;
+  call->subject_info = subject_info != NULL ? polkit_backend_subject_info_ref (subject_info) : NULL;
+
+  return call;
+}
+
+static void
+subclass_call_free (SubclassCall *call)
+{
+  if (call->caller != NULL)
+    g_object_unref (call->caller);
+  g_object_unref (call->subject);
+  g_object_unref (call->user_for_subject);
+  g_free (call->action_id);
+  if (call->details != NULL)
+    g_object_unref (call->details);
+  if (call->subject_info != NULL)
+    polkit_backend_subject_info_unref (call->subject_info);
+  g_free (call);
+}
+
+static void
+check_authorization_sync_thread_func (GSimpleAsyncResult *simple,
+                                      GObject            *object,
+                                      GCancellable       *cancellable)
+{
+  SubclassCall *call = g_simple_async_result_get_op_res_gpointer (simple);
+
+  call->implicit = polkit_backend_interactive_authority_check_authorization_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (object),
+                                                                                  call->caller,
+                                                                                  call->subject,
+                                                                                  call->user_for_subject,
+                                                                                  call->subject_is_local,
+                                                                                  call->subject_is_active,
+                                                                                  call->action_id,
+                                                                                  call->details,
+                                                                                  call->implicit,
+                                                                                  call->subject_info);
+}
+
+/**
+ * polkit_backend_interactive_authority_check_authorization_async:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @caller: The subject that is inquiring whether @subject is authorized.
+ * @subject: The subject we are checking an authorization for.
+ * @user_for_subject: The user of the subject we are checking an authorization for.
+ * @subject_is_local: %TRUE if the session for @subject is local.
+ * @subject_is_active: %TRUE if the session for @subject is active.
+ * @action_id: The action we are checking an authorization for.
+ * @details: Details about the action.
+ * @implicit: A #PolkitImplicitAuthorization value computed from the policy file and @subject.
+ * @subject_info: (allow-none): Facts about @subject already resolved for this request, or %NULL.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the check is done.
+ * @user_data: The data to pass to @callback.
+ *
+ * Like polkit_backend_interactive_authority_check_authorization_sync()
+ * but without blocking, for subclasses that have to ask other services
+ * about checks.
+ *
+ * The default implementation runs
+ * polkit_backend_interactive_authority_check_authorization_sync() in a
+ * thread. Subclasses implementing this method have CheckAuthorization()
+ * requests evaluated from the main loop, one action at a time, rather
+ * than in a worker thread; only the facts about the subject are still
+ * looked up there.
+ *
+ * When done, @callback is invoked in the thread-default main loop of
+ * the thread you are calling this from. You can then call
+ * polkit_backend_interactive_authority_check_authorization_async_finish().
+ */
+void
+polkit_backend_interactive_authority_check_authorization_async (PolkitBackendInteractiveAuthority *authority,
+                                                                PolkitSubject                     *caller,
+                                                                PolkitSubject                     *subject,
+                                                                PolkitIdentity                    *user_for_subject,
+                                                                gboolean                           subject_is_local,
+                                                                gboolean                           subject_is_active,
+                                                                const gchar                       *action_id,
+                                                                PolkitDetails                     *details,
+                                                                PolkitImplicitAuthorization        implicit,
+                                                                PolkitBackendSubjectInfo          *subject_info,
+                                                                GCancellable                      *cancellable,
+                                                                GAsyncReadyCallback                callback,
+                                                                gpointer                           user_data)
+{
+  PolkitBackendInteractiveAuthorityClass *klass;
+  GSimpleAsyncResult *simple;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+
+  klass = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority);
+
+  if (klass->check_authorization_async != NULL)
+    {
+      klass->check_authorization_async (authority,
+                                        caller,
+                                        subject,
+                                        user_for_subject,
+                                        subject_is_local,
+                                        subject_is_active,
+                                        action_id,
+                                        details,
+                                        implicit,
+                                        subject_info,
+                                        cancellable,
+                                        callback,
+                                        user_data);
+      return;
     }
 
-  return ret;
+  simple = g_simple_async_result_new (G_OBJECT (authority),
+                                      callback,
+                                      user_data,
+                                      polkit_backend_interactive_authority_check_authorization_async);
+  g_simple_async_result_set_op_res_gpointer (simple,
+                                             subclass_call_new (caller,
+                                                                subject,
+                                                                user_for_subject,
+                                                                subject_is_local,
+                                                                subject_is_active,
+                                                                action_id,
+                                                                details,
+                                                                implicit,
+                                                                subject_info),
+                                             (GDestroyNotify) subclass_call_free);
+  g_simple_async_result_run_in_thread (simple,
+                                       check_authorization_sync_thread_func,
+                                       G_PRIORITY_DEFAULT,
+                                       cancellable);
+  g_object_unref (simple);
+}
+
+/**
+ * polkit_backend_interactive_authority_check_authorization_async_finish:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @res: A #GAsyncResult obtained from the #GAsyncReadyCallback passed to polkit_backend_interactive_authority_check_authorization_async().
+ *
+ * Finishes checking for an authorization.
+ *
+ * Returns: A #PolkitImplicitAuthorization that specifies if the subject is authorized or whether
+ *     authentication is required.
+ */
+PolkitImplicitAuthorization
+polkit_backend_interactive_authority_check_authorization_async_finish (PolkitBackendInteractiveAuthority *authority,
+                                                                       GAsyncResult                      *res)
+{
+  PolkitBackendInteractiveAuthorityClass *klass;
+  SubclassCall *call;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority), POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+
+  klass = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority);
+
+  if (klass->check_authorization_async != NULL)
+    return klass->check_authorization_async_finish (authority, res);
+
+  g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res), POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+  g_warn_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) == polkit_backend_interactive_authority_check_authorization_async);
+
+  call = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
+  return call->implicit;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1408,6 +3846,8 @@ struct AuthenticationSession
 {
   AuthenticationAgent         *agent;
 
+  PolkitSubject               *scope;
+
   gchar                       *cookie;
 
   PolkitSubject               *subject;
@@ -1440,6 +3880,10 @@ struct AuthenticationSession
   GCancellable                *cancellable;
 
   gulong                       cancellable_signal_handler_id;
+
+  /* for the metrics, when BeginAuthentication was sent and answered */
+  gint64                       begun;
+  gint64                       responded;
 };
 
 static void
@@ -1497,6 +3941,7 @@ authentication_agent_generate_cookie (AuthenticationAgent *agent)
 
 static AuthenticationSession *
 authentication_session_new (AuthenticationAgent         *agent,
+                            PolkitSubject               *scope,
                             PolkitSubject               *subject,
                             PolkitIdentity              *user_of_subject,
                             PolkitSubject               *caller,
@@ -1510,10 +3955,14 @@ authentication_session_new (AuthenticationAgent         *agent,
                             AuthenticationAgentCallback  callback,
                             gpointer                     user_data)
 {
+  PolkitBackendInteractiveAuthorityPrivate *priv;
   AuthenticationSession *session;
 
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
   session = g_new0 (AuthenticationSession, 1);
   session->agent = authentication_agent_ref (agent);
+  session->scope = g_object_ref (scope);
   session->cookie = authentication_agent_generate_cookie (agent);
   session->subject = g_object_ref (subject);
   session->user_of_subject = g_object_ref (user_of_subject);
@@ -1537,13 +3986,39 @@ authentication_session_new (AuthenticationAgent         *agent,
                                                                  session);
     }
 
+  /* cookies start with the agent serial, so they only repeat if the
+   * per-agent session serial wraps around
+   */
+  g_hash_table_insert (priv->hash_cookie_to_authentication_session, session->cookie, session);
+  name_index_add (priv->hash_initiator_to_authentication_sessions,
+                  session->initiated_by_system_bus_unique_name,
+                  session);
+  if (POLKIT_IS_SYSTEM_BUS_NAME (session->subject))
+    name_index_add (priv->hash_subject_name_to_authentication_sessions,
+                    polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (session->subject)),
+                    session);
+
   return session;
 }
 
 static void
 authentication_session_free (AuthenticationSession *session)
 {
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (session->authority);
+  if (g_hash_table_lookup (priv->hash_cookie_to_authentication_session, session->cookie) == session)
+    g_hash_table_remove (priv->hash_cookie_to_authentication_session, session->cookie);
+  name_index_remove (priv->hash_initiator_to_authentication_sessions,
+                     session->initiated_by_system_bus_unique_name,
+                     session);
+  if (POLKIT_IS_SYSTEM_BUS_NAME (session->subject))
+    name_index_remove (priv->hash_subject_name_to_authentication_sessions,
+                       polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (session->subject)),
+                       session);
+
   authentication_agent_unref (session->agent);
+  g_object_unref (session->scope);
   g_free (session->cookie);
   g_list_foreach (session->identities, (GFunc) g_object_unref, NULL);
   g_list_free (session->identities);
@@ -1563,14 +4038,57 @@ authentication_session_free (AuthenticationSession *session)
   g_free (session);
 }
 
+/* Returns which of the subjects @agent was registered for @subject_info
+ * got it through, one of the subject, its process or its session */
 static PolkitSubject *
-authentication_agent_get_scope (AuthenticationAgent *agent)
+authentication_agent_get_scope_for_subject (PolkitBackendInteractiveAuthority *authority,
+                                            AuthenticationAgent               *agent,
+                                            PolkitBackendSubjectInfo          *subject_info)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitSubject *candidates[3];
+  guint n;
+
+  if (agent->scopes->len == 1)
+    return g_ptr_array_index (agent->scopes, 0);
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  candidates[0] = polkit_backend_subject_info_get_subject (subject_info);
+  candidates[1] = polkit_backend_subject_info_get_process (subject_info);
+  candidates[2] = polkit_backend_subject_info_get_session (subject_info);
+  for (n = 0; n < G_N_ELEMENTS (candidates); n++)
+    {
+      if (candidates[n] != NULL &&
+          g_hash_table_lookup (priv->hash_scope_to_authentication_agent, candidates[n]) == agent)
+        return candidates[n];
+    }
+
+  /* not reached, the agent was found through one of them */
+  return g_ptr_array_index (agent->scopes, 0);
+}
+
+/* Returns a description of the subjects @agent is registered for, free with g_free() */
+static gchar *
+authentication_agent_scopes_to_string (AuthenticationAgent *agent)
 {
-  return agent->scope;
+  gchar *first;
+  gchar *ret;
+
+  first = polkit_subject_to_string (g_ptr_array_index (agent->scopes, 0));
+  if (agent->scopes->len == 1)
+    return first;
+
+  ret = g_strdup_printf ("%s and %u more", first, agent->scopes->len - 1);
+  g_free (first);
+  return ret;
 }
 
+/* Cancels the active sessions of @agent started through @scope, or all of
+ * them if @scope is %NULL */
 static void
-authentication_agent_cancel_all_sessions (AuthenticationAgent *agent)
+authentication_agent_cancel_sessions (AuthenticationAgent *agent,
+                                      PolkitSubject       *scope)
 {
   /* cancel all active authentication sessions; use a copy of the list since
    * callbacks will modify the list
@@ -1584,12 +4102,19 @@ authentication_agent_cancel_all_sessions (AuthenticationAgent *agent)
       for (l = active_sessions; l != NULL; l = l->next)
         {
           AuthenticationSession *session = l->data;
-          authentication_session_cancel (session);
+          if (scope == NULL || polkit_subject_equal (session->scope, scope))
+            authentication_session_cancel (session);
         }
       g_list_free (active_sessions);
     }
 }
 
+static void
+authentication_agent_cancel_all_sessions (AuthenticationAgent *agent)
+{
+  authentication_agent_cancel_sessions (agent, NULL);
+}
+
 static AuthenticationAgent *
 authentication_agent_ref (AuthenticationAgent *agent)
 {
@@ -1602,9 +4127,8 @@ authentication_agent_unref (AuthenticationAgent *agent)
 {
   if (g_atomic_int_dec_and_test (&agent->ref_count))
     {
-      if (agent->proxy != NULL)
-        g_object_unref (agent->proxy);
-      g_object_unref (agent->scope);
+      g_object_unref (agent->connection);
+      g_ptr_array_unref (agent->scopes);
       g_free (agent->locale);
       g_free (agent->object_path);
       g_free (agent->unique_system_bus_name);
@@ -1618,6 +4142,7 @@ authentication_agent_unref (AuthenticationAgent *agent)
 
 static AuthenticationAgent *
 authentication_agent_new (guint64      serial,
+                          GDBusConnection *connection,
                           PolkitSubject *scope,
                           PolkitIdentity *creator,
                           const gchar *unique_system_bus_name,
@@ -1627,7 +4152,6 @@ authentication_agent_new (guint64      serial,
                           GError     **error)
 {
   AuthenticationAgent *agent;
-  GDBusProxy *proxy;
   PolkitUnixUser *creator_user;
 
   g_assert (POLKIT_IS_UNIX_USER (creator));
@@ -1640,31 +4164,24 @@ authentication_agent_new (guint64      serial,
       return NULL;
     }
 
-  proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-                                         G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
-                                         G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
-                                         NULL, /* GDBusInterfaceInfo* */
-                                         unique_system_bus_name,
-                                         object_path,
-                                         "org.freedesktop.PolicyKit1.AuthenticationAgent",
-                                         NULL, /* GCancellable* */
-                                         error);
-  if (proxy == NULL)
+  if (connection == NULL)
     {
-      g_prefix_error (error, "Failed to construct proxy for agent: " );
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Not connected to the system bus");
       return NULL;
     }
 
   agent = g_new0 (AuthenticationAgent, 1);
   agent->ref_count = 1;
   agent->serial = serial;
-  agent->scope = g_object_ref (scope);
+  agent->scopes = g_ptr_array_new_with_free_func (g_object_unref);
+  g_ptr_array_add (agent->scopes, g_object_ref (scope));
   agent->creator_uid = (uid_t)polkit_unix_user_get_uid (creator_user);
   agent->object_path = g_strdup (object_path);
   agent->unique_system_bus_name = g_strdup (unique_system_bus_name);
   agent->locale = g_strdup (locale);
   agent->registration_options = registration_options != NULL ? g_variant_ref (registration_options) : NULL;
-  agent->proxy = proxy;
+  agent->connection = g_object_ref (connection);
 
   {
     GString *cookie_prefix = g_string_new ("");
@@ -1689,10 +4206,11 @@ authentication_agent_new (guint64      serial,
 }
 
 static AuthenticationAgent *
-get_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authority,
-                                      PolkitSubject *subject)
+resolve_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authority,
+                                          PolkitBackendSubjectInfo *subject_info)
 {
   PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitSubject *subject;
   PolkitSubject *session_for_subject = NULL;
   AuthenticationAgent *agent = NULL;
   AuthenticationAgent *agent_fallback = NULL;
@@ -1700,19 +4218,15 @@ get_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authori
 
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
+  subject = polkit_backend_subject_info_get_subject (subject_info);
   agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, subject);
 
   if (agent == NULL && POLKIT_IS_SYSTEM_BUS_NAME (subject))
     {
       PolkitSubject *process;
-      process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject),
-                                                         NULL,
-                                                         NULL);
+      process = polkit_backend_subject_info_get_process (subject_info);
       if (process != NULL)
-        {
-          agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, process);
-          g_object_unref (process);
-        }
+        agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, process);
     }
 
   if (agent != NULL)
@@ -1738,9 +4252,7 @@ get_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authori
    * and UnixSession subjects!
    */
 
-  session_for_subject = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
-                                                                                subject,
-                                                                                NULL);
+  session_for_subject = polkit_backend_subject_info_get_session (subject_info);
   if (session_for_subject == NULL)
     goto out;
 
@@ -1751,8 +4263,33 @@ get_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authori
     agent = agent_fallback;
 
  out:
-  if (session_for_subject != NULL)
-    g_object_unref (session_for_subject);
+  return agent;
+}
+
+static AuthenticationAgent *
+get_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authority,
+                                      PolkitBackendSubjectInfo *subject_info)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitSubject *subject;
+  const gchar *name;
+  AuthenticationAgent *agent;
+  gpointer cached;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  subject = polkit_backend_subject_info_get_subject (subject_info);
+  if (!POLKIT_IS_SYSTEM_BUS_NAME (subject))
+    return resolve_authentication_agent_for_subject (authority, subject_info);
+
+  /* a unique name keeps its process, and so its session, until it goes
+   * away, so the agent for it only changes along with the agents */
+  name = polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (subject));
+  if (g_hash_table_lookup_extended (priv->hash_name_to_resolved_agent, name, NULL, &cached))
+    return cached;
+
+  agent = resolve_authentication_agent_for_subject (authority, subject_info);
+  g_hash_table_insert (priv->hash_name_to_resolved_agent, g_strdup (name), agent);
 
   return agent;
 }
@@ -1763,48 +4300,29 @@ get_authentication_session_for_uid_and_cookie (PolkitBackendInteractiveAuthority
                                                const gchar                       *cookie)
 {
   PolkitBackendInteractiveAuthorityPrivate *priv;
-  GHashTableIter hash_iter;
-  AuthenticationAgent *agent;
   AuthenticationSession *result;
 
-  result = NULL;
-
-  /* TODO: perhaps use a hash on the cookie to speed this up */
-
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
-  g_hash_table_iter_init (&hash_iter, priv->hash_scope_to_authentication_agent);
-  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &agent))
-    {
-      GList *l;
-
-      /* We need to ensure that if somehow we have duplicate cookies
-       * due to wrapping, that the cookie used is matched to the user
-       * who called AuthenticationAgentResponse2.  See
-       * http://lists.freedesktop.org/archives/polkit-devel/2015-June/000425.html
-       * 
-       * Except if the legacy AuthenticationAgentResponse is invoked,
-       * we don't know the uid and hence use -1.  Continue to support
-       * the old behavior for backwards compatibility, although everyone
-       * who is using our own setuid helper will automatically be updated
-       * to the new API.
-       */
-      if (uid != (uid_t)-1)
-        {
-          if (agent->creator_uid != uid)
-            continue;
-        }
-
-      for (l = agent->active_sessions; l != NULL; l = l->next)
-        {
-          AuthenticationSession *session = l->data;
+  result = g_hash_table_lookup (priv->hash_cookie_to_authentication_session, cookie);
+  if (result == NULL)
+    goto out;
 
-          if (strcmp (session->cookie, cookie) == 0)
-            {
-              result = session;
-              goto out;
-            }
-        }
+  /* We need to ensure that if somehow we have duplicate cookies
+   * due to wrapping, that the cookie used is matched to the user
+   * who called AuthenticationAgentResponse2.  See
+   * http://lists.freedesktop.org/archives/polkit-devel/2015-June/000425.html
+   *
+   * Except if the legacy AuthenticationAgentResponse is invoked,
+   * we don't know the uid and hence use -1.  Continue to support
+   * the old behavior for backwards compatibility, although everyone
+   * who is using our own setuid helper will automatically be updated
+   * to the new API.
+   */
+  if (uid != (uid_t)-1)
+    {
+      if (result->agent->creator_uid != uid)
+        result = NULL;
     }
 
  out:
@@ -1816,33 +4334,12 @@ get_authentication_sessions_initiated_by_system_bus_unique_name (PolkitBackendIn
                                                                  const gchar *system_bus_unique_name)
 {
   PolkitBackendInteractiveAuthorityPrivate *priv;
-  GHashTableIter hash_iter;
-  AuthenticationAgent *agent;
-  GList *result;
-
-  result = NULL;
-
-  /* TODO: perhaps use a hash on the cookie to speed this up */
 
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
-  g_hash_table_iter_init (&hash_iter, priv->hash_scope_to_authentication_agent);
-  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &agent))
-    {
-      GList *l;
-
-      for (l = agent->active_sessions; l != NULL; l = l->next)
-        {
-          AuthenticationSession *session = l->data;
-
-          if (strcmp (session->initiated_by_system_bus_unique_name, system_bus_unique_name) == 0)
-            {
-              result = g_list_prepend (result, session);
-            }
-        }
-    }
-
-   return result;
+  /* copy, cancelling the sessions modifies the index */
+  return g_list_copy (name_index_lookup (priv->hash_initiator_to_authentication_sessions,
+                                         system_bus_unique_name));
 }
 
 static GList *
@@ -1850,65 +4347,125 @@ get_authentication_sessions_for_system_bus_unique_name_subject (PolkitBackendInt
                                                                 const gchar *system_bus_unique_name)
 {
   PolkitBackendInteractiveAuthorityPrivate *priv;
-  GHashTableIter hash_iter;
-  AuthenticationAgent *agent;
-  GList *result;
 
-  result = NULL;
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  /* copy, cancelling the sessions modifies the index */
+  return g_list_copy (name_index_lookup (priv->hash_subject_name_to_authentication_sessions,
+                                         system_bus_unique_name));
+}
+
 
-  /* TODO: perhaps use a hash on the cookie to speed this up */
+static AuthenticationAgent *
+get_authentication_agent_by_unique_system_bus_name (PolkitBackendInteractiveAuthority *authority,
+                                                    const gchar *unique_system_bus_name)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GList *agents;
 
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
-  g_hash_table_iter_init (&hash_iter, priv->hash_scope_to_authentication_agent);
-  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &agent))
-    {
-      GList *l;
+  agents = name_index_lookup (priv->hash_name_to_authentication_agents, unique_system_bus_name);
+  return agents != NULL ? agents->data : NULL;
+}
 
-      for (l = agent->active_sessions; l != NULL; l = l->next)
-        {
-          AuthenticationSession *session = l->data;
+/* Registers @agent with @authority, which takes over the reference */
+static void
+add_authentication_agent (PolkitBackendInteractiveAuthority *authority,
+                          AuthenticationAgent               *agent)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  guint n;
 
-          if (POLKIT_IS_SYSTEM_BUS_NAME (session->subject) &&
-              strcmp (polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (session->subject)),
-                      system_bus_unique_name) == 0)
-            {
-              result = g_list_prepend (result, session);
-            }
-        }
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  for (n = 0; n < agent->scopes->len; n++)
+    {
+      /* the first scope takes over the reference of the caller */
+      g_hash_table_insert (priv->hash_scope_to_authentication_agent,
+                           g_object_ref (g_ptr_array_index (agent->scopes, n)),
+                           n == 0 ? agent : authentication_agent_ref (agent));
     }
+  g_hash_table_remove_all (priv->hash_name_to_resolved_agent);
+  name_index_add (priv->hash_name_to_authentication_agents,
+                  agent->unique_system_bus_name,
+                  agent);
+}
+
+/* Registers the already registered @agent for @scope too */
+static void
+add_authentication_agent_scope (PolkitBackendInteractiveAuthority *authority,
+                                AuthenticationAgent               *agent,
+                                PolkitSubject                     *scope)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
 
-   return result;
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  g_ptr_array_add (agent->scopes, g_object_ref (scope));
+  g_hash_table_insert (priv->hash_scope_to_authentication_agent,
+                       g_object_ref (scope),
+                       authentication_agent_ref (agent));
+  g_hash_table_remove_all (priv->hash_name_to_resolved_agent);
 }
 
+/* Unregisters @agent from @authority, this may free @agent */
+static void
+remove_authentication_agent (PolkitBackendInteractiveAuthority *authority,
+                             AuthenticationAgent               *agent)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  guint n;
 
-static AuthenticationAgent *
-get_authentication_agent_by_unique_system_bus_name (PolkitBackendInteractiveAuthority *authority,
-                                                    const gchar *unique_system_bus_name)
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  name_index_remove (priv->hash_name_to_authentication_agents,
+                     agent->unique_system_bus_name,
+                     agent);
+  g_hash_table_remove_all (priv->hash_name_to_resolved_agent);
+  /* this works because we have exactly one agent per session; the last
+   * scope removed drops the last reference */
+  authentication_agent_ref (agent);
+  for (n = 0; n < agent->scopes->len; n++)
+    g_hash_table_remove (priv->hash_scope_to_authentication_agent, g_ptr_array_index (agent->scopes, n));
+  authentication_agent_unref (agent);
+}
+
+/* Unregisters @agent from @authority for @scope only, or altogether if
+ * that was the last subject it was registered for; this may free @agent */
+static void
+remove_authentication_agent_scope (PolkitBackendInteractiveAuthority *authority,
+                                   AuthenticationAgent               *agent,
+                                   PolkitSubject                     *scope)
 {
   PolkitBackendInteractiveAuthorityPrivate *priv;
-  GHashTableIter hash_iter;
-  AuthenticationAgent *agent;
+  guint n;
 
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
-  g_hash_table_iter_init (&hash_iter, priv->hash_scope_to_authentication_agent);
-  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &agent))
+  if (agent->scopes->len == 1)
     {
-      if (strcmp (agent->unique_system_bus_name, unique_system_bus_name) == 0)
-        goto out;
+      remove_authentication_agent (authority, agent);
+      return;
     }
 
-  agent = NULL;
+  for (n = 0; n < agent->scopes->len; n++)
+    {
+      if (polkit_subject_equal (g_ptr_array_index (agent->scopes, n), scope))
+        break;
+    }
+  g_assert (n < agent->scopes->len);
 
-  out:
-  return agent;
+  g_hash_table_remove_all (priv->hash_name_to_resolved_agent);
+  /* drops the reference of the scope, but never the last one */
+  g_hash_table_remove (priv->hash_scope_to_authentication_agent, scope);
+  g_ptr_array_remove_index (agent->scopes, n);
 }
 
 static void
-authentication_agent_begin_cb (GDBusProxy   *proxy,
-                               GAsyncResult *res,
-                               gpointer      user_data)
+authentication_agent_begin_cb (GDBusConnection *connection,
+                               GAsyncResult    *res,
+                               gpointer         user_data)
 {
   AuthenticationSession *session = user_data;
   gboolean gained_authorization;
@@ -1920,7 +4477,7 @@ authentication_agent_begin_cb (GDBusProxy   *proxy,
   gained_authorization = FALSE;
 
   error = NULL;
-  result = g_dbus_proxy_call_finish (proxy, res, &error);
+  result = g_dbus_connection_call_finish (connection, res, &error);
   if (result == NULL)
     {
       g_printerr ("Error performing authentication: %s (%s %d)\n",
@@ -1939,6 +4496,14 @@ authentication_agent_begin_cb (GDBusProxy   *proxy,
     }
 
   session->agent->active_sessions = g_list_remove (session->agent->active_sessions, session);
+  if (session->responded == 0)
+    metrics_add_latency (POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (session->authority),
+                         POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_AGENT,
+                         session->begun);
+  POLKIT_BACKEND_PROBE3 (agent__begin__authentication__return,
+                         session->action_id,
+                         gained_authorization,
+                         was_dismissed);
 
   session->callback (session->agent,
                      session->subject,
@@ -1952,52 +4517,61 @@ authentication_agent_begin_cb (GDBusProxy   *proxy,
                      was_dismissed,
                      session->authenticated_identity,
                      session->user_data);
+  metrics_add_latency (POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (session->authority),
+                       POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_COMPLETE,
+                       session->responded);
 
   authentication_session_free (session);
 }
 
+/* A message with $(property) references, split up once into the text
+ * around them and the names of the properties
+ */
+typedef struct
+{
+  gboolean is_property;
+  gchar *text;
+} MessageSegment;
+
+typedef struct
+{
+  gchar *message;
+  MessageSegment *segments;
+  guint n_segments;
+  gsize text_len; /* of all the text put together */
+} MessageTemplate;
+
 static void
-append_property (GString *dest,
-                 PolkitDetails *details,
-                 const gchar *key,
-                 PolkitBackendInteractiveAuthority *authority,
-                 const gchar *message,
-                 const gchar *action_id)
+message_template_add_segment (GArray   *segments,
+                              gboolean  is_property,
+                              GString  *text)
 {
-  const gchar *value;
+  MessageSegment segment;
 
-  value = polkit_details_lookup (details, key);
-  if (value != NULL)
-    {
-      g_string_append (dest, value);
-    }
-  else
-    {
-      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                    "Error substituting value for property $(%s) when preparing message `%s' for action-id %s",
-                                    key,
-                                    message,
-                                    action_id);
-      g_string_append (dest, "$(");
-      g_string_append (dest, key);
-      g_string_append (dest, ")");
-    }
+  segment.is_property = is_property;
+  segment.text = g_strndup (text->str, text->len);
+  g_array_append_val (segments, segment);
+  g_string_set_size (text, 0);
 }
 
-static gchar *
-expand_properties (const gchar *message,
-                   PolkitDetails *details,
-                   PolkitBackendInteractiveAuthority *authority,
-                   const gchar *action_id)
+static MessageTemplate *
+message_template_new (const gchar *message)
 {
-  GString *ret;
+  MessageTemplate *template;
+  GArray *segments;
+  GString *text;
   GString *var;
   guint n;
   gboolean in_resolve;
 
-  ret = g_string_new (NULL);
+  template = g_new0 (MessageTemplate, 1);
+  template->message = g_strdup (message);
+
+  segments = g_array_new (FALSE, FALSE, sizeof (MessageSegment));
+  text = g_string_new (NULL);
   var = g_string_new (NULL);
 
+  /* an unterminated $( swallows the rest of the message */
   in_resolve = FALSE;
   for (n = 0; message[n] != '\0'; n++)
     {
@@ -2013,8 +4587,12 @@ expand_properties (const gchar *message,
             {
               if (c == ')')
                 {
-                  append_property (ret, details, var->str, authority, message, action_id);
-                  g_string_set_size (var, 0);
+                  if (text->len > 0)
+                    {
+                      template->text_len += text->len;
+                      message_template_add_segment (segments, FALSE, text);
+                    }
+                  message_template_add_segment (segments, TRUE, var);
                   in_resolve = FALSE;
                 }
               else
@@ -2024,15 +4602,144 @@ expand_properties (const gchar *message,
             }
           else
             {
-              g_string_append_c (ret, c);
+              g_string_append_c (text, c);
             }
         }
     }
+  if (text->len > 0)
+    {
+      template->text_len += text->len;
+      message_template_add_segment (segments, FALSE, text);
+    }
   g_string_free (var, TRUE);
+  g_string_free (text, TRUE);
+
+  template->n_segments = segments->len;
+  template->segments = (MessageSegment *) g_array_free (segments, FALSE);
+
+  return template;
+}
+
+static void
+message_template_free (MessageTemplate *template)
+{
+  guint n;
+
+  for (n = 0; n < template->n_segments; n++)
+    g_free (template->segments[n].text);
+  g_free (template->segments);
+  g_free (template->message);
+  g_free (template);
+}
+
+/* Puts the message together, with $(property) replaced by its value in @details */
+static gchar *
+message_template_expand (MessageTemplate                   *template,
+                         PolkitDetails                     *details,
+                         PolkitBackendInteractiveAuthority *authority,
+                         const gchar                       *action_id)
+{
+  GString *ret;
+  guint n;
+
+  ret = g_string_sized_new (template->text_len + 1);
+  for (n = 0; n < template->n_segments; n++)
+    {
+      MessageSegment *segment = &template->segments[n];
+      const gchar *value;
+
+      if (!segment->is_property)
+        {
+          g_string_append (ret, segment->text);
+          continue;
+        }
+
+      value = polkit_details_lookup (details, segment->text);
+      if (value != NULL)
+        {
+          g_string_append (ret, value);
+        }
+      else
+        {
+          polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                        "Error substituting value for property $(%s) when preparing message `%s' for action-id %s",
+                                        segment->text,
+                                        template->message,
+                                        action_id);
+          g_string_append (ret, "$(");
+          g_string_append (ret, segment->text);
+          g_string_append (ret, ")");
+        }
+    }
 
   return g_string_free (ret, FALSE);
 }
 
+/* What a challenge shows for an action in a given locale, unless the
+ * caller overrides it through details
+ */
+struct LocalizedChallengeData
+{
+  MessageTemplate *message; /* NULL if the action has no message */
+  gchar *icon_name;
+};
+
+static void
+localized_challenge_data_free (LocalizedChallengeData *data)
+{
+  if (data->message != NULL)
+    message_template_free (data->message);
+  g_free (data->icon_name);
+  g_free (data);
+}
+
+/* Looks up, and remembers, what the pool has for @action_id in @locale */
+static LocalizedChallengeData *
+lookup_localized_challenge_data (PolkitBackendInteractiveAuthority *authority,
+                                 const gchar                       *action_id,
+                                 const gchar                       *locale)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  LocalizedChallengeData *data;
+  PolkitActionDescription *action_desc;
+  const gchar *message;
+  gchar *key;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  key = g_strconcat (action_id, "\n", locale, NULL);
+  data = g_hash_table_lookup (priv->hash_key_to_localized_challenge_data, key);
+  if (data != NULL)
+    {
+      g_free (key);
+      return data;
+    }
+
+  action_desc = polkit_backend_action_pool_get_action (priv->action_pool,
+                                                       action_id,
+                                                       locale);
+  if (action_desc == NULL)
+    {
+      g_free (key);
+      return NULL;
+    }
+
+  /* agents only ever use a handful of locales, but don't let it grow without end */
+  if (g_hash_table_size (priv->hash_key_to_localized_challenge_data) >= LOCALIZED_CHALLENGE_DATA_CACHE_SIZE)
+    g_hash_table_remove_all (priv->hash_key_to_localized_challenge_data);
+
+  data = g_new0 (LocalizedChallengeData, 1);
+  message = polkit_action_description_get_message (action_desc);
+  if (message != NULL)
+    data->message = message_template_new (message);
+  data->icon_name = g_strdup (polkit_action_description_get_icon_name (action_desc));
+  g_hash_table_insert (priv->hash_key_to_localized_challenge_data, key, data);
+
+  g_object_unref (action_desc);
+
+  return data;
+}
+
 static void
 get_localized_data_for_challenge (PolkitBackendInteractiveAuthority *authority,
                                   PolkitSubject               *caller,
@@ -2045,70 +4752,58 @@ get_localized_data_for_challenge (PolkitBackendInteractiveAuthority *authority,
                                   gchar                      **out_localized_icon_name,
                                   PolkitDetails              **out_localized_details)
 {
-  PolkitBackendInteractiveAuthorityPrivate *priv;
-  PolkitActionDescription *action_desc;
+  LocalizedChallengeData *data;
+  MessageTemplate *template;
   gchar *message;
   gchar *icon_name;
   PolkitDetails *localized_details;
   const gchar *message_to_use;
   const gchar *gettext_domain;
-  gchar *s;
-
-  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
   message = NULL;
   icon_name = NULL;
   localized_details = NULL;
-  action_desc = NULL;
 
   *out_localized_message = NULL;
-  *out_localized_icon_name = NULL;
-  *out_localized_details = NULL;
-
-  action_desc = polkit_backend_action_pool_get_action (priv->action_pool,
-                                                       action_id,
-                                                       locale);
-  if (action_desc == NULL)
-    goto out;
+  *out_localized_icon_name = NULL;
+  *out_localized_details = NULL;
 
-  /* Set LANG and locale so g_dgettext() + friends work below */
-  if (setlocale (LC_ALL, locale) == NULL)
-    {
-      g_printerr ("Invalid locale '%s'\n", locale);
-    }
-  g_setenv ("LANG", locale, TRUE);
+  data = lookup_localized_challenge_data (authority, action_id, locale);
+  if (data == NULL)
+    goto out;
 
   gettext_domain = polkit_details_lookup (details, "polkit.gettext_domain");
   message_to_use = polkit_details_lookup (details, "polkit.message");
   if (message_to_use != NULL)
     {
-      message = g_strdup (g_dgettext (gettext_domain, message_to_use));
-      /* g_print ("locale=%s, domain=%s, msg=`%s' -> `%s'\n", locale, gettext_domain, message_to_use, message); */
+      /* Set LANG and locale so g_dgettext() + friends work */
+      if (setlocale (LC_ALL, locale) == NULL)
+        {
+          g_printerr ("Invalid locale '%s'\n", locale);
+        }
+      g_setenv ("LANG", locale, TRUE);
+
+      /* messages from callers are used once, so they aren't worth remembering */
+      template = message_template_new (g_dgettext (gettext_domain, message_to_use));
+      message = message_template_expand (template, details, authority, action_id);
+      message_template_free (template);
+
+      /* Back to C! */
+      setlocale (LC_ALL, "C");
+      g_setenv ("LANG", "C", TRUE);
     }
   icon_name = g_strdup (polkit_details_lookup (details, "polkit.icon_name"));
 
   /* fall back to action description */
-  if (message == NULL)
+  if (message == NULL && data->message != NULL)
     {
-      message = g_strdup (polkit_action_description_get_message (action_desc));
+      message = message_template_expand (data->message, details, authority, action_id);
     }
   if (icon_name == NULL)
     {
-      icon_name = g_strdup (polkit_action_description_get_icon_name (action_desc));
-    }
-
-  /* replace $(property) with values */
-  if (message != NULL)
-    {
-      s = message;
-      message = expand_properties (message, details, authority, action_id);
-      g_free (s);
+      icon_name = g_strdup (data->icon_name);
     }
 
-  /* Back to C! */
-  setlocale (LC_ALL, "C");
-  g_setenv ("LANG", "C", TRUE);
-
  out:
   if (message == NULL)
     message = g_strdup ("");
@@ -2117,14 +4812,13 @@ get_localized_data_for_challenge (PolkitBackendInteractiveAuthority *authority,
   *out_localized_message = message;
   *out_localized_icon_name = icon_name;
   *out_localized_details = localized_details;
-  if (action_desc != NULL)
-    g_object_unref (action_desc);
 }
 
 static void
-add_pid (PolkitDetails *details,
-         PolkitSubject *subject,
-         const gchar   *key)
+add_pid (PolkitBackendSessionMonitor *monitor,
+         PolkitDetails               *details,
+         PolkitSubject               *subject,
+         const gchar                 *key)
 {
   gchar buf[32];
   gint pid;
@@ -2139,9 +4833,9 @@ add_pid (PolkitDetails *details,
       GError *error;
 
       error = NULL;
-      process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject),
-                                                         NULL,
-                                                         &error);
+      process = polkit_backend_session_monitor_get_process_for_bus_name (monitor,
+                                                                         POLKIT_SYSTEM_BUS_NAME (subject),
+                                                                         &error);
       if (process == NULL)
         {
           g_printerr ("Error getting process for system bus name `%s': %s\n",
@@ -2180,136 +4874,126 @@ add_pid (PolkitDetails *details,
 /* ---------------------------------------------------------------------------------------------------- */
 
 static GList *
-get_users_in_group (PolkitIdentity                    *group,
-                    gboolean                           include_root)
+get_users_for_members (PolicyMembersRecord *record,
+                       const gchar         *kind,
+                       gboolean             include_root)
 {
-  gid_t gid;
-  struct group *grp;
   GList *ret;
   guint n;
 
   ret = NULL;
 
-  gid = polkit_unix_group_get_gid (POLKIT_UNIX_GROUP (group));
-  grp = getgrgid (gid);
-  if (grp == NULL)
-    {
-      g_warning ("Error looking up group with gid %d: %s", gid, g_strerror (errno));
-      goto out;
-    }
-
-  for (n = 0; grp->gr_mem != NULL && grp->gr_mem[n] != NULL; n++)
+  for (n = 0; n < record->members->len; n++)
     {
-      PolkitIdentity *user;
-      GError *error;
+      PolicyMember *member = &g_array_index (record->members, PolicyMember, n);
 
-      if (!include_root && g_strcmp0 (grp->gr_mem[n], "root") == 0)
+      if (!include_root && g_strcmp0 (member->name, "root") == 0)
         continue;
 
-      error = NULL;
-      user = polkit_unix_user_new_for_name (grp->gr_mem[n], &error);
-      if (user == NULL)
-        {
-          g_warning ("Unknown username '%s' in group: %s", grp->gr_mem[n], error->message);
-          g_error_free (error);
-        }
+      if (member->uid == -1)
+        g_warning ("Unknown username '%s' in %s", member->name, kind);
       else
-        {
-          ret = g_list_prepend (ret, user);
-        }
+        ret = g_list_prepend (ret, polkit_unix_user_new_shared (member->uid));
     }
 
-  ret = g_list_reverse (ret);
-
- out:
-  return ret;
+  return g_list_reverse (ret);
 }
 
 static GList *
-get_users_in_net_group (PolkitIdentity                    *group,
-                        gboolean                           include_root)
+get_users_in_group (PolkitBackendInteractiveAuthority *authority,
+                    PolkitIdentity                    *group,
+                    gboolean                           include_root)
 {
-  const gchar *name;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolicyMembersRecord *record;
+  gid_t gid;
   GList *ret;
 
-  ret = NULL;
-  name = polkit_unix_netgroup_get_name (POLKIT_UNIX_NETGROUP (group));
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
-#ifdef HAVE_SETNETGRENT_RETURN
-  if (setnetgrent (name) == 0)
+  gid = polkit_unix_group_get_gid (POLKIT_UNIX_GROUP (group));
+  record = policy_identity_cache_lookup_group (priv->identities, gid);
+  if (!record->found)
     {
-      g_warning ("Error looking up net group with name %s: %s", name, g_strerror (errno));
-      goto out;
+      g_warning ("Error looking up group with gid %d", gid);
+      ret = NULL;
     }
-#else
-  setnetgrent (name);
-#endif
-
-  for (;;)
+  else
     {
-#if defined(HAVE_NETBSD) || defined(HAVE_OPENBSD)
-      const char *hostname, *username, *domainname;
-#else
-      char *hostname, *username, *domainname;
-#endif
-      PolkitIdentity *user;
-      GError *error = NULL;
+      ret = get_users_for_members (record, "group", include_root);
+    }
 
-      if (getnetgrent (&hostname, &username, &domainname) == 0)
-        break;
+  policy_members_record_unref (record);
+  return ret;
+}
 
-      /* Skip NULL entries since we never want to make everyone an admin
-       * Skip "-" entries which mean "no match ever" in netgroup land */
-      if (username == NULL || g_strcmp0 (username, "-") == 0)
-        continue;
+static GList *
+get_users_in_net_group (PolkitBackendInteractiveAuthority *authority,
+                        PolkitIdentity                    *group,
+                        gboolean                           include_root)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolicyMembersRecord *record;
+  const gchar *name;
+  GList *ret;
 
-      /* TODO: Should we match on hostname? Maybe only allow "-" as a hostname
-       * for safety. */
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
-      user = polkit_unix_user_new_for_name (username, &error);
-      if (user == NULL)
-        {
-          g_warning ("Unknown username '%s' in unix-netgroup: %s", username, error->message);
-          g_error_free (error);
-        }
-      else
-        {
-          ret = g_list_prepend (ret, user);
-        }
+  /* TODO: Should we match on hostname? Maybe only allow "-" as a hostname
+   * for safety. */
+  name = polkit_unix_netgroup_get_name (POLKIT_UNIX_NETGROUP (group));
+  record = policy_identity_cache_lookup_netgroup (priv->identities, name);
+  if (!record->found)
+    {
+      g_warning ("Error looking up net group with name %s", name);
+      ret = NULL;
+    }
+  else
+    {
+      ret = get_users_for_members (record, "unix-netgroup", include_root);
     }
 
-  ret = g_list_reverse (ret);
-
- out:
-  endnetgrent ();
+  policy_members_record_unref (record);
   return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Asks @agent to authenticate one of @identities, taking ownership of
+ * them, for the challenge started by authentication_agent_initiate_challenge()
+ * at @initiated
+ */
 static void
-authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
-                                         PolkitSubject               *subject,
-                                         PolkitIdentity              *user_of_subject,
-                                         PolkitBackendInteractiveAuthority *authority,
-                                         const gchar                 *action_id,
-                                         PolkitDetails               *details,
-                                         PolkitSubject               *caller,
-                                         PolkitImplicitAuthorization  implicit_authorization,
-                                         GCancellable                *cancellable,
-                                         AuthenticationAgentCallback  callback,
-                                         gpointer                     user_data)
+authentication_agent_begin_challenge (AuthenticationAgent         *agent,
+                                      PolkitBackendSubjectInfo    *subject_info,
+                                      PolkitSubject               *scope,
+                                      PolkitBackendInteractiveAuthority *authority,
+                                      const gchar                 *action_id,
+                                      PolkitDetails               *details,
+                                      PolkitSubject               *caller,
+                                      PolkitImplicitAuthorization  implicit_authorization,
+                                      GList                       *identities,
+                                      gint64                       initiated,
+                                      GCancellable                *cancellable,
+                                      AuthenticationAgentCallback  callback,
+                                      gpointer                     user_data)
 {
-  PolkitBackendInteractiveAuthorityPrivate *priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
   AuthenticationSession *session;
+  PolkitSubject *subject;
+  PolkitIdentity *user_of_subject;
   GList *l;
-  GList *identities;
   gchar *localized_message;
   gchar *localized_icon_name;
   PolkitDetails *localized_details;
   GList *user_identities = NULL;
   GVariantBuilder identities_builder;
   GVariant *parameters;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  subject = polkit_backend_subject_info_get_subject (subject_info);
+  user_of_subject = polkit_backend_subject_info_get_user (subject_info);
 
   get_localized_data_for_challenge (authority,
                                     caller,
@@ -2322,40 +5006,6 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
                                     &localized_icon_name,
                                     &localized_details);
 
-  identities = NULL;
-
-  /* select admin user if required by the implicit authorization */
-  if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED ||
-      implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
-    {
-      gboolean is_local = FALSE;
-      gboolean is_active = FALSE;
-      PolkitSubject *session_for_subject = NULL;
-
-      session_for_subject = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
-                                                                                    subject,
-                                                                                    NULL);
-      if (session_for_subject != NULL)
-        {
-          is_local = polkit_backend_session_monitor_is_session_local (priv->session_monitor, session_for_subject);
-          is_active = polkit_backend_session_monitor_is_session_active (priv->session_monitor, session_for_subject);
-        }
-
-      identities = polkit_backend_interactive_authority_get_admin_identities (authority,
-                                                                              caller,
-                                                                              subject,
-                                                                              user_of_subject,
-                                                                              is_local,
-                                                                              is_active,
-                                                                              action_id,
-                                                                              details);
-      g_clear_object (&session_for_subject);
-    }
-  else
-    {
-      identities = g_list_prepend (identities, g_object_ref (user_of_subject));
-    }
-
   /* expand groups/netgroups to users */
   user_identities = NULL;
   for (l = identities; l != NULL; l = l->next)
@@ -2367,11 +5017,11 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
         }
       else if (POLKIT_IS_UNIX_GROUP (identity))
         {
-          user_identities = g_list_concat (user_identities, get_users_in_group (identity, FALSE));
+          user_identities = g_list_concat (user_identities, get_users_in_group (authority, identity, FALSE));
         }
       else if (POLKIT_IS_UNIX_NETGROUP (identity))
         {
-          user_identities =  g_list_concat (user_identities, get_users_in_net_group (identity, FALSE));
+          user_identities =  g_list_concat (user_identities, get_users_in_net_group (authority, identity, FALSE));
         }
       else
         {
@@ -2381,9 +5031,10 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
 
   /* Fall back to uid 0 if no users are available (rhbz #834494) */
   if (user_identities == NULL)
-    user_identities = g_list_prepend (NULL, polkit_unix_user_new (0));
+    user_identities = g_list_prepend (NULL, polkit_unix_user_new_shared (0));
 
   session = authentication_session_new (agent,
+                                        scope,
                                         subject,
                                         user_of_subject,
                                         caller,
@@ -2401,8 +5052,8 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
 
   if (localized_details == NULL)
     localized_details = polkit_details_new ();
-  add_pid (localized_details, caller, "polkit.caller-pid");
-  add_pid (localized_details, subject, "polkit.subject-pid");
+  add_pid (priv->session_monitor, localized_details, caller, "polkit.caller-pid");
+  add_pid (priv->session_monitor, localized_details, subject, "polkit.subject-pid");
 
   g_variant_builder_init (&identities_builder, G_VARIANT_TYPE ("a(sa{sv})"));
   for (l = user_identities; l != NULL; l = l->next)
@@ -2420,14 +5071,21 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
                               session->cookie,
                               &identities_builder);
 
-  g_dbus_proxy_call (agent->proxy,
-                     "BeginAuthentication",
-                     parameters, /* consumes the floating GVariant */
-                     G_DBUS_CALL_FLAGS_NONE,
-                     G_MAXINT, /* timeout_msec - no timeout */
-                     session->cancellable,
-                     (GAsyncReadyCallback) authentication_agent_begin_cb,
-                     session);
+  POLKIT_BACKEND_PROBE2 (agent__begin__authentication__entry, action_id, session->cookie);
+  g_dbus_connection_call (agent->connection,
+                          agent->unique_system_bus_name,
+                          agent->object_path,
+                          "org.freedesktop.PolicyKit1.AuthenticationAgent",
+                          "BeginAuthentication",
+                          parameters, /* consumes the floating GVariant */
+                          NULL, /* GVariantType* */
+                          G_DBUS_CALL_FLAGS_NONE,
+                          G_MAXINT, /* timeout_msec - no timeout */
+                          session->cancellable,
+                          (GAsyncReadyCallback) authentication_agent_begin_cb,
+                          session);
+  metrics_add_latency (priv, POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_INITIATE, initiated);
+  session->begun = metrics_now (priv);
 
   g_list_free_full (user_identities, g_object_unref);
   g_list_foreach (identities, (GFunc) g_object_unref, NULL);
@@ -2439,16 +5097,155 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
     g_object_unref (localized_details);
 }
 
+/* A challenge waiting for the subclass to pick the administrators */
+typedef struct
+{
+  AuthenticationAgent *agent;
+  PolkitBackendSubjectInfo *subject_info;
+  PolkitSubject *scope;
+  gchar *action_id;
+  PolkitDetails *details;
+  PolkitSubject *caller;
+  PolkitImplicitAuthorization implicit_authorization;
+  gint64 initiated;
+  GCancellable *cancellable;
+  AuthenticationAgentCallback callback;
+  gpointer user_data;
+} InitiateChallengeData;
+
+static void
+initiate_challenge_admin_identities_cb (GObject      *source_object,
+                                        GAsyncResult *res,
+                                        gpointer      user_data)
+{
+  InitiateChallengeData *data = user_data;
+  PolkitBackendInteractiveAuthority *authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (source_object);
+  GList *identities;
+
+  /* if the agent went away or the challenge was cancelled meanwhile,
+   * BeginAuthentication fails and the challenge with it */
+  identities = polkit_backend_interactive_authority_get_admin_identities_async_finish (authority, res);
+  authentication_agent_begin_challenge (data->agent,
+                                        data->subject_info,
+                                        data->scope,
+                                        authority,
+                                        data->action_id,
+                                        data->details,
+                                        data->caller,
+                                        data->implicit_authorization,
+                                        identities,
+                                        data->initiated,
+                                        data->cancellable,
+                                        data->callback,
+                                        data->user_data);
+
+  authentication_agent_unref (data->agent);
+  polkit_backend_subject_info_unref (data->subject_info);
+  g_object_unref (data->scope);
+  g_free (data->action_id);
+  g_object_unref (data->details);
+  g_object_unref (data->caller);
+  g_object_unref (data->cancellable);
+  g_free (data);
+}
+
+static void
+authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
+                                         PolkitBackendSubjectInfo    *subject_info,
+                                         PolkitSubject               *scope,
+                                         PolkitBackendInteractiveAuthority *authority,
+                                         const gchar                 *action_id,
+                                         PolkitDetails               *details,
+                                         PolkitSubject               *caller,
+                                         PolkitImplicitAuthorization  implicit_authorization,
+                                         GCancellable                *cancellable,
+                                         AuthenticationAgentCallback  callback,
+                                         gpointer                     user_data)
+{
+  PolkitSubject *subject;
+  PolkitIdentity *user_of_subject;
+  GList *identities;
+  gint64 initiated;
+
+  initiated = metrics_now (POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority));
+  subject = polkit_backend_subject_info_get_subject (subject_info);
+  user_of_subject = polkit_backend_subject_info_get_user (subject_info);
+
+  /* select admin user if required by the implicit authorization */
+  if (implicit_authorization != POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED &&
+      implicit_authorization != POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
+    {
+      identities = g_list_prepend (NULL, g_object_ref (user_of_subject));
+    }
+  else if (POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority)->get_admin_identities_async != NULL)
+    {
+      InitiateChallengeData *data;
+
+      data = g_new0 (InitiateChallengeData, 1);
+      data->agent = authentication_agent_ref (agent);
+      data->subject_info = polkit_backend_subject_info_ref (subject_info);
+      data->scope = g_object_ref (scope);
+      data->action_id = g_strdup (action_id);
+      data->details = g_object_ref (details);
+      data->caller = g_object_ref (caller);
+      data->implicit_authorization = implicit_authorization;
+      data->initiated = initiated;
+      data->cancellable = g_object_ref (cancellable);
+      data->callback = callback;
+      data->user_data = user_data;
+
+      polkit_backend_interactive_authority_get_admin_identities_async (authority,
+                                                                       caller,
+                                                                       subject,
+                                                                       user_of_subject,
+                                                                       polkit_backend_subject_info_get_is_local (subject_info),
+                                                                       polkit_backend_subject_info_get_is_active (subject_info),
+                                                                       action_id,
+                                                                       details,
+                                                                       subject_info,
+                                                                       cancellable,
+                                                                       initiate_challenge_admin_identities_cb,
+                                                                       data);
+      return;
+    }
+  else
+    {
+      identities = polkit_backend_interactive_authority_get_admin_identities (authority,
+                                                                              caller,
+                                                                              subject,
+                                                                              user_of_subject,
+                                                                              polkit_backend_subject_info_get_is_local (subject_info),
+                                                                              polkit_backend_subject_info_get_is_active (subject_info),
+                                                                              action_id,
+                                                                              details,
+                                                                              subject_info);
+    }
+
+  authentication_agent_begin_challenge (agent,
+                                        subject_info,
+                                        scope,
+                                        authority,
+                                        action_id,
+                                        details,
+                                        caller,
+                                        implicit_authorization,
+                                        identities,
+                                        initiated,
+                                        cancellable,
+                                        callback,
+                                        user_data);
+}
+
 static void
-authentication_agent_cancel_cb (GDBusProxy   *proxy,
-                                GAsyncResult *res,
-                                gpointer      user_data)
+authentication_agent_cancel_cb (GDBusConnection *connection,
+                                GAsyncResult    *res,
+                                gpointer         user_data)
 {
   GVariant *result;
   GError *error;
 
   error = NULL;
-  result = g_dbus_proxy_call_finish (proxy, res, &error);
+  result = g_dbus_connection_call_finish (connection, res, &error);
   if (result == NULL)
     {
       g_printerr ("Error cancelling authentication: %s\n", error->message);
@@ -2461,70 +5258,73 @@ authentication_agent_cancel_cb (GDBusProxy   *proxy,
 static void
 authentication_session_cancel (AuthenticationSession *session)
 {
-  g_dbus_proxy_call (session->agent->proxy,
-                     "CancelAuthentication",
-                     g_variant_new ("(s)", session->cookie),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1, /* timeout_msec */
-                     NULL, /* GCancellable* */
-                     (GAsyncReadyCallback) authentication_agent_cancel_cb,
-                     NULL);
+  g_dbus_connection_call (session->agent->connection,
+                          session->agent->unique_system_bus_name,
+                          session->agent->object_path,
+                          "org.freedesktop.PolicyKit1.AuthenticationAgent",
+                          "CancelAuthentication",
+                          g_variant_new ("(s)", session->cookie),
+                          NULL, /* GVariantType* */
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1, /* timeout_msec */
+                          NULL, /* GCancellable* */
+                          (GAsyncReadyCallback) authentication_agent_cancel_cb,
+                          NULL);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Checks that @caller, running as @user_of_caller, may register an
+ * authentication agent for @subject. Sessions must be the one @caller is
+ * in, unless @allow_other_sessions is set and @caller runs as uid 0.
+ */
 static gboolean
-polkit_backend_interactive_authority_register_authentication_agent (PolkitBackendAuthority   *authority,
-                                                                    PolkitSubject            *caller,
-                                                                    PolkitSubject            *subject,
-                                                                    const gchar              *locale,
-                                                                    const gchar              *object_path,
-                                                                    GVariant                 *options,
-                                                                    GError                  **error)
+check_authentication_agent_subject (PolkitBackendInteractiveAuthority *authority,
+                                    PolkitSubject                     *caller,
+                                    PolkitIdentity                    *user_of_caller,
+                                    PolkitSubject                     *subject,
+                                    gboolean                           allow_other_sessions,
+                                    GError                           **error)
 {
-  PolkitBackendInteractiveAuthority *interactive_authority;
   PolkitBackendInteractiveAuthorityPrivate *priv;
   PolkitSubject *session_for_caller;
-  PolkitIdentity *user_of_caller;
   PolkitIdentity *user_of_subject;
   gboolean user_of_subject_matches;
-  AuthenticationAgent *agent;
   gboolean ret;
-  gchar *caller_cmdline;
-  gchar *subject_as_string;
 
-  ret = FALSE;
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
 
+  ret = FALSE;
   session_for_caller = NULL;
-  user_of_caller = NULL;
   user_of_subject = NULL;
-  subject_as_string = NULL;
-  caller_cmdline = NULL;
-  agent = NULL;
-
-  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
-  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
 
   if (POLKIT_IS_UNIX_SESSION (subject))
     {
-      session_for_caller = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
-                                                                                   caller,
-                                                                                   NULL);
-      if (session_for_caller == NULL)
+      if (allow_other_sessions && identity_is_root_user (user_of_caller))
         {
-          g_set_error (error,
-                       POLKIT_ERROR,
-                       POLKIT_ERROR_FAILED,
-                       "Cannot determine session the caller is in");
-          goto out;
+          /* explicitly allow uid 0 to register for other sessions */
         }
-      if (!polkit_subject_equal (session_for_caller, subject))
+      else
         {
-          g_set_error (error,
-                       POLKIT_ERROR,
-                       POLKIT_ERROR_FAILED,
-                       "Passed session and the session the caller is in differs. They must be equal for now.");
-          goto out;
+          session_for_caller = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
+                                                                                       caller,
+                                                                                       NULL);
+          if (session_for_caller == NULL)
+            {
+              g_set_error (error,
+                           POLKIT_ERROR,
+                           POLKIT_ERROR_FAILED,
+                           "Cannot determine session the caller is in");
+              goto out;
+            }
+          if (!polkit_subject_equal (session_for_caller, subject))
+            {
+              g_set_error (error,
+                           POLKIT_ERROR,
+                           POLKIT_ERROR_FAILED,
+                           "Passed session and the session the caller is in differs. They must be equal for now.");
+              goto out;
+            }
         }
     }
   else if (POLKIT_IS_UNIX_PROCESS (subject))
@@ -2540,15 +5340,6 @@ polkit_backend_interactive_authority_register_authentication_agent (PolkitBacken
       goto out;
     }
 
-  user_of_caller = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor, caller, NULL, NULL);
-  if (user_of_caller == NULL)
-    {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Cannot determine user of caller");
-      goto out;
-    }
   user_of_subject = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor, subject, &user_of_subject_matches, NULL);
   if (user_of_subject == NULL)
     {
@@ -2575,6 +5366,56 @@ polkit_backend_interactive_authority_register_authentication_agent (PolkitBacken
         }
     }
 
+  ret = TRUE;
+
+ out:
+  if (user_of_subject != NULL)
+    g_object_unref (user_of_subject);
+  if (session_for_caller != NULL)
+    g_object_unref (session_for_caller);
+  return ret;
+}
+
+static gboolean
+polkit_backend_interactive_authority_register_authentication_agent (PolkitBackendAuthority   *authority,
+                                                                    PolkitSubject            *caller,
+                                                                    PolkitSubject            *subject,
+                                                                    const gchar              *locale,
+                                                                    const gchar              *object_path,
+                                                                    GVariant                 *options,
+                                                                    GError                  **error)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitIdentity *user_of_caller;
+  AuthenticationAgent *agent;
+  gboolean ret;
+  gchar *caller_cmdline;
+  gchar *subject_as_string;
+
+  ret = FALSE;
+
+  user_of_caller = NULL;
+  subject_as_string = NULL;
+  caller_cmdline = NULL;
+  agent = NULL;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_REGISTER_AUTHENTICATION_AGENT);
+
+  user_of_caller = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor, caller, NULL, NULL);
+  if (user_of_caller == NULL)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Cannot determine user of caller");
+      goto out;
+    }
+  if (!check_authentication_agent_subject (interactive_authority, caller, user_of_caller, subject, FALSE, error))
+    goto out;
+
   agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, subject);
   if (agent != NULL)
     {
@@ -2587,6 +5428,7 @@ polkit_backend_interactive_authority_register_authentication_agent (PolkitBacken
 
   priv->agent_serial++;
   agent = authentication_agent_new (priv->agent_serial,
+                                    priv->system_bus_connection,
                                     subject,
                                     user_of_caller,
                                     polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (caller)),
@@ -2597,11 +5439,9 @@ polkit_backend_interactive_authority_register_authentication_agent (PolkitBacken
   if (!agent)
     goto out;
 
-  g_hash_table_insert (priv->hash_scope_to_authentication_agent,
-                       g_object_ref (subject),
-                       agent);
+  add_authentication_agent (interactive_authority, agent);
 
-  caller_cmdline = _polkit_subject_get_cmdline (caller);
+  caller_cmdline = polkit_backend_subject_get_cmdline (caller);
   if (caller_cmdline == NULL)
     caller_cmdline = g_strdup ("<unknown>");
 
@@ -2632,72 +5472,77 @@ polkit_backend_interactive_authority_register_authentication_agent (PolkitBacken
   g_free (subject_as_string);
   if (user_of_caller != NULL)
     g_object_unref (user_of_caller);
-  if (user_of_subject != NULL)
-    g_object_unref (user_of_subject);
-  if (session_for_caller != NULL)
-    g_object_unref (session_for_caller);
 
   return ret;
 }
 
+/* The agent @caller already registered at @object_path, if any */
+static AuthenticationAgent *
+get_authentication_agent_for_caller_and_object_path (PolkitBackendInteractiveAuthority *authority,
+                                                     PolkitSubject                     *caller,
+                                                     const gchar                       *object_path)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GList *l;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  for (l = name_index_lookup (priv->hash_name_to_authentication_agents,
+                              polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (caller)));
+       l != NULL;
+       l = l->next)
+    {
+      AuthenticationAgent *agent = l->data;
+      if (g_strcmp0 (agent->object_path, object_path) == 0)
+        return agent;
+    }
+  return NULL;
+}
+
+/* Like polkit_backend_interactive_authority_register_authentication_agent(),
+ * but one agent serves all of @subjects, and uid 0 may register it for
+ * sessions other than its own. If @caller already has an agent at
+ * @object_path, @subjects are added to it and @locale and @options are
+ * those it was first registered with. Either every subject is
+ * registered, or none is.
+ */
 static gboolean
-polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBackendAuthority   *authority,
-                                                                      PolkitSubject            *caller,
-                                                                      PolkitSubject            *subject,
-                                                                      const gchar              *object_path,
-                                                                      GError                  **error)
+polkit_backend_interactive_authority_register_authentication_agent_for_subjects (PolkitBackendAuthority   *authority,
+                                                                                 PolkitSubject            *caller,
+                                                                                 GList                    *subjects,
+                                                                                 const gchar              *locale,
+                                                                                 const gchar              *object_path,
+                                                                                 GVariant                 *options,
+                                                                                 GError                  **error)
 {
   PolkitBackendInteractiveAuthority *interactive_authority;
   PolkitBackendInteractiveAuthorityPrivate *priv;
-  PolkitSubject *session_for_caller;
   PolkitIdentity *user_of_caller;
-  PolkitIdentity *user_of_subject;
-  gboolean user_of_subject_matches;
   AuthenticationAgent *agent;
+  AuthenticationAgent *existing;
+  GHashTable *seen;
+  GList *l;
   gboolean ret;
-  gchar *scope_str;
-
-  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
-  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  gchar *caller_cmdline;
+  gchar *scopes_as_string;
 
   ret = FALSE;
-  session_for_caller = NULL;
+
   user_of_caller = NULL;
-  user_of_subject = NULL;
+  scopes_as_string = NULL;
+  caller_cmdline = NULL;
+  seen = NULL;
 
-  if (POLKIT_IS_UNIX_SESSION (subject))
-    {
-      session_for_caller = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
-                                                                                   caller,
-                                                                                   NULL);
-      if (session_for_caller == NULL)
-        {
-          g_set_error (error,
-                       POLKIT_ERROR,
-                       POLKIT_ERROR_FAILED,
-                       "Cannot determine session the caller is in");
-          goto out;
-        }
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_REGISTER_AUTHENTICATION_AGENT);
 
-      if (!polkit_subject_equal (session_for_caller, subject))
-        {
-          g_set_error (error,
-                       POLKIT_ERROR,
-                       POLKIT_ERROR_FAILED,
-                       "Passed session and the session the caller is in differs. They must be equal for now.");
-          goto out;
-        }
-    }
-  else if (POLKIT_IS_UNIX_PROCESS (subject))
-    {
-      /* explicitly OK */
-    }
-  else
+  if (subjects == NULL)
     {
       g_set_error (error,
                    POLKIT_ERROR,
                    POLKIT_ERROR_FAILED,
-                   "Only unix-process and unix-session subjects can be used for authentication agents.");
+                   "No subjects to register the authentication agent for");
       goto out;
     }
 
@@ -2710,31 +5555,133 @@ polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBack
                    "Cannot determine user of caller");
       goto out;
     }
-  user_of_subject = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor, subject, &user_of_subject_matches, NULL);
-  if (user_of_subject == NULL)
-    {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Cannot determine user of subject");
-      goto out;
-    }
-  if (!user_of_subject_matches
-      || !polkit_identity_equal (user_of_caller, user_of_subject))
+
+  existing = get_authentication_agent_for_caller_and_object_path (interactive_authority, caller, object_path);
+
+  /* check everything before registering anything */
+  seen = g_hash_table_new ((GHashFunc) polkit_subject_hash, (GEqualFunc) polkit_subject_equal);
+  for (l = subjects; l != NULL; l = l->next)
     {
-      if (identity_is_root_user (user_of_caller))
-        {
-          /* explicitly allow uid 0 to register for other users */
-        }
-      else
+      PolkitSubject *subject = POLKIT_SUBJECT (l->data);
+      gchar *subject_as_string;
+
+      if (!check_authentication_agent_subject (interactive_authority, caller, user_of_caller, subject, TRUE, error))
+        goto out;
+
+      if (g_hash_table_lookup (seen, subject) != NULL ||
+          g_hash_table_lookup (priv->hash_scope_to_authentication_agent, subject) != NULL)
         {
+          subject_as_string = polkit_subject_to_string (subject);
           g_set_error (error,
                        POLKIT_ERROR,
                        POLKIT_ERROR_FAILED,
-                       "User of caller and user of subject differs.");
+                       "An authentication agent already exists for %s",
+                       subject_as_string);
+          g_free (subject_as_string);
           goto out;
         }
+      g_hash_table_insert (seen, subject, subject);
+    }
+
+  if (existing != NULL)
+    {
+      agent = existing;
+      for (l = subjects; l != NULL; l = l->next)
+        add_authentication_agent_scope (interactive_authority, agent, POLKIT_SUBJECT (l->data));
+    }
+  else
+    {
+      priv->agent_serial++;
+      agent = authentication_agent_new (priv->agent_serial,
+                                        priv->system_bus_connection,
+                                        POLKIT_SUBJECT (subjects->data),
+                                        user_of_caller,
+                                        polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (caller)),
+                                        locale,
+                                        object_path,
+                                        options,
+                                        error);
+      if (!agent)
+        goto out;
+      for (l = subjects->next; l != NULL; l = l->next)
+        g_ptr_array_add (agent->scopes, g_object_ref (l->data));
+
+      add_authentication_agent (interactive_authority, agent);
+    }
+
+  caller_cmdline = polkit_backend_subject_get_cmdline (caller);
+  if (caller_cmdline == NULL)
+    caller_cmdline = g_strdup ("<unknown>");
+
+  scopes_as_string = authentication_agent_scopes_to_string (agent);
+
+  g_debug ("Added authentication agent for %u subjects, now %s, at name %s [%s], object path %s, locale %s",
+           g_list_length (subjects),
+           scopes_as_string,
+           agent->unique_system_bus_name,
+           caller_cmdline,
+           agent->object_path,
+           agent->locale);
+
+  polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                "Registered Authentication Agent for %u subjects, now %s "
+                                "(system bus name %s [%s], object path %s, locale %s)",
+                                g_list_length (subjects),
+                                scopes_as_string,
+                                agent->unique_system_bus_name,
+                                caller_cmdline,
+                                agent->object_path,
+                                agent->locale);
+
+  g_signal_emit_by_name (authority, "changed");
+
+  ret = TRUE;
+
+ out:
+  g_free (caller_cmdline);
+  g_free (scopes_as_string);
+  if (seen != NULL)
+    g_hash_table_unref (seen);
+  if (user_of_caller != NULL)
+    g_object_unref (user_of_caller);
+
+  return ret;
+}
+
+static gboolean
+polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBackendAuthority   *authority,
+                                                                      PolkitSubject            *caller,
+                                                                      PolkitSubject            *subject,
+                                                                      const gchar              *object_path,
+                                                                      GError                  **error)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitIdentity *user_of_caller;
+  AuthenticationAgent *agent;
+  gboolean ret;
+  gchar *scope_str;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_UNREGISTER_AUTHENTICATION_AGENT);
+
+  ret = FALSE;
+  user_of_caller = NULL;
+
+  user_of_caller = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor, caller, NULL, NULL);
+  if (user_of_caller == NULL)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Cannot determine user of caller");
+      goto out;
     }
+  /* other sessions are fine, only the owner of the agent gets past the
+   * checks below */
+  if (!check_authentication_agent_subject (interactive_authority, caller, user_of_caller, subject, TRUE, error))
+    goto out;
 
   agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, subject);
   if (agent == NULL)
@@ -2764,7 +5711,7 @@ polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBack
       goto out;
     }
 
-  scope_str = polkit_subject_to_string (agent->scope);
+  scope_str = polkit_subject_to_string (subject);
   g_debug ("Removing authentication agent for %s at name %s, object path %s, locale %s",
            scope_str,
            agent->unique_system_bus_name,
@@ -2780,10 +5727,10 @@ polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBack
                                 agent->locale);
   g_free (scope_str);
 
-  authentication_agent_cancel_all_sessions (agent);
-  /* this works because we have exactly one agent per session */
-  /* this frees agent... */
-  g_hash_table_remove (priv->hash_scope_to_authentication_agent, agent->scope);
+  /* an agent shared by several subjects keeps serving the others */
+  authentication_agent_cancel_sessions (agent, subject);
+  /* this may free agent... */
+  remove_authentication_agent_scope (interactive_authority, agent, subject);
 
   g_signal_emit_by_name (authority, "changed");
 
@@ -2792,10 +5739,6 @@ polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBack
  out:
   if (user_of_caller != NULL)
     g_object_unref (user_of_caller);
-  if (user_of_subject != NULL)
-    g_object_unref (user_of_subject);
-  if (session_for_caller != NULL)
-    g_object_unref (session_for_caller);
   return ret;
 }
 
@@ -2819,6 +5762,7 @@ polkit_backend_interactive_authority_authentication_agent_response (PolkitBacken
 
   interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_AUTHENTICATION_AGENT_RESPONSE);
 
   ret = FALSE;
   user_of_caller = NULL;
@@ -2878,6 +5822,8 @@ polkit_backend_interactive_authority_authentication_agent_response (PolkitBacken
   /* checks out, mark the session as authenticated */
   session->is_authenticated = TRUE;
   session->authenticated_identity = g_object_ref (identity);
+  metrics_add_latency (priv, POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_AGENT, session->begun);
+  session->responded = metrics_now (priv);
 
   ret = TRUE;
 
@@ -2912,12 +5858,17 @@ polkit_backend_interactive_authority_system_bus_name_owner_changed (PolkitBacken
       GList *sessions;
       GList *l;
 
+      /* unique names are never reused, so what is known about one is
+       * good until it goes away */
+      polkit_backend_session_monitor_forget_bus_name (priv->session_monitor, name);
+      g_hash_table_remove (priv->hash_name_to_resolved_agent, name);
+
       agent = get_authentication_agent_by_unique_system_bus_name (interactive_authority, name);
       if (agent != NULL)
         {
           gchar *scope_str;
 
-          scope_str = polkit_subject_to_string (agent->scope);
+          scope_str = authentication_agent_scopes_to_string (agent);
           g_debug ("Removing authentication agent for %s at name %s, object path %s (disconnected from bus)",
                    scope_str,
                    agent->unique_system_bus_name,
@@ -2933,20 +5884,23 @@ polkit_backend_interactive_authority_system_bus_name_owner_changed (PolkitBacken
           g_free (scope_str);
 
           authentication_agent_cancel_all_sessions (agent);
-          /* this works because we have exactly one agent per session */
           /* this frees agent... */
-          g_hash_table_remove (priv->hash_scope_to_authentication_agent, agent->scope);
+          remove_authentication_agent (interactive_authority, agent);
 
           g_signal_emit_by_name (authority, "changed");
         }
 
+      /* challenges shared with other checks carry on without the vanished name */
+      pending_challenges_forget_name (interactive_authority, name);
+
       /* cancel all authentication sessions initiated by the process owning the vanished name */
       sessions = get_authentication_sessions_initiated_by_system_bus_unique_name (interactive_authority, name);
       for (l = sessions; l != NULL; l = l->next)
         {
           AuthenticationSession *session = l->data;
 
-          authentication_session_cancel (session);
+          if (session->callback != check_authorization_challenge_cb)
+            authentication_session_cancel (session);
         }
       g_list_free (sessions);
 
@@ -2956,7 +5910,8 @@ polkit_backend_interactive_authority_system_bus_name_owner_changed (PolkitBacken
         {
           AuthenticationSession *session = l->data;
 
-          authentication_session_cancel (session);
+          if (session->callback != check_authorization_challenge_cb)
+            authentication_session_cancel (session);
         }
       g_list_free (sessions);
 
@@ -2970,45 +5925,290 @@ polkit_backend_interactive_authority_system_bus_name_owner_changed (PolkitBacken
 
 }
 
-/* ---------------------------------------------------------------------------------------------------- */
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct TemporaryAuthorization TemporaryAuthorization;
+typedef struct TemporaryAuthorizationBucket TemporaryAuthorizationBucket;
+
+/* What happened to an authorization, as told in the
+ * TemporaryAuthorizationsChanged D-Bus signal
+ */
+typedef enum
+{
+  TEMPORARY_AUTHORIZATION_ADDED,
+  TEMPORARY_AUTHORIZATION_EXPIRED,
+  TEMPORARY_AUTHORIZATION_REVOKED
+} TemporaryAuthorizationChange;
+
+static const gchar *temporary_authorization_change_names[] = {
+  "added",
+  "expired",
+  "revoked",
+};
+
+struct TemporaryAuthorizationStore
+{
+  /* all authorizations, most recently added first */
+  GList *authorizations;
+
+  /* TemporaryAuthorizationBucket set, keyed on action id and subject */
+  GHashTable *by_subject;
+
+  /* id -> TemporaryAuthorization */
+  GHashTable *by_id;
+
+  /* name -> GQueue of TemporaryAuthorization for system bus name subjects */
+  GHashTable *by_bus_name;
+
+  /* scope -> GQueue of TemporaryAuthorization, usually one per session */
+  GHashTable *by_scope;
+
+  /* binary min-heap of TemporaryAuthorization on time_expires, driven by
+   * a single timeout that is armed for the authorization at the top
+   */
+  GPtrArray *expirations;
+  guint expiration_timeout_id;
+  gint64 expiration_scheduled;
+
+  /* copies of the authorizations of processes that outlive the daemon */
+  PolkitBackendAuthorizationJournal *journal;
+  gchar *journal_path;
+
+  PolkitBackendInteractiveAuthority *authority;
+  guint64 serial;
+};
+
+/* The authorizations for an action id whose subjects are equal according
+ * to polkit_subject_equal() - subject_equal_for_authz() is stricter than
+ * that, so there may be more than one of them.
+ */
+struct TemporaryAuthorizationBucket
+{
+  gchar *action_id;
+  PolkitSubject *subject;
+  GList *authorizations;
+};
+
+struct TemporaryAuthorization
+{
+  TemporaryAuthorizationStore *store;
+  TemporaryAuthorizationBucket *bucket;
+  GList *link;
+  GList *scope_link;
+  PolkitSubject *subject;
+  PolkitSubject *scope;
+  gchar *id;
+  gchar *action_id;
+  /* both of these are obtained using g_get_monotonic_time(),
+   * so the resolution is usec
+   */
+  gint64 time_granted;
+  gint64 time_expires;
+  guint expiration_index;
+  guint check_vanished_timeout_id;
+  /* pidfd of a unix process subject, if the kernel supports it */
+  gint pidfd;
+  guint pidfd_watch_id;
+  /* slot in the journal, or -1 if not journaled */
+  gint journal_slot;
+};
+
+static void
+temporary_authorization_free (TemporaryAuthorization *authorization)
+{
+  g_free (authorization->id);
+  g_object_unref (authorization->subject);
+  g_object_unref (authorization->scope);
+  g_free (authorization->action_id);
+  if (authorization->check_vanished_timeout_id > 0)
+    g_source_remove (authorization->check_vanished_timeout_id);
+  if (authorization->pidfd_watch_id > 0)
+    g_source_remove (authorization->pidfd_watch_id);
+  if (authorization->pidfd >= 0)
+    close (authorization->pidfd);
+  g_free (authorization);
+}
+
+static guint
+temporary_authorization_bucket_hash (gconstpointer key)
+{
+  const TemporaryAuthorizationBucket *bucket = key;
+
+  return g_str_hash (bucket->action_id) ^ polkit_subject_hash (bucket->subject);
+}
+
+static gboolean
+temporary_authorization_bucket_equal (gconstpointer a,
+                                      gconstpointer b)
+{
+  const TemporaryAuthorizationBucket *bucket_a = a;
+  const TemporaryAuthorizationBucket *bucket_b = b;
+
+  return strcmp (bucket_a->action_id, bucket_b->action_id) == 0 &&
+    polkit_subject_equal (bucket_a->subject, bucket_b->subject);
+}
+
+static void
+temporary_authorization_bucket_free (TemporaryAuthorizationBucket *bucket)
+{
+  g_free (bucket->action_id);
+  g_object_unref (bucket->subject);
+  g_list_free (bucket->authorizations);
+  g_free (bucket);
+}
+
+static void
+expiration_heap_set (GPtrArray              *heap,
+                     guint                   index,
+                     TemporaryAuthorization *authorization)
+{
+  heap->pdata[index] = authorization;
+  authorization->expiration_index = index;
+}
+
+static void
+expiration_heap_sift_up (GPtrArray *heap,
+                         guint      index)
+{
+  TemporaryAuthorization *authorization = heap->pdata[index];
+
+  while (index > 0)
+    {
+      guint parent = (index - 1) / 2;
+      TemporaryAuthorization *p = heap->pdata[parent];
+
+      if (p->time_expires <= authorization->time_expires)
+        break;
+      expiration_heap_set (heap, index, p);
+      index = parent;
+    }
+  expiration_heap_set (heap, index, authorization);
+}
+
+static void
+expiration_heap_sift_down (GPtrArray *heap,
+                           guint      index)
+{
+  TemporaryAuthorization *authorization = heap->pdata[index];
+
+  for (;;)
+    {
+      guint child = 2 * index + 1;
+      TemporaryAuthorization *c;
+
+      if (child >= heap->len)
+        break;
+      if (child + 1 < heap->len &&
+          ((TemporaryAuthorization *) heap->pdata[child + 1])->time_expires <
+          ((TemporaryAuthorization *) heap->pdata[child])->time_expires)
+        child++;
+      c = heap->pdata[child];
+      if (authorization->time_expires <= c->time_expires)
+        break;
+      expiration_heap_set (heap, index, c);
+      index = child;
+    }
+  expiration_heap_set (heap, index, authorization);
+}
+
+static void
+expiration_heap_push (GPtrArray              *heap,
+                      TemporaryAuthorization *authorization)
+{
+  g_ptr_array_add (heap, authorization);
+  expiration_heap_sift_up (heap, heap->len - 1);
+}
+
+static void
+expiration_heap_remove (GPtrArray              *heap,
+                        TemporaryAuthorization *authorization)
+{
+  guint index = authorization->expiration_index;
+  TemporaryAuthorization *last;
 
-typedef struct TemporaryAuthorization TemporaryAuthorization;
+  g_assert (index < heap->len && heap->pdata[index] == authorization);
 
-struct TemporaryAuthorizationStore
-{
-  GList *authorizations;
-  PolkitBackendInteractiveAuthority *authority;
-  guint64 serial;
-};
+  last = g_ptr_array_remove_index (heap, heap->len - 1);
+  if (last == authorization)
+    return;
 
-struct TemporaryAuthorization
+  expiration_heap_set (heap, index, last);
+  if (index > 0 &&
+      ((TemporaryAuthorization *) heap->pdata[(index - 1) / 2])->time_expires > last->time_expires)
+    expiration_heap_sift_up (heap, index);
+  else
+    expiration_heap_sift_down (heap, index);
+}
+
+/* Tells clients about @change to @authorization, right before the ::changed
+ * signal that the caller emits; the session and id are enough for clients
+ * of the session to know whether to enumerate its authorizations again, and
+ * others don't learn what was authorized.
+ */
+static void
+temporary_authorization_store_notify (TemporaryAuthorizationStore  *store,
+                                      TemporaryAuthorization       *authorization,
+                                      TemporaryAuthorizationChange  change)
 {
-  TemporaryAuthorizationStore *store;
-  PolkitSubject *subject;
-  PolkitSubject *scope;
-  gchar *id;
-  gchar *action_id;
-  /* both of these are obtained using g_get_monotonic_time(),
-   * so the resolution is usec
-   */
-  gint64 time_granted;
-  gint64 time_expires;
-  guint expiration_timeout_id;
-  guint check_vanished_timeout_id;
-};
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GError *error;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (store->authority);
+  if (priv->system_bus_connection == NULL)
+    return;
 
+  error = NULL;
+  if (!g_dbus_connection_emit_signal (priv->system_bus_connection,
+                                      NULL, /* destination_bus_name */
+                                      "/org/freedesktop/PolicyKit1/Authority",
+                                      "org.freedesktop.PolicyKit1.Authority",
+                                      "TemporaryAuthorizationsChanged",
+                                      g_variant_new ("(@(sa{sv})ss)",
+                                                     polkit_subject_to_gvariant (authorization->scope), /* A floating value */
+                                                     authorization->id,
+                                                     temporary_authorization_change_names[change]),
+                                      &error))
+    {
+      g_warning ("Error emitting TemporaryAuthorizationsChanged: %s", error->message);
+      g_error_free (error);
+    }
+}
+
+static gboolean on_expiration_timeout (gpointer user_data);
+
+/* (Re)arms the store timeout for the authorization that expires first */
 static void
-temporary_authorization_free (TemporaryAuthorization *authorization)
+temporary_authorization_store_schedule_expiration (TemporaryAuthorizationStore *store)
 {
-  g_free (authorization->id);
-  g_object_unref (authorization->subject);
-  g_object_unref (authorization->scope);
-  g_free (authorization->action_id);
-  if (authorization->expiration_timeout_id > 0)
-    g_source_remove (authorization->expiration_timeout_id);
-  if (authorization->check_vanished_timeout_id > 0)
-    g_source_remove (authorization->check_vanished_timeout_id);
-  g_free (authorization);
+  TemporaryAuthorization *first;
+  gint64 delay;
+
+  if (store->expirations->len == 0)
+    {
+      if (store->expiration_timeout_id > 0)
+        {
+          g_source_remove (store->expiration_timeout_id);
+          store->expiration_timeout_id = 0;
+        }
+      return;
+    }
+
+  first = store->expirations->pdata[0];
+  if (store->expiration_timeout_id > 0)
+    {
+      if (store->expiration_scheduled == first->time_expires)
+        return;
+      g_source_remove (store->expiration_timeout_id);
+    }
+
+  /* round up, we must not wake up before the authorization has expired */
+  delay = first->time_expires - g_get_monotonic_time ();
+  delay = delay > 0 ? (delay + 999) / 1000 : 0;
+  store->expiration_scheduled = first->time_expires;
+  /* g_timeout_add() is using monotonic time since 2.28 */
+  store->expiration_timeout_id = g_timeout_add (MIN (delay, G_MAXUINT),
+                                                on_expiration_timeout,
+                                                store);
 }
 
 static TemporaryAuthorizationStore *
@@ -3019,6 +6219,20 @@ temporary_authorization_store_new (PolkitBackendInteractiveAuthority *authority)
   store = g_new0 (TemporaryAuthorizationStore, 1);
   store->authority = authority;
   store->authorizations = NULL;
+  store->by_subject = g_hash_table_new_full (temporary_authorization_bucket_hash,
+                                             temporary_authorization_bucket_equal,
+                                             (GDestroyNotify) temporary_authorization_bucket_free,
+                                             NULL);
+  store->by_id = g_hash_table_new (g_str_hash, g_str_equal);
+  store->by_bus_name = g_hash_table_new_full (g_str_hash,
+                                              g_str_equal,
+                                              g_free,
+                                              (GDestroyNotify) g_queue_free);
+  store->by_scope = g_hash_table_new_full ((GHashFunc) polkit_subject_hash,
+                                           (GEqualFunc) polkit_subject_equal,
+                                           g_object_unref,
+                                           (GDestroyNotify) g_queue_free);
+  store->expirations = g_ptr_array_new ();
 
   return store;
 }
@@ -3026,11 +6240,73 @@ temporary_authorization_store_new (PolkitBackendInteractiveAuthority *authority)
 static void
 temporary_authorization_store_free (TemporaryAuthorizationStore *store)
 {
+  g_hash_table_unref (store->by_subject);
+  g_hash_table_unref (store->by_id);
+  g_hash_table_unref (store->by_bus_name);
+  g_hash_table_unref (store->by_scope);
+  if (store->expiration_timeout_id > 0)
+    g_source_remove (store->expiration_timeout_id);
+  g_ptr_array_unref (store->expirations);
   g_list_foreach (store->authorizations, (GFunc) temporary_authorization_free, NULL);
   g_list_free (store->authorizations);
+  /* the journaled authorizations are kept for the next daemon */
+  if (store->journal != NULL)
+    polkit_backend_authorization_journal_free (store->journal);
+  g_free (store->journal_path);
   g_free (store);
 }
 
+/* Unlinks @authorization from @store and all of its indexes and tells
+ * clients about @change, the caller frees it
+ */
+static void
+temporary_authorization_store_remove (TemporaryAuthorizationStore  *store,
+                                      TemporaryAuthorization       *authorization,
+                                      TemporaryAuthorizationChange  change)
+{
+  TemporaryAuthorizationBucket *bucket;
+  GQueue *queue;
+
+  bucket = authorization->bucket;
+  bucket->authorizations = g_list_remove (bucket->authorizations, authorization);
+  if (bucket->authorizations == NULL)
+    g_hash_table_remove (store->by_subject, bucket);
+  authorization->bucket = NULL;
+
+  if (POLKIT_IS_SYSTEM_BUS_NAME (authorization->subject))
+    {
+      const gchar *name;
+
+      name = polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (authorization->subject));
+      queue = g_hash_table_lookup (store->by_bus_name, name);
+      g_queue_remove (queue, authorization);
+      if (g_queue_is_empty (queue))
+        g_hash_table_remove (store->by_bus_name, name);
+    }
+
+  g_hash_table_remove (store->by_id, authorization->id);
+
+  queue = g_hash_table_lookup (store->by_scope, authorization->scope);
+  g_queue_delete_link (queue, authorization->scope_link);
+  authorization->scope_link = NULL;
+  if (g_queue_is_empty (queue))
+    g_hash_table_remove (store->by_scope, authorization->scope);
+
+  expiration_heap_remove (store->expirations, authorization);
+  temporary_authorization_store_schedule_expiration (store);
+
+  store->authorizations = g_list_delete_link (store->authorizations, authorization->link);
+  authorization->link = NULL;
+
+  if (authorization->journal_slot >= 0)
+    {
+      polkit_backend_authorization_journal_remove (store->journal, authorization->journal_slot);
+      authorization->journal_slot = -1;
+    }
+
+  temporary_authorization_store_notify (store, authorization, change);
+}
+
 /* See the comment at the top of polkitunixprocess.c */
 static gboolean
 subject_equal_for_authz (PolkitSubject *a,
@@ -3072,6 +6348,8 @@ temporary_authorization_store_has_authorization (TemporaryAuthorizationStore *st
                                                  const gchar                 *action_id,
                                                  const gchar                **out_tmp_authz_id)
 {
+  TemporaryAuthorizationBucket key;
+  TemporaryAuthorizationBucket *bucket;
   GList *l;
   gboolean ret;
   PolkitSubject *subject_to_use;
@@ -3080,14 +6358,16 @@ temporary_authorization_store_has_authorization (TemporaryAuthorizationStore *st
   g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), FALSE);
   g_return_val_if_fail (action_id != NULL, FALSE);
 
+  POLKIT_BACKEND_PROBE1 (temporary__authorization__lookup__entry, action_id);
+
   /* XXX: for now, prefer to store the process */
   if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
     {
       GError *error;
       error = NULL;
-      subject_to_use = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject),
-                                                                NULL,
-                                                                &error);
+      subject_to_use = polkit_backend_session_monitor_get_process_for_bus_name (POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (store->authority)->session_monitor,
+                                                                                POLKIT_SYSTEM_BUS_NAME (subject),
+                                                                                &error);
       if (subject_to_use == NULL)
         {
           g_printerr ("Error getting process for system bus name `%s': %s\n",
@@ -3104,11 +6384,16 @@ temporary_authorization_store_has_authorization (TemporaryAuthorizationStore *st
 
   ret = FALSE;
 
-  for (l = store->authorizations; l != NULL; l = l->next) {
+  key.action_id = (gchar *) action_id;
+  key.subject = subject_to_use;
+  bucket = g_hash_table_lookup (store->by_subject, &key);
+  if (bucket == NULL)
+    goto out;
+
+  for (l = bucket->authorizations; l != NULL; l = l->next) {
     TemporaryAuthorization *authorization = l->data;
 
-    if (strcmp (action_id, authorization->action_id) == 0 &&
-        subject_equal_for_authz (subject_to_use, authorization->subject))
+    if (subject_equal_for_authz (subject_to_use, authorization->subject))
       {
         ret = TRUE;
         if (out_tmp_authz_id != NULL)
@@ -3118,6 +6403,7 @@ temporary_authorization_store_has_authorization (TemporaryAuthorizationStore *st
   }
 
  out:
+  POLKIT_BACKEND_PROBE2 (temporary__authorization__lookup__return, action_id, ret);
   g_object_unref (subject_to_use);
   return ret;
 }
@@ -3125,27 +6411,113 @@ temporary_authorization_store_has_authorization (TemporaryAuthorizationStore *st
 static gboolean
 on_expiration_timeout (gpointer user_data)
 {
-  TemporaryAuthorization *authorization = user_data;
+  TemporaryAuthorizationStore *store = user_data;
+  guint num_removed;
+  gint64 now;
+
+  /* removing the authorizations reschedules a new source as needed */
+  store->expiration_timeout_id = 0;
+
+  num_removed = 0;
+  now = g_get_monotonic_time ();
+  while (store->expirations->len > 0)
+    {
+      TemporaryAuthorization *authorization = store->expirations->pdata[0];
+      gchar *s;
+
+      if (authorization->time_expires > now)
+        break;
+
+      s = polkit_subject_to_string (authorization->subject);
+      g_debug ("Removing tempoary authorization with id `%s' for action-id `%s' for subject `%s': "
+               "authorization has expired",
+               authorization->id,
+               authorization->action_id,
+               s);
+      g_free (s);
+
+      temporary_authorization_store_remove (store, authorization, TEMPORARY_AUTHORIZATION_EXPIRED);
+      temporary_authorization_free (authorization);
+
+      num_removed++;
+    }
+
+  temporary_authorization_store_schedule_expiration (store);
+
+  if (num_removed > 0)
+    g_signal_emit_by_name (store->authority, "changed");
+
+  /* remove source */
+  return FALSE;
+}
+
+static void
+temporary_authorization_unix_process_vanished (TemporaryAuthorization *authorization)
+{
   gchar *s;
 
   s = polkit_subject_to_string (authorization->subject);
   g_debug ("Removing tempoary authorization with id `%s' for action-id `%s' for subject `%s': "
-           "authorization has expired",
+           "subject has vanished",
            authorization->id,
            authorization->action_id,
            s);
   g_free (s);
 
-  authorization->store->authorizations = g_list_remove (authorization->store->authorizations,
-                                                        authorization);
-  authorization->expiration_timeout_id = 0;
+  temporary_authorization_store_remove (authorization->store, authorization, TEMPORARY_AUTHORIZATION_REVOKED);
   g_signal_emit_by_name (authorization->store->authority, "changed");
   temporary_authorization_free (authorization);
+}
+
+static gboolean
+on_unix_process_pidfd_ready (gint         fd,
+                             GIOCondition condition,
+                             gpointer     user_data)
+{
+  TemporaryAuthorization *authorization = user_data;
+
+  /* a pidfd becomes readable when the process exits */
+  authorization->pidfd_watch_id = 0;
+  temporary_authorization_unix_process_vanished (authorization);
 
   /* remove source */
   return FALSE;
 }
 
+/* Returns %TRUE if the process of @authorization is now watched through a
+ * pidfd, %FALSE if it has to be polled instead
+ */
+static gboolean
+temporary_authorization_watch_unix_process (TemporaryAuthorization *authorization)
+{
+#ifdef SYS_pidfd_open
+  gint fd;
+
+  fd = syscall (SYS_pidfd_open, polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (authorization->subject)), 0);
+  if (fd < 0)
+    {
+      /* ENOSYS on kernels before 5.3, ESRCH if the process is already gone */
+      return FALSE;
+    }
+
+  /* the pid may have been reused before it was opened */
+  if (!polkit_subject_exists_sync (authorization->subject, NULL, NULL))
+    {
+      close (fd);
+      return FALSE;
+    }
+
+  authorization->pidfd = fd;
+  authorization->pidfd_watch_id = g_unix_fd_add (fd,
+                                                 G_IO_IN,
+                                                 on_unix_process_pidfd_ready,
+                                                 authorization);
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
 static gboolean
 on_unix_process_check_vanished_timeout (gpointer user_data)
 {
@@ -3165,20 +6537,7 @@ on_unix_process_check_vanished_timeout (gpointer user_data)
         }
       else
         {
-          gchar *s;
-
-          s = polkit_subject_to_string (authorization->subject);
-          g_debug ("Removing tempoary authorization with id `%s' for action-id `%s' for subject `%s': "
-                   "subject has vanished",
-                   authorization->id,
-                   authorization->action_id,
-                   s);
-          g_free (s);
-
-          authorization->store->authorizations = g_list_remove (authorization->store->authorizations,
-                                                                authorization);
-          g_signal_emit_by_name (authorization->store->authority, "changed");
-          temporary_authorization_free (authorization);
+          temporary_authorization_unix_process_vanished (authorization);
         }
     }
 
@@ -3191,23 +6550,15 @@ temporary_authorization_store_remove_authorizations_for_system_bus_name (Tempora
                                                                          const gchar *name)
 {
   guint num_removed;
-  GList *l, *ll;
+  GQueue *queue;
 
   num_removed = 0;
-  for (l = store->authorizations; l != NULL; l = ll)
+  /* the queue goes away along with its last authorization */
+  while ((queue = g_hash_table_lookup (store->by_bus_name, name)) != NULL)
     {
-      TemporaryAuthorization *ta = l->data;
+      TemporaryAuthorization *ta = g_queue_peek_head (queue);
       gchar *s;
 
-      ll = l->next;
-
-      if (!POLKIT_IS_SYSTEM_BUS_NAME (ta->subject))
-        continue;
-
-      if (g_strcmp0 (name, polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (ta->subject))) != 0)
-        continue;
-
-
       s = polkit_subject_to_string (ta->subject);
       g_debug ("Removing tempoary authorization with id `%s' for action-id `%s' for subject `%s': "
                "subject has vanished",
@@ -3216,7 +6567,7 @@ temporary_authorization_store_remove_authorizations_for_system_bus_name (Tempora
                s);
       g_free (s);
 
-      store->authorizations = g_list_remove (store->authorizations, ta);
+      temporary_authorization_store_remove (store, ta, TEMPORARY_AUTHORIZATION_REVOKED);
       temporary_authorization_free (ta);
 
       num_removed++;
@@ -3226,6 +6577,163 @@ temporary_authorization_store_remove_authorizations_for_system_bus_name (Tempora
     g_signal_emit_by_name (store->authority, "changed");
 }
 
+/* Removes all authorizations obtained in @scope, returns how many there were */
+static guint
+temporary_authorization_store_remove_authorizations_for_scope (TemporaryAuthorizationStore *store,
+                                                               PolkitSubject               *scope)
+{
+  guint num_removed;
+  GQueue *queue;
+
+  num_removed = 0;
+  /* the queue goes away along with its last authorization */
+  while ((queue = g_hash_table_lookup (store->by_scope, scope)) != NULL)
+    {
+      TemporaryAuthorization *ta = g_queue_peek_head (queue);
+
+      temporary_authorization_store_remove (store, ta, TEMPORARY_AUTHORIZATION_REVOKED);
+      temporary_authorization_free (ta);
+
+      num_removed++;
+    }
+
+  return num_removed;
+}
+
+/* Removes the authorizations obtained in sessions that are gone; the caller
+ * emits the ::changed signal
+ */
+static void
+temporary_authorization_store_remove_authorizations_for_ended_sessions (TemporaryAuthorizationStore *store)
+{
+  PolkitBackendSessionMonitor *session_monitor;
+  GHashTableIter iter;
+  PolkitSubject *scope;
+  GPtrArray *ended;
+  guint n;
+
+  session_monitor = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (store->authority)->session_monitor;
+
+  ended = g_ptr_array_new_with_free_func (g_object_unref);
+  g_hash_table_iter_init (&iter, store->by_scope);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &scope, NULL))
+    {
+      if (POLKIT_IS_UNIX_SESSION (scope) &&
+          !polkit_backend_session_monitor_session_exists (session_monitor, scope))
+        g_ptr_array_add (ended, g_object_ref (scope));
+    }
+
+  for (n = 0; n < ended->len; n++)
+    {
+      scope = ended->pdata[n];
+      g_debug ("Removing %u temporary authorizations for session `%s': session has ended",
+               temporary_authorization_store_remove_authorizations_for_scope (store, scope),
+               polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (scope)));
+    }
+
+  g_ptr_array_unref (ended);
+}
+
+/* Adds an authorization of @subject, which must not be a bus name, to all
+ * indexes of @store and starts watching for @subject to go away
+ */
+static TemporaryAuthorization *
+temporary_authorization_store_insert (TemporaryAuthorizationStore *store,
+                                      PolkitSubject               *subject,
+                                      PolkitSubject               *scope,
+                                      const gchar                 *action_id,
+                                      gint64                       time_granted,
+                                      gint64                       time_expires,
+                                      gint                         journal_slot)
+{
+  TemporaryAuthorization *authorization;
+  TemporaryAuthorizationBucket key;
+  TemporaryAuthorizationBucket *bucket;
+  GQueue *queue;
+
+  authorization = g_new0 (TemporaryAuthorization, 1);
+  authorization->id = g_strdup_printf ("tmpauthz%" G_GUINT64_FORMAT, store->serial++);
+  authorization->store = store;
+  authorization->subject = g_object_ref (subject);
+  authorization->scope = g_object_ref (scope);
+  authorization->action_id = g_strdup (action_id);
+  authorization->pidfd = -1;
+  authorization->journal_slot = journal_slot;
+  /* store monotonic time and convert to secs-since-epoch when returning TemporaryAuthorization structs */
+  authorization->time_granted = time_granted;
+  authorization->time_expires = time_expires;
+  expiration_heap_push (store->expirations, authorization);
+  temporary_authorization_store_schedule_expiration (store);
+
+  if (POLKIT_IS_UNIX_PROCESS (authorization->subject))
+    {
+      /* We want to know when the process vanishes so we can remove the temporary
+       * authorization - this is because we want agents to update e.g. a notification
+       * area icon saying the user has temporary authorizations (e.g. remove the icon).
+       *
+       * A pidfd tells us as soon as the process exits, without any wakeups in the
+       * meantime. On kernels without pidfds, set up a timer to poll every two
+       * seconds instead.
+       */
+      if (!temporary_authorization_watch_unix_process (authorization))
+        authorization->check_vanished_timeout_id = g_timeout_add_seconds (2,
+                                                                          on_unix_process_check_vanished_timeout,
+                                                                          authorization);
+    }
+#if 0
+  else if (POLKIT_IS_SYSTEM_BUS_NAME (authorization->subject))
+    {
+      /* This is currently handled in polkit_backend_interactive_authority_system_bus_name_owner_changed()  */
+    }
+#endif
+
+
+  store->authorizations = g_list_prepend (store->authorizations, authorization);
+  authorization->link = store->authorizations;
+
+  key.action_id = authorization->action_id;
+  key.subject = authorization->subject;
+  bucket = g_hash_table_lookup (store->by_subject, &key);
+  if (bucket == NULL)
+    {
+      bucket = g_new0 (TemporaryAuthorizationBucket, 1);
+      bucket->action_id = g_strdup (action_id);
+      bucket->subject = g_object_ref (authorization->subject);
+      g_hash_table_add (store->by_subject, bucket);
+    }
+  bucket->authorizations = g_list_prepend (bucket->authorizations, authorization);
+  authorization->bucket = bucket;
+
+  g_hash_table_insert (store->by_id, authorization->id, authorization);
+
+  queue = g_hash_table_lookup (store->by_scope, authorization->scope);
+  if (queue == NULL)
+    {
+      queue = g_queue_new ();
+      g_hash_table_insert (store->by_scope, g_object_ref (authorization->scope), queue);
+    }
+  g_queue_push_head (queue, authorization);
+  authorization->scope_link = queue->head;
+
+  if (POLKIT_IS_SYSTEM_BUS_NAME (authorization->subject))
+    {
+      const gchar *name;
+
+      name = polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (authorization->subject));
+      queue = g_hash_table_lookup (store->by_bus_name, name);
+      if (queue == NULL)
+        {
+          queue = g_queue_new ();
+          g_hash_table_insert (store->by_bus_name, g_strdup (name), queue);
+        }
+      g_queue_push_head (queue, authorization);
+    }
+
+  temporary_authorization_store_notify (store, authorization, TEMPORARY_AUTHORIZATION_ADDED);
+
+  return authorization;
+}
+
 static const gchar *
 temporary_authorization_store_add_authorization (TemporaryAuthorizationStore *store,
                                                  PolkitSubject               *subject,
@@ -3235,6 +6743,9 @@ temporary_authorization_store_add_authorization (TemporaryAuthorizationStore *st
   TemporaryAuthorization *authorization;
   guint expiration_seconds;
   PolkitSubject *subject_to_use;
+  gint64 time_granted;
+  gint64 time_expires;
+  gint journal_slot;
 
   g_return_val_if_fail (store != NULL, NULL);
   g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), NULL);
@@ -3246,9 +6757,9 @@ temporary_authorization_store_add_authorization (TemporaryAuthorizationStore *st
     {
       GError *error;
       error = NULL;
-      subject_to_use = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject),
-                                                                NULL,
-                                                                &error);
+      subject_to_use = polkit_backend_session_monitor_get_process_for_bus_name (POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (store->authority)->session_monitor,
+                                                                                POLKIT_SYSTEM_BUS_NAME (subject),
+                                                                                &error);
       if (subject_to_use == NULL)
         {
           g_printerr ("Error getting process for system bus name `%s': %s\n",
@@ -3260,65 +6771,173 @@ temporary_authorization_store_add_authorization (TemporaryAuthorizationStore *st
     }
   else
     {
-      subject_to_use = g_object_ref (subject);
+      subject_to_use = g_object_ref (subject);
+    }
+
+  /* TODO: right now the time the temporary authorization is kept is hard-coded - we
+   *       could make it a propery on the PolkitBackendInteractiveAuthority class (so
+   *       the local authority could read it from a config file) or a vfunc
+   *       (so the local authority could read it from an annotation on the action).
+   */
+  expiration_seconds = 5 * 60;
+
+  time_granted = g_get_monotonic_time ();
+  time_expires = time_granted + expiration_seconds * G_USEC_PER_SEC;
+
+  /* only processes can be told apart after a restart */
+  journal_slot = -1;
+  if (store->journal != NULL)
+    journal_slot = polkit_backend_authorization_journal_add (store->journal,
+                                                             subject_to_use,
+                                                             scope,
+                                                             action_id,
+                                                             time_granted,
+                                                             time_expires);
+
+  authorization = temporary_authorization_store_insert (store,
+                                                        subject_to_use,
+                                                        scope,
+                                                        action_id,
+                                                        time_granted,
+                                                        time_expires,
+                                                        journal_slot);
+
+  g_object_unref (subject_to_use);
+
+  return authorization->id;
+}
+
+static void
+on_journal_authorization (PolkitBackendAuthorizationJournal *journal,
+                          gint                               slot,
+                          PolkitSubject                     *subject,
+                          PolkitSubject                     *scope,
+                          const gchar                       *action_id,
+                          gint64                             time_granted,
+                          gint64                             time_expires,
+                          gpointer                           user_data)
+{
+  TemporaryAuthorizationStore *store = user_data;
+
+  /* the start time tells whether the pid still belongs to the same process */
+  if (time_expires <= g_get_monotonic_time () ||
+      !polkit_subject_exists_sync (subject, NULL, NULL) ||
+      temporary_authorization_store_has_authorization (store, subject, action_id, NULL))
+    {
+      polkit_backend_authorization_journal_remove (journal, slot);
+      return;
+    }
+
+  temporary_authorization_store_insert (store,
+                                        subject,
+                                        scope,
+                                        action_id,
+                                        time_granted,
+                                        time_expires,
+                                        slot);
+}
+
+/* Keeps the authorizations of processes in the file at @path from now on,
+ * after picking up those still valid from it
+ */
+static void
+temporary_authorization_store_set_journal (TemporaryAuthorizationStore *store,
+                                           const gchar                 *path)
+{
+  GError *error;
+  GList *l;
+  guint num_before;
+  guint num_restored;
+
+  if (g_strcmp0 (path, store->journal_path) == 0)
+    return;
+
+  if (store->journal != NULL)
+    {
+      for (l = store->authorizations; l != NULL; l = l->next)
+        ((TemporaryAuthorization *) l->data)->journal_slot = -1;
+      polkit_backend_authorization_journal_free (store->journal);
+      store->journal = NULL;
+    }
+  g_free (store->journal_path);
+  store->journal_path = NULL;
+
+  if (path == NULL)
+    return;
+
+  error = NULL;
+  store->journal = polkit_backend_authorization_journal_open (path, &error);
+  if (store->journal == NULL)
+    {
+      g_printerr ("Error opening temporary authorization journal: %s\n", error->message);
+      g_error_free (error);
+      return;
     }
+  store->journal_path = g_strdup (path);
 
-  /* TODO: right now the time the temporary authorization is kept is hard-coded - we
-   *       could make it a propery on the PolkitBackendInteractiveAuthority class (so
-   *       the local authority could read it from a config file) or a vfunc
-   *       (so the local authority could read it from an annotation on the action).
-   */
-  expiration_seconds = 5 * 60;
-
-  authorization = g_new0 (TemporaryAuthorization, 1);
-  authorization->id = g_strdup_printf ("tmpauthz%" G_GUINT64_FORMAT, store->serial++);
-  authorization->store = store;
-  authorization->subject = g_object_ref (subject_to_use);
-  authorization->scope = g_object_ref (scope);
-  authorization->action_id = g_strdup (action_id);
-  /* store monotonic time and convert to secs-since-epoch when returning TemporaryAuthorization structs */
-  authorization->time_granted = g_get_monotonic_time ();
-  authorization->time_expires = authorization->time_granted + expiration_seconds * G_USEC_PER_SEC;
-  /* g_timeout_add() is using monotonic time since 2.28 */
-  authorization->expiration_timeout_id = g_timeout_add (expiration_seconds * 1000,
-                                                        on_expiration_timeout,
-                                                        authorization);
+  num_before = g_list_length (store->authorizations);
+  polkit_backend_authorization_journal_foreach (store->journal, on_journal_authorization, store);
+  num_restored = g_list_length (store->authorizations) - num_before;
 
-  if (POLKIT_IS_UNIX_PROCESS (authorization->subject))
+  /* the authorizations obtained before go in as well */
+  for (l = store->authorizations; l != NULL; l = l->next)
     {
-      /* For now, set up a timer to poll every two seconds - this is used to determine
-       * when the process vanishes. We want to do this so we can remove the temporary
-       * authorization - this is because we want agents to update e.g. a notification
-       * area icon saying the user has temporary authorizations (e.g. remove the icon).
-       *
-       * Ideally we'd just do
-       *
-       *   g_signal_connect (kernel, "process-exited", G_CALLBACK (on_process_exited), user_data);
-       *
-       * but that is not how things work right now (and, hey, it's not like the kernel
-       * is a GObject either!) - so we poll.
-       *
-       * TODO: On Linux, it might be possible to obtain notifications by connecting
-       *       to the netlink socket. Needs looking into.
-       */
+      TemporaryAuthorization *authorization = l->data;
 
-      authorization->check_vanished_timeout_id = g_timeout_add_seconds (2,
-                                                                        on_unix_process_check_vanished_timeout,
-                                                                        authorization);
+      if (authorization->journal_slot >= 0)
+        continue;
+      authorization->journal_slot = polkit_backend_authorization_journal_add (store->journal,
+                                                                              authorization->subject,
+                                                                              authorization->scope,
+                                                                              authorization->action_id,
+                                                                              authorization->time_granted,
+                                                                              authorization->time_expires);
     }
-#if 0
-  else if (POLKIT_IS_SYSTEM_BUS_NAME (authorization->subject))
+
+  if (num_restored > 0)
     {
-      /* This is currently handled in polkit_backend_interactive_authority_system_bus_name_owner_changed()  */
+      g_debug ("Restored %u temporary authorizations from %s", num_restored, path);
+      g_signal_emit_by_name (store->authority, "changed");
     }
-#endif
+}
 
+static const gchar *
+temporary_authorization_store_get_journal (TemporaryAuthorizationStore *store)
+{
+  return store->journal_path;
+}
 
-  store->authorizations = g_list_prepend (store->authorizations, authorization);
+/* What a hash table entry costs, besides the key and value themselves */
+#define HASH_ENTRY_SIZE (2 * sizeof (gpointer) + sizeof (guint))
 
-  g_object_unref (subject_to_use);
+/* Whether @store has no authorizations left, as expired ones are removed right away */
+static gboolean
+temporary_authorization_store_is_empty (TemporaryAuthorizationStore *store)
+{
+  return store->authorizations == NULL;
+}
 
-  return authorization->id;
+static void
+temporary_authorization_store_get_memory_usage (TemporaryAuthorizationStore *store,
+                                                guint64                     *bytes,
+                                                guint64                     *objects)
+{
+  GList *l;
+
+  for (l = store->authorizations; l != NULL; l = l->next)
+    {
+      TemporaryAuthorization *authorization = l->data;
+
+      /* the authorization, its list nodes, its entry by id and its heap slot */
+      *bytes += sizeof (TemporaryAuthorization) + 3 * sizeof (GList) + HASH_ENTRY_SIZE + sizeof (gpointer);
+      *bytes += strlen (authorization->id) + 1;
+      *bytes += strlen (authorization->action_id) + 1;
+      *objects += 1;
+    }
+
+  *bytes += g_hash_table_size (store->by_subject) * (sizeof (TemporaryAuthorizationBucket) + HASH_ENTRY_SIZE);
+  *bytes += g_hash_table_size (store->by_bus_name) * (sizeof (GQueue) + HASH_ENTRY_SIZE);
+  *bytes += g_hash_table_size (store->by_scope) * (sizeof (GQueue) + HASH_ENTRY_SIZE);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -3334,11 +6953,13 @@ polkit_backend_interactive_authority_enumerate_temporary_authorizations (PolkitB
   PolkitSubject *session_for_caller;
   GList *ret;
   GList *l;
+  GQueue *queue;
   gint64 monotonic_now;
   GTimeVal real_now;
 
   interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_ENUMERATE_TEMPORARY_AUTHORIZATIONS);
 
   ret = NULL;
   session_for_caller = NULL;
@@ -3376,16 +6997,14 @@ polkit_backend_interactive_authority_enumerate_temporary_authorizations (PolkitB
   monotonic_now = g_get_monotonic_time ();
   g_get_current_time (&real_now);
 
-  for (l = priv->temporary_authorization_store->authorizations; l != NULL; l = l->next)
+  queue = g_hash_table_lookup (priv->temporary_authorization_store->by_scope, subject);
+  for (l = queue != NULL ? queue->head : NULL; l != NULL; l = l->next)
     {
       TemporaryAuthorization *ta = l->data;
       PolkitTemporaryAuthorization *tmp_authz;
       guint64 real_granted;
       guint64 real_expires;
 
-      if (!polkit_subject_equal (ta->scope, subject))
-        continue;
-
       real_granted = (ta->time_granted - monotonic_now) / G_USEC_PER_SEC + real_now.tv_sec;
       real_expires = (ta->time_expires - monotonic_now) / G_USEC_PER_SEC + real_now.tv_sec;
 
@@ -3417,12 +7036,11 @@ polkit_backend_interactive_authority_revoke_temporary_authorizations (PolkitBack
   PolkitBackendInteractiveAuthorityPrivate *priv;
   PolkitSubject *session_for_caller;
   gboolean ret;
-  GList *l;
-  GList *ll;
   guint num_removed;
 
   interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_REVOKE_TEMPORARY_AUTHORIZATIONS);
 
   ret = FALSE;
   session_for_caller = NULL;
@@ -3457,22 +7075,8 @@ polkit_backend_interactive_authority_revoke_temporary_authorizations (PolkitBack
       goto out;
     }
 
-  num_removed = 0;
-  for (l = priv->temporary_authorization_store->authorizations; l != NULL; l = ll)
-    {
-      TemporaryAuthorization *ta = l->data;
-
-      ll = l->next;
-
-      if (!polkit_subject_equal (ta->scope, subject))
-        continue;
-
-      priv->temporary_authorization_store->authorizations = g_list_remove (priv->temporary_authorization_store->authorizations, ta);
-      temporary_authorization_free (ta);
-
-      num_removed++;
-    }
-
+  num_removed = temporary_authorization_store_remove_authorizations_for_scope (priv->temporary_authorization_store,
+                                                                              subject);
   if (num_removed > 0)
     g_signal_emit_by_name (authority, "changed");
 
@@ -3496,13 +7100,12 @@ polkit_backend_interactive_authority_revoke_temporary_authorization_by_id (Polki
   PolkitBackendInteractiveAuthority *interactive_authority;
   PolkitBackendInteractiveAuthorityPrivate *priv;
   PolkitSubject *session_for_caller;
+  TemporaryAuthorization *ta;
   gboolean ret;
-  GList *l;
-  GList *ll;
-  guint num_removed;
 
   interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
   priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (interactive_authority);
+  metrics_count_call (priv, POLKIT_BACKEND_METRICS_METHOD_REVOKE_TEMPORARY_AUTHORIZATIONS);
 
   ret = FALSE;
   session_for_caller = NULL;
@@ -3519,45 +7122,31 @@ polkit_backend_interactive_authority_revoke_temporary_authorization_by_id (Polki
       goto out;
     }
 
-  num_removed = 0;
-  for (l = priv->temporary_authorization_store->authorizations; l != NULL; l = ll)
+  ta = g_hash_table_lookup (priv->temporary_authorization_store->by_id, id);
+  if (ta == NULL)
     {
-      TemporaryAuthorization *ta = l->data;
-
-      ll = l->next;
-
-      if (strcmp (ta->id, id) != 0)
-        continue;
-
-      if (!polkit_subject_equal (session_for_caller, ta->scope))
-        {
-          g_set_error (error,
-                       POLKIT_ERROR,
-                       POLKIT_ERROR_FAILED,
-                       "Cannot remove a temporary authorization belonging to another subject.");
-          goto out;
-        }
-
-      priv->temporary_authorization_store->authorizations = g_list_remove (priv->temporary_authorization_store->authorizations, ta);
-      temporary_authorization_free (ta);
-
-      num_removed++;
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "No such authorization with id `%s'",
+                   id);
+      goto out;
     }
 
-  if (num_removed > 0)
-    {
-      g_signal_emit_by_name (authority, "changed");
-    }
-  else
+  if (!polkit_subject_equal (session_for_caller, ta->scope))
     {
       g_set_error (error,
                    POLKIT_ERROR,
                    POLKIT_ERROR_FAILED,
-                   "No such authorization with id `%s'",
-                   id);
+                   "Cannot remove a temporary authorization belonging to another subject.");
       goto out;
     }
 
+  temporary_authorization_store_remove (priv->temporary_authorization_store, ta, TEMPORARY_AUTHORIZATION_REVOKED);
+  temporary_authorization_free (ta);
+
+  g_signal_emit_by_name (authority, "changed");
+
   ret = TRUE;
 
  out:
@@ -3568,3 +7157,416 @@ polkit_backend_interactive_authority_revoke_temporary_authorization_by_id (Polki
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
+
+static const gchar metrics_introspection_data[] =
+  "<node>"
+  "  <interface name='org.freedesktop.PolicyKit1.Metrics'>"
+  "    <method name='GetMetrics'>"
+  "      <arg type='a{sv}' name='metrics' direction='out'/>"
+  "    </method>"
+  "    <method name='TrimMemory'/>"
+  "  </interface>"
+  "</node>";
+
+typedef struct
+{
+  PolkitBackendInteractiveAuthority *authority;
+  GDBusConnection *connection;
+  GDBusNodeInfo *introspection_data;
+  guint id;
+} MetricsRegistration;
+
+/**
+ * polkit_backend_interactive_authority_add_memory_usage:
+ * @builder: A #GVariantBuilder for a dictionary of type <literal>a{s(tt)}</literal>.
+ * @subsystem: The name of what holds the memory.
+ * @bytes: About how many bytes @subsystem holds.
+ * @objects: How many objects those bytes are for.
+ *
+ * Adds the memory used by @subsystem to the <literal>memory</literal>
+ * entry of the metrics.
+ */
+void
+polkit_backend_interactive_authority_add_memory_usage (GVariantBuilder *builder,
+                                                       const gchar     *subsystem,
+                                                       guint64          bytes,
+                                                       guint64          objects)
+{
+  g_variant_builder_add (builder, "{s(tt)}", subsystem, bytes, objects);
+}
+
+/* Estimates from the size of what every subsystem holds on to; the
+ * allocator's own overhead and fragmentation aren't accounted for
+ */
+static GVariant *
+get_memory_usage (PolkitBackendInteractiveAuthority *authority)
+{
+  PolkitBackendInteractiveAuthorityClass *klass;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GVariantBuilder builder;
+  GHashTableIter hash_iter;
+  AuthenticationAgent *agent;
+  PolkitSubject *scope;
+  AuthenticationSession *session;
+  LocalizedChallengeData *data;
+  const gchar *key;
+  guint64 bytes;
+  guint64 objects;
+
+  klass = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(tt)}"));
+
+  bytes = objects = 0;
+  polkit_backend_action_pool_get_memory_usage (priv->action_pool, &bytes, &objects);
+  polkit_backend_interactive_authority_add_memory_usage (&builder, "action-pool", bytes, objects);
+
+  bytes = objects = 0;
+  temporary_authorization_store_get_memory_usage (priv->temporary_authorization_store, &bytes, &objects);
+  polkit_backend_interactive_authority_add_memory_usage (&builder, "temporary-authorizations", bytes, objects);
+
+  bytes = objects = 0;
+  g_hash_table_iter_init (&hash_iter, priv->hash_scope_to_authentication_agent);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &scope, (gpointer) &agent))
+    {
+      bytes += HASH_ENTRY_SIZE + sizeof (gpointer);
+      /* an agent shared by several scopes is only counted once */
+      if (scope != g_ptr_array_index (agent->scopes, 0))
+        continue;
+      bytes += sizeof (AuthenticationAgent) + sizeof (GPtrArray);
+      bytes += strlen (agent->object_path) + 1;
+      bytes += strlen (agent->unique_system_bus_name) + 1;
+      bytes += agent->locale != NULL ? strlen (agent->locale) + 1 : 0;
+      bytes += agent->cookie_prefix != NULL ? strlen (agent->cookie_prefix) + 1 : 0;
+      bytes += agent->registration_options != NULL ? g_variant_get_size (agent->registration_options) : 0;
+      objects++;
+    }
+  polkit_backend_interactive_authority_add_memory_usage (&builder, "authentication-agents", bytes, objects);
+
+  bytes = objects = 0;
+  g_hash_table_iter_init (&hash_iter, priv->hash_cookie_to_authentication_session);
+  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &session))
+    {
+      bytes += sizeof (AuthenticationSession) + HASH_ENTRY_SIZE;
+      bytes += strlen (session->cookie) + 1;
+      bytes += strlen (session->action_id) + 1;
+      bytes += session->initiated_by_system_bus_unique_name != NULL ? strlen (session->initiated_by_system_bus_unique_name) + 1 : 0;
+      bytes += g_list_length (session->identities) * sizeof (GList);
+      objects++;
+    }
+  polkit_backend_interactive_authority_add_memory_usage (&builder, "authentication-sessions", bytes, objects);
+
+  bytes = objects = 0;
+  g_hash_table_iter_init (&hash_iter, priv->hash_key_to_localized_challenge_data);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &key, (gpointer) &data))
+    {
+      bytes += sizeof (LocalizedChallengeData) + HASH_ENTRY_SIZE + strlen (key) + 1;
+      bytes += data->icon_name != NULL ? strlen (data->icon_name) + 1 : 0;
+      if (data->message != NULL)
+        bytes += sizeof (MessageTemplate) + 2 * (strlen (data->message->message) + 1) +
+                 data->message->n_segments * sizeof (MessageSegment);
+      objects++;
+    }
+  polkit_backend_interactive_authority_add_memory_usage (&builder, "challenge-data-cache", bytes, objects);
+
+  bytes = objects = 0;
+  policy_identity_cache_get_memory_usage (priv->identities, &bytes, &objects);
+  polkit_backend_interactive_authority_add_memory_usage (&builder, "identity-cache", bytes, objects);
+
+  if (klass->get_memory_usage != NULL)
+    klass->get_memory_usage (authority, &builder);
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * polkit_backend_interactive_authority_trim_memory:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ *
+ * Releases the memory held by caches that are filled again on demand,
+ * and has the allocator return free memory to the system. Done after
+ * the actions or rules are reloaded, since that leaves much memory
+ * unused, and whenever asked to through the metrics interface.
+ */
+void
+polkit_backend_interactive_authority_trim_memory (PolkitBackendInteractiveAuthority *authority)
+{
+  PolkitBackendInteractiveAuthorityClass *klass;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+
+  klass = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority);
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  g_hash_table_remove_all (priv->hash_key_to_localized_challenge_data);
+  polkit_backend_action_pool_trim (priv->action_pool);
+
+  if (klass->trim_memory != NULL)
+    klass->trim_memory (authority);
+
+#ifdef HAVE_MALLOC_TRIM
+  malloc_trim (0);
+#endif
+}
+
+/* The counters, along with how many of everything there is right now */
+static GVariant *
+metrics_get_metrics (PolkitBackendInteractiveAuthority *authority)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GVariantBuilder builder;
+  GList *sessions;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  polkit_backend_metrics_snapshot (priv->metrics, &builder);
+
+  sessions = polkit_backend_session_monitor_get_sessions (priv->session_monitor);
+  g_variant_builder_add (&builder, "{sv}", "sessions",
+                         g_variant_new_uint32 (g_list_length (sessions)));
+  g_list_free_full (sessions, g_object_unref);
+
+  g_variant_builder_add (&builder, "{sv}", "authentication-agents",
+                         g_variant_new_uint32 (g_hash_table_size (priv->hash_scope_to_authentication_agent)));
+  g_variant_builder_add (&builder, "{sv}", "authentication-sessions",
+                         g_variant_new_uint32 (g_hash_table_size (priv->hash_cookie_to_authentication_session)));
+  g_variant_builder_add (&builder, "{sv}", "pending-challenges",
+                         g_variant_new_uint32 (g_hash_table_size (priv->hash_key_to_pending_challenge)));
+  g_variant_builder_add (&builder, "{sv}", "temporary-authorizations",
+                         g_variant_new_uint32 (g_hash_table_size (priv->temporary_authorization_store->by_id)));
+
+  if (priv->check_queue != NULL)
+    {
+      g_variant_builder_add (&builder, "{sv}", "checks-queued",
+                             g_variant_new_uint32 (polkit_backend_check_queue_get_n_queued (priv->check_queue)));
+      g_variant_builder_add (&builder, "{sv}", "checks-running",
+                             g_variant_new_uint32 (polkit_backend_check_queue_get_n_running (priv->check_queue)));
+      g_variant_builder_add (&builder, "{sv}", "checks-rejected",
+                             g_variant_new_uint32 (polkit_backend_check_queue_get_n_rejected (priv->check_queue)));
+    }
+
+  g_variant_builder_add (&builder, "{sv}", "audit-records-dropped",
+                         g_variant_new_uint32 (polkit_backend_audit_log_get_dropped (priv->audit_log)));
+
+  g_variant_builder_add (&builder, "{sv}", "memory", get_memory_usage (authority));
+
+  return g_variant_new ("(a{sv})", &builder);
+}
+
+static void
+metrics_method_call (GDBusConnection       *connection,
+                     const gchar           *sender,
+                     const gchar           *object_path,
+                     const gchar           *interface_name,
+                     const gchar           *method_name,
+                     GVariant              *parameters,
+                     GDBusMethodInvocation *invocation,
+                     gpointer               user_data)
+{
+  MetricsRegistration *registration = user_data;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitSubject *caller;
+  PolkitIdentity *user_of_caller;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (registration->authority);
+
+  /* what is being checked and how often says a fair bit about who does what */
+  caller = polkit_system_bus_name_new (sender);
+  user_of_caller = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
+                                                                        caller, NULL,
+                                                                        NULL);
+  g_object_unref (caller);
+  if (!identity_is_root_user (user_of_caller))
+    {
+      g_dbus_method_invocation_return_error_literal (invocation,
+                                                     G_DBUS_ERROR,
+                                                     G_DBUS_ERROR_ACCESS_DENIED,
+                                                     "Only root may read the metrics");
+      goto out;
+    }
+
+  if (g_strcmp0 (method_name, "GetMetrics") == 0)
+    {
+      g_dbus_method_invocation_return_value (invocation, metrics_get_metrics (registration->authority));
+    }
+  else if (g_strcmp0 (method_name, "TrimMemory") == 0)
+    {
+      polkit_backend_interactive_authority_trim_memory (registration->authority);
+      g_dbus_method_invocation_return_value (invocation, NULL);
+    }
+  else
+    g_assert_not_reached ();
+
+ out:
+  if (user_of_caller != NULL)
+    g_object_unref (user_of_caller);
+}
+
+static const GDBusInterfaceVTable metrics_vtable =
+{
+  metrics_method_call,
+  NULL,
+  NULL,
+};
+
+/**
+ * polkit_backend_interactive_authority_get_metrics:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ *
+ * Gets the metrics subclasses may record to.
+ *
+ * Returns: A #PolkitBackendMetrics owned by @authority, or %NULL if
+ *   metrics aren't being collected.
+ */
+PolkitBackendMetrics *
+polkit_backend_interactive_authority_get_metrics (PolkitBackendInteractiveAuthority *authority)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority), NULL);
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  return g_atomic_pointer_get (&priv->metrics);
+}
+
+/**
+ * polkit_backend_interactive_authority_is_explaining:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @details: The details a check was handed to the subclass with.
+ *
+ * Checks whether the caller asked for the check to be explained, see
+ * polkit_backend_interactive_authority_explain(). Subclasses may then
+ * want to skip whatever doesn't remember what decided a check, such as
+ * a cache of answers.
+ *
+ * Returns: %TRUE if the check is being explained.
+ */
+gboolean
+polkit_backend_interactive_authority_is_explaining (PolkitBackendInteractiveAuthority *authority,
+                                                    PolkitDetails                     *details)
+{
+  g_return_val_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority), FALSE);
+
+  return details != NULL && g_object_get_data (G_OBJECT (details), EXPLAIN_DATA_KEY) != NULL;
+}
+
+/**
+ * polkit_backend_interactive_authority_explain:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @details: The details a check was handed to the subclass with.
+ * @source: What decided the check, e.g. "rule".
+ * @rule: (allow-none): The rule that decided the check, or %NULL.
+ * @file: (allow-none): The file @rule is in, or %NULL.
+ *
+ * Lets a subclass say what decided a check it answered, for the caller
+ * to see if it asked for the check to be explained. Does nothing
+ * otherwise. May be called from the check pool.
+ */
+void
+polkit_backend_interactive_authority_explain (PolkitBackendInteractiveAuthority *authority,
+                                              PolkitDetails                     *details,
+                                              const gchar                       *source,
+                                              const gchar                       *rule,
+                                              const gchar                       *file)
+{
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+  g_return_if_fail (source != NULL);
+
+  if (!polkit_backend_interactive_authority_is_explaining (authority, details))
+    return;
+
+  polkit_details_insert (details, "polkit.explain.source", source);
+  if (rule != NULL)
+    polkit_details_insert (details, "polkit.explain.rule", rule);
+  if (file != NULL)
+    polkit_details_insert (details, "polkit.explain.file", file);
+}
+
+/**
+ * polkit_backend_interactive_authority_register_metrics:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @connection: The #GDBusConnection to export on.
+ * @object_path: The object path to export at.
+ * @error: Return location for error or %NULL.
+ *
+ * Starts collecting metrics and exports the
+ * <literal>org.freedesktop.PolicyKit1.Metrics</literal> interface at
+ * @object_path. Only processes running as root may read it.
+ *
+ * Metrics are collected from then on for as long as @authority lives,
+ * and only one registration may exist at a time.
+ *
+ * Returns: A registration id to pass to
+ *   polkit_backend_interactive_authority_unregister_metrics(), or
+ *   %NULL if @error is set.
+ */
+gpointer
+polkit_backend_interactive_authority_register_metrics (PolkitBackendInteractiveAuthority  *authority,
+                                                       GDBusConnection                    *connection,
+                                                       const gchar                        *object_path,
+                                                       GError                            **error)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  MetricsRegistration *registration;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), NULL);
+  g_return_val_if_fail (object_path != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (authority);
+
+  g_return_val_if_fail (priv->metrics_registration == NULL, NULL);
+
+  registration = g_new0 (MetricsRegistration, 1);
+  registration->authority = authority;
+  registration->introspection_data = g_dbus_node_info_new_for_xml (metrics_introspection_data, NULL);
+  g_assert (registration->introspection_data != NULL);
+
+  registration->id = g_dbus_connection_register_object (connection,
+                                                        object_path,
+                                                        registration->introspection_data->interfaces[0],
+                                                        &metrics_vtable,
+                                                        registration,
+                                                        NULL,
+                                                        error);
+  if (registration->id == 0)
+    {
+      g_dbus_node_info_unref (registration->introspection_data);
+      g_free (registration);
+      return NULL;
+    }
+  registration->connection = g_object_ref (connection);
+
+  /* the workers of the check pool only ever see it set or not set */
+  if (priv->metrics == NULL)
+    g_atomic_pointer_set (&priv->metrics, polkit_backend_metrics_new ());
+  priv->metrics_registration = registration;
+
+  return registration;
+}
+
+/**
+ * polkit_backend_interactive_authority_unregister_metrics:
+ * @registration_id: A registration id from polkit_backend_interactive_authority_register_metrics().
+ *
+ * Stops exporting the metrics. They keep being collected.
+ */
+void
+polkit_backend_interactive_authority_unregister_metrics (gpointer registration_id)
+{
+  MetricsRegistration *registration = registration_id;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  priv = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_PRIVATE (registration->authority);
+  priv->metrics_registration = NULL;
+
+  g_dbus_connection_unregister_object (registration->connection, registration->id);
+  g_object_unref (registration->connection);
+  g_dbus_node_info_unref (registration->introspection_data);
+  g_free (registration);
+}
@@ -59,6 +59,16 @@ struct _PolkitBackendInteractiveAuthority
  *   implementation. See polkit_backend_interactive_authority_get_admin_identities() for details.
  * @check_authorization_sync: Checks for an authorization or %NULL to use the default implementation.
  *  See polkit_backend_interactive_authority_check_authorization_sync() for details.
+ * @get_memory_usage: Adds the memory held by the subclass to a dictionary of type
+ *  <literal>a{s(tt)}</literal> with polkit_backend_interactive_authority_add_memory_usage(), or %NULL.
+ * @trim_memory: Releases memory held by caches of the subclass, or %NULL.
+ *  See polkit_backend_interactive_authority_trim_memory() for details.
+ * @check_authorization_async: Checks for an authorization without blocking, or %NULL to run
+ *  @check_authorization_sync in a thread. See polkit_backend_interactive_authority_check_authorization_async().
+ * @check_authorization_async_finish: Finishes @check_authorization_async, or %NULL if that is %NULL too.
+ * @get_admin_identities_async: Gets the identities for administrator authentication without blocking,
+ *  or %NULL to call @get_admin_identities. See polkit_backend_interactive_authority_get_admin_identities_async().
+ * @get_admin_identities_async_finish: Finishes @get_admin_identities_async, or %NULL if that is %NULL too.
  *
  * Class structure for #PolkitBackendInteractiveAuthority.
  */
@@ -75,7 +85,8 @@ struct _PolkitBackendInteractiveAuthorityClass
                                                                 gboolean                           subject_is_local,
                                                                 gboolean                           subject_is_active,
                                                                 const gchar                       *action_id,
-                                                                PolkitDetails                     *details);
+                                                                PolkitDetails                     *details,
+                                                                PolkitBackendSubjectInfo          *subject_info);
 
   PolkitImplicitAuthorization (*check_authorization_sync) (PolkitBackendInteractiveAuthority *authority,
                                                            PolkitSubject                     *caller,
@@ -85,16 +96,49 @@ struct _PolkitBackendInteractiveAuthorityClass
                                                            gboolean                           subject_is_active,
                                                            const gchar                       *action_id,
                                                            PolkitDetails                     *details,
-                                                           PolkitImplicitAuthorization        implicit);
+                                                           PolkitImplicitAuthorization        implicit,
+                                                           PolkitBackendSubjectInfo          *subject_info);
+
+  void                        (*get_memory_usage)         (PolkitBackendInteractiveAuthority *authority,
+                                                           GVariantBuilder                   *builder);
+
+  void                        (*trim_memory)              (PolkitBackendInteractiveAuthority *authority);
+
+  void                        (*check_authorization_async)  (PolkitBackendInteractiveAuthority *authority,
+                                                             PolkitSubject                     *caller,
+                                                             PolkitSubject                     *subject,
+                                                             PolkitIdentity                    *user_for_subject,
+                                                             gboolean                           subject_is_local,
+                                                             gboolean                           subject_is_active,
+                                                             const gchar                       *action_id,
+                                                             PolkitDetails                     *details,
+                                                             PolkitImplicitAuthorization        implicit,
+                                                             PolkitBackendSubjectInfo          *subject_info,
+                                                             GCancellable                      *cancellable,
+                                                             GAsyncReadyCallback                callback,
+                                                             gpointer                           user_data);
+
+  PolkitImplicitAuthorization (*check_authorization_async_finish) (PolkitBackendInteractiveAuthority *authority,
+                                                                   GAsyncResult                      *res);
+
+  void                        (*get_admin_identities_async)  (PolkitBackendInteractiveAuthority *authority,
+                                                              PolkitSubject                     *caller,
+                                                              PolkitSubject                     *subject,
+                                                              PolkitIdentity                    *user_for_subject,
+                                                              gboolean                           subject_is_local,
+                                                              gboolean                           subject_is_active,
+                                                              const gchar                       *action_id,
+                                                              PolkitDetails                     *details,
+                                                              PolkitBackendSubjectInfo          *subject_info,
+                                                              GCancellable                      *cancellable,
+                                                              GAsyncReadyCallback                callback,
+                                                              gpointer                           user_data);
+
+  GList *                     (*get_admin_identities_async_finish) (PolkitBackendInteractiveAuthority *authority,
+                                                                    GAsyncResult                      *res);
 
   /*< private >*/
   /* Padding for future expansion */
-  void (*_polkit_reserved1) (void);
-  void (*_polkit_reserved2) (void);
-  void (*_polkit_reserved3) (void);
-  void (*_polkit_reserved4) (void);
-  void (*_polkit_reserved5) (void);
-  void (*_polkit_reserved6) (void);
   void (*_polkit_reserved7) (void);
   void (*_polkit_reserved8) (void);
   void (*_polkit_reserved9) (void);
@@ -131,7 +175,56 @@ GList  *polkit_backend_interactive_authority_get_admin_identities (PolkitBackend
                                                                    gboolean                           subject_is_local,
                                                                    gboolean                           subject_is_active,
                                                                    const gchar                       *action_id,
-                                                                   PolkitDetails                     *details);
+                                                                   PolkitDetails                     *details,
+                                                                   PolkitBackendSubjectInfo          *subject_info);
+void    polkit_backend_interactive_authority_get_admin_identities_async (PolkitBackendInteractiveAuthority *authority,
+                                                                         PolkitSubject                     *caller,
+                                                                         PolkitSubject                     *subject,
+                                                                         PolkitIdentity                    *user_for_subject,
+                                                                         gboolean                           subject_is_local,
+                                                                         gboolean                           subject_is_active,
+                                                                         const gchar                       *action_id,
+                                                                         PolkitDetails                     *details,
+                                                                         PolkitBackendSubjectInfo          *subject_info,
+                                                                         GCancellable                      *cancellable,
+                                                                         GAsyncReadyCallback                callback,
+                                                                         gpointer                           user_data);
+GList  *polkit_backend_interactive_authority_get_admin_identities_async_finish (PolkitBackendInteractiveAuthority *authority,
+                                                                                GAsyncResult                      *res);
+void    polkit_backend_interactive_authority_prefetch_admin_identities (PolkitBackendInteractiveAuthority *authority,
+                                                                        GList                             *identities);
+
+void    polkit_backend_interactive_authority_actions_changed (PolkitBackendInteractiveAuthority *authority,
+                                                              const gchar * const               *action_ids);
+
+void    polkit_backend_interactive_authority_warm_up        (PolkitBackendInteractiveAuthority *authority,
+                                                             GAsyncReadyCallback                callback,
+                                                             gpointer                           user_data);
+void    polkit_backend_interactive_authority_warm_up_finish (PolkitBackendInteractiveAuthority *authority,
+                                                             GAsyncResult                      *res);
+
+gint64  polkit_backend_interactive_authority_get_idle_time  (PolkitBackendInteractiveAuthority *authority);
+
+PolkitBackendMetrics *polkit_backend_interactive_authority_get_metrics        (PolkitBackendInteractiveAuthority  *authority);
+gpointer              polkit_backend_interactive_authority_register_metrics   (PolkitBackendInteractiveAuthority  *authority,
+                                                                               GDBusConnection                    *connection,
+                                                                               const gchar                        *object_path,
+                                                                               GError                            **error);
+void                  polkit_backend_interactive_authority_unregister_metrics (gpointer                            registration_id);
+
+gboolean polkit_backend_interactive_authority_is_explaining (PolkitBackendInteractiveAuthority *authority,
+                                                             PolkitDetails                     *details);
+void     polkit_backend_interactive_authority_explain        (PolkitBackendInteractiveAuthority *authority,
+                                                             PolkitDetails                     *details,
+                                                             const gchar                       *source,
+                                                             const gchar                       *rule,
+                                                             const gchar                       *file);
+
+void    polkit_backend_interactive_authority_add_memory_usage (GVariantBuilder                   *builder,
+                                                               const gchar                       *subsystem,
+                                                               guint64                            bytes,
+                                                               guint64                            objects);
+void    polkit_backend_interactive_authority_trim_memory      (PolkitBackendInteractiveAuthority *authority);
 
 PolkitImplicitAuthorization polkit_backend_interactive_authority_check_authorization_sync (
                                                           PolkitBackendInteractiveAuthority *authority,
@@ -142,7 +235,25 @@ PolkitImplicitAuthorization polkit_backend_interactive_authority_check_authoriza
                                                           gboolean                           subject_is_active,
                                                           const gchar                       *action_id,
                                                           PolkitDetails                     *details,
-                                                          PolkitImplicitAuthorization        implicit);
+                                                          PolkitImplicitAuthorization        implicit,
+                                                          PolkitBackendSubjectInfo          *subject_info);
+void                        polkit_backend_interactive_authority_check_authorization_async (
+                                                          PolkitBackendInteractiveAuthority *authority,
+                                                          PolkitSubject                     *caller,
+                                                          PolkitSubject                     *subject,
+                                                          PolkitIdentity                    *user_for_subject,
+                                                          gboolean                           subject_is_local,
+                                                          gboolean                           subject_is_active,
+                                                          const gchar                       *action_id,
+                                                          PolkitDetails                     *details,
+                                                          PolkitImplicitAuthorization        implicit,
+                                                          PolkitBackendSubjectInfo          *subject_info,
+                                                          GCancellable                      *cancellable,
+                                                          GAsyncReadyCallback                callback,
+                                                          gpointer                           user_data);
+PolkitImplicitAuthorization polkit_backend_interactive_authority_check_authorization_async_finish (
+                                                          PolkitBackendInteractiveAuthority *authority,
+                                                          GAsyncResult                      *res);
 
 G_END_DECLS
 
@@ -24,8 +24,7 @@
 
 #include "config.h"
 #include <errno.h>
-#include <grp.h>
-#include <pwd.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #ifdef HAVE_NETGROUP_H
 #include <netgroup.h>
@@ -39,14 +38,22 @@
 #include <string.h>
 
 #include "polkitbackendkeyfileauthority.h"
+#include "polkitbackendmetrics.h"
+#include "polkitbackendpolicyarena.h"
+#include "polkitbackendpolicycache.h"
 #include "polkitbackendpolicyfile.h"
+#include "polkitbackendpolicyloader.h"
+#include "polkitbackendpolicyruleset.h"
+#include "polkitbackendprobes.h"
+#include "polkitbackendsubjectinfo.h"
 #include <polkit/polkit.h>
 
-#include <polkit/polkitprivate.h>
+#ifdef HAVE_BUILTIN_RULES
+/* The default rules, compiled at build time by mkbuiltinrules */
+#include "polkitbackendbuiltinrules.h"
+#endif
 
-#ifdef HAVE_LIBSYSTEMD
-#include <systemd/sd-login.h>
-#endif /* HAVE_LIBSYSTEMD */
+#include <polkit/polkitprivate.h>
 
 /**
  * SECTION:polkitbackendkeyfileauthority
@@ -63,15 +70,67 @@
 /* ----------------------------------------------------------------------------------------------------
  */
 
+/**
+ * Number of log2 buckets in each per-check histogram
+ */
+#define KEYFILE_HISTOGRAM_BUCKETS 32
+
 struct _PolkitBackendKeyfileAuthorityPrivate
 {
   gchar **rules_dirs;
   GFileMonitor *
       *dir_monitors; /* NULL-terminated array of GFileMonitor instances */
 
-  PolicyFile *policy; /* Linked series of policies */
+  GMutex ruleset_lock;    /* Guards swapping the ruleset pointer */
+  PolicyRuleset *ruleset; /* Compiled series of policies, never NULL */
+  GMutex cache_lock;      /* Checks are evaluated from worker threads */
+  PolicyCache *cache;     /* Recent ruleset outcomes */
+  PolicyNetgroupCache *netgroups; /* Recent InNetGroups= lookups */
+
+  GThreadPool *reload_pool;  /* Compiles rulesets off the main loop */
+  gboolean reload_in_flight; /* A ruleset is being compiled in a thread */
+  gboolean reload_pending;   /* Rules changed again while compiling */
+  gint64 reload_started;     /* When the reload in flight began */
+  guint reload_delay;        /* Milliseconds of quiet before reloading */
+  guint reload_source_id;    /* Pending debounced reload */
+
+  /* Only ever used by a single reload at a time */
+  PolicyLoader *loader;
+  GPtrArray *loader_messages; /* Logged from the main loop once it's done */
+  gchar *rules_cache; /* Precompiled image of the rules, or NULL */
+  gchar *rules_bundle; /* Signed rules loaded instead of rules_dirs, or NULL */
+  gchar *rules_bundle_key; /* The key rules_bundle is signed with */
+  GVariant *load_profile; /* Of the last compile, see keyfile_update_load_profile() */
+
+  /* Test every check against the rules one by one too, and serve that */
+  volatile gint shadow_evaluation;
+
+  /* Evaluated (i.e. uncached) checks, see keyfile_histogram_bucket() */
+  volatile gsize rules_tested[KEYFILE_HISTOGRAM_BUCKETS];
+  volatile gsize prepare_usec[KEYFILE_HISTOGRAM_BUCKETS];
 };
 
+/**
+ * Default quiet period after the last monitor event before reloading. A
+ * single editor save emits 4-8 events.
+ */
+#define KEYFILE_RELOAD_DELAY 500
+
+/**
+ * Bounds for the decision cache. Entries also expire so that changes in
+ * group membership are picked up without a reload.
+ */
+#define KEYFILE_CACHE_SIZE 1024
+#define KEYFILE_CACHE_TTL (30 * G_USEC_PER_SEC)
+
+/**
+ * Bounds for netgroup lookups. Non-members are forgotten sooner, so that a
+ * user newly added to a netgroup doesn't wait on the full TTL.
+ */
+#define KEYFILE_NETGROUP_SIZE 1024
+#define KEYFILE_NETGROUP_TTL (300 * G_USEC_PER_SEC)
+#define KEYFILE_NETGROUP_NEGATIVE_TTL (60 * G_USEC_PER_SEC)
+
 static void on_dir_monitor_changed (GFileMonitor *monitor, GFile *file,
                                     GFile *other_file,
                                     GFileMonitorEvent event_type,
@@ -84,6 +143,15 @@ enum
 {
   PROP_0,
   PROP_RULES_DIRS,
+  PROP_RELOAD_DELAY,
+  PROP_RULES_CACHE,
+  PROP_CACHE_HITS,
+  PROP_CACHE_MISSES,
+  PROP_CACHE_EVICTIONS,
+  PROP_CACHE_EXPIRED,
+  PROP_SHADOW_EVALUATION,
+  PROP_RULES_BUNDLE,
+  PROP_RULES_BUNDLE_KEY,
 };
 
 /* ----------------------------------------------------------------------------------------------------
@@ -95,7 +163,8 @@ static GList *polkit_backend_keyfile_authority_get_admin_auth_identities (
     PolkitBackendInteractiveAuthority *authority, PolkitSubject *caller,
     PolkitSubject *subject, PolkitIdentity *user_for_subject,
     gboolean subject_is_local, gboolean subject_is_active,
-    const gchar *action_id, PolkitDetails *details);
+    const gchar *action_id, PolkitDetails *details,
+    PolkitBackendSubjectInfo *subject_info);
 
 static PolkitImplicitAuthorization
 polkit_backend_keyfile_authority_check_authorization_sync (
@@ -103,7 +172,16 @@ polkit_backend_keyfile_authority_check_authorization_sync (
     PolkitSubject *subject, PolkitIdentity *user_for_subject,
     gboolean subject_is_local, gboolean subject_is_active,
     const gchar *action_id, PolkitDetails *details,
-    PolkitImplicitAuthorization implicit);
+    PolkitImplicitAuthorization implicit,
+    PolkitBackendSubjectInfo *subject_info);
+
+static void polkit_backend_keyfile_authority_get_memory_usage (
+    PolkitBackendInteractiveAuthority *authority, GVariantBuilder *builder);
+
+static void polkit_backend_keyfile_authority_trim_memory (
+    PolkitBackendInteractiveAuthority *authority);
+
+static void reload_rules_thread_func (gpointer data, gpointer user_data);
 
 G_DEFINE_TYPE (PolkitBackendKeyfileAuthority, polkit_backend_keyfile_authority,
                POLKIT_BACKEND_TYPE_INTERACTIVE_AUTHORITY);
@@ -118,124 +196,299 @@ polkit_backend_keyfile_authority_init (
   authority->priv = G_TYPE_INSTANCE_GET_PRIVATE (
       authority, POLKIT_BACKEND_TYPE_KEYFILE_AUTHORITY,
       PolkitBackendKeyfileAuthorityPrivate);
+  g_mutex_init (&authority->priv->ruleset_lock);
+  g_mutex_init (&authority->priv->cache_lock);
+  authority->priv->reload_pool
+      = g_thread_pool_new (reload_rules_thread_func, NULL, 1, FALSE, NULL);
+  authority->priv->loader_messages = g_ptr_array_new_with_free_func (g_free);
+  authority->priv->cache
+      = policy_cache_new (KEYFILE_CACHE_SIZE, KEYFILE_CACHE_TTL);
+  authority->priv->netgroups = policy_netgroup_cache_new (
+      KEYFILE_NETGROUP_SIZE, KEYFILE_NETGROUP_TTL,
+      KEYFILE_NETGROUP_NEGATIVE_TTL);
 }
 
-static gint
-rules_file_name_cmp (const gchar *a, const gchar *b)
+/**
+ * The loader may be compiling in a worker thread, so what it has to say is
+ * kept along with it and logged by keyfile_flush_loader_log()
+ */
+static void
+keyfile_loader_log (const gchar *message, gpointer user_data)
 {
-  gint ret;
-  const gchar *a_base;
-  const gchar *b_base;
+  PolkitBackendKeyfileAuthority *authority
+      = POLKIT_BACKEND_KEYFILE_AUTHORITY (user_data);
 
-  a_base = strrchr (a, '/');
-  b_base = strrchr (b, '/');
+  g_ptr_array_add (authority->priv->loader_messages, g_strdup (message));
+}
 
-  g_assert (a_base != NULL);
-  g_assert (b_base != NULL);
-  a_base += 1;
-  b_base += 1;
+/**
+ * Log the messages of the loader, from the main loop while nothing else is
+ * using it
+ */
+static void
+keyfile_flush_loader_log (PolkitBackendKeyfileAuthority *authority)
+{
+  GPtrArray *messages = authority->priv->loader_messages;
 
-  ret = g_strcmp0 (a_base, b_base);
-  if (ret == 0)
+  for (guint i = 0; i < messages->len; i++)
     {
-      /* /etc wins over /usr */
-      ret = g_strcmp0 (a, b);
-      g_assert (ret != 0);
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    "%s", (const gchar *)messages->pdata[i]);
     }
+  g_ptr_array_set_size (messages, 0);
+}
+
+/**
+ * Take a reference on the current ruleset, so that it outlives a reload
+ * for as long as the caller is using it.
+ */
+static PolicyRuleset *
+ref_ruleset (PolkitBackendKeyfileAuthority *authority)
+{
+  PolicyRuleset *ret = NULL;
+
+  g_mutex_lock (&authority->priv->ruleset_lock);
+  ret = policy_ruleset_ref (authority->priv->ruleset);
+  g_mutex_unlock (&authority->priv->ruleset_lock);
 
   return ret;
 }
 
-/* authority->priv->cx must be within a request */
+/**
+ * Have the members of the admin groups of @ruleset kept cached, as the
+ * first challenge would otherwise wait on NSS to expand them.
+ */
 static void
-load_rules (PolkitBackendKeyfileAuthority *authority)
+prefetch_admin_identities (PolkitBackendKeyfileAuthority *authority,
+                           PolicyRuleset *ruleset)
 {
-  GList *files = NULL;
-  GList *l;
-  guint num_files = 0;
-  GError *error = NULL;
-  guint n;
-  PolicyFile *last = NULL;
+  GList *identities = NULL;
 
-  files = NULL;
+  identities = policy_ruleset_get_admin_identities (ruleset);
+  polkit_backend_interactive_authority_prefetch_admin_identities (
+      POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority), identities);
+  g_list_free_full (identities, g_object_unref);
+}
 
-  for (n = 0; authority->priv->rules_dirs != NULL
-              && authority->priv->rules_dirs[n] != NULL;
-       n++)
-    {
-      const gchar *dir_name = authority->priv->rules_dirs[n];
-      GDir *dir = NULL;
+/**
+ * Replace the current ruleset, taking ownership of @ruleset. Readers that
+ * still hold the old ruleset finish against it.
+ */
+static void
+publish_ruleset (PolkitBackendKeyfileAuthority *authority,
+                 PolicyRuleset *ruleset)
+{
+  PolicyRuleset *old = NULL;
 
-      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                    "Loading rules from directory %s",
-                                    dir_name);
+  g_mutex_lock (&authority->priv->ruleset_lock);
+  old = authority->priv->ruleset;
+  authority->priv->ruleset = ruleset;
+  g_mutex_unlock (&authority->priv->ruleset_lock);
 
-      dir = g_dir_open (dir_name, 0, &error);
-      if (dir == NULL)
-        {
-          polkit_backend_authority_log (
-              POLKIT_BACKEND_AUTHORITY (authority),
-              "Error opening rules directory: %s (%s, %d)", error->message,
-              g_quark_to_string (error->domain), error->code);
-          g_clear_error (&error);
-        }
-      else
-        {
-          const gchar *name;
-          while ((name = g_dir_read_name (dir)) != NULL)
-            {
-              if (g_str_has_suffix (name, ".keyrules"))
-                files = g_list_prepend (
-                    files, g_strdup_printf ("%s/%s", dir_name, name));
-            }
-          g_dir_close (dir);
-        }
+  /* Nothing decided by the old rules may be served again, and a reload is
+   * as good a hint as any that netgroups may have changed too */
+  g_mutex_lock (&authority->priv->cache_lock);
+  policy_cache_bump_generation (authority->priv->cache);
+  g_mutex_unlock (&authority->priv->cache_lock);
+  policy_netgroup_cache_clear (authority->priv->netgroups);
+
+  prefetch_admin_identities (authority, ruleset);
+
+  policy_ruleset_unref (old);
+}
+
+/**
+ * Keep what the last compile cost, as a{sv} for the Debug interface. Only
+ * called from the main loop while no compile is running, as the profile
+ * belongs to the loader.
+ */
+static void
+keyfile_update_load_profile (PolkitBackendKeyfileAuthority *authority)
+{
+  const PolicyLoaderProfile *profile = NULL;
+  GVariantBuilder builder;
+  GVariantBuilder files;
+
+  profile = policy_loader_get_profile (authority->priv->loader);
+
+  g_variant_builder_init (&files, G_VARIANT_TYPE ("a(sbbtttuut)"));
+  for (guint i = 0; i < profile->files->len; i++)
+    {
+      const PolicyLoaderFileProfile *file
+          = &g_array_index (profile->files, PolicyLoaderFileProfile, i);
+
+      g_variant_builder_add (
+          &files, "(sbbtttuut)", file->path, file->parsed, file->failed,
+          (guint64)file->times.read_usec, (guint64)file->times.parse_usec,
+          (guint64)file->times.compile_usec, file->n_rules,
+          file->n_admin_rules, (guint64)file->string_bytes);
     }
 
-  files = g_list_sort (files, (GCompareFunc)rules_file_name_cmp);
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{sv}", "total-usec",
+                         g_variant_new_uint64 (profile->total_usec));
+  g_variant_builder_add (&builder, "{sv}", "scan-usec",
+                         g_variant_new_uint64 (profile->scan_usec));
+  g_variant_builder_add (&builder, "{sv}", "parse-usec",
+                         g_variant_new_uint64 (profile->parse_usec));
+  g_variant_builder_add (&builder, "{sv}", "ruleset-usec",
+                         g_variant_new_uint64 (profile->ruleset_usec));
+  g_variant_builder_add (&builder, "{sv}", "files",
+                         g_variant_builder_end (&files));
+
+  g_clear_pointer (&authority->priv->load_profile, g_variant_unref);
+  authority->priv->load_profile
+      = g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static void reload_rules (PolkitBackendKeyfileAuthority *authority);
 
-  for (l = files; l != NULL; l = l->next)
+/**
+ * A reload handed to the worker thread, which keeps the authority alive
+ * until the ruleset is published
+ */
+typedef struct KeyfileReload
+{
+  PolkitBackendKeyfileAuthority *authority;
+  GMainContext *context; /* Where the reload was started */
+  PolicyRuleset *ruleset;
+} KeyfileReload;
+
+static gboolean
+reload_rules_done_cb (gpointer user_data)
+{
+  KeyfileReload *reload = user_data;
+  PolkitBackendKeyfileAuthority *authority = reload->authority;
+  PolicyRuleset *ruleset = reload->ruleset;
+  PolicyRuleset *old = NULL;
+  PolkitBackendMetrics *metrics = NULL;
+  gchar **changed = NULL;
+
+  old = ref_ruleset (authority);
+  publish_ruleset (authority, policy_ruleset_ref (ruleset));
+  changed = policy_ruleset_diff_actions (old, ruleset);
+  policy_ruleset_unref (old);
+  authority->priv->reload_in_flight = FALSE;
+  keyfile_flush_loader_log (authority);
+  POLKIT_BACKEND_PROBE1 (
+      reload__rules__done,
+      g_get_monotonic_time () - authority->priv->reload_started);
+
+  keyfile_update_load_profile (authority);
+
+  metrics = polkit_backend_interactive_authority_get_metrics (
+      POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority));
+  if (metrics)
     {
-      const gchar *filename = (gchar *)l->data;
-      PolicyFile *file = NULL;
-      g_autoptr (GError) err = NULL;
+      const PolicyLoaderProfile *profile
+          = policy_loader_get_profile (authority->priv->loader);
+
+      polkit_backend_metrics_add_latency (
+          metrics, POLKIT_BACKEND_METRICS_PHASE_RELOAD,
+          g_get_monotonic_time () - authority->priv->reload_started);
+      polkit_backend_metrics_add_latency (
+          metrics, POLKIT_BACKEND_METRICS_PHASE_RELOAD_PARSE,
+          profile->parse_usec);
+      polkit_backend_metrics_add_latency (
+          metrics, POLKIT_BACKEND_METRICS_PHASE_RELOAD_COMPILE,
+          profile->ruleset_usec);
+    }
 
-      file = policy_file_new_from_path (filename, &err);
-      if (!file)
-        {
-          polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                        "Error compiling rules %s: %s",
-                                        filename, err->message);
-          continue;
-        }
+  /* Let applications know we have new rules, and for which actions... */
+  polkit_backend_interactive_authority_actions_changed (
+      POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+      (const gchar *const *)changed);
+  g_strfreev (changed);
 
-      if (last)
-        {
-          last->next = file;
-          last = file;
-        }
-      else
-        {
-          last = authority->priv->policy = file;
-        }
-      num_files++;
+  /* The old ruleset is gone unless a check still holds it */
+  polkit_backend_interactive_authority_trim_memory (
+      POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority));
+
+  /* ...and pick up anything that changed while we were compiling */
+  if (authority->priv->reload_pending)
+    {
+      authority->priv->reload_pending = FALSE;
+      reload_rules (authority);
     }
 
-  polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                "Finished loading %d rules", num_files);
-  g_list_free_full (files, g_free);
+  policy_ruleset_unref (ruleset);
+  g_main_context_unref (reload->context);
+  g_object_unref (authority);
+  g_free (reload);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+reload_rules_thread_func (gpointer data, gpointer user_data)
+{
+  KeyfileReload *reload = data;
+
+  reload->ruleset = policy_loader_compile (reload->authority->priv->loader);
+
+  /* Publishing, and everything else, happens where the reload came from */
+  g_main_context_invoke (reload->context, reload_rules_done_cb, reload);
 }
 
+/**
+ * Compile the rules in a worker thread, so the main loop keeps serving
+ * checks from the current ruleset in the meantime. At most one reload runs
+ * at a time, later requests are coalesced into a single follow-up.
+ */
 static void
 reload_rules (PolkitBackendKeyfileAuthority *authority)
 {
-  /* Remove old rules */
-  g_clear_pointer (&authority->priv->policy, policy_file_free);
+  KeyfileReload *reload = NULL;
 
-  load_rules (authority);
+  if (authority->priv->reload_in_flight)
+    {
+      authority->priv->reload_pending = TRUE;
+      return;
+    }
+  authority->priv->reload_in_flight = TRUE;
+  authority->priv->reload_started = g_get_monotonic_time ();
+  POLKIT_BACKEND_PROBE (reload__rules__start);
+
+  reload = g_new0 (KeyfileReload, 1);
+  reload->authority = g_object_ref (authority);
+  reload->context = g_main_context_ref_thread_default ();
+  g_thread_pool_push (authority->priv->reload_pool, reload, NULL);
+}
+
+static gboolean
+on_reload_timeout (gpointer user_data)
+{
+  PolkitBackendKeyfileAuthority *authority
+      = POLKIT_BACKEND_KEYFILE_AUTHORITY (user_data);
+
+  authority->priv->reload_source_id = 0;
 
-  /* Let applications know we have new rules... */
-  g_signal_emit_by_name (authority, "changed");
+  polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                "Reloading rules");
+  reload_rules (authority);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * Whether @file is the rules bundle, which may live outside the rules
+ * directories
+ */
+static gboolean
+keyfile_is_rules_bundle (PolkitBackendKeyfileAuthority *authority,
+                         GFile *file)
+{
+  gchar *path = NULL;
+  gboolean ret;
+
+  if (authority->priv->rules_bundle == NULL)
+    {
+      return FALSE;
+    }
+  path = g_file_get_path (file);
+  ret = g_strcmp0 (path, authority->priv->rules_bundle) == 0;
+  g_free (path);
+  return ret;
 }
 
 static void
@@ -245,11 +498,6 @@ on_dir_monitor_changed (GFileMonitor *monitor, GFile *file, GFile *other_file,
   PolkitBackendKeyfileAuthority *authority
       = POLKIT_BACKEND_KEYFILE_AUTHORITY (user_data);
 
-  /* TODO: maybe rate-limit so storms of events are collapsed into one with a
-   * 500ms resolution? Because when editing a file with emacs we get 4-8
-   * events..
-   */
-
   if (file != NULL)
     {
       gchar *name;
@@ -259,19 +507,52 @@ on_dir_monitor_changed (GFileMonitor *monitor, GFile *file, GFile *other_file,
       /* g_print ("event_type=%d file=%p name=%s\n", event_type, file, name);
        */
       if (!g_str_has_prefix (name, ".") && !g_str_has_prefix (name, "#")
-          && g_str_has_suffix (name, ".keyrules")
+          && (g_str_has_suffix (name, ".keyrules")
+              || g_str_has_suffix (name, ".keylist")
+              || keyfile_is_rules_bundle (authority, file))
           && (event_type == G_FILE_MONITOR_EVENT_CREATED
               || event_type == G_FILE_MONITOR_EVENT_DELETED
               || event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT))
         {
-          polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                        "Reloading rules");
-          reload_rules (authority);
+          /* Collapse event storms (editors, config management) into one
+           * reload, once there has been no event for the whole delay */
+          if (authority->priv->reload_source_id != 0)
+            {
+              g_source_remove (authority->priv->reload_source_id);
+            }
+          authority->priv->reload_source_id = g_timeout_add (
+              authority->priv->reload_delay, on_reload_timeout, authority);
         }
       g_free (name);
     }
 }
 
+static void
+add_dir_monitor (PolkitBackendKeyfileAuthority *authority, GPtrArray *p,
+                 const gchar *dir_name)
+{
+  GFile *file;
+  GError *error;
+  GFileMonitor *monitor;
+
+  file = g_file_new_for_path (dir_name);
+  error = NULL;
+  monitor = g_file_monitor_directory (file, G_FILE_MONITOR_NONE, NULL, &error);
+  g_object_unref (file);
+  if (monitor == NULL)
+    {
+      g_warning ("Error monitoring directory %s: %s", dir_name,
+                 error->message);
+      g_clear_error (&error);
+    }
+  else
+    {
+      g_signal_connect (monitor, "changed",
+                        G_CALLBACK (on_dir_monitor_changed), authority);
+      g_ptr_array_add (p, monitor);
+    }
+}
+
 static void
 setup_file_monitors (PolkitBackendKeyfileAuthority *authority)
 {
@@ -283,27 +564,14 @@ setup_file_monitors (PolkitBackendKeyfileAuthority *authority)
               && authority->priv->rules_dirs[n] != NULL;
        n++)
     {
-      GFile *file;
-      GError *error;
-      GFileMonitor *monitor;
-
-      file = g_file_new_for_path (authority->priv->rules_dirs[n]);
-      error = NULL;
-      monitor
-          = g_file_monitor_directory (file, G_FILE_MONITOR_NONE, NULL, &error);
-      g_object_unref (file);
-      if (monitor == NULL)
-        {
-          g_warning ("Error monitoring directory %s: %s",
-                     authority->priv->rules_dirs[n], error->message);
-          g_clear_error (&error);
-        }
-      else
-        {
-          g_signal_connect (monitor, "changed",
-                            G_CALLBACK (on_dir_monitor_changed), authority);
-          g_ptr_array_add (p, monitor);
-        }
+      add_dir_monitor (authority, p, authority->priv->rules_dirs[n]);
+    }
+  /* A new bundle is renamed over the old one, so watch its directory */
+  if (authority->priv->rules_bundle != NULL)
+    {
+      gchar *dir_name = g_path_get_dirname (authority->priv->rules_bundle);
+      add_dir_monitor (authority, p, dir_name);
+      g_free (dir_name);
     }
   g_ptr_array_add (p, NULL);
   authority->priv->dir_monitors = (GFileMonitor **)g_ptr_array_free (p, FALSE);
@@ -315,17 +583,58 @@ polkit_backend_keyfile_authority_constructed (GObject *object)
   PolkitBackendKeyfileAuthority *authority
       = POLKIT_BACKEND_KEYFILE_AUTHORITY (object);
 
+#ifdef HAVE_BUILTIN_RULES
+  gboolean system_rules = authority->priv->rules_dirs == NULL;
+#endif
+
   if (authority->priv->rules_dirs == NULL)
     {
+      /* Only the system rules are worth precompiling */
+      if (authority->priv->rules_cache == NULL)
+        {
+          authority->priv->rules_cache = g_strdup (POLICY_LOADER_RULES_CACHE);
+        }
+
       authority->priv->rules_dirs = g_new0 (gchar *, 3);
       authority->priv->rules_dirs[0]
-          = g_strdup (PACKAGE_SYSCONF_DIR "/polkit-1/rules.d");
+          = g_strdup (POLICY_LOADER_SYSCONF_RULES_DIR);
       authority->priv->rules_dirs[1]
-          = g_strdup (PACKAGE_DATA_DIR "/polkit-1/rules.d");
+          = g_strdup (POLICY_LOADER_DATA_RULES_DIR);
     }
 
   setup_file_monitors (authority);
-  load_rules (authority);
+
+  authority->priv->loader = policy_loader_new (
+      (const gchar *const *)authority->priv->rules_dirs,
+      authority->priv->rules_cache, TRUE, keyfile_loader_log, authority);
+#ifdef HAVE_BUILTIN_RULES
+  /* The defaults ship inside polkitd rather than in the rules directories */
+  if (system_rules)
+    {
+      policy_loader_set_builtin (authority->priv->loader,
+                                 (const gchar *)builtin_rules_image,
+                                 sizeof (builtin_rules_image));
+    }
+#endif
+  if (authority->priv->rules_bundle != NULL
+      && authority->priv->rules_bundle_key == NULL)
+    {
+      g_warning ("Ignoring rules bundle %s, no key to check it with",
+                 authority->priv->rules_bundle);
+    }
+  else if (authority->priv->rules_bundle != NULL)
+    {
+      policy_loader_set_bundle (authority->priv->loader,
+                                authority->priv->rules_bundle,
+                                authority->priv->rules_bundle_key);
+    }
+
+  /* Nothing can be served before the first ruleset, so load it right away */
+  policy_loader_read_cache (authority->priv->loader);
+  authority->priv->ruleset = policy_loader_compile (authority->priv->loader);
+  keyfile_flush_loader_log (authority);
+  keyfile_update_load_profile (authority);
+  prefetch_admin_identities (authority, authority->priv->ruleset);
 
   G_OBJECT_CLASS (polkit_backend_keyfile_authority_parent_class)
       ->constructed (object);
@@ -350,8 +659,25 @@ polkit_backend_keyfile_authority_finalize (GObject *object)
   g_free (authority->priv->dir_monitors);
   g_strfreev (authority->priv->rules_dirs);
 
+  if (authority->priv->reload_source_id != 0)
+    {
+      g_source_remove (authority->priv->reload_source_id);
+    }
+  /* Every reload holds a reference, so none can be in flight by now */
+  g_thread_pool_free (authority->priv->reload_pool, FALSE, TRUE);
+  g_clear_pointer (&authority->priv->loader, policy_loader_free);
+  g_ptr_array_unref (authority->priv->loader_messages);
+  g_free (authority->priv->rules_cache);
+  g_free (authority->priv->rules_bundle);
+  g_free (authority->priv->rules_bundle_key);
+  g_clear_pointer (&authority->priv->load_profile, g_variant_unref);
+
   /* Remove old rules */
-  g_clear_pointer (&authority->priv->policy, policy_file_free);
+  g_clear_pointer (&authority->priv->ruleset, policy_ruleset_unref);
+  g_mutex_clear (&authority->priv->ruleset_lock);
+  g_mutex_clear (&authority->priv->cache_lock);
+  g_clear_pointer (&authority->priv->cache, policy_cache_free);
+  g_clear_pointer (&authority->priv->netgroups, policy_netgroup_cache_free);
 
   G_OBJECT_CLASS (polkit_backend_keyfile_authority_parent_class)
       ->finalize (object);
@@ -373,6 +699,88 @@ polkit_backend_keyfile_authority_set_property (GObject *object,
       authority->priv->rules_dirs = (gchar **)g_value_dup_boxed (value);
       break;
 
+    case PROP_RELOAD_DELAY:
+      authority->priv->reload_delay = g_value_get_uint (value);
+      break;
+
+    case PROP_RULES_CACHE:
+      g_assert (authority->priv->rules_cache == NULL);
+      authority->priv->rules_cache = g_value_dup_string (value);
+      break;
+
+    case PROP_SHADOW_EVALUATION:
+      g_atomic_int_set (&authority->priv->shadow_evaluation,
+                        g_value_get_boolean (value));
+      break;
+
+    case PROP_RULES_BUNDLE:
+      g_assert (authority->priv->rules_bundle == NULL);
+      authority->priv->rules_bundle = g_value_dup_string (value);
+      break;
+
+    case PROP_RULES_BUNDLE_KEY:
+      g_assert (authority->priv->rules_bundle_key == NULL);
+      authority->priv->rules_bundle_key = g_value_dup_string (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+/**
+ * The check threads update the counters under the cache lock, so they are
+ * read under it as well
+ */
+static void
+keyfile_copy_cache_stats (PolkitBackendKeyfileAuthority *authority,
+                          PolicyCacheStats *stats)
+{
+  g_mutex_lock (&authority->priv->cache_lock);
+  *stats = *policy_cache_get_stats (authority->priv->cache);
+  g_mutex_unlock (&authority->priv->cache_lock);
+}
+
+static void
+polkit_backend_keyfile_authority_get_property (GObject *object,
+                                               guint property_id,
+                                               GValue *value,
+                                               GParamSpec *pspec)
+{
+  PolkitBackendKeyfileAuthority *authority
+      = POLKIT_BACKEND_KEYFILE_AUTHORITY (object);
+  PolicyCacheStats stats = { 0 };
+
+  keyfile_copy_cache_stats (authority, &stats);
+
+  switch (property_id)
+    {
+    case PROP_RELOAD_DELAY:
+      g_value_set_uint (value, authority->priv->reload_delay);
+      break;
+
+    case PROP_CACHE_HITS:
+      g_value_set_uint64 (value, stats.hits);
+      break;
+
+    case PROP_CACHE_MISSES:
+      g_value_set_uint64 (value, stats.misses);
+      break;
+
+    case PROP_CACHE_EVICTIONS:
+      g_value_set_uint64 (value, stats.evictions);
+      break;
+
+    case PROP_CACHE_EXPIRED:
+      g_value_set_uint64 (value, stats.expired);
+      break;
+
+    case PROP_SHADOW_EVALUATION:
+      g_value_set_boolean (
+          value, g_atomic_int_get (&authority->priv->shadow_evaluation));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -410,6 +818,7 @@ polkit_backend_keyfile_authority_class_init (
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize = polkit_backend_keyfile_authority_finalize;
   gobject_class->set_property = polkit_backend_keyfile_authority_set_property;
+  gobject_class->get_property = polkit_backend_keyfile_authority_get_property;
   gobject_class->constructed = polkit_backend_keyfile_authority_constructed;
 
   authority_class = POLKIT_BACKEND_AUTHORITY_CLASS (klass);
@@ -424,12 +833,75 @@ polkit_backend_keyfile_authority_class_init (
       = polkit_backend_keyfile_authority_get_admin_auth_identities;
   interactive_authority_class->check_authorization_sync
       = polkit_backend_keyfile_authority_check_authorization_sync;
+  interactive_authority_class->get_memory_usage
+      = polkit_backend_keyfile_authority_get_memory_usage;
+  interactive_authority_class->trim_memory
+      = polkit_backend_keyfile_authority_trim_memory;
 
   g_object_class_install_property (
       gobject_class, PROP_RULES_DIRS,
       g_param_spec_boxed ("rules-dirs", NULL, NULL, G_TYPE_STRV,
                           G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
 
+  g_object_class_install_property (
+      gobject_class, PROP_RELOAD_DELAY,
+      g_param_spec_uint ("reload-delay", "Reload delay",
+                         "Milliseconds without rules changes to wait for "
+                         "before reloading",
+                         0, G_MAXUINT, KEYFILE_RELOAD_DELAY,
+                         G_PARAM_CONSTRUCT | G_PARAM_READWRITE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_RULES_CACHE,
+      g_param_spec_string ("rules-cache", NULL, NULL, NULL,
+                           G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_CACHE_HITS,
+      g_param_spec_uint64 ("cache-hits", "Cache hits",
+                           "Checks answered from the decision cache", 0,
+                           G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_CACHE_MISSES,
+      g_param_spec_uint64 ("cache-misses", "Cache misses",
+                           "Checks that had to evaluate the rules", 0,
+                           G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_CACHE_EVICTIONS,
+      g_param_spec_uint64 ("cache-evictions", "Cache evictions",
+                           "Decisions dropped to stay within the cache size",
+                           0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_CACHE_EXPIRED,
+      g_param_spec_uint64 ("cache-expired", "Cache expired",
+                           "Decisions dropped due to age or a rules reload",
+                           0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_SHADOW_EVALUATION,
+      g_param_spec_boolean ("shadow-evaluation", "Shadow evaluation",
+                            "Also test every check against the rules one by "
+                            "one, serve that answer and count where the "
+                            "compiled rules disagree",
+                            FALSE, G_PARAM_CONSTRUCT | G_PARAM_READWRITE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_RULES_BUNDLE,
+      g_param_spec_string ("rules-bundle", "Rules bundle",
+                           "Precompiled, signed rules to load instead of the "
+                           "rules directories while usable",
+                           NULL, G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_RULES_BUNDLE_KEY,
+      g_param_spec_string ("rules-bundle-key", "Rules bundle key",
+                           "File holding the key the rules bundle is signed "
+                           "with",
+                           NULL, G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
+
   g_type_class_add_private (klass,
                             sizeof (PolkitBackendKeyfileAuthorityPrivate));
 }
@@ -438,146 +910,197 @@ polkit_backend_keyfile_authority_class_init (
  */
 
 /**
- * Ensure we prepare the context with extra details and make cookie bits work.
+ * Histograms count values in log2 buckets: bucket 0 holds zero, and bucket
+ * n the values in [2^(n-1), 2^n), with the last bucket holding the rest
  */
-static gboolean
-polkit_backend_keyfile_internal_prepare_context (
-    PolkitBackendKeyfileAuthority *authority, PolicyContext *context)
+static guint
+keyfile_histogram_bucket (guint64 value)
+{
+  guint bucket = 0;
+
+  while (value > 0 && bucket < KEYFILE_HISTOGRAM_BUCKETS - 1)
+    {
+      value >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+static void
+keyfile_histogram_add (volatile gsize *histogram, guint64 value)
 {
+  g_atomic_pointer_add (&histogram[keyfile_histogram_bucket (value)], 1);
+}
+
+/* Bytes of scratch space a check starts out with, the arena grows on demand */
+#define KEYFILE_ARENA_SIZE 1024
+
+/**
+ * Scratch space for the checks run on each thread, reset after every check
+ */
+static GPrivate keyfile_arena = G_PRIVATE_INIT ((GDestroyNotify)policy_arena_free);
 
-  pid_t pid;
-  uid_t uid;
-  struct passwd *passwd;
+static PolicyArena *
+keyfile_get_arena (void)
+{
+  PolicyArena *arena = g_private_get (&keyfile_arena);
 
-  if (POLKIT_IS_UNIX_PROCESS (context->subject))
+  if (!arena)
     {
-      pid = polkit_unix_process_get_pid (
-          POLKIT_UNIX_PROCESS (context->subject));
+      arena = policy_arena_new (KEYFILE_ARENA_SIZE);
+      g_private_set (&keyfile_arena, arena);
     }
-  else if (POLKIT_IS_SYSTEM_BUS_NAME (context->subject))
+  return arena;
+}
+
+/**
+ * What the resolve callbacks need for a single check, along with the time
+ * they spent preparing its context
+ */
+typedef struct KeyfileResolveData
+{
+  PolkitBackendSubjectInfo *subject_info;
+  gint64 prepare_usec;
+} KeyfileResolveData;
+
+/**
+ * Take the passwd entry for the user, which every other fact is based on,
+ * from the request's subject info so it is only looked up once
+ */
+static void
+polkit_backend_keyfile_internal_resolve_username (PolicyContext *context)
+{
+  KeyfileResolveData *data = context->resolve_data;
+  PolkitBackendSubjectInfo *subject_info = data->subject_info;
+  const gchar *username = NULL;
+
+  username = polkit_backend_subject_info_get_user_name (
+      subject_info, &context->primary_gid);
+  if (username == NULL)
     {
-      g_autoptr (GError) err = NULL;
-      PolkitSubject *process;
-      process = polkit_system_bus_name_get_process_sync (
-          POLKIT_SYSTEM_BUS_NAME (context->subject), NULL, &err);
-      if (process == NULL)
-        {
-          polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                        "Failed to get process details: %s",
-                                        err->message);
-          return FALSE;
-        }
-      pid = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
-      g_object_unref (process);
+      gint uid = polkit_backend_subject_info_get_uid (subject_info);
+      context->username
+          = policy_arena_strdup_printf (context->arena, "%d", uid);
+      g_warning ("Error looking up info for uid %d: %m", uid);
     }
   else
     {
-      g_assert_not_reached ();
+      /* Owned by the subject info, which outlives the check */
+      context->username = (gchar *)username;
     }
+}
 
-#ifdef HAVE_LIBSYSTEMD
-  if (sd_pid_get_session (pid, &context->session_id) == 0)
-    {
-      if (sd_session_get_seat (context->session_id, &context->seat_id) == 0)
-        {
-          /* do nothing */
-        }
-    }
-#endif /* HAVE_LIBSYSTEMD */
+static void
+polkit_backend_keyfile_internal_resolve_gids (PolicyContext *context)
+{
+  KeyfileResolveData *data = context->resolve_data;
+  PolkitBackendSubjectInfo *subject_info = data->subject_info;
+  PolicyUserRecord *record = NULL;
 
-  g_assert (POLKIT_IS_UNIX_USER (context->user_for_subject));
-  uid = polkit_unix_user_get_uid (
-      POLKIT_UNIX_USER (context->user_for_subject));
+  /* Groups are matched by gid, so there's no need to resolve names here */
+  record = polkit_backend_subject_info_get_user_record (subject_info);
+  context->gids = record ? record->gids : NULL;
+}
+
+/**
+ * Resolve subject facts as and when the rules need them, so that a check
+ * against plain Actions= rules needs no lookups at all.
+ */
+static void
+polkit_backend_keyfile_internal_resolve_context (PolicyContext *context,
+                                                 PolicyContextFact fact)
+{
+  KeyfileResolveData *data = context->resolve_data;
+  gint64 start = g_get_monotonic_time ();
 
-  context->groups = g_ptr_array_new_with_free_func (g_free);
+  POLKIT_BACKEND_PROBE1 (prepare__context__entry, fact);
 
-  passwd = getpwuid (uid);
-  if (passwd == NULL)
+  switch (fact)
     {
-      context->username = g_strdup_printf ("%d", (gint)uid);
-      g_warning ("Error looking up info for uid %d: %m", (gint)uid);
-    }
-  else
-    {
-      gid_t gids[512];
-      int num_gids = 512;
+    case POLICY_CONTEXT_USERNAME:
+      polkit_backend_keyfile_internal_resolve_username (context);
+      break;
 
-      context->username = g_strdup (passwd->pw_name);
+    case POLICY_CONTEXT_GIDS:
+      polkit_backend_keyfile_internal_resolve_gids (context);
+      break;
 
-      if (getgrouplist (passwd->pw_name, passwd->pw_gid, gids, &num_gids) < 0)
-        {
-          g_warning ("Error looking up groups for uid %d: %m", (gint)uid);
-        }
-      else
-        {
-          gint n;
-          for (n = 0; n < num_gids; n++)
-            {
-              struct group *group;
-              group = getgrgid (gids[n]);
-              if (group == NULL)
-                {
-                  g_ptr_array_add (context->groups,
-                                   g_strdup_printf ("%d", (gint)gids[n]));
-                }
-              else
-                {
-                  g_ptr_array_add (context->groups, g_strdup (group->gr_name));
-                }
-            }
-        }
+    default:
+      g_assert_not_reached ();
     }
 
-  return TRUE;
+  data->prepare_usec += g_get_monotonic_time () - start;
+
+  POLKIT_BACKEND_PROBE1 (prepare__context__return, fact);
 }
 
 /**
- * Clear up any allocated types on the policycontext
+ * Report the compiled rules, the parsed files kept for the next reload and
+ * the cached outcomes
  */
 static void
-polkit_backend_keyfile_internal_clear_context (PolicyContext *context)
+polkit_backend_keyfile_authority_get_memory_usage (
+    PolkitBackendInteractiveAuthority *_authority, GVariantBuilder *builder)
 {
-  g_clear_pointer (&context->seat_id, free);
-  g_clear_pointer (&context->session_id, free);
-  g_clear_pointer (&context->groups, g_ptr_array_unref);
-  g_clear_pointer (&context->username, g_free);
+  PolkitBackendKeyfileAuthority *authority
+      = POLKIT_BACKEND_KEYFILE_AUTHORITY (_authority);
+  PolicyRuleset *ruleset = NULL;
+  guint64 bytes = 0;
+  guint64 objects = 0;
+
+  ruleset = ref_ruleset (authority);
+  policy_ruleset_get_memory_usage (ruleset, &bytes, &objects);
+  policy_ruleset_unref (ruleset);
+  polkit_backend_interactive_authority_add_memory_usage (builder, "rules",
+                                                         bytes, objects);
+
+  /* A reload in flight owns the loader until it is done */
+  if (!authority->priv->reload_in_flight)
+    {
+      bytes = objects = 0;
+      policy_loader_get_memory_usage (authority->priv->loader, &bytes,
+                                      &objects);
+      polkit_backend_interactive_authority_add_memory_usage (
+          builder, "rules-files", bytes, objects);
+    }
+
+  bytes = objects = 0;
+  g_mutex_lock (&authority->priv->cache_lock);
+  policy_cache_get_memory_usage (authority->priv->cache, &bytes, &objects);
+  g_mutex_unlock (&authority->priv->cache_lock);
+  polkit_backend_interactive_authority_add_memory_usage (
+      builder, "rules-cache", bytes, objects);
 }
 
-static GList *
-polkit_backend_keyfile_internal_build_admin (
-    PolkitBackendKeyfileAuthority *authority, GList *ret, gchar **grouping,
-    gsize n_items, gchar *id_prefix)
+/**
+ * Drop the cached outcomes, they are computed again as checks come in
+ */
+static void
+polkit_backend_keyfile_authority_trim_memory (
+    PolkitBackendInteractiveAuthority *_authority)
 {
-  g_autoptr (GError) err = NULL;
+  PolkitBackendKeyfileAuthority *authority
+      = POLKIT_BACKEND_KEYFILE_AUTHORITY (_authority);
 
-  for (gsize i = 0; i < n_items; i++)
+  g_mutex_lock (&authority->priv->cache_lock);
+  if (policy_cache_get_size (authority->priv->cache) > 0)
     {
-      const gchar *match_item = g_strstrip (grouping[i]);
-      const gchar *identifier = NULL;
-
-      /* Allow %wheel% substitution here */
-      if (g_str_equal (match_item, POLICY_MATCH_WHEEL))
-        {
-          identifier = POLICY_WHEEL_GROUP;
-        }
-      else
-        {
-          identifier = match_item;
-        }
-
-      g_autofree gchar *nom = g_strdup_printf ("%s:%s", id_prefix, identifier);
-      PolkitIdentity *i = polkit_identity_from_string (nom, &err);
-      if (err)
-        {
-          polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                        "Identity `%s' is not valid, ignoring",
-                                        nom);
-          g_clear_error (&err);
-          continue;
-        }
-      ret = g_list_prepend (ret, i);
+      policy_cache_bump_generation (authority->priv->cache);
     }
-  return ret;
+  g_mutex_unlock (&authority->priv->cache_lock);
+  policy_netgroup_cache_clear (authority->priv->netgroups);
+}
+
+/**
+ * Drop the borrowed facts from the policycontext, and release whatever the
+ * check allocated in one go
+ */
+static void
+polkit_backend_keyfile_internal_clear_context (PolicyContext *context)
+{
+  context->gids = NULL;
+  context->username = NULL;
+  policy_arena_reset (context->arena);
 }
 
 static GList *
@@ -585,79 +1108,185 @@ polkit_backend_keyfile_authority_get_admin_auth_identities (
     PolkitBackendInteractiveAuthority *_authority, PolkitSubject *caller,
     PolkitSubject *subject, PolkitIdentity *user_for_subject,
     gboolean subject_is_local, gboolean subject_is_active,
-    const gchar *action_id, PolkitDetails *details)
+    const gchar *action_id, PolkitDetails *details,
+    PolkitBackendSubjectInfo *subject_info)
 {
   GList *ret = NULL;
   PolkitBackendKeyfileAuthority *authority
       = POLKIT_BACKEND_KEYFILE_AUTHORITY (_authority);
+  PolicyRuleset *ruleset = NULL;
 
-  /* Organise the context to pass to the policy file for testing */
-  PolicyContext context = {
-    .subject = subject,
-    .user_for_subject = user_for_subject,
-    .subject_is_local = subject_is_local,
-    .subject_is_active = subject_is_active,
-    .details = details,
-  };
+  /* Compiled along with the ruleset, as they never depend on the subject */
+  ruleset = ref_ruleset (authority);
+  ret = policy_ruleset_get_admin_identities (ruleset);
+  policy_ruleset_unref (ruleset);
+
+  if (ret == NULL)
+    ret = g_list_prepend (ret, polkit_unix_user_new (0));
 
-  if (!polkit_backend_keyfile_internal_prepare_context (authority, &context))
+  return ret;
+}
+
+/* ----------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * Describe everything a rule may have looked at, for the log
+ */
+static gchar *
+keyfile_shadow_describe_context (PolicyContext *context)
+{
+  GString *str = g_string_new (NULL);
+  g_autofree gchar *subject = NULL;
+  g_autofree gchar *user = NULL;
+  gchar **keys = NULL;
+
+  subject = polkit_subject_to_string (context->subject);
+  user = polkit_identity_to_string (context->user_for_subject);
+  g_string_append_printf (
+      str, "subject=%s user=%s username=%s primary-gid=%d local=%d active=%d",
+      subject, user, context->username ? context->username : "(none)",
+      (gint)context->primary_gid, context->subject_is_local,
+      context->subject_is_active);
+  g_string_append_printf (
+      str, " seat=%s class=%s type=%s",
+      context->seat ? context->seat : "(none)",
+      context->session_class ? context->session_class : "(none)",
+      context->session_type ? context->session_type : "(none)");
+
+  g_string_append (str, " gids=");
+  for (guint i = 0; context->gids && i < context->gids->len; i++)
     {
-      goto context_fail;
+      g_string_append_printf (str, "%s%d", i > 0 ? "," : "",
+                              (gint)g_array_index (context->gids, gid_t, i));
     }
 
-  for (PolicyFile *file = authority->priv->policy; file; file = file->next)
+  if (context->details)
     {
-      for (Policy *policy = file->rules.admin; policy; policy = policy->next)
-        {
-          if ((policy->constraints & PF_CONSTRAINT_UNIX_GROUPS)
-              == PF_CONSTRAINT_UNIX_GROUPS)
-            {
-              ret = polkit_backend_keyfile_internal_build_admin (
-                  authority, ret, policy->unix_groups, policy->n_unix_groups,
-                  "unix-group");
-            }
-          if ((policy->constraints & PF_CONSTRAINT_UNIX_NAMES)
-              == PF_CONSTRAINT_UNIX_NAMES)
-            {
-              ret = polkit_backend_keyfile_internal_build_admin (
-                  authority, ret, policy->unix_names, policy->n_unix_names,
-                  "unix-user");
-            }
-          if ((policy->constraints & PF_CONSTRAINT_NET_GROUPS)
-              == PF_CONSTRAINT_NET_GROUPS)
-            {
-              ret = polkit_backend_keyfile_internal_build_admin (
-                  authority, ret, policy->net_groups, policy->n_net_groups,
-                  "unix-netgroup");
-            }
-        }
+      keys = polkit_details_get_keys (context->details);
     }
+  for (guint i = 0; keys && keys[i]; i++)
+    {
+      g_string_append_printf (
+          str, " details[%s]=%s", keys[i],
+          polkit_details_lookup (context->details, keys[i]));
+    }
+  g_strfreev (keys);
 
-  ret = g_list_reverse (ret);
+  return g_string_free (str, FALSE);
+}
 
-context_fail:
-  polkit_backend_keyfile_internal_clear_context (&context);
+/**
+ * Test @action_id against both the compiled rules and every rule in turn,
+ * the way the rules were tested before they were compiled. The answer of
+ * the latter is returned, so whatever the compiled rules get wrong is only
+ * counted and logged.
+ */
+static PolkitImplicitAuthorization
+keyfile_shadow_test (PolkitBackendKeyfileAuthority *authority,
+                     const gchar *action_id, PolicyContext *context)
+{
+  PolkitImplicitAuthorization reference;
+  PolkitImplicitAuthorization compiled;
+  PolicyRuleset *ruleset = NULL;
+  PolkitBackendMetrics *metrics = NULL;
+  gint64 reference_usec;
+  gint64 compiled_usec;
+  gint64 start;
+
+  /* Neither answer pays for resolving the subject, so that the latencies
+   * only differ by the evaluation itself */
+  policy_context_get_username (context);
+  policy_context_get_gids (context);
+
+  ruleset = ref_ruleset (authority);
+
+  start = g_get_monotonic_time ();
+  reference = policy_file_test (ruleset->files, action_id, context);
+  reference_usec = g_get_monotonic_time () - start;
+
+  start = g_get_monotonic_time ();
+  compiled = policy_ruleset_test (ruleset, action_id, context);
+  compiled_usec = g_get_monotonic_time () - start;
+
+  policy_ruleset_unref (ruleset);
+
+  metrics = polkit_backend_interactive_authority_get_metrics (
+      POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority));
+  if (metrics)
+    {
+      polkit_backend_metrics_count (
+          metrics, POLKIT_BACKEND_METRICS_COUNTER_SHADOW_CHECKS);
+      polkit_backend_metrics_add_latency (
+          metrics, POLKIT_BACKEND_METRICS_PHASE_SHADOW_REFERENCE,
+          reference_usec);
+      polkit_backend_metrics_add_latency (
+          metrics, POLKIT_BACKEND_METRICS_PHASE_SHADOW_COMPILED,
+          compiled_usec);
+    }
 
-  if (ret == NULL)
-    ret = g_list_prepend (ret, polkit_unix_user_new (0));
+  if (compiled != reference)
+    {
+      g_autofree gchar *described = NULL;
+
+      if (metrics)
+        polkit_backend_metrics_count (
+            metrics, POLKIT_BACKEND_METRICS_COUNTER_SHADOW_MISMATCHES);
+
+      described = keyfile_shadow_describe_context (context);
+      polkit_backend_authority_log (
+          POLKIT_BACKEND_AUTHORITY (authority),
+          "Shadow evaluation mismatch for action %s: rules give %s, compiled "
+          "rules give %s (%s)",
+          action_id, polkit_implicit_authorization_to_string (reference),
+          polkit_implicit_authorization_to_string (compiled), described);
+    }
 
-  return ret;
+  return reference;
 }
 
 /* ----------------------------------------------------------------------------------------------------
  */
 
+/**
+ * Say which rule decided a check, for a caller that wants it explained;
+ * the ruleset of @trace must still be referenced
+ */
+static void
+keyfile_explain (PolkitBackendInteractiveAuthority *authority,
+                 PolkitDetails *details, const PolicyRulesetTrace *trace)
+{
+  const PolicyRulesetEntry *entry = trace->matched;
+
+  if (!entry)
+    return;
+
+  polkit_backend_interactive_authority_explain (
+      authority, details, "rule",
+      policy_file_get_id (entry->file, entry->policy), entry->file->path);
+}
+
 static PolkitImplicitAuthorization
 polkit_backend_keyfile_authority_check_authorization_sync (
     PolkitBackendInteractiveAuthority *_authority, PolkitSubject *caller,
     PolkitSubject *subject, PolkitIdentity *user_for_subject,
     gboolean subject_is_local, gboolean subject_is_active,
     const gchar *action_id, PolkitDetails *details,
-    PolkitImplicitAuthorization implicit)
+    PolkitImplicitAuthorization implicit,
+    PolkitBackendSubjectInfo *subject_info)
 {
   PolkitImplicitAuthorization ret = implicit;
   PolkitBackendKeyfileAuthority *authority
       = POLKIT_BACKEND_KEYFILE_AUTHORITY (_authority);
+  PolicyCacheKey key = { 0 };
+  PolicyRuleset *ruleset = NULL;
+  PolkitBackendSubjectInfo *owned_info = NULL;
+  KeyfileResolveData data = { .subject_info = subject_info };
+  PolicyRulesetTrace trace = { 0 };
+  gboolean cached = FALSE;
+  gboolean explaining = FALSE;
+  guint generation;
+  PolkitBackendMetrics *metrics = NULL;
 
   /* Organise the context to pass to the policy file for testing */
   PolicyContext context = {
@@ -666,18 +1295,121 @@ polkit_backend_keyfile_authority_check_authorization_sync (
     .subject_is_local = subject_is_local,
     .subject_is_active = subject_is_active,
     .details = details,
+    .netgroups = authority->priv->netgroups,
+    .arena = keyfile_get_arena (),
+    .resolve = polkit_backend_keyfile_internal_resolve_context,
+    .resolve_data = &data,
   };
 
-  if (!polkit_backend_keyfile_internal_prepare_context (authority, &context))
+  g_assert (POLKIT_IS_UNIX_USER (user_for_subject));
+
+  /* Every check is tested in full, bypassing the static answers and the
+   * cache as both come from the compiled rules */
+  if (g_atomic_int_get (&authority->priv->shadow_evaluation))
     {
+      if (!subject_info)
+        {
+          owned_info = polkit_backend_subject_info_new (NULL, NULL, subject,
+                                                        user_for_subject);
+          data.subject_info = owned_info;
+        }
+      context.seat = polkit_backend_subject_info_get_seat (data.subject_info);
+      context.session_class
+          = polkit_backend_subject_info_get_session_class (data.subject_info);
+      context.session_type
+          = polkit_backend_subject_info_get_session_type (data.subject_info);
+
+      ret = keyfile_shadow_test (authority, action_id, &context);
+
       polkit_backend_keyfile_internal_clear_context (&context);
-      return POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
+      g_clear_pointer (&owned_info, polkit_backend_subject_info_unref);
+
+      return ret == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN ? implicit : ret;
     }
 
-  /* Check if our policy files know about this */
-  ret = policy_file_test (authority->priv->policy, action_id, &context);
+  /* Some answers are the same for every subject, and need neither the
+   * cache nor any lookups */
+  ruleset = ref_ruleset (authority);
+  if (policy_ruleset_test_static (ruleset, action_id, &trace, &ret))
+    {
+      keyfile_explain (_authority, details, &trace);
+      policy_ruleset_unref (ruleset);
+      keyfile_histogram_add (authority->priv->rules_tested, trace.n_tested);
+      return ret;
+    }
+  g_clear_pointer (&ruleset, policy_ruleset_unref);
+
+  /* The ruleset only ever consumes these, so repeat checks skip the lookups */
+  key.uid = polkit_unix_user_get_uid (POLKIT_UNIX_USER (user_for_subject));
+  key.action_id = action_id;
+  key.subject_is_local = subject_is_local;
+  key.subject_is_active = subject_is_active;
+  /* Called directly rather than for a CheckAuthorization request, but the
+   * key needs the session all the same */
+  if (!subject_info)
+    {
+      gint64 start = g_get_monotonic_time ();
+
+      owned_info = polkit_backend_subject_info_new (NULL, NULL, subject,
+                                                    user_for_subject);
+      data.subject_info = owned_info;
+      data.prepare_usec += g_get_monotonic_time () - start;
+    }
+  /* Known along with local and active, from the session monitor's cache */
+  key.seat = polkit_backend_subject_info_get_seat (data.subject_info);
+  key.session_class
+      = polkit_backend_subject_info_get_session_class (data.subject_info);
+  key.session_type
+      = polkit_backend_subject_info_get_session_type (data.subject_info);
+  context.seat = key.seat;
+  context.session_class = key.session_class;
+  context.session_type = key.session_type;
+
+  /* The cache only remembers answers, not the rules that gave them */
+  explaining
+      = polkit_backend_interactive_authority_is_explaining (_authority, details);
+
+  g_mutex_lock (&authority->priv->cache_lock);
+  if (!explaining)
+    cached = policy_cache_lookup (authority->priv->cache, &key, &ret);
+  generation = policy_cache_get_generation (authority->priv->cache);
+  g_mutex_unlock (&authority->priv->cache_lock);
+
+  metrics = polkit_backend_interactive_authority_get_metrics (_authority);
+  if (metrics && !explaining)
+    polkit_backend_metrics_count (
+        metrics, cached ? POLKIT_BACKEND_METRICS_COUNTER_RULES_CACHE_HITS
+                        : POLKIT_BACKEND_METRICS_COUNTER_RULES_CACHE_MISSES);
+
+  if (!cached)
+    {
+      /* Check if our policy files know about this. Taking the generation
+       * first means an outcome from a replaced ruleset is never cached. */
+      ruleset = ref_ruleset (authority);
+      POLKIT_BACKEND_PROBE1 (rules__test__entry, action_id);
+      ret = policy_ruleset_test_full (ruleset, action_id, &context, &trace);
+      POLKIT_BACKEND_PROBE3 (rules__test__return, action_id, ret,
+                             trace.n_tested);
+      keyfile_explain (_authority, details, &trace);
+      policy_ruleset_unref (ruleset);
+
+      keyfile_histogram_add (authority->priv->rules_tested, trace.n_tested);
+      keyfile_histogram_add (authority->priv->prepare_usec,
+                             (guint64)data.prepare_usec);
+
+      polkit_backend_keyfile_internal_clear_context (&context);
 
-  polkit_backend_keyfile_internal_clear_context (&context);
+      /* The key doesn't cover the details, so neither can the cache */
+      if (!trace.used_details)
+        {
+          g_mutex_lock (&authority->priv->cache_lock);
+          policy_cache_insert (authority->priv->cache, &key, generation, ret);
+          g_mutex_unlock (&authority->priv->cache_lock);
+        }
+    }
+
+  /* Made for the key, so a cache hit needs it released as well */
+  g_clear_pointer (&owned_info, polkit_backend_subject_info_unref);
 
   /* No rules answered, so we'll just return the implicit auth */
   if (ret == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
@@ -688,3 +1420,286 @@ polkit_backend_keyfile_authority_check_authorization_sync (
   /* Return auth per the policies */
   return ret;
 }
+
+/* ----------------------------------------------------------------------------------------------------
+ */
+
+static const gchar keyfile_debug_introspection_data[]
+    = "<node>"
+      "  <interface name='org.freedesktop.PolicyKit1.Debug'>"
+      "    <method name='GetRuleStats'>"
+      "      <arg type='a(sstttt)' name='rules' direction='out'/>"
+      "    </method>"
+      "    <method name='GetCheckStats'>"
+      "      <arg type='a{sv}' name='stats' direction='out'/>"
+      "    </method>"
+      "    <method name='GetLoadProfile'>"
+      "      <arg type='a{sv}' name='profile' direction='out'/>"
+      "    </method>"
+      "  </interface>"
+      "</node>";
+
+typedef struct KeyfileDebugRegistration
+{
+  GDBusConnection *connection;
+  GDBusNodeInfo *introspection_data;
+  guint id;
+} KeyfileDebugRegistration;
+
+/**
+ * Every normal rule of the current ruleset, in priority order, as
+ * (file, section, evaluated, matched, decided, inverse decided)
+ */
+static GVariant *
+keyfile_debug_get_rule_stats (PolkitBackendKeyfileAuthority *authority)
+{
+  GVariantBuilder builder;
+  PolicyRuleset *ruleset = NULL;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sstttt)"));
+
+  ruleset = ref_ruleset (authority);
+  for (guint i = 0; i < ruleset->rules->len; i++)
+    {
+      const PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, i);
+      PolicyRuleStats *stats = &ruleset->stats[i];
+
+      g_variant_builder_add (
+          &builder, "(sstttt)", entry->file->path ? entry->file->path : "",
+          policy_file_get_id (entry->file, entry->policy),
+          (guint64)g_atomic_pointer_get (&stats->evaluated),
+          (guint64)g_atomic_pointer_get (&stats->matched),
+          (guint64)g_atomic_pointer_get (&stats->decided),
+          (guint64)g_atomic_pointer_get (&stats->inverse_decided));
+    }
+  policy_ruleset_unref (ruleset);
+
+  return g_variant_new ("(a(sstttt))", &builder);
+}
+
+static GVariant *
+keyfile_debug_new_histogram (volatile gsize *histogram)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("at"));
+  for (guint i = 0; i < KEYFILE_HISTOGRAM_BUCKETS; i++)
+    {
+      g_variant_builder_add (&builder, "t",
+                             (guint64)g_atomic_pointer_get (&histogram[i]));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+keyfile_debug_get_check_stats (PolkitBackendKeyfileAuthority *authority)
+{
+  GVariantBuilder builder;
+  PolicyCacheStats stats = { 0 };
+
+  keyfile_copy_cache_stats (authority, &stats);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{sv}", "cache-hits",
+                         g_variant_new_uint64 (stats.hits));
+  g_variant_builder_add (&builder, "{sv}", "cache-misses",
+                         g_variant_new_uint64 (stats.misses));
+  g_variant_builder_add (
+      &builder, "{sv}", "rules-tested",
+      keyfile_debug_new_histogram (authority->priv->rules_tested));
+  g_variant_builder_add (
+      &builder, "{sv}", "prepare-usec",
+      keyfile_debug_new_histogram (authority->priv->prepare_usec));
+
+  return g_variant_new ("(a{sv})", &builder);
+}
+
+typedef struct KeyfileDebugCall
+{
+  PolkitBackendKeyfileAuthority *authority;
+  GDBusMethodInvocation *invocation;
+} KeyfileDebugCall;
+
+static void
+keyfile_debug_on_caller_uid (GObject *source, GAsyncResult *res,
+                             gpointer user_data)
+{
+  KeyfileDebugCall *call = user_data;
+  PolkitBackendKeyfileAuthority *authority = call->authority;
+  GDBusMethodInvocation *invocation = call->invocation;
+  const gchar *method_name = NULL;
+  g_autoptr (GVariant) reply = NULL;
+  guint32 uid = G_MAXUINT32;
+
+  reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res,
+                                         NULL);
+  if (reply)
+    {
+      g_variant_get (reply, "(u)", &uid);
+    }
+  if (uid != 0)
+    {
+      g_dbus_method_invocation_return_error_literal (
+          invocation, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED,
+          "Only root may read the rule statistics");
+      goto out;
+    }
+
+  method_name = g_dbus_method_invocation_get_method_name (invocation);
+  if (g_strcmp0 (method_name, "GetRuleStats") == 0)
+    {
+      g_dbus_method_invocation_return_value (
+          invocation, keyfile_debug_get_rule_stats (authority));
+    }
+  else if (g_strcmp0 (method_name, "GetCheckStats") == 0)
+    {
+      g_dbus_method_invocation_return_value (
+          invocation, keyfile_debug_get_check_stats (authority));
+    }
+  else if (g_strcmp0 (method_name, "GetLoadProfile") == 0)
+    {
+      g_dbus_method_invocation_return_value (
+          invocation,
+          g_variant_new ("(@a{sv})", authority->priv->load_profile));
+    }
+  else
+    {
+      g_assert_not_reached ();
+    }
+
+out:
+  g_object_unref (authority);
+  g_free (call);
+}
+
+static void
+keyfile_debug_method_call (GDBusConnection *connection, const gchar *sender,
+                           const gchar *object_path,
+                           const gchar *interface_name,
+                           const gchar *method_name, GVariant *parameters,
+                           GDBusMethodInvocation *invocation,
+                           gpointer user_data)
+{
+  KeyfileDebugCall *call = NULL;
+
+  call = g_new0 (KeyfileDebugCall, 1);
+  call->authority = g_object_ref (POLKIT_BACKEND_KEYFILE_AUTHORITY (user_data));
+  call->invocation = invocation;
+
+  /* Rule names and hit counts say a lot about who does what, so this is
+   * for root only, whatever the bus policy. Asked without blocking, as the
+   * handler runs on the main loop. */
+  g_dbus_connection_call (
+      connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+      "org.freedesktop.DBus", "GetConnectionUnixUser",
+      g_variant_new ("(s)", sender), G_VARIANT_TYPE ("(u)"),
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, keyfile_debug_on_caller_uid, call);
+}
+
+static const GDBusInterfaceVTable keyfile_debug_vtable = {
+  keyfile_debug_method_call,
+  NULL,
+  NULL,
+};
+
+gpointer
+polkit_backend_keyfile_authority_register_debug (
+    PolkitBackendKeyfileAuthority *authority, GDBusConnection *connection,
+    const gchar *object_path, GError **error)
+{
+  KeyfileDebugRegistration *registration = NULL;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_KEYFILE_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), NULL);
+  g_return_val_if_fail (object_path != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  registration = g_new0 (KeyfileDebugRegistration, 1);
+  registration->introspection_data
+      = g_dbus_node_info_new_for_xml (keyfile_debug_introspection_data, NULL);
+  g_assert (registration->introspection_data != NULL);
+
+  registration->id = g_dbus_connection_register_object (
+      connection, object_path,
+      registration->introspection_data->interfaces[0], &keyfile_debug_vtable,
+      g_object_ref (authority), g_object_unref, error);
+  if (registration->id == 0)
+    {
+      g_dbus_node_info_unref (registration->introspection_data);
+      g_free (registration);
+      return NULL;
+    }
+  registration->connection = g_object_ref (connection);
+
+  return registration;
+}
+
+void
+polkit_backend_keyfile_authority_unregister_debug (gpointer registration_id)
+{
+  KeyfileDebugRegistration *registration = registration_id;
+
+  g_dbus_connection_unregister_object (registration->connection,
+                                       registration->id);
+  g_object_unref (registration->connection);
+  g_dbus_node_info_unref (registration->introspection_data);
+  g_free (registration);
+}
+
+gchar *
+polkit_backend_keyfile_authority_format_load_profile (
+    PolkitBackendKeyfileAuthority *authority)
+{
+  GString *str = NULL;
+  GVariant *files = NULL;
+  GVariantIter iter;
+  const gchar *path = NULL;
+  gboolean parsed;
+  gboolean failed;
+  guint64 read_usec;
+  guint64 parse_usec;
+  guint64 compile_usec;
+  guint n_rules;
+  guint n_admin_rules;
+  guint64 string_bytes;
+  guint64 value = 0;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_KEYFILE_AUTHORITY (authority), NULL);
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "%-8s %10s %10s %10s %6s %6s %10s  %s\n",
+                          "STATE", "READ-US", "PARSE-US", "COMPILE-US",
+                          "RULES", "ADMIN", "STRINGS", "FILE");
+
+  files = g_variant_lookup_value (authority->priv->load_profile, "files",
+                                  G_VARIANT_TYPE ("a(sbbtttuut)"));
+  g_variant_iter_init (&iter, files);
+  while (g_variant_iter_next (&iter, "(&sbbtttuut)", &path, &parsed, &failed,
+                              &read_usec, &parse_usec, &compile_usec,
+                              &n_rules, &n_admin_rules, &string_bytes))
+    {
+      g_string_append_printf (
+          str,
+          "%-8s %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+          " %10" G_GUINT64_FORMAT " %6u %6u %10" G_GUINT64_FORMAT "  %s\n",
+          failed ? "failed" : (parsed ? "parsed" : "reused"), read_usec,
+          parse_usec, compile_usec, n_rules, n_admin_rules, string_bytes,
+          path);
+    }
+  g_variant_unref (files);
+
+  g_variant_lookup (authority->priv->load_profile, "scan-usec", "t", &value);
+  g_string_append_printf (str, "scan-usec: %" G_GUINT64_FORMAT "\n", value);
+  g_variant_lookup (authority->priv->load_profile, "parse-usec", "t", &value);
+  g_string_append_printf (str, "parse-usec: %" G_GUINT64_FORMAT "\n", value);
+  g_variant_lookup (authority->priv->load_profile, "ruleset-usec", "t",
+                    &value);
+  g_string_append_printf (str, "ruleset-usec: %" G_GUINT64_FORMAT "\n",
+                          value);
+  g_variant_lookup (authority->priv->load_profile, "total-usec", "t", &value);
+  g_string_append_printf (str, "total-usec: %" G_GUINT64_FORMAT "\n", value);
+
+  return g_string_free (str, FALSE);
+}
@@ -31,6 +31,7 @@
 #ifndef __POLKIT_BACKEND_KEYFILE_AUTHORITY_H
 #define __POLKIT_BACKEND_KEYFILE_AUTHORITY_H
 
+#include <gio/gio.h>
 #include <glib-object.h>
 #include <polkitbackend/polkitbackendinteractiveauthority.h>
 #include <polkitbackend/polkitbackendtypes.h>
@@ -84,6 +85,25 @@ struct _PolkitBackendKeyfileAuthorityClass
 
 GType polkit_backend_keyfile_authority_get_type (void) G_GNUC_CONST;
 
+/**
+ * Export the read-only org.freedesktop.PolicyKit1.Debug interface, with
+ * per-rule hit counters and per-check histograms, at @object_path.
+ * Returns an opaque registration, or NULL with @error set.
+ */
+gpointer polkit_backend_keyfile_authority_register_debug (
+    PolkitBackendKeyfileAuthority *authority, GDBusConnection *connection,
+    const gchar *object_path, GError **error);
+
+void polkit_backend_keyfile_authority_unregister_debug (
+    gpointer registration_id);
+
+/**
+ * Describe what the last load of the rules cost, file by file, as a table
+ * for humans. Free with g_free().
+ */
+gchar *polkit_backend_keyfile_authority_format_load_profile (
+    PolkitBackendKeyfileAuthority *authority);
+
 G_END_DECLS
 
 #endif /* __POLKIT_BACKEND_KEYFILE_AUTHORITY_H */
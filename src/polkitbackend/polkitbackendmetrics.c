@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include "polkitbackendmetrics.h"
+
+/**
+ * SECTION:polkitbackendmetrics
+ * @title: PolkitBackendMetrics
+ * @short_description: Counters and latency histograms of the daemon
+ * @stability: Unstable
+ *
+ * A #PolkitBackendMetrics counts the calls to every method of the
+ * authority and what became of the checks, and records how long the
+ * phases of a check take.
+ *
+ * Every counter is a single word updated with an atomic add, so
+ * recording is safe from any thread, never takes a lock and costs about
+ * as much as the call to g_get_monotonic_time() that usually goes with
+ * it. A snapshot read while checks are running may be a few events
+ * behind; the counters are never reset.
+ */
+
+struct _PolkitBackendMetrics
+{
+  volatile gsize calls[POLKIT_BACKEND_METRICS_N_METHODS];
+  volatile gsize counters[POLKIT_BACKEND_METRICS_N_COUNTERS];
+  volatile gsize latency[POLKIT_BACKEND_METRICS_N_PHASES][POLKIT_BACKEND_METRICS_BUCKETS];
+};
+
+static const gchar *method_names[POLKIT_BACKEND_METRICS_N_METHODS] =
+{
+  "EnumerateActions",
+  "CheckAuthorization",
+  "CheckAuthorizations",
+  "RegisterAuthenticationAgent",
+  "UnregisterAuthenticationAgent",
+  "AuthenticationAgentResponse",
+  "EnumerateTemporaryAuthorizations",
+  "RevokeTemporaryAuthorizations",
+};
+
+static const gchar *counter_names[POLKIT_BACKEND_METRICS_N_COUNTERS] =
+{
+  "checks-authorized",
+  "checks-challenged",
+  "checks-not-authorized",
+  "checks-failed",
+  "rules-cache-hits",
+  "rules-cache-misses",
+  "shadow-checks",
+  "shadow-mismatches",
+  "provider-cache-hits",
+  "provider-answers",
+  "provider-fallbacks",
+};
+
+static const gchar *phase_names[POLKIT_BACKEND_METRICS_N_PHASES] =
+{
+  "check",
+  "subject",
+  "session",
+  "rules",
+  "temporary-authorization",
+  "reload",
+  "reload-parse",
+  "reload-compile",
+  "shadow-reference",
+  "shadow-compiled",
+  "provider",
+  "challenge-initiate",
+  "challenge-agent",
+  "challenge-complete",
+};
+
+/**
+ * polkit_backend_metrics_new:
+ *
+ * Creates a new #PolkitBackendMetrics with every counter at zero.
+ *
+ * Returns: A #PolkitBackendMetrics. Free with polkit_backend_metrics_free().
+ */
+PolkitBackendMetrics *
+polkit_backend_metrics_new (void)
+{
+  return g_new0 (PolkitBackendMetrics, 1);
+}
+
+/**
+ * polkit_backend_metrics_free:
+ * @metrics: A #PolkitBackendMetrics.
+ *
+ * Frees @metrics. Nothing may be recording to it any more.
+ */
+void
+polkit_backend_metrics_free (PolkitBackendMetrics *metrics)
+{
+  g_free (metrics);
+}
+
+/**
+ * polkit_backend_metrics_count_call:
+ * @metrics: A #PolkitBackendMetrics.
+ * @method: The method that was called.
+ *
+ * Counts a call to @method. Safe to call from any thread.
+ */
+void
+polkit_backend_metrics_count_call (PolkitBackendMetrics       *metrics,
+                                   PolkitBackendMetricsMethod  method)
+{
+  g_return_if_fail (method < POLKIT_BACKEND_METRICS_N_METHODS);
+
+  g_atomic_pointer_add (&metrics->calls[method], 1);
+}
+
+/**
+ * polkit_backend_metrics_count:
+ * @metrics: A #PolkitBackendMetrics.
+ * @counter: What happened.
+ *
+ * Counts @counter once. Safe to call from any thread.
+ */
+void
+polkit_backend_metrics_count (PolkitBackendMetrics        *metrics,
+                              PolkitBackendMetricsCounter  counter)
+{
+  g_return_if_fail (counter < POLKIT_BACKEND_METRICS_N_COUNTERS);
+
+  g_atomic_pointer_add (&metrics->counters[counter], 1);
+}
+
+/**
+ * polkit_backend_metrics_add_latency:
+ * @metrics: A #PolkitBackendMetrics.
+ * @phase: What took @usec.
+ * @usec: How long it took, in microseconds.
+ *
+ * Records that @phase took @usec once. Safe to call from any thread.
+ */
+void
+polkit_backend_metrics_add_latency (PolkitBackendMetrics      *metrics,
+                                    PolkitBackendMetricsPhase  phase,
+                                    gint64                     usec)
+{
+  guint bucket;
+  guint64 value;
+
+  g_return_if_fail (phase < POLKIT_BACKEND_METRICS_N_PHASES);
+
+  /* the monotonic clock doesn't go back, but be safe anyway */
+  value = usec > 0 ? (guint64) usec : 0;
+  bucket = 0;
+  while (value > 0 && bucket < POLKIT_BACKEND_METRICS_BUCKETS - 1)
+    {
+      value >>= 1;
+      bucket++;
+    }
+
+  g_atomic_pointer_add (&metrics->latency[phase][bucket], 1);
+}
+
+/**
+ * polkit_backend_metrics_snapshot:
+ * @metrics: A #PolkitBackendMetrics.
+ * @builder: A #GVariantBuilder for a dictionary of type <literal>a{sv}</literal>.
+ *
+ * Adds the current value of every counter to @builder:
+ * <literal>calls</literal> maps method names to the number of calls,
+ * <literal>counters</literal> maps counter names to their value, and
+ * <literal>latency-usec</literal> maps phase names to the buckets of
+ * their histogram.
+ */
+void
+polkit_backend_metrics_snapshot (PolkitBackendMetrics *metrics,
+                                 GVariantBuilder      *builder)
+{
+  GVariantBuilder dict_builder;
+  GVariantBuilder histogram_builder;
+  guint n;
+  guint m;
+
+  g_variant_builder_init (&dict_builder, G_VARIANT_TYPE ("a{st}"));
+  for (n = 0; n < POLKIT_BACKEND_METRICS_N_METHODS; n++)
+    g_variant_builder_add (&dict_builder, "{st}",
+                           method_names[n],
+                           (guint64) g_atomic_pointer_get (&metrics->calls[n]));
+  g_variant_builder_add (builder, "{sv}", "calls", g_variant_builder_end (&dict_builder));
+
+  g_variant_builder_init (&dict_builder, G_VARIANT_TYPE ("a{st}"));
+  for (n = 0; n < POLKIT_BACKEND_METRICS_N_COUNTERS; n++)
+    g_variant_builder_add (&dict_builder, "{st}",
+                           counter_names[n],
+                           (guint64) g_atomic_pointer_get (&metrics->counters[n]));
+  g_variant_builder_add (builder, "{sv}", "counters", g_variant_builder_end (&dict_builder));
+
+  g_variant_builder_init (&dict_builder, G_VARIANT_TYPE ("a{sat}"));
+  for (n = 0; n < POLKIT_BACKEND_METRICS_N_PHASES; n++)
+    {
+      g_variant_builder_init (&histogram_builder, G_VARIANT_TYPE ("at"));
+      for (m = 0; m < POLKIT_BACKEND_METRICS_BUCKETS; m++)
+        g_variant_builder_add (&histogram_builder, "t",
+                               (guint64) g_atomic_pointer_get (&metrics->latency[n][m]));
+      g_variant_builder_add (&dict_builder, "{s@at}",
+                             phase_names[n],
+                             g_variant_builder_end (&histogram_builder));
+    }
+  g_variant_builder_add (builder, "{sv}", "latency-usec", g_variant_builder_end (&dict_builder));
+}
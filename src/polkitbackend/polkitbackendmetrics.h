@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined (_POLKIT_BACKEND_COMPILATION) || defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error "This is a private header file."
+#endif
+
+#ifndef __POLKIT_BACKEND_METRICS_H
+#define __POLKIT_BACKEND_METRICS_H
+
+#include <glib-object.h>
+#include <polkitbackend/polkitbackendtypes.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PolkitBackendMetricsMethod:
+ *
+ * The methods of the authority whose calls are counted.
+ */
+typedef enum
+{
+  POLKIT_BACKEND_METRICS_METHOD_ENUMERATE_ACTIONS,
+  POLKIT_BACKEND_METRICS_METHOD_CHECK_AUTHORIZATION,
+  POLKIT_BACKEND_METRICS_METHOD_CHECK_AUTHORIZATIONS,
+  POLKIT_BACKEND_METRICS_METHOD_REGISTER_AUTHENTICATION_AGENT,
+  POLKIT_BACKEND_METRICS_METHOD_UNREGISTER_AUTHENTICATION_AGENT,
+  POLKIT_BACKEND_METRICS_METHOD_AUTHENTICATION_AGENT_RESPONSE,
+  POLKIT_BACKEND_METRICS_METHOD_ENUMERATE_TEMPORARY_AUTHORIZATIONS,
+  POLKIT_BACKEND_METRICS_METHOD_REVOKE_TEMPORARY_AUTHORIZATIONS,
+  POLKIT_BACKEND_METRICS_N_METHODS
+} PolkitBackendMetricsMethod;
+
+/**
+ * PolkitBackendMetricsPhase:
+ * @POLKIT_BACKEND_METRICS_PHASE_CHECK: A whole check, until it is answered or handed to an agent.
+ * @POLKIT_BACKEND_METRICS_PHASE_SUBJECT: Finding the users and process of the caller and subject.
+ * @POLKIT_BACKEND_METRICS_PHASE_SESSION: Asking the session monitor about the subject's session.
+ * @POLKIT_BACKEND_METRICS_PHASE_RULES: Evaluating the rules for every action of a check.
+ * @POLKIT_BACKEND_METRICS_PHASE_TEMPORARY: Looking for temporary authorizations.
+ * @POLKIT_BACKEND_METRICS_PHASE_RELOAD: Reloading the rules.
+ * @POLKIT_BACKEND_METRICS_PHASE_RELOAD_PARSE: Parsing the new or modified rules files of a reload.
+ * @POLKIT_BACKEND_METRICS_PHASE_RELOAD_COMPILE: Compiling the rules files of a reload into a ruleset.
+ * @POLKIT_BACKEND_METRICS_PHASE_SHADOW_REFERENCE: Testing the rules one by one, in shadow evaluation.
+ * @POLKIT_BACKEND_METRICS_PHASE_SHADOW_COMPILED: Testing the compiled rules, in shadow evaluation.
+ * @POLKIT_BACKEND_METRICS_PHASE_PROVIDER: Asking the decision provider, whether it answered or not.
+ * @POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_INITIATE: Starting a challenge, until the agent is asked to authenticate.
+ * @POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_AGENT: The agent authenticating, until the helper responds or the agent gives up.
+ * @POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_COMPLETE: Answering the challenged check, once the helper responded.
+ *
+ * The parts of the work whose latency is recorded.
+ */
+typedef enum
+{
+  POLKIT_BACKEND_METRICS_PHASE_CHECK,
+  POLKIT_BACKEND_METRICS_PHASE_SUBJECT,
+  POLKIT_BACKEND_METRICS_PHASE_SESSION,
+  POLKIT_BACKEND_METRICS_PHASE_RULES,
+  POLKIT_BACKEND_METRICS_PHASE_TEMPORARY,
+  POLKIT_BACKEND_METRICS_PHASE_RELOAD,
+  POLKIT_BACKEND_METRICS_PHASE_RELOAD_PARSE,
+  POLKIT_BACKEND_METRICS_PHASE_RELOAD_COMPILE,
+  POLKIT_BACKEND_METRICS_PHASE_SHADOW_REFERENCE,
+  POLKIT_BACKEND_METRICS_PHASE_SHADOW_COMPILED,
+  POLKIT_BACKEND_METRICS_PHASE_PROVIDER,
+  POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_INITIATE,
+  POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_AGENT,
+  POLKIT_BACKEND_METRICS_PHASE_CHALLENGE_COMPLETE,
+  POLKIT_BACKEND_METRICS_N_PHASES
+} PolkitBackendMetricsPhase;
+
+/**
+ * PolkitBackendMetricsCounter:
+ *
+ * Events that are counted and don't belong to a single method.
+ */
+typedef enum
+{
+  POLKIT_BACKEND_METRICS_COUNTER_CHECKS_AUTHORIZED,
+  POLKIT_BACKEND_METRICS_COUNTER_CHECKS_CHALLENGED,
+  POLKIT_BACKEND_METRICS_COUNTER_CHECKS_NOT_AUTHORIZED,
+  POLKIT_BACKEND_METRICS_COUNTER_CHECKS_FAILED,
+  POLKIT_BACKEND_METRICS_COUNTER_RULES_CACHE_HITS,
+  POLKIT_BACKEND_METRICS_COUNTER_RULES_CACHE_MISSES,
+  POLKIT_BACKEND_METRICS_COUNTER_SHADOW_CHECKS,
+  POLKIT_BACKEND_METRICS_COUNTER_SHADOW_MISMATCHES,
+  POLKIT_BACKEND_METRICS_COUNTER_PROVIDER_CACHE_HITS,
+  POLKIT_BACKEND_METRICS_COUNTER_PROVIDER_ANSWERS,
+  POLKIT_BACKEND_METRICS_COUNTER_PROVIDER_FALLBACKS,
+  POLKIT_BACKEND_METRICS_N_COUNTERS
+} PolkitBackendMetricsCounter;
+
+/* Latencies are counted in log2 buckets of microseconds: bucket 0 holds zero,
+ * and bucket n the values in [2^(n-1), 2^n), with the last one holding the rest
+ */
+#define POLKIT_BACKEND_METRICS_BUCKETS 32
+
+PolkitBackendMetrics *polkit_backend_metrics_new         (void);
+void                  polkit_backend_metrics_free        (PolkitBackendMetrics        *metrics);
+
+void                  polkit_backend_metrics_count_call  (PolkitBackendMetrics        *metrics,
+                                                          PolkitBackendMetricsMethod   method);
+void                  polkit_backend_metrics_count       (PolkitBackendMetrics        *metrics,
+                                                          PolkitBackendMetricsCounter  counter);
+void                  polkit_backend_metrics_add_latency (PolkitBackendMetrics        *metrics,
+                                                          PolkitBackendMetricsPhase    phase,
+                                                          gint64                       usec);
+
+void                  polkit_backend_metrics_snapshot    (PolkitBackendMetrics        *metrics,
+                                                          GVariantBuilder             *builder);
+
+G_END_DECLS
+
+#endif /* __POLKIT_BACKEND_METRICS_H */
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "polkitbackendpolicyarena.h"
+
+/* Every allocation is rounded up to this, as malloc would */
+#define POLICY_ARENA_ALIGN (2 * sizeof (gsize))
+
+/**
+ * Once the first chunk is full, further allocations come from overflow
+ * chunks. These only live until the next reset, which then grows the
+ * first chunk to fit the lot.
+ */
+typedef struct PolicyArenaChunk
+{
+  struct PolicyArenaChunk *next;
+  gsize size;
+  gsize used;
+} PolicyArenaChunk;
+
+struct PolicyArena
+{
+  guint8 *data;
+  gsize size;
+  gsize used;
+  PolicyArenaChunk *overflow; /**<Most recent first */
+  gsize overflow_used;        /**<Bytes handed out from overflow chunks */
+};
+
+static gsize
+policy_arena_round (gsize size)
+{
+  return (size + POLICY_ARENA_ALIGN - 1) & ~(POLICY_ARENA_ALIGN - 1);
+}
+
+/* The header is rounded up too, so the data following it stays aligned */
+#define POLICY_ARENA_CHUNK_HEADER (policy_arena_round (sizeof (PolicyArenaChunk)))
+
+PolicyArena *
+policy_arena_new (gsize size)
+{
+  PolicyArena *ret = NULL;
+
+  ret = g_new0 (PolicyArena, 1);
+  ret->size = policy_arena_round (MAX (size, POLICY_ARENA_ALIGN));
+  ret->data = g_malloc (ret->size);
+
+  return ret;
+}
+
+static gpointer
+policy_arena_alloc_overflow (PolicyArena *arena, gsize size)
+{
+  PolicyArenaChunk *chunk = arena->overflow;
+
+  if (!chunk || chunk->size - chunk->used < size)
+    {
+      gsize chunk_size = MAX (size, arena->size);
+
+      chunk = g_malloc (POLICY_ARENA_CHUNK_HEADER + chunk_size);
+      chunk->next = arena->overflow;
+      chunk->size = chunk_size;
+      chunk->used = 0;
+      arena->overflow = chunk;
+    }
+
+  chunk->used += size;
+  arena->overflow_used += size;
+
+  return (guint8 *)chunk + POLICY_ARENA_CHUNK_HEADER + chunk->used - size;
+}
+
+gpointer
+policy_arena_alloc0 (PolicyArena *arena, gsize size)
+{
+  gpointer ret = NULL;
+
+  size = policy_arena_round (MAX (size, 1));
+  if (arena->size - arena->used >= size)
+    {
+      ret = arena->data + arena->used;
+      arena->used += size;
+    }
+  else
+    {
+      ret = policy_arena_alloc_overflow (arena, size);
+    }
+
+  return memset (ret, 0, size);
+}
+
+gchar *
+policy_arena_strdup (PolicyArena *arena, const gchar *str)
+{
+  gsize len = 0;
+
+  if (!str)
+    {
+      return NULL;
+    }
+  len = strlen (str) + 1;
+  return memcpy (policy_arena_alloc0 (arena, len), str, len);
+}
+
+gchar *
+policy_arena_strdup_printf (PolicyArena *arena, const gchar *format, ...)
+{
+  va_list args;
+  va_list copy;
+  gint len = 0;
+  gchar *ret = NULL;
+
+  va_start (args, format);
+  va_copy (copy, args);
+  len = g_vsnprintf (NULL, 0, format, copy);
+  va_end (copy);
+
+  ret = policy_arena_alloc0 (arena, (gsize)len + 1);
+  g_vsnprintf (ret, (gulong)len + 1, format, args);
+  va_end (args);
+
+  return ret;
+}
+
+static void
+policy_arena_free_overflow (PolicyArena *arena)
+{
+  PolicyArenaChunk *chunk = NULL;
+
+  while ((chunk = arena->overflow))
+    {
+      arena->overflow = chunk->next;
+      g_free (chunk);
+    }
+  arena->overflow_used = 0;
+}
+
+void
+policy_arena_reset (PolicyArena *arena)
+{
+  if (arena->overflow)
+    {
+      /* Make room for everything this round needed in a single chunk */
+      gsize size = policy_arena_round (arena->used + arena->overflow_used);
+
+      policy_arena_free_overflow (arena);
+      g_free (arena->data);
+      arena->size = size;
+      arena->data = g_malloc (arena->size);
+    }
+  arena->used = 0;
+}
+
+gsize
+policy_arena_get_used (PolicyArena *arena)
+{
+  return arena->used + arena->overflow_used;
+}
+
+void
+policy_arena_free (PolicyArena *arena)
+{
+  if (!arena)
+    {
+      return;
+    }
+  policy_arena_free_overflow (arena);
+  g_free (arena->data);
+  g_free (arena);
+}
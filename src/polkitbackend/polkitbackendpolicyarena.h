@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_POLICY_ARENA_H
+#define __POLKIT_BACKEND_POLICY_ARENA_H
+
+#include <glib.h>
+
+/**
+ * PolicyArena is a bump allocator for what a single check needs only
+ * while it runs. Nothing allocated from it is freed on its own, the whole
+ * lot goes at once in policy_arena_reset().
+ *
+ * The arena keeps its memory across resets, and grows its first chunk to
+ * fit the largest request seen, so steady state checks never reach malloc.
+ * It is not thread safe, use one per thread.
+ */
+typedef struct PolicyArena PolicyArena;
+
+/**
+ * Create a new arena, starting out with @size bytes
+ */
+PolicyArena *policy_arena_new (gsize size);
+
+/**
+ * Allocate @size zeroed bytes, suitably aligned for any type
+ */
+gpointer policy_arena_alloc0 (PolicyArena *arena, gsize size);
+
+/**
+ * Copy @str into the arena
+ */
+gchar *policy_arena_strdup (PolicyArena *arena, const gchar *str);
+
+/**
+ * Format a string into the arena
+ */
+gchar *policy_arena_strdup_printf (PolicyArena *arena, const gchar *format,
+                                   ...) G_GNUC_PRINTF (2, 3);
+
+/**
+ * Release everything allocated so far, keeping the memory for next time
+ */
+void policy_arena_reset (PolicyArena *arena);
+
+/**
+ * Number of bytes handed out since the last reset
+ */
+gsize policy_arena_get_used (PolicyArena *arena);
+
+/**
+ * Free any resources associated with a PolicyArena
+ */
+void policy_arena_free (PolicyArena *arena);
+
+#endif /* __POLKIT_BACKEND_POLICY_ARENA_H */
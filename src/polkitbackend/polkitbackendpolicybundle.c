@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "polkitbackendpolicybundle.h"
+#include "polkitbackendpolicyimage.h"
+
+/**
+ * The bundle is laid out as a header followed by a rules image, which
+ * starts out aligned as the header is a multiple of 8 bytes long. The
+ * signature covers the header, with the signature itself zeroed, and the
+ * whole image.
+ */
+#define POLICY_BUNDLE_MAGIC 0x42524b50 /* "PKRB" */
+#define POLICY_BUNDLE_SIGNATURE_SIZE 32
+
+typedef struct PolicyBundleHeader
+{
+  guint32 magic;
+  guint32 version;
+  guint64 serial;
+  guint64 image_size;
+  guint8 signature[POLICY_BUNDLE_SIGNATURE_SIZE]; /**<HMAC-SHA256 */
+} PolicyBundleHeader;
+
+G_STATIC_ASSERT (sizeof (PolicyBundleHeader) % 8 == 0);
+
+GBytes *
+policy_bundle_read_key (const gchar *path, GError **error)
+{
+  gchar *contents = NULL;
+  gsize length = 0;
+
+  if (!g_file_get_contents (path, &contents, &length, error))
+    {
+      return NULL;
+    }
+  if (length < POLICY_BUNDLE_MIN_KEY_SIZE)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Key %s is too short, it needs at least %d bytes", path,
+                   POLICY_BUNDLE_MIN_KEY_SIZE);
+      g_free (contents);
+      return NULL;
+    }
+
+  return g_bytes_new_take (contents, length);
+}
+
+/**
+ * Sign @header, whose signature is ignored, along with @image
+ */
+static void
+policy_bundle_sign (const PolicyBundleHeader *header, const gchar *image,
+                    gsize image_size, GBytes *key,
+                    guint8 signature[POLICY_BUNDLE_SIGNATURE_SIZE])
+{
+  PolicyBundleHeader unsigned_header = *header;
+  GHmac *hmac = NULL;
+  gsize signature_size = POLICY_BUNDLE_SIGNATURE_SIZE;
+
+  memset (unsigned_header.signature, 0, sizeof (unsigned_header.signature));
+
+  hmac = g_hmac_new (G_CHECKSUM_SHA256, g_bytes_get_data (key, NULL),
+                     g_bytes_get_size (key));
+  g_hmac_update (hmac, (const guchar *)&unsigned_header,
+                 sizeof (unsigned_header));
+  g_hmac_update (hmac, (const guchar *)image, image_size);
+  g_hmac_get_digest (hmac, signature, &signature_size);
+  g_hmac_unref (hmac);
+}
+
+/**
+ * Compare without stopping at the first difference, so that how long it
+ * takes says nothing about how much of the signature was right
+ */
+static gboolean
+policy_bundle_signature_equal (const guint8 *a, const guint8 *b)
+{
+  guint8 diff = 0;
+
+  for (guint i = 0; i < POLICY_BUNDLE_SIGNATURE_SIZE; i++)
+    {
+      diff |= a[i] ^ b[i];
+    }
+  return diff == 0;
+}
+
+gboolean
+policy_bundle_write (const gchar *path, const PolicyFile *files,
+                     guint64 serial, GBytes *key, GError **error)
+{
+  GArray *entries = NULL;
+  GBytes *image = NULL;
+  GByteArray *bundle = NULL;
+  PolicyBundleHeader header = { 0 };
+  gboolean ret = FALSE;
+
+  entries = g_array_new (FALSE, TRUE, sizeof (PolicyImageEntry));
+  for (const PolicyFile *file = files; file; file = file->next)
+    {
+      /* Nothing on the hosts loading the bundle matches a stamp taken
+       * here, so none is kept */
+      PolicyImageEntry entry = {
+        .path = file->path ? file->path : "",
+        .file = (PolicyFile *)file,
+      };
+
+      g_array_append_val (entries, entry);
+    }
+  image = policy_image_serialize ((PolicyImageEntry *)entries->data,
+                                  entries->len);
+
+  header.magic = POLICY_BUNDLE_MAGIC;
+  header.version = POLICY_BUNDLE_VERSION;
+  header.serial = serial;
+  header.image_size = g_bytes_get_size (image);
+  policy_bundle_sign (&header, g_bytes_get_data (image, NULL),
+                      g_bytes_get_size (image), key, header.signature);
+
+  bundle = g_byte_array_sized_new (sizeof (header) + header.image_size);
+  g_byte_array_append (bundle, (const guint8 *)&header, sizeof (header));
+  g_byte_array_append (bundle, g_bytes_get_data (image, NULL),
+                       g_bytes_get_size (image));
+
+  /* Written to a temporary file and renamed over, so readers only ever
+   * see a complete bundle */
+  ret = g_file_set_contents (path, (const gchar *)bundle->data, bundle->len,
+                             error);
+
+  g_byte_array_unref (bundle);
+  g_bytes_unref (image);
+  g_array_unref (entries);
+  return ret;
+}
+
+gboolean
+policy_bundle_read (const gchar *path, GBytes *key, PolicyFile **out_files,
+                    guint64 *out_serial, GError **error)
+{
+  GMappedFile *mapped = NULL;
+  const gchar *data = NULL;
+  gsize length;
+  PolicyBundleHeader header;
+  guint8 signature[POLICY_BUNDLE_SIGNATURE_SIZE];
+  GArray *entries = NULL;
+  PolicyFile *first = NULL;
+  PolicyFile *last = NULL;
+  gboolean ret = FALSE;
+
+  mapped = g_mapped_file_new (path, FALSE, error);
+  if (!mapped)
+    {
+      return FALSE;
+    }
+  data = g_mapped_file_get_contents (mapped);
+  length = g_mapped_file_get_length (mapped);
+
+  if (length < sizeof (header))
+    {
+      goto corrupt;
+    }
+  memcpy (&header, data, sizeof (header));
+  if (header.magic != POLICY_BUNDLE_MAGIC)
+    {
+      goto corrupt;
+    }
+  if (header.version != POLICY_BUNDLE_VERSION)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Bundle %s is from another version", path);
+      goto out;
+    }
+  if (header.image_size != length - sizeof (header))
+    {
+      goto corrupt;
+    }
+
+  /* Nothing of the image is looked at before it is known to be ours */
+  policy_bundle_sign (&header, data + sizeof (header), header.image_size, key,
+                      signature);
+  if (!policy_bundle_signature_equal (signature, header.signature))
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Bundle %s is not signed with this key", path);
+      goto out;
+    }
+
+  entries = policy_image_read_data (data + sizeof (header), header.image_size,
+                                    path, error);
+  if (!entries)
+    {
+      goto out;
+    }
+
+  for (guint n = 0; n < entries->len; n++)
+    {
+      PolicyImageEntry *entry = &g_array_index (entries, PolicyImageEntry, n);
+      PolicyFile *file = g_steal_pointer (&entry->file);
+
+      if (last)
+        {
+          last->next = file;
+        }
+      else
+        {
+          first = file;
+        }
+      last = file;
+    }
+  g_array_unref (entries);
+
+  *out_files = first;
+  if (out_serial)
+    {
+      *out_serial = header.serial;
+    }
+  ret = TRUE;
+  goto out;
+
+corrupt:
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+               "Bundle %s is corrupt", path);
+
+out:
+  g_mapped_file_unref (mapped);
+  return ret;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_POLICY_BUNDLE_H
+#define __POLKIT_BACKEND_POLICY_BUNDLE_H
+
+#include <glib.h>
+
+#include "polkitbackendpolicyfile.h"
+
+/**
+ * Bump whenever the layout of the bundle header changes. The image within
+ * carries its own version, and a bundle is only usable when both match.
+ */
+#define POLICY_BUNDLE_VERSION 1
+
+/**
+ * Keys shorter than this are refused, as they'd make the signature easy to
+ * forge
+ */
+#define POLICY_BUNDLE_MIN_KEY_SIZE 16
+
+/**
+ * A bundle is a whole chain of PolicyFiles compiled ahead of time, say on
+ * a build server, and signed with a key shared with every host that loads
+ * it. Unlike the rules cache it doesn't depend on the sources being
+ * present, only on the host having the same architecture and version of
+ * polkit as the one that wrote it.
+ *
+ * The signature is an HMAC-SHA256 of the whole bundle, so anyone holding
+ * the key can also produce bundles; keep it readable by root only.
+ */
+
+/**
+ * Read the signing key at @path, refusing keys that are too short
+ */
+GBytes *policy_bundle_read_key (const gchar *path, GError **error);
+
+/**
+ * Atomically replace the bundle at @path with the given chain of files,
+ * in priority order
+ * @serial: Version of the rules. polkitd logs it, and refuses bundles
+ * with a lower serial than one it loaded before.
+ */
+gboolean policy_bundle_write (const gchar *path, const PolicyFile *files,
+                              guint64 serial, GBytes *key, GError **error);
+
+/**
+ * Map the bundle at @path, check its signature against @key and load its
+ * files. Returns FALSE if the bundle is missing, corrupt, not signed with
+ * @key or from another version.
+ * @out_files: Set to the chain of files, in priority order, possibly NULL
+ * @out_serial: If not NULL, set to the serial the bundle was written with
+ */
+gboolean policy_bundle_read (const gchar *path, GBytes *key,
+                             PolicyFile **out_files, guint64 *out_serial,
+                             GError **error);
+
+#endif /* __POLKIT_BACKEND_POLICY_BUNDLE_H */
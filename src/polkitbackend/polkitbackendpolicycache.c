@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include "polkitbackendpolicycache.h"
+
+/**
+ * A single cached outcome. The key owns a copy of the action ID, and the
+ * entry is linked into the LRU queue via its embedded link.
+ */
+typedef struct PolicyCacheEntry
+{
+  PolicyCacheKey key;
+  PolkitImplicitAuthorization result;
+  guint generation;
+  gint64 expires; /**<Monotonic time after which this entry is stale */
+  GList link;     /**<Position in the LRU queue, data points back here */
+} PolicyCacheEntry;
+
+struct PolicyCache
+{
+  GHashTable *entries; /**<PolicyCacheKey to PolicyCacheEntry */
+  GQueue lru;          /**<Most recently used at the head */
+  guint capacity;
+  gint64 ttl;
+  guint generation;
+  PolicyCacheStats stats;
+};
+
+static guint
+policy_cache_key_hash (gconstpointer v)
+{
+  const PolicyCacheKey *key = v;
+  guint hash = g_str_hash (key->action_id);
+
+  hash = (hash * 31) + (guint)key->uid;
+  hash = (hash * 31) + (key->subject_is_local ? 1 : 0);
+  hash = (hash * 31) + (key->subject_is_active ? 1 : 0);
+  hash = (hash * 31) + g_direct_hash (key->seat);
+  hash = (hash * 31) + g_direct_hash (key->session_class);
+  hash = (hash * 31) + g_direct_hash (key->session_type);
+
+  return hash;
+}
+
+static gboolean
+policy_cache_key_equal (gconstpointer a, gconstpointer b)
+{
+  const PolicyCacheKey *ka = a;
+  const PolicyCacheKey *kb = b;
+
+  return ka->uid == kb->uid
+         && !ka->subject_is_local == !kb->subject_is_local
+         && !ka->subject_is_active == !kb->subject_is_active
+         && ka->seat == kb->seat && ka->session_class == kb->session_class
+         && ka->session_type == kb->session_type
+         && g_str_equal (ka->action_id, kb->action_id);
+}
+
+static void
+policy_cache_entry_free (PolicyCacheEntry *entry)
+{
+  g_free ((gchar *)entry->key.action_id);
+  g_free (entry);
+}
+
+PolicyCache *
+policy_cache_new (guint capacity, gint64 ttl)
+{
+  PolicyCache *ret = NULL;
+
+  ret = g_new0 (PolicyCache, 1);
+  ret->entries = g_hash_table_new_full (
+      policy_cache_key_hash, policy_cache_key_equal, NULL,
+      (GDestroyNotify)policy_cache_entry_free);
+  g_queue_init (&ret->lru);
+  ret->capacity = MAX (capacity, 1);
+  ret->ttl = ttl;
+
+  return ret;
+}
+
+/**
+ * Unlink and free the entry
+ */
+static void
+policy_cache_remove (PolicyCache *cache, PolicyCacheEntry *entry)
+{
+  g_queue_unlink (&cache->lru, &entry->link);
+  g_hash_table_remove (cache->entries, &entry->key);
+}
+
+guint
+policy_cache_get_generation (PolicyCache *cache)
+{
+  return cache->generation;
+}
+
+void
+policy_cache_bump_generation (PolicyCache *cache)
+{
+  cache->stats.expired += g_hash_table_size (cache->entries);
+  cache->generation++;
+
+  /* Nothing from an older generation may ever be served, drop it all now */
+  g_queue_init (&cache->lru);
+  g_hash_table_remove_all (cache->entries);
+}
+
+gboolean
+policy_cache_lookup (PolicyCache *cache, const PolicyCacheKey *key,
+                     PolkitImplicitAuthorization *result)
+{
+  PolicyCacheEntry *entry = NULL;
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (!entry)
+    {
+      cache->stats.misses++;
+      return FALSE;
+    }
+
+  if (entry->generation != cache->generation
+      || g_get_monotonic_time () >= entry->expires)
+    {
+      policy_cache_remove (cache, entry);
+      cache->stats.expired++;
+      cache->stats.misses++;
+      return FALSE;
+    }
+
+  /* Move to the front of the queue */
+  g_queue_unlink (&cache->lru, &entry->link);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+
+  cache->stats.hits++;
+  *result = entry->result;
+  return TRUE;
+}
+
+void
+policy_cache_insert (PolicyCache *cache, const PolicyCacheKey *key,
+                     guint generation, PolkitImplicitAuthorization result)
+{
+  PolicyCacheEntry *entry = NULL;
+
+  /* Computed against rules that have since been replaced */
+  if (generation != cache->generation)
+    {
+      return;
+    }
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry)
+    {
+      policy_cache_remove (cache, entry);
+    }
+
+  while (g_hash_table_size (cache->entries) >= cache->capacity)
+    {
+      PolicyCacheEntry *oldest = g_queue_peek_tail (&cache->lru);
+      policy_cache_remove (cache, oldest);
+      cache->stats.evictions++;
+    }
+
+  entry = g_new0 (PolicyCacheEntry, 1);
+  entry->key = *key;
+  entry->key.action_id = g_strdup (key->action_id);
+  entry->result = result;
+  entry->generation = generation;
+  entry->expires = g_get_monotonic_time () + cache->ttl;
+  entry->link.data = entry;
+
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  g_hash_table_insert (cache->entries, &entry->key, entry);
+}
+
+guint
+policy_cache_get_size (PolicyCache *cache)
+{
+  return g_hash_table_size (cache->entries);
+}
+
+void
+policy_cache_get_memory_usage (PolicyCache *cache, guint64 *bytes,
+                               guint64 *objects)
+{
+  GHashTableIter iter;
+  PolicyCacheEntry *entry = NULL;
+
+  g_hash_table_iter_init (&iter, cache->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry))
+    {
+      /* the entry, its action ID and its slot in the table */
+      *bytes += sizeof (PolicyCacheEntry) + strlen (entry->key.action_id) + 1
+                + 2 * sizeof (gpointer) + sizeof (guint);
+      *objects += 1;
+    }
+}
+
+const PolicyCacheStats *
+policy_cache_get_stats (PolicyCache *cache)
+{
+  return &cache->stats;
+}
+
+void
+policy_cache_free (PolicyCache *cache)
+{
+  if (!cache)
+    {
+      return;
+    }
+  g_clear_pointer (&cache->entries, g_hash_table_unref);
+  g_free (cache);
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_POLICY_CACHE_H
+#define __POLKIT_BACKEND_POLICY_CACHE_H
+
+#include <glib.h>
+#include <polkit/polkitprivate.h>
+#include <sys/types.h>
+
+/**
+ * PolicyCacheKey holds exactly the inputs a PolicyRuleset consumes, so two
+ * checks with equal keys are guaranteed the same outcome from the same
+ * ruleset (for as long as group membership is unchanged). Outcomes that
+ * depended on the details of a check are left out of the cache.
+ */
+typedef struct PolicyCacheKey
+{
+  uid_t uid;
+  const gchar *action_id;
+  gboolean subject_is_local;
+  gboolean subject_is_active;
+  /* Interned with g_intern_string() and compared by address, or NULL */
+  const gchar *seat;
+  const gchar *session_class;
+  const gchar *session_type;
+} PolicyCacheKey;
+
+/**
+ * PolicyCacheStats are running counters, suited to scraping
+ */
+typedef struct PolicyCacheStats
+{
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions; /**<Entries dropped to stay within the capacity */
+  guint64 expired;   /**<Entries dropped due to TTL or a new generation */
+} PolicyCacheStats;
+
+/**
+ * PolicyCache is a bounded LRU cache of ruleset outcomes.
+ *
+ * Entries are stamped with the generation they were computed against.
+ * Bumping the generation (i.e. on reload) invalidates every entry at once,
+ * and entries also expire after a TTL so that group membership changes are
+ * eventually noticed.
+ */
+typedef struct PolicyCache PolicyCache;
+
+/**
+ * Create a new cache holding at most @capacity entries, each valid for
+ * @ttl microseconds
+ */
+PolicyCache *policy_cache_new (guint capacity, gint64 ttl);
+
+/**
+ * Current generation, to be passed back to policy_cache_insert() once the
+ * outcome has been computed
+ */
+guint policy_cache_get_generation (PolicyCache *cache);
+
+/**
+ * Invalidate every entry, i.e. because the rules changed
+ */
+void policy_cache_bump_generation (PolicyCache *cache);
+
+/**
+ * Look up a cached outcome, returning TRUE on a hit
+ */
+gboolean policy_cache_lookup (PolicyCache *cache, const PolicyCacheKey *key,
+                              PolkitImplicitAuthorization *result);
+
+/**
+ * Store an outcome computed against the given generation. Outcomes from an
+ * older generation are silently discarded.
+ */
+void policy_cache_insert (PolicyCache *cache, const PolicyCacheKey *key,
+                          guint generation,
+                          PolkitImplicitAuthorization result);
+
+/**
+ * Number of entries currently held
+ */
+guint policy_cache_get_size (PolicyCache *cache);
+
+/**
+ * Estimate the memory held by the entries, and add it to @bytes and
+ * @objects
+ */
+void policy_cache_get_memory_usage (PolicyCache *cache, guint64 *bytes,
+                                    guint64 *objects);
+
+/**
+ * Running counters for this cache
+ */
+const PolicyCacheStats *policy_cache_get_stats (PolicyCache *cache);
+
+/**
+ * Free any resources associated with a PolicyCache
+ */
+void policy_cache_free (PolicyCache *cache);
+
+#endif /* __POLKIT_BACKEND_POLICY_CACHE_H */
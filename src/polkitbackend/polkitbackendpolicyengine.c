@@ -0,0 +1,517 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include <polkit/polkit.h>
+
+#include "polkitbackendactionpool.h"
+#include "polkitbackendpolicyarena.h"
+#include "polkitbackendpolicycache.h"
+#include "polkitbackendpolicyengine.h"
+#include "polkitbackendpolicyidentity.h"
+#include "polkitbackendpolicyloader.h"
+#include "polkitbackendpolicynetgroup.h"
+#include "polkitbackendpolicyruleset.h"
+
+/**
+ * SECTION:polkitbackendpolicyengine
+ * @title: PolkitBackendPolicyEngine
+ * @short_description: In-process evaluation of keyfile rules
+ *
+ * #PolkitBackendPolicyEngine answers authorization checks against the
+ * same .keyrules files and .policy actions that polkitd uses, without a
+ * daemon or a bus. It is meant for trusted services in environments
+ * where polkitd isn't running, such as containers or an initramfs.
+ *
+ * The answers are those polkitd's keyfile authority would give, with
+ * two exceptions that only the daemon can provide: temporary
+ * authorizations obtained by authenticating are not consulted, and
+ * actions are not implied by others through
+ * <literal>org.freedesktop.policykit.imply</literal>. An answer that
+ * requires authentication is returned to the caller to act on.
+ *
+ * An engine may be shared between threads.
+ */
+
+/**
+ * Bounds for the decision cache, as in polkitd
+ */
+#define ENGINE_CACHE_SIZE 1024
+#define ENGINE_CACHE_TTL (30 * G_USEC_PER_SEC)
+
+/**
+ * Bounds for netgroup lookups, as in polkitd
+ */
+#define ENGINE_NETGROUP_SIZE 1024
+#define ENGINE_NETGROUP_TTL (300 * G_USEC_PER_SEC)
+#define ENGINE_NETGROUP_NEGATIVE_TTL (60 * G_USEC_PER_SEC)
+
+/* Bytes of scratch space a check starts out with, the arena grows on demand */
+#define ENGINE_ARENA_SIZE 1024
+
+struct _PolkitBackendPolicyEngine
+{
+  volatile gint ref_count;
+
+  GMutex loader_lock; /* Held across a reload */
+  PolicyLoader *loader;
+
+  GMutex ruleset_lock;
+  PolicyRuleset *ruleset;
+
+  GMutex cache_lock;
+  PolicyCache *cache;
+  PolicyNetgroupCache *netgroups;
+
+  /* The action pool is not thread-safe, so every use is under pool_lock */
+  GMutex pool_lock;
+  gchar *actions_dir;
+  PolkitBackendActionPool *pool;
+};
+
+/**
+ * Scratch space for the checks run on each thread, reset after every check
+ */
+static GPrivate engine_arena = G_PRIVATE_INIT ((GDestroyNotify)policy_arena_free);
+
+static PolicyArena *
+engine_get_arena (void)
+{
+  PolicyArena *arena = g_private_get (&engine_arena);
+
+  if (!arena)
+    {
+      arena = policy_arena_new (ENGINE_ARENA_SIZE);
+      g_private_set (&engine_arena, arena);
+    }
+  return arena;
+}
+
+static PolkitBackendActionPool *
+engine_new_pool (const gchar *actions_dir)
+{
+  PolkitBackendActionPool *pool = NULL;
+  GFile *directory = NULL;
+
+  directory = g_file_new_for_path (actions_dir);
+  pool = polkit_backend_action_pool_new (directory);
+  g_object_unref (directory);
+
+  return pool;
+}
+
+static PolicyRuleset *
+engine_ref_ruleset (PolkitBackendPolicyEngine *engine)
+{
+  PolicyRuleset *ret = NULL;
+
+  g_mutex_lock (&engine->ruleset_lock);
+  ret = policy_ruleset_ref (engine->ruleset);
+  g_mutex_unlock (&engine->ruleset_lock);
+
+  return ret;
+}
+
+/**
+ * polkit_backend_policy_engine_get_version:
+ *
+ * Gets the version of the #PolkitBackendPolicyEngine API provided by
+ * the library, see %POLKIT_BACKEND_POLICY_ENGINE_VERSION.
+ *
+ * Returns: The version of the API.
+ *
+ * Since: 0.121
+ */
+guint
+polkit_backend_policy_engine_get_version (void)
+{
+  return POLKIT_BACKEND_POLICY_ENGINE_VERSION;
+}
+
+/**
+ * polkit_backend_policy_engine_new:
+ * @rules_dirs: (allow-none): Directories to load .keyrules files from,
+ *   in the order they are searched, or %NULL for the system rules.
+ * @actions_dir: (allow-none): Directory to load .policy files from, or
+ *   %NULL for the system actions.
+ *
+ * Creates a new engine and loads its rules. The system rules are
+ * started from the image polkitd precompiled, if it is readable; the
+ * engine never writes it.
+ *
+ * Returns: A new #PolkitBackendPolicyEngine, free with
+ *   polkit_backend_policy_engine_unref().
+ *
+ * Since: 0.121
+ */
+PolkitBackendPolicyEngine *
+polkit_backend_policy_engine_new (const gchar *const *rules_dirs,
+                                  const gchar *actions_dir)
+{
+  PolkitBackendPolicyEngine *engine = NULL;
+  const gchar *system_dirs[] = { POLICY_LOADER_SYSCONF_RULES_DIR,
+                                 POLICY_LOADER_DATA_RULES_DIR, NULL };
+  const gchar *rules_cache = NULL;
+
+  if (rules_dirs == NULL)
+    {
+      rules_dirs = system_dirs;
+      rules_cache = POLICY_LOADER_RULES_CACHE;
+    }
+  if (actions_dir == NULL)
+    {
+      actions_dir = PACKAGE_DATA_DIR "/polkit-1/actions";
+    }
+
+  engine = g_new0 (PolkitBackendPolicyEngine, 1);
+  engine->ref_count = 1;
+  g_mutex_init (&engine->loader_lock);
+  g_mutex_init (&engine->ruleset_lock);
+  g_mutex_init (&engine->cache_lock);
+  g_mutex_init (&engine->pool_lock);
+
+  engine->loader = policy_loader_new (rules_dirs, rules_cache, FALSE, NULL,
+                                      NULL);
+  policy_loader_read_cache (engine->loader);
+  engine->ruleset = policy_loader_compile (engine->loader);
+
+  engine->cache = policy_cache_new (ENGINE_CACHE_SIZE, ENGINE_CACHE_TTL);
+  engine->netgroups = policy_netgroup_cache_new (
+      ENGINE_NETGROUP_SIZE, ENGINE_NETGROUP_TTL, ENGINE_NETGROUP_NEGATIVE_TTL);
+
+  engine->actions_dir = g_strdup (actions_dir);
+  engine->pool = engine_new_pool (engine->actions_dir);
+
+  return engine;
+}
+
+/**
+ * polkit_backend_policy_engine_ref:
+ * @engine: A #PolkitBackendPolicyEngine.
+ *
+ * Increases the reference count of @engine.
+ *
+ * Returns: @engine.
+ *
+ * Since: 0.121
+ */
+PolkitBackendPolicyEngine *
+polkit_backend_policy_engine_ref (PolkitBackendPolicyEngine *engine)
+{
+  g_return_val_if_fail (engine != NULL, NULL);
+
+  g_atomic_int_inc (&engine->ref_count);
+  return engine;
+}
+
+/**
+ * polkit_backend_policy_engine_unref:
+ * @engine: A #PolkitBackendPolicyEngine.
+ *
+ * Decreases the reference count of @engine, and frees it once the last
+ * reference is gone.
+ *
+ * Since: 0.121
+ */
+void
+polkit_backend_policy_engine_unref (PolkitBackendPolicyEngine *engine)
+{
+  g_return_if_fail (engine != NULL);
+
+  if (!g_atomic_int_dec_and_test (&engine->ref_count))
+    {
+      return;
+    }
+
+  policy_loader_free (engine->loader);
+  policy_ruleset_unref (engine->ruleset);
+  policy_cache_free (engine->cache);
+  policy_netgroup_cache_free (engine->netgroups);
+  g_object_unref (engine->pool);
+  g_free (engine->actions_dir);
+
+  g_mutex_clear (&engine->loader_lock);
+  g_mutex_clear (&engine->ruleset_lock);
+  g_mutex_clear (&engine->cache_lock);
+  g_mutex_clear (&engine->pool_lock);
+  g_free (engine);
+}
+
+/**
+ * polkit_backend_policy_engine_reload:
+ * @engine: A #PolkitBackendPolicyEngine.
+ *
+ * Loads the rules and actions again. Only rules files that changed are
+ * parsed again. Checks running meanwhile are answered from the previous
+ * rules.
+ *
+ * Since: 0.121
+ */
+void
+polkit_backend_policy_engine_reload (PolkitBackendPolicyEngine *engine)
+{
+  PolicyRuleset *ruleset = NULL;
+  PolkitBackendActionPool *pool = NULL;
+
+  g_return_if_fail (engine != NULL);
+
+  g_mutex_lock (&engine->loader_lock);
+  ruleset = policy_loader_compile (engine->loader);
+  g_mutex_unlock (&engine->loader_lock);
+
+  g_mutex_lock (&engine->ruleset_lock);
+  policy_ruleset_unref (engine->ruleset);
+  engine->ruleset = ruleset;
+  g_mutex_unlock (&engine->ruleset_lock);
+
+  /* Outcomes cached from now on belong to the new rules */
+  g_mutex_lock (&engine->cache_lock);
+  policy_cache_bump_generation (engine->cache);
+  g_mutex_unlock (&engine->cache_lock);
+  policy_netgroup_cache_clear (engine->netgroups);
+
+  pool = engine_new_pool (engine->actions_dir);
+  g_mutex_lock (&engine->pool_lock);
+  g_object_unref (engine->pool);
+  engine->pool = pool;
+  g_mutex_unlock (&engine->pool_lock);
+}
+
+/**
+ * What the resolve callback needs for a single check
+ */
+typedef struct EngineResolveData
+{
+  uid_t uid;
+  PolicyUserRecord *record; /**<Looked up on first use */
+} EngineResolveData;
+
+static PolicyUserRecord *
+engine_get_user_record (EngineResolveData *data)
+{
+  if (!data->record)
+    {
+      data->record = policy_identity_cache_lookup_user (NULL, data->uid);
+    }
+  return data->record;
+}
+
+/**
+ * Resolve subject facts as and when the rules need them, so that a check
+ * against plain Actions= rules needs no lookups at all.
+ */
+static void
+engine_resolve_context (PolicyContext *context, PolicyContextFact fact)
+{
+  EngineResolveData *data = context->resolve_data;
+  PolicyUserRecord *record = engine_get_user_record (data);
+
+  switch (fact)
+    {
+    case POLICY_CONTEXT_USERNAME:
+      if (record->name == NULL)
+        {
+          context->username = policy_arena_strdup_printf (
+              context->arena, "%d", (gint)data->uid);
+          g_warning ("Error looking up info for uid %d", (gint)data->uid);
+        }
+      else
+        {
+          /* Owned by the record, which outlives the check */
+          context->username = record->name;
+        }
+      context->primary_gid = record->primary_gid;
+      break;
+
+    case POLICY_CONTEXT_GIDS:
+      /* Groups are matched by gid, so there's no need to resolve names */
+      context->gids = record->gids;
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/**
+ * Pick the implicit authorization of @action_id for the subject, or
+ * return FALSE if the action isn't registered
+ */
+static gboolean
+engine_get_implicit (PolkitBackendPolicyEngine *engine,
+                     const PolkitBackendPolicySubject *subject,
+                     const gchar *action_id,
+                     PolkitImplicitAuthorization *implicit)
+{
+  PolkitActionDescription *action_desc = NULL;
+
+  g_mutex_lock (&engine->pool_lock);
+  action_desc
+      = polkit_backend_action_pool_get_action (engine->pool, action_id, NULL);
+  g_mutex_unlock (&engine->pool_lock);
+
+  if (action_desc == NULL)
+    {
+      return FALSE;
+    }
+
+  if (subject->is_local && subject->is_active)
+    {
+      *implicit = polkit_action_description_get_implicit_active (action_desc);
+    }
+  else if (subject->is_local)
+    {
+      *implicit = polkit_action_description_get_implicit_inactive (action_desc);
+    }
+  else
+    {
+      *implicit = polkit_action_description_get_implicit_any (action_desc);
+    }
+  g_object_unref (action_desc);
+
+  return TRUE;
+}
+
+/**
+ * polkit_backend_policy_engine_check:
+ * @engine: A #PolkitBackendPolicyEngine.
+ * @subject: What is known about the subject.
+ * @action_id: The action to check.
+ * @details: (allow-none): Details about the action, or %NULL.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Checks whether @subject is authorized for @action_id, the way polkitd
+ * would. The rules are consulted first, and the action's defaults
+ * answer when no rule does. The user with uid 0 is always authorized.
+ *
+ * Answers that depend on nothing but the subject are cached, so that
+ * repeat checks cost no lookups.
+ *
+ * Returns: The answer, or %POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN if
+ *   @action_id isn't registered and @error is set.
+ *
+ * Since: 0.121
+ */
+PolkitImplicitAuthorization
+polkit_backend_policy_engine_check (PolkitBackendPolicyEngine *engine,
+                                    const PolkitBackendPolicySubject *subject,
+                                    const gchar *action_id,
+                                    PolkitDetails *details, GError **error)
+{
+  PolkitImplicitAuthorization implicit
+      = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
+  PolkitImplicitAuthorization ret = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  PolicyCacheKey key = { 0 };
+  PolicyRuleset *ruleset = NULL;
+  PolicyRulesetTrace trace = { 0 };
+  EngineResolveData data = { 0 };
+  gboolean cached = FALSE;
+  guint generation;
+
+  g_return_val_if_fail (engine != NULL, POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  g_return_val_if_fail (subject != NULL, POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  g_return_val_if_fail (POLKIT_IS_UNIX_USER (subject->user),
+                        POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  g_return_val_if_fail (action_id != NULL,
+                        POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  g_return_val_if_fail (error == NULL || *error == NULL,
+                        POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+
+  if (!engine_get_implicit (engine, subject, action_id, &implicit))
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Action %s is not registered", action_id);
+      return POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+    }
+
+  data.uid = polkit_unix_user_get_uid (POLKIT_UNIX_USER (subject->user));
+  if (data.uid == 0)
+    {
+      return POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED;
+    }
+
+  /* Some answers are the same for every subject */
+  ruleset = engine_ref_ruleset (engine);
+  if (policy_ruleset_test_static (ruleset, action_id, &trace, &ret))
+    {
+      policy_ruleset_unref (ruleset);
+      goto out;
+    }
+  g_clear_pointer (&ruleset, policy_ruleset_unref);
+
+  /* The cache compares session facts by pointer */
+  key.uid = data.uid;
+  key.action_id = action_id;
+  key.subject_is_local = subject->is_local;
+  key.subject_is_active = subject->is_active;
+  key.seat = g_intern_string (subject->seat);
+  key.session_class = g_intern_string (subject->session_class);
+  key.session_type = g_intern_string (subject->session_type);
+
+  g_mutex_lock (&engine->cache_lock);
+  cached = policy_cache_lookup (engine->cache, &key, &ret);
+  generation = policy_cache_get_generation (engine->cache);
+  g_mutex_unlock (&engine->cache_lock);
+
+  if (!cached)
+    {
+      PolicyContext context = {
+        .subject = NULL,
+        .user_for_subject = subject->user,
+        .subject_is_local = subject->is_local,
+        .subject_is_active = subject->is_active,
+        .details = details,
+        .seat = key.seat,
+        .session_class = key.session_class,
+        .session_type = key.session_type,
+        .netgroups = engine->netgroups,
+        .arena = engine_get_arena (),
+        .resolve = engine_resolve_context,
+        .resolve_data = &data,
+      };
+
+      ruleset = engine_ref_ruleset (engine);
+      ret = policy_ruleset_test_full (ruleset, action_id, &context, &trace);
+      policy_ruleset_unref (ruleset);
+
+      context.gids = NULL;
+      context.username = NULL;
+      policy_arena_reset (context.arena);
+      g_clear_pointer (&data.record, policy_user_record_unref);
+
+      /* The key doesn't cover the details, so neither can the cache */
+      if (!trace.used_details)
+        {
+          g_mutex_lock (&engine->cache_lock);
+          policy_cache_insert (engine->cache, &key, generation, ret);
+          g_mutex_unlock (&engine->cache_lock);
+        }
+    }
+
+out:
+  /* No rules answered, so the action's defaults do */
+  if (ret == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
+    {
+      return implicit;
+    }
+  return ret;
+}
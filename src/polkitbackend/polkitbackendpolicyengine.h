@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#ifndef __POLKIT_BACKEND_POLICY_ENGINE_H
+#define __POLKIT_BACKEND_POLICY_ENGINE_H
+
+#include <polkit/polkit.h>
+
+G_BEGIN_DECLS
+
+/**
+ * POLKIT_BACKEND_POLICY_ENGINE_VERSION:
+ *
+ * The version of the #PolkitBackendPolicyEngine API, bumped whenever
+ * it is extended. Compare it with
+ * polkit_backend_policy_engine_get_version() to find out what the
+ * library you are running against provides.
+ */
+#define POLKIT_BACKEND_POLICY_ENGINE_VERSION 1
+
+typedef struct _PolkitBackendPolicyEngine  PolkitBackendPolicyEngine;
+typedef struct _PolkitBackendPolicySubject PolkitBackendPolicySubject;
+
+/**
+ * PolkitBackendPolicySubject:
+ * @user: The #PolkitUnixUser the subject runs as.
+ * @is_local: Whether the subject's session is local.
+ * @is_active: Whether the subject's session is active.
+ * @seat: The seat of the subject's session, or %NULL.
+ * @session_class: The class of the subject's session, or %NULL.
+ * @session_type: The type of the subject's session, or %NULL.
+ *
+ * What is known about the subject of a check. Initialize it to all
+ * zeroes before filling it in, so that fields added later keep their
+ * defaults.
+ */
+struct _PolkitBackendPolicySubject
+{
+  PolkitIdentity *user;
+  gboolean        is_local;
+  gboolean        is_active;
+  const gchar    *seat;
+  const gchar    *session_class;
+  const gchar    *session_type;
+
+  /*< private >*/
+  gpointer        _polkit_reserved[8];
+};
+
+guint                        polkit_backend_policy_engine_get_version (void);
+
+PolkitBackendPolicyEngine   *polkit_backend_policy_engine_new         (const gchar * const              *rules_dirs,
+                                                                       const gchar                      *actions_dir);
+PolkitBackendPolicyEngine   *polkit_backend_policy_engine_ref         (PolkitBackendPolicyEngine        *engine);
+void                         polkit_backend_policy_engine_unref       (PolkitBackendPolicyEngine        *engine);
+
+void                         polkit_backend_policy_engine_reload      (PolkitBackendPolicyEngine        *engine);
+
+PolkitImplicitAuthorization  polkit_backend_policy_engine_check       (PolkitBackendPolicyEngine        *engine,
+                                                                       const PolkitBackendPolicySubject *subject,
+                                                                       const gchar                      *action_id,
+                                                                       PolkitDetails                    *details,
+                                                                       GError                          **error);
+
+G_END_DECLS
+
+#endif /* __POLKIT_BACKEND_POLICY_ENGINE_H */
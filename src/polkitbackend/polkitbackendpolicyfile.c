@@ -21,7 +21,9 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <glib.h>
+#include <grp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,35 +38,257 @@
 #define POLICY_SECTION "Policy"
 
 /**
- * Action ID to match all possible IDs
- * Useful for "SubjectUser=" matches
+ * Prefix of the sections defining a shared list, i.e. "[List admins]"
  */
-#define POLICY_MATCH_ALL "*"
+#define POLICY_LIST_SECTION "List "
 
-static gboolean policy_file_load_rules (GKeyFile *keyfile,
-                                        const gchar *section, Policy **target);
+/**
+ * First character of a list entry naming a shared list, i.e. "@admins"
+ */
+#define POLICY_LIST_REFERENCE '@'
+
+/**
+ * A [List name] section, only added to the string table once a rule names
+ * it. Every rule naming it then shares the same range.
+ */
+typedef struct PolicyList
+{
+  gchar **values;
+  PolicyStrings strings[2]; /**<As is, and with the wheel substituted */
+  gboolean resolved[2];
+} PolicyList;
+
+/**
+ * Scratch state used while loading a single PolicyFile, so that the final
+ * file is just a handful of flat allocations
+ */
+typedef struct PolicyFileBuilder
+{
+  GString *pool;         /**<Backing string pool */
+  GArray *strings;       /**<Pool offsets (guint) for PolicyStrings */
+  GHashTable *interned;  /**<String to (pool offset + 1) for deduplication */
+  GHashTable *lists;     /**<Name to PolicyList */
+  GArray *rules[2];      /**<Normal and admin Policy records */
+} PolicyFileBuilder;
+
+static gboolean policy_file_load_rules (PolicyFileBuilder *builder,
+                                        GKeyFile *keyfile,
+                                        const gchar *section, GArray *target,
+                                        GError **err);
 static PolkitImplicitAuthorization policy_string_to_result (const gchar *inp);
 
-PolicyFile *
-policy_file_new_from_path (const char *path, GError **err)
+/**
+ * Store the string in the pool once, returning its offset
+ */
+static guint
+policy_file_builder_intern (PolicyFileBuilder *builder, const gchar *str)
 {
-  g_autoptr (GKeyFile) keyf = NULL;
+  gpointer existing = NULL;
+  guint offset;
+
+  if (g_hash_table_lookup_extended (builder->interned, str, NULL, &existing))
+    {
+      return GPOINTER_TO_UINT (existing) - 1;
+    }
+
+  offset = builder->pool->len;
+  g_string_append_len (builder->pool, str, strlen (str) + 1);
+  g_hash_table_insert (builder->interned, g_strdup (str),
+                       GUINT_TO_POINTER (offset + 1));
+  return offset;
+}
+
+static void
+policy_list_free (PolicyList *list)
+{
+  g_strfreev (list->values);
+  g_free (list);
+}
+
+static void
+policy_file_builder_init (PolicyFileBuilder *builder)
+{
+  builder->pool = g_string_new (NULL);
+  builder->strings = g_array_new (FALSE, FALSE, sizeof (guint));
+  builder->interned
+      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  builder->lists = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                          (GDestroyNotify)policy_list_free);
+  builder->rules[0] = g_array_new (FALSE, TRUE, sizeof (Policy));
+  builder->rules[1] = g_array_new (FALSE, TRUE, sizeof (Policy));
+}
+
+/**
+ * Hand the builder contents over to the file, invalidating the builder
+ */
+static void
+policy_file_builder_finish (PolicyFileBuilder *builder, PolicyFile *file)
+{
+  file->n_strings = builder->strings->len;
+  file->strings = (guint *)g_array_free (builder->strings, FALSE);
+  file->pool_size = builder->pool->len;
+  file->pool = g_string_free (builder->pool, FALSE);
+  file->rules.n_normal = builder->rules[0]->len;
+  file->rules.normal = (Policy *)g_array_free (builder->rules[0], FALSE);
+  file->rules.n_admin = builder->rules[1]->len;
+  file->rules.admin = (Policy *)g_array_free (builder->rules[1], FALSE);
+  g_clear_pointer (&builder->interned, g_hash_table_unref);
+  g_clear_pointer (&builder->lists, g_hash_table_unref);
+}
+
+static void
+policy_file_builder_clear (PolicyFileBuilder *builder)
+{
+  if (builder->pool)
+    {
+      g_string_free (builder->pool, TRUE);
+    }
+  g_clear_pointer (&builder->strings, g_array_unref);
+  g_clear_pointer (&builder->interned, g_hash_table_unref);
+  g_clear_pointer (&builder->lists, g_hash_table_unref);
+  g_clear_pointer (&builder->rules[0], g_array_unref);
+  g_clear_pointer (&builder->rules[1], g_array_unref);
+}
+
+/**
+ * Collect the [List name] sections of @keyfile, which was loaded from @path
+ */
+static gboolean
+policy_file_builder_add_lists (PolicyFileBuilder *builder, GKeyFile *keyfile,
+                               const gchar *path, GError **err)
+{
+  gchar **groups = g_key_file_get_groups (keyfile, NULL);
+  gboolean ret = FALSE;
+
+  for (guint i = 0; groups[i]; i++)
+    {
+      const gchar *name = groups[i] + strlen (POLICY_LIST_SECTION);
+      PolicyList *list = NULL;
+
+      if (!g_str_has_prefix (groups[i], POLICY_LIST_SECTION))
+        {
+          continue;
+        }
+      if (*name == '\0' || g_hash_table_contains (builder->lists, name))
+        {
+          g_set_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                       "Unnamed or duplicate list '%s' in %s", name, path);
+          goto out;
+        }
+
+      list = g_new0 (PolicyList, 1);
+      list->values = g_key_file_get_string_list (keyfile, groups[i], "Values",
+                                                 NULL, err);
+      if (!list->values)
+        {
+          g_free (list);
+          goto out;
+        }
+      for (guint j = 0; list->values[j]; j++)
+        {
+          /* Keeping lists flat means each one resolves in a single pass */
+          if (g_strstrip (list->values[j])[0] == POLICY_LIST_REFERENCE)
+            {
+              g_set_error (err, G_KEY_FILE_ERROR,
+                           G_KEY_FILE_ERROR_INVALID_VALUE,
+                           "List '%s' in %s names another list", name, path);
+              policy_list_free (list);
+              goto out;
+            }
+        }
+      g_hash_table_insert (builder->lists, g_strdup (name), list);
+    }
+  ret = TRUE;
+
+out:
+  g_strfreev (groups);
+  return ret;
+}
+
+/**
+ * Collect the lists of every fragment named by Include=, relative to the
+ * directory of the including file. Fragments only ever contribute lists.
+ */
+static gboolean
+policy_file_builder_include (PolicyFileBuilder *builder, GKeyFile *keyfile,
+                             const gchar *path, gboolean *out_included,
+                             GError **err)
+{
+  gchar **includes = NULL;
+  g_autofree gchar *dir = NULL;
+  gboolean ret = FALSE;
+
+  *out_included = FALSE;
+  if (!g_key_file_has_key (keyfile, POLICY_SECTION, "Include", NULL))
+    {
+      return TRUE;
+    }
+
+  includes = g_key_file_get_string_list (keyfile, POLICY_SECTION, "Include",
+                                         NULL, err);
+  if (!includes)
+    {
+      return FALSE;
+    }
+
+  dir = g_path_get_dirname (path);
+  for (guint i = 0; includes[i]; i++)
+    {
+      g_autoptr (GKeyFile) fragment = g_key_file_new ();
+      g_autofree gchar *fragment_path = NULL;
+      const gchar *name = g_strstrip (includes[i]);
+
+      fragment_path = g_path_is_absolute (name)
+                          ? g_strdup (name)
+                          : g_build_filename (dir, name, NULL);
+      if (!g_key_file_load_from_file (fragment, fragment_path,
+                                      G_KEY_FILE_NONE, err))
+        {
+          g_prefix_error (err, "Error including %s: ", fragment_path);
+          goto out;
+        }
+      if (!policy_file_builder_add_lists (builder, fragment, fragment_path,
+                                          err))
+        {
+          goto out;
+        }
+      *out_included = TRUE;
+    }
+  ret = TRUE;
+
+out:
+  g_strfreev (includes);
+  return ret;
+}
+
+/**
+ * Everything after the keyfile is parsed, with the time it takes
+ * attributed to compiling
+ */
+static PolicyFile *
+policy_file_new_from_keyfile (GKeyFile *keyf, const char *path, GError **err)
+{
+  PolicyFileBuilder builder = { 0 };
   PolicyFile *ret = NULL;
   gboolean has_rules = FALSE;
+  gboolean has_includes = FALSE;
 
-  keyf = g_key_file_new ();
-  if (!g_key_file_load_from_file (keyf, path, G_KEY_FILE_NONE, err))
+  policy_file_builder_init (&builder);
+
+  /* Lists first, as any rule may name one */
+  if (!policy_file_builder_include (&builder, keyf, path, &has_includes, err)
+      || !policy_file_builder_add_lists (&builder, keyf, path, err))
     {
+      policy_file_builder_clear (&builder);
       return NULL;
     }
 
-  ret = g_new0 (PolicyFile, 1);
-
   if (g_key_file_has_key (keyf, POLICY_SECTION, "Rules", NULL))
     {
-      if (!policy_file_load_rules (keyf, "Rules", &ret->rules.normal))
+      if (!policy_file_load_rules (&builder, keyf, "Rules", builder.rules[0],
+                                   err))
         {
-          policy_file_free (ret);
+          policy_file_builder_clear (&builder);
           return NULL;
         }
       has_rules = TRUE;
@@ -73,9 +297,10 @@ policy_file_new_from_path (const char *path, GError **err)
   if (g_key_file_has_key (keyf, POLICY_SECTION, "AdminRules", NULL))
     {
 
-      if (!policy_file_load_rules (keyf, "AdminRules", &ret->rules.admin))
+      if (!policy_file_load_rules (&builder, keyf, "AdminRules",
+                                   builder.rules[1], err))
         {
-          policy_file_free (ret);
+          policy_file_builder_clear (&builder);
           return NULL;
         }
       has_rules = TRUE;
@@ -84,131 +309,475 @@ policy_file_new_from_path (const char *path, GError **err)
   /* No sense in loading empty rules */
   if (!has_rules)
     {
-      policy_file_free (ret);
+      g_set_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                   "No Rules or AdminRules in [%s]", POLICY_SECTION);
+      policy_file_builder_clear (&builder);
       return NULL;
     }
 
+  ret = g_new0 (PolicyFile, 1);
+  policy_file_builder_finish (&builder, ret);
+  ret->path = g_strdup (path);
+  ret->has_includes = has_includes;
+
   return ret;
 }
 
-static void
-policy_free (Policy *policy)
+PolicyFile *
+policy_file_new_from_path (const char *path, GError **err)
+{
+  return policy_file_new_from_path_profiled (path, NULL, err);
+}
+
+PolicyFile *
+policy_file_new_from_path_profiled (const char *path,
+                                    PolicyFileLoadProfile *profile,
+                                    GError **err)
 {
-  if (!policy)
+  g_autoptr (GKeyFile) keyf = NULL;
+  g_autofree gchar *contents = NULL;
+  gsize length = 0;
+  PolicyFileLoadProfile times = { 0 };
+  PolicyFile *ret = NULL;
+  gboolean parsed = FALSE;
+  gint64 start;
+
+  /* Read and parse separately, unlike g_key_file_load_from_file(), so
+   * that slow storage and large files can be told apart */
+  start = g_get_monotonic_time ();
+  if (!g_file_get_contents (path, &contents, &length, err))
     {
-      return;
+      goto out;
+    }
+  times.read_usec = g_get_monotonic_time () - start;
+
+  start = g_get_monotonic_time ();
+  keyf = g_key_file_new ();
+  parsed = g_key_file_load_from_data (keyf, contents, length,
+                                      G_KEY_FILE_NONE, err);
+  times.parse_usec = g_get_monotonic_time () - start;
+  if (!parsed)
+    {
+      goto out;
+    }
+  g_clear_pointer (&contents, g_free);
+
+  start = g_get_monotonic_time ();
+  ret = policy_file_new_from_keyfile (keyf, path, err);
+  times.compile_usec = g_get_monotonic_time () - start;
+
+out:
+  if (profile)
+    {
+      *profile = times;
+    }
+  return ret;
+}
+
+static gpointer
+policy_memdup (gconstpointer mem, gsize size)
+{
+  gpointer ret = NULL;
+
+  if (!mem || size == 0)
+    {
+      return NULL;
     }
-  g_clear_pointer (&policy->next, policy_free);
-  g_clear_pointer (&policy->id, g_free);
-  g_clear_pointer (&policy->actions, g_strfreev);
-  g_clear_pointer (&policy->action_contains, g_strfreev);
-  g_clear_pointer (&policy->unix_groups, g_strfreev);
-  g_clear_pointer (&policy->unix_names, g_strfreev);
-  g_clear_pointer (&policy->net_groups, g_strfreev);
-  g_free (policy);
+  ret = g_malloc (size);
+  memcpy (ret, mem, size);
+  return ret;
+}
+
+PolicyFile *
+policy_file_copy (const PolicyFile *file)
+{
+  PolicyFile *ret = NULL;
+
+  /* Everything is offsets into flat tables, so a copy is just memcpy */
+  ret = g_new0 (PolicyFile, 1);
+  ret->path = g_strdup (file->path);
+  ret->has_includes = file->has_includes;
+  ret->pool_size = file->pool_size;
+  ret->pool = policy_memdup (file->pool, file->pool_size);
+  ret->n_strings = file->n_strings;
+  ret->strings
+      = policy_memdup (file->strings, file->n_strings * sizeof (guint));
+  ret->rules.n_normal = file->rules.n_normal;
+  ret->rules.normal = policy_memdup (file->rules.normal,
+                                     file->rules.n_normal * sizeof (Policy));
+  ret->rules.n_admin = file->rules.n_admin;
+  ret->rules.admin = policy_memdup (file->rules.admin,
+                                    file->rules.n_admin * sizeof (Policy));
+
+  return ret;
+}
+
+gsize
+policy_file_get_memory_size (const PolicyFile *file)
+{
+  return sizeof (PolicyFile) + (file->path ? strlen (file->path) + 1 : 0)
+         + file->pool_size + file->n_strings * sizeof (guint)
+         + (file->rules.n_normal + file->rules.n_admin) * sizeof (Policy);
+}
+
+gboolean
+policy_file_equal (const PolicyFile *a, const PolicyFile *b)
+{
+  /* Loading is deterministic, so equal rules have equal tables */
+  return g_strcmp0 (a->path, b->path) == 0
+         && a->has_includes == b->has_includes
+         && a->pool_size == b->pool_size && a->n_strings == b->n_strings
+         && a->rules.n_normal == b->rules.n_normal
+         && a->rules.n_admin == b->rules.n_admin
+         && memcmp (a->pool, b->pool, a->pool_size) == 0
+         && memcmp (a->strings, b->strings, a->n_strings * sizeof (guint))
+                == 0
+         && memcmp (a->rules.normal, b->rules.normal,
+                    a->rules.n_normal * sizeof (Policy))
+                == 0
+         && memcmp (a->rules.admin, b->rules.admin,
+                    a->rules.n_admin * sizeof (Policy))
+                == 0;
 }
 
 void
 policy_file_free (PolicyFile *file)
 {
-  if (!file)
+  /* Iterate rather than recurse so long chains can't grow the stack */
+  while (file)
+    {
+      PolicyFile *next = file->next;
+
+      g_free (file->rules.admin);
+      g_free (file->rules.normal);
+      g_free (file->strings);
+      g_free (file->pool);
+      g_free (file->path);
+      g_free (file);
+      file = next;
+    }
+}
+
+static void
+policy_context_ensure (PolicyContext *context, PolicyContextFact fact)
+{
+  if (!context->resolve || (context->resolved & fact) == fact)
     {
       return;
     }
-  g_clear_pointer (&file->next, policy_file_free);
-  g_clear_pointer (&file->rules.admin, policy_free);
-  g_clear_pointer (&file->rules.normal, policy_free);
-  g_free (file);
+  /* Marked first, so one fact may build on another without recursing */
+  context->resolved |= fact;
+  context->resolve (context, fact);
+}
+
+const gchar *
+policy_context_get_username (PolicyContext *context)
+{
+  policy_context_ensure (context, POLICY_CONTEXT_USERNAME);
+  return context->username;
+}
+
+GArray *
+policy_context_get_gids (PolicyContext *context)
+{
+  policy_context_ensure (context, POLICY_CONTEXT_GIDS);
+  return context->gids;
 }
 
 /**
- * Attempt to load a policy from the given section id and keyfile
+ * Append the (stripped) string to the string table. When @wheel is set,
+ * POLICY_MATCH_WHEEL is substituted for the wheel group.
+ */
+static void
+policy_file_builder_append (PolicyFileBuilder *builder, const gchar *str,
+                            gboolean wheel)
+{
+  guint offset;
+
+  /* Perform %wheel% substitution here */
+  if (wheel && g_str_equal (str, POLICY_MATCH_WHEEL))
+    {
+      str = POLICY_WHEEL_GROUP;
+    }
+
+  offset = policy_file_builder_intern (builder, str);
+  g_array_append_val (builder->strings, offset);
+}
+
+/**
+ * Look up the list named by @reference, adding it to the string table the
+ * first time it is used (with or without the wheel substitution)
+ */
+static PolicyList *
+policy_file_builder_resolve_list (PolicyFileBuilder *builder,
+                                  const gchar *section_id,
+                                  const gchar *reference, gboolean wheel,
+                                  GError **err)
+{
+  PolicyList *list = g_hash_table_lookup (builder->lists, reference + 1);
+
+  if (!list)
+    {
+      g_set_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                   "Unknown list '%s' in rule '%s'", reference, section_id);
+      return NULL;
+    }
+
+  if (!list->resolved[wheel])
+    {
+      list->strings[wheel].start = builder->strings->len;
+      list->strings[wheel].n = g_strv_length (list->values);
+      for (guint i = 0; list->values[i]; i++)
+        {
+          policy_file_builder_append (builder, list->values[i], wheel);
+        }
+      list->resolved[wheel] = TRUE;
+    }
+
+  return list;
+}
+
+/**
+ * Load the (stripped) string list for the given key into the string table.
+ * When @wheel is set, POLICY_MATCH_WHEEL is substituted for the wheel group.
+ * A key naming nothing but one list shares its strings outright.
  */
-static Policy *
-policy_load (GKeyFile *file, const gchar *section_id)
+static gboolean
+policy_load_strings (PolicyFileBuilder *builder, GKeyFile *file,
+                     const gchar *section_id, const gchar *key,
+                     gboolean wheel, PolicyStrings *target, GError **err)
 {
-  Policy *policy = NULL;
+  gchar **strv = NULL;
   gsize n_segments = 0;
-  g_autoptr (GError) err = NULL;
+  GError *local_err = NULL;
+  PolicyList *list = NULL;
+
+  strv = g_key_file_get_string_list (file, section_id, key, &n_segments,
+                                     &local_err);
+  if (local_err)
+    {
+      g_propagate_error (err, local_err);
+      return FALSE;
+    }
+
+  /* Resolve every list up front, as that grows the string table */
+  for (gsize i = 0; i < n_segments; i++)
+    {
+      const gchar *str = g_strstrip (strv[i]);
+
+      if (str[0] != POLICY_LIST_REFERENCE)
+        {
+          continue;
+        }
+      list = policy_file_builder_resolve_list (builder, section_id, str,
+                                               wheel, err);
+      if (!list)
+        {
+          g_strfreev (strv);
+          return FALSE;
+        }
+    }
+
+  if (n_segments == 1 && list)
+    {
+      *target = list->strings[wheel];
+      g_strfreev (strv);
+      return TRUE;
+    }
 
+  target->start = builder->strings->len;
+  target->n = 0;
+
+  for (gsize i = 0; i < n_segments; i++)
+    {
+      PolicyStrings shared;
+
+      if (strv[i][0] != POLICY_LIST_REFERENCE)
+        {
+          policy_file_builder_append (builder, strv[i], wheel);
+          target->n++;
+          continue;
+        }
+
+      /* Mixed with other entries, so the list is copied in */
+      list = g_hash_table_lookup (builder->lists, strv[i] + 1);
+      shared = list->strings[wheel];
+      for (guint j = 0; j < shared.n; j++)
+        {
+          guint offset
+              = g_array_index (builder->strings, guint, shared.start + j);
+          g_array_append_val (builder->strings, offset);
+        }
+      target->n += shared.n;
+    }
+
+  g_strfreev (strv);
+  return TRUE;
+}
+
+/**
+ * Ensure every Actions= entry is an action ID, POLICY_MATCH_ALL or a prefix
+ * pattern. A '*' anywhere else would never match and is surely a typo.
+ */
+static gboolean
+policy_check_actions (PolicyFileBuilder *builder, const gchar *section_id,
+                      const PolicyStrings *actions, GError **err)
+{
+  for (guint i = 0; i < actions->n; i++)
+    {
+      guint offset = g_array_index (builder->strings, guint, actions->start + i);
+      const gchar *action = builder->pool->str + offset;
+      const gchar *star = strchr (action, '*');
+
+      if (!star || g_str_equal (action, POLICY_MATCH_ALL))
+        {
+          continue;
+        }
+      if (policy_action_is_prefix (action) && star[1] == '\0')
+        {
+          continue;
+        }
+      g_set_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                   "Invalid action pattern '%s' in rule '%s'", action,
+                   section_id);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * Attempt to load a policy from the given section id and keyfile
+ */
+static gboolean
+policy_load (PolicyFileBuilder *builder, GKeyFile *file,
+             const gchar *section_id, Policy *policy, GError **err)
+{
   if (!g_key_file_has_group (file, section_id))
     {
-      g_warning ("Missing rule: '%s'\n", section_id);
-      return NULL;
+      g_set_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+                   "Missing rule: '%s'", section_id);
+      goto handle_err;
     }
 
-  policy = g_new0 (Policy, 1);
-  policy->id = g_strdup (section_id);
+  policy->id = policy_file_builder_intern (builder, section_id);
 
   /* Load Action IDs */
   if (g_key_file_has_key (file, section_id, "Actions", NULL))
     {
-      policy->actions = g_key_file_get_string_list (
-          file, section_id, "Actions", &n_segments, &err);
-      if (err)
+      if (!policy_load_strings (builder, file, section_id, "Actions", FALSE,
+                                &policy->actions, err)
+          || !policy_check_actions (builder, section_id, &policy->actions,
+                                    err))
         {
           goto handle_err;
         }
-      policy->n_actions = n_segments;
       policy->constraints |= PF_CONSTRAINT_ACTIONS;
-      n_segments = 0;
     }
 
   /* Load ActionContains IDs */
   if (g_key_file_has_key (file, section_id, "ActionContains", NULL))
     {
-      policy->action_contains = g_key_file_get_string_list (
-          file, section_id, "ActionContains", &n_segments, &err);
-      if (err)
+      if (!policy_load_strings (builder, file, section_id, "ActionContains",
+                                FALSE, &policy->action_contains, err))
         {
           goto handle_err;
         }
-      policy->n_action_contains = n_segments;
       policy->constraints |= PF_CONSTRAINT_ACTION_CONTAINS;
-      n_segments = 0;
     }
 
   /* Are specific unix groups needed? */
   if (g_key_file_has_key (file, section_id, "InUnixGroups", NULL))
     {
-      policy->unix_groups = g_key_file_get_string_list (
-          file, section_id, "InUnixGroups", &n_segments, &err);
-      if (err)
+      if (!policy_load_strings (builder, file, section_id, "InUnixGroups",
+                                TRUE, &policy->unix_groups, err))
         {
           goto handle_err;
         }
-      policy->n_unix_groups = n_segments;
       policy->constraints |= PF_CONSTRAINT_UNIX_GROUPS;
-      n_segments = 0;
     }
 
   /* Are specific net groups needed? */
   if (g_key_file_has_key (file, section_id, "InNetGroups", NULL))
     {
-      policy->net_groups = g_key_file_get_string_list (
-          file, section_id, "InNetGroups", &n_segments, &err);
-      if (err)
+      if (!policy_load_strings (builder, file, section_id, "InNetGroups",
+                                FALSE, &policy->net_groups, err))
         {
           goto handle_err;
         }
-      policy->n_net_groups = n_segments;
       policy->constraints |= PF_CONSTRAINT_NET_GROUPS;
-      n_segments = 0;
+    }
+
+  /* Match a detail of the check against a set of values */
+  if (g_key_file_has_key (file, section_id, "DetailKey", NULL)
+      || g_key_file_has_key (file, section_id, "InDetailValues", NULL))
+    {
+      g_autofree gchar *key = NULL;
+
+      key = g_key_file_get_string (file, section_id, "DetailKey", err);
+      if (!key)
+        {
+          goto handle_err;
+        }
+      if (!g_key_file_has_key (file, section_id, "InDetailValues", NULL))
+        {
+          g_set_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                       "DetailKey without InDetailValues in '%s'",
+                       section_id);
+          goto handle_err;
+        }
+      policy->detail_key = policy_file_builder_intern (builder, g_strstrip (key));
+      if (!policy_load_strings (builder, file, section_id, "InDetailValues",
+                                FALSE, &policy->detail_values, err))
+        {
+          goto handle_err;
+        }
+      policy->constraints |= PF_CONSTRAINT_DETAILS;
+    }
+
+  /* Match the seat, class and type of the subject's session */
+  if (g_key_file_has_key (file, section_id, "InSeats", NULL))
+    {
+      if (!policy_load_strings (builder, file, section_id, "InSeats", FALSE,
+                                &policy->seats, err))
+        {
+          goto handle_err;
+        }
+      policy->constraints |= PF_CONSTRAINT_SEATS;
+    }
+  if (g_key_file_has_key (file, section_id, "SessionClass", NULL))
+    {
+      if (!policy_load_strings (builder, file, section_id, "SessionClass",
+                                FALSE, &policy->session_classes, err))
+        {
+          goto handle_err;
+        }
+      policy->constraints |= PF_CONSTRAINT_SESSION_CLASSES;
+    }
+  if (g_key_file_has_key (file, section_id, "SessionType", NULL))
+    {
+      if (!policy_load_strings (builder, file, section_id, "SessionType",
+                                FALSE, &policy->session_types, err))
+        {
+          goto handle_err;
+        }
+      policy->constraints |= PF_CONSTRAINT_SESSION_TYPES;
     }
 
   /* Find out the response type */
   if (g_key_file_has_key (file, section_id, "Result", NULL))
     {
       g_autofree gchar *result
-          = g_key_file_get_string (file, section_id, "Result", &err);
-      if (err)
+          = g_key_file_get_string (file, section_id, "Result", err);
+      if (!result)
         {
           goto handle_err;
         }
       policy->response = policy_string_to_result (g_strstrip (result));
       if (policy->response == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
         {
-          g_warning ("Invalid 'Result': '%s'\n", result);
+          g_set_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                       "Invalid 'Result': '%s'", result);
           goto handle_err;
         }
       policy->constraints |= PF_CONSTRAINT_RESULT;
@@ -218,15 +787,16 @@ policy_load (GKeyFile *file, const gchar *section_id)
   if (g_key_file_has_key (file, section_id, "ResultInverse", NULL))
     {
       g_autofree gchar *result
-          = g_key_file_get_string (file, section_id, "ResultInverse", &err);
-      if (err)
+          = g_key_file_get_string (file, section_id, "ResultInverse", err);
+      if (!result)
         {
           goto handle_err;
         }
       policy->response_inverse = policy_string_to_result (g_strstrip (result));
-      if (policy->response == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
+      if (policy->response_inverse == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
         {
-          g_warning ("Invalid 'ResultInverse': '%s'\n", result);
+          g_set_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                       "Invalid 'ResultInverse': '%s'", result);
           goto handle_err;
         }
       policy->constraints |= PF_CONSTRAINT_RESULT_INVERSE;
@@ -235,24 +805,24 @@ policy_load (GKeyFile *file, const gchar *section_id)
   /* Match unix usernames */
   if (g_key_file_has_key (file, section_id, "InUserNames", NULL))
     {
-      policy->unix_names = g_key_file_get_string_list (
-          file, section_id, "InUserNames", &n_segments, &err);
-      if (err)
+      if (!policy_load_strings (builder, file, section_id, "InUserNames",
+                                FALSE, &policy->unix_names, err))
         {
           goto handle_err;
         }
-      policy->n_unix_names = n_segments;
       policy->constraints |= PF_CONSTRAINT_UNIX_NAMES;
-      n_segments = 0;
     }
 
   /* Match active */
   if (g_key_file_has_key (file, section_id, "SubjectActive", NULL))
     {
-      policy->require_active
-          = g_key_file_get_boolean (file, section_id, "SubjectActive", &err);
-      if (err)
+      GError *local_err = NULL;
+
+      policy->require_active = g_key_file_get_boolean (
+          file, section_id, "SubjectActive", &local_err);
+      if (local_err)
         {
+          g_propagate_error (err, local_err);
           goto handle_err;
         }
       policy->constraints |= PF_CONSTRAINT_SUBJECT_ACTIVE;
@@ -261,66 +831,60 @@ policy_load (GKeyFile *file, const gchar *section_id)
   /* Match local */
   if (g_key_file_has_key (file, section_id, "SubjectLocal", NULL))
     {
-      policy->require_local
-          = g_key_file_get_boolean (file, section_id, "SubjectLocal", &err);
-      if (err)
+      GError *local_err = NULL;
+
+      policy->require_local = g_key_file_get_boolean (
+          file, section_id, "SubjectLocal", &local_err);
+      if (local_err)
         {
+          g_propagate_error (err, local_err);
           goto handle_err;
         }
       policy->constraints |= PF_CONSTRAINT_SUBJECT_LOCAL;
     }
 
-  return policy;
+  return TRUE;
 
 handle_err:
 
   /* Print error.. */
-  g_warning ("policy_load(): error: %s\n", err->message);
+  g_warning ("policy_load(): error: %s\n",
+             err && *err ? (*err)->message : section_id);
 
-  policy_free (policy);
-  return NULL;
+  return FALSE;
 }
 
 /**
  * Attempt to load rules from the named section within the key file
  */
 static gboolean
-policy_file_load_rules (GKeyFile *keyfile, const gchar *section,
-                        Policy **target)
+policy_file_load_rules (PolicyFileBuilder *builder, GKeyFile *keyfile,
+                        const gchar *section, GArray *target, GError **err)
 {
   gchar **sections = NULL;
   gsize n_sections = 0;
-  g_autoptr (GError) err = NULL;
-  Policy *last = NULL;
+  GError *local_err = NULL;
 
   sections = g_key_file_get_string_list (keyfile, POLICY_SECTION, section,
-                                         &n_sections, &err);
-  if (err)
+                                         &n_sections, &local_err);
+  if (local_err)
     {
-      g_warning ("Failed to get sections: %s\n", err->message);
+      g_warning ("Failed to get sections: %s\n", local_err->message);
+      g_propagate_error (err, local_err);
       return FALSE;
     }
 
   /* Attempt to load each rule now */
   for (gsize i = 0; i < n_sections; i++)
     {
-      Policy *p = NULL;
+      Policy p = { 0 };
 
-      p = policy_load (keyfile, g_strstrip (sections[i]));
-      if (!p)
+      if (!policy_load (builder, keyfile, g_strstrip (sections[i]), &p, err))
         {
           g_strfreev (sections);
           return FALSE;
         }
-      if (last)
-        {
-          last->next = p;
-          last = p;
-        }
-      else
-        {
-          last = *target = p;
-        }
+      g_array_append_val (target, p);
     }
 
   g_strfreev (sections);
@@ -346,31 +910,36 @@ policy_string_to_result (const gchar *inp)
 }
 
 /**
- * Test the given policy againt the given constraints, and find out if we have
- * some specified action to take.
- * Notice that the highest priority policies are lower in the list and reached
- * first, so they can quite happily block later policies from evaluating
- * completely.
+ * Determine whether the policy targets the given action ID at all, either
+ * via Actions= or ActionContains=
  */
-static PolkitImplicitAuthorization
-policy_test (Policy *policy, const gchar *action_id, PolicyContext *context)
+static gboolean
+policy_match_action (const PolicyFile *file, const Policy *policy,
+                     const gchar *action_id)
 {
-  PolkitImplicitAuthorization response = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
-  gboolean conditions = FALSE;
-  gboolean id_matched = FALSE;
-
   /* Check actions to see if we've been matched */
   if ((policy->constraints & PF_CONSTRAINT_ACTIONS) == PF_CONSTRAINT_ACTIONS)
     {
-      for (gsize i = 0; i < policy->n_actions; i++)
+      for (guint i = 0; i < policy->actions.n; i++)
         {
-          const gchar *action = g_strstrip (policy->actions[i]);
+          const gchar *action
+              = policy_file_get_string (file, policy->actions, i);
           /* Actions can match either directly or via special '*' character */
           if (g_str_equal (action, action_id)
               || g_str_equal (action, POLICY_MATCH_ALL))
             {
-              conditions = TRUE;
-              break;
+              return TRUE;
+            }
+          /* Or everything below a prefix, keeping the '.' in the comparison */
+          if (policy_action_is_prefix (action))
+            {
+              gsize len = strlen (action) - 1;
+
+              if (strncmp (action, action_id, len) == 0
+                  && action_id[len] != '\0')
+                {
+                  return TRUE;
+                }
             }
         }
     }
@@ -379,25 +948,236 @@ policy_test (Policy *policy, const gchar *action_id, PolicyContext *context)
   if ((policy->constraints & PF_CONSTRAINT_ACTION_CONTAINS)
       == PF_CONSTRAINT_ACTION_CONTAINS)
     {
-      for (gsize i = 0; i < policy->n_action_contains; i++)
+      for (guint i = 0; i < policy->action_contains.n; i++)
         {
-          const gchar *action = g_strstrip (policy->action_contains[i]);
+          const gchar *action
+              = policy_file_get_string (file, policy->action_contains, i);
           if (strstr (action_id, action))
             {
-              conditions = TRUE;
-              break;
+              return TRUE;
+            }
+        }
+    }
+
+  return FALSE;
+}
+
+/**
+ * Test the given policy againt the given constraints, and find out if we have
+ * some specified action to take.
+ * Only this one policy is considered, walking the rest of the table is left
+ * up to the caller so that compiled rulesets can test just their candidates.
+ */
+PolkitImplicitAuthorization
+policy_test (const PolicyFile *file, const Policy *policy,
+             const gchar *action_id, PolicyContext *context)
+{
+  /* Without an actual ID match this policy has no opinion. */
+  if (!policy_match_action (file, policy, action_id))
+    {
+      return POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+    }
+
+  return policy_test_matched (file, policy, NULL, NULL, context, NULL);
+}
+
+gint
+policy_file_path_cmp (const gchar *a, const gchar *b)
+{
+  gint ret;
+  const gchar *a_base;
+  const gchar *b_base;
+
+  a_base = strrchr (a, '/');
+  b_base = strrchr (b, '/');
+
+  g_assert (a_base != NULL);
+  g_assert (b_base != NULL);
+  a_base += 1;
+  b_base += 1;
+
+  ret = g_strcmp0 (a_base, b_base);
+  if (ret == 0)
+    {
+      /* /etc wins over /usr */
+      ret = g_strcmp0 (a, b);
+      g_assert (ret != 0);
+    }
+
+  return ret;
+}
+
+G_LOCK_DEFINE_STATIC (policy_resolve_group);
+
+gboolean
+policy_resolve_group (const gchar *name, gid_t *gid)
+{
+  struct group *group = NULL;
+  gchar *end = NULL;
+  guint64 value;
+  gboolean found = FALSE;
+
+  /* getgrnam() shares static storage, and rulesets are compiled off the
+   * main thread */
+  G_LOCK (policy_resolve_group);
+  group = getgrnam (name);
+  if (group)
+    {
+      *gid = group->gr_gid;
+      found = TRUE;
+    }
+  G_UNLOCK (policy_resolve_group);
+
+  if (found)
+    {
+      return TRUE;
+    }
+
+  /* Groups without a name can only ever be referenced by their gid */
+  errno = 0;
+  value = g_ascii_strtoull (name, &end, 10);
+  if (*name == '\0' || *end != '\0' || errno != 0 || value > G_MAXUINT32)
+    {
+      return FALSE;
+    }
+  *gid = (gid_t)value;
+  return TRUE;
+}
+
+/**
+ * Test the subject's groups against the rule's groups, resolving the
+ * rule's group names on every call
+ */
+static gboolean
+policy_match_groups (const PolicyFile *file, const Policy *policy,
+                     PolicyContext *context)
+{
+  GArray *gids = policy_context_get_gids (context);
+
+  for (guint i = 0; i < policy->unix_groups.n; i++)
+    {
+      const gchar *group
+          = policy_file_get_string (file, policy->unix_groups, i);
+      gid_t gid;
+
+      if (!policy_resolve_group (group, &gid))
+        {
+          continue;
+        }
+
+      for (guint j = 0; gids && j < gids->len; j++)
+        {
+          if (g_array_index (gids, gid_t, j) == gid)
+            {
+              return TRUE;
+            }
+        }
+    }
+
+  return FALSE;
+}
+
+/**
+ * Whether @value is one of @strings. Subjects outside of any session, or
+ * that logind knows nothing about, carry NULL and never match.
+ */
+static gboolean
+policy_match_session (const PolicyFile *file, PolicyStrings strings,
+                      const gchar *value)
+{
+  if (!value)
+    {
+      return FALSE;
+    }
+
+  for (guint i = 0; i < strings.n; i++)
+    {
+      if (g_str_equal (policy_file_get_string (file, strings, i), value))
+        {
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/**
+ * Test the value of the rule's DetailKey= against InDetailValues=. Checks
+ * without the detail never match.
+ */
+static gboolean
+policy_match_details (const PolicyFile *file, const Policy *policy,
+                      GHashTable *detail_values, PolicyContext *context)
+{
+  const gchar *value = NULL;
+
+  if (context->details)
+    {
+      value = polkit_details_lookup (context->details,
+                                     file->pool + policy->detail_key);
+    }
+  if (!value)
+    {
+      return FALSE;
+    }
+
+  if (detail_values && g_hash_table_contains (detail_values, value))
+    {
+      return TRUE;
+    }
+
+  for (guint i = 0; i < policy->detail_values.n; i++)
+    {
+      const gchar *entry
+          = policy_file_get_string (file, policy->detail_values, i);
+
+      if (policy_detail_is_prefix (entry))
+        {
+          if (strncmp (entry, value, strlen (entry) - 1) == 0)
+            {
+              return TRUE;
             }
         }
+      else if (!detail_values && g_str_equal (entry, value))
+        {
+          return TRUE;
+        }
     }
 
-  /* At this point, policy test must've passed as we're explicitly testing
-   * action IDs */
-  if (!conditions)
+  return FALSE;
+}
+
+/**
+ * Test the subject's groups against the rule's groups, by atom
+ */
+static gboolean
+policy_match_group_atoms (const PolicyGroupMatch *groups)
+{
+  for (guint i = 0; i < groups->n_words; i++)
     {
-      goto unmatched;
+      if (groups->rule[i] & groups->subject[i])
+        {
+          return TRUE;
+        }
     }
 
-  id_matched = TRUE;
+  return FALSE;
+}
+
+PolkitImplicitAuthorization
+policy_test_matched (const PolicyFile *file, const Policy *policy,
+                     const PolicyGroupMatch *groups, GHashTable *detail_values,
+                     PolicyContext *context, gboolean *out_matched)
+{
+  PolkitImplicitAuthorization response = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  /* At this point, policy test must've passed as the action ID is known
+   * to be targeted by this policy */
+  gboolean conditions = TRUE;
+
+  if (out_matched)
+    {
+      *out_matched = FALSE;
+    }
 
   /* Check for SubjectActive */
   if ((policy->constraints & PF_CONSTRAINT_SUBJECT_ACTIVE)
@@ -422,39 +1202,84 @@ policy_test (Policy *policy, const gchar *action_id, PolicyContext *context)
       conditions = TRUE;
     }
 
-  /* Check for Unix Groups */
+  /* Check for details, which are known without any lookups */
+  if ((policy->constraints & PF_CONSTRAINT_DETAILS) == PF_CONSTRAINT_DETAILS)
+    {
+      if (!policy_match_details (file, policy, detail_values, context))
+        {
+          conditions = FALSE;
+          goto unmatched;
+        }
+      conditions = TRUE;
+    }
+
+  /* Session state comes from the session monitor's cache, not sd-login */
+  if ((policy->constraints & PF_CONSTRAINT_SEATS) == PF_CONSTRAINT_SEATS)
+    {
+      if (!policy_match_session (file, policy->seats, context->seat))
+        {
+          conditions = FALSE;
+          goto unmatched;
+        }
+      conditions = TRUE;
+    }
+  if ((policy->constraints & PF_CONSTRAINT_SESSION_CLASSES)
+      == PF_CONSTRAINT_SESSION_CLASSES)
+    {
+      if (!policy_match_session (file, policy->session_classes,
+                                 context->session_class))
+        {
+          conditions = FALSE;
+          goto unmatched;
+        }
+      conditions = TRUE;
+    }
+  if ((policy->constraints & PF_CONSTRAINT_SESSION_TYPES)
+      == PF_CONSTRAINT_SESSION_TYPES)
+    {
+      if (!policy_match_session (file, policy->session_types,
+                                 context->session_type))
+        {
+          conditions = FALSE;
+          goto unmatched;
+        }
+      conditions = TRUE;
+    }
+
+  /* Check for Unix Groups, %wheel% was substituted at load time */
   if ((policy->constraints & PF_CONSTRAINT_UNIX_GROUPS)
       == PF_CONSTRAINT_UNIX_GROUPS)
     {
       /* Must explicitly re-match here for unix groups now */
-      gboolean local_test = FALSE;
+      gboolean local_test = groups ? policy_match_group_atoms (groups)
+                                   : policy_match_groups (file, policy, context);
 
-      for (gsize i = 0; i < policy->n_unix_groups; i++)
+      if (!local_test)
         {
-          for (gsize j = 0; j < context->groups->len; j++)
-            {
-              const gchar *group = NULL;
-              const gchar *spec_group = g_strstrip (policy->unix_groups[i]);
-              const gchar *test_group = g_ptr_array_index (context->groups, j);
+          conditions = FALSE;
+          goto unmatched;
+        }
+      conditions = TRUE;
+    }
 
-              /* Perform %wheel% substitution here */
-              if (g_str_equal (spec_group, POLICY_MATCH_WHEEL))
-                {
-                  group = POLICY_WHEEL_GROUP;
-                }
-              else
-                {
-                  group = spec_group;
-                }
+  /* Check for Unix usernames */
+  if ((policy->constraints & PF_CONSTRAINT_UNIX_NAMES)
+      == PF_CONSTRAINT_UNIX_NAMES)
+    {
+      /* Must explicitly re-match here for unix names now */
+      gboolean local_test = FALSE;
 
-              if (g_str_equal (group, test_group))
-                {
-                  local_test = conditions = TRUE;
-                  break;
-                }
+      for (guint i = 0; i < policy->unix_names.n; i++)
+        {
+          const gchar *username
+              = policy_file_get_string (file, policy->unix_names, i);
+          if (g_strcmp0 (username, policy_context_get_username (context))
+              == 0)
+            {
+              local_test = conditions = TRUE;
+              break;
             }
         }
-
       if (!local_test)
         {
           conditions = FALSE;
@@ -462,17 +1287,19 @@ policy_test (Policy *policy, const gchar *action_id, PolicyContext *context)
         }
     }
 
-  /* Check for Unix usernames */
-  if ((policy->constraints & PF_CONSTRAINT_UNIX_NAMES)
-      == PF_CONSTRAINT_UNIX_NAMES)
+  /* Check for netgroups, which may mean a network round trip */
+  if ((policy->constraints & PF_CONSTRAINT_NET_GROUPS)
+      == PF_CONSTRAINT_NET_GROUPS)
     {
-      /* Must explicitly re-match here for unix names now */
       gboolean local_test = FALSE;
 
-      for (gsize i = 0; i < policy->n_unix_names; i++)
+      for (guint i = 0; i < policy->net_groups.n; i++)
         {
-          const gchar *username = g_strstrip (policy->unix_names[i]);
-          if (g_str_equal (username, context->username))
+          const gchar *netgroup
+              = policy_file_get_string (file, policy->net_groups, i);
+          if (policy_netgroup_cache_contains (
+                  context->netgroups, netgroup,
+                  policy_context_get_username (context)))
             {
               local_test = conditions = TRUE;
               break;
@@ -486,6 +1313,10 @@ policy_test (Policy *policy, const gchar *action_id, PolicyContext *context)
     }
 
   /* We hit our conditions */
+  if (out_matched)
+    {
+      *out_matched = conditions;
+    }
   if (conditions
       && (policy->constraints & PF_CONSTRAINT_RESULT) == PF_CONSTRAINT_RESULT)
     {
@@ -493,16 +1324,6 @@ policy_test (Policy *policy, const gchar *action_id, PolicyContext *context)
     }
 
 unmatched:
-  /* Must have an actual ID match */
-  if (!id_matched)
-    {
-      if (response == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN && policy->next)
-        {
-          return policy_test (policy->next, action_id, context);
-        }
-      return response;
-    }
-
   /* Conditions for the ID match were unmet and an inverse response is set */
   if (!conditions
       && (policy->constraints & PF_CONSTRAINT_RESULT_INVERSE)
@@ -511,11 +1332,6 @@ unmatched:
       return policy->response_inverse;
     }
 
-  /* Return or pass along */
-  if (response == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN && policy->next)
-    {
-      return policy_test (policy->next, action_id, context);
-    }
   return response;
 }
 
@@ -523,20 +1339,20 @@ PolkitImplicitAuthorization
 policy_file_test (PolicyFile *file, const gchar *action_id,
                   PolicyContext *context)
 {
-
-  PolkitImplicitAuthorization response = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
-
-  /* Traverse our policies and see if we find a match of some description */
-  if (file->rules.normal)
-    {
-      response = policy_test (file->rules.normal, action_id, context);
-    }
-
-  /* If we're still unhandled, pass it down the chain */
-  if (response == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN && file->next)
+  /* Traverse our policies and see if we find a match of some description,
+   * passing down the chain of files while we're still unhandled */
+  for (; file; file = file->next)
     {
-      return policy_file_test (file->next, action_id, context);
+      for (guint i = 0; i < file->rules.n_normal; i++)
+        {
+          PolkitImplicitAuthorization response
+              = policy_test (file, &file->rules.normal[i], action_id, context);
+          if (response != POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
+            {
+              return response;
+            }
+        }
     }
 
-  return response;
+  return POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
 }
@@ -30,6 +30,11 @@
 
 #include <glib.h>
 #include <polkit/polkitprivate.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "polkitbackendpolicyarena.h"
+#include "polkitbackendpolicynetgroup.h"
 
 /**
  * Set at build time, redocumented here for clarity.
@@ -43,6 +48,24 @@
  */
 #define POLICY_MATCH_WHEEL "%sudo%"
 
+/**
+ * Action ID to match all possible IDs
+ * Useful for "SubjectUser=" matches
+ */
+#define POLICY_MATCH_ALL "*"
+
+/**
+ * Final component of an Actions= entry matching every action ID below a
+ * prefix, i.e. "org.freedesktop.udisks2.*"
+ */
+#define POLICY_MATCH_PREFIX ".*"
+
+/**
+ * Final character of an InDetailValues= entry matching every value that
+ * starts with the rest of it, i.e. "user@*"
+ */
+#define POLICY_MATCH_DETAIL_PREFIX '*'
+
 /**
  * PolicyFileContraints are set per policy to ensure we'll only match
  * for explicitly set fields, as opposed to testing the default values
@@ -58,56 +81,107 @@ typedef enum {
   PF_CONSTRAINT_NET_GROUPS = 1 << 7,
   PF_CONSTRAINT_RESULT = 1 << 8,
   PF_CONSTRAINT_RESULT_INVERSE = 1 << 9,
+  PF_CONSTRAINT_DETAILS = 1 << 10,
+  PF_CONSTRAINT_SEATS = 1 << 11,
+  PF_CONSTRAINT_SESSION_CLASSES = 1 << 12,
+  PF_CONSTRAINT_SESSION_TYPES = 1 << 13,
 } PolicyFileConstraints;
 
 /**
- * Each file may have multiple policies defined, which are chained
+ * A contiguous range of strings within the PolicyFile string table
  */
-typedef struct Policy
+typedef struct PolicyStrings
 {
-  gchar *id;           /**<ID for this particular policy */
-  struct Policy *next; /**<Next policy in this chain */
-
-  gchar **actions; /**<Matched action IDs for Actions */
-  gsize n_actions;
+  guint start; /**<First index into PolicyFile.strings */
+  guint n;     /**<Number of strings in this range */
+} PolicyStrings;
 
-  gchar **action_contains; /**<Substring action IDs for Actions */
-  gsize n_action_contains;
-
-  gchar **unix_groups; /**<Unix groups for InUnixGroups */
-  gsize n_unix_groups;
-
-  gchar **unix_names; /**<Unix usernames for InUserNames */
-  gsize n_unix_names;
-
-  gchar **net_groups; /**<Net groups for InNetGroups */
-  gsize n_net_groups;
+/**
+ * Each file may have multiple policies defined, which are stored back to
+ * back in a fixed size record table. All strings are stripped (and have
+ * the wheel group substituted) at load time and live in the string pool
+ * of the owning PolicyFile.
+ */
+typedef struct Policy
+{
+  guint id; /**<Pool offset of the ID for this particular policy */
 
-  gboolean require_active;
-  gboolean require_local;
+  PolicyStrings actions;         /**<Matched action IDs for Actions */
+  PolicyStrings action_contains; /**<Substring action IDs for Actions */
+  PolicyStrings unix_groups;     /**<Unix groups for InUnixGroups */
+  PolicyStrings unix_names;      /**<Unix usernames for InUserNames */
+  PolicyStrings net_groups;      /**<Net groups for InNetGroups */
+  guint detail_key;              /**<Pool offset of DetailKey, if set */
+  PolicyStrings detail_values;   /**<Values and prefixes for InDetailValues */
+  PolicyStrings seats;           /**<Seat IDs for InSeats */
+  PolicyStrings session_classes; /**<Session classes for SessionClass */
+  PolicyStrings session_types;   /**<Session types for SessionType */
 
   PolkitImplicitAuthorization response;
   PolkitImplicitAuthorization response_inverse;
 
   unsigned int constraints; /**<Match constraints per the keyfile */
+
+  gboolean require_active;
+  gboolean require_local;
 } Policy;
 
 /**
  * PolicyContext is a throw away type to organise a call to policy_file_test,
- * and allows for future expansion.
+ * and allows for future expansion. The context owns none of its fields, they
+ * are borrowed from whoever set up the check for as long as it runs.
+ */
+typedef struct PolicyContext PolicyContext;
+
+/**
+ * Facts about the subject that are costly to look up, and so are only
+ * resolved once a rule actually asks for them
  */
-typedef struct PolicyContext
+typedef enum
+{
+  POLICY_CONTEXT_USERNAME = 1 << 0,
+  POLICY_CONTEXT_GIDS = 1 << 1,
+} PolicyContextFact;
+
+/**
+ * Fill in the field(s) for @fact. Called at most once per fact.
+ */
+typedef void (*PolicyContextResolveFunc) (PolicyContext *context,
+                                          PolicyContextFact fact);
+
+struct PolicyContext
 {
   PolkitSubject *subject;
   PolkitIdentity *user_for_subject;
   gboolean subject_is_local;
   gboolean subject_is_active;
   PolkitDetails *details;
-  GPtrArray *groups;
+  const gchar *seat;          /**<Seat of the subject's session, or NULL */
+  const gchar *session_class; /**<Class of the subject's session, or NULL */
+  const gchar *session_type;  /**<Type of the subject's session, or NULL */
+  GArray *gids; /**<gid_t of every group the subject is a member of */
   gchar *username;
-  char *session_id;
-  char *seat_id;
-} PolicyContext;
+  gid_t primary_gid; /**<Valid once the username is resolved, or -1 */
+  PolicyNetgroupCache *netgroups; /**<Optional, for InNetGroups= */
+  PolicyArena *arena; /**<Optional, for scratch space during the check */
+
+  PolicyContextResolveFunc resolve; /**<NULL when every field is filled */
+  gpointer resolve_data;            /**<For use by @resolve */
+  guint resolved;                   /**<PolicyContextFact already resolved */
+};
+
+/**
+ * PolicyGroupMatch is optionally handed to policy_test_matched() by a
+ * compiled ruleset, which resolves every InUnixGroups= name to its gid
+ * and interns those into small integer atoms. The group test then becomes a word-wise AND of the two
+ * bitsets rather than a nested loop of string comparisons.
+ */
+typedef struct PolicyGroupMatch
+{
+  const guint64 *rule;    /**<Atoms accepted by the rule */
+  const guint64 *subject; /**<Atoms the subject is a member of */
+  guint n_words;
+} PolicyGroupMatch;
 
 /**
  * PolicyFile is the "compiled" variant of a policykit plain-text rules
@@ -116,33 +190,176 @@ typedef struct PolicyContext
  *
  * All of the rule files must be well defined ahead of time to allow very
  * strict runtime comparisons, vs runtime *execution*.
+ *
+ * Any string list may name a [List name] section of the file, or of a
+ * fragment given by Include=, as "@name". Each list is stored once and
+ * shared by every rule naming it. As a file's own contents don't tell
+ * whether its fragments changed, files with has_includes set must always
+ * be parsed afresh rather than reused or cached.
  */
 typedef struct PolicyFile
 {
   struct PolicyFile *next; /**<Next PolicyFile in the chain */
+  gchar *path;             /**<Where the file was loaded from, or NULL */
+  gboolean has_includes;   /**<Built with Include= fragments, see below */
+
+  gchar *pool;     /**<NUL terminated strings, back to back */
+  gsize pool_size; /**<Length of the pool in bytes */
+  guint *strings;  /**<Pool offsets, as indexed by PolicyStrings */
+  guint n_strings;
 
   struct
   {
     Policy *normal; /**<Ordinary rules */
-    Policy *admin;  /**<Specialist admin rules */
+    guint n_normal;
+    Policy *admin; /**<Specialist admin rules */
+    guint n_admin;
   } rules;
 } PolicyFile;
 
+/**
+ * Look up the @index'th string of the given range within the file's pool
+ */
+static inline const gchar *
+policy_file_get_string (const PolicyFile *file, PolicyStrings strings,
+                        guint index)
+{
+  return file->pool + file->strings[strings.start + index];
+}
+
+/**
+ * Look up the section ID of the given policy
+ */
+static inline const gchar *
+policy_file_get_id (const PolicyFile *file, const Policy *policy)
+{
+  return file->pool + policy->id;
+}
+
+/**
+ * Whether the Actions= entry is a prefix pattern. The action IDs it matches
+ * start with everything up to and including the final '.', followed by at
+ * least one more character.
+ */
+static inline gboolean
+policy_action_is_prefix (const gchar *action)
+{
+  return g_str_has_suffix (action, POLICY_MATCH_PREFIX)
+         && strlen (action) > strlen (POLICY_MATCH_PREFIX);
+}
+
+/**
+ * Whether the InDetailValues= entry is a prefix, matching every value that
+ * starts with it save for the trailing POLICY_MATCH_DETAIL_PREFIX
+ */
+static inline gboolean
+policy_detail_is_prefix (const gchar *value)
+{
+  gsize len = strlen (value);
+
+  return len > 0 && value[len - 1] == POLICY_MATCH_DETAIL_PREFIX;
+}
+
+/**
+ * Return the subject's username, resolving it first if need be
+ */
+const gchar *policy_context_get_username (PolicyContext *context);
+
+/**
+ * Return the gid_t of every group the subject is in, resolving them first if
+ * need be. May return NULL.
+ */
+GArray *policy_context_get_gids (PolicyContext *context);
+
 /**
  * Attempt to load a PolicyFile from the given path
  * @err: If not NULL, any parsing error will be stored here
  */
 PolicyFile *policy_file_new_from_path (const char *path, GError **err);
 
+/**
+ * Where the time went while loading a single PolicyFile, in microseconds
+ */
+typedef struct PolicyFileLoadProfile
+{
+  gint64 read_usec;    /**<Reading the file */
+  gint64 parse_usec;   /**<Parsing it as a GKeyFile */
+  gint64 compile_usec; /**<Building the rules, Include= fragments and all */
+} PolicyFileLoadProfile;
+
+/**
+ * As policy_file_new_from_path(), additionally filling in @profile, which
+ * is also set for files that fail to load
+ */
+PolicyFile *policy_file_new_from_path_profiled (const char *path,
+                                                PolicyFileLoadProfile *profile,
+                                                GError **err);
+
+/**
+ * Order the paths of two rules files by their basename, so that files from
+ * every rules directory are interleaved. Where the basenames are the same
+ * the full paths decide, so /etc sorts ahead of (and so wins over) /usr.
+ */
+gint policy_file_path_cmp (const gchar *a, const gchar *b);
+
 /**
  * Check all policies until we hit a break, i.e a response that is not
  * POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN If none of our own policies find a
- * match, this call will traverse onto the ->next member.
+ * match, this call will traverse onto the ->next member, iteratively.
  */
 PolkitImplicitAuthorization policy_file_test (PolicyFile *file,
                                               const gchar *action_id,
                                               PolicyContext *context);
 
+/**
+ * Test a single policy from the given file.
+ * Returns POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN if the policy has no opinion
+ * on the given action.
+ */
+PolkitImplicitAuthorization policy_test (const PolicyFile *file,
+                                         const Policy *policy,
+                                         const gchar *action_id,
+                                         PolicyContext *context);
+
+/**
+ * Test the conditions of a single policy that is already known to target the
+ * action ID in question, i.e. via a compiled index, skipping the Actions= and
+ * ActionContains= comparisons entirely.
+ * @groups: If not NULL, used in place of comparing InUnixGroups= by name
+ * @detail_values: If not NULL, the set of InDetailValues= that aren't
+ * prefixes, used in place of comparing those one by one
+ * @out_matched: If not NULL, set to whether every condition held
+ */
+PolkitImplicitAuthorization policy_test_matched (const PolicyFile *file,
+                                                 const Policy *policy,
+                                                 const PolicyGroupMatch *groups,
+                                                 GHashTable *detail_values,
+                                                 PolicyContext *context,
+                                                 gboolean *out_matched);
+
+/**
+ * Resolve an InUnixGroups= entry to a gid. Names are looked up via NSS,
+ * falling back to a literal numeric gid for groups without a name.
+ */
+gboolean policy_resolve_group (const gchar *name, gid_t *gid);
+
+/**
+ * Copy a previously loaded PolicyFile without parsing it again.
+ * The copy is not part of any chain.
+ */
+PolicyFile *policy_file_copy (const PolicyFile *file);
+
+/**
+ * Bytes allocated for the given file, not counting those it's chained to
+ */
+gsize policy_file_get_memory_size (const PolicyFile *file);
+
+/**
+ * Whether two PolicyFiles were loaded from the same path and hold the same
+ * rules. Loading the same contents twice gives equal files.
+ */
+gboolean policy_file_equal (const PolicyFile *a, const PolicyFile *b);
+
 /**
  * Free any resources associated with a PolicyFile
  */
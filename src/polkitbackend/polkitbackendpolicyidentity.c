@@ -0,0 +1,650 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include <grp.h>
+#include <limits.h>
+#include <pwd.h>
+#ifdef HAVE_NETGROUP_H
+#include <netgroup.h>
+#else
+#include <netdb.h>
+#endif
+#include <stdlib.h>
+
+#include "polkitbackendpolicyidentity.h"
+
+/**
+ * getpwuid() and friends share static buffers, so every NSS call made by
+ * the cache is serialised. This is a separate lock from the table so that
+ * hits are never held up by a slow lookup.
+ */
+G_LOCK_DEFINE_STATIC (policy_identity_nss);
+
+typedef enum
+{
+  POLICY_IDENTITY_USER = 'u',
+  POLICY_IDENTITY_GROUP = 'g',
+  POLICY_IDENTITY_NETGROUP = 'n',
+} PolicyIdentityKind;
+
+typedef struct PolicyIdentityEntry
+{
+  PolicyIdentityKind kind;
+  gpointer record;     /**<PolicyUserRecord or PolicyMembersRecord */
+  gint64 expires;      /**<Monotonic time after which it must be refreshed */
+} PolicyIdentityEntry;
+
+struct PolicyIdentityCache
+{
+  GMutex lock;
+  GCond refreshed;
+  GHashTable *entries; /**<"kind:id" to PolicyIdentityEntry */
+  GHashTable *resolving; /**<Set of the keys NSS is being asked about */
+  GThreadPool *workers;
+  guint pending; /**<Refreshes queued or running */
+  guint capacity;
+  gint64 ttl;
+  gint64 negative_ttl;
+  gint64 max_stale;
+};
+
+PolicyUserRecord *
+policy_user_record_ref (PolicyUserRecord *record)
+{
+  g_atomic_int_inc (&record->ref_count);
+  return record;
+}
+
+void
+policy_user_record_unref (PolicyUserRecord *record)
+{
+  if (!g_atomic_int_dec_and_test (&record->ref_count))
+    {
+      return;
+    }
+  g_free (record->name);
+  g_array_unref (record->gids);
+  g_free (record);
+}
+
+PolicyMembersRecord *
+policy_members_record_ref (PolicyMembersRecord *record)
+{
+  g_atomic_int_inc (&record->ref_count);
+  return record;
+}
+
+void
+policy_members_record_unref (PolicyMembersRecord *record)
+{
+  if (!g_atomic_int_dec_and_test (&record->ref_count))
+    {
+      return;
+    }
+  g_array_unref (record->members);
+  g_free (record);
+}
+
+static void
+policy_member_clear (gpointer data)
+{
+  PolicyMember *member = data;
+  g_free (member->name);
+}
+
+static gboolean
+policy_identity_record_found (PolicyIdentityKind kind, gpointer record)
+{
+  if (kind == POLICY_IDENTITY_USER)
+    {
+      return ((PolicyUserRecord *)record)->name != NULL;
+    }
+  return ((PolicyMembersRecord *)record)->found;
+}
+
+static gpointer
+policy_identity_record_ref (PolicyIdentityKind kind, gpointer record)
+{
+  if (kind == POLICY_IDENTITY_USER)
+    {
+      return policy_user_record_ref (record);
+    }
+  return policy_members_record_ref (record);
+}
+
+static void
+policy_identity_record_unref (PolicyIdentityKind kind, gpointer record)
+{
+  if (kind == POLICY_IDENTITY_USER)
+    {
+      policy_user_record_unref (record);
+    }
+  else
+    {
+      policy_members_record_unref (record);
+    }
+}
+
+static void
+policy_identity_entry_free (PolicyIdentityEntry *entry)
+{
+  policy_identity_record_unref (entry->kind, entry->record);
+  g_free (entry);
+}
+
+/* ----------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * Ask NSS about a single user. Must hold policy_identity_nss.
+ */
+static PolicyUserRecord *
+policy_identity_resolve_user (uid_t uid)
+{
+  PolicyUserRecord *ret = NULL;
+  struct passwd *passwd = NULL;
+  int num_gids = 64;
+
+  ret = g_new0 (PolicyUserRecord, 1);
+  ret->ref_count = 1;
+  ret->uid = uid;
+  ret->primary_gid = (gid_t)-1;
+  ret->gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+
+  passwd = getpwuid (uid);
+  if (!passwd)
+    {
+      return ret;
+    }
+  ret->name = g_strdup (passwd->pw_name);
+  ret->primary_gid = passwd->pw_gid;
+
+  /* Keep growing the buffer until every group fits */
+  for (;;)
+    {
+      int prev_num_gids = num_gids;
+
+      g_array_set_size (ret->gids, num_gids);
+      if (getgrouplist (ret->name, ret->primary_gid, (gid_t *)ret->gids->data,
+                        &num_gids)
+          >= 0)
+        {
+          g_array_set_size (ret->gids, num_gids);
+          break;
+        }
+
+      /* Not all implementations report the required size */
+      if (num_gids <= prev_num_gids)
+        {
+          num_gids = prev_num_gids * 2;
+        }
+      if (num_gids > NGROUPS_MAX)
+        {
+          g_array_set_size (ret->gids, 0);
+          break;
+        }
+    }
+
+  return ret;
+}
+
+/**
+ * Take ownership of @names and resolve each of them to a uid. Must hold
+ * policy_identity_nss.
+ */
+static PolicyMembersRecord *
+policy_identity_members_new (gboolean found, GPtrArray *names)
+{
+  PolicyMembersRecord *ret = NULL;
+
+  ret = g_new0 (PolicyMembersRecord, 1);
+  ret->ref_count = 1;
+  ret->found = found;
+  ret->members = g_array_sized_new (FALSE, FALSE, sizeof (PolicyMember),
+                                    names->len);
+  g_array_set_clear_func (ret->members, policy_member_clear);
+
+  for (guint i = 0; i < names->len; i++)
+    {
+      PolicyMember member = { 0 };
+      struct passwd *passwd = NULL;
+
+      member.name = names->pdata[i];
+      passwd = getpwnam (member.name);
+      member.uid = passwd ? (gint64)passwd->pw_uid : -1;
+      g_array_append_val (ret->members, member);
+    }
+
+  g_ptr_array_free (names, TRUE);
+  return ret;
+}
+
+static PolicyMembersRecord *
+policy_identity_resolve_group (gid_t gid)
+{
+  GPtrArray *names = g_ptr_array_new ();
+  struct group *group = NULL;
+
+  group = getgrgid (gid);
+  if (!group)
+    {
+      return policy_identity_members_new (FALSE, names);
+    }
+
+  /* Copy them out first, as getpwnam() may clobber the group */
+  for (guint i = 0; group->gr_mem && group->gr_mem[i]; i++)
+    {
+      g_ptr_array_add (names, g_strdup (group->gr_mem[i]));
+    }
+
+  return policy_identity_members_new (TRUE, names);
+}
+
+static PolicyMembersRecord *
+policy_identity_resolve_netgroup (const gchar *netgroup)
+{
+  GPtrArray *names = g_ptr_array_new ();
+
+#ifdef HAVE_SETNETGRENT_RETURN
+  if (setnetgrent (netgroup) == 0)
+    {
+      endnetgrent ();
+      return policy_identity_members_new (FALSE, names);
+    }
+#else
+  setnetgrent (netgroup);
+#endif
+
+  for (;;)
+    {
+#if defined(HAVE_NETBSD) || defined(HAVE_OPENBSD)
+      const char *hostname, *username, *domainname;
+#else
+      char *hostname, *username, *domainname;
+#endif
+
+      if (getnetgrent (&hostname, &username, &domainname) == 0)
+        {
+          break;
+        }
+
+      /* Skip NULL entries since we never want to make everyone an admin
+       * Skip "-" entries which mean "no match ever" in netgroup land */
+      if (!username || g_str_equal (username, "-"))
+        {
+          continue;
+        }
+      g_ptr_array_add (names, g_strdup (username));
+    }
+  endnetgrent ();
+
+  return policy_identity_members_new (TRUE, names);
+}
+
+/**
+ * Perform the NSS lookup(s) behind @key
+ */
+static gpointer
+policy_identity_resolve (const gchar *key)
+{
+  gpointer ret = NULL;
+  const gchar *id = key + 2;
+
+  G_LOCK (policy_identity_nss);
+  switch (key[0])
+    {
+    case POLICY_IDENTITY_USER:
+      ret = policy_identity_resolve_user (
+          (uid_t)g_ascii_strtoull (id, NULL, 10));
+      break;
+    case POLICY_IDENTITY_GROUP:
+      ret = policy_identity_resolve_group (
+          (gid_t)g_ascii_strtoull (id, NULL, 10));
+      break;
+    case POLICY_IDENTITY_NETGROUP:
+      ret = policy_identity_resolve_netgroup (id);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+  G_UNLOCK (policy_identity_nss);
+
+  return ret;
+}
+
+/* ----------------------------------------------------------------------------------------------------
+ */
+
+static gboolean
+policy_identity_entry_unusable (gpointer key, gpointer value,
+                                gpointer user_data)
+{
+  const PolicyIdentityEntry *entry = value;
+  PolicyIdentityCache *cache = user_data;
+
+  return !g_hash_table_contains (cache->resolving, key)
+         && g_get_monotonic_time () >= entry->expires + cache->max_stale;
+}
+
+/**
+ * Store a freshly resolved record. Must hold the lock.
+ */
+static void
+policy_identity_cache_store (PolicyIdentityCache *cache, const gchar *key,
+                             gpointer record)
+{
+  PolicyIdentityEntry *entry = NULL;
+  PolicyIdentityKind kind = key[0];
+
+  if (!g_hash_table_contains (cache->entries, key)
+      && g_hash_table_size (cache->entries) >= cache->capacity)
+    {
+      g_hash_table_foreach_remove (cache->entries,
+                                   policy_identity_entry_unusable, cache);
+      if (g_hash_table_size (cache->entries) >= cache->capacity)
+        {
+          g_hash_table_remove_all (cache->entries);
+        }
+    }
+
+  entry = g_new0 (PolicyIdentityEntry, 1);
+  entry->kind = kind;
+  entry->record = policy_identity_record_ref (kind, record);
+  entry->expires = g_get_monotonic_time ()
+                   + (policy_identity_record_found (kind, record)
+                          ? cache->ttl
+                          : cache->negative_ttl);
+  g_hash_table_replace (cache->entries, g_strdup (key), entry);
+}
+
+static void
+policy_identity_cache_refresh (gpointer data, gpointer user_data)
+{
+  PolicyIdentityCache *cache = user_data;
+  gchar *key = data;
+  gpointer record = NULL;
+
+  record = policy_identity_resolve (key);
+
+  g_mutex_lock (&cache->lock);
+  policy_identity_cache_store (cache, key, record);
+  g_hash_table_remove (cache->resolving, key);
+  cache->pending--;
+  g_cond_broadcast (&cache->refreshed);
+  g_mutex_unlock (&cache->lock);
+
+  policy_identity_record_unref (key[0], record);
+  g_free (key);
+}
+
+/**
+ * Return a reference to the record for @key, from the cache where possible
+ */
+static gpointer
+policy_identity_cache_lookup (PolicyIdentityCache *cache, const gchar *key)
+{
+  PolicyIdentityEntry *entry = NULL;
+  PolicyIdentityKind kind = key[0];
+  gpointer ret = NULL;
+  gint64 now;
+
+  if (!cache)
+    {
+      return policy_identity_resolve (key);
+    }
+
+  g_mutex_lock (&cache->lock);
+  for (;;)
+    {
+      now = g_get_monotonic_time ();
+      entry = g_hash_table_lookup (cache->entries, key);
+      if (entry && now < entry->expires + cache->max_stale)
+        {
+          ret = policy_identity_record_ref (kind, entry->record);
+
+          /* Serve the stale record, and have it refreshed for next time */
+          if (now >= entry->expires
+              && !g_hash_table_contains (cache->resolving, key))
+            {
+              g_hash_table_add (cache->resolving, g_strdup (key));
+              cache->pending++;
+              g_thread_pool_push (cache->workers, g_strdup (key), NULL);
+            }
+          g_mutex_unlock (&cache->lock);
+          return ret;
+        }
+
+      if (!g_hash_table_contains (cache->resolving, key))
+        {
+          break;
+        }
+      /* Somebody is asking NSS about it already, wait for their answer */
+      g_cond_wait (&cache->refreshed, &cache->lock);
+    }
+  g_hash_table_add (cache->resolving, g_strdup (key));
+  g_mutex_unlock (&cache->lock);
+
+  /* Nothing we may serve, so this one has to wait */
+  ret = policy_identity_resolve (key);
+
+  g_mutex_lock (&cache->lock);
+  policy_identity_cache_store (cache, key, ret);
+  g_hash_table_remove (cache->resolving, key);
+  g_cond_broadcast (&cache->refreshed);
+  g_mutex_unlock (&cache->lock);
+
+  return ret;
+}
+
+/**
+ * Queue a refresh of @key, unless it is fresh or being refreshed already
+ */
+static void
+policy_identity_cache_prefetch (PolicyIdentityCache *cache, const gchar *key)
+{
+  PolicyIdentityEntry *entry = NULL;
+
+  g_mutex_lock (&cache->lock);
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (g_hash_table_contains (cache->resolving, key)
+      || (entry && g_get_monotonic_time () < entry->expires))
+    {
+      g_mutex_unlock (&cache->lock);
+      return;
+    }
+
+  g_hash_table_add (cache->resolving, g_strdup (key));
+  cache->pending++;
+  g_thread_pool_push (cache->workers, g_strdup (key), NULL);
+  g_mutex_unlock (&cache->lock);
+}
+
+PolicyIdentityCache *
+policy_identity_cache_new (guint capacity, gint64 ttl, gint64 negative_ttl,
+                           gint64 max_stale)
+{
+  PolicyIdentityCache *ret = NULL;
+
+  ret = g_new0 (PolicyIdentityCache, 1);
+  g_mutex_init (&ret->lock);
+  g_cond_init (&ret->refreshed);
+  ret->entries = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify)policy_identity_entry_free);
+  ret->resolving = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                          NULL);
+  ret->workers = g_thread_pool_new (policy_identity_cache_refresh, ret, 1,
+                                    FALSE, NULL);
+  ret->capacity = MAX (capacity, 1);
+  ret->ttl = ttl;
+  ret->negative_ttl = negative_ttl;
+  ret->max_stale = max_stale;
+
+  return ret;
+}
+
+void
+policy_identity_cache_set_ttl (PolicyIdentityCache *cache, gint64 ttl,
+                               gint64 negative_ttl)
+{
+  g_mutex_lock (&cache->lock);
+  cache->ttl = ttl;
+  cache->negative_ttl = negative_ttl;
+  g_mutex_unlock (&cache->lock);
+}
+
+PolicyUserRecord *
+policy_identity_cache_lookup_user (PolicyIdentityCache *cache, uid_t uid)
+{
+  gchar key[32];
+
+  g_snprintf (key, sizeof (key), "%c:%u", POLICY_IDENTITY_USER, (guint)uid);
+  return policy_identity_cache_lookup (cache, key);
+}
+
+PolicyMembersRecord *
+policy_identity_cache_lookup_group (PolicyIdentityCache *cache, gid_t gid)
+{
+  gchar key[32];
+
+  g_snprintf (key, sizeof (key), "%c:%u", POLICY_IDENTITY_GROUP, (guint)gid);
+  return policy_identity_cache_lookup (cache, key);
+}
+
+PolicyMembersRecord *
+policy_identity_cache_lookup_netgroup (PolicyIdentityCache *cache,
+                                       const gchar *netgroup)
+{
+  PolicyMembersRecord *ret = NULL;
+  gchar *key = NULL;
+
+  key = g_strdup_printf ("%c:%s", POLICY_IDENTITY_NETGROUP, netgroup);
+  ret = policy_identity_cache_lookup (cache, key);
+  g_free (key);
+
+  return ret;
+}
+
+void
+policy_identity_cache_prefetch_user (PolicyIdentityCache *cache, uid_t uid)
+{
+  gchar key[32];
+
+  g_snprintf (key, sizeof (key), "%c:%u", POLICY_IDENTITY_USER, (guint)uid);
+  policy_identity_cache_prefetch (cache, key);
+}
+
+void
+policy_identity_cache_prefetch_group (PolicyIdentityCache *cache, gid_t gid)
+{
+  gchar key[32];
+
+  g_snprintf (key, sizeof (key), "%c:%u", POLICY_IDENTITY_GROUP, (guint)gid);
+  policy_identity_cache_prefetch (cache, key);
+}
+
+void
+policy_identity_cache_prefetch_netgroup (PolicyIdentityCache *cache,
+                                         const gchar *netgroup)
+{
+  gchar *key = NULL;
+
+  key = g_strdup_printf ("%c:%s", POLICY_IDENTITY_NETGROUP, netgroup);
+  policy_identity_cache_prefetch (cache, key);
+  g_free (key);
+}
+
+void
+policy_identity_cache_sync (PolicyIdentityCache *cache)
+{
+  g_mutex_lock (&cache->lock);
+  while (cache->pending > 0)
+    {
+      g_cond_wait (&cache->refreshed, &cache->lock);
+    }
+  g_mutex_unlock (&cache->lock);
+}
+
+void
+policy_identity_cache_get_memory_usage (PolicyIdentityCache *cache,
+                                        guint64 *bytes, guint64 *objects)
+{
+  GHashTableIter iter;
+  const gchar *key = NULL;
+  PolicyIdentityEntry *entry = NULL;
+
+  g_mutex_lock (&cache->lock);
+  g_hash_table_iter_init (&iter, cache->entries);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&entry))
+    {
+      *bytes += sizeof (PolicyIdentityEntry) + strlen (key) + 1
+                + 2 * sizeof (gpointer) + sizeof (guint);
+      if (entry->kind == POLICY_IDENTITY_USER)
+        {
+          const PolicyUserRecord *user = entry->record;
+
+          *bytes += sizeof (PolicyUserRecord)
+                    + (user->name ? strlen (user->name) + 1 : 0)
+                    + user->gids->len * sizeof (gid_t);
+        }
+      else
+        {
+          const PolicyMembersRecord *members = entry->record;
+
+          *bytes += sizeof (PolicyMembersRecord);
+          for (guint n = 0; n < members->members->len; n++)
+            {
+              const PolicyMember *member
+                  = &g_array_index (members->members, PolicyMember, n);
+
+              *bytes += sizeof (PolicyMember) + strlen (member->name) + 1;
+            }
+        }
+      *objects += 1;
+    }
+  g_mutex_unlock (&cache->lock);
+}
+
+void
+policy_identity_cache_clear (PolicyIdentityCache *cache)
+{
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove_all (cache->entries);
+  g_mutex_unlock (&cache->lock);
+}
+
+void
+policy_identity_cache_free (PolicyIdentityCache *cache)
+{
+  if (!cache)
+    {
+      return;
+    }
+  /* Let queued refreshes finish, as they reference the cache */
+  g_thread_pool_free (cache->workers, FALSE, TRUE);
+  g_clear_pointer (&cache->entries, g_hash_table_unref);
+  g_clear_pointer (&cache->resolving, g_hash_table_unref);
+  g_cond_clear (&cache->refreshed);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
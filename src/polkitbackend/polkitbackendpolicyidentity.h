@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_POLICY_IDENTITY_H
+#define __POLKIT_BACKEND_POLICY_IDENTITY_H
+
+#include <glib.h>
+#include <sys/types.h>
+
+/**
+ * PolicyUserRecord is what NSS knows about a single user. Records are
+ * immutable once returned, and may be shared between threads.
+ */
+typedef struct PolicyUserRecord
+{
+  volatile gint ref_count;
+  uid_t uid;
+  gchar *name;       /**<NULL if the user is unknown */
+  gid_t primary_gid; /**<-1 if the user is unknown */
+  GArray *gids;      /**<gid_t of every group the user is a member of */
+} PolicyUserRecord;
+
+/**
+ * A single member of a group or netgroup
+ */
+typedef struct PolicyMember
+{
+  gchar *name;
+  gint64 uid; /**<-1 if the name isn't a known user */
+} PolicyMember;
+
+/**
+ * PolicyMembersRecord lists the members of a group or netgroup. It is
+ * immutable once returned, and may be shared between threads.
+ */
+typedef struct PolicyMembersRecord
+{
+  volatile gint ref_count;
+  gboolean found; /**<FALSE if the group itself is unknown */
+  GArray *members; /**<PolicyMember, in NSS order */
+} PolicyMembersRecord;
+
+/**
+ * PolicyIdentityCache keeps the outcome of NSS lookups, so that a slow
+ * directory server (i.e. LDAP) doesn't stall every check.
+ *
+ * Known identities are fresh for @ttl and unknown ones for @negative_ttl.
+ * Once a record goes stale it is still served for up to @max_stale while
+ * a worker thread refreshes it. Past that, lookups wait on NSS, but only
+ * one of them asks it and the others wait for its answer. The cache is
+ * safe to share between threads.
+ */
+typedef struct PolicyIdentityCache PolicyIdentityCache;
+
+/**
+ * Create a new cache holding at most @capacity records, with lifetimes in
+ * microseconds
+ */
+PolicyIdentityCache *policy_identity_cache_new (guint capacity, gint64 ttl,
+                                                gint64 negative_ttl,
+                                                gint64 max_stale);
+
+/**
+ * Change the lifetimes used for records stored from now on
+ */
+void policy_identity_cache_set_ttl (PolicyIdentityCache *cache, gint64 ttl,
+                                    gint64 negative_ttl);
+
+/**
+ * Look up a user by uid. @cache may be NULL, in which case NSS is always
+ * asked. Never returns NULL; unref the record with policy_user_record_unref
+ */
+PolicyUserRecord *policy_identity_cache_lookup_user (PolicyIdentityCache *cache,
+                                                     uid_t uid);
+
+/**
+ * Look up the members of a group by gid. @cache may be NULL.
+ */
+PolicyMembersRecord *
+policy_identity_cache_lookup_group (PolicyIdentityCache *cache, gid_t gid);
+
+/**
+ * Look up the users of a netgroup by name. @cache may be NULL.
+ */
+PolicyMembersRecord *
+policy_identity_cache_lookup_netgroup (PolicyIdentityCache *cache,
+                                       const gchar *netgroup);
+
+/**
+ * Have a user, along with the groups it is a member of, looked up in the
+ * background unless it is fresh already. Never blocks.
+ */
+void policy_identity_cache_prefetch_user (PolicyIdentityCache *cache,
+                                          uid_t uid);
+
+/**
+ * Have the members of a group, or of a netgroup, looked up in the
+ * background unless they are fresh already, so that a later lookup needn't
+ * wait on NSS. Never blocks.
+ */
+void policy_identity_cache_prefetch_group (PolicyIdentityCache *cache,
+                                           gid_t gid);
+void policy_identity_cache_prefetch_netgroup (PolicyIdentityCache *cache,
+                                              const gchar *netgroup);
+
+/**
+ * Block until every pending background refresh has completed
+ */
+void policy_identity_cache_sync (PolicyIdentityCache *cache);
+
+/**
+ * Estimate the memory held by the records, and add it to @bytes and
+ * @objects
+ */
+void policy_identity_cache_get_memory_usage (PolicyIdentityCache *cache,
+                                             guint64 *bytes,
+                                             guint64 *objects);
+
+/**
+ * Forget every record, so the next lookups go to NSS
+ */
+void policy_identity_cache_clear (PolicyIdentityCache *cache);
+
+/**
+ * Free any resources associated with a PolicyIdentityCache, waiting for a
+ * refresh already in progress
+ */
+void policy_identity_cache_free (PolicyIdentityCache *cache);
+
+PolicyUserRecord *policy_user_record_ref (PolicyUserRecord *record);
+void policy_user_record_unref (PolicyUserRecord *record);
+
+PolicyMembersRecord *policy_members_record_ref (PolicyMembersRecord *record);
+void policy_members_record_unref (PolicyMembersRecord *record);
+
+#endif /* __POLKIT_BACKEND_POLICY_IDENTITY_H */
@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "polkitbackendpolicyimage.h"
+
+/**
+ * The image is laid out as a header, followed by one record per file and
+ * then the tables each record points to. Everything is in native byte
+ * order, as an image is only ever read back by the host that wrote it.
+ */
+#define POLICY_IMAGE_MAGIC 0x49524b50 /* "PKRI" */
+#define POLICY_IMAGE_ALIGN 8
+
+typedef struct PolicyImageHeader
+{
+  guint32 magic;
+  guint32 version;
+  guint32 policy_size; /**<sizeof (Policy), catching any ABI difference */
+  guint32 n_entries;
+  guint64 size; /**<Length of the whole image */
+} PolicyImageHeader;
+
+/**
+ * Offsets are from the start of the image, counts are in elements
+ */
+typedef struct PolicyImageRecord
+{
+  PolicyFileStamp stamp;
+  guint64 path;
+  guint64 path_len; /**<Not including the NUL terminator */
+  guint64 pool;
+  guint64 pool_size;
+  guint64 strings;
+  guint64 n_strings;
+  guint64 normal;
+  guint64 n_normal;
+  guint64 admin;
+  guint64 n_admin;
+} PolicyImageRecord;
+
+gboolean
+policy_file_stamp_new_from_path (const gchar *path, PolicyFileStamp *stamp,
+                                 GError **error)
+{
+  GStatBuf st;
+  gchar *contents = NULL;
+  gsize length = 0;
+  GChecksum *checksum = NULL;
+  gsize digest_len = sizeof (stamp->digest);
+
+  /* Stat before reading, so that a racing write leaves a stale stamp
+   * behind rather than a stamp that claims the new contents */
+  if (g_stat (path, &st) != 0)
+    {
+      int errsv = errno;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "Failed to stat %s: %s", path, g_strerror (errsv));
+      return FALSE;
+    }
+
+  if (!g_file_get_contents (path, &contents, &length, error))
+    {
+      return FALSE;
+    }
+
+  memset (stamp, 0, sizeof (*stamp));
+  stamp->dev = st.st_dev;
+  stamp->ino = st.st_ino;
+  stamp->size = st.st_size;
+  stamp->mtime = st.st_mtime;
+  stamp->ctime = st.st_ctime;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (const guchar *)contents, length);
+  g_checksum_get_digest (checksum, stamp->digest, &digest_len);
+  g_checksum_free (checksum);
+  g_free (contents);
+
+  return TRUE;
+}
+
+gboolean
+policy_file_stamp_matches_stat (const PolicyFileStamp *stamp,
+                                const GStatBuf *st)
+{
+  return stamp->dev == (guint64)st->st_dev
+         && stamp->ino == (guint64)st->st_ino
+         && stamp->size == (guint64)st->st_size
+         && stamp->mtime == (gint64)st->st_mtime
+         && stamp->ctime == (gint64)st->st_ctime;
+}
+
+/**
+ * Append @size bytes at the next aligned offset, returning that offset
+ */
+static guint64
+policy_image_append (GByteArray *image, gconstpointer data, gsize size)
+{
+  static const guint8 padding[POLICY_IMAGE_ALIGN] = { 0 };
+  guint64 offset;
+
+  if (image->len % POLICY_IMAGE_ALIGN != 0)
+    {
+      g_byte_array_append (image, padding,
+                           POLICY_IMAGE_ALIGN
+                               - (image->len % POLICY_IMAGE_ALIGN));
+    }
+  offset = image->len;
+  if (size > 0)
+    {
+      g_byte_array_append (image, data, size);
+    }
+
+  return offset;
+}
+
+GBytes *
+policy_image_serialize (const PolicyImageEntry *entries, guint n_entries)
+{
+  GByteArray *image = NULL;
+  PolicyImageHeader header = { 0 };
+  PolicyImageRecord *records = NULL;
+  guint n;
+
+  image = g_byte_array_new ();
+  records = g_new0 (PolicyImageRecord, MAX (n_entries, 1));
+
+  /* Reserve the header and records, filled in once offsets are known */
+  policy_image_append (image, &header, sizeof (header));
+  policy_image_append (image, records, n_entries * sizeof (*records));
+
+  for (n = 0; n < n_entries; n++)
+    {
+      const PolicyImageEntry *entry = &entries[n];
+      const PolicyFile *file = entry->file;
+      PolicyImageRecord *record = &records[n];
+
+      record->stamp = entry->stamp;
+      record->path_len = strlen (entry->path);
+      record->path
+          = policy_image_append (image, entry->path, record->path_len + 1);
+      record->pool_size = file->pool_size;
+      record->pool = policy_image_append (image, file->pool, file->pool_size);
+      record->n_strings = file->n_strings;
+      record->strings = policy_image_append (
+          image, file->strings, file->n_strings * sizeof (guint));
+      record->n_normal = file->rules.n_normal;
+      record->normal = policy_image_append (
+          image, file->rules.normal, file->rules.n_normal * sizeof (Policy));
+      record->n_admin = file->rules.n_admin;
+      record->admin = policy_image_append (
+          image, file->rules.admin, file->rules.n_admin * sizeof (Policy));
+    }
+
+  header.magic = POLICY_IMAGE_MAGIC;
+  header.version = POLICY_IMAGE_VERSION;
+  header.policy_size = sizeof (Policy);
+  header.n_entries = n_entries;
+  header.size = image->len;
+  memcpy (image->data, &header, sizeof (header));
+  memcpy (image->data + sizeof (header), records,
+          n_entries * sizeof (*records));
+  g_free (records);
+
+  return g_byte_array_free_to_bytes (image);
+}
+
+gboolean
+policy_image_write (const gchar *path, const PolicyImageEntry *entries,
+                    guint n_entries, GError **error)
+{
+  GBytes *image = NULL;
+  gchar *dir = NULL;
+  gboolean ret = FALSE;
+
+  image = policy_image_serialize (entries, n_entries);
+
+  dir = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      int errsv = errno;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "Failed to create %s: %s", dir, g_strerror (errsv));
+      goto out;
+    }
+
+  /* Written to a temporary file and renamed over, so readers only ever
+   * see a complete image */
+  ret = g_file_set_contents (path, g_bytes_get_data (image, NULL),
+                             g_bytes_get_size (image), error);
+
+out:
+  g_free (dir);
+  g_bytes_unref (image);
+  return ret;
+}
+
+/**
+ * Ensure [offset, offset + n * size) lies within the image
+ */
+static gboolean
+policy_image_check_range (gsize length, guint64 offset, guint64 n,
+                          guint64 size)
+{
+  if (offset > length)
+    {
+      return FALSE;
+    }
+  if (size != 0 && n > (length - offset) / size)
+    {
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+policy_image_check_strings (const PolicyFile *file, PolicyStrings strings)
+{
+  return (guint64)strings.start + strings.n <= file->n_strings;
+}
+
+static gboolean
+policy_image_check_policy (const PolicyFile *file, const Policy *policy)
+{
+  return policy->id < file->pool_size
+         && policy_image_check_strings (file, policy->actions)
+         && policy_image_check_strings (file, policy->action_contains)
+         && policy_image_check_strings (file, policy->unix_groups)
+         && policy_image_check_strings (file, policy->unix_names)
+         && policy_image_check_strings (file, policy->net_groups)
+         && policy->detail_key < file->pool_size
+         && policy_image_check_strings (file, policy->detail_values)
+         && policy_image_check_strings (file, policy->seats)
+         && policy_image_check_strings (file, policy->session_classes)
+         && policy_image_check_strings (file, policy->session_types)
+         && policy->response >= POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN
+         && policy->response <= POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED
+         && policy->response_inverse >= POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN
+         && policy->response_inverse
+                <= POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED;
+}
+
+/**
+ * A loaded file is only ever indexed through its own tables, so make sure
+ * none of those indices can point outside of them.
+ */
+static gboolean
+policy_image_check_file (const PolicyFile *file)
+{
+  guint n;
+
+  if (file->pool_size > 0 && file->pool[file->pool_size - 1] != '\0')
+    {
+      return FALSE;
+    }
+  for (n = 0; n < file->n_strings; n++)
+    {
+      if (file->strings[n] >= file->pool_size)
+        {
+          return FALSE;
+        }
+    }
+  for (n = 0; n < file->rules.n_normal; n++)
+    {
+      if (!policy_image_check_policy (file, &file->rules.normal[n]))
+        {
+          return FALSE;
+        }
+    }
+  for (n = 0; n < file->rules.n_admin; n++)
+    {
+      if (!policy_image_check_policy (file, &file->rules.admin[n]))
+        {
+          return FALSE;
+        }
+    }
+  return TRUE;
+}
+
+static void
+policy_image_entry_clear (PolicyImageEntry *entry)
+{
+  g_clear_pointer (&entry->path, g_free);
+  g_clear_pointer (&entry->file, policy_file_free);
+}
+
+GArray *
+policy_image_read (const gchar *path, GError **error)
+{
+  GMappedFile *mapped = NULL;
+  GArray *ret = NULL;
+
+  mapped = g_mapped_file_new (path, FALSE, error);
+  if (!mapped)
+    {
+      return NULL;
+    }
+  ret = policy_image_read_data (g_mapped_file_get_contents (mapped),
+                                g_mapped_file_get_length (mapped), path,
+                                error);
+  g_mapped_file_unref (mapped);
+
+  return ret;
+}
+
+GArray *
+policy_image_read_data (const gchar *data, gsize length, const gchar *name,
+                        GError **error)
+{
+  PolicyImageHeader header;
+  const PolicyImageRecord *records = NULL;
+  GArray *ret = NULL;
+  guint n;
+
+  if (length < sizeof (header))
+    {
+      goto corrupt;
+    }
+  memcpy (&header, data, sizeof (header));
+  if (header.magic != POLICY_IMAGE_MAGIC || header.size != length)
+    {
+      goto corrupt;
+    }
+  if (header.version != POLICY_IMAGE_VERSION
+      || header.policy_size != sizeof (Policy))
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Image %s is from another version", name);
+      goto out;
+    }
+  if (!policy_image_check_range (length, sizeof (header), header.n_entries,
+                                 sizeof (PolicyImageRecord)))
+    {
+      goto corrupt;
+    }
+  records = (const PolicyImageRecord *)(data + sizeof (header));
+
+  ret = g_array_sized_new (FALSE, TRUE, sizeof (PolicyImageEntry),
+                           header.n_entries);
+  g_array_set_clear_func (ret, (GDestroyNotify)policy_image_entry_clear);
+
+  for (n = 0; n < header.n_entries; n++)
+    {
+      const PolicyImageRecord *record = &records[n];
+      PolicyImageEntry entry = { 0 };
+      PolicyFile view = { 0 };
+      PolicyFile *file = NULL;
+
+      if (record->path_len >= length
+          || !policy_image_check_range (length, record->path,
+                                        record->path_len + 1, 1)
+          || data[record->path + record->path_len] != '\0'
+          || !policy_image_check_range (length, record->pool,
+                                        record->pool_size, 1)
+          || !policy_image_check_range (length, record->strings,
+                                        record->n_strings, sizeof (guint))
+          || !policy_image_check_range (length, record->normal,
+                                        record->n_normal, sizeof (Policy))
+          || !policy_image_check_range (length, record->admin,
+                                        record->n_admin, sizeof (Policy))
+          || record->strings % POLICY_IMAGE_ALIGN != 0
+          || record->normal % POLICY_IMAGE_ALIGN != 0
+          || record->admin % POLICY_IMAGE_ALIGN != 0
+          || record->pool_size > G_MAXUINT || record->n_strings > G_MAXUINT
+          || record->n_normal > G_MAXUINT || record->n_admin > G_MAXUINT)
+        {
+          goto corrupt;
+        }
+
+      /* Copy out of the mapping, so the files outlive it */
+      view.path = (gchar *)data + record->path;
+      view.pool = (gchar *)data + record->pool;
+      view.pool_size = record->pool_size;
+      view.strings = (guint *)(data + record->strings);
+      view.n_strings = record->n_strings;
+      view.rules.normal = (Policy *)(data + record->normal);
+      view.rules.n_normal = record->n_normal;
+      view.rules.admin = (Policy *)(data + record->admin);
+      view.rules.n_admin = record->n_admin;
+      file = policy_file_copy (&view);
+
+      entry.path = g_strdup (data + record->path);
+      entry.stamp = record->stamp;
+      entry.file = file;
+      g_array_append_val (ret, entry);
+
+      if (!policy_image_check_file (file))
+        {
+          goto corrupt;
+        }
+    }
+
+  goto out;
+
+corrupt:
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Image %s is corrupt",
+               name);
+  g_clear_pointer (&ret, g_array_unref);
+
+out:
+  return ret;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_POLICY_IMAGE_H
+#define __POLKIT_BACKEND_POLICY_IMAGE_H
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "polkitbackendpolicyfile.h"
+
+/**
+ * Bump whenever the layout of the image, or of any PolicyFile table stored
+ * within it, changes.
+ */
+#define POLICY_IMAGE_VERSION 3
+
+/**
+ * PolicyFileStamp identifies the exact source a PolicyFile was parsed from
+ */
+typedef struct PolicyFileStamp
+{
+  guint64 dev;
+  guint64 ino;
+  guint64 size;
+  gint64 mtime;
+  gint64 ctime;
+  guint8 digest[32]; /**<SHA-256 of the contents */
+} PolicyFileStamp;
+
+/**
+ * A PolicyFile and the source it was parsed from
+ */
+typedef struct PolicyImageEntry
+{
+  gchar *path;
+  PolicyFileStamp stamp;
+  PolicyFile *file;
+} PolicyImageEntry;
+
+/**
+ * Stamp the file at @path, hashing its current contents
+ */
+gboolean policy_file_stamp_new_from_path (const gchar *path,
+                                          PolicyFileStamp *stamp,
+                                          GError **error);
+
+/**
+ * Cheap check that @st still describes the stamped file, without hashing
+ */
+gboolean policy_file_stamp_matches_stat (const PolicyFileStamp *stamp,
+                                         const GStatBuf *st);
+
+/**
+ * Lay the given entries out as an image, in memory
+ */
+GBytes *policy_image_serialize (const PolicyImageEntry *entries,
+                                guint n_entries);
+
+/**
+ * Atomically replace the image at @path with the given entries
+ */
+gboolean policy_image_write (const gchar *path,
+                             const PolicyImageEntry *entries,
+                             guint n_entries, GError **error);
+
+/**
+ * Map and validate the image at @path, returning a GArray of
+ * PolicyImageEntry that owns each path and file, or NULL if the image is
+ * missing, corrupt or from another version.
+ */
+GArray *policy_image_read (const gchar *path, GError **error);
+
+/**
+ * As policy_image_read(), for an image of @length bytes at @data, which
+ * must be aligned to 8 bytes. @name is only used for errors.
+ */
+GArray *policy_image_read_data (const gchar *data, gsize length,
+                                const gchar *name, GError **error);
+
+#endif /* __POLKIT_BACKEND_POLICY_IMAGE_H */
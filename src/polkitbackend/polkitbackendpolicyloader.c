@@ -0,0 +1,830 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "polkitbackendpolicybundle.h"
+#include "polkitbackendpolicyimage.h"
+#include "polkitbackendpolicyloader.h"
+
+/**
+ * LoadedRulesFile remembers a parsed file along with enough about its
+ * source to notice when it changes, so that unchanged files are not parsed
+ * again on reload (or from the image, at startup).
+ */
+typedef struct LoadedRulesFile
+{
+  PolicyFileStamp stamp;
+  PolicyFile *file; /**<Unchained, copied into each new ruleset */
+} LoadedRulesFile;
+
+static void
+loaded_rules_file_free (LoadedRulesFile *loaded)
+{
+  policy_file_free (loaded->file);
+  g_free (loaded);
+}
+
+struct PolicyLoader
+{
+  gchar **rules_dirs;
+  gchar *rules_cache; /**<Precompiled image of loaded_files, or NULL */
+  gboolean write_cache;
+  gchar *bundle;     /**<Precompiled, signed rules used instead, or NULL */
+  gchar *bundle_key; /**<The key @bundle is signed with */
+  guint64 bundle_serial; /**<Highest serial loaded, older bundles are refused */
+
+  /* Path to LoadedRulesFile, for every file compiled into polkitd, or NULL */
+  GHashTable *builtin_files;
+
+  PolicyLoaderLogFunc log_func;
+  gpointer log_data;
+
+  /* Path to LoadedRulesFile, for every file that was parsed */
+  GHashTable *loaded_files;
+
+  PolicyLoaderProfile profile; /**<Of the last compile */
+};
+
+static void
+policy_loader_file_profile_clear (PolicyLoaderFileProfile *file)
+{
+  g_free (file->path);
+}
+
+static void policy_loader_log (PolicyLoader *loader, const gchar *format,
+                               ...) G_GNUC_PRINTF (2, 3);
+
+static void
+policy_loader_log (PolicyLoader *loader, const gchar *format, ...)
+{
+  va_list args;
+  gchar *message = NULL;
+
+  va_start (args, format);
+  message = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  if (loader->log_func)
+    {
+      loader->log_func (message, loader->log_data);
+    }
+  else
+    {
+      g_debug ("%s", message);
+    }
+  g_free (message);
+}
+
+PolicyLoader *
+policy_loader_new (const gchar *const *rules_dirs, const gchar *rules_cache,
+                   gboolean write_cache, PolicyLoaderLogFunc log_func,
+                   gpointer log_data)
+{
+  PolicyLoader *loader = NULL;
+
+  loader = g_new0 (PolicyLoader, 1);
+  loader->rules_dirs = g_strdupv ((gchar **)rules_dirs);
+  loader->rules_cache = g_strdup (rules_cache);
+  loader->write_cache = write_cache;
+  loader->log_func = log_func;
+  loader->log_data = log_data;
+  loader->loaded_files
+      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                               (GDestroyNotify)loaded_rules_file_free);
+  loader->profile.files
+      = g_array_new (FALSE, TRUE, sizeof (PolicyLoaderFileProfile));
+  g_array_set_clear_func (loader->profile.files,
+                          (GDestroyNotify)policy_loader_file_profile_clear);
+
+  return loader;
+}
+
+void
+policy_loader_free (PolicyLoader *loader)
+{
+  if (!loader)
+    {
+      return;
+    }
+  g_strfreev (loader->rules_dirs);
+  g_free (loader->rules_cache);
+  g_free (loader->bundle);
+  g_free (loader->bundle_key);
+  g_hash_table_unref (loader->loaded_files);
+  g_clear_pointer (&loader->builtin_files, g_hash_table_unref);
+  g_array_unref (loader->profile.files);
+  g_free (loader);
+}
+
+void
+policy_loader_set_bundle (PolicyLoader *loader, const gchar *bundle,
+                          const gchar *bundle_key)
+{
+  g_free (loader->bundle);
+  g_free (loader->bundle_key);
+  loader->bundle = g_strdup (bundle);
+  loader->bundle_key = g_strdup (bundle_key);
+}
+
+void
+policy_loader_set_builtin (PolicyLoader *loader, const gchar *data,
+                           gsize length)
+{
+  GArray *entries = NULL;
+  g_autoptr (GError) err = NULL;
+
+  g_clear_pointer (&loader->builtin_files, g_hash_table_unref);
+
+  entries = policy_image_read_data (data, length, "<built-in>", &err);
+  if (!entries)
+    {
+      policy_loader_log (loader, "Ignoring built-in rules: %s",
+                         err->message);
+      return;
+    }
+
+  loader->builtin_files
+      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                               (GDestroyNotify)loaded_rules_file_free);
+  for (guint n = 0; n < entries->len; n++)
+    {
+      PolicyImageEntry *entry
+          = &g_array_index (entries, PolicyImageEntry, n);
+      LoadedRulesFile *loaded = NULL;
+
+      /* Only replaceable by name if it has one */
+      if (!strchr (entry->path, '/'))
+        {
+          continue;
+        }
+
+      loaded = g_new0 (LoadedRulesFile, 1);
+      loaded->stamp = entry->stamp;
+      loaded->file = g_steal_pointer (&entry->file);
+      g_hash_table_insert (loader->builtin_files,
+                           g_steal_pointer (&entry->path), loaded);
+    }
+  g_array_unref (entries);
+}
+
+/**
+ * Add the path of every built-in file to @paths, unless one of @paths
+ * replaces it by having the same name
+ */
+static GList *
+add_builtin_paths (PolicyLoader *loader, GList *paths)
+{
+  g_autoptr (GHashTable) names = NULL;
+  GHashTableIter iter;
+  const gchar *path = NULL;
+
+  if (!loader->builtin_files)
+    {
+      return paths;
+    }
+
+  names = g_hash_table_new (g_str_hash, g_str_equal);
+  for (GList *l = paths; l != NULL; l = l->next)
+    {
+      const gchar *name = strrchr (l->data, '/');
+
+      g_hash_table_insert (names, (gchar *)(name ? name + 1 : l->data),
+                           l->data);
+    }
+
+  g_hash_table_iter_init (&iter, loader->builtin_files);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&path, NULL))
+    {
+      const gchar *replacement
+          = g_hash_table_lookup (names, strrchr (path, '/') + 1);
+
+      if (replacement)
+        {
+          policy_loader_log (loader, "Built-in rules %s replaced by %s",
+                             path, replacement);
+          continue;
+        }
+      paths = g_list_prepend (paths, g_strdup (path));
+    }
+
+  return paths;
+}
+
+/**
+ * Files that need parsing are spread over at most this many threads
+ */
+#define POLICY_LOADER_THREADS 8
+
+/**
+ * RulesFileJob tracks a single rules file through policy_loader_compile(). Only
+ * the parsing runs in the loader threads, everything else stays with the
+ * caller so that loaded_files needs no locking.
+ */
+typedef struct RulesFileJob
+{
+  const gchar *filename;
+  LoadedRulesFile *loaded; /**<Owned by seen once loaded */
+  gboolean parse;          /**<New or modified since we last saw it */
+  PolicyFileLoadProfile times; /**<Set once parsed */
+  GError *error;
+} RulesFileJob;
+
+/**
+ * Find out whether the given rules file needs parsing again, reusing what
+ * we loaded before if it is unchanged. Seen files are moved into @seen, so
+ * that whatever remains in loaded_files was deleted.
+ */
+static void
+prepare_rules_file (PolicyLoader *loader, RulesFileJob *job,
+                    GHashTable *seen)
+{
+  GStatBuf st;
+  LoadedRulesFile *loaded = NULL;
+  gchar *key = NULL;
+
+  if (g_stat (job->filename, &st) != 0)
+    {
+      policy_loader_log (loader, "Error reading rules %s: %s",
+                         job->filename, g_strerror (errno));
+      return;
+    }
+
+  if (g_hash_table_lookup_extended (loader->loaded_files, job->filename,
+                                    (gpointer *)&key, (gpointer *)&loaded))
+    {
+      g_hash_table_steal (loader->loaded_files, job->filename);
+      /* The stamp doesn't cover the fragments a file includes */
+      if (!loaded->file->has_includes
+          && policy_file_stamp_matches_stat (&loaded->stamp, &st))
+        {
+          g_hash_table_insert (seen, key, loaded);
+          job->loaded = loaded;
+          return;
+        }
+      g_free (key);
+      loaded_rules_file_free (loaded);
+    }
+
+  job->parse = TRUE;
+}
+
+/**
+ * Parse a single rules file. This touches nothing but @job, so that
+ * several files may be parsed at once.
+ */
+static void
+parse_rules_file (RulesFileJob *job)
+{
+  LoadedRulesFile *loaded = NULL;
+
+  loaded = g_new0 (LoadedRulesFile, 1);
+  if (policy_file_stamp_new_from_path (job->filename, &loaded->stamp,
+                                       &job->error))
+    {
+      loaded->file = policy_file_new_from_path_profiled (
+          job->filename, &job->times, &job->error);
+    }
+  if (!loaded->file)
+    {
+      g_free (loaded);
+      return;
+    }
+  job->loaded = loaded;
+}
+
+static void
+parse_rules_file_thread_func (gpointer data, gpointer user_data)
+{
+  parse_rules_file (data);
+}
+
+/**
+ * Parse every job that needs it, waiting until all of them are done
+ */
+static void
+parse_rules_files (RulesFileJob *jobs, guint n_jobs, guint n_parse)
+{
+  GThreadPool *pool = NULL;
+  g_autoptr (GError) err = NULL;
+  guint n;
+
+  if (n_parse > 1)
+    {
+      pool = g_thread_pool_new (
+          parse_rules_file_thread_func, NULL,
+          MIN (MIN ((guint)g_get_num_processors (), n_parse),
+               POLICY_LOADER_THREADS),
+          FALSE, &err);
+      if (!pool)
+        {
+          g_warning ("Error creating rules loader threads: %s",
+                     err->message);
+        }
+    }
+
+  for (n = 0; n < n_jobs; n++)
+    {
+      if (!jobs[n].parse)
+        {
+          continue;
+        }
+      if (pool)
+        {
+          g_thread_pool_push (pool, &jobs[n], NULL);
+        }
+      else
+        {
+          parse_rules_file (&jobs[n]);
+        }
+    }
+
+  if (pool)
+    {
+      g_thread_pool_free (pool, FALSE, TRUE);
+    }
+}
+
+/**
+ * Save every loaded file to the rules cache, so that the next startup can
+ * skip parsing those that are unchanged.
+ */
+static void
+write_rules_cache (PolicyLoader *loader)
+{
+  GArray *entries = NULL;
+  GHashTableIter iter;
+  const gchar *path = NULL;
+  LoadedRulesFile *loaded = NULL;
+  g_autoptr (GError) err = NULL;
+
+  if (!loader->rules_cache || !loader->write_cache)
+    {
+      return;
+    }
+
+  entries = g_array_new (FALSE, TRUE, sizeof (PolicyImageEntry));
+  g_hash_table_iter_init (&iter, loader->loaded_files);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&path,
+                                 (gpointer *)&loaded))
+    {
+      PolicyImageEntry entry = {
+        .path = (gchar *)path,
+        .stamp = loaded->stamp,
+        .file = loaded->file,
+      };
+
+      if (loaded->file->has_includes)
+        {
+          continue;
+        }
+      g_array_append_val (entries, entry);
+    }
+
+  if (!policy_image_write (loader->rules_cache,
+                           (PolicyImageEntry *)entries->data, entries->len,
+                           &err))
+    {
+      policy_loader_log (loader, "Error writing rules cache: %s",
+                         err->message);
+    }
+  g_array_unref (entries);
+}
+
+void
+policy_loader_read_cache (PolicyLoader *loader)
+{
+  GArray *entries = NULL;
+  guint n;
+  guint num_valid = 0;
+  g_autoptr (GError) err = NULL;
+
+  if (!loader->rules_cache)
+    {
+      return;
+    }
+
+  entries = policy_image_read (loader->rules_cache, &err);
+  if (!entries)
+    {
+      if (!g_error_matches (err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+          policy_loader_log (loader, "Ignoring rules cache: %s",
+                             err->message);
+        }
+      return;
+    }
+
+  for (n = 0; n < entries->len; n++)
+    {
+      PolicyImageEntry *entry
+          = &g_array_index (entries, PolicyImageEntry, n);
+      LoadedRulesFile *loaded = NULL;
+      PolicyFileStamp stamp;
+
+      if (!policy_file_stamp_new_from_path (entry->path, &stamp, NULL)
+          || memcmp (&stamp, &entry->stamp, sizeof (stamp)) != 0)
+        {
+          continue;
+        }
+
+      loaded = g_new0 (LoadedRulesFile, 1);
+      loaded->stamp = stamp;
+      loaded->file = g_steal_pointer (&entry->file);
+      g_hash_table_insert (loader->loaded_files,
+                           g_steal_pointer (&entry->path), loaded);
+      num_valid++;
+    }
+
+  policy_loader_log (loader, "Using %u of %u precompiled rules from %s",
+                     num_valid, entries->len, loader->rules_cache);
+  g_array_unref (entries);
+}
+
+/**
+ * Tell the administrator about every rule that can never answer a check,
+ * which is almost always a mistake in the rules files
+ */
+static void
+log_pruned_rules (PolicyLoader *loader, PolicyRuleset *ruleset)
+{
+  for (guint i = 0; ruleset->n_pruned > 0 && i < ruleset->rules->len; i++)
+    {
+      const PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, i);
+      const PolicyRulesetEntry *shadow = NULL;
+
+      switch (entry->status)
+        {
+        case POLICY_RULE_SHADOWED:
+          shadow = &g_array_index (ruleset->rules, PolicyRulesetEntry,
+                                   entry->shadowed_by);
+          policy_loader_log (
+              loader,
+              "Ignoring rule '%s' in %s, rule '%s' in %s always answers first",
+              policy_file_get_id (entry->file, entry->policy),
+              entry->file->path ? entry->file->path : "<unknown>",
+              policy_file_get_id (shadow->file, shadow->policy),
+              shadow->file->path ? shadow->file->path : "<unknown>");
+          break;
+        case POLICY_RULE_INERT:
+          policy_loader_log (
+              loader, "Ignoring rule '%s' in %s, it can never answer a check",
+              policy_file_get_id (entry->file, entry->policy),
+              entry->file->path ? entry->file->path : "<unknown>");
+          break;
+        default:
+          break;
+        }
+    }
+}
+
+/**
+ * Chain copies of the built-in files into @files, where they belong in load
+ * order, unless one of @files replaces them
+ */
+static PolicyFile *
+add_builtin_files (PolicyLoader *loader, PolicyFile *files)
+{
+  GList *paths = NULL;
+  PolicyFile **link = NULL;
+
+  if (!loader->builtin_files)
+    {
+      return files;
+    }
+
+  for (PolicyFile *file = files; file; file = file->next)
+    {
+      if (file->path && strchr (file->path, '/'))
+        {
+          paths = g_list_prepend (paths, g_strdup (file->path));
+        }
+    }
+  paths = add_builtin_paths (loader, paths);
+
+  for (GList *l = paths; l != NULL; l = l->next)
+    {
+      LoadedRulesFile *loaded
+          = g_hash_table_lookup (loader->builtin_files, l->data);
+      PolicyFile *file = NULL;
+
+      if (!loaded)
+        {
+          continue;
+        }
+
+      for (link = &files; *link; link = &(*link)->next)
+        {
+          if ((*link)->path && strchr ((*link)->path, '/')
+              && policy_file_path_cmp ((*link)->path, loaded->file->path) > 0)
+            {
+              break;
+            }
+        }
+      file = policy_file_copy (loaded->file);
+      file->next = *link;
+      *link = file;
+    }
+  g_list_free_full (paths, g_free);
+
+  return files;
+}
+
+/**
+ * Compile the rules from the bundle, or return NULL if it can't be used
+ * and the sources should be loaded instead
+ */
+static PolicyRuleset *
+compile_bundle (PolicyLoader *loader, gint64 started)
+{
+  PolicyLoaderProfile *profile = &loader->profile;
+  GBytes *key = NULL;
+  PolicyFile *files = NULL;
+  guint64 serial = 0;
+  guint num_files = 0;
+  PolicyRuleset *ret = NULL;
+  g_autoptr (GError) err = NULL;
+  gint64 start;
+
+  key = policy_bundle_read_key (loader->bundle_key, &err);
+  if (!key || !policy_bundle_read (loader->bundle, key, &files, &serial, &err))
+    {
+      policy_loader_log (loader, "Ignoring rules bundle %s: %s",
+                         loader->bundle, err->message);
+      if (key)
+        {
+          g_bytes_unref (key);
+        }
+      return NULL;
+    }
+  g_bytes_unref (key);
+
+  /* The signature only says who wrote the bundle, not that it's the latest
+   * one, so don't let an older one put back rules that were replaced */
+  if (serial < loader->bundle_serial)
+    {
+      policy_loader_log (loader,
+                         "Ignoring rules bundle %s: serial %" G_GUINT64_FORMAT
+                         " is older than %" G_GUINT64_FORMAT
+                         ", which was loaded before",
+                         loader->bundle, serial, loader->bundle_serial);
+      policy_file_free (files);
+      return NULL;
+    }
+  loader->bundle_serial = serial;
+
+  files = add_builtin_files (loader, files);
+
+  for (PolicyFile *file = files; file; file = file->next)
+    {
+      PolicyLoaderFileProfile file_profile = {
+        .path = g_strdup (file->path),
+        .n_rules = file->rules.n_normal,
+        .n_admin_rules = file->rules.n_admin,
+        .string_bytes = file->pool_size,
+      };
+
+      g_array_append_val (profile->files, file_profile);
+      num_files++;
+    }
+
+  start = g_get_monotonic_time ();
+  profile->scan_usec = start - started;
+  profile->parse_usec = 0;
+  ret = policy_ruleset_new (files);
+  profile->ruleset_usec = g_get_monotonic_time () - start;
+  log_pruned_rules (loader, ret);
+
+  profile->total_usec = g_get_monotonic_time () - started;
+  policy_loader_log (loader,
+                     "Finished loading %d rules from bundle %s (serial %"
+                     G_GUINT64_FORMAT ") in %.1f ms",
+                     num_files, loader->bundle, serial,
+                     profile->total_usec / 1000.0);
+  return ret;
+}
+
+PolicyRuleset *
+policy_loader_compile (PolicyLoader *loader)
+{
+  GList *files = NULL;
+  GList *l;
+  guint num_files = 0;
+  guint num_parsed = 0;
+  GError *error = NULL;
+  guint n;
+  PolicyFile *first = NULL;
+  PolicyFile *last = NULL;
+  PolicyRuleset *ret = NULL;
+  GHashTable *seen = NULL;
+  RulesFileJob *jobs = NULL;
+  guint n_jobs = 0;
+  PolicyLoaderProfile *profile = &loader->profile;
+  gint64 started = g_get_monotonic_time ();
+  gint64 start;
+
+  files = NULL;
+  g_array_set_size (profile->files, 0);
+
+  if (loader->bundle)
+    {
+      ret = compile_bundle (loader, started);
+      if (ret)
+        {
+          return ret;
+        }
+    }
+
+  for (n = 0; loader->rules_dirs != NULL && loader->rules_dirs[n] != NULL;
+       n++)
+    {
+      const gchar *dir_name = loader->rules_dirs[n];
+      GDir *dir = NULL;
+
+      policy_loader_log (loader, "Loading rules from directory %s", dir_name);
+
+      dir = g_dir_open (dir_name, 0, &error);
+      if (dir == NULL)
+        {
+          policy_loader_log (loader,
+                             "Error opening rules directory: %s (%s, %d)",
+                             error->message,
+                             g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+      else
+        {
+          const gchar *name;
+          while ((name = g_dir_read_name (dir)) != NULL)
+            {
+              if (g_str_has_suffix (name, ".keyrules"))
+                files = g_list_prepend (
+                    files, g_strdup_printf ("%s/%s", dir_name, name));
+            }
+          g_dir_close (dir);
+        }
+    }
+
+  files = add_builtin_paths (loader, files);
+  files = g_list_sort (files, (GCompareFunc)policy_file_path_cmp);
+
+  seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                (GDestroyNotify)loaded_rules_file_free);
+
+  jobs = g_new0 (RulesFileJob, g_list_length (files));
+  for (l = files, n_jobs = 0; l != NULL; l = l->next, n_jobs++)
+    {
+      jobs[n_jobs].filename = (gchar *)l->data;
+      if (loader->builtin_files)
+        {
+          jobs[n_jobs].loaded
+              = g_hash_table_lookup (loader->builtin_files, l->data);
+          if (jobs[n_jobs].loaded)
+            {
+              continue;
+            }
+        }
+      prepare_rules_file (loader, &jobs[n_jobs], seen);
+      if (jobs[n_jobs].parse)
+        {
+          num_parsed++;
+        }
+    }
+
+  start = g_get_monotonic_time ();
+  profile->scan_usec = start - started;
+  parse_rules_files (jobs, n_jobs, num_parsed);
+  profile->parse_usec = g_get_monotonic_time () - start;
+
+  /* Chain them up in load order, however they finished parsing */
+  for (n = 0; n < n_jobs; n++)
+    {
+      RulesFileJob *job = &jobs[n];
+      PolicyFile *file = NULL;
+      PolicyLoaderFileProfile file_profile = {
+        .path = g_strdup (job->filename),
+        .parsed = job->parse,
+        .failed = !job->loaded,
+        .times = job->times,
+      };
+
+      if (job->loaded)
+        {
+          file_profile.n_rules = job->loaded->file->rules.n_normal;
+          file_profile.n_admin_rules = job->loaded->file->rules.n_admin;
+          file_profile.string_bytes = job->loaded->file->pool_size;
+        }
+      g_array_append_val (profile->files, file_profile);
+
+      if (job->error)
+        {
+          policy_loader_log (loader, "Error compiling rules %s: %s",
+                             job->filename, job->error->message);
+          g_clear_error (&job->error);
+        }
+      if (!job->loaded)
+        {
+          continue;
+        }
+      if (job->parse)
+        {
+          g_hash_table_insert (seen, g_strdup (job->filename), job->loaded);
+        }
+
+      file = policy_file_copy (job->loaded->file);
+      if (last)
+        {
+          last->next = file;
+          last = file;
+        }
+      else
+        {
+          first = last = file;
+        }
+      num_files++;
+    }
+  g_free (jobs);
+
+  /* Anything we didn't come across this time has been deleted */
+  if (g_hash_table_size (loader->loaded_files) > 0)
+    {
+      num_parsed++;
+    }
+  g_hash_table_unref (loader->loaded_files);
+  loader->loaded_files = seen;
+
+  if (num_parsed > 0)
+    {
+      write_rules_cache (loader);
+    }
+
+  start = g_get_monotonic_time ();
+  ret = policy_ruleset_new (first);
+  profile->ruleset_usec = g_get_monotonic_time () - start;
+  log_pruned_rules (loader, ret);
+
+  profile->total_usec = g_get_monotonic_time () - started;
+  policy_loader_log (loader, "Finished loading %d rules (%d parsed) in %.1f ms",
+                     num_files, num_parsed, profile->total_usec / 1000.0);
+  g_list_free_full (files, g_free);
+
+  return ret;
+}
+
+const PolicyLoaderProfile *
+policy_loader_get_profile (PolicyLoader *loader)
+{
+  return &loader->profile;
+}
+
+void
+policy_loader_get_memory_usage (PolicyLoader *loader, guint64 *bytes,
+                                guint64 *objects)
+{
+  GHashTableIter iter;
+  LoadedRulesFile *loaded = NULL;
+
+  g_hash_table_iter_init (&iter, loader->loaded_files);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&loaded))
+    {
+      *bytes += sizeof (LoadedRulesFile)
+                + policy_file_get_memory_size (loaded->file);
+      (*objects)++;
+    }
+
+  if (!loader->builtin_files)
+    {
+      return;
+    }
+  g_hash_table_iter_init (&iter, loader->builtin_files);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&loaded))
+    {
+      *bytes += sizeof (LoadedRulesFile)
+                + policy_file_get_memory_size (loaded->file);
+      (*objects)++;
+    }
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_POLICY_LOADER_H
+#define __POLKIT_BACKEND_POLICY_LOADER_H
+
+#include <glib.h>
+
+#include "polkitbackendpolicyruleset.h"
+
+/**
+ * The default rules directories, searched in this order, and where they
+ * are precompiled to. Only polkitd writes the image.
+ */
+#define POLICY_LOADER_SYSCONF_RULES_DIR PACKAGE_SYSCONF_DIR "/polkit-1/rules.d"
+#define POLICY_LOADER_DATA_RULES_DIR PACKAGE_DATA_DIR "/polkit-1/rules.d"
+#define POLICY_LOADER_RULES_CACHE                                             \
+  PACKAGE_LOCALSTATE_DIR "/cache/polkit-1/keyrules.cache"
+
+/**
+ * Where the rules compiled into polkitd appear to come from, in messages
+ * and profiles
+ */
+#define POLICY_LOADER_BUILTIN_RULES_DIR "<built-in>"
+
+/**
+ * Called for everything worth telling the administrator while loading
+ */
+typedef void (*PolicyLoaderLogFunc) (const gchar *message,
+                                     gpointer user_data);
+
+/**
+ * PolicyLoader compiles the .keyrules files found in a list of directories
+ * into a PolicyRuleset. It keeps every file it parsed, along with enough
+ * about its source to tell whether it changed, so that a reload only
+ * parses what is new or modified. The parsed files may also be saved to a
+ * precompiled image, which the next loader of the same directories starts
+ * from.
+ *
+ * A loader is not safe to share between threads, but may be used from any
+ * one thread at a time.
+ */
+typedef struct PolicyLoader PolicyLoader;
+
+/**
+ * Create a new loader for @rules_dirs, in the order they are searched
+ * @rules_cache: Path to a precompiled image, or NULL
+ * @write_cache: Whether to save the image after changes, or only read it
+ * @log_func: Optional, where to send messages. Messages go to g_debug()
+ * without one
+ */
+PolicyLoader *policy_loader_new (const gchar *const *rules_dirs,
+                                 const gchar *rules_cache,
+                                 gboolean write_cache,
+                                 PolicyLoaderLogFunc log_func,
+                                 gpointer log_data);
+
+void policy_loader_free (PolicyLoader *loader);
+
+/**
+ * Seed the loader from the precompiled image, if there is one. Only files
+ * whose source is unchanged are taken from it.
+ */
+void policy_loader_read_cache (PolicyLoader *loader);
+
+/**
+ * Load the rules from a precompiled bundle instead of the rules
+ * directories, see polkitbackendpolicybundle.h. Every compile falls back to
+ * the directories while the bundle is missing, isn't signed with the key
+ * at @bundle_key, was written by another version or has a lower serial
+ * than a bundle this loader loaded before.
+ * @bundle: Path to the bundle, or NULL to stop using one
+ */
+void policy_loader_set_bundle (PolicyLoader *loader, const gchar *bundle,
+                               const gchar *bundle_key);
+
+/**
+ * Compile the files in the precompiled image at @data in with every ruleset,
+ * as if they were in the rules directories, except where a directory has a
+ * file of the same name, which replaces the built-in one. @data is copied
+ * from, and must be aligned to 8 bytes. An image that can't be read is
+ * logged and ignored.
+ */
+void policy_loader_set_builtin (PolicyLoader *loader, const gchar *data,
+                                gsize length);
+
+/**
+ * Parse whatever changed since the last call, and compile every file into
+ * a new ruleset. Never returns NULL; a loader without usable files
+ * compiles an empty ruleset.
+ */
+PolicyRuleset *policy_loader_compile (PolicyLoader *loader);
+
+/**
+ * What loading a single rules file cost, as recorded by the last compile
+ */
+typedef struct PolicyLoaderFileProfile
+{
+  gchar *path;
+  gboolean parsed; /**<FALSE when the file was unchanged and reused */
+  gboolean failed; /**<The file couldn't be read or has errors */
+  PolicyFileLoadProfile times; /**<All zero unless parsed */
+  guint n_rules;
+  guint n_admin_rules;
+  gsize string_bytes; /**<Size of the file's string pool */
+} PolicyLoaderFileProfile;
+
+/**
+ * What the last policy_loader_compile() cost, in microseconds. Files are
+ * parsed in parallel, so @parse_usec is the wall time for all of them and
+ * may be well below the sum of the per-file times.
+ */
+typedef struct PolicyLoaderProfile
+{
+  gint64 total_usec;   /**<The whole compile */
+  gint64 scan_usec;    /**<Listing the directories, telling what changed */
+  gint64 parse_usec;   /**<Parsing every new or modified file */
+  gint64 ruleset_usec; /**<Compiling the files into a ruleset */
+  GArray *files;       /**<PolicyLoaderFileProfile, in load order */
+} PolicyLoaderProfile;
+
+/**
+ * Return the profile of the last compile, owned by the loader and valid
+ * until the next one. Empty before the first compile.
+ */
+const PolicyLoaderProfile *policy_loader_get_profile (PolicyLoader *loader);
+
+/**
+ * Add the parsed and built-in files kept for the next compile to @bytes and
+ * @objects
+ */
+void policy_loader_get_memory_usage (PolicyLoader *loader, guint64 *bytes,
+                                     guint64 *objects);
+
+#endif /* __POLKIT_BACKEND_POLICY_LOADER_H */
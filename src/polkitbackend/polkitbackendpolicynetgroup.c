@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_NETGROUP_H
+#include <netgroup.h>
+#else
+#include <netdb.h>
+#endif
+#include <string.h>
+
+#include "polkitbackendpolicynetgroup.h"
+
+/**
+ * innetgr() isn't reentrant, so every call is serialised. This is a
+ * separate lock from the table so that hits are never held up by a slow
+ * NIS or LDAP lookup.
+ */
+G_LOCK_DEFINE_STATIC (policy_netgroup_nss);
+
+typedef struct PolicyNetgroupEntry
+{
+  gboolean member;
+  gint64 expires; /**<Monotonic time after which we must ask again */
+} PolicyNetgroupEntry;
+
+struct PolicyNetgroupCache
+{
+  GMutex lock;
+  GCond resolved;        /**<Broadcast whenever a lookup finishes */
+  GHashTable *entries;   /**<"netgroup\nuser" to PolicyNetgroupEntry */
+  GHashTable *resolving; /**<Keys being looked up right now */
+  guint generation;      /**<Bumped on clear, drops lookups in flight */
+  guint capacity;
+  gint64 ttl;
+  gint64 negative_ttl;
+};
+
+PolicyNetgroupCache *
+policy_netgroup_cache_new (guint capacity, gint64 ttl, gint64 negative_ttl)
+{
+  PolicyNetgroupCache *ret = NULL;
+
+  ret = g_new0 (PolicyNetgroupCache, 1);
+  g_mutex_init (&ret->lock);
+  g_cond_init (&ret->resolved);
+  ret->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        g_free);
+  ret->resolving = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                          NULL);
+  ret->capacity = MAX (capacity, 1);
+  ret->ttl = ttl;
+  ret->negative_ttl = negative_ttl;
+
+  return ret;
+}
+
+static gboolean
+policy_netgroup_entry_expired (gpointer key, gpointer value,
+                               gpointer user_data)
+{
+  const PolicyNetgroupEntry *entry = value;
+  const gint64 *now = user_data;
+
+  return *now >= entry->expires;
+}
+
+static gboolean
+policy_netgroup_lookup (const gchar *netgroup, const gchar *user)
+{
+  gboolean member;
+
+  G_LOCK (policy_netgroup_nss);
+  member = innetgr (netgroup, NULL, user, NULL) == 1;
+  G_UNLOCK (policy_netgroup_nss);
+
+  return member;
+}
+
+gboolean
+policy_netgroup_cache_contains (PolicyNetgroupCache *cache,
+                                const gchar *netgroup, const gchar *user)
+{
+  PolicyNetgroupEntry *entry = NULL;
+  gchar *key = NULL;
+  gboolean member;
+  guint generation;
+  gint64 now;
+
+  if (!user)
+    {
+      return FALSE;
+    }
+  if (!cache)
+    {
+      return policy_netgroup_lookup (netgroup, user);
+    }
+
+  /* Neither may contain a newline, so the key is unambiguous */
+  key = g_strconcat (netgroup, "\n", user, NULL);
+
+  g_mutex_lock (&cache->lock);
+  for (;;)
+    {
+      now = g_get_monotonic_time ();
+      entry = g_hash_table_lookup (cache->entries, key);
+      if (entry && now < entry->expires)
+        {
+          member = entry->member;
+          g_mutex_unlock (&cache->lock);
+          g_free (key);
+          return member;
+        }
+
+      if (!g_hash_table_contains (cache->resolving, key))
+        {
+          break;
+        }
+      /* Somebody is asking about it already, wait for their answer */
+      g_cond_wait (&cache->resolved, &cache->lock);
+    }
+  g_hash_table_add (cache->resolving, g_strdup (key));
+  generation = cache->generation;
+  g_mutex_unlock (&cache->lock);
+
+  member = policy_netgroup_lookup (netgroup, user);
+
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove (cache->resolving, key);
+  g_cond_broadcast (&cache->resolved);
+  /* The rules were reloaded meanwhile, so the answer may be outdated */
+  if (generation != cache->generation)
+    {
+      g_mutex_unlock (&cache->lock);
+      g_free (key);
+      return member;
+    }
+
+  now = g_get_monotonic_time ();
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (!entry && g_hash_table_size (cache->entries) >= cache->capacity)
+    {
+      g_hash_table_foreach_remove (cache->entries,
+                                   policy_netgroup_entry_expired, &now);
+      if (g_hash_table_size (cache->entries) >= cache->capacity)
+        {
+          g_hash_table_remove_all (cache->entries);
+        }
+    }
+
+  entry = g_new0 (PolicyNetgroupEntry, 1);
+  entry->member = member;
+  entry->expires = now + (member ? cache->ttl : cache->negative_ttl);
+  g_hash_table_replace (cache->entries, key, entry);
+  g_mutex_unlock (&cache->lock);
+
+  return member;
+}
+
+void
+policy_netgroup_cache_clear (PolicyNetgroupCache *cache)
+{
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove_all (cache->entries);
+  cache->generation++;
+  g_mutex_unlock (&cache->lock);
+}
+
+void
+policy_netgroup_cache_free (PolicyNetgroupCache *cache)
+{
+  if (!cache)
+    {
+      return;
+    }
+  g_clear_pointer (&cache->entries, g_hash_table_unref);
+  g_clear_pointer (&cache->resolving, g_hash_table_unref);
+  g_cond_clear (&cache->resolved);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_POLICY_NETGROUP_H
+#define __POLKIT_BACKEND_POLICY_NETGROUP_H
+
+#include <glib.h>
+
+/**
+ * PolicyNetgroupCache remembers the outcome of netgroup membership tests,
+ * as innetgr() against NIS or LDAP may take a network round trip each.
+ *
+ * Members are remembered for @ttl and non-members, which are by far the
+ * common case when testing a rule, for @negative_ttl. The cache is safe to
+ * share between threads.
+ */
+typedef struct PolicyNetgroupCache PolicyNetgroupCache;
+
+/**
+ * Create a new cache holding at most @capacity outcomes, with lifetimes in
+ * microseconds
+ */
+PolicyNetgroupCache *policy_netgroup_cache_new (guint capacity, gint64 ttl,
+                                                gint64 negative_ttl);
+
+/**
+ * Determine whether @user is a member of @netgroup. @cache may be NULL, in
+ * which case the lookup is always performed.
+ */
+gboolean policy_netgroup_cache_contains (PolicyNetgroupCache *cache,
+                                         const gchar *netgroup,
+                                         const gchar *user);
+
+/**
+ * Forget every outcome, i.e. because the rules were reloaded
+ */
+void policy_netgroup_cache_clear (PolicyNetgroupCache *cache);
+
+/**
+ * Free any resources associated with a PolicyNetgroupCache
+ */
+void policy_netgroup_cache_free (PolicyNetgroupCache *cache);
+
+#endif /* __POLKIT_BACKEND_POLICY_NETGROUP_H */
@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "polkitbackendpolicyprovider.h"
+
+/**
+ * A query lives on the stack of the thread that asked it. The I/O thread
+ * only ever touches it under the lock, while it is in pending or in_flight,
+ * and the asking thread takes it out of either before giving up on it.
+ */
+typedef struct PolicyProviderQuery
+{
+  guint64 id;
+  gchar *request; /**<A whole line, newline included */
+  gboolean done;
+  gboolean answered;
+  PolkitImplicitAuthorization result;
+} PolicyProviderQuery;
+
+struct PolicyProvider
+{
+  gchar *socket_path;
+  gint64 timeout;
+  gint64 retry_delay;
+
+  GMutex lock;
+  GCond work_cond;       /**<Signalled for the I/O thread */
+  GCond answer_cond;     /**<Broadcast whenever queries are done */
+  GQueue pending;        /**<Queries waiting for the next batch */
+  GHashTable *in_flight; /**<Queries of the batch out, by id */
+  guint64 next_id;
+  gint64 down_until; /**<Queries fail right away until then */
+  gboolean quit;
+  PolicyProviderStats stats;
+
+  /* Only used by the I/O thread */
+  GThread *thread;
+  gint fd;
+  GString *input; /**<Received, not yet complete lines */
+};
+
+static gint
+policy_provider_poll_timeout (gint64 deadline)
+{
+  gint64 remaining = deadline - g_get_monotonic_time ();
+
+  if (remaining <= 0)
+    {
+      return 0;
+    }
+  return (gint)MIN ((remaining + 999) / 1000, G_MAXINT);
+}
+
+static gboolean
+policy_provider_connect (PolicyProvider *provider)
+{
+  struct sockaddr_un addr = { 0 };
+  gint fd;
+
+  if (strlen (provider->socket_path) >= sizeof (addr.sun_path))
+    {
+      return FALSE;
+    }
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, provider->socket_path);
+
+  fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    {
+      return FALSE;
+    }
+  if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) != 0)
+    {
+      close (fd);
+      return FALSE;
+    }
+
+  provider->fd = fd;
+  g_string_truncate (provider->input, 0);
+  return TRUE;
+}
+
+static void
+policy_provider_disconnect (PolicyProvider *provider)
+{
+  if (provider->fd >= 0)
+    {
+      close (provider->fd);
+      provider->fd = -1;
+    }
+  g_string_truncate (provider->input, 0);
+}
+
+static gboolean
+policy_provider_send (PolicyProvider *provider, const GString *batch,
+                      gint64 deadline)
+{
+  gsize written = 0;
+
+  while (written < batch->len)
+    {
+      struct pollfd pfd = { .fd = provider->fd, .events = POLLOUT };
+      gssize n;
+
+      if (poll (&pfd, 1, policy_provider_poll_timeout (deadline)) <= 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          return FALSE;
+        }
+      n = send (provider->fd, batch->str + written, batch->len - written,
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (n < 0)
+        {
+          if (errno == EINTR || errno == EAGAIN)
+            {
+              continue;
+            }
+          return FALSE;
+        }
+      written += (gsize)n;
+    }
+
+  return TRUE;
+}
+
+/**
+ * Hand the answer on @line to whoever asked for it, returning FALSE if the
+ * line makes no sense. Answers nobody waits for anymore are dropped.
+ */
+static gboolean
+policy_provider_handle_line (PolicyProvider *provider, const gchar *line)
+{
+  PolicyProviderQuery *query = NULL;
+  PolkitImplicitAuthorization result = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  gchar *end = NULL;
+  guint64 id;
+
+  id = g_ascii_strtoull (line, &end, 10);
+  if (end == line || *end != ' ')
+    {
+      return FALSE;
+    }
+  end++;
+  if (!g_str_equal (end, "-")
+      && !polkit_implicit_authorization_from_string (end, &result))
+    {
+      return FALSE;
+    }
+
+  g_mutex_lock (&provider->lock);
+  query = g_hash_table_lookup (provider->in_flight, &id);
+  if (query)
+    {
+      query->done = TRUE;
+      query->answered = TRUE;
+      query->result = result;
+      g_hash_table_remove (provider->in_flight, &id);
+      g_cond_broadcast (&provider->answer_cond);
+    }
+  g_mutex_unlock (&provider->lock);
+
+  return TRUE;
+}
+
+/**
+ * Read answers until every query of the batch out has one, or @deadline
+ */
+static gboolean
+policy_provider_receive (PolicyProvider *provider, gint64 deadline)
+{
+  for (;;)
+    {
+      struct pollfd pfd = { .fd = provider->fd, .events = POLLIN };
+      gchar buffer[4096];
+      gchar *newline = NULL;
+      gsize start = 0;
+      gboolean waiting;
+      gssize n;
+
+      g_mutex_lock (&provider->lock);
+      waiting = g_hash_table_size (provider->in_flight) > 0;
+      g_mutex_unlock (&provider->lock);
+      if (!waiting)
+        {
+          return TRUE;
+        }
+
+      if (poll (&pfd, 1, policy_provider_poll_timeout (deadline)) <= 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          return FALSE;
+        }
+      n = recv (provider->fd, buffer, sizeof (buffer), MSG_DONTWAIT);
+      if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        {
+          continue;
+        }
+      if (n <= 0)
+        {
+          return FALSE;
+        }
+      g_string_append_len (provider->input, buffer, n);
+
+      while ((newline = memchr (provider->input->str + start, '\n',
+                                provider->input->len - start)))
+        {
+          *newline = '\0';
+          if (!policy_provider_handle_line (provider,
+                                            provider->input->str + start))
+            {
+              return FALSE;
+            }
+          start = (gsize)(newline - provider->input->str) + 1;
+        }
+      g_string_erase (provider->input, 0, start);
+    }
+}
+
+/**
+ * Fail every query of the batch out, and any later ones until the retry
+ * delay is over. Called with the lock held.
+ */
+static void
+policy_provider_fail_locked (PolicyProvider *provider)
+{
+  GHashTableIter iter;
+  PolicyProviderQuery *query = NULL;
+
+  g_hash_table_iter_init (&iter, provider->in_flight);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&query))
+    {
+      query->done = TRUE;
+    }
+  g_hash_table_remove_all (provider->in_flight);
+  provider->down_until = g_get_monotonic_time () + provider->retry_delay;
+  g_cond_broadcast (&provider->answer_cond);
+}
+
+static gpointer
+policy_provider_thread_func (gpointer user_data)
+{
+  PolicyProvider *provider = user_data;
+  GString *batch = g_string_new (NULL);
+
+  g_mutex_lock (&provider->lock);
+  while (!provider->quit)
+    {
+      gint64 deadline;
+      gboolean ok;
+
+      if (g_queue_is_empty (&provider->pending))
+        {
+          g_cond_wait (&provider->work_cond, &provider->lock);
+          continue;
+        }
+
+      /* Whatever queued up while the last batch was out goes in this one */
+      g_string_truncate (batch, 0);
+      while (!g_queue_is_empty (&provider->pending))
+        {
+          PolicyProviderQuery *query = g_queue_pop_head (&provider->pending);
+
+          g_string_append (batch, query->request);
+          g_hash_table_insert (provider->in_flight, &query->id, query);
+        }
+      provider->stats.queries += g_hash_table_size (provider->in_flight);
+      provider->stats.batches++;
+      g_mutex_unlock (&provider->lock);
+
+      deadline = g_get_monotonic_time () + provider->timeout;
+      ok = (provider->fd >= 0 || policy_provider_connect (provider))
+           && policy_provider_send (provider, batch, deadline)
+           && policy_provider_receive (provider, deadline);
+
+      g_mutex_lock (&provider->lock);
+      if (!ok)
+        {
+          policy_provider_disconnect (provider);
+          policy_provider_fail_locked (provider);
+        }
+    }
+
+  /* Nobody is going to send these anymore */
+  while (!g_queue_is_empty (&provider->pending))
+    {
+      PolicyProviderQuery *query = g_queue_pop_head (&provider->pending);
+
+      query->done = TRUE;
+    }
+  g_cond_broadcast (&provider->answer_cond);
+  g_mutex_unlock (&provider->lock);
+
+  policy_provider_disconnect (provider);
+  g_string_free (batch, TRUE);
+  return NULL;
+}
+
+PolicyProvider *
+policy_provider_new (const gchar *socket_path, gint64 timeout,
+                     gint64 retry_delay)
+{
+  PolicyProvider *provider = NULL;
+
+  g_return_val_if_fail (socket_path != NULL, NULL);
+
+  provider = g_new0 (PolicyProvider, 1);
+  provider->socket_path = g_strdup (socket_path);
+  provider->timeout = timeout;
+  provider->retry_delay = retry_delay;
+  provider->fd = -1;
+  provider->input = g_string_new (NULL);
+  provider->in_flight = g_hash_table_new (g_int64_hash, g_int64_equal);
+  g_mutex_init (&provider->lock);
+  g_cond_init (&provider->work_cond);
+  g_cond_init (&provider->answer_cond);
+  g_queue_init (&provider->pending);
+  provider->thread = g_thread_new ("polkit provider",
+                                   policy_provider_thread_func, provider);
+
+  return provider;
+}
+
+gboolean
+policy_provider_query (PolicyProvider *provider, const PolicyCacheKey *key,
+                       PolkitImplicitAuthorization *out_result)
+{
+  PolicyProviderQuery query = { 0 };
+  gboolean ret = FALSE;
+  gint64 deadline;
+
+  g_mutex_lock (&provider->lock);
+  if (provider->quit || g_get_monotonic_time () < provider->down_until)
+    {
+      provider->stats.failures++;
+      g_mutex_unlock (&provider->lock);
+      return FALSE;
+    }
+
+  query.id = ++provider->next_id;
+  query.request = g_strdup_printf (
+      "%" G_GUINT64_FORMAT " %u %s %d %d %s %s %s\n", query.id,
+      (guint)key->uid, key->action_id, key->subject_is_local ? 1 : 0,
+      key->subject_is_active ? 1 : 0, key->seat ? key->seat : "-",
+      key->session_class ? key->session_class : "-",
+      key->session_type ? key->session_type : "-");
+  deadline = g_get_monotonic_time () + provider->timeout;
+  g_queue_push_tail (&provider->pending, &query);
+  g_cond_signal (&provider->work_cond);
+
+  while (!query.done)
+    {
+      if (!g_cond_wait_until (&provider->answer_cond, &provider->lock,
+                              deadline))
+        {
+          break;
+        }
+    }
+
+  if (!query.done)
+    {
+      /* Taken out of whichever still has it, nothing may touch it after */
+      if (!g_queue_remove (&provider->pending, &query))
+        {
+          g_hash_table_remove (provider->in_flight, &query.id);
+        }
+      /* Without waiting on the I/O thread to notice, lest the next check
+       * queue up behind the batch that is too slow */
+      provider->down_until = g_get_monotonic_time () + provider->retry_delay;
+      provider->stats.timeouts++;
+    }
+  else if (query.answered)
+    {
+      *out_result = query.result;
+      provider->stats.answered++;
+      ret = TRUE;
+    }
+  else
+    {
+      provider->stats.failures++;
+    }
+  g_mutex_unlock (&provider->lock);
+
+  g_free (query.request);
+  return ret;
+}
+
+void
+policy_provider_get_stats (PolicyProvider *provider,
+                           PolicyProviderStats *out_stats)
+{
+  g_mutex_lock (&provider->lock);
+  *out_stats = provider->stats;
+  g_mutex_unlock (&provider->lock);
+}
+
+void
+policy_provider_free (PolicyProvider *provider)
+{
+  if (!provider)
+    {
+      return;
+    }
+
+  g_mutex_lock (&provider->lock);
+  provider->quit = TRUE;
+  g_cond_signal (&provider->work_cond);
+  g_mutex_unlock (&provider->lock);
+  g_thread_join (provider->thread);
+
+  g_hash_table_unref (provider->in_flight);
+  g_string_free (provider->input, TRUE);
+  g_mutex_clear (&provider->lock);
+  g_cond_clear (&provider->work_cond);
+  g_cond_clear (&provider->answer_cond);
+  g_free (provider->socket_path);
+  g_free (provider);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_POLICY_PROVIDER_H
+#define __POLKIT_BACKEND_POLICY_PROVIDER_H
+
+#include <glib.h>
+
+#include "polkitbackendpolicycache.h"
+
+/**
+ * PolicyProvider asks a decision service listening on a Unix socket about
+ * checks, before the local rules are. Every query carries exactly the
+ * inputs of a PolicyCacheKey, so that answers can be cached like those of
+ * the rules.
+ *
+ * The protocol is line based. polkitd sends
+ *
+ *   ID UID ACTION LOCAL ACTIVE SEAT CLASS TYPE
+ *
+ * with LOCAL and ACTIVE as 0 or 1, and a "-" for whatever isn't known, and
+ * the service answers each with
+ *
+ *   ID RESULT
+ *
+ * in any order, where RESULT is one of "no", "auth_self", "auth_admin",
+ * "auth_self_keep", "auth_admin_keep", "yes", or "-" to leave the check to
+ * the local rules.
+ *
+ * A single thread talks to the service, and queries made while a batch is
+ * waiting for its answers go out together in the next one. A query that
+ * isn't answered within the timeout fails; so does every query for a while
+ * after the service was unreachable, too slow or spoke nonsense, so that
+ * checks don't each wait out the timeout on a provider that is down.
+ */
+typedef struct PolicyProvider PolicyProvider;
+
+/**
+ * PolicyProviderStats are running counters, suited to scraping
+ */
+typedef struct PolicyProviderStats
+{
+  guint64 queries;  /**<Queries sent to the provider */
+  guint64 batches;  /**<Writes to the provider, each with one or more queries */
+  guint64 answered; /**<Queries the provider answered in time */
+  guint64 timeouts; /**<Queries the provider didn't answer in time */
+  guint64 failures; /**<Queries failed as the provider was unusable */
+} PolicyProviderStats;
+
+/**
+ * Create a new provider for the service listening at @socket_path, which
+ * is only connected to once it is first queried
+ * @timeout: Microseconds a query waits for its answer
+ * @retry_delay: Microseconds to fail queries for after the service failed
+ */
+PolicyProvider *policy_provider_new (const gchar *socket_path, gint64 timeout,
+                                     gint64 retry_delay);
+
+/**
+ * Ask the provider about @key, blocking for at most the timeout. Returns
+ * FALSE if it didn't answer, otherwise @out_result is what it answered,
+ * which is POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN when it left the check to
+ * the rules.
+ */
+gboolean policy_provider_query (PolicyProvider *provider,
+                                const PolicyCacheKey *key,
+                                PolkitImplicitAuthorization *out_result);
+
+/**
+ * Copy the running counters of @provider to @out_stats
+ */
+void policy_provider_get_stats (PolicyProvider *provider,
+                                PolicyProviderStats *out_stats);
+
+/**
+ * Fail the queries in progress, disconnect and free @provider
+ */
+void policy_provider_free (PolicyProvider *provider);
+
+#endif /* __POLKIT_BACKEND_POLICY_PROVIDER_H */
@@ -0,0 +1,1438 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+#include <polkit/polkit.h>
+#include <string.h>
+
+#include "polkitbackendpolicyruleset.h"
+
+/**
+ * Append the priority to the candidate list, unless it is already the most
+ * recent entry. Rules are indexed in priority order, so this is enough to
+ * ignore the same action being listed twice within one rule.
+ */
+static void
+policy_ruleset_list_append (GArray *list, guint priority)
+{
+  if (list->len > 0 && g_array_index (list, guint, list->len - 1) == priority)
+    {
+      return;
+    }
+  g_array_append_val (list, priority);
+}
+
+static GArray *
+policy_ruleset_list_new (void)
+{
+  return g_array_new (FALSE, FALSE, sizeof (guint));
+}
+
+static gint
+policy_ruleset_priority_cmp (gconstpointer a, gconstpointer b)
+{
+  guint pa = *(const guint *)a;
+  guint pb = *(const guint *)b;
+
+  return pa < pb ? -1 : (pa > pb ? 1 : 0);
+}
+
+/**
+ * Sort the list and drop any repeated priorities
+ */
+static void
+policy_ruleset_list_normalise (GArray *list)
+{
+  guint out = 0;
+
+  if (list->len < 2)
+    {
+      return;
+    }
+
+  g_array_sort (list, policy_ruleset_priority_cmp);
+  for (guint i = 1; i < list->len; i++)
+    {
+      if (g_array_index (list, guint, i) != g_array_index (list, guint, out))
+        {
+          g_array_index (list, guint, ++out) = g_array_index (list, guint, i);
+        }
+    }
+  g_array_set_size (list, out + 1);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * A single ActionContains= pattern, pending compilation into the matcher
+ */
+typedef struct PolicyContainsPattern
+{
+  const gchar *pattern; /**<Owned by the PolicyFile pool */
+  guint priority;
+} PolicyContainsPattern;
+
+#define POLICY_MATCHER_NO_STATE G_MAXUINT
+
+static void
+policy_contains_matcher_free (PolicyContainsMatcher *matcher)
+{
+  if (!matcher)
+    {
+      return;
+    }
+  g_free (matcher->transitions);
+  g_free (matcher->hit_offsets);
+  g_free (matcher->hits);
+  g_free (matcher);
+}
+
+/**
+ * Build the automaton for the given (non-empty) patterns.
+ *
+ * We first reduce the input alphabet to the bytes actually used by the
+ * patterns, then build the trie and finally fill in the failure
+ * transitions breadth first, to end up with a complete DFA where each
+ * state knows every rule priority it reports.
+ */
+static PolicyContainsMatcher *
+policy_contains_matcher_new (GArray *patterns)
+{
+  PolicyContainsMatcher *matcher = NULL;
+  GArray *transitions = NULL;
+  GPtrArray *outputs = NULL;
+  g_autofree guint *fail = NULL;
+  g_autofree guint *queue = NULL;
+  guint head = 0;
+  guint tail = 0;
+  guint n_hits = 0;
+  guint none = POLICY_MATCHER_NO_STATE;
+
+  matcher = g_new0 (PolicyContainsMatcher, 1);
+
+  /* Class 0 is reserved for bytes that appear in no pattern at all */
+  matcher->n_classes = 1;
+  for (guint i = 0; i < patterns->len; i++)
+    {
+      const PolicyContainsPattern *p
+          = &g_array_index (patterns, PolicyContainsPattern, i);
+      for (const guchar *c = (const guchar *)p->pattern; *c; c++)
+        {
+          if (matcher->classes[*c] == 0)
+            {
+              matcher->classes[*c] = matcher->n_classes++;
+            }
+        }
+    }
+
+  transitions = g_array_new (FALSE, FALSE, sizeof (guint));
+  outputs = g_ptr_array_new_with_free_func ((GDestroyNotify)g_array_unref);
+
+  /* Root state */
+  for (guint c = 0; c < matcher->n_classes; c++)
+    {
+      g_array_append_val (transitions, none);
+    }
+  g_ptr_array_add (outputs, policy_ruleset_list_new ());
+  matcher->n_states = 1;
+
+  /* Plain trie of every pattern */
+  for (guint i = 0; i < patterns->len; i++)
+    {
+      const PolicyContainsPattern *p
+          = &g_array_index (patterns, PolicyContainsPattern, i);
+      guint state = 0;
+
+      for (const guchar *c = (const guchar *)p->pattern; *c; c++)
+        {
+          guint idx = state * matcher->n_classes + matcher->classes[*c];
+          guint next = g_array_index (transitions, guint, idx);
+
+          if (next == POLICY_MATCHER_NO_STATE)
+            {
+              next = matcher->n_states++;
+              g_array_index (transitions, guint, idx) = next;
+              for (guint j = 0; j < matcher->n_classes; j++)
+                {
+                  g_array_append_val (transitions, none);
+                }
+              g_ptr_array_add (outputs, policy_ruleset_list_new ());
+            }
+          state = next;
+        }
+      g_array_append_val (g_ptr_array_index (outputs, state), p->priority);
+    }
+
+  /* Breadth first failure links, completing the DFA as we go */
+  fail = g_new0 (guint, matcher->n_states);
+  queue = g_new0 (guint, matcher->n_states);
+
+  for (guint c = 0; c < matcher->n_classes; c++)
+    {
+      guint *next = &g_array_index (transitions, guint, c);
+      if (*next == POLICY_MATCHER_NO_STATE)
+        {
+          *next = 0;
+        }
+      else
+        {
+          fail[*next] = 0;
+          queue[tail++] = *next;
+        }
+    }
+
+  while (head < tail)
+    {
+      guint state = queue[head++];
+      GArray *out = g_ptr_array_index (outputs, state);
+      GArray *fail_out = g_ptr_array_index (outputs, fail[state]);
+
+      /* Report everything our longest proper suffix reports */
+      g_array_append_vals (out, fail_out->data, fail_out->len);
+      policy_ruleset_list_normalise (out);
+
+      for (guint c = 0; c < matcher->n_classes; c++)
+        {
+          guint *next = &g_array_index (transitions, guint,
+                                        state * matcher->n_classes + c);
+          guint fallback = g_array_index (
+              transitions, guint, fail[state] * matcher->n_classes + c);
+
+          if (*next == POLICY_MATCHER_NO_STATE)
+            {
+              *next = fallback;
+            }
+          else
+            {
+              fail[*next] = fallback;
+              queue[tail++] = *next;
+            }
+        }
+    }
+
+  /* Flatten the per-state outputs */
+  matcher->hit_offsets = g_new0 (guint, matcher->n_states + 1);
+  for (guint i = 0; i < matcher->n_states; i++)
+    {
+      GArray *out = g_ptr_array_index (outputs, i);
+      matcher->hit_offsets[i] = n_hits;
+      n_hits += out->len;
+    }
+  matcher->hit_offsets[matcher->n_states] = n_hits;
+  matcher->hits = g_new0 (guint, MAX (n_hits, 1));
+  for (guint i = 0; i < matcher->n_states; i++)
+    {
+      GArray *out = g_ptr_array_index (outputs, i);
+      memcpy (matcher->hits + matcher->hit_offsets[i], out->data,
+              out->len * sizeof (guint));
+    }
+
+  matcher->transitions = (guint *)g_array_free (transitions, FALSE);
+  g_ptr_array_unref (outputs);
+
+  return matcher;
+}
+
+/**
+ * Run the action ID through the automaton once, appending the priorities
+ * of every rule with an ActionContains= hit to @hits
+ */
+static void
+policy_contains_matcher_scan (PolicyContainsMatcher *matcher,
+                              const gchar *action_id, GArray *hits)
+{
+  guint state = 0;
+
+  for (const guchar *c = (const guchar *)action_id; *c; c++)
+    {
+      guint start;
+      guint end;
+
+      state = matcher->transitions[state * matcher->n_classes
+                                   + matcher->classes[*c]];
+      start = matcher->hit_offsets[state];
+      end = matcher->hit_offsets[state + 1];
+      if (start != end)
+        {
+          g_array_append_vals (hits, matcher->hits + start, end - start);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Action IDs up to this long are split into components without allocating */
+#define POLICY_PREFIX_STACK_SIZE 256
+
+static void
+policy_prefix_node_free (PolicyPrefixNode *node)
+{
+  if (!node)
+    {
+      return;
+    }
+  g_clear_pointer (&node->children, g_hash_table_unref);
+  g_clear_pointer (&node->hits, g_array_unref);
+  g_free (node);
+}
+
+/**
+ * Add a prefix pattern (with the trailing POLICY_MATCH_PREFIX) to the trie,
+ * creating a node for every component on the way
+ */
+static void
+policy_prefix_trie_insert (PolicyPrefixNode *root, const gchar *pattern,
+                           guint priority)
+{
+  g_autofree gchar *prefix = NULL;
+  PolicyPrefixNode *node = root;
+  gchar *segment = NULL;
+
+  prefix = g_strndup (pattern, strlen (pattern) - strlen (POLICY_MATCH_PREFIX));
+  segment = prefix;
+
+  for (;;)
+    {
+      gchar *dot = strchr (segment, '.');
+      PolicyPrefixNode *child = NULL;
+
+      if (dot)
+        {
+          *dot = '\0';
+        }
+      if (!node->children)
+        {
+          node->children = g_hash_table_new_full (
+              g_str_hash, g_str_equal, g_free,
+              (GDestroyNotify)policy_prefix_node_free);
+        }
+      child = g_hash_table_lookup (node->children, segment);
+      if (!child)
+        {
+          child = g_new0 (PolicyPrefixNode, 1);
+          g_hash_table_insert (node->children, g_strdup (segment), child);
+        }
+      node = child;
+
+      if (!dot)
+        {
+          break;
+        }
+      segment = dot + 1;
+    }
+
+  if (!node->hits)
+    {
+      node->hits = policy_ruleset_list_new ();
+    }
+  policy_ruleset_list_append (node->hits, priority);
+}
+
+/**
+ * Walk the components of the action ID down the trie, appending the
+ * priorities of every rule with a prefix pattern that matches to @hits.
+ * A prefix only matches if at least one more character follows it, so the
+ * final component can never end one.
+ */
+static void
+policy_prefix_trie_scan (PolicyPrefixNode *root, const gchar *action_id,
+                         GArray *hits)
+{
+  gchar stack[POLICY_PREFIX_STACK_SIZE];
+  g_autofree gchar *heap = NULL;
+  PolicyPrefixNode *node = root;
+  gsize len = strlen (action_id);
+  gchar *segment = NULL;
+
+  if (len < sizeof (stack))
+    {
+      segment = memcpy (stack, action_id, len + 1);
+    }
+  else
+    {
+      segment = heap = g_strdup (action_id);
+    }
+
+  for (;;)
+    {
+      gchar *dot = strchr (segment, '.');
+
+      if (!dot || !node->children)
+        {
+          break;
+        }
+      *dot = '\0';
+      node = g_hash_table_lookup (node->children, segment);
+      if (!node)
+        {
+          break;
+        }
+      if (node->hits && dot[1] != '\0')
+        {
+          g_array_append_vals (hits, node->hits->data, node->hits->len);
+        }
+      segment = dot + 1;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * Index a single normal rule under every action ID it could match
+ */
+static void
+policy_ruleset_index (PolicyRuleset *ruleset, const PolicyFile *file,
+                      const Policy *policy, guint priority, GArray *patterns)
+{
+  if ((policy->constraints & PF_CONSTRAINT_ACTIONS) == PF_CONSTRAINT_ACTIONS)
+    {
+      for (guint i = 0; i < policy->actions.n; i++)
+        {
+          const gchar *action
+              = policy_file_get_string (file, policy->actions, i);
+          GArray *list = NULL;
+
+          if (g_str_equal (action, POLICY_MATCH_ALL))
+            {
+              policy_ruleset_list_append (ruleset->wildcard, priority);
+              continue;
+            }
+          if (policy_action_is_prefix (action))
+            {
+              if (!ruleset->prefixes)
+                {
+                  ruleset->prefixes = g_new0 (PolicyPrefixNode, 1);
+                }
+              policy_prefix_trie_insert (ruleset->prefixes, action, priority);
+              continue;
+            }
+
+          list = g_hash_table_lookup (ruleset->exact, action);
+          if (!list)
+            {
+              list = policy_ruleset_list_new ();
+              /* Key is owned by the file pool, which outlives the table */
+              g_hash_table_insert (ruleset->exact, (gpointer)action, list);
+            }
+          policy_ruleset_list_append (list, priority);
+        }
+    }
+
+  if ((policy->constraints & PF_CONSTRAINT_ACTION_CONTAINS)
+      == PF_CONSTRAINT_ACTION_CONTAINS)
+    {
+      for (guint i = 0; i < policy->action_contains.n; i++)
+        {
+          PolicyContainsPattern p = {
+            .pattern
+            = policy_file_get_string (file, policy->action_contains, i),
+            .priority = priority,
+          };
+
+          /* An empty substring is contained in every action ID */
+          if (*p.pattern == '\0')
+            {
+              policy_ruleset_list_append (ruleset->wildcard, priority);
+              continue;
+            }
+          g_array_append_val (patterns, p);
+        }
+    }
+}
+
+#define POLICY_GROUP_WORD_BITS 64
+
+/**
+ * Resolve every InUnixGroups= name to a gid and intern those into atoms,
+ * then give each rule with the constraint a bitset of the atoms it accepts.
+ * Names that don't resolve can never match and are left out of the bitset.
+ */
+static void
+policy_ruleset_compile_groups (PolicyRuleset *ruleset)
+{
+  g_autoptr (GArray) atoms = NULL;
+  g_autoptr (GArray) spans = NULL;
+  guint n_masks = 0;
+  guint n_atoms = 0;
+
+  /* Per rule, the range of resolved atoms it accepts, or G_MAXUINT */
+  atoms = g_array_new (FALSE, FALSE, sizeof (guint));
+  spans = g_array_new (FALSE, FALSE, sizeof (PolicyStrings));
+
+  for (guint i = 0; i < ruleset->rules->len; i++)
+    {
+      const PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, i);
+      const Policy *policy = entry->policy;
+      PolicyStrings span = { .start = G_MAXUINT, .n = 0 };
+
+      if ((policy->constraints & PF_CONSTRAINT_UNIX_GROUPS)
+          == PF_CONSTRAINT_UNIX_GROUPS)
+        {
+          span.start = atoms->len;
+          for (guint j = 0; j < policy->unix_groups.n; j++)
+            {
+              const gchar *group = policy_file_get_string (
+                  entry->file, policy->unix_groups, j);
+              gpointer existing = NULL;
+              guint atom;
+              gid_t gid;
+
+              if (!policy_resolve_group (group, &gid))
+                {
+                  g_message ("Unknown group '%s' in rule '%s', ignoring",
+                             group, policy_file_get_id (entry->file, policy));
+                  continue;
+                }
+
+              existing = g_hash_table_lookup (ruleset->group_atoms,
+                                              GUINT_TO_POINTER (gid));
+              if (existing)
+                {
+                  atom = GPOINTER_TO_UINT (existing) - 1;
+                }
+              else
+                {
+                  atom = n_atoms++;
+                  g_hash_table_insert (ruleset->group_atoms,
+                                       GUINT_TO_POINTER (gid),
+                                       GUINT_TO_POINTER (atom + 1));
+                }
+              g_array_append_val (atoms, atom);
+            }
+          span.n = atoms->len - span.start;
+          n_masks++;
+        }
+      g_array_append_val (spans, span);
+    }
+
+  if (n_masks == 0)
+    {
+      return;
+    }
+
+  ruleset->n_group_words
+      = MAX (1, (n_atoms + POLICY_GROUP_WORD_BITS - 1) / POLICY_GROUP_WORD_BITS);
+  ruleset->group_masks = g_new0 (guint64, n_masks * ruleset->n_group_words);
+  n_masks = 0;
+
+  for (guint i = 0; i < ruleset->rules->len; i++)
+    {
+      PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, i);
+      const PolicyStrings *span = &g_array_index (spans, PolicyStrings, i);
+      guint64 *bits = NULL;
+
+      if (span->start == G_MAXUINT)
+        {
+          continue;
+        }
+
+      bits = ruleset->group_masks + (n_masks++ * ruleset->n_group_words);
+      for (guint j = 0; j < span->n; j++)
+        {
+          guint atom = g_array_index (atoms, guint, span->start + j);
+
+          bits[atom / POLICY_GROUP_WORD_BITS]
+              |= G_GUINT64_CONSTANT (1) << (atom % POLICY_GROUP_WORD_BITS);
+        }
+      entry->groups = bits;
+    }
+}
+
+/**
+ * Turn the exact InDetailValues= of every live rule into a set, so that a
+ * rule allowing hundreds of values tests one as quickly as a single one
+ */
+static void
+policy_ruleset_compile_details (PolicyRuleset *ruleset)
+{
+  for (guint i = 0; i < ruleset->rules->len; i++)
+    {
+      PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, i);
+      const Policy *policy = entry->policy;
+
+      if (entry->status != POLICY_RULE_LIVE
+          || (policy->constraints & PF_CONSTRAINT_DETAILS)
+                 != PF_CONSTRAINT_DETAILS)
+        {
+          continue;
+        }
+
+      /* Values are owned by the file pool, which outlives the set */
+      entry->detail_values = g_hash_table_new (g_str_hash, g_str_equal);
+      for (guint j = 0; j < policy->detail_values.n; j++)
+        {
+          const gchar *value
+              = policy_file_get_string (entry->file, policy->detail_values, j);
+
+          if (!policy_detail_is_prefix (value))
+            {
+              g_hash_table_add (entry->detail_values, (gpointer)value);
+            }
+        }
+    }
+}
+
+/**
+ * Map the subject's gids onto the ruleset's atoms, setting them in @bits.
+ * Groups that no rule cares about are simply dropped.
+ */
+static void
+policy_ruleset_subject_groups (PolicyRuleset *ruleset, PolicyContext *context,
+                               guint64 *bits)
+{
+  GArray *gids = policy_context_get_gids (context);
+
+  for (guint i = 0; gids && i < gids->len; i++)
+    {
+      gid_t gid = g_array_index (gids, gid_t, i);
+      gpointer atom
+          = g_hash_table_lookup (ruleset->group_atoms, GUINT_TO_POINTER (gid));
+
+      if (atom)
+        {
+          guint n = GPOINTER_TO_UINT (atom) - 1;
+          bits[n / POLICY_GROUP_WORD_BITS]
+              |= G_GUINT64_CONSTANT (1) << (n % POLICY_GROUP_WORD_BITS);
+        }
+    }
+}
+
+/**
+ * Append an identity for each entry in @grouping to the admin identities
+ */
+static void
+policy_ruleset_compile_identities (PolicyRuleset *ruleset,
+                                   const PolicyFile *file,
+                                   PolicyStrings grouping,
+                                   const gchar *id_prefix)
+{
+  for (guint i = 0; i < grouping.n; i++)
+    {
+      /* %wheel% substitution already happened at load time */
+      const gchar *identifier = policy_file_get_string (file, grouping, i);
+      g_autofree gchar *nom = NULL;
+      g_autoptr (GError) err = NULL;
+      PolkitIdentity *identity = NULL;
+
+      nom = g_strdup_printf ("%s:%s", id_prefix, identifier);
+      identity = polkit_identity_from_string (nom, &err);
+      if (!identity)
+        {
+          g_message ("Identity `%s' is not valid, ignoring", nom);
+          continue;
+        }
+      ruleset->admin_identities
+          = g_list_prepend (ruleset->admin_identities, identity);
+    }
+}
+
+/**
+ * AdminRules only ever name identities, and never depend on the subject,
+ * so the list is built once here rather than on every challenge.
+ */
+static void
+policy_ruleset_compile_admin (PolicyRuleset *ruleset)
+{
+  for (const PolicyFile *file = ruleset->files; file; file = file->next)
+    {
+      for (guint i = 0; i < file->rules.n_admin; i++)
+        {
+          const Policy *policy = &file->rules.admin[i];
+
+          if ((policy->constraints & PF_CONSTRAINT_UNIX_GROUPS)
+              == PF_CONSTRAINT_UNIX_GROUPS)
+            {
+              policy_ruleset_compile_identities (
+                  ruleset, file, policy->unix_groups, "unix-group");
+            }
+          if ((policy->constraints & PF_CONSTRAINT_UNIX_NAMES)
+              == PF_CONSTRAINT_UNIX_NAMES)
+            {
+              policy_ruleset_compile_identities (
+                  ruleset, file, policy->unix_names, "unix-user");
+            }
+          if ((policy->constraints & PF_CONSTRAINT_NET_GROUPS)
+              == PF_CONSTRAINT_NET_GROUPS)
+            {
+              policy_ruleset_compile_identities (
+                  ruleset, file, policy->net_groups, "unix-netgroup");
+            }
+        }
+    }
+
+  ruleset->admin_identities = g_list_reverse (ruleset->admin_identities);
+}
+
+/**
+ * Index every live rule
+ */
+static void
+policy_ruleset_compile_index (PolicyRuleset *ruleset)
+{
+  g_autoptr (GArray) patterns = NULL;
+
+  ruleset->exact = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                          (GDestroyNotify)g_array_unref);
+  ruleset->wildcard = policy_ruleset_list_new ();
+  patterns = g_array_new (FALSE, FALSE, sizeof (PolicyContainsPattern));
+
+  for (guint i = 0; i < ruleset->rules->len; i++)
+    {
+      const PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, i);
+
+      if (entry->status == POLICY_RULE_LIVE)
+        {
+          policy_ruleset_index (ruleset, entry->file, entry->policy, i,
+                                patterns);
+        }
+    }
+
+  if (patterns->len > 0)
+    {
+      ruleset->contains = policy_contains_matcher_new (patterns);
+    }
+}
+
+static void
+policy_ruleset_clear_index (PolicyRuleset *ruleset)
+{
+  g_clear_pointer (&ruleset->exact, g_hash_table_unref);
+  g_clear_pointer (&ruleset->wildcard, g_array_unref);
+  g_clear_pointer (&ruleset->contains, policy_contains_matcher_free);
+  g_clear_pointer (&ruleset->prefixes, policy_prefix_node_free);
+  g_clear_pointer (&ruleset->decisions, g_hash_table_unref);
+}
+
+/**
+ * Append the priority of every indexed rule that targets the action ID to
+ * @hits, unsorted and possibly repeated
+ */
+static void
+policy_ruleset_collect (PolicyRuleset *ruleset, const gchar *action_id,
+                        GArray *hits)
+{
+  GArray *list = g_hash_table_lookup (ruleset->exact, action_id);
+
+  if (list)
+    {
+      g_array_append_vals (hits, list->data, list->len);
+    }
+  g_array_append_vals (hits, ruleset->wildcard->data, ruleset->wildcard->len);
+  if (ruleset->contains)
+    {
+      policy_contains_matcher_scan (ruleset->contains, action_id, hits);
+    }
+  if (ruleset->prefixes)
+    {
+      policy_prefix_trie_scan (ruleset->prefixes, action_id, hits);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Conditions on the subject, any of which may fail */
+#define POLICY_RULE_CONDITIONS                                                \
+  (PF_CONSTRAINT_SUBJECT_ACTIVE | PF_CONSTRAINT_SUBJECT_LOCAL                 \
+   | PF_CONSTRAINT_UNIX_GROUPS | PF_CONSTRAINT_UNIX_NAMES                     \
+   | PF_CONSTRAINT_NET_GROUPS | PF_CONSTRAINT_DETAILS | PF_CONSTRAINT_SEATS    \
+   | PF_CONSTRAINT_SESSION_CLASSES | PF_CONSTRAINT_SESSION_TYPES)
+
+/**
+ * Whether the rule answers every check that reaches it, whoever the subject.
+ * A failed SubjectActive= never falls back on ResultInverse=, see
+ * policy_test_matched().
+ */
+static gboolean
+policy_rule_always_answers (const Policy *policy)
+{
+  guint conditions = policy->constraints & POLICY_RULE_CONDITIONS;
+
+  if ((policy->constraints & PF_CONSTRAINT_RESULT) != PF_CONSTRAINT_RESULT
+      || policy->response == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
+    {
+      return FALSE;
+    }
+  if (conditions == 0)
+    {
+      return TRUE;
+    }
+  return (policy->constraints & PF_CONSTRAINT_RESULT_INVERSE)
+             == PF_CONSTRAINT_RESULT_INVERSE
+         && (conditions & PF_CONSTRAINT_SUBJECT_ACTIVE) == 0;
+}
+
+/**
+ * Whether the rule can never answer a check, either because it targets no
+ * action ID or because it has no response to give
+ */
+static gboolean
+policy_rule_is_inert (const Policy *policy)
+{
+  guint conditions = policy->constraints & POLICY_RULE_CONDITIONS;
+
+  if (policy->actions.n == 0 && policy->action_contains.n == 0)
+    {
+      return TRUE;
+    }
+  if ((policy->constraints & PF_CONSTRAINT_RESULT) == PF_CONSTRAINT_RESULT)
+    {
+      return FALSE;
+    }
+  /* ResultInverse= alone is only given when a condition other than
+   * SubjectActive= fails */
+  return (policy->constraints & PF_CONSTRAINT_RESULT_INVERSE)
+             != PF_CONSTRAINT_RESULT_INVERSE
+         || (conditions & ~PF_CONSTRAINT_SUBJECT_ACTIVE) == 0;
+}
+
+/**
+ * Find a rule ahead of @priority that always answers for every action ID
+ * matched by the given Actions= entry or ActionContains= pattern, or
+ * G_MAXUINT if there is none. The index already knows the candidates for
+ * any action ID, and a pattern is covered by:
+ *  - POLICY_MATCH_ALL, for anything
+ *  - an ActionContains= pattern within it, for anything but POLICY_MATCH_ALL
+ *  - a prefix pattern it starts with, for an action ID or prefix pattern
+ *  - the same action ID, for an action ID
+ */
+static guint
+policy_ruleset_find_shadow (PolicyRuleset *ruleset, guint priority,
+                            const gchar *pattern, gboolean contains)
+{
+  g_autoptr (GArray) hits = policy_ruleset_list_new ();
+  guint shadow = G_MAXUINT;
+
+  if (contains || g_str_equal (pattern, POLICY_MATCH_ALL))
+    {
+      g_array_append_vals (hits, ruleset->wildcard->data,
+                           ruleset->wildcard->len);
+      if (contains && *pattern != '\0' && ruleset->contains)
+        {
+          policy_contains_matcher_scan (ruleset->contains, pattern, hits);
+        }
+    }
+  else if (policy_action_is_prefix (pattern))
+    {
+      g_autofree gchar *prefix = g_strndup (pattern, strlen (pattern) - 1);
+
+      g_array_append_vals (hits, ruleset->wildcard->data,
+                           ruleset->wildcard->len);
+      if (ruleset->contains)
+        {
+          policy_contains_matcher_scan (ruleset->contains, prefix, hits);
+        }
+      if (ruleset->prefixes)
+        {
+          /* the trailing '*' stands in for whatever follows the prefix */
+          policy_prefix_trie_scan (ruleset->prefixes, pattern, hits);
+        }
+    }
+  else
+    {
+      policy_ruleset_collect (ruleset, pattern, hits);
+    }
+
+  for (guint i = 0; i < hits->len; i++)
+    {
+      guint candidate = g_array_index (hits, guint, i);
+      const PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, candidate);
+
+      if (candidate < priority && candidate < shadow
+          && policy_rule_always_answers (entry->policy))
+        {
+          shadow = candidate;
+        }
+    }
+
+  return shadow;
+}
+
+/**
+ * Mark every rule whose whole Actions= and ActionContains= are covered by
+ * earlier rules that always answer, returning how many there are
+ */
+static guint
+policy_ruleset_analyse (PolicyRuleset *ruleset)
+{
+  guint n_shadowed = 0;
+
+  for (guint i = 0; i < ruleset->rules->len; i++)
+    {
+      PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, i);
+      const Policy *policy = entry->policy;
+      guint shadow = G_MAXUINT;
+      gboolean covered = TRUE;
+
+      if (entry->status != POLICY_RULE_LIVE)
+        {
+          continue;
+        }
+
+      for (guint j = 0; covered && j < policy->actions.n; j++)
+        {
+          shadow = policy_ruleset_find_shadow (
+              ruleset, i, policy_file_get_string (entry->file, policy->actions, j),
+              FALSE);
+          covered = shadow != G_MAXUINT;
+        }
+      for (guint j = 0; covered && j < policy->action_contains.n; j++)
+        {
+          shadow = policy_ruleset_find_shadow (
+              ruleset, i,
+              policy_file_get_string (entry->file, policy->action_contains, j),
+              TRUE);
+          covered = shadow != G_MAXUINT;
+        }
+
+      if (covered)
+        {
+          entry->status = POLICY_RULE_SHADOWED;
+          entry->shadowed_by = shadow;
+          n_shadowed++;
+        }
+    }
+
+  return n_shadowed;
+}
+
+/**
+ * Whether the rule gives its Result= to every subject
+ */
+static gboolean
+policy_rule_is_static (const Policy *policy)
+{
+  return (policy->constraints & POLICY_RULE_CONDITIONS) == 0
+         && policy_rule_always_answers (policy);
+}
+
+/**
+ * Fold every action ID named in Actions= whose first candidate rule gives
+ * the same answer to every subject into the decision table
+ */
+static void
+policy_ruleset_compile_decisions (PolicyRuleset *ruleset)
+{
+  g_autoptr (GArray) hits = policy_ruleset_list_new ();
+  GHashTableIter iter;
+  gpointer action_id = NULL;
+
+  ruleset->decisions = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_hash_table_iter_init (&iter, ruleset->exact);
+  while (g_hash_table_iter_next (&iter, &action_id, NULL))
+    {
+      guint first = G_MAXUINT;
+      const PolicyRulesetEntry *entry = NULL;
+
+      g_array_set_size (hits, 0);
+      policy_ruleset_collect (ruleset, action_id, hits);
+      for (guint i = 0; i < hits->len; i++)
+        {
+          first = MIN (first, g_array_index (hits, guint, i));
+        }
+
+      entry = &g_array_index (ruleset->rules, PolicyRulesetEntry, first);
+      if (policy_rule_is_static (entry->policy))
+        {
+          /* Key is owned by the file pool, as for the exact table */
+          g_hash_table_insert (ruleset->decisions, action_id,
+                               GUINT_TO_POINTER (first + 1));
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+PolicyRuleset *
+policy_ruleset_new (PolicyFile *files)
+{
+  PolicyRuleset *ret = NULL;
+  guint n_shadowed = 0;
+
+  ret = g_new0 (PolicyRuleset, 1);
+  ret->ref_count = 1;
+  ret->files = files;
+  ret->rules = g_array_new (FALSE, FALSE, sizeof (PolicyRulesetEntry));
+  ret->group_atoms = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  for (PolicyFile *file = files; file; file = file->next)
+    {
+      for (guint i = 0; i < file->rules.n_normal; i++)
+        {
+          PolicyRulesetEntry entry = {
+            .file = file,
+            .policy = &file->rules.normal[i],
+            .groups = NULL,
+            .detail_values = NULL,
+            .status = POLICY_RULE_LIVE,
+            .shadowed_by = G_MAXUINT,
+          };
+
+          if (policy_rule_is_inert (entry.policy))
+            {
+              entry.status = POLICY_RULE_INERT;
+              ret->n_pruned++;
+            }
+          g_array_append_val (ret->rules, entry);
+        }
+      ret->n_files++;
+    }
+
+  /* Shadowing is found through the index, which then has to be built once
+   * more without the shadowed rules. That only happens when some are. */
+  policy_ruleset_compile_index (ret);
+  n_shadowed = policy_ruleset_analyse (ret);
+  if (n_shadowed > 0)
+    {
+      policy_ruleset_clear_index (ret);
+      policy_ruleset_compile_index (ret);
+      ret->n_pruned += n_shadowed;
+    }
+  policy_ruleset_compile_decisions (ret);
+
+  policy_ruleset_compile_groups (ret);
+  policy_ruleset_compile_details (ret);
+  policy_ruleset_compile_admin (ret);
+  ret->stats = g_new0 (PolicyRuleStats, MAX (ret->rules->len, 1));
+
+  return ret;
+}
+
+/**
+ * Checks run concurrently on a shared ruleset, so every counter is bumped
+ * atomically rather than under a lock
+ */
+static inline void
+policy_rule_stats_bump (volatile gsize *counter)
+{
+  g_atomic_pointer_add (counter, 1);
+}
+
+/**
+ * Pop the lowest priority from the heads of the given candidate lists
+ */
+static gboolean
+policy_ruleset_next (GArray **lists, guint *pos, gsize n_lists,
+                     guint *priority)
+{
+  gboolean found = FALSE;
+
+  for (gsize i = 0; i < n_lists; i++)
+    {
+      guint candidate;
+
+      if (!lists[i] || pos[i] >= lists[i]->len)
+        {
+          continue;
+        }
+      candidate = g_array_index (lists[i], guint, pos[i]);
+      if (!found || candidate < *priority)
+        {
+          *priority = candidate;
+          found = TRUE;
+        }
+    }
+
+  if (!found)
+    {
+      return FALSE;
+    }
+
+  /* Consume it from every list so a rule is only ever tested once */
+  for (gsize i = 0; i < n_lists; i++)
+    {
+      if (lists[i] && pos[i] < lists[i]->len
+          && g_array_index (lists[i], guint, pos[i]) == *priority)
+        {
+          pos[i]++;
+        }
+    }
+
+  return TRUE;
+}
+
+gboolean
+policy_ruleset_test_static (PolicyRuleset *ruleset, const gchar *action_id,
+                            PolicyRulesetTrace *trace,
+                            PolkitImplicitAuthorization *out_response)
+{
+  const PolicyRulesetEntry *entry = NULL;
+  PolicyRuleStats *stats = NULL;
+  guint priority;
+
+  if (!ruleset)
+    {
+      return FALSE;
+    }
+
+  priority
+      = GPOINTER_TO_UINT (g_hash_table_lookup (ruleset->decisions, action_id));
+  if (priority == 0)
+    {
+      return FALSE;
+    }
+  priority--;
+
+  entry = &g_array_index (ruleset->rules, PolicyRulesetEntry, priority);
+  stats = &ruleset->stats[priority];
+  policy_rule_stats_bump (&stats->evaluated);
+  policy_rule_stats_bump (&stats->matched);
+  policy_rule_stats_bump (&stats->decided);
+  if (trace)
+    {
+      trace->n_tested = 1;
+      trace->matched = entry;
+      trace->used_details = FALSE;
+    }
+
+  *out_response = entry->policy->response;
+  return TRUE;
+}
+
+PolkitImplicitAuthorization
+policy_ruleset_test (PolicyRuleset *ruleset, const gchar *action_id,
+                     PolicyContext *context)
+{
+  return policy_ruleset_test_full (ruleset, action_id, context, NULL);
+}
+
+PolkitImplicitAuthorization
+policy_ruleset_test_full (PolicyRuleset *ruleset, const gchar *action_id,
+                          PolicyContext *context, PolicyRulesetTrace *trace)
+{
+  PolkitImplicitAuthorization response = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  g_autoptr (GArray) hits = NULL;
+  g_autofree guint64 *owned_groups = NULL;
+  guint64 *subject_groups = NULL;
+  GArray *lists[3] = { NULL };
+  guint pos[G_N_ELEMENTS (lists)] = { 0 };
+  guint priority = 0;
+
+  if (trace)
+    {
+      trace->n_tested = 0;
+      trace->matched = NULL;
+      trace->used_details = FALSE;
+    }
+
+  if (!ruleset)
+    {
+      return POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+    }
+
+  /* Answers that don't depend on the subject were worked out up front */
+  if (policy_ruleset_test_static (ruleset, action_id, trace, &response))
+    {
+      return response;
+    }
+
+  lists[0] = g_hash_table_lookup (ruleset->exact, action_id);
+  lists[1] = ruleset->wildcard;
+  if (ruleset->contains || ruleset->prefixes)
+    {
+      hits = policy_ruleset_list_new ();
+      if (ruleset->contains)
+        {
+          policy_contains_matcher_scan (ruleset->contains, action_id, hits);
+        }
+      if (ruleset->prefixes)
+        {
+          policy_prefix_trie_scan (ruleset->prefixes, action_id, hits);
+        }
+      policy_ruleset_list_normalise (hits);
+      lists[2] = hits;
+    }
+
+  /* Merge the candidates by priority, first match wins. Every candidate is
+   * known to target this action ID, so only the conditions are left. */
+  while (policy_ruleset_next (lists, pos, G_N_ELEMENTS (lists), &priority))
+    {
+      const PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, priority);
+      PolicyRuleStats *stats = &ruleset->stats[priority];
+      PolicyGroupMatch groups = {
+        .rule = entry->groups,
+        .n_words = ruleset->n_group_words,
+      };
+      gboolean matched = FALSE;
+
+      /* Only resolve the subject's atoms once a candidate needs them */
+      if (entry->groups && !subject_groups)
+        {
+          gsize size = ruleset->n_group_words * sizeof (guint64);
+
+          if (context->arena)
+            {
+              subject_groups = policy_arena_alloc0 (context->arena, size);
+            }
+          else
+            {
+              subject_groups = owned_groups = g_malloc0 (size);
+            }
+          policy_ruleset_subject_groups (ruleset, context, subject_groups);
+        }
+      groups.subject = subject_groups;
+
+      response = policy_test_matched (entry->file, entry->policy,
+                                      entry->groups ? &groups : NULL,
+                                      entry->detail_values, context, &matched);
+      policy_rule_stats_bump (&stats->evaluated);
+      if (matched)
+        {
+          policy_rule_stats_bump (&stats->matched);
+        }
+      if (trace)
+        {
+          trace->n_tested++;
+          trace->used_details |= entry->detail_values != NULL;
+        }
+      if (response != POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
+        {
+          policy_rule_stats_bump (matched ? &stats->decided
+                                          : &stats->inverse_decided);
+          if (trace)
+            {
+              trace->matched = entry;
+            }
+          break;
+        }
+    }
+
+  return response;
+}
+
+GList *
+policy_ruleset_get_admin_identities (PolicyRuleset *ruleset)
+{
+  return g_list_copy_deep (ruleset->admin_identities, (GCopyFunc)g_object_ref,
+                           NULL);
+}
+
+/* What a hash table entry costs, besides the key and value themselves */
+#define POLICY_RULESET_HASH_ENTRY_SIZE (2 * sizeof (gpointer) + sizeof (guint))
+
+void
+policy_ruleset_get_memory_usage (PolicyRuleset *ruleset, guint64 *bytes,
+                                 guint64 *objects)
+{
+  GHashTableIter iter;
+  GArray *priorities = NULL;
+
+  *bytes += sizeof (PolicyRuleset);
+  for (const PolicyFile *file = ruleset->files; file; file = file->next)
+    {
+      *bytes += policy_file_get_memory_size (file);
+      *objects += 1;
+    }
+
+  for (guint n = 0; n < ruleset->rules->len; n++)
+    {
+      const PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, n);
+
+      *bytes += sizeof (PolicyRulesetEntry) + sizeof (PolicyRuleStats);
+      if (entry->groups)
+        {
+          *bytes += ruleset->n_group_words * sizeof (guint64);
+        }
+      if (entry->detail_values)
+        {
+          *bytes += g_hash_table_size (entry->detail_values)
+                    * POLICY_RULESET_HASH_ENTRY_SIZE;
+        }
+      *objects += 1;
+    }
+
+  g_hash_table_iter_init (&iter, ruleset->exact);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&priorities))
+    {
+      *bytes += POLICY_RULESET_HASH_ENTRY_SIZE + sizeof (GArray)
+                + priorities->len * sizeof (guint);
+    }
+  *bytes += ruleset->wildcard->len * sizeof (guint);
+  *bytes += g_hash_table_size (ruleset->decisions)
+            * POLICY_RULESET_HASH_ENTRY_SIZE;
+  *bytes += g_hash_table_size (ruleset->group_atoms)
+            * POLICY_RULESET_HASH_ENTRY_SIZE;
+}
+
+/**
+ * Compare two elements of a GPtrArray of strings
+ */
+static gint
+policy_ruleset_strv_cmp (gconstpointer a, gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar *const *)a, *(const gchar *const *)b);
+}
+
+/**
+ * Add every action ID a changed file's rules target to @actions. Returns
+ * FALSE if one of them may target action IDs that aren't spelled out.
+ */
+static gboolean
+policy_ruleset_diff_file (const PolicyFile *file, GHashTable *actions)
+{
+  /* Administrators are asked for by every action */
+  if (file->rules.n_admin > 0)
+    {
+      return FALSE;
+    }
+
+  for (guint n = 0; n < file->rules.n_normal; n++)
+    {
+      const Policy *policy = &file->rules.normal[n];
+
+      if ((policy->constraints & PF_CONSTRAINT_ACTION_CONTAINS)
+              == PF_CONSTRAINT_ACTION_CONTAINS
+          && policy->action_contains.n > 0)
+        {
+          return FALSE;
+        }
+      if ((policy->constraints & PF_CONSTRAINT_ACTIONS)
+          != PF_CONSTRAINT_ACTIONS)
+        {
+          continue;
+        }
+      for (guint i = 0; i < policy->actions.n; i++)
+        {
+          const gchar *action
+              = policy_file_get_string (file, policy->actions, i);
+
+          if (g_str_equal (action, POLICY_MATCH_ALL)
+              || policy_action_is_prefix (action))
+            {
+              return FALSE;
+            }
+          g_hash_table_add (actions, (gpointer)action);
+        }
+    }
+
+  return TRUE;
+}
+
+gchar **
+policy_ruleset_diff_actions (PolicyRuleset *old_ruleset,
+                             PolicyRuleset *new_ruleset)
+{
+  GHashTable *old_files = NULL;
+  GHashTable *actions = NULL;
+  GHashTableIter iter;
+  const PolicyFile *file = NULL;
+  gboolean confined = TRUE;
+  GPtrArray *ret = NULL;
+  gpointer key = NULL;
+
+  /* Files are ordered by path, so only their contents can differ. Those
+   * loaded from elsewhere can't be told apart. */
+  old_files = g_hash_table_new (g_str_hash, g_str_equal);
+  for (file = old_ruleset->files; confined && file; file = file->next)
+    {
+      confined = file->path != NULL;
+      if (confined)
+        {
+          g_hash_table_insert (old_files, file->path, (gpointer)file);
+        }
+    }
+
+  /* Keys are owned by the pools of both rulesets, which the caller holds */
+  actions = g_hash_table_new (g_str_hash, g_str_equal);
+  for (file = new_ruleset->files; confined && file; file = file->next)
+    {
+      const PolicyFile *old_file = NULL;
+
+      confined = file->path != NULL;
+      if (!confined)
+        {
+          break;
+        }
+      old_file = g_hash_table_lookup (old_files, file->path);
+      if (old_file)
+        {
+          g_hash_table_remove (old_files, file->path);
+          if (policy_file_equal (old_file, file))
+            {
+              continue;
+            }
+          confined = policy_ruleset_diff_file (old_file, actions);
+        }
+      confined = confined && policy_ruleset_diff_file (file, actions);
+    }
+
+  /* Whatever is left was removed */
+  g_hash_table_iter_init (&iter, old_files);
+  while (confined && g_hash_table_iter_next (&iter, NULL, (gpointer *)&file))
+    {
+      confined = policy_ruleset_diff_file (file, actions);
+    }
+
+  if (confined)
+    {
+      ret = g_ptr_array_new ();
+      g_hash_table_iter_init (&iter, actions);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          g_ptr_array_add (ret, g_strdup (key));
+        }
+      g_ptr_array_sort (ret, (GCompareFunc)policy_ruleset_strv_cmp);
+      g_ptr_array_add (ret, NULL);
+    }
+
+  g_hash_table_unref (actions);
+  g_hash_table_unref (old_files);
+
+  return ret ? (gchar **)g_ptr_array_free (ret, FALSE) : NULL;
+}
+
+PolicyRuleset *
+policy_ruleset_ref (PolicyRuleset *ruleset)
+{
+  g_atomic_int_inc (&ruleset->ref_count);
+  return ruleset;
+}
+
+void
+policy_ruleset_unref (PolicyRuleset *ruleset)
+{
+  if (!ruleset || !g_atomic_int_dec_and_test (&ruleset->ref_count))
+    {
+      return;
+    }
+  policy_ruleset_clear_index (ruleset);
+  for (guint i = 0; i < ruleset->rules->len; i++)
+    {
+      g_clear_pointer (
+          &g_array_index (ruleset->rules, PolicyRulesetEntry, i).detail_values,
+          g_hash_table_unref);
+    }
+  g_clear_pointer (&ruleset->group_atoms, g_hash_table_unref);
+  g_clear_pointer (&ruleset->group_masks, g_free);
+  g_list_free_full (ruleset->admin_identities, g_object_unref);
+  g_clear_pointer (&ruleset->rules, g_array_unref);
+  g_clear_pointer (&ruleset->stats, g_free);
+  g_clear_pointer (&ruleset->files, policy_file_free);
+  g_free (ruleset);
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_POLICY_RULESET_H
+#define __POLKIT_BACKEND_POLICY_RULESET_H
+
+#include <glib.h>
+
+#include "polkitbackendpolicyfile.h"
+
+/**
+ * PolicyContainsMatcher is an Aho-Corasick automaton built over every
+ * ActionContains= pattern within a ruleset, so that a single pass over an
+ * action ID yields every rule with a substring hit, no matter how many
+ * patterns are in use.
+ */
+typedef struct PolicyContainsMatcher
+{
+  guint8 classes[256]; /**<Input byte to class, 0 for bytes in no pattern */
+  guint n_classes;
+  guint n_states;
+  guint *transitions; /**<Complete DFA, n_states * n_classes */
+  guint *hit_offsets; /**<Per state range into hits, n_states + 1 long */
+  guint *hits;        /**<Sorted rule priorities reported by each state */
+} PolicyContainsMatcher;
+
+/**
+ * PolicyPrefixNode is a single dot separated component in the trie built
+ * over every Actions= prefix pattern within a ruleset, i.e. "udisks2" in
+ * "org.freedesktop.udisks2.*". Looking up an action ID walks at most one
+ * node per component, no matter how many patterns are in use.
+ */
+typedef struct PolicyPrefixNode
+{
+  GHashTable *children; /**<Next component to PolicyPrefixNode, may be NULL */
+  GArray *hits; /**<Priorities of rules whose prefix ends here, may be NULL */
+} PolicyPrefixNode;
+
+/**
+ * What the load time analysis found out about a rule. Anything but a live
+ * rule is left out of the index, as no check could ever be answered by it.
+ */
+typedef enum
+{
+  POLICY_RULE_LIVE = 0,
+  POLICY_RULE_SHADOWED, /**<An earlier rule always answers first */
+  POLICY_RULE_INERT,    /**<Targets no action, or has no response to give */
+} PolicyRuleStatus;
+
+/**
+ * A normal rule and the file (and thus string pool) it belongs to
+ */
+typedef struct PolicyRulesetEntry
+{
+  const PolicyFile *file;
+  const Policy *policy;
+  const guint64 *groups; /**<InUnixGroups= atoms, NULL without the constraint */
+  GHashTable *detail_values; /**<Set of exact InDetailValues=, or NULL */
+  PolicyRuleStatus status;
+  guint shadowed_by; /**<Priority of a rule answering first, when shadowed */
+} PolicyRulesetEntry;
+
+/**
+ * Running totals for a single normal rule, bumped atomically by every
+ * policy_ruleset_test() so that readers never take a lock
+ */
+typedef struct PolicyRuleStats
+{
+  volatile gsize evaluated;       /**<Conditions were tested */
+  volatile gsize matched;         /**<Every condition held */
+  volatile gsize decided;         /**<Answered with Result= */
+  volatile gsize inverse_decided; /**<Answered with ResultInverse= */
+} PolicyRuleStats;
+
+/**
+ * PolicyRuleset is the "compiled" form of a whole chain of PolicyFiles.
+ *
+ * Every normal rule is given a global priority (its position in the
+ * chain, i.e. file order followed by rule order) and is then indexed by
+ * the action IDs it can possibly match. Evaluation only ever visits the
+ * candidate rules for a given action ID, in priority order, so we retain
+ * the first-match semantics of policy_file_test().
+ *
+ * Rules that can never answer a check, whether because an earlier rule
+ * always answers for every action they target or because they have no
+ * response at all, are found at compile time and not indexed. Action IDs
+ * whose first candidate gives the same answer to every subject are folded
+ * into a decision table that needs no PolicyContext at all.
+ *
+ * A compiled ruleset is immutable and reference counted, so a reader may
+ * keep evaluating a snapshot while a replacement is published.
+ */
+typedef struct PolicyRuleset
+{
+  volatile gint ref_count;
+
+  PolicyFile *files; /**<Owned chain of PolicyFiles, in priority order */
+  guint n_files;
+
+  GArray *rules; /**<All PolicyRulesetEntry, indexed by priority */
+  PolicyRuleStats *stats; /**<Counters for each rule, indexed by priority */
+  guint n_pruned;         /**<Rules that are not POLICY_RULE_LIVE */
+
+  GHashTable *exact; /**<Exact action ID to GArray of rule priorities */
+  GArray *wildcard;  /**<Priorities of rules matching any action ID */
+  PolicyContainsMatcher *contains; /**<NULL without ActionContains= rules */
+  PolicyPrefixNode *prefixes; /**<Trie root, NULL without prefix patterns */
+  GHashTable *decisions; /**<Action ID to (priority + 1) of a static answer */
+
+  GHashTable *group_atoms; /**<InUnixGroups= gid to (atom + 1) */
+  guint n_group_words;     /**<Length of every group bitset */
+  guint64 *group_masks;    /**<Backing storage for PolicyRulesetEntry.groups */
+
+  GList *admin_identities; /**<Every AdminRules PolkitIdentity, in order */
+} PolicyRuleset;
+
+/**
+ * Compile a new PolicyRuleset from the given chain of files, with a single
+ * reference. The ruleset takes ownership of @files, which may be NULL.
+ */
+PolicyRuleset *policy_ruleset_new (PolicyFile *files);
+
+/**
+ * Find the response of the first candidate rule that has an opinion on
+ * the given action ID, or POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN if there
+ * is none.
+ */
+PolkitImplicitAuthorization policy_ruleset_test (PolicyRuleset *ruleset,
+                                                 const gchar *action_id,
+                                                 PolicyContext *context);
+
+/**
+ * What policy_ruleset_test_full() did to reach its answer, for tooling
+ */
+typedef struct PolicyRulesetTrace
+{
+  guint n_tested; /**<Candidate rules whose conditions were tested */
+  const PolicyRulesetEntry *matched; /**<Rule that answered, or NULL */
+  gboolean used_details; /**<The answer depends on the details of the check */
+} PolicyRulesetTrace;
+
+/**
+ * Look the action ID up in the decision table, for when the answer doesn't
+ * depend on the subject, so that a caller may skip preparing a context.
+ * Returns FALSE if the rules have to be tested with policy_ruleset_test().
+ * @trace: If not NULL, filled in on success
+ */
+gboolean policy_ruleset_test_static (PolicyRuleset *ruleset,
+                                     const gchar *action_id,
+                                     PolicyRulesetTrace *trace,
+                                     PolkitImplicitAuthorization *out_response);
+
+/**
+ * As policy_ruleset_test(), additionally filling in @trace if not NULL
+ */
+PolkitImplicitAuthorization policy_ruleset_test_full (PolicyRuleset *ruleset,
+                                                      const gchar *action_id,
+                                                      PolicyContext *context,
+                                                      PolicyRulesetTrace *trace);
+
+/**
+ * Return a new list of references to the administrator identities, to be
+ * freed with g_list_free_full() and g_object_unref()
+ */
+GList *policy_ruleset_get_admin_identities (PolicyRuleset *ruleset);
+
+/**
+ * Work out which action IDs @new_ruleset may answer differently than
+ * @old_ruleset, from the files that were added, removed or changed. Returns
+ * a sorted, NULL terminated and possibly empty array to be freed with
+ * g_strfreev(), or NULL if the change isn't confined to named actions, as
+ * when a changed rule matches a pattern or changes the administrators.
+ */
+gchar **policy_ruleset_diff_actions (PolicyRuleset *old_ruleset,
+                                     PolicyRuleset *new_ruleset);
+
+/**
+ * Estimate the memory held by the ruleset and its files, from the size of
+ * its structures and strings, and add it to @bytes and @objects (files and
+ * compiled rules)
+ */
+void policy_ruleset_get_memory_usage (PolicyRuleset *ruleset, guint64 *bytes,
+                                      guint64 *objects);
+
+/**
+ * Take a new reference on the given PolicyRuleset
+ */
+PolicyRuleset *policy_ruleset_ref (PolicyRuleset *ruleset);
+
+/**
+ * Drop a reference, freeing the ruleset and its files along with the last
+ */
+void policy_ruleset_unref (PolicyRuleset *ruleset);
+
+#endif /* __POLKIT_BACKEND_POLICY_RULESET_H */
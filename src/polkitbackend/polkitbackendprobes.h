@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+
+#if !defined (_POLKIT_BACKEND_COMPILATION) || defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error "This is a private header file."
+#endif
+
+#ifndef __POLKIT_BACKEND_PROBES_H
+#define __POLKIT_BACKEND_PROBES_H
+
+/* Static probes in the "polkit" provider, for bpftrace, perf and
+ * SystemTap to attach to. Without HAVE_SDT they compile to nothing, and
+ * with it an unattached probe is a single nop.
+ *
+ * Probe names use double underscores, which the tools show as dashes.
+ * Arguments must be cheap to compute, they are evaluated every time.
+ */
+#ifdef HAVE_SDT
+
+#include <sys/sdt.h>
+
+#define POLKIT_BACKEND_PROBE(name) \
+  DTRACE_PROBE (polkit, name)
+#define POLKIT_BACKEND_PROBE1(name, a1) \
+  DTRACE_PROBE1 (polkit, name, a1)
+#define POLKIT_BACKEND_PROBE2(name, a1, a2) \
+  DTRACE_PROBE2 (polkit, name, a1, a2)
+#define POLKIT_BACKEND_PROBE3(name, a1, a2, a3) \
+  DTRACE_PROBE3 (polkit, name, a1, a2, a3)
+
+#else
+
+#define POLKIT_BACKEND_PROBE(name) do { } while (0)
+#define POLKIT_BACKEND_PROBE1(name, a1) do { } while (0)
+#define POLKIT_BACKEND_PROBE2(name, a1, a2) do { } while (0)
+#define POLKIT_BACKEND_PROBE3(name, a1, a2, a3) do { } while (0)
+
+#endif
+
+#endif /* __POLKIT_BACKEND_PROBES_H */
@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include "polkitbackendmetrics.h"
+#include "polkitbackendpolicycache.h"
+#include "polkitbackendpolicyprovider.h"
+#include "polkitbackendproviderauthority.h"
+#include "polkitbackendsubjectinfo.h"
+#include <polkit/polkit.h>
+
+/**
+ * SECTION:polkitbackendproviderauthority
+ * @title: PolkitBackendProviderAuthority
+ * @short_description: Provider Authority
+ * @stability: Unstable
+ *
+ * A #PolkitBackendKeyfileAuthority that first asks a local decision
+ * service about every check, see polkitbackendpolicyprovider.h. Checks the
+ * service leaves to the rules, doesn't answer in time or can't be asked
+ * about are decided by the keyfile rules as usual.
+ */
+
+/* ----------------------------------------------------------------------------------------------------
+ */
+
+struct _PolkitBackendProviderAuthorityPrivate
+{
+  gchar *socket_path;
+  guint timeout;     /* Milliseconds a check waits for the provider */
+  guint ttl;         /* Milliseconds answers are cached for */
+  guint retry_delay; /* Milliseconds to skip the provider after it failed */
+
+  PolicyProvider *provider;
+  GMutex cache_lock;  /* Checks are evaluated from worker threads */
+  PolicyCache *cache; /* Recent provider answers */
+};
+
+/**
+ * Defaults for the provider. The timeout is kept short, as every check
+ * the provider doesn't answer waits it out before the rules are asked.
+ */
+#define PROVIDER_TIMEOUT 50
+#define PROVIDER_TTL 10000
+#define PROVIDER_RETRY_DELAY 5000
+#define PROVIDER_CACHE_SIZE 4096
+
+enum
+{
+  PROP_0,
+  PROP_PROVIDER_SOCKET,
+  PROP_PROVIDER_TIMEOUT,
+  PROP_PROVIDER_TTL,
+  PROP_PROVIDER_RETRY_DELAY,
+};
+
+static PolkitImplicitAuthorization
+polkit_backend_provider_authority_check_authorization_sync (
+    PolkitBackendInteractiveAuthority *authority, PolkitSubject *caller,
+    PolkitSubject *subject, PolkitIdentity *user_for_subject,
+    gboolean subject_is_local, gboolean subject_is_active,
+    const gchar *action_id, PolkitDetails *details,
+    PolkitImplicitAuthorization implicit,
+    PolkitBackendSubjectInfo *subject_info);
+
+static void polkit_backend_provider_authority_get_memory_usage (
+    PolkitBackendInteractiveAuthority *authority, GVariantBuilder *builder);
+
+static void polkit_backend_provider_authority_trim_memory (
+    PolkitBackendInteractiveAuthority *authority);
+
+G_DEFINE_TYPE (PolkitBackendProviderAuthority,
+               polkit_backend_provider_authority,
+               POLKIT_BACKEND_TYPE_KEYFILE_AUTHORITY);
+
+/* ----------------------------------------------------------------------------------------------------
+ */
+
+static void
+polkit_backend_provider_authority_init (
+    PolkitBackendProviderAuthority *authority)
+{
+  authority->priv = G_TYPE_INSTANCE_GET_PRIVATE (
+      authority, POLKIT_BACKEND_TYPE_PROVIDER_AUTHORITY,
+      PolkitBackendProviderAuthorityPrivate);
+  g_mutex_init (&authority->priv->cache_lock);
+}
+
+static void
+polkit_backend_provider_authority_constructed (GObject *object)
+{
+  PolkitBackendProviderAuthority *authority
+      = POLKIT_BACKEND_PROVIDER_AUTHORITY (object);
+
+  authority->priv->cache = policy_cache_new (
+      PROVIDER_CACHE_SIZE, (gint64)authority->priv->ttl * G_TIME_SPAN_MILLISECOND);
+  if (authority->priv->socket_path != NULL)
+    {
+      authority->priv->provider = policy_provider_new (
+          authority->priv->socket_path,
+          (gint64)authority->priv->timeout * G_TIME_SPAN_MILLISECOND,
+          (gint64)authority->priv->retry_delay * G_TIME_SPAN_MILLISECOND);
+    }
+  else
+    {
+      g_warning ("No decision provider socket given, using the rules only");
+    }
+
+  G_OBJECT_CLASS (polkit_backend_provider_authority_parent_class)
+      ->constructed (object);
+}
+
+static void
+polkit_backend_provider_authority_finalize (GObject *object)
+{
+  PolkitBackendProviderAuthority *authority
+      = POLKIT_BACKEND_PROVIDER_AUTHORITY (object);
+
+  g_clear_pointer (&authority->priv->provider, policy_provider_free);
+  g_clear_pointer (&authority->priv->cache, policy_cache_free);
+  g_mutex_clear (&authority->priv->cache_lock);
+  g_free (authority->priv->socket_path);
+
+  G_OBJECT_CLASS (polkit_backend_provider_authority_parent_class)
+      ->finalize (object);
+}
+
+static void
+polkit_backend_provider_authority_set_property (GObject *object,
+                                                guint property_id,
+                                                const GValue *value,
+                                                GParamSpec *pspec)
+{
+  PolkitBackendProviderAuthority *authority
+      = POLKIT_BACKEND_PROVIDER_AUTHORITY (object);
+
+  switch (property_id)
+    {
+    case PROP_PROVIDER_SOCKET:
+      g_assert (authority->priv->socket_path == NULL);
+      authority->priv->socket_path = g_value_dup_string (value);
+      break;
+
+    case PROP_PROVIDER_TIMEOUT:
+      authority->priv->timeout = g_value_get_uint (value);
+      break;
+
+    case PROP_PROVIDER_TTL:
+      authority->priv->ttl = g_value_get_uint (value);
+      break;
+
+    case PROP_PROVIDER_RETRY_DELAY:
+      authority->priv->retry_delay = g_value_get_uint (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+polkit_backend_provider_authority_get_property (GObject *object,
+                                                guint property_id,
+                                                GValue *value,
+                                                GParamSpec *pspec)
+{
+  PolkitBackendProviderAuthority *authority
+      = POLKIT_BACKEND_PROVIDER_AUTHORITY (object);
+
+  switch (property_id)
+    {
+    case PROP_PROVIDER_TIMEOUT:
+      g_value_set_uint (value, authority->priv->timeout);
+      break;
+
+    case PROP_PROVIDER_TTL:
+      g_value_set_uint (value, authority->priv->ttl);
+      break;
+
+    case PROP_PROVIDER_RETRY_DELAY:
+      g_value_set_uint (value, authority->priv->retry_delay);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static const gchar *
+polkit_backend_provider_authority_get_name (PolkitBackendAuthority *authority)
+{
+  return "provider";
+}
+
+static void
+polkit_backend_provider_authority_class_init (
+    PolkitBackendProviderAuthorityClass *klass)
+{
+  GObjectClass *gobject_class;
+  PolkitBackendAuthorityClass *authority_class;
+  PolkitBackendInteractiveAuthorityClass *interactive_authority_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = polkit_backend_provider_authority_finalize;
+  gobject_class->set_property = polkit_backend_provider_authority_set_property;
+  gobject_class->get_property = polkit_backend_provider_authority_get_property;
+  gobject_class->constructed = polkit_backend_provider_authority_constructed;
+
+  authority_class = POLKIT_BACKEND_AUTHORITY_CLASS (klass);
+  authority_class->get_name = polkit_backend_provider_authority_get_name;
+
+  interactive_authority_class
+      = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_CLASS (klass);
+  interactive_authority_class->check_authorization_sync
+      = polkit_backend_provider_authority_check_authorization_sync;
+  interactive_authority_class->get_memory_usage
+      = polkit_backend_provider_authority_get_memory_usage;
+  interactive_authority_class->trim_memory
+      = polkit_backend_provider_authority_trim_memory;
+
+  g_object_class_install_property (
+      gobject_class, PROP_PROVIDER_SOCKET,
+      g_param_spec_string ("provider-socket", "Provider socket",
+                           "Unix socket the decision provider listens on",
+                           NULL, G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_PROVIDER_TIMEOUT,
+      g_param_spec_uint ("provider-timeout", "Provider timeout",
+                         "Milliseconds to wait for the decision provider "
+                         "before asking the rules",
+                         1, G_MAXUINT, PROVIDER_TIMEOUT,
+                         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_PROVIDER_TTL,
+      g_param_spec_uint ("provider-ttl", "Provider TTL",
+                         "Milliseconds to cache the decision provider's "
+                         "answers for",
+                         0, G_MAXUINT, PROVIDER_TTL,
+                         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
+
+  g_object_class_install_property (
+      gobject_class, PROP_PROVIDER_RETRY_DELAY,
+      g_param_spec_uint ("provider-retry-delay", "Provider retry delay",
+                         "Milliseconds to only ask the rules for after the "
+                         "decision provider failed",
+                         0, G_MAXUINT, PROVIDER_RETRY_DELAY,
+                         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
+
+  g_type_class_add_private (klass,
+                            sizeof (PolkitBackendProviderAuthorityPrivate));
+}
+
+/* ----------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * Report the cached answers, along with everything of the rules
+ */
+static void
+polkit_backend_provider_authority_get_memory_usage (
+    PolkitBackendInteractiveAuthority *_authority, GVariantBuilder *builder)
+{
+  PolkitBackendProviderAuthority *authority
+      = POLKIT_BACKEND_PROVIDER_AUTHORITY (_authority);
+  guint64 bytes = 0;
+  guint64 objects = 0;
+
+  g_mutex_lock (&authority->priv->cache_lock);
+  policy_cache_get_memory_usage (authority->priv->cache, &bytes, &objects);
+  g_mutex_unlock (&authority->priv->cache_lock);
+  polkit_backend_interactive_authority_add_memory_usage (
+      builder, "provider-cache", bytes, objects);
+
+  POLKIT_BACKEND_INTERACTIVE_AUTHORITY_CLASS (
+      polkit_backend_provider_authority_parent_class)
+      ->get_memory_usage (_authority, builder);
+}
+
+/**
+ * Drop the cached answers, the provider is asked again as checks come in
+ */
+static void
+polkit_backend_provider_authority_trim_memory (
+    PolkitBackendInteractiveAuthority *_authority)
+{
+  PolkitBackendProviderAuthority *authority
+      = POLKIT_BACKEND_PROVIDER_AUTHORITY (_authority);
+
+  g_mutex_lock (&authority->priv->cache_lock);
+  if (policy_cache_get_size (authority->priv->cache) > 0)
+    {
+      policy_cache_bump_generation (authority->priv->cache);
+    }
+  g_mutex_unlock (&authority->priv->cache_lock);
+
+  POLKIT_BACKEND_INTERACTIVE_AUTHORITY_CLASS (
+      polkit_backend_provider_authority_parent_class)
+      ->trim_memory (_authority);
+}
+
+/* ----------------------------------------------------------------------------------------------------
+ */
+
+static PolkitImplicitAuthorization
+polkit_backend_provider_authority_check_authorization_sync (
+    PolkitBackendInteractiveAuthority *_authority, PolkitSubject *caller,
+    PolkitSubject *subject, PolkitIdentity *user_for_subject,
+    gboolean subject_is_local, gboolean subject_is_active,
+    const gchar *action_id, PolkitDetails *details,
+    PolkitImplicitAuthorization implicit,
+    PolkitBackendSubjectInfo *subject_info)
+{
+  PolkitBackendProviderAuthority *authority
+      = POLKIT_BACKEND_PROVIDER_AUTHORITY (_authority);
+  PolkitImplicitAuthorization ret = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  PolicyCacheKey key = { 0 };
+  PolkitBackendMetrics *metrics = NULL;
+  gboolean cached = FALSE;
+  guint generation;
+
+  g_assert (POLKIT_IS_UNIX_USER (user_for_subject));
+
+  if (authority->priv->provider == NULL)
+    {
+      goto fallback;
+    }
+
+  /* The provider is asked about what the rules would consume, so that its
+   * answers can be cached the same way */
+  key.uid = polkit_unix_user_get_uid (POLKIT_UNIX_USER (user_for_subject));
+  key.action_id = action_id;
+  key.subject_is_local = subject_is_local;
+  key.subject_is_active = subject_is_active;
+  if (subject_info)
+    {
+      key.seat = polkit_backend_subject_info_get_seat (subject_info);
+      key.session_class
+          = polkit_backend_subject_info_get_session_class (subject_info);
+      key.session_type
+          = polkit_backend_subject_info_get_session_type (subject_info);
+    }
+
+  g_mutex_lock (&authority->priv->cache_lock);
+  cached = policy_cache_lookup (authority->priv->cache, &key, &ret);
+  generation = policy_cache_get_generation (authority->priv->cache);
+  g_mutex_unlock (&authority->priv->cache_lock);
+
+  metrics = polkit_backend_interactive_authority_get_metrics (_authority);
+
+  if (cached)
+    {
+      if (metrics)
+        polkit_backend_metrics_count (
+            metrics, POLKIT_BACKEND_METRICS_COUNTER_PROVIDER_CACHE_HITS);
+    }
+  else
+    {
+      gint64 start = g_get_monotonic_time ();
+      gboolean answered;
+
+      answered = policy_provider_query (authority->priv->provider, &key, &ret);
+      if (metrics)
+        {
+          polkit_backend_metrics_add_latency (
+              metrics, POLKIT_BACKEND_METRICS_PHASE_PROVIDER,
+              g_get_monotonic_time () - start);
+          polkit_backend_metrics_count (
+              metrics, answered
+                           ? POLKIT_BACKEND_METRICS_COUNTER_PROVIDER_ANSWERS
+                           : POLKIT_BACKEND_METRICS_COUNTER_PROVIDER_FALLBACKS);
+        }
+      if (!answered)
+        {
+          goto fallback;
+        }
+
+      /* Including the checks left to the rules, which then skip the
+       * provider for as long as anything it did answer */
+      g_mutex_lock (&authority->priv->cache_lock);
+      policy_cache_insert (authority->priv->cache, &key, generation, ret);
+      g_mutex_unlock (&authority->priv->cache_lock);
+    }
+
+  if (ret != POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
+    {
+      polkit_backend_interactive_authority_explain (_authority, details,
+                                                    "provider", NULL, NULL);
+      return ret;
+    }
+
+fallback:
+  return POLKIT_BACKEND_INTERACTIVE_AUTHORITY_CLASS (
+             polkit_backend_provider_authority_parent_class)
+      ->check_authorization_sync (_authority, caller, subject,
+                                  user_for_subject, subject_is_local,
+                                  subject_is_active, action_id, details,
+                                  implicit, subject_info);
+}
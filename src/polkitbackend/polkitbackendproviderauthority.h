@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined(_POLKIT_BACKEND_COMPILATION)                                     \
+    && !defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error                                                                        \
+    "Only <polkitbackend/polkitbackend.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_BACKEND_PROVIDER_AUTHORITY_H
+#define __POLKIT_BACKEND_PROVIDER_AUTHORITY_H
+
+#include <glib-object.h>
+#include <polkitbackend/polkitbackendkeyfileauthority.h>
+#include <polkitbackend/polkitbackendtypes.h>
+
+G_BEGIN_DECLS
+
+#define POLKIT_BACKEND_TYPE_PROVIDER_AUTHORITY                                \
+  (polkit_backend_provider_authority_get_type ())
+#define POLKIT_BACKEND_PROVIDER_AUTHORITY(o)                                  \
+  (G_TYPE_CHECK_INSTANCE_CAST ((o), POLKIT_BACKEND_TYPE_PROVIDER_AUTHORITY,   \
+                               PolkitBackendProviderAuthority))
+#define POLKIT_BACKEND_PROVIDER_AUTHORITY_CLASS(k)                            \
+  (G_TYPE_CHECK_CLASS_CAST ((k), POLKIT_BACKEND_TYPE_PROVIDER_AUTHORITY,      \
+                            PolkitBackendProviderAuthorityClass))
+#define POLKIT_BACKEND_PROVIDER_AUTHORITY_GET_CLASS(o)                        \
+  (G_TYPE_INSTANCE_GET_CLASS ((o), POLKIT_BACKEND_TYPE_PROVIDER_AUTHORITY,    \
+                              PolkitBackendProviderAuthorityClass))
+#define POLKIT_BACKEND_IS_PROVIDER_AUTHORITY(o)                               \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((o), POLKIT_BACKEND_TYPE_PROVIDER_AUTHORITY))
+#define POLKIT_BACKEND_IS_PROVIDER_AUTHORITY_CLASS(k)                         \
+  (G_TYPE_CHECK_CLASS_TYPE ((k), POLKIT_BACKEND_TYPE_PROVIDER_AUTHORITY))
+
+typedef struct _PolkitBackendProviderAuthorityClass
+    PolkitBackendProviderAuthorityClass;
+typedef struct _PolkitBackendProviderAuthorityPrivate
+    PolkitBackendProviderAuthorityPrivate;
+
+/**
+ * PolkitBackendProviderAuthority:
+ *
+ * The #PolkitBackendProviderAuthority struct should not be accessed
+ * directly.
+ */
+struct _PolkitBackendProviderAuthority
+{
+  /*< private >*/
+  PolkitBackendKeyfileAuthority parent_instance;
+  PolkitBackendProviderAuthorityPrivate *priv;
+};
+
+/**
+ * PolkitBackendProviderAuthorityClass:
+ * @parent_class: The parent class.
+ *
+ * Class structure for #PolkitBackendProviderAuthority.
+ */
+struct _PolkitBackendProviderAuthorityClass
+{
+  /*< public >*/
+  PolkitBackendKeyfileAuthorityClass parent_class;
+};
+
+GType polkit_backend_provider_authority_get_type (void) G_GNUC_CONST;
+
+G_END_DECLS
+
+#endif /* __POLKIT_BACKEND_PROVIDER_AUTHORITY_H */
@@ -27,10 +27,13 @@
 #include <glib/gstdio.h>
 #include <systemd/sd-login.h>
 #include <stdlib.h>
+#include <poll.h>
 
 #include <polkit/polkit.h>
 #include <polkit/polkitprivate.h>
 #include "polkitbackendsessionmonitor.h"
+#include "polkitbackendbusnamecache.h"
+#include "polkitbackendprobes.h"
 
 /* <internal>
  * SECTION:polkitbackendsessionmonitor
@@ -38,8 +41,43 @@
  * @short_description: Monitor sessions
  *
  * The #PolkitBackendSessionMonitor class is a utility class to track and monitor sessions.
+ *
+ * What logind says about processes and sessions is remembered until it
+ * reports a change, so that repeated checks from the same process don't
+ * read cgroup files under /proc and state files under /run each time.
+ * Lookups may happen from any thread.
+ *
+ * While a change is reported but not yet dispatched to the main loop,
+ * sessions are looked up afresh and nothing learnt is remembered.
  */
 
+/* Processes and sessions remembered, at most */
+#define SESSION_CACHE_SIZE 1024
+
+typedef struct
+{
+  gchar *session_id; /* NULL if the process is in no session */
+} ProcessEntry;
+
+/* Seats, classes and types are interned, there are only ever a few */
+typedef struct
+{
+  gboolean is_local;
+  gboolean is_active;
+  gboolean has_uid;
+  uid_t uid;
+  const gchar *seat;
+  const gchar *session_class;
+  const gchar *session_type;
+} SessionEntry;
+
+static void
+process_entry_free (ProcessEntry *entry)
+{
+  g_free (entry->session_id);
+  g_free (entry);
+}
+
 typedef struct
 {
   GSource source;
@@ -105,6 +143,7 @@ sd_source_new (void)
 
   source = g_source_new (&sd_source_funcs, sizeof (SdSource));
   sd_source = (SdSource *)source;
+  sd_source->pollfd.fd = -1;
 
   if ((ret = sd_login_monitor_new (NULL, &sd_source->monitor)) < 0)
     {
@@ -126,7 +165,18 @@ struct _PolkitBackendSessionMonitor
 
   GDBusConnection *system_bus;
 
+  PolkitBackendBusNameCache *bus_names;
+
   GSource *sd_source;
+
+  /* protects everything below */
+  GMutex cache_lock;
+  /* "pid:start_time" -> ProcessEntry */
+  GHashTable *processes;
+  /* session id -> SessionEntry */
+  GHashTable *sessions;
+  /* bumped on every change, so that lookups racing with one aren't stored */
+  guint generation;
 };
 
 struct _PolkitBackendSessionMonitorClass
@@ -154,6 +204,12 @@ sessions_changed (gpointer user_data)
 {
   PolkitBackendSessionMonitor *monitor = POLKIT_BACKEND_SESSION_MONITOR (user_data);
 
+  g_mutex_lock (&monitor->cache_lock);
+  g_hash_table_remove_all (monitor->processes);
+  g_hash_table_remove_all (monitor->sessions);
+  monitor->generation++;
+  g_mutex_unlock (&monitor->cache_lock);
+
   g_signal_emit (monitor, signals[CHANGED_SIGNAL], 0);
 
   return TRUE;
@@ -165,6 +221,8 @@ polkit_backend_session_monitor_init (PolkitBackendSessionMonitor *monitor)
 {
   GError *error;
 
+  monitor->bus_names = polkit_backend_bus_name_cache_new ();
+
   error = NULL;
   monitor->system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
   if (monitor->system_bus == NULL)
@@ -173,6 +231,10 @@ polkit_backend_session_monitor_init (PolkitBackendSessionMonitor *monitor)
       g_error_free (error);
     }
 
+  g_mutex_init (&monitor->cache_lock);
+  monitor->processes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) process_entry_free);
+  monitor->sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
   monitor->sd_source = sd_source_new ();
   g_source_set_callback (monitor->sd_source, sessions_changed, monitor, NULL);
   g_source_attach (monitor->sd_source, NULL);
@@ -192,6 +254,12 @@ polkit_backend_session_monitor_finalize (GObject *object)
       g_source_unref (monitor->sd_source);
     }
 
+  g_hash_table_unref (monitor->processes);
+  g_hash_table_unref (monitor->sessions);
+  g_mutex_clear (&monitor->cache_lock);
+
+  polkit_backend_bus_name_cache_free (monitor->bus_names);
+
   if (G_OBJECT_CLASS (polkit_backend_session_monitor_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (polkit_backend_session_monitor_parent_class)->finalize (object);
 }
@@ -234,11 +302,155 @@ polkit_backend_session_monitor_new (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Makes room for another entry in @table, which must be locked */
+static void
+session_cache_make_room (GHashTable *table)
+{
+  if (g_hash_table_size (table) >= SESSION_CACHE_SIZE)
+    g_hash_table_remove_all (table);
+}
+
+/* Whether logind reported a change that sessions_changed() hasn't seen yet */
+static gboolean
+session_cache_change_pending (PolkitBackendSessionMonitor *monitor)
+{
+  SdSource *sd_source = (SdSource *) monitor->sd_source;
+  struct pollfd pollfd;
+
+  /* without a login monitor nothing would ever be forgotten */
+  if (sd_source->pollfd.fd < 0)
+    return TRUE;
+
+  pollfd.fd = sd_source->pollfd.fd;
+  pollfd.events = POLLIN;
+  pollfd.revents = 0;
+  return poll (&pollfd, 1, 0) != 0;
+}
+
+/* Checks whether *any* of the current sessions of @uid are active */
+static gboolean
+lookup_session_is_active (const gchar *session_id,
+                          gboolean     has_uid,
+                          uid_t        uid)
+{
+  char *state;
+  gboolean is_active;
+
+  if (!has_uid)
+    goto fallback;
+
+  g_debug ("Session %s has UID %u.", session_id, uid);
+
+  if (sd_uid_get_state (uid, &state) < 0)
+    goto fallback;
+
+  g_debug ("UID %u has state %s.", uid, state);
+
+  is_active = (g_strcmp0 (state, "active") == 0);
+  free (state);
+
+  return is_active;
+
+fallback:
+  /* Fall back to checking the session. This is not ideal, since the user
+   * might have multiple sessions, and we cannot guarantee to have chosen
+   * the active one.
+   *
+   * See: https://bugs.freedesktop.org/show_bug.cgi?id=76358. */
+  return sd_session_is_active (session_id) > 0;
+}
+
+/* Gets the state of @session_id as of the last change logind reported */
+static SessionEntry
+lookup_session (PolkitBackendSessionMonitor *monitor,
+                const gchar                 *session_id)
+{
+  SessionEntry entry;
+  SessionEntry *cached;
+  char *seat;
+  char *value;
+  guint generation;
+
+  g_mutex_lock (&monitor->cache_lock);
+  cached = g_hash_table_lookup (monitor->sessions, session_id);
+  if (cached != NULL)
+    entry = *cached;
+  generation = monitor->generation;
+  g_mutex_unlock (&monitor->cache_lock);
+
+  /* an entry may predate a change that is still on its way */
+  if (session_cache_change_pending (monitor))
+    cached = NULL;
+
+  if (cached != NULL)
+    return entry;
+
+  entry.is_local = FALSE;
+  entry.seat = NULL;
+  if (sd_session_get_seat (session_id, &seat) == 0)
+    {
+      entry.seat = g_intern_string (seat);
+      free (seat);
+      entry.is_local = TRUE;
+    }
+  entry.session_class = NULL;
+  if (sd_session_get_class (session_id, &value) >= 0)
+    {
+      entry.session_class = g_intern_string (value);
+      free (value);
+    }
+  entry.session_type = NULL;
+  if (sd_session_get_type (session_id, &value) >= 0)
+    {
+      entry.session_type = g_intern_string (value);
+      free (value);
+    }
+  entry.has_uid = sd_session_get_uid (session_id, &entry.uid) >= 0;
+  entry.is_active = lookup_session_is_active (session_id, entry.has_uid, entry.uid);
+
+  /* Only remember what was found if no change came in meanwhile. One
+   * that comes in later empties the cache once it is dispatched, and
+   * until then the entry isn't used.
+   */
+  g_mutex_lock (&monitor->cache_lock);
+  if (generation == monitor->generation && !session_cache_change_pending (monitor))
+    {
+      cached = g_new (SessionEntry, 1);
+      *cached = entry;
+      session_cache_make_room (monitor->sessions);
+      g_hash_table_replace (monitor->sessions, g_strdup (session_id), cached);
+    }
+  g_mutex_unlock (&monitor->cache_lock);
+
+  return entry;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 GList *
 polkit_backend_session_monitor_get_sessions (PolkitBackendSessionMonitor *monitor)
 {
-  /* TODO */
-  return NULL;
+  GList *ret;
+  gchar **sessions;
+  gint n_sessions;
+  gint n;
+
+  ret = NULL;
+  sessions = NULL;
+  n_sessions = sd_get_sessions (&sessions);
+  if (n_sessions < 0)
+    goto out;
+
+  for (n = 0; n < n_sessions; n++)
+    {
+      ret = g_list_prepend (ret, polkit_unix_session_new (sessions[n]));
+      free (sessions[n]);
+    }
+  free (sessions);
+  ret = g_list_reverse (ret);
+
+ out:
+  return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -274,6 +486,8 @@ polkit_backend_session_monitor_get_user_for_subject (PolkitBackendSessionMonitor
   ret = NULL;
   matches = FALSE;
 
+  POLKIT_BACKEND_PROBE (session__monitor__get__user__entry);
+
   if (POLKIT_IS_UNIX_PROCESS (subject))
     {
       gint subject_uid, current_uid;
@@ -295,19 +509,20 @@ polkit_backend_session_monitor_get_user_for_subject (PolkitBackendSessionMonitor
 	  g_propagate_error (error, local_error);
 	  goto out;
 	}
-      ret = polkit_unix_user_new (subject_uid);
+      ret = polkit_unix_user_new_shared (subject_uid);
       matches = (subject_uid == current_uid);
     }
   else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
     {
-      ret = (PolkitIdentity*)polkit_system_bus_name_get_user_sync (POLKIT_SYSTEM_BUS_NAME (subject), NULL, error);
+      ret = polkit_backend_bus_name_cache_get_user (monitor->bus_names, POLKIT_SYSTEM_BUS_NAME (subject), error);
       matches = TRUE;
     }
   else if (POLKIT_IS_UNIX_SESSION (subject))
     {
-      uid_t uid;
+      SessionEntry session;
 
-      if (sd_session_get_uid (polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (subject)), &uid) < 0)
+      session = lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (subject)));
+      if (!session.has_uid)
         {
           g_set_error (error,
                        POLKIT_ERROR,
@@ -316,7 +531,7 @@ polkit_backend_session_monitor_get_user_for_subject (PolkitBackendSessionMonitor
           goto out;
         }
 
-      ret = polkit_unix_user_new (uid);
+      ret = polkit_unix_user_new_shared (session.uid);
       matches = TRUE;
     }
 
@@ -325,6 +540,7 @@ polkit_backend_session_monitor_get_user_for_subject (PolkitBackendSessionMonitor
     {
       *result_matches = matches;
     }
+  POLKIT_BACKEND_PROBE2 (session__monitor__get__user__return, ret != NULL, matches);
   return ret;
 }
 
@@ -348,16 +564,22 @@ polkit_backend_session_monitor_get_session_for_subject (PolkitBackendSessionMoni
   PolkitSubject *session = NULL;
   char *session_id = NULL;
   pid_t pid;
+  guint64 start_time;
+  gchar *key = NULL;
+  ProcessEntry *entry;
+  guint generation = 0;
 #if HAVE_SD_UID_GET_DISPLAY
   uid_t uid;
 #endif
 
+  POLKIT_BACKEND_PROBE (session__monitor__get__session__entry);
+
   if (POLKIT_IS_UNIX_PROCESS (subject))
     process = POLKIT_UNIX_PROCESS (subject); /* We already have a process */
   else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
     {
       /* Convert bus name to process */
-      tmp_process = (PolkitUnixProcess*)polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject), NULL, error);
+      tmp_process = (PolkitUnixProcess*)polkit_backend_bus_name_cache_get_process (monitor->bus_names, POLKIT_SYSTEM_BUS_NAME (subject), error);
       if (!tmp_process)
 	goto out;
       process = tmp_process;
@@ -375,43 +597,105 @@ polkit_backend_session_monitor_get_session_for_subject (PolkitBackendSessionMoni
   g_assert (process != NULL);
   pid = polkit_unix_process_get_pid (process);
 
+  /* the start time tells a pid apart from a later process reusing it */
+  start_time = polkit_unix_process_get_start_time (process);
+  if (start_time != 0)
+    {
+      key = g_strdup_printf ("%d:%" G_GUINT64_FORMAT, (gint) pid, start_time);
+
+      g_mutex_lock (&monitor->cache_lock);
+      entry = g_hash_table_lookup (monitor->processes, key);
+      if (entry != NULL && entry->session_id != NULL)
+        session = polkit_unix_session_new (entry->session_id);
+      generation = monitor->generation;
+      g_mutex_unlock (&monitor->cache_lock);
+
+      if (entry != NULL)
+        goto out;
+    }
+
   if (sd_pid_get_session (pid, &session_id) >= 0)
     {
       session = polkit_unix_session_new (session_id);
-      goto out;
+      goto store;
     }
 
 #if HAVE_SD_UID_GET_DISPLAY
   /* Now do process -> uid -> graphical session (systemd version 213)*/
   if (sd_pid_get_owner_uid (pid, &uid) < 0)
-    goto out;
+    goto store;
 
   if (sd_uid_get_display (uid, &session_id) >= 0)
     {
       session = polkit_unix_session_new (session_id);
-      goto out;
+      goto store;
     }
 #endif
 
+ store:
+  if (key != NULL)
+    {
+      g_mutex_lock (&monitor->cache_lock);
+      if (generation == monitor->generation)
+        {
+          entry = g_new0 (ProcessEntry, 1);
+          entry->session_id = g_strdup (session_id);
+          session_cache_make_room (monitor->processes);
+          g_hash_table_replace (monitor->processes, key, entry);
+          key = NULL;
+        }
+      g_mutex_unlock (&monitor->cache_lock);
+    }
+
  out:
+  g_free (key);
   free (session_id);
   if (tmp_process) g_object_unref (tmp_process);
+  POLKIT_BACKEND_PROBE1 (session__monitor__get__session__return, session != NULL);
   return session;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * polkit_backend_session_monitor_get_process_for_bus_name:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @system_bus_name: A #PolkitSystemBusName.
+ * @error: Return location for error.
+ *
+ * Gets the process behind @system_bus_name. What the bus says about a
+ * unique name is remembered until polkit_backend_session_monitor_forget_bus_name()
+ * is called for it.
+ *
+ * Returns: %NULL if @error is set otherwise a #PolkitUnixProcess that should be freed with g_object_unref().
+ */
+PolkitSubject *
+polkit_backend_session_monitor_get_process_for_bus_name (PolkitBackendSessionMonitor *monitor,
+                                                         PolkitSystemBusName         *system_bus_name,
+                                                         GError                     **error)
+{
+  return polkit_backend_bus_name_cache_get_process (monitor->bus_names, system_bus_name, error);
+}
+
+/**
+ * polkit_backend_session_monitor_forget_bus_name:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @name: A unique name that went away.
+ *
+ * Forgets what is known about @name.
+ */
+void
+polkit_backend_session_monitor_forget_bus_name (PolkitBackendSessionMonitor *monitor,
+                                                const gchar                 *name)
+{
+  polkit_backend_bus_name_cache_remove (monitor->bus_names, name);
+}
+
 gboolean
 polkit_backend_session_monitor_is_session_local (PolkitBackendSessionMonitor *monitor,
                                                  PolkitSubject               *session)
 {
-  char *seat;
-
-  if (!sd_session_get_seat (polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session)), &seat))
-    {
-      free (seat);
-      return TRUE;
-    }
-
-  return FALSE;
+  return lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session))).is_local;
 }
 
 
@@ -420,36 +704,75 @@ polkit_backend_session_monitor_is_session_active (PolkitBackendSessionMonitor *m
                                                   PolkitSubject               *session)
 {
   const char *session_id;
-  char *state;
-  uid_t uid;
-  gboolean is_active = FALSE;
 
   session_id = polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session));
 
   g_debug ("Checking whether session %s is active.", session_id);
 
-  /* Check whether *any* of the user's current sessions are active. */
-  if (sd_session_get_uid (session_id, &uid) < 0)
-    goto fallback;
-
-  g_debug ("Session %s has UID %u.", session_id, uid);
-
-  if (sd_uid_get_state (uid, &state) < 0)
-    goto fallback;
-
-  g_debug ("UID %u has state %s.", uid, state);
+  return lookup_session (monitor, session_id).is_active;
+}
 
-  is_active = (g_strcmp0 (state, "active") == 0);
-  free (state);
+/**
+ * polkit_backend_session_monitor_session_exists:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @session: A #PolkitUnixSession.
+ *
+ * Checks whether logind still knows about @session, closing or not.
+ *
+ * Returns: %TRUE if @session exists.
+ */
+gboolean
+polkit_backend_session_monitor_session_exists (PolkitBackendSessionMonitor *monitor,
+                                               PolkitSubject               *session)
+{
+  /* every session logind knows of has a user */
+  return lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session))).has_uid;
+}
 
-  return is_active;
+/**
+ * polkit_backend_session_monitor_get_session_seat:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @session: A #PolkitUnixSession.
+ *
+ * Gets the seat @session is on, as of the last change logind reported.
+ *
+ * Returns: An interned string, or %NULL if @session is on no seat.
+ */
+const gchar *
+polkit_backend_session_monitor_get_session_seat (PolkitBackendSessionMonitor *monitor,
+                                                 PolkitSubject               *session)
+{
+  return lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session))).seat;
+}
 
-fallback:
-  /* Fall back to checking the session. This is not ideal, since the user
-   * might have multiple sessions, and we cannot guarantee to have chosen
-   * the active one.
-   *
-   * See: https://bugs.freedesktop.org/show_bug.cgi?id=76358. */
-  return sd_session_is_active (session_id);
+/**
+ * polkit_backend_session_monitor_get_session_class:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @session: A #PolkitUnixSession.
+ *
+ * Gets the class of @session, such as "user" or "greeter".
+ *
+ * Returns: An interned string, or %NULL if not known.
+ */
+const gchar *
+polkit_backend_session_monitor_get_session_class (PolkitBackendSessionMonitor *monitor,
+                                                  PolkitSubject               *session)
+{
+  return lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session))).session_class;
 }
 
+/**
+ * polkit_backend_session_monitor_get_session_type:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @session: A #PolkitUnixSession.
+ *
+ * Gets the type of @session, such as "x11", "wayland" or "tty".
+ *
+ * Returns: An interned string, or %NULL if not known.
+ */
+const gchar *
+polkit_backend_session_monitor_get_session_type (PolkitBackendSessionMonitor *monitor,
+                                                 PolkitSubject               *session)
+{
+  return lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session))).session_type;
+}
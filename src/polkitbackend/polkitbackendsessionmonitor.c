@@ -29,26 +29,63 @@
 #include <polkit/polkit.h>
 #include <polkit/polkitprivate.h>
 #include "polkitbackendsessionmonitor.h"
+#include "polkitbackendbusnamecache.h"
+#include "polkitbackendprobes.h"
 
 #define CKDB_PATH "/var/run/ConsoleKit/database"
 
+/* Processes and sessions remembered, at most */
+#define SESSION_CACHE_SIZE 1024
+
 /* <internal>
  * SECTION:polkitbackendsessionmonitor
  * @title: PolkitBackendSessionMonitor
  * @short_description: Monitor sessions
  *
  * The #PolkitBackendSessionMonitor class is a utility class to track and monitor sessions.
+ *
+ * The session of a process and the properties of a session are
+ * remembered, so that repeated checks neither call into ConsoleKit nor
+ * look at its database. ConsoleKit signals keep them current: the
+ * activity of a session is updated by ActiveChanged, and whatever
+ * refers to a session is forgotten by SessionRemoved. Everything is
+ * forgotten when the database changes or ConsoleKit goes away.
  */
 
+/* Seats, classes and types are interned, there are only ever a few */
+typedef struct
+{
+  gboolean is_local;
+  gboolean is_active;
+  gint uid;
+  const gchar *seat;
+  const gchar *session_class;
+  const gchar *session_type;
+} SessionEntry;
+
 struct _PolkitBackendSessionMonitor
 {
   GObject parent_instance;
 
   GDBusConnection *system_bus;
 
+  PolkitBackendBusNameCache *bus_names;
+
+  guint ck_signal_ids[3];
+
+  /* Sessions are looked up from worker threads too, this protects
+   * everything below */
+  GMutex database_lock;
   GKeyFile *database;
   GFileMonitor *database_monitor;
   time_t database_mtime;
+
+  /* "pid:start_time" -> session id, NULL if not caching */
+  GHashTable *processes;
+  /* session id -> SessionEntry, NULL if not caching */
+  GHashTable *sessions;
+  /* bumped on every change, so that lookups racing with one aren't stored */
+  guint generation;
 };
 
 struct _PolkitBackendSessionMonitorClass
@@ -155,20 +192,79 @@ on_file_monitor_changed (GFileMonitor     *file_monitor,
   PolkitBackendSessionMonitor *monitor = POLKIT_BACKEND_SESSION_MONITOR (user_data);
 
   /* throw away cache */
+  g_mutex_lock (&monitor->database_lock);
   if (monitor->database != NULL)
     {
       g_key_file_free (monitor->database);
       monitor->database = NULL;
     }
+  if (monitor->sessions != NULL)
+    g_hash_table_remove_all (monitor->sessions);
+  monitor->generation++;
+  g_mutex_unlock (&monitor->database_lock);
   g_signal_emit (monitor, signals[CHANGED_SIGNAL], 0);
 }
 
+static void
+on_ck_signal (GDBusConnection *connection,
+              const gchar     *sender_name,
+              const gchar     *object_path,
+              const gchar     *interface_name,
+              const gchar     *signal_name,
+              GVariant        *parameters,
+              gpointer         user_data)
+{
+  PolkitBackendSessionMonitor *monitor = POLKIT_BACKEND_SESSION_MONITOR (user_data);
+
+  g_mutex_lock (&monitor->database_lock);
+
+  if (g_strcmp0 (signal_name, "ActiveChanged") == 0 &&
+      g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)")))
+    {
+      SessionEntry *entry;
+
+      entry = g_hash_table_lookup (monitor->sessions, object_path);
+      if (entry != NULL)
+        g_variant_get (parameters, "(b)", &entry->is_active);
+    }
+  else if (g_strcmp0 (signal_name, "SessionRemoved") == 0 &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(o)")))
+    {
+      GHashTableIter iter;
+      const gchar *session_id;
+      const gchar *process_session_id;
+
+      /* sessions added need nothing, failed lookups aren't remembered */
+      g_variant_get (parameters, "(&o)", &session_id);
+      g_hash_table_remove (monitor->sessions, session_id);
+      g_hash_table_iter_init (&iter, monitor->processes);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &process_session_id))
+        {
+          if (g_strcmp0 (process_session_id, session_id) == 0)
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+  else if (g_strcmp0 (signal_name, "NameOwnerChanged") == 0)
+    {
+      /* ConsoleKit went away or was replaced */
+      g_hash_table_remove_all (monitor->processes);
+      g_hash_table_remove_all (monitor->sessions);
+    }
+
+  monitor->generation++;
+  g_mutex_unlock (&monitor->database_lock);
+}
+
 static void
 polkit_backend_session_monitor_init (PolkitBackendSessionMonitor *monitor)
 {
   GError *error;
   GFile *file;
 
+  g_mutex_init (&monitor->database_lock);
+
+  monitor->bus_names = polkit_backend_bus_name_cache_new ();
+
   error = NULL;
   monitor->system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
   if (monitor->system_bus == NULL)
@@ -176,6 +272,46 @@ polkit_backend_session_monitor_init (PolkitBackendSessionMonitor *monitor)
       g_printerr ("Error getting system bus: %s", error->message);
       g_error_free (error);
     }
+  else
+    {
+      /* without the signals nothing would ever be forgotten */
+      monitor->processes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+      monitor->sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+      monitor->ck_signal_ids[0] =
+        g_dbus_connection_signal_subscribe (monitor->system_bus,
+                                            "org.freedesktop.ConsoleKit",         /* sender */
+                                            "org.freedesktop.ConsoleKit.Session", /* interface */
+                                            "ActiveChanged",                      /* member */
+                                            NULL,                                 /* path */
+                                            NULL,                                 /* arg0 */
+                                            G_DBUS_SIGNAL_FLAGS_NONE,
+                                            on_ck_signal,
+                                            monitor,
+                                            NULL);
+      monitor->ck_signal_ids[1] =
+        g_dbus_connection_signal_subscribe (monitor->system_bus,
+                                            "org.freedesktop.ConsoleKit",         /* sender */
+                                            "org.freedesktop.ConsoleKit.Manager", /* interface */
+                                            "SessionRemoved",                     /* member */
+                                            "/org/freedesktop/ConsoleKit/Manager", /* path */
+                                            NULL,                                 /* arg0 */
+                                            G_DBUS_SIGNAL_FLAGS_NONE,
+                                            on_ck_signal,
+                                            monitor,
+                                            NULL);
+      monitor->ck_signal_ids[2] =
+        g_dbus_connection_signal_subscribe (monitor->system_bus,
+                                            "org.freedesktop.DBus",               /* sender */
+                                            "org.freedesktop.DBus",               /* interface */
+                                            "NameOwnerChanged",                   /* member */
+                                            "/org/freedesktop/DBus",              /* path */
+                                            "org.freedesktop.ConsoleKit",         /* arg0 */
+                                            G_DBUS_SIGNAL_FLAGS_NONE,
+                                            on_ck_signal,
+                                            monitor,
+                                            NULL);
+    }
 
   error = NULL;
   if (!ensure_database (monitor, &error))
@@ -211,7 +347,18 @@ polkit_backend_session_monitor_finalize (GObject *object)
   PolkitBackendSessionMonitor *monitor = POLKIT_BACKEND_SESSION_MONITOR (object);
 
   if (monitor->system_bus != NULL)
-    g_object_unref (monitor->system_bus);
+    {
+      guint n;
+
+      for (n = 0; n < G_N_ELEMENTS (monitor->ck_signal_ids); n++)
+        g_dbus_connection_signal_unsubscribe (monitor->system_bus, monitor->ck_signal_ids[n]);
+      g_object_unref (monitor->system_bus);
+    }
+
+  if (monitor->processes != NULL)
+    g_hash_table_unref (monitor->processes);
+  if (monitor->sessions != NULL)
+    g_hash_table_unref (monitor->sessions);
 
   if (monitor->database_monitor != NULL)
     g_object_unref (monitor->database_monitor);
@@ -219,6 +366,10 @@ polkit_backend_session_monitor_finalize (GObject *object)
   if (monitor->database != NULL)
     g_key_file_free (monitor->database);
 
+  g_mutex_clear (&monitor->database_lock);
+
+  polkit_backend_bus_name_cache_free (monitor->bus_names);
+
   if (G_OBJECT_CLASS (polkit_backend_session_monitor_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (polkit_backend_session_monitor_parent_class)->finalize (object);
 }
@@ -264,8 +415,201 @@ polkit_backend_session_monitor_new (void)
 GList *
 polkit_backend_session_monitor_get_sessions (PolkitBackendSessionMonitor *monitor)
 {
-  /* TODO */
-  return NULL;
+  GList *ret;
+  gchar **groups;
+  GError *error;
+  guint n;
+
+  ret = NULL;
+  groups = NULL;
+
+  g_mutex_lock (&monitor->database_lock);
+
+  error = NULL;
+  if (!ensure_database (monitor, &error))
+    {
+      g_printerr ("Error loading " CKDB_PATH ": %s\n", error->message);
+      g_error_free (error);
+      goto out;
+    }
+
+  groups = g_key_file_get_groups (monitor->database, NULL);
+  for (n = 0; groups[n] != NULL; n++)
+    {
+      if (g_str_has_prefix (groups[n], "Session "))
+        ret = g_list_prepend (ret, polkit_unix_session_new (groups[n] + strlen ("Session ")));
+    }
+  ret = g_list_reverse (ret);
+
+ out:
+  g_mutex_unlock (&monitor->database_lock);
+  g_strfreev (groups);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Makes room for another entry in @table, which must be locked */
+static void
+session_cache_make_room (GHashTable *table)
+{
+  if (g_hash_table_size (table) >= SESSION_CACHE_SIZE)
+    g_hash_table_remove_all (table);
+}
+
+/* Gets an interned string from the CK database, or NULL if not set */
+static const gchar *
+lookup_session_string (PolkitBackendSessionMonitor *monitor,
+                       const gchar                 *group,
+                       const gchar                 *key)
+{
+  const gchar *ret;
+  gchar *value;
+
+  ret = NULL;
+  value = g_key_file_get_string (monitor->database, group, key, NULL);
+  if (value != NULL && value[0] != '\0')
+    ret = g_intern_string (value);
+  g_free (value);
+
+  return ret;
+}
+
+/* Gets the properties of @session_id, from the CK database if not known yet */
+static gboolean
+lookup_session (PolkitBackendSessionMonitor  *monitor,
+                const gchar                  *session_id,
+                SessionEntry                 *out_entry,
+                GError                      **error)
+{
+  SessionEntry *cached;
+  SessionEntry entry;
+  gchar *group;
+  GError *local_error;
+  gboolean ret;
+
+  ret = FALSE;
+  group = NULL;
+
+  g_mutex_lock (&monitor->database_lock);
+
+  cached = monitor->sessions != NULL ? g_hash_table_lookup (monitor->sessions, session_id) : NULL;
+  if (cached != NULL)
+    {
+      *out_entry = *cached;
+      ret = TRUE;
+      goto out;
+    }
+
+  if (!ensure_database (monitor, error))
+    {
+      g_prefix_error (error, "Error ensuring CK database at " CKDB_PATH ": ");
+      goto out;
+    }
+
+  group = g_strdup_printf ("Session %s", session_id);
+  local_error = NULL;
+  entry.is_local = g_key_file_get_boolean (monitor->database, group, "is_local", &local_error);
+  if (local_error == NULL)
+    entry.is_active = g_key_file_get_boolean (monitor->database, group, "is_active", &local_error);
+  if (local_error == NULL)
+    entry.uid = g_key_file_get_integer (monitor->database, group, "uid", &local_error);
+  if (local_error != NULL)
+    {
+      g_propagate_prefixed_error (error, local_error, "Error looking up %s using " CKDB_PATH ": ", group);
+      goto out;
+    }
+  /* not every version of ConsoleKit records these */
+  entry.seat = lookup_session_string (monitor, group, "seat");
+  entry.session_class = lookup_session_string (monitor, group, "session_class");
+  entry.session_type = lookup_session_string (monitor, group, "session_type");
+
+  /* read under the lock, so no signal or database change came in meanwhile */
+  if (monitor->sessions != NULL)
+    {
+      cached = g_new (SessionEntry, 1);
+      *cached = entry;
+      session_cache_make_room (monitor->sessions);
+      g_hash_table_replace (monitor->sessions, g_strdup (session_id), cached);
+    }
+
+  *out_entry = entry;
+  ret = TRUE;
+
+ out:
+  g_mutex_unlock (&monitor->database_lock);
+  g_free (group);
+  return ret;
+}
+
+/* Asks ConsoleKit for the session of @process, unless it is known already */
+static PolkitSubject *
+lookup_session_for_process (PolkitBackendSessionMonitor  *monitor,
+                            PolkitUnixProcess            *process,
+                            GError                      **error)
+{
+  PolkitSubject *session;
+  const gchar *cached;
+  const gchar *session_id;
+  GVariant *result;
+  guint64 start_time;
+  guint generation;
+  gchar *key;
+
+  session = NULL;
+  key = NULL;
+  generation = 0;
+
+  /* without a start time, the pid may be reused behind our back */
+  start_time = polkit_unix_process_get_start_time (process);
+  if (start_time != 0 && monitor->processes != NULL)
+    {
+      key = g_strdup_printf ("%d:%" G_GUINT64_FORMAT, polkit_unix_process_get_pid (process), start_time);
+
+      g_mutex_lock (&monitor->database_lock);
+      cached = g_hash_table_lookup (monitor->processes, key);
+      if (cached != NULL)
+        session = polkit_unix_session_new (cached);
+      generation = monitor->generation;
+      g_mutex_unlock (&monitor->database_lock);
+
+      if (session != NULL)
+        goto out;
+    }
+
+  result = g_dbus_connection_call_sync (monitor->system_bus,
+                                        "org.freedesktop.ConsoleKit",
+                                        "/org/freedesktop/ConsoleKit/Manager",
+                                        "org.freedesktop.ConsoleKit.Manager",
+                                        "GetSessionForUnixProcess",
+                                        g_variant_new ("(u)", polkit_unix_process_get_pid (process)),
+                                        G_VARIANT_TYPE ("(o)"),
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1, /* timeout_msec */
+                                        NULL, /* GCancellable */
+                                        error);
+  if (result == NULL)
+    goto out;
+  g_variant_get (result, "(&o)", &session_id);
+  session = polkit_unix_session_new (session_id);
+
+  /* the session may have gone away while we were asking */
+  if (key != NULL)
+    {
+      g_mutex_lock (&monitor->database_lock);
+      if (generation == monitor->generation)
+        {
+          session_cache_make_room (monitor->processes);
+          g_hash_table_replace (monitor->processes, key, g_strdup (session_id));
+          key = NULL;
+        }
+      g_mutex_unlock (&monitor->database_lock);
+    }
+  g_variant_unref (result);
+
+ out:
+  g_free (key);
+  return session;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -302,6 +646,8 @@ polkit_backend_session_monitor_get_user_for_subject (PolkitBackendSessionMonitor
   ret = NULL;
   matches = FALSE;
 
+  POLKIT_BACKEND_PROBE (session__monitor__get__user__entry);
+
   if (POLKIT_IS_UNIX_PROCESS (subject))
     {
       gint subject_uid, current_uid;
@@ -322,37 +668,25 @@ polkit_backend_session_monitor_get_user_for_subject (PolkitBackendSessionMonitor
 	  g_propagate_error (error, local_error);
 	  goto out;
 	}
-      ret = polkit_unix_user_new (subject_uid);
+      ret = polkit_unix_user_new_shared (subject_uid);
       matches = (subject_uid == current_uid);
     }
   else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
     {
-      ret = (PolkitIdentity*)polkit_system_bus_name_get_user_sync (POLKIT_SYSTEM_BUS_NAME (subject), NULL, error);
+      ret = polkit_backend_bus_name_cache_get_user (monitor->bus_names, POLKIT_SYSTEM_BUS_NAME (subject), error);
       matches = TRUE;
     }
   else if (POLKIT_IS_UNIX_SESSION (subject))
     {
-      gint uid;
-      gchar *group;
+      SessionEntry entry;
 
-      if (!ensure_database (monitor, error))
+      if (!lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (subject)), &entry, error))
         {
-          g_prefix_error (error, "Error getting user for session: Error ensuring CK database at " CKDB_PATH ": ");
+          g_prefix_error (error, "Error getting user for session: ");
           goto out;
         }
 
-      group = g_strdup_printf ("Session %s", polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (subject)));
-      local_error = NULL;
-      uid = g_key_file_get_integer (monitor->database, group, "uid", &local_error);
-      if (local_error != NULL)
-        {
-          g_propagate_prefixed_error (error, local_error, "Error getting uid using " CKDB_PATH ": ");
-          g_free (group);
-          goto out;
-        }
-      g_free (group);
-
-      ret = polkit_unix_user_new (uid);
+      ret = polkit_unix_user_new_shared (entry.uid);
       matches = TRUE;
     }
 
@@ -361,6 +695,7 @@ polkit_backend_session_monitor_get_user_for_subject (PolkitBackendSessionMonitor
     {
       *result_matches = matches;
     }
+  POLKIT_BACKEND_PROBE2 (session__monitor__get__user__return, ret != NULL, matches);
   return ret;
 }
 
@@ -383,65 +718,21 @@ polkit_backend_session_monitor_get_session_for_subject (PolkitBackendSessionMoni
 
   session = NULL;
 
+  POLKIT_BACKEND_PROBE (session__monitor__get__session__entry);
+
   if (POLKIT_IS_UNIX_PROCESS (subject))
     {
-      const gchar *session_id;
-      GVariant *result;
-      result = g_dbus_connection_call_sync (monitor->system_bus,
-                                            "org.freedesktop.ConsoleKit",
-                                            "/org/freedesktop/ConsoleKit/Manager",
-                                            "org.freedesktop.ConsoleKit.Manager",
-                                            "GetSessionForUnixProcess",
-                                            g_variant_new ("(u)", polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (subject))),
-                                            G_VARIANT_TYPE ("(o)"),
-                                            G_DBUS_CALL_FLAGS_NONE,
-                                            -1, /* timeout_msec */
-                                            NULL, /* GCancellable */
-                                            error);
-      if (result == NULL)
-        goto out;
-      g_variant_get (result, "(&o)", &session_id);
-      session = polkit_unix_session_new (session_id);
-      g_variant_unref (result);
+      session = lookup_session_for_process (monitor, POLKIT_UNIX_PROCESS (subject), error);
     }
   else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
     {
-      guint32 pid;
-      const gchar *session_id;
-      GVariant *result;
-
-      result = g_dbus_connection_call_sync (monitor->system_bus,
-                                            "org.freedesktop.DBus",
-                                            "/org/freedesktop/DBus",
-                                            "org.freedesktop.DBus",
-                                            "GetConnectionUnixProcessID",
-                                            g_variant_new ("(s)", polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (subject))),
-                                            G_VARIANT_TYPE ("(u)"),
-                                            G_DBUS_CALL_FLAGS_NONE,
-                                            -1, /* timeout_msec */
-                                            NULL, /* GCancellable */
-                                            error);
-      if (result == NULL)
-        goto out;
-      g_variant_get (result, "(u)", &pid);
-      g_variant_unref (result);
-
-      result = g_dbus_connection_call_sync (monitor->system_bus,
-                                            "org.freedesktop.ConsoleKit",
-                                            "/org/freedesktop/ConsoleKit/Manager",
-                                            "org.freedesktop.ConsoleKit.Manager",
-                                            "GetSessionForUnixProcess",
-                                            g_variant_new ("(u)", pid),
-                                            G_VARIANT_TYPE ("(o)"),
-                                            G_DBUS_CALL_FLAGS_NONE,
-                                            -1, /* timeout_msec */
-                                            NULL, /* GCancellable */
-                                            error);
-      if (result == NULL)
+      PolkitSubject *process;
+
+      process = polkit_backend_bus_name_cache_get_process (monitor->bus_names, POLKIT_SYSTEM_BUS_NAME (subject), error);
+      if (process == NULL)
         goto out;
-      g_variant_get (result, "(&o)", &session_id);
-      session = polkit_unix_session_new (session_id);
-      g_variant_unref (result);
+      session = lookup_session_for_process (monitor, POLKIT_UNIX_PROCESS (process), error);
+      g_object_unref (process);
     }
   else
     {
@@ -454,62 +745,196 @@ polkit_backend_session_monitor_get_session_for_subject (PolkitBackendSessionMoni
 
  out:
 
+  POLKIT_BACKEND_PROBE1 (session__monitor__get__session__return, session != NULL);
   return session;
 }
 
-static gboolean
-get_boolean (PolkitBackendSessionMonitor *monitor,
-             PolkitSubject               *session,
-             const gchar                 *key_name)
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * polkit_backend_session_monitor_get_process_for_bus_name:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @system_bus_name: A #PolkitSystemBusName.
+ * @error: Return location for error.
+ *
+ * Gets the process behind @system_bus_name. What the bus says about a
+ * unique name is remembered until polkit_backend_session_monitor_forget_bus_name()
+ * is called for it.
+ *
+ * Returns: %NULL if @error is set otherwise a #PolkitUnixProcess that should be freed with g_object_unref().
+ */
+PolkitSubject *
+polkit_backend_session_monitor_get_process_for_bus_name (PolkitBackendSessionMonitor *monitor,
+                                                         PolkitSystemBusName         *system_bus_name,
+                                                         GError                     **error)
 {
-  gboolean ret;
-  gchar *group;
-  GError *error;
+  return polkit_backend_bus_name_cache_get_process (monitor->bus_names, system_bus_name, error);
+}
 
-  ret = FALSE;
+/**
+ * polkit_backend_session_monitor_forget_bus_name:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @name: A unique name that went away.
+ *
+ * Forgets what is known about @name.
+ */
+void
+polkit_backend_session_monitor_forget_bus_name (PolkitBackendSessionMonitor *monitor,
+                                                const gchar                 *name)
+{
+  polkit_backend_bus_name_cache_remove (monitor->bus_names, name);
+}
 
-  group = g_strdup_printf ("Session %s", polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session)));
+static void
+print_session_error (PolkitSubject *session,
+                     GError        *error)
+{
+  g_printerr ("Error getting properties of session %s: %s\n",
+              polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session)),
+              error->message);
+  g_error_free (error);
+}
+
+gboolean
+polkit_backend_session_monitor_is_session_local  (PolkitBackendSessionMonitor *monitor,
+                                                  PolkitSubject               *session)
+{
+  SessionEntry entry;
+  GError *error;
 
   error = NULL;
-  if (!ensure_database (monitor, &error))
+  if (!lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session)), &entry, &error))
     {
-      g_printerr ("Error getting boolean `%s' in group `%s': Error ensuring CK database at " CKDB_PATH ": %s",
-                  key_name,
-                  group,
-                  error->message);
-      g_error_free (error);
-      goto out;
+      print_session_error (session, error);
+      return FALSE;
     }
 
+  return entry.is_local;
+}
+
+
+gboolean
+polkit_backend_session_monitor_is_session_active (PolkitBackendSessionMonitor *monitor,
+                                                  PolkitSubject               *session)
+{
+  SessionEntry entry;
+  GError *error;
+
   error = NULL;
-  ret = g_key_file_get_boolean (monitor->database, group, key_name, &error);
-  if (error != NULL)
+  if (!lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session)), &entry, &error))
     {
-      g_printerr ("Error looking %s using " CKDB_PATH " for %s: %s\n",
-                  key_name,
-                  group,
-                  error->message);
-      g_error_free (error);
-      goto out;
+      print_session_error (session, error);
+      return FALSE;
     }
 
- out:
-  g_free (group);
-  return ret;
+  return entry.is_active;
 }
 
+/**
+ * polkit_backend_session_monitor_session_exists:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @session: A #PolkitUnixSession.
+ *
+ * Checks whether the ConsoleKit database still has @session. If the
+ * database can't be read, @session is taken to exist.
+ *
+ * Returns: %TRUE if @session exists.
+ */
 gboolean
-polkit_backend_session_monitor_is_session_local  (PolkitBackendSessionMonitor *monitor,
-                                                  PolkitSubject               *session)
+polkit_backend_session_monitor_session_exists (PolkitBackendSessionMonitor *monitor,
+                                               PolkitSubject               *session)
 {
-  return get_boolean (monitor, session, "is_local");
+  SessionEntry entry;
+  GError *error;
+  gboolean ret;
+
+  error = NULL;
+  if (lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session)), &entry, &error))
+    return TRUE;
+
+  ret = !g_error_matches (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND);
+  if (ret)
+    print_session_error (session, error);
+  else
+    g_error_free (error);
+
+  return ret;
 }
 
+/**
+ * polkit_backend_session_monitor_get_session_seat:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @session: A #PolkitUnixSession.
+ *
+ * Gets the seat @session is on.
+ *
+ * Returns: An interned string, or %NULL if @session is on no seat.
+ */
+const gchar *
+polkit_backend_session_monitor_get_session_seat (PolkitBackendSessionMonitor *monitor,
+                                                 PolkitSubject               *session)
+{
+  SessionEntry entry;
+  GError *error;
 
-gboolean
-polkit_backend_session_monitor_is_session_active (PolkitBackendSessionMonitor *monitor,
+  error = NULL;
+  if (!lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session)), &entry, &error))
+    {
+      print_session_error (session, error);
+      return NULL;
+    }
+
+  return entry.seat;
+}
+
+/**
+ * polkit_backend_session_monitor_get_session_class:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @session: A #PolkitUnixSession.
+ *
+ * Gets the class of @session, if ConsoleKit records it.
+ *
+ * Returns: An interned string, or %NULL if not known.
+ */
+const gchar *
+polkit_backend_session_monitor_get_session_class (PolkitBackendSessionMonitor *monitor,
                                                   PolkitSubject               *session)
 {
-  return get_boolean (monitor, session, "is_active");
+  SessionEntry entry;
+  GError *error;
+
+  error = NULL;
+  if (!lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session)), &entry, &error))
+    {
+      print_session_error (session, error);
+      return NULL;
+    }
+
+  return entry.session_class;
 }
 
+/**
+ * polkit_backend_session_monitor_get_session_type:
+ * @monitor: A #PolkitBackendSessionMonitor.
+ * @session: A #PolkitUnixSession.
+ *
+ * Gets the type of @session, such as "x11".
+ *
+ * Returns: An interned string, or %NULL if not known.
+ */
+const gchar *
+polkit_backend_session_monitor_get_session_type (PolkitBackendSessionMonitor *monitor,
+                                                 PolkitSubject               *session)
+{
+  SessionEntry entry;
+  GError *error;
+
+  error = NULL;
+  if (!lookup_session (monitor, polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session)), &entry, &error))
+    {
+      print_session_error (session, error);
+      return NULL;
+    }
+
+  return entry.session_type;
+}
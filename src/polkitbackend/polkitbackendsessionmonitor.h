@@ -54,12 +54,31 @@ PolkitSubject               *polkit_backend_session_monitor_get_session_for_subj
                                                                                      PolkitSubject               *subject,
                                                                                      GError                     **error);
 
+PolkitSubject               *polkit_backend_session_monitor_get_process_for_bus_name (PolkitBackendSessionMonitor *monitor,
+                                                                                      PolkitSystemBusName         *system_bus_name,
+                                                                                      GError                     **error);
+
+void                         polkit_backend_session_monitor_forget_bus_name (PolkitBackendSessionMonitor *monitor,
+                                                                             const gchar                 *name);
+
 gboolean                     polkit_backend_session_monitor_is_session_local  (PolkitBackendSessionMonitor *monitor,
                                                                                PolkitSubject               *session);
 
 gboolean                     polkit_backend_session_monitor_is_session_active (PolkitBackendSessionMonitor *monitor,
                                                                                PolkitSubject               *session);
 
+gboolean                     polkit_backend_session_monitor_session_exists    (PolkitBackendSessionMonitor *monitor,
+                                                                               PolkitSubject               *session);
+
+const gchar                 *polkit_backend_session_monitor_get_session_seat  (PolkitBackendSessionMonitor *monitor,
+                                                                               PolkitSubject               *session);
+
+const gchar                 *polkit_backend_session_monitor_get_session_class (PolkitBackendSessionMonitor *monitor,
+                                                                               PolkitSubject               *session);
+
+const gchar                 *polkit_backend_session_monitor_get_session_type  (PolkitBackendSessionMonitor *monitor,
+                                                                               PolkitSubject               *session);
+
 G_END_DECLS
 
 #endif /* __POLKIT_BACKEND_SESSION_MONITOR_H */
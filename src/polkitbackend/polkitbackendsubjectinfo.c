@@ -0,0 +1,558 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+
+#include "polkitbackendsubjectinfo.h"
+
+/**
+ * SECTION:polkitbackendsubjectinfo
+ * @title: PolkitBackendSubjectInfo
+ * @short_description: Facts about a subject, resolved once per request
+ * @stability: Unstable
+ *
+ * A #PolkitBackendSubjectInfo is created for every authorization check
+ * and handed to everything involved in answering it. Each fact (the
+ * process behind a bus name, its session, the passwd entry of the user)
+ * is looked up the first time it is asked for, and then remembered for
+ * the rest of the request. User lookups go through the daemon's
+ * #PolicyIdentityCache, so they usually don't reach NSS at all.
+ *
+ * It is deliberately never kept beyond a single request, as none of
+ * the facts are guaranteed to stay true.
+ */
+
+typedef enum
+{
+  SUBJECT_INFO_PROCESS = 1 << 0,
+  SUBJECT_INFO_SESSION = 1 << 1,
+  SUBJECT_INFO_PASSWD  = 1 << 2,
+} SubjectInfoFact;
+
+struct _PolkitBackendSubjectInfo
+{
+  volatile gint ref_count;
+
+  PolkitBackendSessionMonitor *session_monitor;
+  PolicyIdentityCache *identities; /* not owned, outlives every request */
+
+  PolkitSubject *subject;
+  PolkitIdentity *user_of_subject;
+
+  /* SubjectInfoFact already looked up */
+  guint resolved;
+
+  PolkitSubject *process;
+  PolkitSubject *session;
+  gboolean is_local;
+  gboolean is_active;
+  const gchar *seat;          /* interned */
+  const gchar *session_class; /* interned */
+  const gchar *session_type;  /* interned */
+  PolicyUserRecord *user_record;
+};
+
+/**
+ * polkit_backend_subject_info_new:
+ * @monitor: (allow-none): A #PolkitBackendSessionMonitor or %NULL if the session is never needed.
+ * @identities: (allow-none): A #PolicyIdentityCache to resolve users through, or %NULL to always ask NSS.
+ * @subject: The subject being checked.
+ * @user_of_subject: The user of @subject, as already validated by the caller.
+ *
+ * Creates a new #PolkitBackendSubjectInfo. No lookups happen until a
+ * fact is asked for.
+ *
+ * Returns: A #PolkitBackendSubjectInfo. Free with polkit_backend_subject_info_unref().
+ */
+PolkitBackendSubjectInfo *
+polkit_backend_subject_info_new (PolkitBackendSessionMonitor *monitor,
+                                 PolicyIdentityCache         *identities,
+                                 PolkitSubject               *subject,
+                                 PolkitIdentity              *user_of_subject)
+{
+  PolkitBackendSubjectInfo *info;
+
+  g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), NULL);
+  g_return_val_if_fail (POLKIT_IS_IDENTITY (user_of_subject), NULL);
+
+  info = g_slice_new0 (PolkitBackendSubjectInfo);
+  info->ref_count = 1;
+  if (monitor != NULL)
+    info->session_monitor = g_object_ref (monitor);
+  info->identities = identities;
+  info->subject = g_object_ref (subject);
+  info->user_of_subject = g_object_ref (user_of_subject);
+
+  return info;
+}
+
+/**
+ * polkit_backend_subject_info_ref:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Increases the reference count of @info.
+ *
+ * Returns: @info.
+ */
+PolkitBackendSubjectInfo *
+polkit_backend_subject_info_ref (PolkitBackendSubjectInfo *info)
+{
+  g_return_val_if_fail (info != NULL, NULL);
+
+  g_atomic_int_inc (&info->ref_count);
+  return info;
+}
+
+/**
+ * polkit_backend_subject_info_unref:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Decreases the reference count of @info, freeing it once it drops to zero.
+ */
+void
+polkit_backend_subject_info_unref (PolkitBackendSubjectInfo *info)
+{
+  g_return_if_fail (info != NULL);
+
+  if (!g_atomic_int_dec_and_test (&info->ref_count))
+    return;
+
+  if (info->session_monitor != NULL)
+    g_object_unref (info->session_monitor);
+  g_object_unref (info->subject);
+  g_object_unref (info->user_of_subject);
+  if (info->process != NULL)
+    g_object_unref (info->process);
+  if (info->session != NULL)
+    g_object_unref (info->session);
+  if (info->user_record != NULL)
+    policy_user_record_unref (info->user_record);
+  g_slice_free (PolkitBackendSubjectInfo, info);
+}
+
+/**
+ * polkit_backend_subject_info_get_subject:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the subject @info was created for.
+ *
+ * Returns: (transfer none): A #PolkitSubject owned by @info.
+ */
+PolkitSubject *
+polkit_backend_subject_info_get_subject (PolkitBackendSubjectInfo *info)
+{
+  return info->subject;
+}
+
+/**
+ * polkit_backend_subject_info_get_user:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the user of the subject.
+ *
+ * Returns: (transfer none): A #PolkitIdentity owned by @info.
+ */
+PolkitIdentity *
+polkit_backend_subject_info_get_user (PolkitBackendSubjectInfo *info)
+{
+  return info->user_of_subject;
+}
+
+/**
+ * polkit_backend_subject_info_get_uid:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the uid of the user of the subject.
+ *
+ * Returns: The uid or -1 if the user is not a #PolkitUnixUser.
+ */
+gint
+polkit_backend_subject_info_get_uid (PolkitBackendSubjectInfo *info)
+{
+  if (!POLKIT_IS_UNIX_USER (info->user_of_subject))
+    return -1;
+
+  return polkit_unix_user_get_uid (POLKIT_UNIX_USER (info->user_of_subject));
+}
+
+/**
+ * polkit_backend_subject_info_get_process:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the process behind the subject. For a #PolkitSystemBusName
+ * this asks the bus the first time it is called.
+ *
+ * Returns: (transfer none): A #PolkitUnixProcess owned by @info or
+ *     %NULL if the subject is not backed by a (known) process.
+ */
+PolkitSubject *
+polkit_backend_subject_info_get_process (PolkitBackendSubjectInfo *info)
+{
+  GError *error;
+
+  if (info->resolved & SUBJECT_INFO_PROCESS)
+    return info->process;
+
+  info->resolved |= SUBJECT_INFO_PROCESS;
+
+  if (POLKIT_IS_UNIX_PROCESS (info->subject))
+    {
+      info->process = g_object_ref (info->subject);
+    }
+  else if (POLKIT_IS_SYSTEM_BUS_NAME (info->subject))
+    {
+      error = NULL;
+      if (info->session_monitor != NULL)
+        info->process = polkit_backend_session_monitor_get_process_for_bus_name (info->session_monitor,
+                                                                                 POLKIT_SYSTEM_BUS_NAME (info->subject),
+                                                                                 &error);
+      else
+        info->process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (info->subject),
+                                                                 NULL,
+                                                                 &error);
+      /* the name going away first is routine, callers cope with no process */
+      if (info->process == NULL)
+        {
+          g_debug ("Error getting process for system bus name `%s': %s",
+                   polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (info->subject)),
+                   error->message);
+          g_error_free (error);
+        }
+    }
+
+  return info->process;
+}
+
+/**
+ * polkit_backend_subject_info_get_pid:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the process id of the process behind the subject.
+ *
+ * Returns: The process id or -1 if there is no process.
+ */
+gint
+polkit_backend_subject_info_get_pid (PolkitBackendSubjectInfo *info)
+{
+  PolkitSubject *process;
+
+  process = polkit_backend_subject_info_get_process (info);
+  if (process == NULL)
+    return -1;
+
+  return polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
+}
+
+/**
+ * polkit_backend_subject_info_get_start_time:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the start time of the process behind the subject.
+ *
+ * Returns: The start time or 0 if there is no process.
+ */
+guint64
+polkit_backend_subject_info_get_start_time (PolkitBackendSubjectInfo *info)
+{
+  PolkitSubject *process;
+
+  process = polkit_backend_subject_info_get_process (info);
+  if (process == NULL)
+    return 0;
+
+  return polkit_unix_process_get_start_time (POLKIT_UNIX_PROCESS (process));
+}
+
+static void
+subject_info_ensure_session (PolkitBackendSubjectInfo *info)
+{
+  PolkitSubject *lookup;
+
+  if (info->resolved & SUBJECT_INFO_SESSION)
+    return;
+
+  info->resolved |= SUBJECT_INFO_SESSION;
+
+  if (info->session_monitor == NULL)
+    return;
+
+  /* Hand the session monitor the process we already have, so that it
+   * doesn't ask the bus about it a second time. */
+  lookup = info->subject;
+  if (POLKIT_IS_SYSTEM_BUS_NAME (info->subject))
+    {
+      lookup = polkit_backend_subject_info_get_process (info);
+      if (lookup == NULL)
+        return;
+    }
+
+  info->session = polkit_backend_session_monitor_get_session_for_subject (info->session_monitor,
+                                                                          lookup,
+                                                                          NULL);
+  if (info->session != NULL)
+    {
+      info->is_local = polkit_backend_session_monitor_is_session_local (info->session_monitor, info->session);
+      info->is_active = polkit_backend_session_monitor_is_session_active (info->session_monitor, info->session);
+      info->seat = polkit_backend_session_monitor_get_session_seat (info->session_monitor, info->session);
+      info->session_class = polkit_backend_session_monitor_get_session_class (info->session_monitor, info->session);
+      info->session_type = polkit_backend_session_monitor_get_session_type (info->session_monitor, info->session);
+    }
+}
+
+/**
+ * polkit_backend_subject_info_get_session:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the session the subject is in.
+ *
+ * Returns: (transfer none): A #PolkitUnixSession owned by @info or
+ *     %NULL if the subject is not in a session.
+ */
+PolkitSubject *
+polkit_backend_subject_info_get_session (PolkitBackendSubjectInfo *info)
+{
+  subject_info_ensure_session (info);
+  return info->session;
+}
+
+/**
+ * polkit_backend_subject_info_get_is_local:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Checks whether the session of the subject is local.
+ *
+ * Returns: %TRUE if the subject is in a local session.
+ */
+gboolean
+polkit_backend_subject_info_get_is_local (PolkitBackendSubjectInfo *info)
+{
+  subject_info_ensure_session (info);
+  return info->is_local;
+}
+
+/**
+ * polkit_backend_subject_info_get_is_active:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Checks whether the session of the subject is active.
+ *
+ * Returns: %TRUE if the subject is in an active session.
+ */
+gboolean
+polkit_backend_subject_info_get_is_active (PolkitBackendSubjectInfo *info)
+{
+  subject_info_ensure_session (info);
+  return info->is_active;
+}
+
+/**
+ * polkit_backend_subject_info_get_seat:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the seat the session of the subject is on.
+ *
+ * Returns: An interned string, or %NULL if the subject is on no seat.
+ */
+const gchar *
+polkit_backend_subject_info_get_seat (PolkitBackendSubjectInfo *info)
+{
+  subject_info_ensure_session (info);
+  return info->seat;
+}
+
+/**
+ * polkit_backend_subject_info_get_session_class:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the class of the session of the subject.
+ *
+ * Returns: An interned string, or %NULL if not known.
+ */
+const gchar *
+polkit_backend_subject_info_get_session_class (PolkitBackendSubjectInfo *info)
+{
+  subject_info_ensure_session (info);
+  return info->session_class;
+}
+
+/**
+ * polkit_backend_subject_info_get_session_type:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets the type of the session of the subject.
+ *
+ * Returns: An interned string, or %NULL if not known.
+ */
+const gchar *
+polkit_backend_subject_info_get_session_type (PolkitBackendSubjectInfo *info)
+{
+  subject_info_ensure_session (info);
+  return info->session_type;
+}
+
+/**
+ * polkit_backend_subject_info_get_user_record:
+ * @info: A #PolkitBackendSubjectInfo.
+ *
+ * Gets what NSS knows about the user of the subject: its name, primary
+ * group and every group it is a member of.
+ *
+ * Returns: (transfer none): A #PolicyUserRecord owned by @info, or %NULL
+ *     if the user is not a #PolkitUnixUser.
+ */
+PolicyUserRecord *
+polkit_backend_subject_info_get_user_record (PolkitBackendSubjectInfo *info)
+{
+  gint uid;
+
+  if (!(info->resolved & SUBJECT_INFO_PASSWD))
+    {
+      info->resolved |= SUBJECT_INFO_PASSWD;
+
+      uid = polkit_backend_subject_info_get_uid (info);
+      if (uid != -1)
+        info->user_record = policy_identity_cache_lookup_user (info->identities, uid);
+    }
+
+  return info->user_record;
+}
+
+/**
+ * polkit_backend_subject_info_get_user_name:
+ * @info: A #PolkitBackendSubjectInfo.
+ * @out_primary_gid: (out) (allow-none): Return location for the primary group of the user.
+ *
+ * Gets the name of the user of the subject from the passwd database.
+ *
+ * Returns: The user name owned by @info, or %NULL (and -1 in
+ *     @out_primary_gid) if the user has no passwd entry.
+ */
+const gchar *
+polkit_backend_subject_info_get_user_name (PolkitBackendSubjectInfo *info,
+                                           gid_t                    *out_primary_gid)
+{
+  PolicyUserRecord *record;
+
+  record = polkit_backend_subject_info_get_user_record (info);
+
+  if (out_primary_gid != NULL)
+    *out_primary_gid = record != NULL ? record->primary_gid : (gid_t) -1;
+  return record != NULL ? record->name : NULL;
+}
+
+/**
+ * polkit_backend_subject_get_cmdline:
+ * @subject: A #PolkitUnixProcess or #PolkitSystemBusName.
+ *
+ * Reads the command line of the process behind @subject from /proc.
+ *
+ * TODO: should probably move to PolkitSubject
+ * (also see copy in src/programs/pkcheck.c)
+ *
+ * Also, can't really trust the cmdline... but might be useful in the logs anyway.
+ *
+ * Returns: (allow-none): The command line, or %NULL if it can't be read. Free with g_free().
+ */
+gchar *
+polkit_backend_subject_get_cmdline (PolkitSubject *subject)
+{
+  PolkitSubject *process;
+  gchar *ret;
+  gint pid;
+  gchar *filename;
+  gchar *contents;
+  gsize contents_len;
+  GError *error;
+  guint n;
+
+  g_return_val_if_fail (subject != NULL, NULL);
+
+  error = NULL;
+
+  ret = NULL;
+  process = NULL;
+  filename = NULL;
+  contents = NULL;
+
+  if (POLKIT_IS_UNIX_PROCESS (subject))
+    {
+      process = g_object_ref (subject);
+    }
+  else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
+    {
+      process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject),
+                                                         NULL,
+                                                         &error);
+      if (process == NULL)
+        {
+          g_debug ("Error getting process for system bus name `%s': %s",
+                   polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (subject)),
+                   error->message);
+          g_error_free (error);
+          goto out;
+        }
+    }
+  else
+    {
+      g_warning ("Unknown subject type passed to polkit_backend_subject_get_cmdline()");
+      goto out;
+    }
+
+  pid = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
+
+  filename = g_strdup_printf ("/proc/%d/cmdline", pid);
+
+  if (!g_file_get_contents (filename,
+                            &contents,
+                            &contents_len,
+                            &error))
+    {
+      /* the process may well have exited already */
+      g_debug ("Error opening `%s': %s",
+               filename,
+               error->message);
+      g_error_free (error);
+      goto out;
+    }
+
+  if (contents == NULL || contents_len == 0)
+    {
+      goto out;
+    }
+  else
+    {
+      /* The kernel uses '\0' to separate arguments - replace those with a space. */
+      for (n = 0; n < contents_len - 1; n++)
+        {
+          if (contents[n] == '\0')
+            contents[n] = ' ';
+        }
+      ret = g_strdup (contents);
+      g_strstrip (ret);
+    }
+
+ out:
+  g_free (filename);
+  g_free (contents);
+  if (process != NULL)
+    g_object_unref (process);
+  return ret;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#if !defined (_POLKIT_BACKEND_COMPILATION) || defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error "This is a private header file."
+#endif
+
+#ifndef __POLKIT_BACKEND_SUBJECT_INFO_H
+#define __POLKIT_BACKEND_SUBJECT_INFO_H
+
+#include <glib-object.h>
+#include <sys/types.h>
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendtypes.h>
+#include "polkitbackendsessionmonitor.h"
+#include "polkitbackendpolicyidentity.h"
+
+G_BEGIN_DECLS
+
+PolkitBackendSubjectInfo *polkit_backend_subject_info_new            (PolkitBackendSessionMonitor *monitor,
+                                                                      PolicyIdentityCache         *identities,
+                                                                      PolkitSubject               *subject,
+                                                                      PolkitIdentity              *user_of_subject);
+PolkitBackendSubjectInfo *polkit_backend_subject_info_ref            (PolkitBackendSubjectInfo    *info);
+void                      polkit_backend_subject_info_unref          (PolkitBackendSubjectInfo    *info);
+
+PolkitSubject            *polkit_backend_subject_info_get_subject    (PolkitBackendSubjectInfo    *info);
+PolkitIdentity           *polkit_backend_subject_info_get_user       (PolkitBackendSubjectInfo    *info);
+gint                      polkit_backend_subject_info_get_uid        (PolkitBackendSubjectInfo    *info);
+
+PolkitSubject            *polkit_backend_subject_info_get_process    (PolkitBackendSubjectInfo    *info);
+gint                      polkit_backend_subject_info_get_pid        (PolkitBackendSubjectInfo    *info);
+guint64                   polkit_backend_subject_info_get_start_time (PolkitBackendSubjectInfo    *info);
+
+PolkitSubject            *polkit_backend_subject_info_get_session    (PolkitBackendSubjectInfo    *info);
+gboolean                  polkit_backend_subject_info_get_is_local   (PolkitBackendSubjectInfo    *info);
+gboolean                  polkit_backend_subject_info_get_is_active  (PolkitBackendSubjectInfo    *info);
+const gchar              *polkit_backend_subject_info_get_seat       (PolkitBackendSubjectInfo    *info);
+const gchar              *polkit_backend_subject_info_get_session_class (PolkitBackendSubjectInfo *info);
+const gchar              *polkit_backend_subject_info_get_session_type  (PolkitBackendSubjectInfo *info);
+
+PolicyUserRecord         *polkit_backend_subject_info_get_user_record (PolkitBackendSubjectInfo   *info);
+const gchar              *polkit_backend_subject_info_get_user_name  (PolkitBackendSubjectInfo    *info,
+                                                                      gid_t                       *out_primary_gid);
+
+gchar                    *polkit_backend_subject_get_cmdline         (PolkitSubject               *subject);
+
+G_END_DECLS
+
+#endif /* __POLKIT_BACKEND_SUBJECT_INFO_H */
@@ -36,5 +36,26 @@ typedef struct _PolkitBackendInteractiveAuthority PolkitBackendInteractiveAuthor
 struct _PolkitBackendKeyfileAuthority;
 typedef struct _PolkitBackendKeyfileAuthority PolkitBackendKeyfileAuthority;
 
+struct _PolkitBackendProviderAuthority;
+typedef struct _PolkitBackendProviderAuthority PolkitBackendProviderAuthority;
+
+struct _PolkitBackendSubjectInfo;
+typedef struct _PolkitBackendSubjectInfo PolkitBackendSubjectInfo;
+
+struct _PolkitBackendAuditLog;
+typedef struct _PolkitBackendAuditLog PolkitBackendAuditLog;
+
+struct _PolkitBackendAuthorizationJournal;
+typedef struct _PolkitBackendAuthorizationJournal PolkitBackendAuthorizationJournal;
+
+struct _PolkitBackendCheckQueue;
+typedef struct _PolkitBackendCheckQueue PolkitBackendCheckQueue;
+
+struct _PolkitBackendBusNameCache;
+typedef struct _PolkitBackendBusNameCache PolkitBackendBusNameCache;
+
+struct _PolkitBackendMetrics;
+typedef struct _PolkitBackendMetrics PolkitBackendMetrics;
+
 #endif /* __POLKIT_BACKEND_TYPES_H */
 
@@ -21,27 +21,75 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
 
 #include <glib-unix.h>
+#include <glib/gstdio.h>
+#include <gio/gunixsocketaddress.h>
 
 #include <pwd.h>
 #include <grp.h>
 
 #include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
 #include <polkitbackend/polkitbackend.h>
 
+/* On a tmpfs, so that nothing outlives a reboot */
+#define TEMPORARY_AUTHORIZATION_JOURNAL_DIR "/run/polkit-1"
+#define TEMPORARY_AUTHORIZATION_JOURNAL     TEMPORARY_AUTHORIZATION_JOURNAL_DIR "/temporary-authorizations"
+
+/* Where the backend saves the rules and actions it parsed, for the next start */
+#define CACHE_DIR PACKAGE_LOCALSTATE_DIR "/cache/polkit-1"
+
+/* After giving up the name, for requests already on their way to be answered */
+#define IDLE_EXIT_GRACE_SECONDS 1
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static PolkitBackendAuthority *authority = NULL;
 static gpointer                registration_id = NULL;
+static gpointer                debug_registration_id = NULL;
+static gpointer                metrics_registration_id = NULL;
 static GMainLoop              *loop = NULL;
+static guint                   name_owner_id = 0;
+static guint                   idle_timeout_id = 0;
+static gint64                  warm_up_started = 0;
 static gboolean                opt_replace = FALSE;
 static gboolean                opt_no_debug = FALSE;
+static gint                    opt_log_checks = 0;
+static gint                    opt_max_running_checks = -1;
+static gint                    opt_max_queued_checks = -1;
+static gint                    opt_check_threads = -1;
+static gboolean                opt_metrics = FALSE;
+static gboolean                opt_no_persist_authorizations = FALSE;
+static gint                    opt_idle_timeout = 0;
+static gboolean                opt_shadow_evaluation = FALSE;
+static gboolean                opt_dump_load_profile = FALSE;
+static gchar                  *opt_rules_bundle = NULL;
+static gchar                  *opt_rules_bundle_key = NULL;
+static gchar                  *opt_decision_provider = NULL;
+static gint                    opt_decision_provider_timeout = 50;
 static GOptionEntry            opt_entries[] = {
   {"replace", 'r', 0, G_OPTION_ARG_NONE, &opt_replace, "Replace existing daemon", NULL},
   {"no-debug", 'n', 0, G_OPTION_ARG_NONE, &opt_no_debug, "Don't print debug information", NULL},
+  {"log-checks", 'l', 0, G_OPTION_ARG_INT, &opt_log_checks, "Log every authorization check (1), along with command lines (2)", "LEVEL"},
+  {"max-running-checks", 0, 0, G_OPTION_ARG_INT, &opt_max_running_checks, "Checks of a single user evaluated at once", "N"},
+  {"max-queued-checks", 0, 0, G_OPTION_ARG_INT, &opt_max_queued_checks, "Checks a single user may have waiting, 0 for no limit", "N"},
+  {"check-threads", 0, 0, G_OPTION_ARG_INT, &opt_check_threads, "Threads evaluating checks, 0 for one per processor", "N"},
+  {"metrics", 0, 0, G_OPTION_ARG_NONE, &opt_metrics, "Collect metrics and export them on the bus", NULL},
+  {"no-persist-authorizations", 0, 0, G_OPTION_ARG_NONE, &opt_no_persist_authorizations, "Don't keep temporary authorizations across restarts", NULL},
+  {"idle-timeout", 0, 0, G_OPTION_ARG_INT, &opt_idle_timeout, "Exit after being idle for this many seconds, 0 to never exit", "SECONDS"},
+  {"shadow-evaluation", 0, 0, G_OPTION_ARG_NONE, &opt_shadow_evaluation, "Test every check against the rules one by one as well, and log where the compiled rules disagree", NULL},
+  {"dump-load-profile", 0, 0, G_OPTION_ARG_NONE, &opt_dump_load_profile, "Load the rules, print what each file cost and exit", NULL},
+  {"rules-bundle", 0, 0, G_OPTION_ARG_FILENAME, &opt_rules_bundle, "Load the rules from a bundle written by pkbundle", "FILE"},
+  {"rules-bundle-key", 0, 0, G_OPTION_ARG_FILENAME, &opt_rules_bundle_key, "Key the rules bundle is signed with", "FILE"},
+  {"decision-provider", 0, 0, G_OPTION_ARG_FILENAME, &opt_decision_provider, "Ask the decision service listening on SOCKET before the rules", "SOCKET"},
+  {"decision-provider-timeout", 0, 0, G_OPTION_ARG_INT, &opt_decision_provider_timeout, "Milliseconds to wait for the decision service before asking the rules", "MSEC"},
   {NULL }
 };
 
@@ -66,6 +114,37 @@ on_bus_acquired (GDBusConnection *connection,
       g_printerr ("Error registering authority: %s\n", error->message);
       g_error_free (error);
       g_main_loop_quit (loop); /* exit */
+      return;
+    }
+
+  /* Rule statistics are only a debugging aid, so carry on without them */
+  if (POLKIT_BACKEND_IS_KEYFILE_AUTHORITY (authority))
+    {
+      error = NULL;
+      debug_registration_id = polkit_backend_keyfile_authority_register_debug (POLKIT_BACKEND_KEYFILE_AUTHORITY (authority),
+                                                                               connection,
+                                                                               "/org/freedesktop/PolicyKit1/Debug",
+                                                                               &error);
+      if (debug_registration_id == NULL)
+        {
+          g_printerr ("Error registering debug interface: %s\n", error->message);
+          g_error_free (error);
+        }
+    }
+
+  /* Same for the metrics */
+  if (opt_metrics && POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    {
+      error = NULL;
+      metrics_registration_id = polkit_backend_interactive_authority_register_metrics (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                                       connection,
+                                                                                       "/org/freedesktop/PolicyKit1/Metrics",
+                                                                                       &error);
+      if (metrics_registration_id == NULL)
+        {
+          g_printerr ("Error registering metrics interface: %s\n", error->message);
+          g_error_free (error);
+        }
     }
 }
 
@@ -79,6 +158,109 @@ on_name_lost (GDBusConnection *connection,
   g_main_loop_quit (loop);
 }
 
+/* Tells the service manager that we are ready, if it asked to be told */
+static void
+notify_ready (void)
+{
+  const gchar *notify_socket;
+  GSocketAddress *address;
+  GSocket *socket;
+  GError *error;
+
+  notify_socket = g_getenv ("NOTIFY_SOCKET");
+  if (notify_socket == NULL || (notify_socket[0] != '/' && notify_socket[0] != '@') || notify_socket[1] == '\0')
+    return;
+
+  if (notify_socket[0] == '@')
+    address = g_unix_socket_address_new_with_type (notify_socket + 1, -1, G_UNIX_SOCKET_ADDRESS_ABSTRACT);
+  else
+    address = g_unix_socket_address_new (notify_socket);
+
+  error = NULL;
+  socket = g_socket_new (G_SOCKET_FAMILY_UNIX, G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_DEFAULT, &error);
+  if (socket == NULL ||
+      g_socket_send_to (socket, address, "READY=1", strlen ("READY=1"), NULL, &error) < 0)
+    {
+      g_printerr ("Error notifying the service manager: %s\n", error->message);
+      g_error_free (error);
+    }
+
+  if (socket != NULL)
+    g_object_unref (socket);
+  g_object_unref (address);
+}
+
+static gboolean on_idle_timeout (gpointer user_data);
+
+/* Checks again once @authority may have been idle for @idle_seconds */
+static void
+schedule_idle_timeout (guint idle_seconds)
+{
+  gint64 idle_time;
+  guint delay;
+
+  idle_time = polkit_backend_interactive_authority_get_idle_time (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority));
+  if (idle_time / G_USEC_PER_SEC >= idle_seconds)
+    delay = 1;
+  else if (idle_time > 0)
+    delay = idle_seconds - idle_time / G_USEC_PER_SEC;
+  else
+    delay = idle_seconds;
+
+  idle_timeout_id = g_timeout_add_seconds (delay, on_idle_timeout, NULL);
+}
+
+static gboolean
+on_idle_timeout (gpointer user_data)
+{
+  gint64 idle_time;
+  guint idle_seconds;
+
+  idle_timeout_id = 0;
+
+  /* Until the name is given up, wait for the whole idle period */
+  idle_seconds = name_owner_id != 0 ? (guint) opt_idle_timeout : IDLE_EXIT_GRACE_SECONDS;
+
+  idle_time = polkit_backend_interactive_authority_get_idle_time (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority));
+  if (idle_time == 0 || idle_time / G_USEC_PER_SEC < idle_seconds)
+    {
+      schedule_idle_timeout (idle_seconds);
+      return FALSE; /* remove source */
+    }
+
+  if (name_owner_id != 0)
+    {
+      /* From now on the bus holds new requests back and activates the
+       * next daemon for them; the ones that reached us are answered first */
+      polkit_backend_authority_log (authority,
+                                    "Idle for %d seconds, releasing the name org.freedesktop.PolicyKit1",
+                                    opt_idle_timeout);
+      g_bus_unown_name (name_owner_id);
+      name_owner_id = 0;
+      idle_timeout_id = g_timeout_add_seconds (IDLE_EXIT_GRACE_SECONDS, on_idle_timeout, NULL);
+    }
+  else
+    {
+      g_main_loop_quit (loop);
+    }
+
+  return FALSE; /* remove source */
+}
+
+static void
+on_warm_up_done (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+  polkit_backend_interactive_authority_warm_up_finish (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (source_object), res);
+  g_print ("Warmed up in %" G_GINT64_FORMAT " ms\n", (g_get_monotonic_time () - warm_up_started) / 1000);
+
+  notify_ready ();
+
+  if (opt_idle_timeout > 0 && idle_timeout_id == 0 && name_owner_id != 0)
+    schedule_idle_timeout ((guint) opt_idle_timeout);
+}
+
 static void
 on_name_acquired (GDBusConnection *connection,
                   const gchar     *name,
@@ -86,6 +268,21 @@ on_name_acquired (GDBusConnection *connection,
 {
   polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
                                 "Acquired the name org.freedesktop.PolicyKit1 on the system bus");
+
+  /* Have the first checks find actions and users loaded already; we only
+   * report being ready once that's done
+   */
+  if (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    {
+      warm_up_started = g_get_monotonic_time ();
+      polkit_backend_interactive_authority_warm_up (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                    on_warm_up_done,
+                                                    NULL);
+    }
+  else
+    {
+      notify_ready ();
+    }
 }
 
 static gboolean
@@ -153,6 +350,46 @@ become_user (const gchar  *user,
   return ret;
 }
 
+/* Hands @dir over to @user, while we still may */
+static gboolean
+prepare_dir (const gchar  *user,
+             const gchar  *dir,
+             GError      **error)
+{
+  gboolean ret = FALSE;
+  struct passwd *pw;
+
+  pw = getpwnam (user);
+  if (pw == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Error calling getpwnam(): %m");
+      goto out;
+    }
+
+  /* usually created by systemd through RuntimeDirectory= or CacheDirectory= */
+  if (g_mkdir_with_parents (dir, 0700) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Error creating %s: %m", dir);
+      goto out;
+    }
+
+  if (chown (dir, pw->pw_uid, pw->pw_gid) != 0 ||
+      g_chmod (dir, 0700) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Error handing %s over to %s: %m",
+                   dir, user);
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
 int
 main (int    argc,
       char **argv)
@@ -160,13 +397,11 @@ main (int    argc,
   GError *error;
   GOptionContext *opt_context;
   gint ret;
-  guint name_owner_id;
   guint sigint_id;
 
   ret = 1;
   loop = NULL;
   opt_context = NULL;
-  name_owner_id = 0;
   sigint_id = 0;
   registration_id = NULL;
 
@@ -183,6 +418,48 @@ main (int    argc,
       goto out;
     }
 
+  if (opt_log_checks < 0 || opt_log_checks > 2)
+    {
+      g_printerr ("Invalid level for --log-checks: %d\n", opt_log_checks);
+      goto out;
+    }
+
+  if (opt_max_running_checks == 0 || opt_max_running_checks < -1)
+    {
+      g_printerr ("Invalid number for --max-running-checks: %d\n", opt_max_running_checks);
+      goto out;
+    }
+
+  if (opt_max_queued_checks < -1)
+    {
+      g_printerr ("Invalid number for --max-queued-checks: %d\n", opt_max_queued_checks);
+      goto out;
+    }
+
+  if (opt_check_threads < -1)
+    {
+      g_printerr ("Invalid number for --check-threads: %d\n", opt_check_threads);
+      goto out;
+    }
+
+  if (opt_idle_timeout < 0)
+    {
+      g_printerr ("Invalid number for --idle-timeout: %d\n", opt_idle_timeout);
+      goto out;
+    }
+
+  if ((opt_rules_bundle == NULL) != (opt_rules_bundle_key == NULL))
+    {
+      g_printerr ("--rules-bundle and --rules-bundle-key must be given together\n");
+      goto out;
+    }
+
+  if (opt_decision_provider_timeout <= 0)
+    {
+      g_printerr ("Invalid number for --decision-provider-timeout: %d\n", opt_decision_provider_timeout);
+      goto out;
+    }
+
   /* If --no-debug is requested don't clutter stdout/stderr etc.
    */
   if (opt_no_debug)
@@ -202,6 +479,25 @@ main (int    argc,
         }
     }
 
+  /* without a journal, temporary authorizations are simply lost on restart */
+  error = NULL;
+  if (!opt_no_persist_authorizations &&
+      !prepare_dir (POLKITD_USER, TEMPORARY_AUTHORIZATION_JOURNAL_DIR, &error))
+    {
+      g_printerr ("Not keeping temporary authorizations across restarts: %s\n",
+                  error->message);
+      g_clear_error (&error);
+      opt_no_persist_authorizations = TRUE;
+    }
+
+  /* without it, the rules and actions are parsed again on every start */
+  if (!prepare_dir (POLKITD_USER, CACHE_DIR, &error))
+    {
+      g_printerr ("Not caching parsed rules and actions: %s\n",
+                  error->message);
+      g_clear_error (&error);
+    }
+
   error = NULL;
   if (!become_user (POLKITD_USER, &error))
     {
@@ -216,7 +512,61 @@ main (int    argc,
   if (g_getenv ("PATH") == NULL)
     g_setenv ("PATH", "/usr/bin:/bin:/usr/sbin:/sbin", TRUE);
 
-  authority = polkit_backend_authority_get ();
+  /* the same processes are looked at again and again */
+  polkit_unix_process_enable_start_time_cache ();
+
+  /* the bundle has to be known before the first rules are loaded */
+  if (opt_decision_provider != NULL)
+    authority = g_object_new (POLKIT_BACKEND_TYPE_PROVIDER_AUTHORITY,
+                              "provider-socket", opt_decision_provider,
+                              "provider-timeout", (guint) opt_decision_provider_timeout,
+                              "rules-bundle", opt_rules_bundle,
+                              "rules-bundle-key", opt_rules_bundle_key,
+                              NULL);
+  else if (opt_rules_bundle != NULL)
+    authority = g_object_new (POLKIT_BACKEND_TYPE_KEYFILE_AUTHORITY,
+                              "rules-bundle", opt_rules_bundle,
+                              "rules-bundle-key", opt_rules_bundle_key,
+                              NULL);
+  else
+    authority = polkit_backend_authority_get ();
+
+  if (opt_dump_load_profile)
+    {
+      gchar *profile;
+
+      if (!POLKIT_BACKEND_IS_KEYFILE_AUTHORITY (authority))
+        {
+          g_printerr ("The %s authority has no load profile\n",
+                      polkit_backend_authority_get_name (authority));
+          goto out;
+        }
+      profile = polkit_backend_keyfile_authority_format_load_profile (POLKIT_BACKEND_KEYFILE_AUTHORITY (authority));
+      g_print ("%s", profile);
+      g_free (profile);
+      ret = 0;
+      goto out;
+    }
+
+  if (opt_log_checks > 0 && POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    g_object_set (authority, "audit-log-level", (guint) opt_log_checks, NULL);
+
+  if (opt_max_running_checks > 0 && POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    g_object_set (authority, "max-running-checks-per-caller", (guint) opt_max_running_checks, NULL);
+
+  if (opt_max_queued_checks >= 0 && POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    g_object_set (authority, "max-queued-checks-per-caller", (guint) opt_max_queued_checks, NULL);
+
+  if (opt_check_threads == 0)
+    opt_check_threads = g_get_num_processors ();
+  if (opt_check_threads > 0 && POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    g_object_set (authority, "check-threads", (guint) opt_check_threads, NULL);
+
+  if (!opt_no_persist_authorizations && POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    g_object_set (authority, "temporary-authorization-journal", TEMPORARY_AUTHORIZATION_JOURNAL, NULL);
+
+  if (opt_shadow_evaluation && POLKIT_BACKEND_IS_KEYFILE_AUTHORITY (authority))
+    g_object_set (authority, "shadow-evaluation", TRUE, NULL);
 
   loop = g_main_loop_new (NULL, FALSE);
 
@@ -243,8 +593,14 @@ main (int    argc,
  out:
   if (sigint_id > 0)
     g_source_remove (sigint_id);
+  if (idle_timeout_id > 0)
+    g_source_remove (idle_timeout_id);
   if (name_owner_id != 0)
     g_bus_unown_name (name_owner_id);
+  if (debug_registration_id != NULL)
+    polkit_backend_keyfile_authority_unregister_debug (debug_registration_id);
+  if (metrics_registration_id != NULL)
+    polkit_backend_interactive_authority_unregister_metrics (metrics_registration_id);
   if (registration_id != NULL)
     polkit_backend_authority_unregister (registration_id);
   if (authority != NULL)
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <glib/gi18n.h>
 #include <polkit/polkit.h>
 
@@ -78,6 +79,169 @@ print_action (PolkitActionDescription *action,
     }
 }
 
+/* Appends @str to @out as a JSON string */
+static void
+json_append_string (GString     *out,
+                    const gchar *str)
+{
+  const gchar *p;
+
+  g_string_append_c (out, '"');
+  for (p = str != NULL ? str : ""; *p != '\0'; p++)
+    {
+      switch (*p)
+        {
+        case '"':
+          g_string_append (out, "\\\"");
+          break;
+        case '\\':
+          g_string_append (out, "\\\\");
+          break;
+        case '\n':
+          g_string_append (out, "\\n");
+          break;
+        case '\r':
+          g_string_append (out, "\\r");
+          break;
+        case '\t':
+          g_string_append (out, "\\t");
+          break;
+        default:
+          if ((guchar) *p < 0x20)
+            g_string_append_printf (out, "\\u%04x", (guint) (guchar) *p);
+          else
+            g_string_append_c (out, *p);
+          break;
+        }
+    }
+  g_string_append_c (out, '"');
+}
+
+static void
+json_append_member (GString     *out,
+                    const gchar *key,
+                    const gchar *value)
+{
+  g_string_append_c (out, ',');
+  json_append_string (out, key);
+  g_string_append_c (out, ':');
+  if (value != NULL)
+    json_append_string (out, value);
+  else
+    g_string_append (out, "null");
+}
+
+/* Prints @action as a single line JSON object with only @fields in it */
+static void
+print_action_json (PolkitActionDescription       *action,
+                   PolkitActionDescriptionFields  fields)
+{
+  GString *out;
+
+  out = g_string_new ("{");
+  json_append_string (out, "action_id");
+  g_string_append_c (out, ':');
+  json_append_string (out, polkit_action_description_get_action_id (action));
+
+  if (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_DESCRIPTION)
+    json_append_member (out, "description", polkit_action_description_get_description (action));
+  if (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_MESSAGE)
+    json_append_member (out, "message", polkit_action_description_get_message (action));
+  if (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_VENDOR)
+    {
+      json_append_member (out, "vendor", polkit_action_description_get_vendor_name (action));
+      json_append_member (out, "vendor_url", polkit_action_description_get_vendor_url (action));
+    }
+  if (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_ICON_NAME)
+    json_append_member (out, "icon", polkit_action_description_get_icon_name (action));
+  if (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_IMPLICIT)
+    {
+      json_append_member (out, "implicit_any",
+                          polkit_implicit_authorization_to_string (polkit_action_description_get_implicit_any (action)));
+      json_append_member (out, "implicit_inactive",
+                          polkit_implicit_authorization_to_string (polkit_action_description_get_implicit_inactive (action)));
+      json_append_member (out, "implicit_active",
+                          polkit_implicit_authorization_to_string (polkit_action_description_get_implicit_active (action)));
+    }
+  if (fields & POLKIT_ACTION_DESCRIPTION_FIELDS_ANNOTATIONS)
+    {
+      const gchar* const *annotation_keys;
+      guint n;
+
+      g_string_append (out, ",\"annotations\":{");
+      annotation_keys = polkit_action_description_get_annotation_keys (action);
+      for (n = 0; annotation_keys[n] != NULL; n++)
+        {
+          if (n > 0)
+            g_string_append_c (out, ',');
+          json_append_string (out, annotation_keys[n]);
+          g_string_append_c (out, ':');
+          json_append_string (out, polkit_action_description_get_annotation (action, annotation_keys[n]));
+        }
+      g_string_append_c (out, '}');
+    }
+
+  g_string_append (out, "}\n");
+  fputs (out->str, stdout);
+  g_string_free (out, TRUE);
+}
+
+static const struct
+{
+  const gchar *name;
+  PolkitActionDescriptionFields field;
+} field_names[] =
+{
+  { "description", POLKIT_ACTION_DESCRIPTION_FIELDS_DESCRIPTION },
+  { "message",     POLKIT_ACTION_DESCRIPTION_FIELDS_MESSAGE },
+  { "vendor",      POLKIT_ACTION_DESCRIPTION_FIELDS_VENDOR },
+  { "icon",        POLKIT_ACTION_DESCRIPTION_FIELDS_ICON_NAME },
+  { "implicit",    POLKIT_ACTION_DESCRIPTION_FIELDS_IMPLICIT },
+  { "annotations", POLKIT_ACTION_DESCRIPTION_FIELDS_ANNOTATIONS },
+  { "all",         POLKIT_ACTION_DESCRIPTION_FIELDS_ALL },
+};
+
+/* Parses a comma separated list of field names, e.g. "description,implicit" */
+static gboolean
+parse_fields (const gchar                    *str,
+              PolkitActionDescriptionFields  *out_fields)
+{
+  gchar **names;
+  guint n;
+  guint m;
+  gboolean ret;
+
+  ret = FALSE;
+  *out_fields = POLKIT_ACTION_DESCRIPTION_FIELDS_NONE;
+  names = g_strsplit (str, ",", 0);
+  for (n = 0; names[n] != NULL; n++)
+    {
+      const gchar *name = g_strstrip (names[n]);
+
+      if (*name == '\0')
+        continue;
+
+      for (m = 0; m < G_N_ELEMENTS (field_names); m++)
+        {
+          if (strcmp (name, field_names[m].name) == 0)
+            {
+              *out_fields |= field_names[m].field;
+              break;
+            }
+        }
+      if (m == G_N_ELEMENTS (field_names))
+        {
+          g_printerr (_("%s: Unknown field `%s'\n"), g_get_prgname (), name);
+          goto out;
+        }
+    }
+  ret = TRUE;
+
+ out:
+  g_strfreev (names);
+  return ret;
+}
+
 static gint
 action_desc_compare_by_action_id_func (PolkitActionDescription *a,
                                        PolkitActionDescription *b)
@@ -86,24 +250,168 @@ action_desc_compare_by_action_id_func (PolkitActionDescription *a,
                     polkit_action_description_get_action_id (b));
 }
 
+/* Takes ownership of @page, a list of actions sorted by action id */
+typedef void (*ActionPageFunc) (GList    *page,
+                                gpointer  user_data);
+
+/* Hands the actions whose identifier starts with @prefix to @func a page
+ * at a time as they arrive, only fetching the fields that will be printed
+ */
+static gboolean
+foreach_action_page (PolkitAuthority                *authority,
+                     const gchar                    *prefix,
+                     PolkitActionDescriptionFields   fields,
+                     ActionPageFunc                  func,
+                     gpointer                        user_data,
+                     GError                        **error)
+{
+  GList *page;
+  gchar *cursor;
+  gchar *next_cursor;
+  GError *local_error;
+  gboolean ret;
+
+  ret = FALSE;
+  cursor = NULL;
+  do
+    {
+      gboolean first_page = (cursor == NULL);
+
+      local_error = NULL;
+      page = polkit_authority_enumerate_actions_paged_sync (authority,
+                                                            prefix,
+                                                            fields,
+                                                            cursor,
+                                                            0,         /* let the authority pick */
+                                                            &next_cursor,
+                                                            NULL,      /* GCancellable */
+                                                            &local_error);
+      g_free (cursor);
+      cursor = NULL;
+      if (local_error != NULL)
+        {
+          /* an older authority only knows how to return everything at once */
+          if (first_page && g_error_matches (local_error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+            {
+              GList *l;
+              GList *next;
+
+              g_error_free (local_error);
+              local_error = NULL;
+              page = polkit_authority_enumerate_actions_sync (authority,
+                                                              NULL,      /* GCancellable */
+                                                              &local_error);
+              if (local_error != NULL)
+                {
+                  g_propagate_error (error, local_error);
+                  goto out;
+                }
+
+              for (l = page; l != NULL; l = next)
+                {
+                  next = l->next;
+                  if (prefix != NULL &&
+                      !g_str_has_prefix (polkit_action_description_get_action_id (l->data), prefix))
+                    {
+                      g_object_unref (l->data);
+                      page = g_list_delete_link (page, l);
+                    }
+                }
+              func (g_list_sort (page, (GCompareFunc) action_desc_compare_by_action_id_func), user_data);
+              ret = TRUE;
+            }
+          else
+            {
+              g_propagate_error (error, local_error);
+            }
+          goto out;
+        }
+
+      func (page, user_data);
+      cursor = next_cursor;
+    }
+  while (cursor != NULL);
+
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+static void
+collect_page (GList    *page,
+              gpointer  user_data)
+{
+  GList **actions = user_data;
+
+  *actions = g_list_concat (*actions, page);
+}
+
+typedef struct
+{
+  const gchar *action_id;
+  PolkitActionDescriptionFields fields;
+  guint num_printed;
+} JsonOutput;
+
+static void
+print_page_json (GList    *page,
+                 gpointer  user_data)
+{
+  JsonOutput *output = user_data;
+  GList *l;
+
+  for (l = page; l != NULL; l = l->next)
+    {
+      PolkitActionDescription *action = POLKIT_ACTION_DESCRIPTION (l->data);
+
+      if (output->action_id == NULL ||
+          g_strcmp0 (polkit_action_description_get_action_id (action), output->action_id) == 0)
+        {
+          print_action_json (action, output->fields);
+          output->num_printed++;
+        }
+    }
+  /* let whoever reads us get going on this page while we fetch the next */
+  fflush (stdout);
+
+  g_list_foreach (page, (GFunc) g_object_unref, NULL);
+  g_list_free (page);
+}
+
 int
 main (int argc, char *argv[])
 {
   guint ret;
   gchar *opt_action_id;
+  gchar *opt_prefix;
+  gchar *opt_fields;
   gchar *s;
   gboolean opt_show_version;
   gboolean opt_verbose;
+  gboolean opt_json;
   GOptionEntry options[] =
     {
       {
 	"action-id", 'a', 0, G_OPTION_ARG_STRING, &opt_action_id,
 	N_("Only output information about ACTION"), N_("ACTION")
       },
+      {
+	"prefix", 0, 0, G_OPTION_ARG_STRING, &opt_prefix,
+	N_("Only output actions whose identifier starts with PREFIX"), N_("PREFIX")
+      },
       {
 	"verbose", 'v', 0, G_OPTION_ARG_NONE, &opt_verbose,
 	N_("Output detailed action information"), NULL
       },
+      {
+	"json", 0, 0, G_OPTION_ARG_NONE, &opt_json,
+	N_("Output one JSON object per action and line"), NULL
+      },
+      {
+	"fields", 0, 0, G_OPTION_ARG_STRING, &opt_fields,
+	N_("Only output FIELDS, separated by commas, with --json"), N_("FIELDS")
+      },
       {
 	"version", 0, 0, G_OPTION_ARG_NONE, &opt_show_version,
 	N_("Show version"), NULL
@@ -112,11 +420,14 @@ main (int argc, char *argv[])
     };
   GOptionContext *context;
   PolkitAuthority *authority;
+  PolkitActionDescriptionFields fields;
   GList *l;
   GList *actions;
   GError *error;
 
   opt_action_id = NULL;
+  opt_prefix = NULL;
+  opt_fields = NULL;
   context = NULL;
   authority = NULL;
   actions = NULL;
@@ -127,9 +438,10 @@ main (int argc, char *argv[])
 
   opt_show_version = FALSE;
   opt_verbose = FALSE;
+  opt_json = FALSE;
 
   error = NULL;
-  context = g_option_context_new (N_("[--action-id ACTION]"));
+  context = g_option_context_new (N_("[--action-id ACTION | --prefix PREFIX]"));
   s = g_strdup_printf (_("Report bugs to: %s\n"
 			 "%s home page: <%s>"), PACKAGE_BUGREPORT,
 		       PACKAGE_NAME, PACKAGE_URL);
@@ -154,6 +466,23 @@ main (int argc, char *argv[])
       ret = 0;
       goto out;
     }
+  if (opt_action_id != NULL && opt_prefix != NULL)
+    {
+      g_printerr (_("%s: --action-id and --prefix can't be used together\n"), g_get_prgname ());
+      goto out;
+    }
+  if (opt_fields != NULL && !opt_json)
+    {
+      g_printerr (_("%s: --fields can only be used with --json\n"), g_get_prgname ());
+      goto out;
+    }
+
+  if (opt_json)
+    fields = POLKIT_ACTION_DESCRIPTION_FIELDS_ALL;
+  else
+    fields = opt_verbose ? POLKIT_ACTION_DESCRIPTION_FIELDS_ALL : POLKIT_ACTION_DESCRIPTION_FIELDS_NONE;
+  if (opt_fields != NULL && !parse_fields (opt_fields, &fields))
+    goto out;
 
   authority = polkit_authority_get_sync (NULL /* GCancellable* */, &error);
   if (authority == NULL)
@@ -163,11 +492,44 @@ main (int argc, char *argv[])
       goto out;
     }
 
+  if (opt_json)
+    {
+      JsonOutput output;
+
+      output.action_id = opt_action_id;
+      output.fields = fields;
+      output.num_printed = 0;
+
+      error = NULL;
+      if (!foreach_action_page (authority,
+                                opt_action_id != NULL ? opt_action_id : opt_prefix,
+                                fields,
+                                print_page_json,
+                                &output,
+                                &error))
+        {
+          g_printerr ("Error enumerating actions: %s\n", error->message);
+          g_error_free (error);
+          goto out;
+        }
+
+      if (opt_action_id != NULL && output.num_printed == 0)
+        {
+          g_printerr ("No action with action id %s\n", opt_action_id);
+          goto out;
+        }
+
+      ret = 0;
+      goto out;
+    }
+
   error = NULL;
-  actions = polkit_authority_enumerate_actions_sync (authority,
-                                                     NULL,      /* GCancellable */
-                                                     &error);
-  if (error != NULL)
+  if (!foreach_action_page (authority,
+                            opt_action_id != NULL ? opt_action_id : opt_prefix,
+                            fields,
+                            collect_page,
+                            &actions,
+                            &error))
     {
       g_printerr ("Error enumerating actions: %s\n", error->message);
       g_error_free (error);
@@ -198,9 +560,6 @@ main (int argc, char *argv[])
     }
   else
     {
-      actions = g_list_sort (actions,
-                             (GCompareFunc) action_desc_compare_by_action_id_func);
-
       for (l = actions; l != NULL; l = l->next)
         {
           PolkitActionDescription *action = POLKIT_ACTION_DESCRIPTION (l->data);
@@ -216,6 +575,8 @@ main (int argc, char *argv[])
   g_list_free (actions);
 
   g_free (opt_action_id);
+  g_free (opt_prefix);
+  g_free (opt_fields);
 
   if (authority != NULL)
     g_object_unref (authority);
@@ -224,4 +585,3 @@ main (int argc, char *argv[])
 
   return ret;
 }
-
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib/gi18n.h>
+#include <polkit/polkit.h>
+
+#include "polkitbackend/polkitbackendpolicybundle.h"
+#include "polkitbackend/polkitbackendpolicyfile.h"
+#include "polkitbackend/polkitbackendpolicyruleset.h"
+
+/* Load every *.keyrules file from the given directories, in the same order
+ * as polkitd does. Unlike polkitd, a single broken file fails the whole
+ * bundle, since no host would ever get to see what it was meant to say. */
+static gboolean
+load_rules (gchar      **rules_dirs,
+            PolicyFile **out_files,
+            guint       *out_num_files)
+{
+  GList *files;
+  GList *l;
+  PolicyFile *first;
+  PolicyFile *last;
+  GError *error;
+  gboolean ret;
+  guint n;
+
+  files = NULL;
+  first = NULL;
+  last = NULL;
+  ret = FALSE;
+  *out_num_files = 0;
+
+  for (n = 0; rules_dirs[n] != NULL; n++)
+    {
+      const gchar *name;
+      GDir *dir;
+
+      error = NULL;
+      dir = g_dir_open (rules_dirs[n], 0, &error);
+      if (dir == NULL)
+        {
+          g_printerr ("Error opening rules directory: %s\n", error->message);
+          g_error_free (error);
+          goto out;
+        }
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          if (g_str_has_suffix (name, ".keyrules"))
+            files = g_list_prepend (files, g_strdup_printf ("%s/%s", rules_dirs[n], name));
+        }
+      g_dir_close (dir);
+    }
+
+  files = g_list_sort (files, (GCompareFunc) policy_file_path_cmp);
+
+  for (l = files; l != NULL; l = l->next)
+    {
+      const gchar *filename = l->data;
+      PolicyFile *file;
+
+      error = NULL;
+      file = policy_file_new_from_path (filename, &error);
+      if (file == NULL)
+        {
+          g_printerr ("Error loading %s: %s\n", filename, error->message);
+          g_error_free (error);
+          goto out;
+        }
+
+      if (last != NULL)
+        last->next = file;
+      else
+        first = file;
+      last = file;
+      *out_num_files += 1;
+    }
+
+  *out_files = first;
+  first = NULL;
+  ret = TRUE;
+
+ out:
+  if (first != NULL)
+    policy_file_free (first);
+  g_list_free_full (files, g_free);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  guint ret;
+  gchar *s;
+  gchar **opt_rules_dirs;
+  gchar *opt_key;
+  gchar *opt_output;
+  gint64 opt_serial;
+  gboolean opt_show_version;
+  GOptionEntry options[] =
+    {
+      {
+	"rules-dir", 'd', 0, G_OPTION_ARG_FILENAME_ARRAY, &opt_rules_dirs,
+	N_("Load rules from DIR instead of the default directories"), N_("DIR")
+      },
+      {
+	"key", 'k', 0, G_OPTION_ARG_FILENAME, &opt_key,
+	N_("Sign the bundle with the key in FILE"), N_("FILE")
+      },
+      {
+	"output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output,
+	N_("Write the bundle to FILE"), N_("FILE")
+      },
+      {
+	"serial", 's', 0, G_OPTION_ARG_INT64, &opt_serial,
+	N_("Version the rules as SERIAL, the current time by default"), N_("SERIAL")
+      },
+      {
+	"version", 0, 0, G_OPTION_ARG_NONE, &opt_show_version,
+	N_("Show version"), NULL
+      },
+      { NULL, 0, 0, 0, NULL, NULL, NULL }
+    };
+  gchar *default_rules_dirs[] =
+    {
+      PACKAGE_SYSCONF_DIR "/polkit-1/rules.d",
+      PACKAGE_DATA_DIR "/polkit-1/rules.d",
+      NULL
+    };
+  GOptionContext *context;
+  PolicyFile *files;
+  PolicyRuleset *ruleset;
+  GBytes *key;
+  GError *error;
+  guint num_files;
+
+  opt_rules_dirs = NULL;
+  opt_key = NULL;
+  opt_output = NULL;
+  opt_serial = -1;
+  opt_show_version = FALSE;
+  context = NULL;
+  files = NULL;
+  ruleset = NULL;
+  key = NULL;
+  ret = 1;
+
+  /* Disable remote file access from GIO. */
+  setenv ("GIO_USE_VFS", "local", 1);
+
+  error = NULL;
+  context = g_option_context_new (N_("--key FILE --output FILE [--rules-dir DIR]..."));
+  s = g_strdup_printf (_("Report bugs to: %s\n"
+			 "%s home page: <%s>"), PACKAGE_BUGREPORT,
+		       PACKAGE_NAME, PACKAGE_URL);
+  g_option_context_set_description (context, s);
+  g_free (s);
+  g_option_context_add_main_entries (context, options, GETTEXT_PACKAGE);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      g_error_free (error);
+      goto out;
+    }
+  if (argc > 1)
+    {
+      g_printerr (_("%s: Unexpected argument `%s'\n"), g_get_prgname (),
+		  argv[1]);
+      goto out;
+    }
+  if (opt_show_version)
+    {
+      g_print ("pkbundle version %s\n", PACKAGE_VERSION);
+      ret = 0;
+      goto out;
+    }
+  if (opt_key == NULL || opt_output == NULL)
+    {
+      g_printerr (_("%s: Both --key and --output are required\n"), g_get_prgname ());
+      goto out;
+    }
+  if (opt_serial < -1)
+    {
+      g_printerr (_("%s: SERIAL must not be negative\n"), g_get_prgname ());
+      goto out;
+    }
+  if (opt_serial == -1)
+    opt_serial = g_get_real_time () / G_USEC_PER_SEC;
+
+  key = policy_bundle_read_key (opt_key, &error);
+  if (key == NULL)
+    {
+      g_printerr ("Error reading key: %s\n", error->message);
+      g_error_free (error);
+      goto out;
+    }
+
+  if (!load_rules (opt_rules_dirs != NULL ? opt_rules_dirs : default_rules_dirs, &files, &num_files))
+    goto out;
+
+  if (!policy_bundle_write (opt_output, files, (guint64) opt_serial, key, &error))
+    {
+      g_printerr ("Error writing bundle: %s\n", error->message);
+      g_error_free (error);
+      goto out;
+    }
+
+  /* Compiled only to report what the hosts will end up with */
+  ruleset = policy_ruleset_new (files);
+  files = NULL;
+
+  g_print ("bundle:        %s (serial %" G_GINT64_FORMAT ", version %d)\n",
+           opt_output, opt_serial, POLICY_BUNDLE_VERSION);
+  g_print ("rules files:   %u (%u rules, %u pruned)\n", num_files, ruleset->rules->len, ruleset->n_pruned);
+
+  ret = 0;
+
+ out:
+  if (ruleset != NULL)
+    policy_ruleset_unref (ruleset);
+  if (files != NULL)
+    policy_file_free (files);
+  if (key != NULL)
+    g_bytes_unref (key);
+  if (context != NULL)
+    g_option_context_free (context);
+  g_strfreev (opt_rules_dirs);
+  g_free (opt_key);
+  g_free (opt_output);
+
+  return ret;
+}
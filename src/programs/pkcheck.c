@@ -25,7 +25,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <glib/gi18n.h>
+#include <gio/gunixinputstream.h>
 #include <polkit/polkit.h>
 #define POLKIT_AGENT_I_KNOW_API_IS_SUBJECT_TO_CHANGE
 #include <polkitagent/polkitagent.h>
@@ -42,13 +45,16 @@ help (void)
 "Application Options:\n"
 "  -a, --action-id=ACTION             Check authorization to perform ACTION\n"
 "  -u, --allow-user-interaction       Interact with the user if necessary\n"
+"  --batch                            Read checks from standard input, one per line\n"
 "  -d, --details=KEY VALUE            Add (KEY, VALUE) to information about the action\n"
 "  --enable-internal-agent            Use an internal authentication agent if necessary\n"
+"  --explain                          Show what decided the authorization, and timings\n"
 "  --list-temp                        List temporary authorizations for current session\n"
 "  -p, --process=PID[,START_TIME,UID] Check authorization of specified process\n"
 "  --revoke-temp                      Revoke all temporary authorizations for current session\n"
 "  -s, --system-bus-name=BUS_NAME     Check authorization of owner of BUS_NAME\n"
 "  --version                          Show version\n"
+"  --window=N                         Keep up to N requests outstanding with --batch\n"
 	     "\n"
 	     "Report bugs to: %s\n"
 	     "%s home page: <%s>\n"), PACKAGE_BUGREPORT, PACKAGE_NAME,
@@ -199,6 +205,35 @@ _polkit_subject_get_cmdline (PolkitSubject *subject)
   return ret;
 }
 
+static PolkitSubject *
+parse_process (const gchar *value)
+{
+  PolkitSubject *subject;
+  gint pid;
+  guint uid;
+  guint64 pid_start_time;
+
+  subject = NULL;
+  if (sscanf (value, "%i,%" G_GUINT64_FORMAT ",%u", &pid, &pid_start_time, &uid) == 3)
+    {
+      subject = polkit_unix_process_new_for_owner (pid, pid_start_time, uid);
+    }
+  else if (sscanf (value, "%i,%" G_GUINT64_FORMAT, &pid, &pid_start_time) == 2)
+    {
+      G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+      subject = polkit_unix_process_new_full (pid, pid_start_time);
+      G_GNUC_END_IGNORE_DEPRECATIONS
+    }
+  else if (sscanf (value, "%i", &pid) == 1)
+    {
+      G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+      subject = polkit_unix_process_new (pid);
+      G_GNUC_END_IGNORE_DEPRECATIONS
+    }
+
+  return subject;
+}
+
 static gint
 do_list_or_revoke_temp_authz (gboolean revoke)
 {
@@ -330,6 +365,492 @@ do_list_or_revoke_temp_authz (gboolean revoke)
   return ret;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* How many checks of the same subject go out in one CheckAuthorizations call */
+#define BATCH_MAX_CHECKS 32
+
+/* How many calls may be outstanding at once unless --window says otherwise */
+#define BATCH_DEFAULT_WINDOW 16
+
+typedef struct
+{
+  PolkitAuthority *authority;
+  PolkitCheckAuthorizationFlags flags;
+  GDataInputStream *input;
+  GMainLoop *loop;
+
+  guint window;
+  guint n_in_flight;
+
+  /* BatchCall objects not sent yet, only the last one is still growing */
+  GQueue waiting;
+
+  guint line;
+  gboolean reading;
+  gboolean eof;
+
+  /* set once the daemon turns out not to know CheckAuthorizations */
+  gboolean no_check_authorizations;
+
+  gint ret;
+} Batch;
+
+/* A single line of input */
+typedef struct
+{
+  guint line;
+  gchar *action_id;
+  PolkitDetails *details;
+} BatchCheck;
+
+/* Checks of the same subject that share a single D-Bus call */
+typedef struct
+{
+  Batch *batch;
+  PolkitSubject *subject;
+  GPtrArray *checks;
+} BatchCall;
+
+static void batch_run (Batch *batch);
+
+static void
+batch_check_free (BatchCheck *check)
+{
+  g_free (check->action_id);
+  g_object_unref (check->details);
+  g_free (check);
+}
+
+static BatchCall *
+batch_call_new (Batch         *batch,
+                PolkitSubject *subject)
+{
+  BatchCall *call;
+
+  call = g_new0 (BatchCall, 1);
+  call->batch = batch;
+  call->subject = g_object_ref (subject);
+  call->checks = g_ptr_array_new_with_free_func ((GDestroyNotify) batch_check_free);
+
+  return call;
+}
+
+static void
+batch_call_free (BatchCall *call)
+{
+  g_object_unref (call->subject);
+  g_ptr_array_unref (call->checks);
+  g_free (call);
+}
+
+static void
+batch_print_result (BatchCheck                *check,
+                    PolkitAuthorizationResult *result)
+{
+  PolkitDetails *result_details;
+  const gchar *outcome;
+  GString *str;
+
+  if (polkit_authorization_result_get_is_authorized (result))
+    outcome = "authorized";
+  else if (polkit_authorization_result_get_is_challenge (result))
+    outcome = "challenge";
+  else if (polkit_authorization_result_get_dismissed (result))
+    outcome = "dismissed";
+  else
+    outcome = "not-authorized";
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "%u %s", check->line, outcome);
+
+  result_details = polkit_authorization_result_get_details (result);
+  if (result_details != NULL)
+    {
+      gchar **keys;
+      guint n;
+
+      keys = polkit_details_get_keys (result_details);
+      for (n = 0; keys != NULL && keys[n] != NULL; n++)
+        {
+          gchar *key;
+          gchar *value;
+
+          key = escape_str (keys[n]);
+          value = escape_str (polkit_details_lookup (result_details, keys[n]));
+          g_string_append_printf (str, " %s=%s", key, value);
+          g_free (key);
+          g_free (value);
+        }
+      g_strfreev (keys);
+    }
+
+  g_print ("%s\n", str->str);
+  g_string_free (str, TRUE);
+}
+
+static void
+batch_print_error (Batch       *batch,
+                   guint        line,
+                   const gchar *action_id,
+                   const gchar *message)
+{
+  if (action_id != NULL)
+    g_printerr ("Error checking for authorization %s on line %u: %s\n", action_id, line, message);
+  else
+    g_printerr ("Error on line %u: %s\n", line, message);
+  g_print ("%u error\n", line);
+  batch->ret = 127;
+}
+
+static void
+batch_check_cb (GObject      *source_object,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  BatchCall *call = user_data;
+  Batch *batch = call->batch;
+  BatchCheck *check;
+  PolkitAuthorizationResult *result;
+  GError *error;
+
+  check = call->checks->pdata[0];
+
+  error = NULL;
+  result = polkit_authority_check_authorization_finish (POLKIT_AUTHORITY (source_object), res, &error);
+  if (result == NULL)
+    {
+      batch_print_error (batch, check->line, check->action_id, error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      batch_print_result (check, result);
+      g_object_unref (result);
+    }
+
+  batch_call_free (call);
+  batch->n_in_flight--;
+  batch_run (batch);
+}
+
+static void
+batch_check_many_cb (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+  BatchCall *call = user_data;
+  Batch *batch = call->batch;
+  GList *results;
+  GList *l;
+  GError *error;
+  guint n;
+
+  batch->n_in_flight--;
+
+  error = NULL;
+  results = polkit_authority_check_authorizations_finish (POLKIT_AUTHORITY (source_object), res, &error);
+  if (results == NULL && g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+    {
+      /* an older daemon, send the checks one by one from now on */
+      batch->no_check_authorizations = TRUE;
+      for (n = call->checks->len; n > 0; n--)
+        {
+          BatchCall *single;
+
+          single = batch_call_new (batch, call->subject);
+          g_ptr_array_add (single->checks, call->checks->pdata[n - 1]);
+          call->checks->pdata[n - 1] = NULL;
+          g_queue_push_head (&batch->waiting, single);
+        }
+      g_ptr_array_set_free_func (call->checks, NULL);
+      g_error_free (error);
+    }
+  else if (results == NULL)
+    {
+      for (n = 0; n < call->checks->len; n++)
+        {
+          BatchCheck *check = call->checks->pdata[n];
+          batch_print_error (batch, check->line, check->action_id, error->message);
+        }
+      g_error_free (error);
+    }
+  else
+    {
+      for (l = results, n = 0; l != NULL && n < call->checks->len; l = l->next, n++)
+        batch_print_result (call->checks->pdata[n], POLKIT_AUTHORIZATION_RESULT (l->data));
+      g_list_free_full (results, g_object_unref);
+    }
+
+  batch_call_free (call);
+  batch_run (batch);
+}
+
+static void
+batch_send (Batch     *batch,
+            BatchCall *call)
+{
+  const gchar **action_ids;
+  PolkitDetails **details;
+  guint n;
+
+  batch->n_in_flight++;
+
+  if (call->checks->len == 1)
+    {
+      BatchCheck *check = call->checks->pdata[0];
+
+      polkit_authority_check_authorization (batch->authority,
+                                            call->subject,
+                                            check->action_id,
+                                            check->details,
+                                            batch->flags,
+                                            NULL, /* GCancellable */
+                                            batch_check_cb,
+                                            call);
+      return;
+    }
+
+  action_ids = g_new0 (const gchar *, call->checks->len + 1);
+  details = g_new0 (PolkitDetails *, call->checks->len);
+  for (n = 0; n < call->checks->len; n++)
+    {
+      BatchCheck *check = call->checks->pdata[n];
+      action_ids[n] = check->action_id;
+      details[n] = check->details;
+    }
+
+  polkit_authority_check_authorizations (batch->authority,
+                                         call->subject,
+                                         action_ids,
+                                         details,
+                                         batch->flags,
+                                         NULL, /* GCancellable */
+                                         batch_check_many_cb,
+                                         call);
+
+  g_free (action_ids);
+  g_free (details);
+}
+
+/* Parses a line of input, which takes the same options as a single check */
+static gboolean
+batch_parse_line (const gchar    *line,
+                  PolkitSubject **out_subject,
+                  BatchCheck     *check,
+                  GError        **error)
+{
+  gchar **args;
+  gint argc;
+  gint n;
+  PolkitSubject *subject;
+  gboolean ret;
+
+  ret = FALSE;
+  subject = NULL;
+
+  if (!g_shell_parse_argv (line, &argc, &args, error))
+    return FALSE;
+
+  for (n = 0; n < argc; n++)
+    {
+      if (n + 1 >= argc)
+        {
+          g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                       "Argument expected after `%s'", args[n]);
+          goto out;
+        }
+
+      if (g_strcmp0 (args[n], "--process") == 0 || g_strcmp0 (args[n], "-p") == 0)
+        {
+          n++;
+          if (subject != NULL)
+            g_object_unref (subject);
+          subject = parse_process (args[n]);
+          if (subject == NULL)
+            {
+              g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                           "Invalid --process value `%s'", args[n]);
+              goto out;
+            }
+        }
+      else if (g_strcmp0 (args[n], "--system-bus-name") == 0 || g_strcmp0 (args[n], "-s") == 0)
+        {
+          n++;
+          if (subject != NULL)
+            g_object_unref (subject);
+          subject = polkit_system_bus_name_new (args[n]);
+        }
+      else if (g_strcmp0 (args[n], "--action-id") == 0 || g_strcmp0 (args[n], "-a") == 0)
+        {
+          n++;
+          g_free (check->action_id);
+          check->action_id = g_strdup (args[n]);
+        }
+      else if (g_strcmp0 (args[n], "--detail") == 0 || g_strcmp0 (args[n], "-d") == 0)
+        {
+          if (n + 2 >= argc)
+            {
+              g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                           "Two arguments expected after `--detail'");
+              goto out;
+            }
+          polkit_details_insert (check->details, args[n + 1], args[n + 2]);
+          n += 2;
+        }
+      else
+        {
+          g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_UNKNOWN_OPTION,
+                       "Unexpected argument `%s'", args[n]);
+          goto out;
+        }
+    }
+
+  if (subject == NULL)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "Subject not specified");
+      goto out;
+    }
+  if (check->action_id == NULL)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "Action not specified");
+      goto out;
+    }
+
+  *out_subject = subject;
+  subject = NULL;
+  ret = TRUE;
+
+ out:
+  if (subject != NULL)
+    g_object_unref (subject);
+  g_strfreev (args);
+  return ret;
+}
+
+static void
+batch_add_line (Batch       *batch,
+                const gchar *line)
+{
+  BatchCheck *check;
+  BatchCall *call;
+  PolkitSubject *subject;
+  GError *error;
+
+  check = g_new0 (BatchCheck, 1);
+  check->line = batch->line;
+  check->details = polkit_details_new ();
+
+  error = NULL;
+  if (!batch_parse_line (line, &subject, check, &error))
+    {
+      batch_print_error (batch, check->line, NULL, error->message);
+      g_error_free (error);
+      batch_check_free (check);
+      return;
+    }
+
+  /* checks of the same subject that pile up while the window is full
+   * are sent together
+   */
+  call = g_queue_peek_tail (&batch->waiting);
+  if (call == NULL ||
+      batch->no_check_authorizations ||
+      call->checks->len >= BATCH_MAX_CHECKS ||
+      !polkit_subject_equal (call->subject, subject))
+    {
+      call = batch_call_new (batch, subject);
+      g_queue_push_tail (&batch->waiting, call);
+    }
+  g_ptr_array_add (call->checks, check);
+
+  g_object_unref (subject);
+}
+
+static void
+batch_read_line_cb (GObject      *source_object,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+  Batch *batch = user_data;
+  gchar *line;
+  GError *error;
+
+  batch->reading = FALSE;
+
+  error = NULL;
+  line = g_data_input_stream_read_line_finish (G_DATA_INPUT_STREAM (source_object), res, NULL, &error);
+  if (line == NULL)
+    {
+      if (error != NULL)
+        {
+          g_printerr ("Error reading standard input: %s\n", error->message);
+          g_error_free (error);
+          batch->ret = 127;
+        }
+      batch->eof = TRUE;
+    }
+  else
+    {
+      batch->line++;
+      g_strstrip (line);
+      if (line[0] != '\0' && line[0] != '#')
+        batch_add_line (batch, line);
+      g_free (line);
+    }
+
+  batch_run (batch);
+}
+
+/* Sends what fits into the window and reads on while there is room */
+static void
+batch_run (Batch *batch)
+{
+  while (batch->n_in_flight < batch->window && !g_queue_is_empty (&batch->waiting))
+    batch_send (batch, g_queue_pop_head (&batch->waiting));
+
+  if (!batch->reading && !batch->eof && g_queue_get_length (&batch->waiting) < batch->window)
+    {
+      batch->reading = TRUE;
+      g_data_input_stream_read_line_async (batch->input,
+                                           G_PRIORITY_DEFAULT,
+                                           NULL, /* GCancellable */
+                                           batch_read_line_cb,
+                                           batch);
+    }
+
+  if (batch->eof && batch->n_in_flight == 0 && g_queue_is_empty (&batch->waiting))
+    g_main_loop_quit (batch->loop);
+}
+
+static gint
+do_batch (PolkitAuthority               *authority,
+          PolkitCheckAuthorizationFlags  flags,
+          guint                          window)
+{
+  GInputStream *stdin_stream;
+  Batch batch;
+
+  memset (&batch, 0, sizeof (Batch));
+  batch.authority = authority;
+  batch.flags = flags;
+  batch.window = window;
+  batch.loop = g_main_loop_new (NULL, FALSE);
+  g_queue_init (&batch.waiting);
+
+  stdin_stream = g_unix_input_stream_new (STDIN_FILENO, FALSE);
+  batch.input = g_data_input_stream_new (stdin_stream);
+  g_object_unref (stdin_stream);
+
+  batch_run (&batch);
+  g_main_loop_run (batch.loop);
+
+  g_object_unref (batch.input);
+  g_main_loop_unref (batch.loop);
+
+  return batch.ret;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -339,9 +860,12 @@ main (int argc, char *argv[])
   gboolean opt_show_help;
   gboolean opt_show_version;
   gboolean allow_user_interaction;
+  gboolean explain;
   gboolean enable_internal_agent;
   gboolean list_temp;
   gboolean revoke_temp;
+  gboolean batch;
+  guint window;
   PolkitAuthority *authority;
   PolkitAuthorizationResult *result;
   PolkitSubject *subject;
@@ -357,9 +881,12 @@ main (int argc, char *argv[])
   authority = NULL;
   result = NULL;
   allow_user_interaction = FALSE;
+  explain = FALSE;
   enable_internal_agent = FALSE;
   list_temp = FALSE;
   revoke_temp = FALSE;
+  batch = FALSE;
+  window = BATCH_DEFAULT_WINDOW;
   local_agent_handle = NULL;
   ret = 126;
 
@@ -383,10 +910,6 @@ main (int argc, char *argv[])
         }
       else if (g_strcmp0 (argv[n], "--process") == 0 || g_strcmp0 (argv[n], "-p") == 0)
         {
-          gint pid;
-	  guint uid;
-          guint64 pid_start_time;
-
           n++;
           if (n >= (guint) argc)
             {
@@ -395,23 +918,8 @@ main (int argc, char *argv[])
               goto out;
             }
 
-          if (sscanf (argv[n], "%i,%" G_GUINT64_FORMAT ",%u", &pid, &pid_start_time, &uid) == 3)
-            {
-              subject = polkit_unix_process_new_for_owner (pid, pid_start_time, uid);
-            }
-          else if (sscanf (argv[n], "%i,%" G_GUINT64_FORMAT, &pid, &pid_start_time) == 2)
-            {
-	      G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-              subject = polkit_unix_process_new_full (pid, pid_start_time);
-	      G_GNUC_END_IGNORE_DEPRECATIONS
-            }
-          else if (sscanf (argv[n], "%i", &pid) == 1)
-            {
-	      G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-              subject = polkit_unix_process_new (pid);
-	      G_GNUC_END_IGNORE_DEPRECATIONS
-            }
-          else
+          subject = parse_process (argv[n]);
+          if (subject == NULL)
             {
 	      g_printerr (_("%s: Invalid --process value `%s'\n"),
 			  g_get_prgname (), argv[n]);
@@ -471,6 +979,10 @@ main (int argc, char *argv[])
         {
           allow_user_interaction = TRUE;
         }
+      else if (g_strcmp0 (argv[n], "--explain") == 0)
+        {
+          explain = TRUE;
+        }
       else if (g_strcmp0 (argv[n], "--enable-internal-agent") == 0)
         {
           enable_internal_agent = TRUE;
@@ -483,6 +995,30 @@ main (int argc, char *argv[])
         {
           revoke_temp = TRUE;
         }
+      else if (g_strcmp0 (argv[n], "--batch") == 0)
+        {
+          batch = TRUE;
+        }
+      else if (g_strcmp0 (argv[n], "--window") == 0)
+        {
+          gchar *endp;
+
+          n++;
+          if (n >= (guint) argc)
+            {
+	      g_printerr (_("%s: Argument expected after `%s'\n"),
+			  g_get_prgname (), "--window");
+              goto out;
+            }
+
+          window = strtoul (argv[n], &endp, 10);
+          if (argv[n][0] == '\0' || *endp != '\0' || window == 0)
+            {
+	      g_printerr (_("%s: Invalid --window value `%s'\n"),
+			  g_get_prgname (), argv[n]);
+              goto out;
+            }
+        }
       else
         {
           break;
@@ -518,6 +1054,21 @@ main (int argc, char *argv[])
       ret = do_list_or_revoke_temp_authz (TRUE);
       goto out;
     }
+  else if (batch)
+    {
+      if (subject != NULL || action_id != NULL)
+        {
+          g_printerr (_("%s: Subjects and actions are read from standard input with --batch\n"),
+                      g_get_prgname ());
+          goto out;
+        }
+      if (enable_internal_agent)
+        {
+          g_printerr (_("%s: --enable-internal-agent can't be used with --batch\n"),
+                      g_get_prgname ());
+          goto out;
+        }
+    }
   else if (subject == NULL)
     {
       g_printerr (_("%s: Subject not specified\n"), g_get_prgname ());
@@ -533,11 +1084,24 @@ main (int argc, char *argv[])
       goto out;
     }
 
+  if (batch)
+    {
+      flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE;
+      if (allow_user_interaction)
+        flags |= POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION;
+      if (explain)
+        flags |= POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN;
+      ret = do_batch (authority, flags, window);
+      goto out;
+    }
+
  try_again:
   error = NULL;
   flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE;
   if (allow_user_interaction)
     flags |= POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION;
+  if (explain)
+    flags |= POLKIT_CHECK_AUTHORIZATION_FLAGS_EXPLAIN;
   result = polkit_authority_check_authorization_sync (authority,
                                                       subject,
                                                       action_id,
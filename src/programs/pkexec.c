@@ -32,9 +32,11 @@
 #include <grp.h>
 #include <pwd.h>
 #include <errno.h>
+#include <dirent.h>
 
 #ifdef __linux__
 #include <sys/prctl.h>
+#include <sys/syscall.h>
 #endif
 
 #include <glib/gi18n.h>
@@ -250,9 +252,41 @@ fdwalk (FdCallback callback,
 {
   gint fd;
   gint max_fd;
+  DIR *dir;
 
   g_return_val_if_fail (callback != NULL, FALSE);
 
+  /* only visit the descriptors that are open, if we can tell */
+  dir = opendir ("/proc/self/fd");
+  if (dir != NULL)
+    {
+      struct dirent *de;
+      gboolean ret;
+
+      ret = TRUE;
+      while ((de = readdir (dir)) != NULL)
+        {
+          gchar *endp;
+          glong value;
+
+          if (de->d_name[0] == '.')
+            continue;
+
+          value = strtol (de->d_name, &endp, 10);
+          if (*endp != '\0' || value < 0 || value > G_MAXINT || value == dirfd (dir))
+            continue;
+
+          if (!callback ((gint) value, user_data))
+            {
+              ret = FALSE;
+              break;
+            }
+        }
+      closedir (dir);
+
+      return ret;
+    }
+
   max_fd = sysconf (_SC_OPEN_MAX);
   for (fd = 0; fd < max_fd; fd++)
     {
@@ -263,13 +297,41 @@ fdwalk (FdCallback callback,
   return TRUE;
 }
 
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+/* Marks every descriptor from @fd_bottom up close-on-exec with a single
+ * system call. Returns FALSE if the kernel doesn't support it.
+ */
+static gboolean
+set_close_on_exec_from (gint fd_bottom)
+{
+#ifdef SYS_close_range
+  return syscall (SYS_close_range, (unsigned int) fd_bottom, ~0U, CLOSE_RANGE_CLOEXEC) == 0;
+#else
+  return FALSE;
+#endif
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
+static gboolean
+action_allows_gui (PolkitActionDescription *action_desc)
+{
+  const gchar *allow_gui_annotation;
+
+  allow_gui_annotation = polkit_action_description_get_annotation (action_desc, "org.freedesktop.policykit.exec.allow_gui");
+
+  return allow_gui_annotation != NULL && strlen (allow_gui_annotation) > 0;
+}
+
+/* For authorities that can't look up the action for a path themselves */
 static gchar *
-find_action_for_path (PolkitAuthority *authority,
-                      const gchar     *path,
-                      const gchar     *argv1,
-                      gboolean        *allow_gui)
+find_action_for_path_in_all_actions (PolkitAuthority *authority,
+                                     const gchar     *path,
+                                     const gchar     *argv1,
+                                     gboolean        *allow_gui)
 {
   GList *l;
   GList *actions;
@@ -279,7 +341,6 @@ find_action_for_path (PolkitAuthority *authority,
   actions = NULL;
   action_id = NULL;
   error = NULL;
-  *allow_gui = FALSE;
 
   actions = polkit_authority_enumerate_actions_sync (authority,
                                                      NULL,
@@ -296,7 +357,6 @@ find_action_for_path (PolkitAuthority *authority,
       PolkitActionDescription *action_desc = POLKIT_ACTION_DESCRIPTION (l->data);
       const gchar *argv1_for_action;
       const gchar *path_for_action;
-      const gchar *allow_gui_annotation;
 
       path_for_action = polkit_action_description_get_annotation (action_desc, "org.freedesktop.policykit.exec.path");
       if (path_for_action == NULL)
@@ -314,11 +374,7 @@ find_action_for_path (PolkitAuthority *authority,
             }
 
           action_id = g_strdup (polkit_action_description_get_action_id (action_desc));
-
-          allow_gui_annotation = polkit_action_description_get_annotation (action_desc, "org.freedesktop.policykit.exec.allow_gui");
-
-          if (allow_gui_annotation != NULL && strlen (allow_gui_annotation) > 0)
-            *allow_gui = TRUE;
+          *allow_gui = action_allows_gui (action_desc);
 
           goto out;
         }
@@ -328,6 +384,48 @@ find_action_for_path (PolkitAuthority *authority,
   g_list_foreach (actions, (GFunc) g_object_unref, NULL);
   g_list_free (actions);
 
+  return action_id;
+}
+
+static gchar *
+find_action_for_path (PolkitAuthority *authority,
+                      const gchar     *path,
+                      const gchar     *argv1,
+                      gboolean        *allow_gui)
+{
+  PolkitActionDescription *action_desc;
+  gchar *action_id;
+  GError *error;
+
+  action_id = NULL;
+  error = NULL;
+  *allow_gui = FALSE;
+
+  /* let the authority pick the action from its index rather than
+   * downloading every action to look for it
+   */
+  action_desc = polkit_authority_get_action_for_exec_path_sync (authority,
+                                                                path,
+                                                                argv1,
+                                                                NULL,
+                                                                &error);
+  if (action_desc != NULL)
+    {
+      action_id = g_strdup (polkit_action_description_get_action_id (action_desc));
+      *allow_gui = action_allows_gui (action_desc);
+      g_object_unref (action_desc);
+    }
+  else if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+    {
+      g_error_free (error);
+      action_id = find_action_for_path_in_all_actions (authority, path, argv1, allow_gui);
+    }
+  else if (error != NULL)
+    {
+      g_warning ("Error looking up action for %s: %s", path, error->message);
+      g_error_free (error);
+    }
+
   /* Fall back to org.freedesktop.policykit.exec */
 
   if (action_id == NULL)
@@ -926,7 +1024,8 @@ main (int argc, char *argv[])
     }
 
   /* set close_on_exec on all file descriptors except stdin, stdout, stderr */
-  if (!fdwalk (set_close_on_exec, GINT_TO_POINTER (3)))
+  if (!set_close_on_exec_from (3) &&
+      !fdwalk (set_close_on_exec, GINT_TO_POINTER (3)))
     {
       g_printerr ("Error setting close-on-exec for file desriptors\n");
       goto out;
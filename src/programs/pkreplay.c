@@ -0,0 +1,680 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <errno.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib/gi18n.h>
+#include <polkit/polkit.h>
+
+#include "polkitbackend/polkitbackendpolicyfile.h"
+#include "polkitbackend/polkitbackendpolicyruleset.h"
+
+/* A single recorded check, as read from the trace */
+typedef struct
+{
+  guint line;
+  gchar *action_id;
+  uid_t uid;
+  gchar *username;
+  GArray *gids;
+  gboolean is_local;
+  gboolean is_active;
+} TraceCheck;
+
+/* What a single evaluation of a check came to */
+typedef struct
+{
+  PolkitImplicitAuthorization response;
+  guint n_tested;
+  const gchar *matched_id;
+} CheckResult;
+
+typedef enum
+{
+  ENGINE_RULESET,
+  ENGINE_LINEAR,
+} Engine;
+
+/* UNKNOWN is -1, so every response is offset by one */
+#define N_RESPONSES (POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED + 2)
+
+static void
+trace_check_free (TraceCheck *check)
+{
+  g_free (check->action_id);
+  g_free (check->username);
+  g_array_unref (check->gids);
+  g_free (check);
+}
+
+static gint64
+get_time_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((gint64) ts.tv_sec) * G_GINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+static const gchar *
+response_to_string (PolkitImplicitAuthorization response)
+{
+  if (response == POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
+    return "unknown";
+  return polkit_implicit_authorization_to_string (response);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Load every *.keyrules file from the given directories, in the same order
+ * as polkitd does, and compile them into a ruleset */
+static PolicyRuleset *
+load_rules (gchar **rules_dirs,
+            guint  *out_num_files)
+{
+  GList *files;
+  GList *l;
+  PolicyFile *first;
+  PolicyFile *last;
+  GError *error;
+  guint n;
+
+  files = NULL;
+  first = NULL;
+  last = NULL;
+  *out_num_files = 0;
+
+  for (n = 0; rules_dirs[n] != NULL; n++)
+    {
+      const gchar *name;
+      GDir *dir;
+
+      error = NULL;
+      dir = g_dir_open (rules_dirs[n], 0, &error);
+      if (dir == NULL)
+        {
+          g_printerr ("Error opening rules directory: %s\n", error->message);
+          g_error_free (error);
+          continue;
+        }
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          if (g_str_has_suffix (name, ".keyrules"))
+            files = g_list_prepend (files, g_strdup_printf ("%s/%s", rules_dirs[n], name));
+        }
+      g_dir_close (dir);
+    }
+
+  files = g_list_sort (files, (GCompareFunc) policy_file_path_cmp);
+
+  for (l = files; l != NULL; l = l->next)
+    {
+      const gchar *filename = l->data;
+      PolicyFile *file;
+
+      error = NULL;
+      file = policy_file_new_from_path (filename, &error);
+      if (file == NULL)
+        {
+          g_printerr ("Error loading %s: %s\n", filename, error->message);
+          g_error_free (error);
+          continue;
+        }
+
+      if (last != NULL)
+        last->next = file;
+      else
+        first = file;
+      last = file;
+      *out_num_files += 1;
+    }
+
+  g_list_free_full (files, g_free);
+
+  return policy_ruleset_new (first);
+}
+
+/* List the rules that the ruleset dropped since they can never answer */
+static void
+print_pruned_rules (PolicyRuleset *ruleset)
+{
+  guint n;
+
+  for (n = 0; n < ruleset->rules->len; n++)
+    {
+      const PolicyRulesetEntry *entry;
+      const PolicyRulesetEntry *shadow;
+
+      entry = &g_array_index (ruleset->rules, PolicyRulesetEntry, n);
+      if (entry->status == POLICY_RULE_SHADOWED)
+        {
+          shadow = &g_array_index (ruleset->rules, PolicyRulesetEntry, entry->shadowed_by);
+          g_print ("pruned [%s] in %s: shadowed by [%s] in %s\n",
+                   policy_file_get_id (entry->file, entry->policy), entry->file->path,
+                   policy_file_get_id (shadow->file, shadow->policy), shadow->file->path);
+        }
+      else if (entry->status == POLICY_RULE_INERT)
+        {
+          g_print ("pruned [%s] in %s: can never answer\n",
+                   policy_file_get_id (entry->file, entry->policy), entry->file->path);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+parse_boolean (const gchar *str,
+               gboolean    *out_value)
+{
+  if (g_strcmp0 (str, "yes") == 0 || g_strcmp0 (str, "true") == 0 || g_strcmp0 (str, "1") == 0)
+    *out_value = TRUE;
+  else if (g_strcmp0 (str, "no") == 0 || g_strcmp0 (str, "false") == 0 || g_strcmp0 (str, "0") == 0)
+    *out_value = FALSE;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+static gboolean
+parse_user (const gchar  *str,
+            uid_t        *out_uid,
+            gchar       **out_username)
+{
+  struct passwd *pw;
+  gchar *end;
+  guint64 value;
+
+  errno = 0;
+  value = g_ascii_strtoull (str, &end, 10);
+  if (*str != '\0' && *end == '\0' && errno == 0 && value <= G_MAXUINT32)
+    {
+      *out_uid = (uid_t) value;
+      pw = getpwuid (*out_uid);
+      /* Same fallback as the keyfile authority for users without a name */
+      *out_username = pw != NULL ? g_strdup (pw->pw_name) : g_strdup_printf ("%d", (gint) *out_uid);
+      return TRUE;
+    }
+
+  pw = getpwnam (str);
+  if (pw == NULL)
+    return FALSE;
+  *out_uid = pw->pw_uid;
+  *out_username = g_strdup (pw->pw_name);
+  return TRUE;
+}
+
+static gboolean
+parse_groups (const gchar  *str,
+              GArray       *gids,
+              GError      **error)
+{
+  gchar **names;
+  gboolean ret;
+  guint n;
+
+  if (g_strcmp0 (str, "-") == 0)
+    return TRUE;
+
+  ret = FALSE;
+  names = g_strsplit (str, ",", -1);
+  for (n = 0; names[n] != NULL; n++)
+    {
+      gid_t gid;
+
+      if (!policy_resolve_group (names[n], &gid))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Unknown group `%s'", names[n]);
+          goto out;
+        }
+      g_array_append_val (gids, gid);
+    }
+  ret = TRUE;
+
+ out:
+  g_strfreev (names);
+  return ret;
+}
+
+/* Split on runs of whitespace */
+static gchar **
+split_fields (const gchar *line)
+{
+  gchar **fields;
+  guint i;
+  guint j;
+
+  fields = g_strsplit_set (line, " \t", -1);
+  for (i = 0, j = 0; fields[i] != NULL; i++)
+    {
+      if (fields[i][0] == '\0')
+        g_free (fields[i]);
+      else
+        fields[j++] = fields[i];
+    }
+  fields[j] = NULL;
+
+  return fields;
+}
+
+/* Each line is ACTION USER GROUPS LOCAL ACTIVE, where USER is a uid or user
+ * name, GROUPS is a comma separated list of groups (or - for none) and LOCAL
+ * and ACTIVE are yes or no. Blank lines and lines starting with # are
+ * ignored. */
+static GPtrArray *
+load_trace (const gchar  *path,
+            GError      **error)
+{
+  GIOChannel *channel;
+  GPtrArray *ret;
+  GPtrArray *checks;
+  gchar *line;
+  guint line_no;
+
+  ret = NULL;
+  checks = g_ptr_array_new_with_free_func ((GDestroyNotify) trace_check_free);
+  line_no = 0;
+
+  if (g_strcmp0 (path, "-") == 0)
+    channel = g_io_channel_unix_new (STDIN_FILENO);
+  else
+    channel = g_io_channel_new_file (path, "r", error);
+  if (channel == NULL)
+    goto out;
+
+  while (g_io_channel_read_line (channel, &line, NULL, NULL, error) == G_IO_STATUS_NORMAL)
+    {
+      TraceCheck *check;
+      gchar **fields;
+      GError *local_error;
+
+      line_no++;
+      g_strstrip (line);
+      if (line[0] == '\0' || line[0] == '#')
+        {
+          g_free (line);
+          continue;
+        }
+
+      fields = split_fields (line);
+      g_free (line);
+
+      check = g_new0 (TraceCheck, 1);
+      check->line = line_no;
+      check->gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+
+      local_error = NULL;
+      if (g_strv_length (fields) != 5)
+        g_set_error (&local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Expected ACTION USER GROUPS LOCAL ACTIVE");
+      else if (!parse_user (fields[1], &check->uid, &check->username))
+        g_set_error (&local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Unknown user `%s'", fields[1]);
+      else if (!parse_groups (fields[2], check->gids, &local_error))
+        ;
+      else if (!parse_boolean (fields[3], &check->is_local) || !parse_boolean (fields[4], &check->is_active))
+        g_set_error (&local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "LOCAL and ACTIVE must be yes or no");
+      else
+        check->action_id = g_strdup (fields[0]);
+
+      g_strfreev (fields);
+      if (local_error != NULL)
+        {
+          g_set_error (error, local_error->domain, local_error->code,
+                       "%s:%u: %s", path, line_no, local_error->message);
+          g_error_free (local_error);
+          trace_check_free (check);
+          goto out;
+        }
+      g_ptr_array_add (checks, check);
+    }
+
+  if (error == NULL || *error == NULL)
+    {
+      ret = checks;
+      checks = NULL;
+    }
+
+ out:
+  if (channel != NULL)
+    g_io_channel_unref (channel);
+  if (checks != NULL)
+    g_ptr_array_unref (checks);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+evaluate (PolicyRuleset    *ruleset,
+          Engine            engine,
+          const TraceCheck *check,
+          CheckResult      *result)
+{
+  PolicyContext context = {
+    .subject_is_local = check->is_local,
+    .subject_is_active = check->is_active,
+    .gids = check->gids,
+    .username = check->username,
+    .primary_gid = (gid_t) -1,
+  };
+
+  result->response = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  result->n_tested = 0;
+  result->matched_id = NULL;
+
+  if (engine == ENGINE_RULESET)
+    {
+      PolicyRulesetTrace trace;
+
+      result->response = policy_ruleset_test_full (ruleset, check->action_id, &context, &trace);
+      result->n_tested = trace.n_tested;
+      if (trace.matched != NULL)
+        result->matched_id = policy_file_get_id (trace.matched->file, trace.matched->policy);
+    }
+  else
+    {
+      const PolicyFile *file;
+      guint n;
+
+      /* The reference first-match walk of policy_file_test(), counted */
+      for (file = ruleset->files; file != NULL; file = file->next)
+        {
+          for (n = 0; n < file->rules.n_normal; n++)
+            {
+              result->response = policy_test (file, &file->rules.normal[n], check->action_id, &context);
+              result->n_tested++;
+              if (result->response != POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN)
+                {
+                  result->matched_id = policy_file_get_id (file, &file->rules.normal[n]);
+                  return;
+                }
+            }
+        }
+    }
+}
+
+static gint
+compare_gint64 (gconstpointer a,
+                gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static gint64
+percentile (GArray *sorted,
+            guint   pct)
+{
+  guint index;
+
+  if (sorted->len == 0)
+    return 0;
+  index = (sorted->len * pct + 99) / 100;
+  if (index > 0)
+    index--;
+  return g_array_index (sorted, gint64, index);
+}
+
+int
+main (int argc, char *argv[])
+{
+  guint ret;
+  gchar *s;
+  gchar **opt_rules_dirs;
+  gchar *opt_trace;
+  gchar *opt_engine;
+  gint opt_repeat;
+  gboolean opt_compare;
+  gboolean opt_quiet;
+  gboolean opt_show_version;
+  GOptionEntry options[] =
+    {
+      {
+	"rules-dir", 'd', 0, G_OPTION_ARG_FILENAME_ARRAY, &opt_rules_dirs,
+	N_("Load rules from DIR instead of the default directories"), N_("DIR")
+      },
+      {
+	"trace", 't', 0, G_OPTION_ARG_FILENAME, &opt_trace,
+	N_("Replay the checks recorded in FILE instead of standard input"), N_("FILE")
+      },
+      {
+	"engine", 'e', 0, G_OPTION_ARG_STRING, &opt_engine,
+	N_("Evaluate with ENGINE, either ruleset (the default) or linear"), N_("ENGINE")
+      },
+      {
+	"compare", 'c', 0, G_OPTION_ARG_NONE, &opt_compare,
+	N_("Also evaluate with the other engine and report any disagreement"), NULL
+      },
+      {
+	"repeat", 'n', 0, G_OPTION_ARG_INT, &opt_repeat,
+	N_("Replay the whole trace COUNT times"), N_("COUNT")
+      },
+      {
+	"quiet", 'q', 0, G_OPTION_ARG_NONE, &opt_quiet,
+	N_("Only print the summary"), NULL
+      },
+      {
+	"version", 0, 0, G_OPTION_ARG_NONE, &opt_show_version,
+	N_("Show version"), NULL
+      },
+      { NULL, 0, 0, 0, NULL, NULL, NULL }
+    };
+  gchar *default_rules_dirs[] =
+    {
+      PACKAGE_SYSCONF_DIR "/polkit-1/rules.d",
+      PACKAGE_DATA_DIR "/polkit-1/rules.d",
+      NULL
+    };
+  GOptionContext *context;
+  PolicyRuleset *ruleset;
+  GPtrArray *checks;
+  GArray *latencies;
+  GError *error;
+  Engine engine;
+  guint64 responses[N_RESPONSES] = { 0 };
+  guint64 total_tested;
+  guint max_tested;
+  guint num_files;
+  guint num_mismatches;
+  gint64 total_ns;
+  gint round;
+  guint n;
+
+  opt_rules_dirs = NULL;
+  opt_trace = NULL;
+  opt_engine = NULL;
+  opt_repeat = 1;
+  opt_compare = FALSE;
+  opt_quiet = FALSE;
+  opt_show_version = FALSE;
+  context = NULL;
+  ruleset = NULL;
+  checks = NULL;
+  latencies = NULL;
+  engine = ENGINE_RULESET;
+  total_tested = 0;
+  max_tested = 0;
+  num_mismatches = 0;
+  total_ns = 0;
+  ret = 1;
+
+  /* Disable remote file access from GIO. */
+  setenv ("GIO_USE_VFS", "local", 1);
+
+  error = NULL;
+  context = g_option_context_new (N_("[--rules-dir DIR]... [--trace FILE]"));
+  s = g_strdup_printf (_("Report bugs to: %s\n"
+			 "%s home page: <%s>"), PACKAGE_BUGREPORT,
+		       PACKAGE_NAME, PACKAGE_URL);
+  g_option_context_set_description (context, s);
+  g_free (s);
+  g_option_context_add_main_entries (context, options, GETTEXT_PACKAGE);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      g_error_free (error);
+      goto out;
+    }
+  if (argc > 1)
+    {
+      g_printerr (_("%s: Unexpected argument `%s'\n"), g_get_prgname (),
+		  argv[1]);
+      goto out;
+    }
+  if (opt_show_version)
+    {
+      g_print ("pkreplay version %s\n", PACKAGE_VERSION);
+      ret = 0;
+      goto out;
+    }
+  if (opt_engine == NULL || g_strcmp0 (opt_engine, "ruleset") == 0)
+    engine = ENGINE_RULESET;
+  else if (g_strcmp0 (opt_engine, "linear") == 0)
+    engine = ENGINE_LINEAR;
+  else
+    {
+      g_printerr (_("%s: Unknown engine `%s'\n"), g_get_prgname (), opt_engine);
+      goto out;
+    }
+  if (opt_repeat < 1)
+    {
+      g_printerr (_("%s: COUNT must be at least 1\n"), g_get_prgname ());
+      goto out;
+    }
+
+  ruleset = load_rules (opt_rules_dirs != NULL ? opt_rules_dirs : default_rules_dirs, &num_files);
+  if (!opt_quiet)
+    print_pruned_rules (ruleset);
+
+  checks = load_trace (opt_trace != NULL ? opt_trace : "-", &error);
+  if (checks == NULL)
+    {
+      g_printerr ("Error reading trace: %s\n", error->message);
+      g_error_free (error);
+      goto out;
+    }
+
+  latencies = g_array_sized_new (FALSE, FALSE, sizeof (gint64), checks->len * opt_repeat);
+
+  for (round = 0; round < opt_repeat; round++)
+    {
+      for (n = 0; n < checks->len; n++)
+        {
+          const TraceCheck *check = checks->pdata[n];
+          CheckResult result;
+          gint64 begin;
+          gint64 elapsed;
+
+          begin = get_time_ns ();
+          evaluate (ruleset, engine, check, &result);
+          elapsed = get_time_ns () - begin;
+
+          g_array_append_val (latencies, elapsed);
+          total_ns += elapsed;
+          total_tested += result.n_tested;
+          max_tested = MAX (max_tested, result.n_tested);
+          responses[result.response + 1]++;
+
+          /* Decisions don't change between rounds, so only report them once */
+          if (round > 0)
+            continue;
+
+          if (!opt_quiet)
+            {
+              g_print ("%u: %s %s -> %s (%u rules tested",
+                       check->line, check->action_id, check->username,
+                       response_to_string (result.response), result.n_tested);
+              if (result.matched_id != NULL)
+                g_print (", matched [%s]", result.matched_id);
+              g_print (")\n");
+            }
+
+          if (opt_compare)
+            {
+              CheckResult other;
+
+              evaluate (ruleset, engine == ENGINE_RULESET ? ENGINE_LINEAR : ENGINE_RULESET, check, &other);
+              if (other.response != result.response)
+                {
+                  g_printerr ("%u: %s %s: engines disagree, %s vs %s\n",
+                              check->line, check->action_id, check->username,
+                              response_to_string (result.response),
+                              response_to_string (other.response));
+                  num_mismatches++;
+                }
+            }
+        }
+    }
+
+  g_array_sort (latencies, compare_gint64);
+
+  g_print ("rules files:   %u (%u rules, %u pruned)\n", num_files, ruleset->rules->len, ruleset->n_pruned);
+  g_print ("checks:        %u (%u per round, %d rounds)\n",
+           latencies->len, checks->len, opt_repeat);
+  for (n = 0; n < N_RESPONSES; n++)
+    {
+      if (responses[n] > 0)
+        g_print ("  %-22s %" G_GUINT64_FORMAT "\n",
+                 response_to_string ((PolkitImplicitAuthorization) ((gint) n - 1)), responses[n]);
+    }
+  if (latencies->len > 0)
+    {
+      g_print ("rules tested:  %.2f mean, %u max\n",
+               (gdouble) total_tested / latencies->len, max_tested);
+      g_print ("latency (ns):  %" G_GINT64_FORMAT " mean, %" G_GINT64_FORMAT " p50, %" G_GINT64_FORMAT " p90, "
+               "%" G_GINT64_FORMAT " p99, %" G_GINT64_FORMAT " max\n",
+               total_ns / latencies->len,
+               percentile (latencies, 50), percentile (latencies, 90),
+               percentile (latencies, 99), percentile (latencies, 100));
+    }
+  if (opt_compare)
+    g_print ("mismatches:    %u\n", num_mismatches);
+
+  ret = num_mismatches > 0 ? 1 : 0;
+
+ out:
+  if (latencies != NULL)
+    g_array_unref (latencies);
+  if (checks != NULL)
+    g_ptr_array_unref (checks);
+  if (ruleset != NULL)
+    policy_ruleset_unref (ruleset);
+  if (context != NULL)
+    g_option_context_free (context);
+  g_strfreev (opt_rules_dirs);
+  g_free (opt_trace);
+  g_free (opt_engine);
+
+  return ret;
+}
@@ -0,0 +1,77 @@
+/**
+ * Copyright 2011 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: Nikki VonHollen <vonhollen@gmail.com>
+ */
+
+#include "fault.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DELAY_CONFIG_KEY "MOCK_DELAY"
+#define FAIL_CONFIG_KEY "MOCK_FAIL"
+
+/** Private methods */
+
+// Value of PREFIX_NAME, or else of PREFIX, or 0 if neither is set
+static unsigned long fault_config(const char *prefix, const char *name) {
+  char key[64];
+  const char *value;
+
+  snprintf(key, sizeof(key), "%s_%s", prefix, name);
+  value = getenv(key);
+  if (!value)
+    value = getenv(prefix);
+  if (!value)
+    return 0;
+
+  return strtoul(value, NULL, 10);
+}
+
+static void fault_delay(unsigned long usec) {
+  struct timespec ts;
+
+  ts.tv_sec = usec / 1000000;
+  ts.tv_nsec = (usec % 1000000) * 1000;
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+    continue;
+}
+
+/** Public methods */
+
+int mock_fault_inject(struct mock_fault *fault) {
+  unsigned long delay = fault_config(DELAY_CONFIG_KEY, fault->name);
+  unsigned long percent = fault_config(FAIL_CONFIG_KEY, fault->name);
+  unsigned long call;
+
+  if (delay > 0)
+    fault_delay(delay);
+
+  if (percent == 0)
+    return 0;
+  if (percent > 100)
+    percent = 100;
+
+  // Fail whenever the running total of failures owed goes up by one
+  call = __sync_add_and_fetch(&fault->calls, 1);
+  if ((call * percent) / 100 == ((call - 1) * percent) / 100)
+    return 0;
+
+  errno = EIO;
+  return 1;
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright 2011 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: Nikki VonHollen <vonhollen@gmail.com>
+ */
+
+#ifndef MOCK_FAULT_H
+#define MOCK_FAULT_H
+
+/**
+ * Delay and failure injection, to stand in for a slow or flaky NSS backend.
+ * Every mocked call goes through mock_fault_inject() first, which looks at
+ * the environment on every call, so a test may change it as it goes:
+ *
+ *   MOCK_DELAY_<FUNC>=usec    Sleep this long before each call to FUNC
+ *   MOCK_DELAY=usec           The same, for functions without their own
+ *   MOCK_FAIL_<FUNC>=percent  Fail this share of calls to FUNC
+ *   MOCK_FAIL=percent         The same, for functions without their own
+ *
+ * FUNC is the function's name in upper case, e.g. MOCK_DELAY_GETGROUPLIST.
+ * Failures are spread evenly rather than at random, so that runs are
+ * repeatable: at 25 percent, every fourth call fails.
+ */
+struct mock_fault {
+  const char *name;
+  volatile unsigned long calls;
+};
+
+#define MOCK_FAULT_INIT(name) { name, 0 }
+
+/**
+ * Delay as configured, then return 1 if this call is to fail and 0 if it
+ * is to go ahead. errno is set to EIO for a failing call.
+ */
+int mock_fault_inject(struct mock_fault *fault);
+
+#endif /* MOCK_FAULT_H */
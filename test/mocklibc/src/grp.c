@@ -18,6 +18,8 @@
 
 #include <grp.h>
 
+#include "fault.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +29,11 @@
 
 static FILE *global_stream = NULL;
 
+static struct mock_fault getgrent_fault = MOCK_FAULT_INIT("GETGRENT");
+static struct mock_fault getgrnam_fault = MOCK_FAULT_INIT("GETGRNAM");
+static struct mock_fault getgrgid_fault = MOCK_FAULT_INIT("GETGRGID");
+static struct mock_fault getgrouplist_fault = MOCK_FAULT_INIT("GETGROUPLIST");
+
 void setgrent(void) {
   if (global_stream)
     endgrent();
@@ -39,6 +46,9 @@ void setgrent(void) {
 }
 
 struct group *getgrent(void) {
+  if (mock_fault_inject(&getgrent_fault))
+    return NULL;
+
   if (!global_stream)
     setgrent();
 
@@ -57,6 +67,9 @@ void endgrent(void) {
 }
 
 struct group *getgrnam(const char *name) {
+  if (mock_fault_inject(&getgrnam_fault))
+    return NULL;
+
   const char *path = getenv(GROUP_CONFIG_KEY);
   if (!path)
     return NULL;
@@ -78,6 +91,9 @@ struct group *getgrnam(const char *name) {
 }
 
 struct group *getgrgid(gid_t gid) {
+  if (mock_fault_inject(&getgrgid_fault))
+    return NULL;
+
   const char *path = getenv(GROUP_CONFIG_KEY);
   if (!path)
     return NULL;
@@ -99,6 +115,10 @@ struct group *getgrgid(gid_t gid) {
 }
 
 int getgrouplist(const char *user, gid_t group, gid_t *groups, int *ngroups) {
+  // Like a backend that is down: nothing fits, however large the buffer
+  if (mock_fault_inject(&getgrouplist_fault))
+    return -1;
+
   const char *path = getenv(GROUP_CONFIG_KEY);
   if (!path) {
     *ngroups = 0;
@@ -16,6 +16,7 @@
  * Author: Nikki VonHollen <vonhollen@gmail.com>
  */
 
+#include "fault.h"
 #include "netgroup.h"
 
 #include <netdb.h>
@@ -32,11 +33,18 @@
 static struct netgroup *global_netgroup_head = NULL;
 static struct netgroup_iter global_iter;
 
+static struct mock_fault setnetgrent_fault = MOCK_FAULT_INIT("SETNETGRENT");
+static struct mock_fault getnetgrent_fault = MOCK_FAULT_INIT("GETNETGRENT");
+static struct mock_fault innetgr_fault = MOCK_FAULT_INIT("INNETGR");
+
 /** Public methods */
 
 // REMEMBER: 1 means success, 0 means failure for netgroup methods
 
 int setnetgrent(const char *netgroup) {
+  if (mock_fault_inject(&setnetgrent_fault))
+    return 0;
+
   if (!global_netgroup_head)
     global_netgroup_head = netgroup_parse_all();
 
@@ -57,6 +65,9 @@ void endnetgrent(void) {
 }
 
 int getnetgrent(char **host, char **user, char **domain) {
+  if (mock_fault_inject(&getnetgrent_fault))
+    return 0;
+
   if (!global_netgroup_head)
     return 0;
 
@@ -72,6 +83,9 @@ int getnetgrent(char **host, char **user, char **domain) {
 
 int innetgr(const char *netgroup, const char *host, const char *user,
     const char *domain) {
+  if (mock_fault_inject(&innetgr_fault))
+    return 0;
+
   int retval = 0;
   struct netgroup *head = netgroup_parse_all();
   struct netgroup *group = netgroup_find(head, netgroup);
@@ -18,6 +18,8 @@
 
 #include <pwd.h>
 
+#include "fault.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +29,10 @@
 
 static FILE *global_stream = NULL;
 
+static struct mock_fault getpwent_fault = MOCK_FAULT_INIT("GETPWENT");
+static struct mock_fault getpwnam_fault = MOCK_FAULT_INIT("GETPWNAM");
+static struct mock_fault getpwuid_fault = MOCK_FAULT_INIT("GETPWUID");
+
 void setpwent(void) {
   if (global_stream)
     endpwent();
@@ -39,6 +45,9 @@ void setpwent(void) {
 }
 
 struct passwd *getpwent(void) {
+  if (mock_fault_inject(&getpwent_fault))
+    return NULL;
+
   if (!global_stream)
     setpwent();
 
@@ -57,6 +66,9 @@ void endpwent(void) {
 }
 
 struct passwd *getpwnam(const char *name) {
+  if (mock_fault_inject(&getpwnam_fault))
+    return NULL;
+
   const char *path = getenv(PASSWD_CONFIG_KEY);
   if (!path)
     return NULL;
@@ -78,6 +90,9 @@ struct passwd *getpwnam(const char *name) {
 }
 
 struct passwd *getpwuid(uid_t uid) {
+  if (mock_fault_inject(&getpwuid_fault))
+    return NULL;
+
   const char *path = getenv(PASSWD_CONFIG_KEY);
   if (!path)
     return NULL;
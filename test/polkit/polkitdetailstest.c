@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "glib.h"
+#include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
+
+
+static void
+test_insert (void)
+{
+  PolkitDetails *details;
+  gchar **keys;
+  gchar key[16];
+  guint n;
+
+  details = polkit_details_new ();
+  g_assert (polkit_details_get_keys (details) == NULL);
+  g_assert (polkit_details_lookup (details, "a") == NULL);
+
+  /* more than fit inline */
+  for (n = 0; n < 10; n++)
+    {
+      g_snprintf (key, sizeof key, "key%u", n);
+      polkit_details_insert (details, key, key);
+    }
+  polkit_details_insert (details, "key3", "replaced");
+  polkit_details_insert (details, "key5", NULL);
+  polkit_details_insert (details, "missing", NULL);
+
+  g_assert_cmpstr (polkit_details_lookup (details, "key0"), ==, "key0");
+  g_assert_cmpstr (polkit_details_lookup (details, "key3"), ==, "replaced");
+  g_assert (polkit_details_lookup (details, "key5") == NULL);
+  g_assert_cmpstr (polkit_details_lookup (details, "key9"), ==, "key9");
+
+  keys = polkit_details_get_keys (details);
+  g_assert_cmpuint (g_strv_length (keys), ==, 9);
+  g_assert_cmpstr (keys[5], ==, "key6");
+  g_strfreev (keys);
+
+  g_object_unref (details);
+}
+
+
+static void
+test_gvariant (void)
+{
+  PolkitDetails *details;
+  PolkitDetails *copy;
+  GVariant *value;
+  gchar **keys;
+
+  value = g_variant_new_parsed ("{'a': 'one', 'b': 'two', 'a': 'three'}");
+  details = polkit_details_new_for_gvariant (value);
+
+  /* read in place, the last value of a key wins */
+  g_assert_cmpstr (polkit_details_lookup (details, "a"), ==, "three");
+  g_assert_cmpstr (polkit_details_lookup (details, "b"), ==, "two");
+  g_assert (polkit_details_lookup (details, "c") == NULL);
+
+  keys = polkit_details_get_keys (details);
+  g_assert_cmpuint (g_strv_length (keys), ==, 2);
+  g_strfreev (keys);
+
+  polkit_details_insert (details, "c", "four");
+  g_assert_cmpstr (polkit_details_lookup (details, "a"), ==, "three");
+  g_assert_cmpstr (polkit_details_lookup (details, "c"), ==, "four");
+
+  value = g_variant_ref_sink (polkit_details_to_gvariant (details));
+  g_assert (g_variant_is_of_type (value, G_VARIANT_TYPE ("a{ss}")));
+  g_assert_cmpuint (g_variant_n_children (value), ==, 3);
+  copy = polkit_details_new_for_gvariant (value);
+  g_variant_unref (value);
+
+  g_assert_cmpstr (polkit_details_lookup (copy, "a"), ==, "three");
+  g_assert_cmpstr (polkit_details_lookup (copy, "b"), ==, "two");
+  g_assert_cmpstr (polkit_details_lookup (copy, "c"), ==, "four");
+
+  g_object_unref (copy);
+  g_object_unref (details);
+
+  value = g_variant_ref_sink (polkit_details_to_gvariant (NULL));
+  g_assert_cmpuint (g_variant_n_children (value), ==, 0);
+  g_variant_unref (value);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/PolkitDetails/insert", test_insert);
+  g_test_add_func ("/PolkitDetails/gvariant", test_gvariant);
+  return g_test_run ();
+}
@@ -21,6 +21,7 @@
 
 #include "glib.h"
 #include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
 
 
 static void
@@ -70,6 +71,34 @@ test_set_gid (void)
 }
 
 
+static void
+test_new_shared (void)
+{
+  PolkitIdentity *first;
+  PolkitIdentity *second;
+  PolkitIdentity *other;
+
+  first = polkit_unix_group_new_shared (500);
+  second = polkit_unix_group_new_shared (500);
+  other = polkit_unix_group_new (500);
+
+  g_assert (first == second);
+  g_assert_cmpint (polkit_unix_group_get_gid (POLKIT_UNIX_GROUP (first)), ==, 500);
+  g_assert (polkit_identity_equal (first, other));
+
+  g_object_unref (second);
+  g_object_unref (first);
+
+  /* a new one once the last reference is gone */
+  first = polkit_unix_group_new_shared (500);
+  g_assert (first != other);
+  g_assert (polkit_identity_equal (first, other));
+
+  g_object_unref (first);
+  g_object_unref (other);
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -77,5 +106,6 @@ main (int argc, char *argv[])
   g_test_add_func ("/PolkitUnixGroup/new", test_new);
   g_test_add_func ("/PolkitUnixGroup/new_for_name", test_new_for_name);
   g_test_add_func ("/PolkitUnixGroup/set_gid", test_set_gid);
+  g_test_add_func ("/PolkitUnixGroup/new_shared", test_new_shared);
   return g_test_run ();
 }
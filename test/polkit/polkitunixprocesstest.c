@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "glib.h"
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
+
+
+static void
+test_new_for_self (void)
+{
+  PolkitUnixProcess *process;
+  GError *error = NULL;
+
+  process = POLKIT_UNIX_PROCESS (polkit_unix_process_new_for_owner (getpid (), 0, -1));
+  g_assert (process);
+
+  g_assert_cmpint (polkit_unix_process_get_pid (process), ==, getpid ());
+  g_assert_cmpint (polkit_unix_process_get_uid (process), ==, getuid ());
+  g_assert_cmpuint (polkit_unix_process_get_start_time (process), !=, 0);
+
+  g_assert_cmpint (polkit_unix_process_get_racy_uid__ (process, &error), ==, getuid ());
+  g_assert_no_error (error);
+
+  g_assert (polkit_subject_exists_sync (POLKIT_SUBJECT (process), NULL, NULL));
+
+  g_object_unref (process);
+}
+
+
+static void
+test_replaced (void)
+{
+  PolkitUnixProcess *self;
+  PolkitUnixProcess *process;
+  GError *error = NULL;
+
+  self = POLKIT_UNIX_PROCESS (polkit_unix_process_new_for_owner (getpid (), 0, -1));
+
+  /* the same pid, but started at another time */
+  process = POLKIT_UNIX_PROCESS (polkit_unix_process_new_for_owner (getpid (),
+                                                                    polkit_unix_process_get_start_time (self) + 1,
+                                                                    getuid ()));
+
+  polkit_unix_process_get_racy_uid__ (process, &error);
+  g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED);
+  g_clear_error (&error);
+
+  g_assert (!polkit_subject_exists_sync (POLKIT_SUBJECT (process), NULL, NULL));
+
+  g_object_unref (process);
+  g_object_unref (self);
+}
+
+
+static void
+test_start_time_cache (void)
+{
+  PolkitUnixProcess *first;
+  PolkitUnixProcess *second;
+
+  polkit_unix_process_enable_start_time_cache ();
+
+  first = POLKIT_UNIX_PROCESS (polkit_unix_process_new_for_owner (getpid (), 0, -1));
+  second = POLKIT_UNIX_PROCESS (polkit_unix_process_new_for_owner (getpid (), 0, -1));
+
+  g_assert_cmpuint (polkit_unix_process_get_start_time (first), !=, 0);
+  g_assert_cmpuint (polkit_unix_process_get_start_time (second), ==,
+                    polkit_unix_process_get_start_time (first));
+  g_assert_cmpint (polkit_unix_process_get_uid (second), ==, getuid ());
+  g_assert (polkit_subject_equal (POLKIT_SUBJECT (first), POLKIT_SUBJECT (second)));
+  g_assert (polkit_subject_exists_sync (POLKIT_SUBJECT (second), NULL, NULL));
+
+  g_object_unref (second);
+  g_object_unref (first);
+}
+
+
+static guint
+count_open_fds (void)
+{
+  GDir *dir;
+  guint ret;
+
+  dir = g_dir_open ("/proc/self/fd", 0, NULL);
+  g_assert (dir != NULL);
+  for (ret = 0; g_dir_read_name (dir) != NULL; ret++)
+    ;
+  g_dir_close (dir);
+
+  return ret;
+}
+
+/* the cache keeps a pidfd per process, see START_TIME_CACHE_SIZE */
+#define START_TIME_CACHE_FDS 64
+
+static void
+test_start_time_cache_bounded (void)
+{
+  guint before;
+  guint n;
+
+  polkit_unix_process_enable_start_time_cache ();
+  before = count_open_fds ();
+
+  /* far more callers than the cache may hold, each gone right after */
+  for (n = 0; n < 4 * START_TIME_CACHE_FDS; n++)
+    {
+      PolkitSubject *process;
+      gint fds[2];
+      pid_t pid;
+      gchar c;
+
+      g_assert_cmpint (pipe (fds), ==, 0);
+      pid = fork ();
+      g_assert_cmpint (pid, >=, 0);
+      if (pid == 0)
+        {
+          /* lives until the parent closes its end */
+          close (fds[1]);
+          if (read (fds[0], &c, 1) < 0)
+            _exit (1);
+          _exit (0);
+        }
+      close (fds[0]);
+
+      process = polkit_unix_process_new_for_owner (pid, 0, -1);
+      g_assert_cmpuint (polkit_unix_process_get_start_time (POLKIT_UNIX_PROCESS (process)), !=, 0);
+      g_object_unref (process);
+
+      close (fds[1]);
+      g_assert_cmpint (waitpid (pid, NULL, 0), ==, pid);
+    }
+
+  g_assert_cmpuint (count_open_fds (), <=, before + START_TIME_CACHE_FDS);
+
+  /* and processes that are still around keep being served from it */
+  test_start_time_cache ();
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/PolkitUnixProcess/new_for_self", test_new_for_self);
+  g_test_add_func ("/PolkitUnixProcess/replaced", test_replaced);
+  g_test_add_func ("/PolkitUnixProcess/start_time_cache", test_start_time_cache);
+  g_test_add_func ("/PolkitUnixProcess/start_time_cache_bounded", test_start_time_cache_bounded);
+  return g_test_run ();
+}
@@ -21,6 +21,7 @@
 
 #include "glib.h"
 #include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
 
 struct user_entry {
   const gchar *name;
@@ -92,6 +93,34 @@ test_set_uid (void)
 }
 
 
+static void
+test_new_shared (void)
+{
+  PolkitIdentity *first;
+  PolkitIdentity *second;
+  PolkitIdentity *other;
+
+  first = polkit_unix_user_new_shared (500);
+  second = polkit_unix_user_new_shared (500);
+  other = polkit_unix_user_new (500);
+
+  g_assert (first == second);
+  g_assert_cmpint (polkit_unix_user_get_uid (POLKIT_UNIX_USER (first)), ==, 500);
+  g_assert (polkit_identity_equal (first, other));
+
+  g_object_unref (second);
+  g_object_unref (first);
+
+  /* a new one once the last reference is gone */
+  first = polkit_unix_user_new_shared (500);
+  g_assert (first != other);
+  g_assert (polkit_identity_equal (first, other));
+
+  g_object_unref (first);
+  g_object_unref (other);
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -99,5 +128,6 @@ main (int argc, char *argv[])
   g_test_add_func ("/PolkitUnixUser/new", test_new);
   g_test_add_func ("/PolkitUnixUser/new_for_name", test_new_for_name);
   g_test_add_func ("/PolkitUnixUser/set_uid", test_set_uid);
+  g_test_add_func ("/PolkitUnixUser/new_shared", test_new_shared);
   return g_test_run ();
 }
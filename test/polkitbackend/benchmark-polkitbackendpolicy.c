@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+/*
+ * Microbenchmarks for the keyfile policy engine. Synthetic rules sets are
+ * generated for every size given on the command line (10, 100, 1000 and
+ * 10000 rules by default), and every result is printed to stdout as a
+ * single line JSON object so that runs may be compared across releases.
+ *
+ * Groups and users are resolved against test/data/etc via mocklibc. The
+ * identity lookups also run against a slow and flaky NSS, by way of the
+ * mocklibc fault injection, to show what the cache does to tail latency.
+ */
+
+#include "config.h"
+#include "glib.h"
+
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <stdlib.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendpolicyfile.h>
+#include <polkitbackend/polkitbackendpolicyidentity.h>
+#include <polkitbackend/polkitbackendpolicyruleset.h>
+
+/* Each benchmark runs for at least this long, in microseconds */
+#define BENCHMARK_MIN_TIME (G_USEC_PER_SEC / 5)
+
+/* Rules are split across files like a real rules.d would be */
+#define BENCHMARK_RULES_PER_FILE 100
+
+static const guint default_sizes[] = { 10, 100, 1000, 10000 };
+
+/* Identity lookups timed one by one, for the latency distribution */
+#define BENCHMARK_IDENTITY_SAMPLES 500
+
+/* What the slow NSS costs per call, in microseconds, and how often it fails */
+#define BENCHMARK_NSS_DELAY "2000"
+#define BENCHMARK_NSS_FAIL "5"
+
+typedef struct BenchmarkSet
+{
+  gchar *dir;
+  GPtrArray *paths; /**<Generated files, in load order */
+  guint n_rules;
+} BenchmarkSet;
+
+typedef void (*BenchmarkFunc) (gpointer data);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static const gchar *results[] = { "yes", "no", "auth_admin", "auth_self" };
+
+/**
+ * Describe rule @i of a generated set. The mix is mostly exact Actions=,
+ * along with prefix patterns, ActionContains=, InUnixGroups= and
+ * InUserNames= rules and the odd wildcard.
+ */
+static void
+benchmark_write_rule (GString *out, guint i)
+{
+  const gchar *result = results[i % G_N_ELEMENTS (results)];
+
+  g_string_append_printf (out, "\n[rule-%u]\n", i);
+
+  switch (i % 10)
+    {
+    case 3:
+      g_string_append_printf (out, "Actions=org.bench.p%u.*;\n", i);
+      break;
+    case 4:
+    case 5:
+      g_string_append_printf (out, "ActionContains=.c%u.;\n", i);
+      break;
+    case 9:
+      /* Wildcards are candidates for every check, so keep them rare */
+      if ((i / 10) % 5 == 0)
+        {
+          g_string_append (out, "Actions=*;\nInUserNames=jane;\n");
+          break;
+        }
+      /* fallthrough */
+    default:
+      g_string_append_printf (out, "Actions=org.bench.exact%u;\n", i);
+      break;
+    }
+
+  switch (i % 10)
+    {
+    case 6:
+      g_string_append (out, "InUnixGroups=users;\n");
+      break;
+    case 7:
+      g_string_append (out, "InUnixGroups=admin;\nResultInverse=no\n");
+      break;
+    case 8:
+      g_string_append (out, "InUserNames=john;\nResultInverse=no\n");
+      break;
+    default:
+      break;
+    }
+
+  g_string_append_printf (out, "Result=%s\n", result);
+}
+
+static void
+benchmark_set_free (BenchmarkSet *set)
+{
+  for (guint i = 0; i < set->paths->len; i++)
+    {
+      g_unlink (set->paths->pdata[i]);
+    }
+  g_rmdir (set->dir);
+  g_ptr_array_unref (set->paths);
+  g_free (set->dir);
+  g_free (set);
+}
+
+static BenchmarkSet *
+benchmark_set_new (guint n_rules)
+{
+  BenchmarkSet *set = NULL;
+  GError *error = NULL;
+  guint i = 0;
+
+  set = g_new0 (BenchmarkSet, 1);
+  set->n_rules = n_rules;
+  set->paths = g_ptr_array_new_with_free_func (g_free);
+  set->dir = g_dir_make_tmp ("polkit-benchmark-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  while (i < n_rules)
+    {
+      GString *out = g_string_new ("[Policy]\nRules=");
+      guint end = MIN (i + BENCHMARK_RULES_PER_FILE, n_rules);
+      gchar *path = NULL;
+
+      for (guint j = i; j < end; j++)
+        {
+          g_string_append_printf (out, "rule-%u;", j);
+        }
+      if (set->paths->len == 0)
+        {
+          g_string_append (out, "\nAdminRules=admin-group;admin-user;");
+        }
+      g_string_append_c (out, '\n');
+
+      for (; i < end; i++)
+        {
+          benchmark_write_rule (out, i);
+        }
+      if (set->paths->len == 0)
+        {
+          g_string_append (out, "\n[admin-group]\nInUnixGroups=admin;\n"
+                                "\n[admin-user]\nInUserNames=henry;\n");
+        }
+
+      path = g_strdup_printf ("%s/%05u-bench.keyrules", set->dir,
+                              set->paths->len);
+      g_file_set_contents (path, out->str, out->len, &error);
+      g_assert_no_error (error);
+      g_ptr_array_add (set->paths, path);
+      g_string_free (out, TRUE);
+    }
+
+  return set;
+}
+
+/**
+ * Load a set the same way the keyfile authority's compile_rules() does
+ */
+static PolicyRuleset *
+benchmark_set_load (BenchmarkSet *set)
+{
+  PolicyFile *first = NULL;
+  PolicyFile *last = NULL;
+
+  for (guint i = 0; i < set->paths->len; i++)
+    {
+      GError *error = NULL;
+      PolicyFile *file = NULL;
+
+      file = policy_file_new_from_path (set->paths->pdata[i], &error);
+      g_assert_no_error (error);
+      if (last)
+        last->next = file;
+      else
+        first = file;
+      last = file;
+    }
+
+  return policy_ruleset_new (first);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * Call @func until BENCHMARK_MIN_TIME has passed, doubling the batch size
+ * so that timer overhead doesn't dominate fast calls, and print the mean
+ * cost of a single call
+ */
+static void
+benchmark_run (const gchar *name, guint n_rules, const gchar *query,
+               BenchmarkFunc func, gpointer data)
+{
+  guint64 iterations = 0;
+  guint64 batch = 1;
+  gint64 start = 0;
+  gint64 elapsed = 0;
+
+  start = g_get_monotonic_time ();
+  do
+    {
+      for (guint64 i = 0; i < batch; i++)
+        {
+          func (data);
+        }
+      iterations += batch;
+      if (batch < (1 << 20))
+        {
+          batch *= 2;
+        }
+      elapsed = g_get_monotonic_time () - start;
+    }
+  while (elapsed < BENCHMARK_MIN_TIME);
+
+  g_print ("{\"benchmark\": \"%s\", \"rules\": %u, \"query\": \"%s\", "
+           "\"iterations\": %" G_GUINT64_FORMAT ", \"ns_per_op\": %.1f}\n",
+           name, n_rules, query, iterations,
+           (gdouble)elapsed * 1000.0 / (gdouble)iterations);
+}
+
+typedef struct BenchmarkCheck
+{
+  PolicyRuleset *ruleset;
+  const gchar *action_id;
+  PolicyContext *context;
+} BenchmarkCheck;
+
+static void
+benchmark_load (gpointer data)
+{
+  policy_ruleset_unref (benchmark_set_load (data));
+}
+
+static void
+benchmark_file_test (gpointer data)
+{
+  BenchmarkCheck *check = data;
+
+  policy_file_test (check->ruleset->files, check->action_id, check->context);
+}
+
+static void
+benchmark_ruleset_test (gpointer data)
+{
+  BenchmarkCheck *check = data;
+
+  policy_ruleset_test (check->ruleset, check->action_id, check->context);
+}
+
+static void
+benchmark_admin_identities (gpointer data)
+{
+  g_list_free_full (policy_ruleset_get_admin_identities (data),
+                    g_object_unref);
+}
+
+static void
+benchmark_size (guint n_rules)
+{
+  BenchmarkSet *set = NULL;
+  PolicyRuleset *ruleset = NULL;
+  PolicyContext context = { 0 };
+  gid_t gid = 100;
+  struct
+  {
+    const gchar *query;
+    gchar *action_id;
+  } queries[] = {
+    { "exact_first", g_strdup ("org.bench.exact0") },
+    { "exact_last", g_strdup_printf ("org.bench.exact%u", n_rules - 1) },
+    { "prefix", g_strdup_printf ("org.bench.p%u.action", n_rules > 3 ? 3 : 0) },
+    { "contains", g_strdup_printf ("org.bench.c%u.action", n_rules > 4 ? 4 : 0) },
+    { "group", g_strdup_printf ("org.bench.exact%u", n_rules > 7 ? 6 : 0) },
+    { "miss", g_strdup ("org.bench.missing") },
+  };
+
+  /* john, in the users group */
+  context.subject_is_local = TRUE;
+  context.subject_is_active = TRUE;
+  context.username = "john";
+  context.primary_gid = gid;
+  context.gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+  g_array_append_val (context.gids, gid);
+
+  set = benchmark_set_new (n_rules);
+  ruleset = benchmark_set_load (set);
+  g_assert_cmpuint (ruleset->rules->len, ==, n_rules);
+
+  benchmark_run ("load_rules", n_rules, "", benchmark_load, set);
+
+  for (guint i = 0; i < G_N_ELEMENTS (queries); i++)
+    {
+      BenchmarkCheck check = {
+        .ruleset = ruleset,
+        .action_id = queries[i].action_id,
+        .context = &context,
+      };
+
+      /* Both engines must agree before their timings mean anything */
+      g_assert_cmpint (
+          policy_file_test (ruleset->files, check.action_id, &context), ==,
+          policy_ruleset_test (ruleset, check.action_id, &context));
+
+      benchmark_run ("policy_file_test", n_rules, queries[i].query,
+                     benchmark_file_test, &check);
+      benchmark_run ("policy_ruleset_test", n_rules, queries[i].query,
+                     benchmark_ruleset_test, &check);
+      g_free (queries[i].action_id);
+    }
+
+  benchmark_run ("get_admin_auth_identities", n_rules, "",
+                 benchmark_admin_identities, ruleset);
+
+  g_array_unref (context.gids);
+  policy_ruleset_unref (ruleset);
+  benchmark_set_free (set);
+}
+
+static gint
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *)a;
+  gint64 y = *(const gint64 *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * Time single lookups of john through @cache, which may be NULL to always
+ * go to NSS, and print the latency distribution
+ */
+static void
+benchmark_identity_run (const gchar *query, PolicyIdentityCache *cache)
+{
+  gint64 samples[BENCHMARK_IDENTITY_SAMPLES];
+  guint n = G_N_ELEMENTS (samples);
+
+  for (guint i = 0; i < n; i++)
+    {
+      gint64 start = g_get_monotonic_time ();
+
+      policy_user_record_unref (policy_identity_cache_lookup_user (cache, 500));
+      samples[i] = g_get_monotonic_time () - start;
+    }
+
+  qsort (samples, n, sizeof (gint64), compare_gint64);
+  g_print ("{\"benchmark\": \"identity_lookup_user\", \"query\": \"%s\", "
+           "\"iterations\": %u, \"p50_us\": %" G_GINT64_FORMAT
+           ", \"p99_us\": %" G_GINT64_FORMAT ", \"max_us\": %" G_GINT64_FORMAT
+           "}\n",
+           query, n, samples[n / 2], samples[n * 99 / 100], samples[n - 1]);
+}
+
+/**
+ * Look users up against an NSS that is slow and sometimes fails. Without
+ * a cache every lookup pays for it; with one, records expire quickly but
+ * are served stale while they are refreshed, so only the first waits.
+ *
+ * The delays only exist with the in-tree mocklibc; elsewhere both runs
+ * measure a fast NSS.
+ */
+static void
+benchmark_identity (void)
+{
+  PolicyIdentityCache *cache = NULL;
+
+  g_setenv ("MOCK_DELAY", BENCHMARK_NSS_DELAY, TRUE);
+  g_setenv ("MOCK_FAIL", BENCHMARK_NSS_FAIL, TRUE);
+
+  benchmark_identity_run ("uncached", NULL);
+
+  cache = policy_identity_cache_new (64, 10 * 1000, 10 * 1000,
+                                     60 * G_USEC_PER_SEC);
+  benchmark_identity_run ("cached", cache);
+  policy_identity_cache_free (cache);
+
+  g_unsetenv ("MOCK_DELAY");
+  g_unsetenv ("MOCK_FAIL");
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  if (argc < 2)
+    {
+      for (guint i = 0; i < G_N_ELEMENTS (default_sizes); i++)
+        {
+          benchmark_size (default_sizes[i]);
+        }
+      benchmark_identity ();
+      return EXIT_SUCCESS;
+    }
+
+  for (gint i = 1; i < argc; i++)
+    {
+      guint64 n_rules = g_ascii_strtoull (argv[i], NULL, 10);
+
+      if (n_rules == 0 || n_rules > G_MAXUINT)
+        {
+          g_printerr ("Invalid number of rules: %s\n", argv[i]);
+          return EXIT_FAILURE;
+        }
+      benchmark_size ((guint)n_rules);
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,915 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+/*
+ * Challenge round trips through a running polkitd. A mock authentication
+ * agent is registered for this process, and every client makes interactive
+ * checks for it, one at a time, that polkitd turns into challenges for the
+ * agent. The agent answers each BeginAuthentication by starting a stub
+ * helper, this same program run with --helper, which responds to polkitd
+ * right away with AuthenticationAgentResponse2, just as
+ * polkit-agent-helper-1 does once PAM is done. With --inline-helper the
+ * agent responds itself instead, leaving out the spawn.
+ *
+ * Once --duration has passed, a single line JSON object is printed for the
+ * check as the client sees it, for the agent's part of every challenge and
+ * for the helper's response. If polkitd runs with --metrics, its own
+ * challenge-initiate, challenge-agent and challenge-complete phases over
+ * the run are printed too, from the histograms of GetMetrics.
+ *
+ * polkitd joins concurrent checks of the same action and subject into a
+ * single challenge, so there are fewer challenges than checks unless every
+ * client has an --action of its own. Actions must need authentication
+ * without keeping it, or only the first check is challenged.
+ *
+ * Only uid 0 may respond to polkitd, so this exits with 77, i.e. skipped,
+ * when not run as root or when nobody answers on the bus.
+ */
+
+#include "config.h"
+#include "glib.h"
+
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
+
+#define BENCHMARK_BUS_NAME "org.freedesktop.PolicyKit1"
+#define BENCHMARK_OBJECT_PATH "/org/freedesktop/PolicyKit1/Authority"
+#define BENCHMARK_INTERFACE "org.freedesktop.PolicyKit1.Authority"
+#define BENCHMARK_METRICS_PATH "/org/freedesktop/PolicyKit1/Metrics"
+#define BENCHMARK_METRICS_INTERFACE "org.freedesktop.PolicyKit1.Metrics"
+#define BENCHMARK_AGENT_PATH "/org/freedesktop/PolicyKit1/BenchmarkAgent"
+#define BENCHMARK_AGENT_INTERFACE                                             \
+  "org.freedesktop.PolicyKit1.AuthenticationAgent"
+
+/* Exit status telling meson and automake the benchmark was skipped */
+#define BENCHMARK_EXIT_SKIP 77
+
+/* As in polkitbackendmetrics.h */
+#define BENCHMARK_METRICS_BUCKETS 32
+
+static const gchar agent_introspection_data[]
+    = "<node>"
+      "  <interface name='" BENCHMARK_AGENT_INTERFACE "'>"
+      "    <method name='BeginAuthentication'>"
+      "      <arg type='s' name='action_id' direction='in'/>"
+      "      <arg type='s' name='message' direction='in'/>"
+      "      <arg type='s' name='icon_name' direction='in'/>"
+      "      <arg type='a{ss}' name='details' direction='in'/>"
+      "      <arg type='s' name='cookie' direction='in'/>"
+      "      <arg type='a(sa{sv})' name='identities' direction='in'/>"
+      "    </method>"
+      "    <method name='CancelAuthentication'>"
+      "      <arg type='s' name='cookie' direction='in'/>"
+      "    </method>"
+      "  </interface>"
+      "</node>";
+
+/* The phases of polkitd's metrics that make up a challenge */
+static const gchar *daemon_phases[] = {
+  "challenge-initiate",
+  "challenge-agent",
+  "challenge-complete",
+};
+
+static gint opt_clients = 4;
+static gint opt_duration = 5;
+static gchar **opt_actions = NULL;
+static gchar *opt_address = NULL;
+static gboolean opt_inline_helper = FALSE;
+static gchar **opt_helper = NULL;
+static GOptionEntry opt_entries[] = {
+  { "clients", 'c', 0, G_OPTION_ARG_INT, &opt_clients,
+    "Concurrent client connections", "N" },
+  { "duration", 'd', 0, G_OPTION_ARG_INT, &opt_duration,
+    "How long to run for, in seconds", "SECS" },
+  { "action", 'a', 0, G_OPTION_ARG_STRING_ARRAY, &opt_actions,
+    "Action to check, may be given once per client", "ACTION" },
+  { "address", 0, 0, G_OPTION_ARG_STRING, &opt_address,
+    "Bus to connect to rather than the system bus", "ADDRESS" },
+  { "inline-helper", 0, 0, G_OPTION_ARG_NONE, &opt_inline_helper,
+    "Respond from the agent rather than a helper process", NULL },
+  { "helper", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING_ARRAY,
+    &opt_helper, "Run as the stub helper for COOKIE and IDENTITY",
+    "COOKIE IDENTITY" },
+  { NULL }
+};
+
+static const gchar *default_actions[] = { "org.freedesktop.policykit.exec",
+                                          NULL };
+
+typedef struct Benchmark Benchmark;
+
+typedef struct BenchmarkClient
+{
+  Benchmark *bench;
+  GDBusConnection *connection;
+  GThread *thread;
+  const gchar *action_id;
+
+  GArray *latencies; /**<gint64, in microseconds */
+  guint64 authorized;
+  guint64 errors;
+} BenchmarkClient;
+
+struct Benchmark
+{
+  GVariant *subject; /**<This process, which the agent is registered for */
+  gchar *self;       /**<This program, run as the helper */
+
+  BenchmarkClient *clients;
+  guint n_clients;
+  gint64 deadline;
+  gint64 elapsed;
+
+  /* The agent, running in a thread and main context of its own */
+  GThread *agent_thread;
+  GMainContext *agent_context;
+  GMainLoop *agent_loop;
+  GDBusConnection *agent_connection;
+  guint agent_id;
+  GMutex agent_lock;
+  GCond agent_cond;
+  gboolean agent_ready;
+  GError *agent_error;
+
+  /* Only touched from the agent thread */
+  GArray *agent_latencies;  /**<BeginAuthentication until its reply */
+  GArray *helper_latencies; /**<Starting the helper until it responded */
+  guint64 helper_errors;
+};
+
+/* A challenge, from BeginAuthentication until the agent replies to it */
+typedef struct BenchmarkChallenge
+{
+  Benchmark *bench;
+  GDBusMethodInvocation *invocation;
+  gint64 started;
+  gint64 helper_started;
+} BenchmarkChallenge;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GDBusConnection *
+benchmark_connect (GError **error)
+{
+  gchar *address = NULL;
+  GDBusConnection *ret = NULL;
+
+  if (opt_address != NULL)
+    {
+      address = g_strdup (opt_address);
+    }
+  else
+    {
+      address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SYSTEM, NULL,
+                                                 error);
+      if (address == NULL)
+        {
+          return NULL;
+        }
+    }
+
+  /* A connection of its own, rather than the shared singleton */
+  ret = g_dbus_connection_new_for_address_sync (
+      address,
+      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+          | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+      NULL, NULL, error);
+  g_free (address);
+
+  return ret;
+}
+
+/**
+ * Tell polkitd that @identity authenticated for @cookie, as the helper
+ * does once the conversation with PAM succeeded
+ */
+static GVariant *
+benchmark_response_parameters (const gchar *cookie, PolkitIdentity *identity)
+{
+  return g_variant_new ("(us@(sa{sv}))", (guint32)getuid (), cookie,
+                        polkit_identity_to_gvariant (identity));
+}
+
+/**
+ * The stub helper: respond for the cookie and exit, as soon as possible
+ */
+static gint
+benchmark_helper_main (const gchar *cookie, const gchar *identity_str)
+{
+  GDBusConnection *connection = NULL;
+  PolkitIdentity *identity = NULL;
+  GVariant *result = NULL;
+  GError *error = NULL;
+  gint ret = EXIT_FAILURE;
+
+  identity = polkit_identity_from_string (identity_str, &error);
+  if (identity == NULL)
+    {
+      goto out;
+    }
+  connection = benchmark_connect (&error);
+  if (connection == NULL)
+    {
+      goto out;
+    }
+  result = g_dbus_connection_call_sync (
+      connection, BENCHMARK_BUS_NAME, BENCHMARK_OBJECT_PATH,
+      BENCHMARK_INTERFACE, "AuthenticationAgentResponse2",
+      benchmark_response_parameters (cookie, identity), NULL,
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+  if (result == NULL)
+    {
+      goto out;
+    }
+  g_variant_unref (result);
+  ret = EXIT_SUCCESS;
+
+out:
+  if (error != NULL)
+    {
+      g_printerr ("Helper failed: %s\n", error->message);
+      g_error_free (error);
+    }
+  g_clear_object (&identity);
+  g_clear_object (&connection);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+benchmark_challenge_finish (BenchmarkChallenge *challenge, gboolean responded)
+{
+  Benchmark *bench = challenge->bench;
+  gint64 now = g_get_monotonic_time ();
+  gint64 latency = 0;
+
+  if (responded)
+    {
+      latency = now - challenge->helper_started;
+      g_array_append_val (bench->helper_latencies, latency);
+    }
+  else
+    {
+      bench->helper_errors++;
+    }
+
+  /* polkitd answers the check once BeginAuthentication returns */
+  g_dbus_method_invocation_return_value (challenge->invocation, NULL);
+  latency = g_get_monotonic_time () - challenge->started;
+  g_array_append_val (bench->agent_latencies, latency);
+  g_free (challenge);
+}
+
+static void
+benchmark_helper_exited_cb (GPid pid, gint status, gpointer user_data)
+{
+  BenchmarkChallenge *challenge = user_data;
+
+  g_spawn_close_pid (pid);
+  benchmark_challenge_finish (
+      challenge, WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS);
+}
+
+static void
+benchmark_inline_response_cb (GObject *source_object, GAsyncResult *res,
+                              gpointer user_data)
+{
+  BenchmarkChallenge *challenge = user_data;
+  GVariant *result = NULL;
+  GError *error = NULL;
+
+  result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object),
+                                          res, &error);
+  if (result == NULL)
+    {
+      g_printerr ("Response failed: %s\n", error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      g_variant_unref (result);
+    }
+  benchmark_challenge_finish (challenge, result != NULL);
+}
+
+static void
+benchmark_begin_authentication (Benchmark *bench,
+                                GDBusMethodInvocation *invocation,
+                                GVariant *parameters)
+{
+  BenchmarkChallenge *challenge = NULL;
+  const gchar *cookie = NULL;
+  GVariant *identities = NULL;
+  GVariant *first = NULL;
+  PolkitIdentity *identity = NULL;
+  gchar *identity_str = NULL;
+  GError *error = NULL;
+
+  challenge = g_new0 (BenchmarkChallenge, 1);
+  challenge->bench = bench;
+  challenge->invocation = invocation;
+  challenge->started = g_get_monotonic_time ();
+
+  g_variant_get (parameters, "(&s&s&s@a{ss}&s@a(sa{sv}))", NULL, NULL, NULL,
+                 NULL, &cookie, &identities);
+  if (g_variant_n_children (identities) > 0)
+    {
+      /* polkitd accepts any of them, they are all as good */
+      first = g_variant_get_child_value (identities, 0);
+      identity = polkit_identity_new_for_gvariant (first, &error);
+      g_variant_unref (first);
+    }
+  g_variant_unref (identities);
+  if (identity == NULL)
+    {
+      if (error != NULL)
+        {
+          g_printerr ("No identity to respond with: %s\n", error->message);
+          g_error_free (error);
+        }
+      challenge->helper_started = challenge->started;
+      benchmark_challenge_finish (challenge, FALSE);
+      return;
+    }
+
+  challenge->helper_started = g_get_monotonic_time ();
+  if (opt_inline_helper)
+    {
+      g_dbus_connection_call (
+          bench->agent_connection, BENCHMARK_BUS_NAME, BENCHMARK_OBJECT_PATH,
+          BENCHMARK_INTERFACE, "AuthenticationAgentResponse2",
+          benchmark_response_parameters (cookie, identity), NULL,
+          G_DBUS_CALL_FLAGS_NONE, -1, NULL, benchmark_inline_response_cb,
+          challenge);
+    }
+  else
+    {
+      GPtrArray *argv = g_ptr_array_new ();
+      GSource *source = NULL;
+      GPid pid = 0;
+
+      identity_str = polkit_identity_to_string (identity);
+      g_ptr_array_add (argv, bench->self);
+      if (opt_address != NULL)
+        {
+          g_ptr_array_add (argv, "--address");
+          g_ptr_array_add (argv, opt_address);
+        }
+      g_ptr_array_add (argv, "--helper");
+      g_ptr_array_add (argv, (gchar *)cookie);
+      g_ptr_array_add (argv, "--helper");
+      g_ptr_array_add (argv, identity_str);
+      g_ptr_array_add (argv, NULL);
+
+      if (!g_spawn_async (NULL, (gchar **)argv->pdata, NULL,
+                          G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid,
+                          &error))
+        {
+          g_printerr ("Error starting helper: %s\n", error->message);
+          g_error_free (error);
+          benchmark_challenge_finish (challenge, FALSE);
+        }
+      else
+        {
+          source = g_child_watch_source_new (pid);
+          g_source_set_callback (source,
+                                 (GSourceFunc)benchmark_helper_exited_cb,
+                                 challenge, NULL);
+          g_source_attach (source, bench->agent_context);
+          g_source_unref (source);
+        }
+      g_ptr_array_free (argv, TRUE);
+      g_free (identity_str);
+    }
+  g_object_unref (identity);
+}
+
+static void
+benchmark_agent_method_call (GDBusConnection *connection, const gchar *sender,
+                             const gchar *object_path,
+                             const gchar *interface_name,
+                             const gchar *method_name, GVariant *parameters,
+                             GDBusMethodInvocation *invocation,
+                             gpointer user_data)
+{
+  Benchmark *bench = user_data;
+
+  if (g_strcmp0 (method_name, "BeginAuthentication") == 0)
+    {
+      benchmark_begin_authentication (bench, invocation, parameters);
+    }
+  else
+    {
+      /* Every challenge is answered right away, nothing to cancel */
+      g_dbus_method_invocation_return_value (invocation, NULL);
+    }
+}
+
+static const GDBusInterfaceVTable agent_vtable = {
+  benchmark_agent_method_call,
+  NULL,
+  NULL,
+};
+
+/**
+ * Export the agent and register it for this process with polkitd
+ */
+static gboolean
+benchmark_agent_register (Benchmark *bench, GError **error)
+{
+  GDBusNodeInfo *info = NULL;
+  GVariant *result = NULL;
+
+  bench->agent_connection = benchmark_connect (error);
+  if (bench->agent_connection == NULL)
+    {
+      return FALSE;
+    }
+
+  info = g_dbus_node_info_new_for_xml (agent_introspection_data, error);
+  g_assert (info != NULL);
+  bench->agent_id = g_dbus_connection_register_object (
+      bench->agent_connection, BENCHMARK_AGENT_PATH, info->interfaces[0],
+      &agent_vtable, bench, NULL, error);
+  g_dbus_node_info_unref (info);
+  if (bench->agent_id == 0)
+    {
+      return FALSE;
+    }
+
+  result = g_dbus_connection_call_sync (
+      bench->agent_connection, BENCHMARK_BUS_NAME, BENCHMARK_OBJECT_PATH,
+      BENCHMARK_INTERFACE, "RegisterAuthenticationAgent",
+      g_variant_new ("(@(sa{sv})so)", bench->subject, "C",
+                     BENCHMARK_AGENT_PATH),
+      NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, error);
+  if (result == NULL)
+    {
+      return FALSE;
+    }
+  g_variant_unref (result);
+  return TRUE;
+}
+
+static gpointer
+benchmark_agent_thread (gpointer data)
+{
+  Benchmark *bench = data;
+  GError *error = NULL;
+  gboolean registered = FALSE;
+
+  /* So that the agent's calls are dispatched here */
+  g_main_context_push_thread_default (bench->agent_context);
+  registered = benchmark_agent_register (bench, &error);
+
+  g_mutex_lock (&bench->agent_lock);
+  bench->agent_ready = TRUE;
+  bench->agent_error = error;
+  g_cond_signal (&bench->agent_cond);
+  g_mutex_unlock (&bench->agent_lock);
+
+  if (registered)
+    {
+      g_main_loop_run (bench->agent_loop);
+    }
+
+  if (bench->agent_id != 0)
+    {
+      g_dbus_connection_unregister_object (bench->agent_connection,
+                                           bench->agent_id);
+    }
+  g_clear_object (&bench->agent_connection);
+  g_main_context_pop_thread_default (bench->agent_context);
+  return NULL;
+}
+
+static gboolean
+benchmark_agent_start (Benchmark *bench, GError **error)
+{
+  bench->agent_context = g_main_context_new ();
+  bench->agent_loop = g_main_loop_new (bench->agent_context, FALSE);
+  bench->agent_latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  bench->helper_latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  bench->agent_thread
+      = g_thread_new ("benchmark-agent", benchmark_agent_thread, bench);
+
+  g_mutex_lock (&bench->agent_lock);
+  while (!bench->agent_ready)
+    {
+      g_cond_wait (&bench->agent_cond, &bench->agent_lock);
+    }
+  g_mutex_unlock (&bench->agent_lock);
+
+  if (bench->agent_error != NULL)
+    {
+      g_propagate_error (error, bench->agent_error);
+      bench->agent_error = NULL;
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+benchmark_agent_quit_cb (gpointer user_data)
+{
+  Benchmark *bench = user_data;
+
+  g_main_loop_quit (bench->agent_loop);
+  return FALSE;
+}
+
+static void
+benchmark_agent_stop (Benchmark *bench)
+{
+  GSource *source = NULL;
+
+  if (bench->agent_thread == NULL)
+    {
+      return;
+    }
+
+  /* Unregistering is left to polkitd noticing the connection went */
+  source = g_idle_source_new ();
+  g_source_set_callback (source, benchmark_agent_quit_cb, bench, NULL);
+  g_source_attach (source, bench->agent_context);
+  g_source_unref (source);
+  g_thread_join (bench->agent_thread);
+  bench->agent_thread = NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gpointer
+benchmark_client_thread (gpointer data)
+{
+  BenchmarkClient *client = data;
+  Benchmark *bench = client->bench;
+
+  while (g_get_monotonic_time () < bench->deadline)
+    {
+      GError *error = NULL;
+      GVariant *result = NULL;
+      gboolean is_authorized = FALSE;
+      gint64 start = 0;
+      gint64 latency = 0;
+
+      start = g_get_monotonic_time ();
+      result = g_dbus_connection_call_sync (
+          client->connection, BENCHMARK_BUS_NAME, BENCHMARK_OBJECT_PATH,
+          BENCHMARK_INTERFACE, "CheckAuthorization",
+          g_variant_new (
+              "(@(sa{sv})s@a{ss}us)", bench->subject, client->action_id,
+              g_variant_new_array (G_VARIANT_TYPE ("{ss}"), NULL, 0),
+              POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION, ""),
+          G_VARIANT_TYPE ("((bba{ss}))"), G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+          &error);
+      latency = g_get_monotonic_time () - start;
+
+      if (result == NULL)
+        {
+          client->errors++;
+          g_error_free (error);
+          continue;
+        }
+      g_variant_get (result, "((bb@a{ss}))", &is_authorized, NULL, NULL);
+      g_variant_unref (result);
+      if (is_authorized)
+        {
+          client->authorized++;
+        }
+      g_array_append_val (client->latencies, latency);
+    }
+
+  return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * The challenge phases of polkitd's metrics, or NULL if it doesn't
+ * collect any
+ */
+static GVariant *
+benchmark_get_daemon_latencies (GDBusConnection *connection)
+{
+  GVariant *result = NULL;
+  GVariant *metrics = NULL;
+  GVariant *ret = NULL;
+
+  result = g_dbus_connection_call_sync (
+      connection, BENCHMARK_BUS_NAME, BENCHMARK_METRICS_PATH,
+      BENCHMARK_METRICS_INTERFACE, "GetMetrics", NULL,
+      G_VARIANT_TYPE ("(a{sv})"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+  if (result == NULL)
+    {
+      return NULL;
+    }
+  metrics = g_variant_get_child_value (result, 0);
+  ret = g_variant_lookup_value (metrics, "latency-usec",
+                                G_VARIANT_TYPE ("a{sat}"));
+  g_variant_unref (metrics);
+  g_variant_unref (result);
+  return ret;
+}
+
+static gint
+benchmark_compare_latency (gconstpointer a, gconstpointer b)
+{
+  gint64 la = *(const gint64 *)a;
+  gint64 lb = *(const gint64 *)b;
+
+  return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+static gint64
+benchmark_percentile (GArray *sorted, gdouble q)
+{
+  guint n = 0;
+
+  if (sorted->len == 0)
+    {
+      return 0;
+    }
+  n = (guint)(q * sorted->len);
+  return g_array_index (sorted, gint64, MIN (n, sorted->len - 1));
+}
+
+static void
+benchmark_print (Benchmark *bench, const gchar *name, GArray *latencies,
+                 guint64 errors)
+{
+  g_array_sort (latencies, benchmark_compare_latency);
+
+  g_print ("{\"benchmark\": \"polkitd-challenge\", \"phase\": \"%s\", "
+           "\"clients\": %u, \"count\": %u, \"errors\": %" G_GUINT64_FORMAT
+           ", \"per_sec\": %.1f, \"p50_usec\": %" G_GINT64_FORMAT ", "
+           "\"p90_usec\": %" G_GINT64_FORMAT ", \"p99_usec\": %" G_GINT64_FORMAT
+           ", \"max_usec\": %" G_GINT64_FORMAT "}\n",
+           name, bench->n_clients, latencies->len, errors,
+           (gdouble)latencies->len * G_USEC_PER_SEC / (gdouble)bench->elapsed,
+           benchmark_percentile (latencies, 0.5),
+           benchmark_percentile (latencies, 0.9),
+           benchmark_percentile (latencies, 0.99),
+           benchmark_percentile (latencies, 1.0));
+}
+
+/**
+ * The upper bound of the bucket holding the @q quantile of @buckets
+ */
+static guint64
+benchmark_bucket_percentile (const guint64 *buckets, guint64 count, gdouble q)
+{
+  guint64 seen = 0;
+  guint n = 0;
+
+  for (n = 0; n < BENCHMARK_METRICS_BUCKETS - 1; n++)
+    {
+      seen += buckets[n];
+      if (seen > (guint64)(q * count))
+        {
+          break;
+        }
+    }
+  return n == 0 ? 0 : (guint64)1 << n;
+}
+
+/**
+ * Print what polkitd recorded of every challenge phase between
+ * @before and @after
+ */
+static void
+benchmark_print_daemon (Benchmark *bench, GVariant *before, GVariant *after)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (daemon_phases); i++)
+    {
+      GVariant *old = g_variant_lookup_value (before, daemon_phases[i],
+                                              G_VARIANT_TYPE ("at"));
+      GVariant *new = g_variant_lookup_value (after, daemon_phases[i],
+                                              G_VARIANT_TYPE ("at"));
+      guint64 buckets[BENCHMARK_METRICS_BUCKETS] = { 0 };
+      guint64 count = 0;
+      const guint64 *old_buckets = NULL;
+      const guint64 *new_buckets = NULL;
+      gsize n_old = 0;
+      gsize n_new = 0;
+
+      if (old == NULL || new == NULL)
+        {
+          /* An older polkitd */
+          g_clear_pointer (&old, g_variant_unref);
+          g_clear_pointer (&new, g_variant_unref);
+          continue;
+        }
+      old_buckets = g_variant_get_fixed_array (old, &n_old, sizeof (guint64));
+      new_buckets = g_variant_get_fixed_array (new, &n_new, sizeof (guint64));
+      for (gsize n = 0; n < MIN (n_new, BENCHMARK_METRICS_BUCKETS); n++)
+        {
+          buckets[n] = new_buckets[n] - (n < n_old ? old_buckets[n] : 0);
+          count += buckets[n];
+        }
+
+      g_print ("{\"benchmark\": \"polkitd-challenge\", "
+               "\"phase\": \"polkitd-%s\", \"clients\": %u, "
+               "\"count\": %" G_GUINT64_FORMAT ", "
+               "\"p50_usec_below\": %" G_GUINT64_FORMAT ", "
+               "\"p90_usec_below\": %" G_GUINT64_FORMAT ", "
+               "\"p99_usec_below\": %" G_GUINT64_FORMAT "}\n",
+               daemon_phases[i], bench->n_clients, count,
+               benchmark_bucket_percentile (buckets, count, 0.5),
+               benchmark_bucket_percentile (buckets, count, 0.9),
+               benchmark_bucket_percentile (buckets, count, 0.99));
+      g_variant_unref (old);
+      g_variant_unref (new);
+    }
+}
+
+static void
+benchmark_report (Benchmark *bench)
+{
+  GArray *checks = g_array_new (FALSE, FALSE, sizeof (gint64));
+  guint64 errors = 0;
+  guint64 authorized = 0;
+
+  for (guint i = 0; i < bench->n_clients; i++)
+    {
+      BenchmarkClient *client = &bench->clients[i];
+
+      g_array_append_vals (checks, client->latencies->data,
+                           client->latencies->len);
+      errors += client->errors;
+      authorized += client->authorized;
+    }
+
+  benchmark_print (bench, "check", checks, errors);
+  benchmark_print (bench, "agent", bench->agent_latencies, 0);
+  benchmark_print (bench, "helper", bench->helper_latencies,
+                   bench->helper_errors);
+  if (authorized < checks->len)
+    {
+      g_printerr ("%" G_GUINT64_FORMAT " of %u checks were not authorized\n",
+                  checks->len - authorized, checks->len);
+    }
+  g_array_unref (checks);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *opt_context = NULL;
+  GError *error = NULL;
+  Benchmark bench = { 0 };
+  PolkitSubject *subject = NULL;
+  GVariant *daemon_before = NULL;
+  GVariant *daemon_after = NULL;
+  gint ret = EXIT_FAILURE;
+  gint64 start = 0;
+  guint n_actions = 0;
+  const gchar *const *actions = NULL;
+
+  setlocale (LC_ALL, "");
+  g_mutex_init (&bench.agent_lock);
+  g_cond_init (&bench.agent_cond);
+
+  opt_context = g_option_context_new ("- time challenges through a running polkitd");
+  g_option_context_add_main_entries (opt_context, opt_entries, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      goto out;
+    }
+  if (opt_helper != NULL)
+    {
+      if (g_strv_length (opt_helper) != 2)
+        {
+          g_printerr ("--helper takes a cookie and an identity\n");
+          goto out;
+        }
+      ret = benchmark_helper_main (opt_helper[0], opt_helper[1]);
+      goto out;
+    }
+  if (opt_clients <= 0 || opt_duration <= 0)
+    {
+      g_printerr ("--clients and --duration must be positive\n");
+      goto out;
+    }
+  if (getuid () != 0)
+    {
+      g_printerr ("Only root may respond to polkitd\n");
+      ret = BENCHMARK_EXIT_SKIP;
+      goto out;
+    }
+
+  actions = opt_actions != NULL ? (const gchar *const *)opt_actions
+                                : default_actions;
+  n_actions = g_strv_length ((gchar **)actions);
+
+  bench.self = g_file_read_link ("/proc/self/exe", NULL);
+  if (bench.self == NULL)
+    {
+      bench.self = g_strdup (argv[0]);
+    }
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  bench.subject = g_variant_ref_sink (polkit_subject_to_gvariant (subject));
+  g_object_unref (subject);
+
+  bench.n_clients = (guint)opt_clients;
+  bench.clients = g_new0 (BenchmarkClient, bench.n_clients);
+  for (guint i = 0; i < bench.n_clients; i++)
+    {
+      BenchmarkClient *client = &bench.clients[i];
+
+      client->bench = &bench;
+      client->action_id = actions[i % n_actions];
+      client->latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+      client->connection = benchmark_connect (&error);
+      if (client->connection == NULL)
+        {
+          g_printerr ("Error connecting to the bus: %s\n", error->message);
+          ret = BENCHMARK_EXIT_SKIP;
+          goto out;
+        }
+    }
+
+  if (!benchmark_agent_start (&bench, &error))
+    {
+      g_printerr ("Error registering the agent: %s\n", error->message);
+      ret = BENCHMARK_EXIT_SKIP;
+      goto out;
+    }
+
+  daemon_before = benchmark_get_daemon_latencies (bench.clients[0].connection);
+
+  start = g_get_monotonic_time ();
+  bench.deadline = start + (gint64)opt_duration * G_USEC_PER_SEC;
+  for (guint i = 0; i < bench.n_clients; i++)
+    {
+      bench.clients[i].thread = g_thread_new (
+          "benchmark-client", benchmark_client_thread, &bench.clients[i]);
+    }
+  for (guint i = 0; i < bench.n_clients; i++)
+    {
+      g_thread_join (bench.clients[i].thread);
+    }
+  bench.elapsed = g_get_monotonic_time () - start;
+
+  daemon_after = benchmark_get_daemon_latencies (bench.clients[0].connection);
+  benchmark_agent_stop (&bench);
+
+  benchmark_report (&bench);
+  if (daemon_before != NULL && daemon_after != NULL)
+    {
+      benchmark_print_daemon (&bench, daemon_before, daemon_after);
+    }
+  ret = EXIT_SUCCESS;
+
+out:
+  benchmark_agent_stop (&bench);
+  for (guint i = 0; bench.clients != NULL && i < bench.n_clients; i++)
+    {
+      g_clear_pointer (&bench.clients[i].latencies, g_array_unref);
+      g_clear_object (&bench.clients[i].connection);
+    }
+  g_free (bench.clients);
+  g_clear_pointer (&bench.agent_latencies, g_array_unref);
+  g_clear_pointer (&bench.helper_latencies, g_array_unref);
+  g_clear_pointer (&bench.agent_loop, g_main_loop_unref);
+  g_clear_pointer (&bench.agent_context, g_main_context_unref);
+  g_clear_pointer (&bench.subject, g_variant_unref);
+  g_clear_pointer (&daemon_before, g_variant_unref);
+  g_clear_pointer (&daemon_after, g_variant_unref);
+  g_free (bench.self);
+  g_mutex_clear (&bench.agent_lock);
+  g_cond_clear (&bench.agent_cond);
+  g_clear_error (&error);
+  if (opt_context != NULL)
+    {
+      g_option_context_free (opt_context);
+    }
+  return ret;
+}
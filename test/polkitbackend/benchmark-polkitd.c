@@ -0,0 +1,607 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+/*
+ * Load generator for a running polkitd. Every client is a connection of
+ * its own to the bus, driven from a thread of its own with one call in
+ * flight at a time, and picks its next call at random from the mix given
+ * with --mix. Once --duration has passed, a single line JSON object is
+ * printed to stdout for every method called, along with one for all of
+ * them, so that runs may be compared across releases.
+ *
+ * Registering an authentication agent is refused while another one holds
+ * the same subject, and every client shares this process as its subject,
+ * so agent traffic is taken in turns rather than measuring those errors.
+ *
+ * Exits with 77, i.e. skipped, when nobody answers on the bus.
+ */
+
+#include "config.h"
+#include "glib.h"
+
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
+
+#define BENCHMARK_BUS_NAME "org.freedesktop.PolicyKit1"
+#define BENCHMARK_OBJECT_PATH "/org/freedesktop/PolicyKit1/Authority"
+#define BENCHMARK_INTERFACE "org.freedesktop.PolicyKit1.Authority"
+#define BENCHMARK_AGENT_PATH "/org/freedesktop/PolicyKit1/Benchmark"
+
+/* Exit status telling meson and automake the benchmark was skipped */
+#define BENCHMARK_EXIT_SKIP 77
+
+typedef enum
+{
+  BENCHMARK_CALL_CHECK,
+  BENCHMARK_CALL_ENUMERATE_ACTIONS,
+  BENCHMARK_CALL_REGISTER_AGENT,
+  BENCHMARK_CALL_UNREGISTER_AGENT,
+  BENCHMARK_CALL_ENUMERATE_TEMPORARY,
+  BENCHMARK_N_CALLS,
+} BenchmarkCall;
+
+static const gchar *call_names[BENCHMARK_N_CALLS] = {
+  "CheckAuthorization",
+  "EnumerateActions",
+  "RegisterAuthenticationAgent",
+  "UnregisterAuthenticationAgent",
+  "EnumerateTemporaryAuthorizations",
+};
+
+/**
+ * The traffic a client picks from. An agent round registers and then
+ * unregisters, so it accounts for two calls.
+ */
+typedef enum
+{
+  BENCHMARK_MIX_CHECK,
+  BENCHMARK_MIX_ENUMERATE,
+  BENCHMARK_MIX_AGENT,
+  BENCHMARK_MIX_TEMPORARY,
+  BENCHMARK_N_MIX,
+} BenchmarkMix;
+
+static const gchar *mix_names[BENCHMARK_N_MIX] = {
+  "check",
+  "enumerate",
+  "agent",
+  "temporary",
+};
+
+static gint opt_clients = 4;
+static gint opt_duration = 5;
+static gchar *opt_mix = NULL;
+static gchar **opt_actions = NULL;
+static gchar *opt_address = NULL;
+static GOptionEntry opt_entries[] = {
+  { "clients", 'c', 0, G_OPTION_ARG_INT, &opt_clients,
+    "Concurrent client connections", "N" },
+  { "duration", 'd', 0, G_OPTION_ARG_INT, &opt_duration,
+    "How long to run for, in seconds", "SECS" },
+  { "mix", 'm', 0, G_OPTION_ARG_STRING, &opt_mix,
+    "Weights of check, enumerate, agent and temporary traffic",
+    "check=70,enumerate=10,agent=10,temporary=10" },
+  { "action", 'a', 0, G_OPTION_ARG_STRING_ARRAY, &opt_actions,
+    "Action to check, may be given more than once", "ACTION" },
+  { "address", 0, 0, G_OPTION_ARG_STRING, &opt_address,
+    "Bus to connect to rather than the system bus", "ADDRESS" },
+  { NULL }
+};
+
+static const gchar *default_actions[] = { "org.freedesktop.policykit.exec",
+                                          NULL };
+
+typedef struct Benchmark Benchmark;
+
+typedef struct BenchmarkClient
+{
+  Benchmark *bench;
+  guint index;
+  GDBusConnection *connection;
+  GThread *thread;
+  GRand *rand;
+
+  GVariant *bus_name_subject; /**<For checks, the connection itself */
+  GVariant *agent_subject;    /**<For agents, this process */
+  GVariant *session_subject;  /**<For temporary authorizations, if any */
+  gchar *agent_path;
+
+  GArray *latencies[BENCHMARK_N_CALLS]; /**<gint64, in microseconds */
+  guint64 errors[BENCHMARK_N_CALLS];
+} BenchmarkClient;
+
+struct Benchmark
+{
+  guint weights[BENCHMARK_N_MIX];
+  guint total_weight;
+  const gchar *const *actions;
+  guint n_actions;
+
+  BenchmarkClient *clients;
+  guint n_clients;
+
+  GMutex agent_lock; /**<Agent rounds are taken in turns */
+  gint64 deadline;
+  gint64 elapsed;
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+benchmark_parse_mix (Benchmark *bench, const gchar *mix, GError **error)
+{
+  gchar **items = NULL;
+  gboolean ret = FALSE;
+
+  memset (bench->weights, 0, sizeof (bench->weights));
+  bench->total_weight = 0;
+
+  items = g_strsplit (mix, ",", -1);
+  for (guint i = 0; items[i] != NULL; i++)
+    {
+      gchar **pair = g_strsplit (items[i], "=", 2);
+      gchar *end = NULL;
+      guint64 weight = 0;
+      guint n = 0;
+
+      for (n = 0; n < BENCHMARK_N_MIX; n++)
+        {
+          if (g_strcmp0 (pair[0], mix_names[n]) == 0)
+            {
+              break;
+            }
+        }
+      if (pair[1] != NULL)
+        {
+          weight = g_ascii_strtoull (pair[1], &end, 10);
+        }
+      if (n == BENCHMARK_N_MIX || pair[1] == NULL || *end != '\0'
+          || weight > G_MAXUINT16)
+        {
+          g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                       "Invalid traffic in --mix: %s", items[i]);
+          g_strfreev (pair);
+          goto out;
+        }
+      bench->weights[n] = (guint)weight;
+      g_strfreev (pair);
+    }
+
+  for (guint n = 0; n < BENCHMARK_N_MIX; n++)
+    {
+      bench->total_weight += bench->weights[n];
+    }
+  if (bench->total_weight == 0)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   "No traffic in --mix: %s", mix);
+      goto out;
+    }
+
+  ret = TRUE;
+
+out:
+  g_strfreev (items);
+  return ret;
+}
+
+static BenchmarkMix
+benchmark_pick (Benchmark *bench, BenchmarkClient *client)
+{
+  guint pick = (guint)g_rand_int_range (client->rand, 0,
+                                        (gint32)bench->total_weight);
+  guint n = 0;
+
+  for (n = 0; n < BENCHMARK_N_MIX - 1; n++)
+    {
+      if (pick < bench->weights[n])
+        {
+          break;
+        }
+      pick -= bench->weights[n];
+    }
+  return n;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * Make a single call, recording how long it took or that it failed
+ */
+static void
+benchmark_call (BenchmarkClient *client, BenchmarkCall call,
+                GVariant *parameters)
+{
+  GError *error = NULL;
+  GVariant *result = NULL;
+  gint64 start = 0;
+  gint64 latency = 0;
+
+  start = g_get_monotonic_time ();
+  result = g_dbus_connection_call_sync (
+      client->connection, BENCHMARK_BUS_NAME, BENCHMARK_OBJECT_PATH,
+      BENCHMARK_INTERFACE, call_names[call], parameters, NULL,
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+  latency = g_get_monotonic_time () - start;
+
+  if (result == NULL)
+    {
+      client->errors[call]++;
+      g_error_free (error);
+      return;
+    }
+  g_variant_unref (result);
+  g_array_append_val (client->latencies[call], latency);
+}
+
+static void
+benchmark_check (Benchmark *bench, BenchmarkClient *client)
+{
+  const gchar *action_id = bench->actions[g_rand_int_range (
+      client->rand, 0, (gint32)bench->n_actions)];
+
+  benchmark_call (client, BENCHMARK_CALL_CHECK,
+                  g_variant_new ("(@(sa{sv})s@a{ss}us)",
+                                 client->bus_name_subject, action_id,
+                                 g_variant_new_array (G_VARIANT_TYPE ("{ss}"),
+                                                      NULL, 0),
+                                 POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE, ""));
+}
+
+static void
+benchmark_agent (Benchmark *bench, BenchmarkClient *client)
+{
+  g_mutex_lock (&bench->agent_lock);
+  benchmark_call (client, BENCHMARK_CALL_REGISTER_AGENT,
+                  g_variant_new ("(@(sa{sv})so)", client->agent_subject, "C",
+                                 client->agent_path));
+  benchmark_call (client, BENCHMARK_CALL_UNREGISTER_AGENT,
+                  g_variant_new ("(@(sa{sv})o)", client->agent_subject,
+                                 client->agent_path));
+  g_mutex_unlock (&bench->agent_lock);
+}
+
+static void
+benchmark_temporary (Benchmark *bench, BenchmarkClient *client)
+{
+  if (client->session_subject == NULL)
+    {
+      /* Not running in a session, there is nothing to ask about */
+      client->errors[BENCHMARK_CALL_ENUMERATE_TEMPORARY]++;
+      return;
+    }
+  benchmark_call (client, BENCHMARK_CALL_ENUMERATE_TEMPORARY,
+                  g_variant_new ("(@(sa{sv}))", client->session_subject));
+}
+
+static gpointer
+benchmark_client_thread (gpointer data)
+{
+  BenchmarkClient *client = data;
+  Benchmark *bench = client->bench;
+
+  while (g_get_monotonic_time () < bench->deadline)
+    {
+      switch (benchmark_pick (bench, client))
+        {
+        case BENCHMARK_MIX_CHECK:
+          benchmark_check (bench, client);
+          break;
+
+        case BENCHMARK_MIX_ENUMERATE:
+          benchmark_call (client, BENCHMARK_CALL_ENUMERATE_ACTIONS,
+                          g_variant_new ("(s)", "C"));
+          break;
+
+        case BENCHMARK_MIX_AGENT:
+          benchmark_agent (bench, client);
+          break;
+
+        case BENCHMARK_MIX_TEMPORARY:
+          benchmark_temporary (bench, client);
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+
+  return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GDBusConnection *
+benchmark_connect (GError **error)
+{
+  gchar *address = NULL;
+  GDBusConnection *ret = NULL;
+
+  if (opt_address != NULL)
+    {
+      address = g_strdup (opt_address);
+    }
+  else
+    {
+      address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SYSTEM, NULL,
+                                                 error);
+      if (address == NULL)
+        {
+          return NULL;
+        }
+    }
+
+  /* A connection of its own, rather than the shared singleton */
+  ret = g_dbus_connection_new_for_address_sync (
+      address,
+      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+          | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+      NULL, NULL, error);
+  g_free (address);
+
+  return ret;
+}
+
+static gboolean
+benchmark_client_init (Benchmark *bench, BenchmarkClient *client, guint index,
+                       GError **error)
+{
+  PolkitSubject *subject = NULL;
+
+  client->bench = bench;
+  client->index = index;
+  client->connection = benchmark_connect (error);
+  if (client->connection == NULL)
+    {
+      return FALSE;
+    }
+  client->rand = g_rand_new_with_seed (index);
+
+  subject = polkit_system_bus_name_new (
+      g_dbus_connection_get_unique_name (client->connection));
+  client->bus_name_subject
+      = g_variant_ref_sink (polkit_subject_to_gvariant (subject));
+  g_object_unref (subject);
+
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  client->agent_subject
+      = g_variant_ref_sink (polkit_subject_to_gvariant (subject));
+  g_object_unref (subject);
+  client->agent_path = g_strdup_printf (BENCHMARK_AGENT_PATH "/%u", index);
+
+  subject = polkit_unix_session_new_for_process_sync (getpid (), NULL, NULL);
+  if (subject != NULL)
+    {
+      client->session_subject
+          = g_variant_ref_sink (polkit_subject_to_gvariant (subject));
+      g_object_unref (subject);
+    }
+
+  for (guint n = 0; n < BENCHMARK_N_CALLS; n++)
+    {
+      client->latencies[n] = g_array_new (FALSE, FALSE, sizeof (gint64));
+    }
+
+  return TRUE;
+}
+
+static void
+benchmark_client_clear (BenchmarkClient *client)
+{
+  for (guint n = 0; n < BENCHMARK_N_CALLS; n++)
+    {
+      g_clear_pointer (&client->latencies[n], g_array_unref);
+    }
+  g_clear_pointer (&client->bus_name_subject, g_variant_unref);
+  g_clear_pointer (&client->agent_subject, g_variant_unref);
+  g_clear_pointer (&client->session_subject, g_variant_unref);
+  g_clear_pointer (&client->agent_path, g_free);
+  g_clear_pointer (&client->rand, g_rand_free);
+  g_clear_object (&client->connection);
+}
+
+/**
+ * Make sure somebody answers before starting the clock, so that a missing
+ * daemon is a skip rather than a run full of errors
+ */
+static gboolean
+benchmark_ping (GDBusConnection *connection, GError **error)
+{
+  GVariant *result = NULL;
+
+  result = g_dbus_connection_call_sync (
+      connection, BENCHMARK_BUS_NAME, BENCHMARK_OBJECT_PATH,
+      "org.freedesktop.DBus.Properties", "Get",
+      g_variant_new ("(ss)", BENCHMARK_INTERFACE, "BackendVersion"), NULL,
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, error);
+  if (result == NULL)
+    {
+      return FALSE;
+    }
+  g_variant_unref (result);
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gint
+benchmark_compare_latency (gconstpointer a, gconstpointer b)
+{
+  gint64 la = *(const gint64 *)a;
+  gint64 lb = *(const gint64 *)b;
+
+  return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+static gint64
+benchmark_percentile (GArray *sorted, gdouble q)
+{
+  guint n = 0;
+
+  if (sorted->len == 0)
+    {
+      return 0;
+    }
+  n = (guint)(q * sorted->len);
+  return g_array_index (sorted, gint64, MIN (n, sorted->len - 1));
+}
+
+static void
+benchmark_print (Benchmark *bench, const gchar *name, GArray *latencies,
+                 guint64 errors)
+{
+  g_array_sort (latencies, benchmark_compare_latency);
+
+  g_print ("{\"benchmark\": \"polkitd\", \"call\": \"%s\", \"clients\": %u, "
+           "\"calls\": %u, \"errors\": %" G_GUINT64_FORMAT ", "
+           "\"calls_per_sec\": %.1f, \"p50_usec\": %" G_GINT64_FORMAT ", "
+           "\"p90_usec\": %" G_GINT64_FORMAT ", \"p99_usec\": %" G_GINT64_FORMAT
+           ", \"max_usec\": %" G_GINT64_FORMAT "}\n",
+           name, bench->n_clients, latencies->len, errors,
+           (gdouble)latencies->len * G_USEC_PER_SEC / (gdouble)bench->elapsed,
+           benchmark_percentile (latencies, 0.5),
+           benchmark_percentile (latencies, 0.9),
+           benchmark_percentile (latencies, 0.99),
+           benchmark_percentile (latencies, 1.0));
+}
+
+static void
+benchmark_report (Benchmark *bench)
+{
+  GArray *all = g_array_new (FALSE, FALSE, sizeof (gint64));
+  guint64 all_errors = 0;
+
+  for (guint n = 0; n < BENCHMARK_N_CALLS; n++)
+    {
+      GArray *latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+      guint64 errors = 0;
+
+      for (guint i = 0; i < bench->n_clients; i++)
+        {
+          BenchmarkClient *client = &bench->clients[i];
+
+          g_array_append_vals (latencies, client->latencies[n]->data,
+                               client->latencies[n]->len);
+          errors += client->errors[n];
+        }
+      if (latencies->len > 0 || errors > 0)
+        {
+          g_array_append_vals (all, latencies->data, latencies->len);
+          all_errors += errors;
+          benchmark_print (bench, call_names[n], latencies, errors);
+        }
+      g_array_unref (latencies);
+    }
+
+  benchmark_print (bench, "all", all, all_errors);
+  g_array_unref (all);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *opt_context = NULL;
+  GError *error = NULL;
+  Benchmark bench = { 0 };
+  gint ret = EXIT_FAILURE;
+  gint64 start = 0;
+
+  setlocale (LC_ALL, "");
+  g_mutex_init (&bench.agent_lock);
+
+  opt_context = g_option_context_new ("- drive a running polkitd");
+  g_option_context_add_main_entries (opt_context, opt_entries, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      goto out;
+    }
+  if (opt_clients <= 0 || opt_duration <= 0)
+    {
+      g_printerr ("--clients and --duration must be positive\n");
+      goto out;
+    }
+  if (!benchmark_parse_mix (&bench,
+                            opt_mix != NULL
+                                ? opt_mix
+                                : "check=70,enumerate=10,agent=10,temporary=10",
+                            &error))
+    {
+      g_printerr ("%s\n", error->message);
+      goto out;
+    }
+  bench.actions = opt_actions != NULL ? (const gchar *const *)opt_actions
+                                      : default_actions;
+  bench.n_actions = g_strv_length ((gchar **)bench.actions);
+
+  bench.n_clients = (guint)opt_clients;
+  bench.clients = g_new0 (BenchmarkClient, bench.n_clients);
+  for (guint i = 0; i < bench.n_clients; i++)
+    {
+      if (!benchmark_client_init (&bench, &bench.clients[i], i, &error))
+        {
+          g_printerr ("Error connecting to the bus: %s\n", error->message);
+          ret = BENCHMARK_EXIT_SKIP;
+          goto out;
+        }
+    }
+  if (!benchmark_ping (bench.clients[0].connection, &error))
+    {
+      g_printerr ("No polkit authority on the bus: %s\n", error->message);
+      ret = BENCHMARK_EXIT_SKIP;
+      goto out;
+    }
+
+  start = g_get_monotonic_time ();
+  bench.deadline = start + (gint64)opt_duration * G_USEC_PER_SEC;
+  for (guint i = 0; i < bench.n_clients; i++)
+    {
+      bench.clients[i].thread = g_thread_new (
+          "benchmark-client", benchmark_client_thread, &bench.clients[i]);
+    }
+  for (guint i = 0; i < bench.n_clients; i++)
+    {
+      g_thread_join (bench.clients[i].thread);
+    }
+  bench.elapsed = g_get_monotonic_time () - start;
+
+  benchmark_report (&bench);
+  ret = EXIT_SUCCESS;
+
+out:
+  for (guint i = 0; bench.clients != NULL && i < bench.n_clients; i++)
+    {
+      benchmark_client_clear (&bench.clients[i]);
+    }
+  g_free (bench.clients);
+  g_mutex_clear (&bench.agent_lock);
+  g_clear_error (&error);
+  if (opt_context != NULL)
+    {
+      g_option_context_free (opt_context);
+    }
+  return ret;
+}
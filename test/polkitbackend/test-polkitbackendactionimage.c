@@ -0,0 +1,576 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+#include "glib.h"
+
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <string.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendactionimage.h>
+#include <polkitbackend/polkitbackendactionpool.h>
+
+#define DIRECTORY "/usr/share/polkit-1/actions"
+
+/* Mirrors the layout in polkitbackendactionimage.c, so that the tests can
+ * damage the fields that are validated on read */
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_files;
+  guint32 n_actions;
+  guint32 n_pairs;
+  guint32 directory;
+  guint64 files;
+  guint64 actions;
+  guint64 pairs;
+  guint64 pool;
+  guint64 pool_size;
+  guint64 size;
+} TestHeader;
+
+typedef struct
+{
+  ActionImageStamp stamp;
+  guint32 name;
+  guint32 first_action;
+  guint32 n_actions;
+  guint32 reserved;
+} TestFileRecord;
+
+typedef struct
+{
+  gchar *dir;
+  gchar *path;
+  GHashTable *descriptions;
+  GHashTable *annotations;
+  ActionImageAction actions[3];
+  ActionImageFile files[2];
+} Fixture;
+
+static void
+fixture_init (Fixture *fixture)
+{
+  GError *error = NULL;
+
+  memset (fixture, 0, sizeof (*fixture));
+
+  fixture->dir = g_dir_make_tmp ("polkit-action-image-XXXXXX", &error);
+  g_assert_no_error (error);
+  fixture->path = g_build_filename (fixture->dir, "cache", "actions.cache",
+                                    NULL);
+
+  fixture->descriptions = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (fixture->descriptions, "de", "Testen");
+  g_hash_table_insert (fixture->descriptions, "fr", "Tester");
+  fixture->annotations = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (fixture->annotations,
+                       "org.freedesktop.policykit.imply",
+                       "org.example.second");
+
+  fixture->actions[0] = (ActionImageAction){
+    .action_id = "org.example.first",
+    .vendor_name = "Example",
+    .vendor_url = "https://example.org",
+    .icon_name = "example",
+    .description = "Test",
+    .message = "Authentication is required to test",
+    .implicit_authorization_any = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED,
+    .implicit_authorization_inactive
+    = POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED,
+    .implicit_authorization_active = POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED,
+    .localized_description = fixture->descriptions,
+    .annotations = fixture->annotations,
+  };
+  /* Shares its vendor with the first, and has none of the optional bits */
+  fixture->actions[1] = (ActionImageAction){
+    .action_id = "org.example.second",
+    .vendor_name = "Example",
+    .implicit_authorization_any = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN,
+    .implicit_authorization_inactive = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN,
+    .implicit_authorization_active
+    = POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED,
+  };
+  fixture->actions[2] = (ActionImageAction){
+    .action_id = "org.example.other",
+    .description = "Other",
+    .implicit_authorization_any = POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED,
+    .implicit_authorization_inactive = POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED,
+    .implicit_authorization_active = POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED,
+  };
+
+  fixture->files[0] = (ActionImageFile){
+    .name = "org.example.policy",
+    .stamp = { .inode = 12, .size = 3456, .mtime = 1500000000 },
+    .actions = &fixture->actions[0],
+    .n_actions = 2,
+  };
+  fixture->files[1] = (ActionImageFile){
+    .name = "org.example.other.policy",
+    .stamp = { .inode = 13, .size = 789, .mtime = 1500000001 },
+    .actions = &fixture->actions[2],
+    .n_actions = 1,
+  };
+
+  g_assert (action_image_write (fixture->path, DIRECTORY, fixture->files,
+                                G_N_ELEMENTS (fixture->files), &error));
+  g_assert_no_error (error);
+}
+
+static void
+fixture_clear (Fixture *fixture)
+{
+  gchar *cache_dir = NULL;
+
+  g_unlink (fixture->path);
+  cache_dir = g_path_get_dirname (fixture->path);
+  g_rmdir (cache_dir);
+  g_rmdir (fixture->dir);
+  g_free (cache_dir);
+  g_free (fixture->path);
+  g_free (fixture->dir);
+  g_hash_table_unref (fixture->descriptions);
+  g_hash_table_unref (fixture->annotations);
+}
+
+static void
+assert_table_equal (GHashTable *table, GHashTable *expected)
+{
+  GHashTableIter iter;
+  const gchar *key = NULL;
+  const gchar *value = NULL;
+
+  if (!expected)
+    {
+      g_assert_cmpuint (g_hash_table_size (table), ==, 0);
+      return;
+    }
+
+  g_assert_cmpuint (g_hash_table_size (table), ==,
+                    g_hash_table_size (expected));
+  g_hash_table_iter_init (&iter, expected);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&value))
+    {
+      g_assert_cmpstr (g_hash_table_lookup (table, key), ==, value);
+    }
+}
+
+/**
+ * Overwrite the image with @length bytes of @contents, and make sure
+ * reading it back fails as corrupt
+ */
+static void
+assert_rejected (const gchar *path, const gchar *contents, gsize length)
+{
+  ActionImage *image = NULL;
+  GError *error = NULL;
+
+  g_assert (g_file_set_contents (path, contents, length, &error));
+  g_assert_no_error (error);
+  image = action_image_read (path, DIRECTORY, &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_assert (image == NULL);
+  g_clear_error (&error);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_round_trip (void)
+{
+  Fixture fixture;
+  ActionImage *image = NULL;
+  GError *error = NULL;
+  guint file;
+
+  fixture_init (&fixture);
+
+  image = action_image_read (fixture.path, DIRECTORY, &error);
+  g_assert_no_error (error);
+  g_assert (image != NULL);
+  g_assert_cmpuint (action_image_get_n_files (image), ==,
+                    G_N_ELEMENTS (fixture.files));
+
+  for (file = 0; file < G_N_ELEMENTS (fixture.files); file++)
+    {
+      const ActionImageFile *orig = &fixture.files[file];
+      ActionImageStamp stamp = { 0 };
+      guint n;
+
+      g_assert_cmpstr (action_image_get_file_name (image, file), ==,
+                       orig->name);
+      action_image_get_file_stamp (image, file, &stamp);
+      g_assert_cmpuint (stamp.inode, ==, orig->stamp.inode);
+      g_assert_cmpuint (stamp.size, ==, orig->stamp.size);
+      g_assert_cmpuint (stamp.mtime, ==, orig->stamp.mtime);
+      g_assert_cmpuint (action_image_get_n_actions (image, file), ==,
+                        orig->n_actions);
+
+      for (n = 0; n < orig->n_actions; n++)
+        {
+          const ActionImageAction *expected = &orig->actions[n];
+          ActionImageAction action = { 0 };
+
+          g_assert_cmpstr (action_image_get_action_id (image, file, n), ==,
+                           expected->action_id);
+
+          action_image_get_action (image, file, n, &action);
+          g_assert_cmpstr (action.action_id, ==, expected->action_id);
+          g_assert_cmpstr (action.vendor_name, ==, expected->vendor_name);
+          g_assert_cmpstr (action.vendor_url, ==, expected->vendor_url);
+          g_assert_cmpstr (action.icon_name, ==, expected->icon_name);
+          g_assert_cmpstr (action.description, ==, expected->description);
+          g_assert_cmpstr (action.message, ==, expected->message);
+          g_assert_cmpint (action.implicit_authorization_any, ==,
+                           expected->implicit_authorization_any);
+          g_assert_cmpint (action.implicit_authorization_inactive, ==,
+                           expected->implicit_authorization_inactive);
+          g_assert_cmpint (action.implicit_authorization_active, ==,
+                           expected->implicit_authorization_active);
+          assert_table_equal (action.localized_description,
+                              expected->localized_description);
+          assert_table_equal (action.localized_message,
+                              expected->localized_message);
+          assert_table_equal (action.annotations, expected->annotations);
+
+          g_hash_table_unref (action.localized_description);
+          g_hash_table_unref (action.localized_message);
+          g_hash_table_unref (action.annotations);
+        }
+    }
+
+  /* The strings point into the mapping, which lives as long as a ref */
+  action_image_ref (image);
+  action_image_unref (image);
+  g_assert_cmpstr (action_image_get_action_id (image, 1, 0), ==,
+                   "org.example.other");
+  action_image_unref (image);
+
+  fixture_clear (&fixture);
+}
+
+static void
+test_empty (void)
+{
+  ActionImage *image = NULL;
+  GError *error = NULL;
+  gchar *dir = NULL;
+  gchar *path = NULL;
+
+  dir = g_dir_make_tmp ("polkit-action-image-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (dir, "actions.cache", NULL);
+
+  g_assert (action_image_write (path, DIRECTORY, NULL, 0, &error));
+  g_assert_no_error (error);
+  image = action_image_read (path, DIRECTORY, &error);
+  g_assert_no_error (error);
+  g_assert (image != NULL);
+  g_assert_cmpuint (action_image_get_n_files (image), ==, 0);
+  action_image_unref (image);
+
+  g_unlink (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+static void
+test_missing (void)
+{
+  ActionImage *image = NULL;
+  GError *error = NULL;
+
+  image = action_image_read ("/nonexistent/actions.cache", DIRECTORY, &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+  g_assert (image == NULL);
+  g_clear_error (&error);
+}
+
+static void
+test_wrong_directory (void)
+{
+  Fixture fixture;
+  ActionImage *image = NULL;
+  GError *error = NULL;
+
+  fixture_init (&fixture);
+
+  image = action_image_read (fixture.path, "/etc/polkit-1/actions", &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_assert (image == NULL);
+  g_clear_error (&error);
+
+  /* Only the whole path matches */
+  image = action_image_read (fixture.path, DIRECTORY "/", &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_assert (image == NULL);
+  g_clear_error (&error);
+
+  fixture_clear (&fixture);
+}
+
+static void
+test_corrupt (void)
+{
+  Fixture fixture;
+  ActionImage *image = NULL;
+  GError *error = NULL;
+  gchar *contents = NULL;
+  gchar *copy = NULL;
+  gsize length = 0;
+  TestHeader *header = NULL;
+  TestFileRecord *record = NULL;
+
+  fixture_init (&fixture);
+  g_assert (g_file_get_contents (fixture.path, &contents, &length, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (length, >, sizeof (TestHeader));
+
+  /* Truncated anywhere, even within the header */
+  assert_rejected (fixture.path, contents, length - 1);
+  assert_rejected (fixture.path, contents, sizeof (TestHeader) - 1);
+  assert_rejected (fixture.path, contents, 0);
+
+  /* Each case damages a fresh copy of the good image */
+#define DAMAGE(stmt)                                                          \
+  G_STMT_START                                                                \
+  {                                                                           \
+    g_free (copy);                                                            \
+    copy = g_memdup (contents, length);                                       \
+    header = (TestHeader *)copy;                                              \
+    record = (TestFileRecord *)(copy + header->files);                        \
+    stmt;                                                                     \
+    assert_rejected (fixture.path, copy, length);                             \
+  }                                                                           \
+  G_STMT_END
+
+  DAMAGE (header->magic = ~header->magic);
+  DAMAGE (header->size = length + 8);
+
+  /* Tables outside of the image, overlapping its end, or misaligned */
+  DAMAGE (header->files = length + 8);
+  DAMAGE (header->actions = G_MAXUINT64 & ~(guint64)7);
+  DAMAGE (header->pairs = header->pairs + 4);
+  DAMAGE (header->n_pairs = G_MAXUINT32);
+  DAMAGE (header->n_actions = header->n_actions + 1000);
+  DAMAGE (header->pool_size = length);
+
+  /* Strings past the pool, or a pool that isn't terminated */
+  DAMAGE (header->directory = header->pool_size);
+  DAMAGE (header->pool_size = header->pool_size - 1);
+  DAMAGE (record[0].name = G_MAXUINT32 - 1);
+
+  /* Files whose actions run past the table */
+  DAMAGE (record[1].first_action = header->n_actions);
+  DAMAGE (record[1].n_actions = G_MAXUINT32);
+
+#undef DAMAGE
+
+  /* Another version is rejected as well, for a reason of its own */
+  g_free (copy);
+  copy = g_memdup (contents, length);
+  ((TestHeader *)copy)->version = ACTION_IMAGE_VERSION + 1;
+  g_assert (g_file_set_contents (fixture.path, copy, length, &error));
+  g_assert_no_error (error);
+  image = action_image_read (fixture.path, DIRECTORY, &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_assert (strstr (error->message, "version") != NULL);
+  g_assert (image == NULL);
+  g_clear_error (&error);
+
+  /* And the good image still reads back after all that */
+  g_assert (g_file_set_contents (fixture.path, contents, length, &error));
+  g_assert_no_error (error);
+  image = action_image_read (fixture.path, DIRECTORY, &error);
+  g_assert_no_error (error);
+  g_assert (image != NULL);
+  action_image_unref (image);
+
+  g_free (copy);
+  g_free (contents);
+  fixture_clear (&fixture);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static const gchar policy[]
+    = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<policyconfig>\n"
+      "  <action id=\"org.example.stamp\">\n"
+      "    <description>From the file</description>\n"
+      "    <message>Authentication is required</message>\n"
+      "    <defaults>\n"
+      "      <allow_any>no</allow_any>\n"
+      "      <allow_inactive>no</allow_inactive>\n"
+      "      <allow_active>yes</allow_active>\n"
+      "    </defaults>\n"
+      "  </action>\n"
+      "</policyconfig>\n";
+
+/**
+ * Write an image of @directory in which org.example.policy defines
+ * org.example.stamp as "From the image", stamped with @stamp
+ */
+static void
+write_stamped_image (const gchar *path, const gchar *directory,
+                     const ActionImageStamp *stamp)
+{
+  ActionImageAction action = {
+    .action_id = "org.example.stamp",
+    .description = "From the image",
+    .message = "Authentication is required",
+    .implicit_authorization_any = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED,
+    .implicit_authorization_inactive
+    = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED,
+    .implicit_authorization_active = POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED,
+  };
+  ActionImageFile file = {
+    .name = "org.example.policy",
+    .stamp = *stamp,
+    .actions = &action,
+    .n_actions = 1,
+  };
+  GError *error = NULL;
+
+  g_assert (action_image_write (path, directory, &file, 1, &error));
+  g_assert_no_error (error);
+}
+
+static gchar *
+lookup_description (GFile *directory, const gchar *path)
+{
+  PolkitBackendActionPool *pool = NULL;
+  PolkitActionDescription *action = NULL;
+  gchar *ret = NULL;
+
+  pool = g_object_new (POLKIT_BACKEND_TYPE_ACTION_POOL, "directory",
+                       directory, "cache-file", path, NULL);
+  action = polkit_backend_action_pool_get_action (pool, "org.example.stamp",
+                                                  NULL);
+  g_assert (action != NULL);
+  ret = g_strdup (polkit_action_description_get_description (action));
+  g_object_unref (action);
+  g_object_unref (pool);
+  return ret;
+}
+
+static void
+test_stamp (void)
+{
+  ActionImageStamp stamp = { 0 };
+  GFileInfo *info = NULL;
+  GFile *directory = NULL;
+  GFile *file = NULL;
+  GError *error = NULL;
+  gchar *dir = NULL;
+  gchar *policy_path = NULL;
+  gchar *path = NULL;
+  gchar *description = NULL;
+
+  dir = g_dir_make_tmp ("polkit-action-image-XXXXXX", &error);
+  g_assert_no_error (error);
+  directory = g_file_new_for_path (dir);
+  policy_path = g_build_filename (dir, "org.example.policy", NULL);
+  path = g_build_filename (dir, "actions.cache", NULL);
+  file = g_file_new_for_path (policy_path);
+
+  g_assert (g_file_set_contents (policy_path, policy, -1, &error));
+  g_assert_no_error (error);
+  info = g_file_query_info (file, "standard::size,time::modified,unix::inode",
+                            G_FILE_QUERY_INFO_NONE, NULL, &error);
+  g_assert_no_error (error);
+  stamp.inode
+      = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+  stamp.size = g_file_info_get_size (info);
+  stamp.mtime
+      = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  g_object_unref (info);
+
+  /* A file matching its stamp is served from the image, unparsed */
+  write_stamped_image (path, dir, &stamp);
+  description = lookup_description (directory, path);
+  g_assert_cmpstr (description, ==, "From the image");
+  g_free (description);
+
+  /* Any part of the stamp differing has the file parsed again */
+  stamp.mtime++;
+  write_stamped_image (path, dir, &stamp);
+  description = lookup_description (directory, path);
+  g_assert_cmpstr (description, ==, "From the file");
+  g_free (description);
+
+  stamp.mtime--;
+  stamp.size++;
+  write_stamped_image (path, dir, &stamp);
+  description = lookup_description (directory, path);
+  g_assert_cmpstr (description, ==, "From the file");
+  g_free (description);
+
+  stamp.size--;
+  stamp.inode++;
+  write_stamped_image (path, dir, &stamp);
+  description = lookup_description (directory, path);
+  g_assert_cmpstr (description, ==, "From the file");
+  g_free (description);
+
+  /* As is every file when the image is of another directory */
+  stamp.inode--;
+  write_stamped_image (path, "/elsewhere", &stamp);
+  g_test_expect_message ("polkitd-1", G_LOG_LEVEL_WARNING,
+                         "*another directory*");
+  description = lookup_description (directory, path);
+  g_test_assert_expected_messages ();
+  g_assert_cmpstr (description, ==, "From the file");
+  g_free (description);
+
+  g_unlink (path);
+  g_unlink (policy_path);
+  g_rmdir (dir);
+  g_object_unref (file);
+  g_object_unref (directory);
+  g_free (path);
+  g_free (policy_path);
+  g_free (dir);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/PolkitBackendActionImage/round_trip", test_round_trip);
+  g_test_add_func ("/PolkitBackendActionImage/empty", test_empty);
+  g_test_add_func ("/PolkitBackendActionImage/missing", test_missing);
+  g_test_add_func ("/PolkitBackendActionImage/wrong_directory",
+                   test_wrong_directory);
+  g_test_add_func ("/PolkitBackendActionImage/corrupt", test_corrupt);
+  g_test_add_func ("/PolkitBackendActionImage/stamp", test_stamp);
+
+  return g_test_run ();
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+#include "glib.h"
+
+#include <locale.h>
+#include <glib/gstdio.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendauthorizationjournal.h>
+
+typedef struct
+{
+  gint slot;
+  gint pid;
+  gint uid;
+  guint64 start_time;
+  gchar *scope;
+  gchar *action_id;
+  gint64 time_granted;
+  gint64 time_expires;
+} Found;
+
+static void
+found_free (gpointer data)
+{
+  Found *found = data;
+
+  g_free (found->scope);
+  g_free (found->action_id);
+  g_free (found);
+}
+
+static void
+record_found (PolkitBackendAuthorizationJournal *journal,
+              gint slot,
+              PolkitSubject *subject,
+              PolkitSubject *scope,
+              const gchar *action_id,
+              gint64 time_granted,
+              gint64 time_expires,
+              gpointer user_data)
+{
+  Found *found = g_new0 (Found, 1);
+
+  found->slot = slot;
+  found->pid = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (subject));
+  found->uid = polkit_unix_process_get_uid (POLKIT_UNIX_PROCESS (subject));
+  found->start_time
+      = polkit_unix_process_get_start_time (POLKIT_UNIX_PROCESS (subject));
+  found->scope = polkit_subject_to_string (scope);
+  found->action_id = g_strdup (action_id);
+  found->time_granted = time_granted;
+  found->time_expires = time_expires;
+  g_ptr_array_add (user_data, found);
+}
+
+static GPtrArray *
+find_all (PolkitBackendAuthorizationJournal *journal)
+{
+  GPtrArray *found = g_ptr_array_new_with_free_func (found_free);
+
+  polkit_backend_authorization_journal_foreach (journal, record_found, found);
+  return found;
+}
+
+static PolkitBackendAuthorizationJournal *
+open_journal (const gchar *path)
+{
+  PolkitBackendAuthorizationJournal *journal;
+  GError *error = NULL;
+
+  journal = polkit_backend_authorization_journal_open (path, &error);
+  g_assert_no_error (error);
+  g_assert (journal != NULL);
+  return journal;
+}
+
+static void
+test_reopen (void)
+{
+  gchar *dir = g_dir_make_tmp ("polkit-journal-XXXXXX", NULL);
+  gchar *path = g_build_filename (dir, "journal", NULL);
+  PolkitBackendAuthorizationJournal *journal;
+  PolkitSubject *process = polkit_unix_process_new_for_owner (1234, 42, 1000);
+  PolkitSubject *session = polkit_unix_session_new ("c1");
+  GPtrArray *found;
+  Found *first;
+  gint kept;
+  gint removed;
+
+  /* without a boot id nothing is ever picked up again */
+  if (!g_file_test ("/proc/sys/kernel/random/boot_id", G_FILE_TEST_EXISTS))
+    {
+      g_test_skip ("No boot id");
+      goto out;
+    }
+
+  journal = open_journal (path);
+  kept = polkit_backend_authorization_journal_add (
+      journal, process, session, "org.example.kept", 100, 200);
+  removed = polkit_backend_authorization_journal_add (
+      journal, process, session, "org.example.removed", 100, 300);
+  g_assert_cmpint (kept, >=, 0);
+  g_assert_cmpint (removed, >=, 0);
+  g_assert_cmpint (kept, !=, removed);
+  polkit_backend_authorization_journal_remove (journal, removed);
+  polkit_backend_authorization_journal_free (journal);
+
+  /* what is left is there for the next daemon */
+  journal = open_journal (path);
+  found = find_all (journal);
+  g_assert_cmpuint (found->len, ==, 1);
+  first = found->pdata[0];
+  g_assert_cmpint (first->slot, ==, kept);
+  g_assert_cmpint (first->pid, ==, 1234);
+  g_assert_cmpint (first->uid, ==, 1000);
+  g_assert_cmpuint (first->start_time, ==, 42);
+  g_assert_cmpstr (first->scope, ==, "unix-session:c1");
+  g_assert_cmpstr (first->action_id, ==, "org.example.kept");
+  g_assert_cmpint (first->time_granted, ==, 100);
+  g_assert_cmpint (first->time_expires, ==, 200);
+  g_ptr_array_unref (found);
+  polkit_backend_authorization_journal_free (journal);
+
+out:
+  g_unlink (path);
+  g_rmdir (dir);
+  g_object_unref (process);
+  g_object_unref (session);
+  g_free (path);
+  g_free (dir);
+}
+
+static void
+test_not_journaled (void)
+{
+  gchar *dir = g_dir_make_tmp ("polkit-journal-XXXXXX", NULL);
+  gchar *path = g_build_filename (dir, "journal", NULL);
+  PolkitBackendAuthorizationJournal *journal;
+  PolkitSubject *process = polkit_unix_process_new_for_owner (1234, 42, 1000);
+  PolkitSubject *no_uid = polkit_unix_process_new_for_owner (1234, 42, -1);
+  PolkitSubject *session = polkit_unix_session_new ("c1");
+  gchar *long_action = g_strnfill (300, 'a');
+  GPtrArray *found;
+  guint n;
+
+  journal = open_journal (path);
+
+  /* only processes whose owner is known can be recognized later */
+  g_assert_cmpint (polkit_backend_authorization_journal_add (
+                       journal, session, session, "org.example.a", 1, 2),
+                   ==, -1);
+  g_assert_cmpint (polkit_backend_authorization_journal_add (
+                       journal, no_uid, session, "org.example.a", 1, 2),
+                   ==, -1);
+  g_assert_cmpint (polkit_backend_authorization_journal_add (
+                       journal, process, session, long_action, 1, 2),
+                   ==, -1);
+
+  /* once the journal is full, further authorizations stay in memory */
+  for (n = 0; n < POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS; n++)
+    g_assert_cmpint (polkit_backend_authorization_journal_add (
+                         journal, process, session, "org.example.a", 1, 2),
+                     >=, 0);
+  g_assert_cmpint (polkit_backend_authorization_journal_add (
+                       journal, process, session, "org.example.a", 1, 2),
+                   ==, -1);
+
+  found = find_all (journal);
+  g_assert_cmpuint (found->len, ==, POLKIT_BACKEND_AUTHORIZATION_JOURNAL_SLOTS);
+  g_ptr_array_unref (found);
+  polkit_backend_authorization_journal_free (journal);
+
+  g_unlink (path);
+  g_rmdir (dir);
+  g_object_unref (process);
+  g_object_unref (no_uid);
+  g_object_unref (session);
+  g_free (long_action);
+  g_free (path);
+  g_free (dir);
+}
+
+static void
+test_corrupt (void)
+{
+  gchar *dir = g_dir_make_tmp ("polkit-journal-XXXXXX", NULL);
+  gchar *path = g_build_filename (dir, "journal", NULL);
+  PolkitBackendAuthorizationJournal *journal;
+  GPtrArray *found;
+
+  g_assert (g_file_set_contents (path, "garbage", -1, NULL));
+
+  /* a journal not written by us is started over */
+  journal = open_journal (path);
+  found = find_all (journal);
+  g_assert_cmpuint (found->len, ==, 0);
+  g_ptr_array_unref (found);
+  polkit_backend_authorization_journal_free (journal);
+
+  g_unlink (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/PolkitBackendAuthorizationJournal/reopen", test_reopen);
+  g_test_add_func ("/PolkitBackendAuthorizationJournal/not_journaled",
+                   test_not_journaled);
+  g_test_add_func ("/PolkitBackendAuthorizationJournal/corrupt", test_corrupt);
+
+  return g_test_run ();
+}
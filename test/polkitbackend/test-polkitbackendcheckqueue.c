@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+#include "glib.h"
+
+#include <locale.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendcheckqueue.h>
+
+/* Items are the names of their callers, started in the order recorded */
+static void
+record_started (gpointer item, gpointer user_data)
+{
+  g_ptr_array_add (user_data, item);
+}
+
+static void
+push (PolkitBackendCheckQueue *queue, const gchar *caller, guint weight)
+{
+  GError *error = NULL;
+
+  g_assert (polkit_backend_check_queue_push (queue, caller, weight,
+                                             (gpointer)caller, &error));
+  g_assert_no_error (error);
+}
+
+/* Finishes the check started @n-th, and returns the name of its caller */
+static const gchar *
+finish (PolkitBackendCheckQueue *queue, GPtrArray *started, guint n)
+{
+  const gchar *caller = started->pdata[n];
+
+  polkit_backend_check_queue_done (queue, caller);
+  return caller;
+}
+
+static void
+test_round_robin (void)
+{
+  GPtrArray *started = g_ptr_array_new ();
+  PolkitBackendCheckQueue *queue
+      = polkit_backend_check_queue_new (1, record_started, started);
+
+  /* a busy caller gets in first, yet the other one isn't left waiting */
+  for (guint i = 0; i < 3; i++)
+    push (queue, "busy", 1);
+  push (queue, "quiet", 1);
+
+  g_assert_cmpuint (started->len, ==, 1);
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_running (queue), ==, 1);
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_queued (queue), ==, 3);
+
+  for (guint i = 0; i < 4; i++)
+    finish (queue, started, i);
+
+  g_assert_cmpuint (started->len, ==, 4);
+  g_assert_cmpstr (started->pdata[0], ==, "busy");
+  g_assert_cmpstr (started->pdata[1], ==, "quiet");
+  g_assert_cmpstr (started->pdata[2], ==, "busy");
+  g_assert_cmpstr (started->pdata[3], ==, "busy");
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_running (queue), ==, 0);
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_queued (queue), ==, 0);
+
+  polkit_backend_check_queue_free (queue);
+  g_ptr_array_unref (started);
+}
+
+static void
+test_weight (void)
+{
+  GPtrArray *started = g_ptr_array_new ();
+  PolkitBackendCheckQueue *queue
+      = polkit_backend_check_queue_new (1, record_started, started);
+
+  polkit_backend_check_queue_set_limits (queue, 0, 0, 4);
+
+  /* keep the single slot taken while the rest is queued */
+  push (queue, "first", 1);
+  for (guint i = 0; i < 4; i++)
+    {
+      push (queue, "root", 3);
+      push (queue, "user", 1);
+    }
+
+  for (guint i = 0; i < 9; i++)
+    finish (queue, started, i);
+
+  g_assert_cmpuint (started->len, ==, 9);
+  g_assert_cmpstr (started->pdata[1], ==, "root");
+  g_assert_cmpstr (started->pdata[2], ==, "root");
+  g_assert_cmpstr (started->pdata[3], ==, "root");
+  g_assert_cmpstr (started->pdata[4], ==, "user");
+  g_assert_cmpstr (started->pdata[5], ==, "root");
+  g_assert_cmpstr (started->pdata[6], ==, "user");
+
+  polkit_backend_check_queue_free (queue);
+  g_ptr_array_unref (started);
+}
+
+static void
+test_running_per_caller (void)
+{
+  GPtrArray *started = g_ptr_array_new ();
+  PolkitBackendCheckQueue *queue
+      = polkit_backend_check_queue_new (4, record_started, started);
+
+  polkit_backend_check_queue_set_limits (queue, 0, 0, 2);
+
+  /* there is room for four, but one caller only ever gets two */
+  for (guint i = 0; i < 3; i++)
+    push (queue, "busy", 1);
+  g_assert_cmpuint (started->len, ==, 2);
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_queued (queue), ==, 1);
+
+  push (queue, "quiet", 1);
+  g_assert_cmpuint (started->len, ==, 3);
+  g_assert_cmpstr (started->pdata[2], ==, "quiet");
+
+  finish (queue, started, 0);
+  g_assert_cmpuint (started->len, ==, 4);
+  g_assert_cmpstr (started->pdata[3], ==, "busy");
+
+  /* raising the limit lets waiting checks of a caller start at once */
+  push (queue, "busy", 1);
+  g_assert_cmpuint (started->len, ==, 4);
+  polkit_backend_check_queue_set_limits (queue, 0, 0, 3);
+  g_assert_cmpuint (started->len, ==, 5);
+
+  for (guint i = 1; i < 5; i++)
+    finish (queue, started, i);
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_running (queue), ==, 0);
+
+  polkit_backend_check_queue_free (queue);
+  g_ptr_array_unref (started);
+}
+
+static void
+test_max_running (void)
+{
+  GPtrArray *started = g_ptr_array_new ();
+  PolkitBackendCheckQueue *queue
+      = polkit_backend_check_queue_new (1, record_started, started);
+
+  polkit_backend_check_queue_set_limits (queue, 0, 0, 4);
+
+  for (guint i = 0; i < 4; i++)
+    push (queue, "busy", 1);
+  g_assert_cmpuint (started->len, ==, 1);
+
+  /* more threads let waiting checks start at once */
+  polkit_backend_check_queue_set_max_running (queue, 3);
+  g_assert_cmpuint (started->len, ==, 3);
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_running (queue), ==, 3);
+
+  /* fewer let the running ones finish first */
+  polkit_backend_check_queue_set_max_running (queue, 1);
+  finish (queue, started, 0);
+  g_assert_cmpuint (started->len, ==, 3);
+  finish (queue, started, 1);
+  g_assert_cmpuint (started->len, ==, 3);
+  finish (queue, started, 2);
+  g_assert_cmpuint (started->len, ==, 4);
+
+  finish (queue, started, 3);
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_running (queue), ==, 0);
+
+  polkit_backend_check_queue_free (queue);
+  g_ptr_array_unref (started);
+}
+
+static void
+test_reject (void)
+{
+  GPtrArray *started = g_ptr_array_new ();
+  PolkitBackendCheckQueue *queue
+      = polkit_backend_check_queue_new (1, record_started, started);
+  GError *error = NULL;
+
+  polkit_backend_check_queue_set_limits (queue, 3, 2, 1);
+
+  push (queue, "busy", 1);
+  push (queue, "busy", 1);
+  push (queue, "busy", 1);
+
+  /* the running check doesn't count, the two waiting do */
+  g_assert (!polkit_backend_check_queue_push (queue, "busy", 1, "busy",
+                                              &error));
+  g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_TOO_MANY_REQUESTS);
+  g_clear_error (&error);
+
+  push (queue, "quiet", 1);
+
+  /* and now all queues together are full */
+  g_assert (!polkit_backend_check_queue_push (queue, "other", 1, "other",
+                                              &error));
+  g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_TOO_MANY_REQUESTS);
+  g_clear_error (&error);
+
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_rejected (queue), ==, 2);
+  g_assert_cmpuint (polkit_backend_check_queue_get_n_queued (queue), ==, 3);
+
+  for (guint i = 0; i < 4; i++)
+    finish (queue, started, i);
+  g_assert_cmpuint (started->len, ==, 4);
+
+  polkit_backend_check_queue_free (queue);
+  g_ptr_array_unref (started);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/PolkitBackendCheckQueue/round_robin", test_round_robin);
+  g_test_add_func ("/PolkitBackendCheckQueue/weight", test_weight);
+  g_test_add_func ("/PolkitBackendCheckQueue/running_per_caller",
+                   test_running_per_caller);
+  g_test_add_func ("/PolkitBackendCheckQueue/max_running", test_max_running);
+  g_test_add_func ("/PolkitBackendCheckQueue/reject", test_reject);
+
+  return g_test_run ();
+}
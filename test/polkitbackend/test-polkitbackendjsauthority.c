@@ -89,7 +89,8 @@ test_get_admin_identities_for_action_id (const gchar         *action_id,
                                                                                 TRUE, /* is_local */
                                                                                 TRUE, /* is_active */
                                                                                 action_id,
-                                                                                details);
+                                                                                details,
+                                                                                NULL);
   for (l = admin_identities, n = 0; l != NULL; l = l->next, n++)
     {
       PolkitIdentity *test_identity = POLKIT_IDENTITY (l->data);
@@ -452,7 +453,8 @@ rules_test_func (gconstpointer user_data)
                                                                           TRUE,
                                                                           tc->action_id,
                                                                           details,
-                                                                          POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+                                                                          POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN,
+                                                                          NULL);
   g_assert_cmpint (result, ==, tc->expected_result);
 
   g_clear_object (&details);
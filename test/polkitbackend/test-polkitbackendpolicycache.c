@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+
+#include "config.h"
+#include "glib.h"
+
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <unistd.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendpolicycache.h>
+#include <polkitbackend/polkitbackendpolicyidentity.h>
+#include <polkitbackend/polkitbackendpolicynetgroup.h>
+#include <polkittesthelper.h>
+
+#define TEST_TTL (60 * G_USEC_PER_SEC)
+
+static PolicyCacheKey
+make_key (uid_t uid, const gchar *action_id)
+{
+  PolicyCacheKey key = {
+    .uid = uid,
+    .action_id = action_id,
+    .subject_is_local = TRUE,
+    .subject_is_active = TRUE,
+  };
+
+  return key;
+}
+
+static void
+test_hit_miss (void)
+{
+  PolicyCache *cache = policy_cache_new (8, TEST_TTL);
+  PolicyCacheKey key = make_key (1000, "net.company.action");
+  PolicyCacheKey other = key;
+  PolkitImplicitAuthorization result = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  gchar *action_id = g_strdup ("net.company.action");
+  const PolicyCacheStats *stats = policy_cache_get_stats (cache);
+
+  g_assert (!policy_cache_lookup (cache, &key, &result));
+  policy_cache_insert (cache, &key, policy_cache_get_generation (cache),
+                       POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  /* The cache keeps its own copy of the action ID */
+  key.action_id = action_id;
+  g_assert (policy_cache_lookup (cache, &key, &result));
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  /* Every input is part of the key */
+  other.subject_is_active = FALSE;
+  g_assert (!policy_cache_lookup (cache, &other, &result));
+  other = key;
+  other.subject_is_local = FALSE;
+  g_assert (!policy_cache_lookup (cache, &other, &result));
+  other = key;
+  other.uid = 1001;
+  g_assert (!policy_cache_lookup (cache, &other, &result));
+  other = key;
+  other.seat = g_intern_static_string ("seat0");
+  g_assert (!policy_cache_lookup (cache, &other, &result));
+  other = key;
+  other.session_class = g_intern_static_string ("greeter");
+  g_assert (!policy_cache_lookup (cache, &other, &result));
+  other = key;
+  other.session_type = g_intern_static_string ("wayland");
+  g_assert (!policy_cache_lookup (cache, &other, &result));
+
+  g_assert_cmpuint (stats->hits, ==, 1);
+  g_assert_cmpuint (stats->misses, ==, 7);
+  g_assert_cmpuint (policy_cache_get_size (cache), ==, 1);
+
+  g_free (action_id);
+  policy_cache_free (cache);
+}
+
+static void
+test_lru_eviction (void)
+{
+  PolicyCache *cache = policy_cache_new (2, TEST_TTL);
+  PolicyCacheKey a = make_key (1, "a");
+  PolicyCacheKey b = make_key (2, "b");
+  PolicyCacheKey c = make_key (3, "c");
+  PolkitImplicitAuthorization result;
+  guint generation = policy_cache_get_generation (cache);
+
+  policy_cache_insert (cache, &a, generation,
+                       POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  policy_cache_insert (cache, &b, generation,
+                       POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+
+  /* Touch a, so b is now the least recently used */
+  g_assert (policy_cache_lookup (cache, &a, &result));
+  policy_cache_insert (cache, &c, generation,
+                       POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+
+  g_assert_cmpuint (policy_cache_get_size (cache), ==, 2);
+  g_assert (policy_cache_lookup (cache, &a, &result));
+  g_assert (!policy_cache_lookup (cache, &b, &result));
+  g_assert (policy_cache_lookup (cache, &c, &result));
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  g_assert_cmpuint (policy_cache_get_stats (cache)->evictions, ==, 1);
+
+  /* Replacing an entry never evicts */
+  policy_cache_insert (cache, &c, generation,
+                       POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_assert_cmpuint (policy_cache_get_stats (cache)->evictions, ==, 1);
+  g_assert (policy_cache_lookup (cache, &c, &result));
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  policy_cache_free (cache);
+}
+
+static void
+test_generation (void)
+{
+  PolicyCache *cache = policy_cache_new (8, TEST_TTL);
+  PolicyCacheKey key = make_key (0, "org.freedesktop.test");
+  PolkitImplicitAuthorization result;
+  guint stale;
+
+  stale = policy_cache_get_generation (cache);
+  policy_cache_insert (cache, &key, stale,
+                       POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  policy_cache_bump_generation (cache);
+  g_assert_cmpuint (policy_cache_get_size (cache), ==, 0);
+  g_assert_cmpuint (policy_cache_get_stats (cache)->expired, ==, 1);
+  g_assert (!policy_cache_lookup (cache, &key, &result));
+
+  /* An outcome computed before the reload must not be stored */
+  policy_cache_insert (cache, &key, stale,
+                       POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_assert (!policy_cache_lookup (cache, &key, &result));
+
+  policy_cache_insert (cache, &key, policy_cache_get_generation (cache),
+                       POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+  g_assert (policy_cache_lookup (cache, &key, &result));
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+
+  policy_cache_free (cache);
+}
+
+static void
+test_ttl (void)
+{
+  PolicyCache *cache = policy_cache_new (8, 1000);
+  PolicyCacheKey key = make_key (0, "org.freedesktop.test");
+  PolkitImplicitAuthorization result;
+
+  policy_cache_insert (cache, &key, policy_cache_get_generation (cache),
+                       POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_usleep (5000);
+
+  g_assert (!policy_cache_lookup (cache, &key, &result));
+  g_assert_cmpuint (policy_cache_get_size (cache), ==, 0);
+  g_assert_cmpuint (policy_cache_get_stats (cache)->expired, ==, 1);
+
+  policy_cache_free (cache);
+}
+
+/* see test/data/etc/netgroup, swapped out underneath the cache */
+static void
+test_netgroup (void)
+{
+  PolicyNetgroupCache *cache = NULL;
+  gchar *orig = NULL;
+  gchar *path = NULL;
+  gint fd;
+  GError *error = NULL;
+
+  orig = polkit_test_get_data_path ("etc/netgroup");
+  fd = g_file_open_tmp ("polkit-netgroup-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+  close (fd);
+  g_assert (g_file_set_contents (path, "foo (-,jane,)\n", -1, &error));
+  g_assert_no_error (error);
+
+  /* Members outlive non-members */
+  cache = policy_netgroup_cache_new (8, 60 * G_USEC_PER_SEC, 1000);
+  g_assert (policy_netgroup_cache_contains (cache, "foo", "john"));
+  g_assert (!policy_netgroup_cache_contains (cache, "foo", "jane"));
+  g_assert (!policy_netgroup_cache_contains (cache, "foo", NULL));
+
+  g_setenv ("MOCK_NETGROUP", path, TRUE);
+  g_usleep (5000);
+  g_assert (policy_netgroup_cache_contains (cache, "foo", "john"));
+  g_assert (policy_netgroup_cache_contains (cache, "foo", "jane"));
+
+  /* Until the cache is cleared */
+  policy_netgroup_cache_clear (cache);
+  g_assert (!policy_netgroup_cache_contains (cache, "foo", "john"));
+
+  /* Without a cache, every check is a lookup */
+  g_assert (policy_netgroup_cache_contains (NULL, "foo", "jane"));
+  g_setenv ("MOCK_NETGROUP", orig, TRUE);
+  g_assert (!policy_netgroup_cache_contains (NULL, "foo", "jane"));
+
+  policy_netgroup_cache_free (cache);
+
+  /* Going over capacity never loses the answer being looked up */
+  cache = policy_netgroup_cache_new (1, 60 * G_USEC_PER_SEC,
+                                     60 * G_USEC_PER_SEC);
+  g_assert (policy_netgroup_cache_contains (cache, "foo", "john"));
+  g_assert (policy_netgroup_cache_contains (cache, "bar", "jane"));
+  g_assert (!policy_netgroup_cache_contains (cache, "bar", "john"));
+  policy_netgroup_cache_free (cache);
+
+  g_unlink (path);
+  g_free (path);
+  g_free (orig);
+}
+
+static gboolean
+has_gid (PolicyUserRecord *record, gid_t gid)
+{
+  for (guint i = 0; i < record->gids->len; i++)
+    {
+      if (g_array_index (record->gids, gid_t, i) == gid)
+        {
+          return TRUE;
+        }
+    }
+  return FALSE;
+}
+
+/* see test/data/etc/{passwd,group,netgroup} */
+static void
+test_identity (void)
+{
+  PolicyIdentityCache *cache = NULL;
+  PolicyUserRecord *user = NULL;
+  PolicyMembersRecord *members = NULL;
+
+  cache = policy_identity_cache_new (8, TEST_TTL, TEST_TTL, TEST_TTL);
+
+  user = policy_identity_cache_lookup_user (cache, 500);
+  g_assert_cmpstr (user->name, ==, "john");
+  g_assert_cmpuint (user->primary_gid, ==, 500);
+  g_assert (has_gid (user, 100));
+  g_assert (!has_gid (user, 101));
+
+  /* Hits share the record */
+  g_assert (policy_identity_cache_lookup_user (cache, 500) == user);
+  policy_user_record_unref (user);
+  policy_user_record_unref (user);
+
+  user = policy_identity_cache_lookup_user (cache, 12345);
+  g_assert_cmpstr (user->name, ==, NULL);
+  g_assert_cmpuint (user->primary_gid, ==, (gid_t)-1);
+  g_assert_cmpuint (user->gids->len, ==, 0);
+  policy_user_record_unref (user);
+
+  members = policy_identity_cache_lookup_group (cache, 101);
+  g_assert (members->found);
+  g_assert_cmpuint (members->members->len, ==, 2);
+  g_assert_cmpstr (g_array_index (members->members, PolicyMember, 0).name, ==,
+                   "sally");
+  g_assert_cmpint (g_array_index (members->members, PolicyMember, 0).uid, ==,
+                   502);
+  g_assert_cmpint (g_array_index (members->members, PolicyMember, 1).uid, ==,
+                   503);
+  policy_members_record_unref (members);
+
+  members = policy_identity_cache_lookup_group (cache, 4242);
+  g_assert (!members->found);
+  policy_members_record_unref (members);
+
+  members = policy_identity_cache_lookup_netgroup (NULL, "foo");
+  g_assert (members->found);
+  g_assert_cmpuint (members->members->len, ==, 1);
+  g_assert_cmpstr (g_array_index (members->members, PolicyMember, 0).name, ==,
+                   "john");
+  g_assert_cmpint (g_array_index (members->members, PolicyMember, 0).uid, ==,
+                   500);
+  policy_members_record_unref (members);
+
+  policy_identity_cache_free (cache);
+}
+
+/* see test/data/etc/group, swapped out underneath the cache */
+static void
+test_identity_stale (void)
+{
+  PolicyIdentityCache *cache = NULL;
+  PolicyMembersRecord *first = NULL;
+  PolicyMembersRecord *members = NULL;
+  gchar *orig = NULL;
+  gchar *path = NULL;
+  gint fd;
+  GError *error = NULL;
+
+  orig = polkit_test_get_data_path ("etc/group");
+  fd = g_file_open_tmp ("polkit-group-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+  close (fd);
+  g_assert (g_file_set_contents (path, "users:x:100:jane\n", -1, &error));
+  g_assert_no_error (error);
+
+  /* Always stale, but may be served for a long while */
+  cache = policy_identity_cache_new (8, 0, 0, TEST_TTL);
+  first = policy_identity_cache_lookup_group (cache, 100);
+  g_assert_cmpuint (first->members->len, ==, 2);
+
+  g_setenv ("MOCK_GROUP", path, TRUE);
+  g_usleep (5000);
+
+  /* The stale record is served immediately, and refreshed behind it */
+  members = policy_identity_cache_lookup_group (cache, 100);
+  g_assert (members == first);
+  policy_members_record_unref (members);
+  policy_identity_cache_sync (cache);
+
+  members = policy_identity_cache_lookup_group (cache, 100);
+  g_assert (members != first);
+  g_assert_cmpuint (members->members->len, ==, 1);
+  policy_members_record_unref (members);
+  policy_identity_cache_sync (cache);
+  policy_identity_cache_free (cache);
+
+  /* Past the stale limit, lookups wait for NSS */
+  cache = policy_identity_cache_new (8, 0, 0, 0);
+  members = policy_identity_cache_lookup_group (cache, 100);
+  g_assert_cmpuint (members->members->len, ==, 1);
+  policy_members_record_unref (members);
+
+  g_setenv ("MOCK_GROUP", orig, TRUE);
+  g_usleep (5000);
+  members = policy_identity_cache_lookup_group (cache, 100);
+  g_assert_cmpuint (members->members->len, ==, 2);
+  policy_members_record_unref (members);
+  policy_identity_cache_free (cache);
+
+  policy_members_record_unref (first);
+  g_unlink (path);
+  g_free (path);
+  g_free (orig);
+}
+
+/* see test/data/etc/group, swapped out once prefetched */
+static void
+test_identity_prefetch (void)
+{
+  PolicyIdentityCache *cache = NULL;
+  PolicyUserRecord *user = NULL;
+  PolicyMembersRecord *first = NULL;
+  PolicyMembersRecord *members = NULL;
+  gchar *orig = NULL;
+  gchar *path = NULL;
+  gint fd;
+  GError *error = NULL;
+
+  orig = polkit_test_get_data_path ("etc/group");
+  fd = g_file_open_tmp ("polkit-group-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+  close (fd);
+  g_assert (g_file_set_contents (path, "users:x:100:jane\n", -1, &error));
+  g_assert_no_error (error);
+
+  cache = policy_identity_cache_new (8, TEST_TTL, TEST_TTL, TEST_TTL);
+  policy_identity_cache_prefetch_group (cache, 101);
+  policy_identity_cache_prefetch_netgroup (cache, "foo");
+  policy_identity_cache_prefetch_user (cache, 500);
+  policy_identity_cache_sync (cache);
+
+  /* All were looked up before anybody asked */
+  g_setenv ("MOCK_GROUP", path, TRUE);
+  g_usleep (5000);
+  first = policy_identity_cache_lookup_group (cache, 101);
+  g_assert (first->found);
+  g_assert_cmpuint (first->members->len, ==, 2);
+  members = policy_identity_cache_lookup_netgroup (cache, "foo");
+  g_assert (members->found);
+  policy_members_record_unref (members);
+  user = policy_identity_cache_lookup_user (cache, 500);
+  g_assert_cmpstr (user->name, ==, "john");
+  g_assert (has_gid (user, 100));
+  policy_user_record_unref (user);
+
+  /* Fresh records are left alone */
+  policy_identity_cache_prefetch_group (cache, 101);
+  policy_identity_cache_sync (cache);
+  members = policy_identity_cache_lookup_group (cache, 101);
+  g_assert (members == first);
+  policy_members_record_unref (members);
+  policy_identity_cache_free (cache);
+
+  /* Stale ones are refreshed */
+  cache = policy_identity_cache_new (8, 0, 0, TEST_TTL);
+  members = policy_identity_cache_lookup_group (cache, 100);
+  g_assert_cmpuint (members->members->len, ==, 1);
+  policy_members_record_unref (members);
+
+  g_setenv ("MOCK_GROUP", orig, TRUE);
+  g_usleep (5000);
+  policy_identity_cache_prefetch_group (cache, 100);
+  policy_identity_cache_sync (cache);
+  members = policy_identity_cache_lookup_group (cache, 100);
+  g_assert_cmpuint (members->members->len, ==, 2);
+  policy_members_record_unref (members);
+  policy_identity_cache_sync (cache);
+  policy_identity_cache_free (cache);
+
+  policy_members_record_unref (first);
+  g_unlink (path);
+  g_free (path);
+  g_free (orig);
+}
+
+#define N_CONCURRENT_LOOKUPS 8
+
+static gpointer
+concurrent_lookup_thread_func (gpointer user_data)
+{
+  return policy_identity_cache_lookup_group (user_data, 101);
+}
+
+/* see test/data/etc/group */
+static void
+test_identity_concurrent (void)
+{
+  PolicyIdentityCache *cache = NULL;
+  GThread *threads[N_CONCURRENT_LOOKUPS];
+  PolicyMembersRecord *members[N_CONCURRENT_LOOKUPS];
+
+  cache = policy_identity_cache_new (8, TEST_TTL, TEST_TTL, TEST_TTL);
+  for (guint n = 0; n < N_CONCURRENT_LOOKUPS; n++)
+    {
+      threads[n] = g_thread_new ("lookup", concurrent_lookup_thread_func,
+                                 cache);
+    }
+  for (guint n = 0; n < N_CONCURRENT_LOOKUPS; n++)
+    {
+      members[n] = g_thread_join (threads[n]);
+    }
+
+  /* Only one of them asked NSS, the others got its answer */
+  for (guint n = 0; n < N_CONCURRENT_LOOKUPS; n++)
+    {
+      g_assert (members[n] == members[0]);
+      g_assert_cmpuint (members[n]->members->len, ==, 2);
+      policy_members_record_unref (members[n]);
+    }
+  policy_identity_cache_free (cache);
+}
+
+static gpointer
+concurrent_netgroup_thread_func (gpointer user_data)
+{
+  PolicyNetgroupCache *cache = user_data;
+  gint ret = 0;
+
+  /* Half of them share a key, the rest race on the table around them */
+  ret += policy_netgroup_cache_contains (cache, "foo", "john");
+  ret += !policy_netgroup_cache_contains (cache, "bar", "john");
+  ret += policy_netgroup_cache_contains (cache, "baz", "jane");
+  return GINT_TO_POINTER (ret);
+}
+
+/* see test/data/etc/netgroup */
+static void
+test_netgroup_concurrent (void)
+{
+  PolicyNetgroupCache *cache = NULL;
+  GThread *threads[N_CONCURRENT_LOOKUPS];
+
+  cache = policy_netgroup_cache_new (8, 60 * G_USEC_PER_SEC,
+                                     60 * G_USEC_PER_SEC);
+  for (guint n = 0; n < N_CONCURRENT_LOOKUPS; n++)
+    {
+      threads[n] = g_thread_new ("netgroup", concurrent_netgroup_thread_func,
+                                 cache);
+    }
+  for (guint n = 0; n < N_CONCURRENT_LOOKUPS; n++)
+    {
+      g_assert_cmpint (GPOINTER_TO_INT (g_thread_join (threads[n])), ==, 3);
+    }
+  policy_netgroup_cache_free (cache);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/PolkitBackendPolicyCache/hit_miss", test_hit_miss);
+  g_test_add_func ("/PolkitBackendPolicyCache/lru_eviction",
+                   test_lru_eviction);
+  g_test_add_func ("/PolkitBackendPolicyCache/generation", test_generation);
+  g_test_add_func ("/PolkitBackendPolicyCache/ttl", test_ttl);
+  g_test_add_func ("/PolkitBackendPolicyCache/netgroup", test_netgroup);
+  g_test_add_func ("/PolkitBackendPolicyCache/identity", test_identity);
+  g_test_add_func ("/PolkitBackendPolicyCache/identity_stale",
+                   test_identity_stale);
+  g_test_add_func ("/PolkitBackendPolicyCache/identity_prefetch",
+                   test_identity_prefetch);
+  g_test_add_func ("/PolkitBackendPolicyCache/identity_concurrent",
+                   test_identity_concurrent);
+  g_test_add_func ("/PolkitBackendPolicyCache/netgroup_concurrent",
+                   test_netgroup_concurrent);
+
+  return g_test_run ();
+}
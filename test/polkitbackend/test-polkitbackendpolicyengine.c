@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+#include "glib.h"
+
+#include <locale.h>
+#include <glib/gstdio.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendpolicyengine.h>
+#include <polkittesthelper.h>
+
+/* see test/data/etc/polkit-1/rules.d/10-testing.keyrules and
+ * test/data/usr/share/polkit-1/rules.d/20-testing.keyrules */
+
+#define ACTIONS_FILE "net.company.test.policy"
+
+static const gchar actions_xml[]
+    = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<policyconfig>\n"
+      "  <action id=\"net.company.john_action\">\n"
+      "    <description>John's action</description>\n"
+      "    <message>Authentication is required</message>\n"
+      "    <defaults>\n"
+      "      <allow_any>no</allow_any>\n"
+      "      <allow_inactive>no</allow_inactive>\n"
+      "      <allow_active>auth_admin</allow_active>\n"
+      "    </defaults>\n"
+      "  </action>\n"
+      "  <action id=\"net.company.plain\">\n"
+      "    <description>Plain action</description>\n"
+      "    <message>Authentication is required</message>\n"
+      "    <defaults>\n"
+      "      <allow_any>auth_admin</allow_any>\n"
+      "      <allow_inactive>no</allow_inactive>\n"
+      "      <allow_active>yes</allow_active>\n"
+      "    </defaults>\n"
+      "  </action>\n"
+      "</policyconfig>\n";
+
+typedef struct
+{
+  gchar *actions_dir;
+  gchar *actions_file;
+  PolkitBackendPolicyEngine *engine;
+} Fixture;
+
+static void
+fixture_setup (Fixture *fixture, gconstpointer user_data)
+{
+  gchar *rules_dirs[3] = { NULL };
+
+  fixture->actions_dir = g_dir_make_tmp ("polkit-engine-XXXXXX", NULL);
+  g_assert (fixture->actions_dir != NULL);
+  fixture->actions_file
+      = g_build_filename (fixture->actions_dir, ACTIONS_FILE, NULL);
+  g_assert (g_file_set_contents (fixture->actions_file, actions_xml, -1,
+                                 NULL));
+
+  rules_dirs[0] = polkit_test_get_data_path ("etc/polkit-1/rules.d");
+  rules_dirs[1] = polkit_test_get_data_path ("usr/share/polkit-1/rules.d");
+  g_assert (rules_dirs[0] != NULL && rules_dirs[1] != NULL);
+
+  fixture->engine = polkit_backend_policy_engine_new (
+      (const gchar *const *)rules_dirs, fixture->actions_dir);
+
+  g_free (rules_dirs[0]);
+  g_free (rules_dirs[1]);
+}
+
+static void
+fixture_teardown (Fixture *fixture, gconstpointer user_data)
+{
+  polkit_backend_policy_engine_unref (fixture->engine);
+  g_unlink (fixture->actions_file);
+  g_rmdir (fixture->actions_dir);
+  g_free (fixture->actions_file);
+  g_free (fixture->actions_dir);
+}
+
+static PolkitImplicitAuthorization
+check (Fixture *fixture, gint uid, gboolean is_local, gboolean is_active,
+       const gchar *action_id)
+{
+  PolkitBackendPolicySubject subject = { 0 };
+  PolkitImplicitAuthorization ret;
+  GError *error = NULL;
+
+  subject.user = polkit_unix_user_new (uid);
+  subject.is_local = is_local;
+  subject.is_active = is_active;
+
+  ret = polkit_backend_policy_engine_check (fixture->engine, &subject,
+                                            action_id, NULL, &error);
+  g_assert_no_error (error);
+
+  g_object_unref (subject.user);
+  return ret;
+}
+
+static void
+test_rules (Fixture *fixture, gconstpointer user_data)
+{
+  /* john-action, and its inverse for everybody else */
+  g_assert_cmpint (check (fixture, 500, TRUE, TRUE, "net.company.john_action"),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_assert_cmpint (check (fixture, 501, TRUE, TRUE, "net.company.john_action"),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+
+  /* the same again, now from the cache */
+  g_assert_cmpint (check (fixture, 500, TRUE, TRUE, "net.company.john_action"),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  /* uid 0 is authorized for anything */
+  g_assert_cmpint (check (fixture, 0, TRUE, TRUE, "net.company.john_action"),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+}
+
+static void
+test_defaults (Fixture *fixture, gconstpointer user_data)
+{
+  /* no rule has an opinion on active subjects, so the defaults answer */
+  g_assert_cmpint (check (fixture, 500, TRUE, TRUE, "net.company.plain"), ==,
+                   POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_assert_cmpint (check (fixture, 500, FALSE, TRUE, "net.company.plain"), ==,
+                   POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED);
+
+  /* inactive-denied */
+  g_assert_cmpint (check (fixture, 500, TRUE, FALSE, "net.company.plain"), ==,
+                   POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+}
+
+static void
+assert_not_registered (Fixture *fixture, const gchar *action_id)
+{
+  PolkitBackendPolicySubject subject = { 0 };
+  PolkitImplicitAuthorization ret;
+  GError *error = NULL;
+
+  subject.user = polkit_unix_user_new (500);
+  subject.is_local = TRUE;
+  subject.is_active = TRUE;
+
+  ret = polkit_backend_policy_engine_check (fixture->engine, &subject,
+                                            action_id, NULL, &error);
+  g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED);
+  g_assert_cmpint (ret, ==, POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+
+  g_clear_error (&error);
+  g_object_unref (subject.user);
+}
+
+static void
+test_not_registered (Fixture *fixture, gconstpointer user_data)
+{
+  /* late-exact has a rule for it, but there is no such action */
+  assert_not_registered (fixture, "org.example.late");
+}
+
+static void
+test_reload (Fixture *fixture, gconstpointer user_data)
+{
+  g_assert_cmpint (polkit_backend_policy_engine_get_version (), ==,
+                   POLKIT_BACKEND_POLICY_ENGINE_VERSION);
+  g_assert_cmpint (check (fixture, 500, TRUE, TRUE, "net.company.plain"), ==,
+                   POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  /* actions that go away are gone after a reload */
+  g_assert (g_unlink (fixture->actions_file) == 0);
+  polkit_backend_policy_engine_reload (fixture->engine);
+  assert_not_registered (fixture, "net.company.plain");
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/PolkitBackendPolicyEngine/rules", Fixture, NULL,
+              fixture_setup, test_rules, fixture_teardown);
+  g_test_add ("/PolkitBackendPolicyEngine/defaults", Fixture, NULL,
+              fixture_setup, test_defaults, fixture_teardown);
+  g_test_add ("/PolkitBackendPolicyEngine/not_registered", Fixture, NULL,
+              fixture_setup, test_not_registered, fixture_teardown);
+  g_test_add ("/PolkitBackendPolicyEngine/reload", Fixture, NULL,
+              fixture_setup, test_reload, fixture_teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+
+#include "config.h"
+#include "glib.h"
+
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendpolicyprovider.h>
+#include <polkittesthelper.h>
+
+#define TEST_TIMEOUT (2 * G_USEC_PER_SEC)
+#define TEST_RETRY_DELAY (60 * G_USEC_PER_SEC)
+
+/**
+ * A decision service serving a single connection. Checks of
+ * "org.example.yes" are allowed, "org.example.no" denied and everything else
+ * left to the rules, unless it is silent and never answers at all.
+ */
+typedef struct
+{
+  gchar *dir;
+  gchar *path;
+  gint listen_fd;
+  gboolean silent;
+  gulong reply_delay; /* Microseconds to wait before answering a read */
+  GThread *thread;
+  GMutex lock;
+  gchar *last_request; /* Without the id */
+  guint reads;
+} FakeProvider;
+
+static void
+fake_provider_answer (FakeProvider *fake, gint fd, const gchar *line)
+{
+  gchar **tokens = g_strsplit (line, " ", 0);
+  const gchar *result = "-";
+  gchar *reply;
+
+  g_assert_cmpuint (g_strv_length (tokens), ==, 8);
+  if (g_str_equal (tokens[2], "org.example.yes"))
+    result = "yes";
+  else if (g_str_equal (tokens[2], "org.example.no"))
+    result = "no";
+
+  g_mutex_lock (&fake->lock);
+  g_free (fake->last_request);
+  fake->last_request = g_strdup (strchr (line, ' ') + 1);
+  g_mutex_unlock (&fake->lock);
+
+  reply = g_strdup_printf ("%s %s\n", tokens[0], result);
+  g_assert_cmpint (send (fd, reply, strlen (reply), MSG_NOSIGNAL), ==,
+                   strlen (reply));
+  g_free (reply);
+  g_strfreev (tokens);
+}
+
+static gpointer
+fake_provider_thread_func (gpointer user_data)
+{
+  FakeProvider *fake = user_data;
+  GString *input = g_string_new (NULL);
+  gchar buffer[4096];
+  gssize n;
+  gint fd;
+
+  fd = accept (fake->listen_fd, NULL, NULL);
+  g_assert_cmpint (fd, >=, 0);
+
+  while ((n = recv (fd, buffer, sizeof (buffer), 0)) > 0)
+    {
+      gchar *newline;
+
+      g_mutex_lock (&fake->lock);
+      fake->reads++;
+      g_mutex_unlock (&fake->lock);
+
+      g_string_append_len (input, buffer, n);
+      if (fake->silent)
+        continue;
+
+      g_usleep (fake->reply_delay);
+      while ((newline = strchr (input->str, '\n')))
+        {
+          *newline = '\0';
+          fake_provider_answer (fake, fd, input->str);
+          g_string_erase (input, 0, newline - input->str + 1);
+        }
+    }
+
+  close (fd);
+  g_string_free (input, TRUE);
+  return NULL;
+}
+
+static FakeProvider *
+fake_provider_new (gboolean silent, gulong reply_delay)
+{
+  FakeProvider *fake = g_new0 (FakeProvider, 1);
+  struct sockaddr_un addr = { 0 };
+
+  fake->dir = g_dir_make_tmp ("polkit-provider-XXXXXX", NULL);
+  g_assert (fake->dir != NULL);
+  fake->path = g_build_filename (fake->dir, "socket", NULL);
+  fake->silent = silent;
+  fake->reply_delay = reply_delay;
+  g_mutex_init (&fake->lock);
+
+  addr.sun_family = AF_UNIX;
+  g_assert_cmpuint (strlen (fake->path), <, sizeof (addr.sun_path));
+  strcpy (addr.sun_path, fake->path);
+  fake->listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  g_assert_cmpint (fake->listen_fd, >=, 0);
+  g_assert_cmpint (bind (fake->listen_fd, (struct sockaddr *)&addr,
+                         sizeof (addr)), ==, 0);
+  g_assert_cmpint (listen (fake->listen_fd, 4), ==, 0);
+
+  fake->thread
+      = g_thread_new ("fake provider", fake_provider_thread_func, fake);
+  return fake;
+}
+
+/* The provider must be freed first, its disconnect ends the thread */
+static void
+fake_provider_free (FakeProvider *fake)
+{
+  g_thread_join (fake->thread);
+  close (fake->listen_fd);
+  g_unlink (fake->path);
+  g_rmdir (fake->dir);
+  g_mutex_clear (&fake->lock);
+  g_free (fake->last_request);
+  g_free (fake->path);
+  g_free (fake->dir);
+  g_free (fake);
+}
+
+static PolicyCacheKey
+make_key (uid_t uid, const gchar *action_id)
+{
+  PolicyCacheKey key = {
+    .uid = uid,
+    .action_id = action_id,
+    .subject_is_local = TRUE,
+    .subject_is_active = FALSE,
+  };
+
+  return key;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_answer (void)
+{
+  FakeProvider *fake = fake_provider_new (FALSE, 0);
+  PolicyProvider *provider
+      = policy_provider_new (fake->path, TEST_TIMEOUT, TEST_RETRY_DELAY);
+  PolicyCacheKey key = make_key (1000, "org.example.yes");
+  PolkitImplicitAuthorization result = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  PolicyProviderStats stats = { 0 };
+
+  g_assert_true (policy_provider_query (provider, &key, &result));
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  g_mutex_lock (&fake->lock);
+  g_assert_cmpstr (fake->last_request, ==, "1000 org.example.yes 1 0 - - -");
+  g_mutex_unlock (&fake->lock);
+
+  /* The same connection serves what comes next */
+  key = make_key (1001, "org.example.no");
+  key.seat = g_intern_string ("seat0");
+  key.session_class = g_intern_string ("user");
+  key.session_type = g_intern_string ("x11");
+  g_assert_true (policy_provider_query (provider, &key, &result));
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+
+  g_mutex_lock (&fake->lock);
+  g_assert_cmpstr (fake->last_request, ==,
+                   "1001 org.example.no 1 0 seat0 user x11");
+  g_mutex_unlock (&fake->lock);
+
+  /* Left to the rules, which is still an answer */
+  key = make_key (1000, "org.example.other");
+  g_assert_true (policy_provider_query (provider, &key, &result));
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+
+  policy_provider_get_stats (provider, &stats);
+  g_assert_cmpuint (stats.queries, ==, 3);
+  g_assert_cmpuint (stats.answered, ==, 3);
+  g_assert_cmpuint (stats.timeouts, ==, 0);
+  g_assert_cmpuint (stats.failures, ==, 0);
+
+  policy_provider_free (provider);
+  fake_provider_free (fake);
+}
+
+typedef struct
+{
+  PolicyProvider *provider;
+  guint index;
+} BatchData;
+
+static gpointer
+batch_thread_func (gpointer user_data)
+{
+  BatchData *data = user_data;
+  PolicyCacheKey key = make_key (1000 + data->index,
+                                 data->index % 2 ? "org.example.yes"
+                                                 : "org.example.no");
+  PolkitImplicitAuthorization result = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+
+  g_assert_true (policy_provider_query (data->provider, &key, &result));
+  g_assert_cmpint (result, ==,
+                   data->index % 2
+                       ? POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED
+                       : POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+  return NULL;
+}
+
+static void
+test_batching (void)
+{
+  /* Slow enough to answer that the other queries pile up meanwhile */
+  FakeProvider *fake = fake_provider_new (FALSE, 100 * 1000);
+  PolicyProvider *provider
+      = policy_provider_new (fake->path, TEST_TIMEOUT, TEST_RETRY_DELAY);
+  BatchData data[16];
+  GThread *threads[16];
+  PolicyProviderStats stats = { 0 };
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (threads); n++)
+    {
+      data[n].provider = provider;
+      data[n].index = n;
+      threads[n] = g_thread_new ("query", batch_thread_func, &data[n]);
+    }
+  for (n = 0; n < G_N_ELEMENTS (threads); n++)
+    g_thread_join (threads[n]);
+
+  policy_provider_get_stats (provider, &stats);
+  g_assert_cmpuint (stats.queries, ==, G_N_ELEMENTS (threads));
+  g_assert_cmpuint (stats.answered, ==, G_N_ELEMENTS (threads));
+  g_assert_cmpuint (stats.batches, <, stats.queries);
+
+  policy_provider_free (provider);
+  fake_provider_free (fake);
+}
+
+static void
+test_timeout (void)
+{
+  FakeProvider *fake = fake_provider_new (TRUE, 0);
+  PolicyProvider *provider = policy_provider_new (
+      fake->path, 100 * G_TIME_SPAN_MILLISECOND, TEST_RETRY_DELAY);
+  PolicyCacheKey key = make_key (1000, "org.example.yes");
+  PolkitImplicitAuthorization result = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  PolicyProviderStats stats = { 0 };
+  gint64 start;
+
+  start = g_get_monotonic_time ();
+  g_assert_false (policy_provider_query (provider, &key, &result));
+  g_assert_cmpint (g_get_monotonic_time () - start, >=,
+                   100 * G_TIME_SPAN_MILLISECOND);
+
+  /* Doesn't wait out the timeout again while the provider is down */
+  start = g_get_monotonic_time ();
+  g_assert_false (policy_provider_query (provider, &key, &result));
+  g_assert_cmpint (g_get_monotonic_time () - start, <,
+                   100 * G_TIME_SPAN_MILLISECOND);
+
+  policy_provider_get_stats (provider, &stats);
+  g_assert_cmpuint (stats.queries, ==, 1);
+  g_assert_cmpuint (stats.answered, ==, 0);
+  g_assert_cmpuint (stats.timeouts + stats.failures, ==, 2);
+
+  policy_provider_free (provider);
+  fake_provider_free (fake);
+}
+
+static void
+test_unreachable (void)
+{
+  gchar *dir = g_dir_make_tmp ("polkit-provider-XXXXXX", NULL);
+  gchar *path = g_build_filename (dir, "missing", NULL);
+  PolicyProvider *provider
+      = policy_provider_new (path, TEST_TIMEOUT, TEST_RETRY_DELAY);
+  PolicyCacheKey key = make_key (1000, "org.example.yes");
+  PolkitImplicitAuthorization result = POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN;
+  PolicyProviderStats stats = { 0 };
+  gint64 start;
+
+  /* Failing to connect fails right away, without waiting on the timeout */
+  start = g_get_monotonic_time ();
+  g_assert_false (policy_provider_query (provider, &key, &result));
+  g_assert_false (policy_provider_query (provider, &key, &result));
+  g_assert_cmpint (g_get_monotonic_time () - start, <, TEST_TIMEOUT);
+
+  policy_provider_get_stats (provider, &stats);
+  g_assert_cmpuint (stats.answered, ==, 0);
+  g_assert_cmpuint (stats.failures, ==, 2);
+
+  policy_provider_free (provider);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/PolkitBackendPolicyProvider/answer", test_answer);
+  g_test_add_func ("/PolkitBackendPolicyProvider/batching", test_batching);
+  g_test_add_func ("/PolkitBackendPolicyProvider/timeout", test_timeout);
+  g_test_add_func ("/PolkitBackendPolicyProvider/unreachable",
+                   test_unreachable);
+
+  return g_test_run ();
+}
@@ -0,0 +1,1741 @@
+/*
+ * Copyright (C) 2017 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Ikey Doherty <ikey@solus-project.com>
+ */
+
+#include "config.h"
+#include "glib.h"
+
+#include <glib/gstdio.h>
+#include <grp.h>
+#include <locale.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendpolicybundle.h>
+#include <polkitbackend/polkitbackendpolicyimage.h>
+#include <polkitbackend/polkitbackendpolicyloader.h>
+#include <polkitbackend/polkitbackendpolicyruleset.h>
+#include <polkittesthelper.h>
+
+/* see test/data/etc/polkit-1/rules.d/10-testing.keyrules and
+ * test/data/usr/share/polkit-1/rules.d/20-testing.keyrules */
+
+static PolicyFile *
+load_files (void)
+{
+  const gchar *paths[] = {
+    "etc/polkit-1/rules.d/10-testing.keyrules",
+    "usr/share/polkit-1/rules.d/20-testing.keyrules",
+  };
+  PolicyFile *first = NULL;
+  PolicyFile *last = NULL;
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (paths); n++)
+    {
+      gchar *path;
+      PolicyFile *file;
+      GError *error = NULL;
+
+      path = polkit_test_get_data_path (paths[n]);
+      g_assert (path != NULL);
+      file = policy_file_new_from_path (path, &error);
+      g_assert_no_error (error);
+      g_assert (file != NULL);
+      g_free (path);
+
+      if (last)
+        last->next = file;
+      else
+        first = file;
+      last = file;
+    }
+
+  return first;
+}
+
+typedef struct RulesetTestCase RulesetTestCase;
+
+struct RulesetTestCase
+{
+  const gchar *test_name;
+  const gchar *action_id;
+  const gchar *username;
+  const gchar *groups[3];
+  gboolean subject_is_active;
+  PolkitImplicitAuthorization expected_result;
+};
+
+static const RulesetTestCase ruleset_test_cases[] = {
+  {
+    /* exact match, with john-action shadowing late-exact */
+    "exact_match",
+    "net.company.john_action",
+    "john", { "john", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED,
+  },
+  {
+    /* failed conditions hand back ResultInverse */
+    "exact_inverse",
+    "net.company.john_action",
+    "jane", { "jane", "users", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED,
+  },
+  {
+    /* exact rules with a higher priority beat the wildcard rule */
+    "exact_before_wildcard",
+    "net.company.john_action",
+    "john", { "john", NULL },
+    FALSE,
+    POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED,
+  },
+  {
+    /* action listed twice, with surrounding whitespace */
+    "group_member",
+    "net.company.group.only_group_users",
+    "jane", { "jane", "users", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED,
+  },
+  {
+    "group_non_member",
+    "net.company.group.only_group_users",
+    "sally", { "sally", "admin", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED,
+  },
+  {
+    /* only the wildcard rule has an opinion */
+    "wildcard_inactive",
+    "net.company.unknown_action",
+    "jane", { "jane", NULL },
+    FALSE,
+    POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED,
+  },
+  {
+    /* nothing has an opinion at all */
+    "unmatched",
+    "net.company.unknown_action",
+    "jane", { "jane", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN,
+  },
+  {
+    /* ActionContains= in the first file beats the exact rule in the second */
+    "contains_before_exact",
+    "org.example.late",
+    "sally", { "sally", "admin", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED,
+  },
+  {
+    /* falls through to the second file */
+    "exact_second_file",
+    "org.example.late",
+    "john", { "john", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED,
+  },
+  {
+    /* "she" hides "he" as a suffix, both must be reported */
+    "contains_overlap_first",
+    "org.ushers",
+    "jane", { "jane", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED,
+  },
+  {
+    "contains_overlap_suffix",
+    "org.ushers",
+    "john", { "john", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED_RETAINED,
+  },
+  {
+    "contains_no_overlap",
+    "org.hers",
+    "jane", { "jane", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED_RETAINED,
+  },
+  {
+    /* every pattern is a partial match only */
+    "contains_partial",
+    "org.exampl",
+    "sally", { "sally", "admin", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN,
+  },
+  {
+    /* john is in baz by way of the nested foo netgroup */
+    "netgroup_nested",
+    "net.company.netgroup",
+    "john", { "john", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED,
+  },
+  {
+    "netgroup_non_member",
+    "net.company.netgroup",
+    "sally", { "sally", "admin", NULL },
+    TRUE,
+    POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED,
+  },
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+ruleset_test_func (gconstpointer user_data)
+{
+  const RulesetTestCase *tc = user_data;
+  PolicyRuleset *ruleset = NULL;
+  PolicyFile *legacy = NULL;
+  PolicyContext context = { 0 };
+  PolkitImplicitAuthorization result;
+  guint n;
+
+  ruleset = policy_ruleset_new (load_files ());
+  legacy = load_files ();
+
+  context.subject_is_local = TRUE;
+  context.subject_is_active = tc->subject_is_active;
+  context.username = (gchar *)tc->username;
+  context.gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+  for (n = 0; tc->groups[n] != NULL; n++)
+    {
+      /* see test/data/etc/group */
+      struct group *group = getgrnam (tc->groups[n]);
+      g_assert (group != NULL);
+      g_array_append_val (context.gids, group->gr_gid);
+    }
+
+  result = policy_ruleset_test (ruleset, tc->action_id, &context);
+  g_assert_cmpint (result, ==, tc->expected_result);
+
+  /* The compiled ruleset must always agree with walking the chain */
+  result = policy_file_test (legacy, tc->action_id, &context);
+  g_assert_cmpint (result, ==, tc->expected_result);
+
+  g_array_unref (context.gids);
+  policy_file_free (legacy);
+  policy_ruleset_unref (ruleset);
+}
+
+static void
+add_ruleset_tests (void)
+{
+  guint n;
+  for (n = 0; n < G_N_ELEMENTS (ruleset_test_cases); n++)
+    {
+      const RulesetTestCase *tc = &ruleset_test_cases[n];
+      gchar *s;
+      s = g_strdup_printf ("/PolkitBackendPolicyRuleset/rules_%s", tc->test_name);
+      g_test_add_data_func (s, &ruleset_test_cases[n], ruleset_test_func);
+      g_free (s);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_file_table (void)
+{
+  PolicyFile *file = NULL;
+  const Policy *policy = NULL;
+
+  file = load_files ();
+
+  g_assert_cmpuint (file->rules.n_normal, ==, 4);
+  g_assert_cmpuint (file->rules.n_admin, ==, 1);
+  g_assert (file->next != NULL);
+  g_assert_cmpuint (file->next->rules.n_normal, ==, 4);
+  g_assert_cmpuint (file->next->rules.n_admin, ==, 0);
+
+  /* Strings are stripped once at load time */
+  policy = &file->rules.normal[1];
+  g_assert_cmpstr (policy_file_get_id (file, policy), ==, "group-users");
+  g_assert_cmpuint (policy->actions.n, ==, 2);
+  g_assert_cmpstr (policy_file_get_string (file, policy->actions, 0), ==,
+                   "net.company.group.only_group_users");
+
+  /* Identical strings share the same pool entry */
+  g_assert (policy_file_get_string (file, policy->actions, 0)
+            == policy_file_get_string (file, policy->actions, 1));
+
+  /* The wheel group is substituted up front */
+  policy = &file->rules.admin[0];
+  g_assert_cmpuint (policy->unix_groups.n, ==, 2);
+  g_assert_cmpstr (policy_file_get_string (file, policy->unix_groups, 0), ==,
+                   POLICY_WHEEL_GROUP);
+  g_assert_cmpstr (policy_file_get_string (file, policy->unix_groups, 1), ==,
+                   "admin");
+
+  policy_file_free (file);
+}
+
+static void
+test_file_copy (void)
+{
+  PolicyFile *file = NULL;
+  PolicyFile *copy = NULL;
+  guint n;
+
+  file = load_files ();
+  copy = policy_file_copy (file);
+
+  /* Copies stand alone, with their own storage */
+  g_assert (copy->next == NULL);
+  g_assert (copy->pool != file->pool);
+  g_assert_cmpuint (copy->pool_size, ==, file->pool_size);
+  g_assert (memcmp (copy->pool, file->pool, file->pool_size) == 0);
+  g_assert_cmpuint (copy->n_strings, ==, file->n_strings);
+  g_assert_cmpuint (copy->rules.n_normal, ==, file->rules.n_normal);
+  g_assert_cmpuint (copy->rules.n_admin, ==, file->rules.n_admin);
+
+  for (n = 0; n < file->rules.n_normal; n++)
+    {
+      g_assert_cmpstr (policy_file_get_id (copy, &copy->rules.normal[n]), ==,
+                       policy_file_get_id (file, &file->rules.normal[n]));
+    }
+
+  policy_file_free (file);
+  g_assert_cmpstr (
+      policy_file_get_string (copy, copy->rules.admin[0].unix_groups, 1), ==,
+      "admin");
+  policy_file_free (copy);
+}
+
+static void
+test_image (void)
+{
+  const gchar *paths[] = {
+    "etc/polkit-1/rules.d/10-testing.keyrules",
+    "usr/share/polkit-1/rules.d/20-testing.keyrules",
+  };
+  PolicyImageEntry entries[G_N_ELEMENTS (paths)];
+  PolicyFile *files = NULL;
+  PolicyFile *file = NULL;
+  GArray *image = NULL;
+  GError *error = NULL;
+  gchar *dir = NULL;
+  gchar *path = NULL;
+  gchar *contents = NULL;
+  gsize length = 0;
+  guint n;
+
+  files = load_files ();
+  for (n = 0, file = files; n < G_N_ELEMENTS (paths); n++, file = file->next)
+    {
+      entries[n].path = polkit_test_get_data_path (paths[n]);
+      entries[n].file = file;
+      g_assert (policy_file_stamp_new_from_path (entries[n].path,
+                                                 &entries[n].stamp, &error));
+      g_assert_no_error (error);
+    }
+
+  dir = g_dir_make_tmp ("polkit-image-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (dir, "cache", "keyrules.cache", NULL);
+
+  g_assert (policy_image_write (path, entries, G_N_ELEMENTS (entries),
+                                &error));
+  g_assert_no_error (error);
+
+  image = policy_image_read (path, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (image->len, ==, G_N_ELEMENTS (entries));
+
+  for (n = 0; n < image->len; n++)
+    {
+      const PolicyImageEntry *entry
+          = &g_array_index (image, PolicyImageEntry, n);
+      const PolicyFile *orig = entries[n].file;
+      guint i;
+
+      g_assert_cmpstr (entry->path, ==, entries[n].path);
+      g_assert (memcmp (&entry->stamp, &entries[n].stamp,
+                        sizeof (entry->stamp))
+                == 0);
+      g_assert_cmpuint (entry->file->rules.n_normal, ==, orig->rules.n_normal);
+      g_assert_cmpuint (entry->file->rules.n_admin, ==, orig->rules.n_admin);
+      for (i = 0; i < orig->rules.n_normal; i++)
+        {
+          g_assert_cmpstr (
+              policy_file_get_id (entry->file, &entry->file->rules.normal[i]),
+              ==, policy_file_get_id (orig, &orig->rules.normal[i]));
+        }
+    }
+  g_array_unref (image);
+
+  /* Truncated images are rejected outright */
+  g_assert (g_file_get_contents (path, &contents, &length, &error));
+  g_assert_no_error (error);
+  g_assert (g_file_set_contents (path, contents, length - 1, &error));
+  g_assert_no_error (error);
+  image = policy_image_read (path, &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_assert (image == NULL);
+  g_clear_error (&error);
+
+  /* As is anything that isn't an image */
+  contents[0] = ~contents[0];
+  g_assert (g_file_set_contents (path, contents, length, &error));
+  g_assert_no_error (error);
+  image = policy_image_read (path, &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_assert (image == NULL);
+  g_clear_error (&error);
+
+  g_unlink (path);
+  g_free (path);
+  path = g_build_filename (dir, "cache", NULL);
+  g_rmdir (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+  g_free (contents);
+  for (n = 0; n < G_N_ELEMENTS (entries); n++)
+    {
+      g_free (entries[n].path);
+    }
+  policy_file_free (files);
+}
+
+static void
+test_ruleset_index (void)
+{
+  PolicyRuleset *ruleset = NULL;
+  GArray *list = NULL;
+  GList *identities = NULL;
+
+  ruleset = policy_ruleset_new (load_files ());
+
+  g_assert_cmpuint (ruleset->n_files, ==, 2);
+  g_assert_cmpuint (ruleset->rules->len, ==, 8);
+  g_assert_cmpuint (ruleset->n_pruned, ==, 0);
+
+  /* Duplicated and whitespace padded entries collapse into one */
+  list = g_hash_table_lookup (ruleset->exact,
+                              "net.company.group.only_group_users");
+  g_assert (list != NULL);
+  g_assert_cmpuint (list->len, ==, 1);
+
+  /* Candidates are kept in priority order across files */
+  list = g_hash_table_lookup (ruleset->exact, "net.company.john_action");
+  g_assert (list != NULL);
+  g_assert_cmpuint (list->len, ==, 2);
+  g_assert_cmpuint (g_array_index (list, guint, 0), ==, 0);
+  g_assert_cmpuint (g_array_index (list, guint, 1), ==, 4);
+
+  g_assert_cmpuint (ruleset->wildcard->len, ==, 1);
+
+  /* AdminRules are flattened into identities once, skipping the wheel
+   * group which test/data/etc/group doesn't know about */
+  identities = policy_ruleset_get_admin_identities (ruleset);
+  g_assert_cmpuint (g_list_length (identities), ==, 1);
+  g_assert (identities->data == ruleset->admin_identities->data);
+  g_assert (POLKIT_IS_UNIX_GROUP (identities->data));
+  g_assert_cmpint (polkit_unix_group_get_gid (identities->data), ==, 101);
+  g_list_free_full (identities, g_object_unref);
+
+  g_assert (ruleset->contains != NULL);
+  g_assert (g_hash_table_lookup (ruleset->exact, "*") == NULL);
+
+  policy_ruleset_unref (ruleset);
+
+  /* An empty ruleset simply has no opinion */
+  ruleset = policy_ruleset_new (NULL);
+  g_assert_cmpint (policy_ruleset_test (ruleset, "net.company.john_action", NULL),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  g_assert (policy_ruleset_get_admin_identities (ruleset) == NULL);
+  policy_ruleset_unref (ruleset);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+add_gid (PolicyContext *context, gid_t gid)
+{
+  g_array_append_val (context->gids, gid);
+}
+
+static void
+test_group_atoms (void)
+{
+  GString *contents = g_string_new ("[Policy]\nRules=many-groups;\n\n"
+                                    "[many-groups]\n"
+                                    "Actions=net.company.groups;\n"
+                                    "Result=yes\nResultInverse=no\n"
+                                    "InUnixGroups=users;no-such-group;");
+  PolicyRuleset *ruleset = NULL;
+  PolicyFile *file = NULL;
+  PolicyContext context = { 0 };
+  GError *error = NULL;
+  gchar *path = NULL;
+  gint fd;
+  guint n;
+
+  /* Groups without a name are referenced by gid, and there are enough of
+   * them to fill a single bitset word */
+  for (n = 5000; n < 5124; n += 2)
+    g_string_append_printf (contents, "%u;", n);
+  g_string_append (contents, "\n");
+
+  fd = g_file_open_tmp ("polkit-test-XXXXXX.keyrules", &path, &error);
+  g_assert_no_error (error);
+  close (fd);
+  g_file_set_contents (path, contents->str, -1, &error);
+  g_assert_no_error (error);
+
+  file = policy_file_new_from_path (path, &error);
+  g_assert_no_error (error);
+  ruleset = policy_ruleset_new (file);
+  /* no-such-group doesn't resolve and is dropped */
+  g_assert_cmpuint (g_hash_table_size (ruleset->group_atoms), ==, 63);
+  g_assert_cmpuint (ruleset->n_group_words, ==, 1);
+
+  context.username = "john";
+  context.gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+  add_gid (&context, 500);
+  add_gid (&context, 5121);
+  g_assert_cmpint (policy_ruleset_test (ruleset, "net.company.groups", &context),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+
+  add_gid (&context, 5122);
+  g_assert_cmpint (policy_ruleset_test (ruleset, "net.company.groups", &context),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  /* "users" resolves via NSS, see test/data/etc/group */
+  g_array_set_size (context.gids, 0);
+  add_gid (&context, 100);
+  g_assert_cmpint (policy_ruleset_test (ruleset, "net.company.groups", &context),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  g_array_unref (context.gids);
+  policy_ruleset_unref (ruleset);
+
+  /* And now past the first word */
+  g_string_truncate (contents, contents->len - 1);
+  for (n = 6000; n < 6070; n++)
+    g_string_append_printf (contents, "%u;", n);
+  g_string_append (contents, "\n");
+  g_file_set_contents (path, contents->str, -1, &error);
+  g_assert_no_error (error);
+
+  file = policy_file_new_from_path (path, &error);
+  g_assert_no_error (error);
+  ruleset = policy_ruleset_new (file);
+  g_assert_cmpuint (ruleset->n_group_words, ==, 3);
+
+  context.gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+  add_gid (&context, 6069);
+  g_assert_cmpint (policy_ruleset_test (ruleset, "net.company.groups", &context),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+
+  /* The atoms come from scratch space when there is some, which grows to
+   * fit on reset */
+  context.arena = policy_arena_new (16);
+  g_assert_cmpint (policy_ruleset_test (ruleset, "net.company.groups", &context),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_assert_cmpuint (policy_arena_get_used (context.arena), >=,
+                    3 * sizeof (guint64));
+  policy_arena_reset (context.arena);
+  g_assert_cmpuint (policy_arena_get_used (context.arena), ==, 0);
+  g_assert_cmpint (policy_ruleset_test (ruleset, "net.company.groups", &context),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_clear_pointer (&context.arena, policy_arena_free);
+
+  g_array_unref (context.gids);
+  policy_ruleset_unref (ruleset);
+
+  g_unlink (path);
+  g_free (path);
+  g_string_free (contents, TRUE);
+}
+
+static PolicyFile *
+load_contents (const gchar *contents, GError **error)
+{
+  PolicyFile *file = NULL;
+  gchar *path = NULL;
+  gint fd;
+
+  fd = g_file_open_tmp ("polkit-test-XXXXXX.keyrules", &path, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  g_assert (g_file_set_contents (path, contents, -1, NULL));
+  file = policy_file_new_from_path (path, error);
+  g_unlink (path);
+  g_free (path);
+
+  return file;
+}
+
+static void
+test_prefix_patterns (void)
+{
+  const gchar *invalid[] = {
+    "org.freedesktop.*.mount",
+    "org.freedesktop.udisks2*",
+    ".*",
+    "org.**",
+  };
+  const struct
+  {
+    const gchar *action_id;
+    const gchar *username;
+    PolkitImplicitAuthorization expected_result;
+  } checks[] = {
+    /* the longer prefix comes first and wins */
+    { "org.freedesktop.udisks2.filesystem.mount", "john",
+      POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    /* and falls through to the shorter one */
+    { "org.freedesktop.udisks2.filesystem.mount", "jane",
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED },
+    { "org.freedesktop.udisks2.eject", "jane",
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED },
+    /* a prefix needs something to follow it */
+    { "org.freedesktop.udisks2", "jane",
+      POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED },
+    { "org.freedesktop.udisks2.", "jane",
+      POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED },
+    { "org.", "jane", POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN },
+    { "org", "jane", POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN },
+    /* components match whole, never in part */
+    { "org.freedesktop.udisks2x.eject", "jane",
+      POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED },
+    { "net.company.exact", "jane",
+      POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED },
+    { "net.company.other", "jane", POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN },
+  };
+  PolicyRuleset *ruleset = NULL;
+  PolicyFile *legacy = NULL;
+  PolicyContext context = { 0 };
+  GError *error = NULL;
+  gchar *contents = NULL;
+  gchar *long_id = NULL;
+  guint n;
+
+  contents = g_strdup ("[Policy]\nRules=udisks-mount;udisks;any-org;\n\n"
+                       "[udisks-mount]\n"
+                       "Actions=org.freedesktop.udisks2.filesystem.*;\n"
+                       "InUserNames=john;\nResult=yes\n\n"
+                       "[udisks]\n"
+                       "Actions=org.freedesktop.udisks2.*;"
+                       "org.freedesktop.udisks2.*;\n"
+                       "Result=auth_admin\n\n"
+                       "[any-org]\n"
+                       "Actions=org.*;net.company.exact;\n"
+                       "Result=no\n");
+  ruleset = policy_ruleset_new (load_contents (contents, &error));
+  g_assert_no_error (error);
+  legacy = load_contents (contents, &error);
+  g_assert_no_error (error);
+
+  /* Prefix patterns never end up in the exact index */
+  g_assert (ruleset->prefixes != NULL);
+  g_assert_cmpuint (g_hash_table_size (ruleset->exact), ==, 1);
+  g_assert_cmpuint (ruleset->wildcard->len, ==, 0);
+
+  for (n = 0; n < G_N_ELEMENTS (checks); n++)
+    {
+      context.username = (gchar *)checks[n].username;
+      g_assert_cmpint (
+          policy_ruleset_test (ruleset, checks[n].action_id, &context), ==,
+          checks[n].expected_result);
+      g_assert_cmpint (policy_file_test (legacy, checks[n].action_id, &context),
+                       ==, checks[n].expected_result);
+    }
+
+  /* Action IDs too long to split on the stack */
+  long_id = g_strdup_printf ("org.freedesktop.udisks2.%0300d", 0);
+  context.username = "jane";
+  g_assert_cmpint (
+      policy_ruleset_test (ruleset, long_id, &context), ==,
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED);
+  g_free (long_id);
+
+  policy_file_free (legacy);
+  policy_ruleset_unref (ruleset);
+  g_free (contents);
+
+  /* A '*' anywhere else is rejected */
+  for (n = 0; n < G_N_ELEMENTS (invalid); n++)
+    {
+      contents = g_strdup_printf ("[Policy]\nRules=bad;\n\n"
+                                  "[bad]\nActions=%s;\nResult=yes\n",
+                                  invalid[n]);
+      g_test_expect_message ("polkitd-1", G_LOG_LEVEL_WARNING,
+                             "*Invalid action pattern*");
+      g_assert (load_contents (contents, &error) == NULL);
+      g_test_assert_expected_messages ();
+      g_assert_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE);
+      g_clear_error (&error);
+      g_free (contents);
+    }
+}
+
+/**
+ * An invalid ResultInverse= fails the file just like an invalid Result=.
+ * Before, only Result= was checked, so both of these used to load.
+ */
+static void
+test_invalid_results (void)
+{
+  const struct
+  {
+    const gchar *contents;
+    const gchar *message;
+  } invalid[] = {
+    { "[Policy]\nRules=bad;\n\n"
+      "[bad]\nActions=org.example.test;\nResult=maybe\n",
+      "*Invalid 'Result': 'maybe'*" },
+    { "[Policy]\nRules=bad;\n\n"
+      "[bad]\nActions=org.example.test;\nResult=yes\nResultInverse=maybe\n",
+      "*Invalid 'ResultInverse': 'maybe'*" },
+    { "[Policy]\nRules=bad;\n\n"
+      "[bad]\nActions=org.example.test;\nResultInverse=maybe\n",
+      "*Invalid 'ResultInverse': 'maybe'*" },
+  };
+  PolicyFile *file = NULL;
+  GError *error = NULL;
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (invalid); n++)
+    {
+      g_test_expect_message ("polkitd-1", G_LOG_LEVEL_WARNING,
+                             invalid[n].message);
+      g_assert (load_contents (invalid[n].contents, &error) == NULL);
+      g_test_assert_expected_messages ();
+      g_assert_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE);
+      g_clear_error (&error);
+    }
+
+  /* Valid values on either key still load */
+  file = load_contents ("[Policy]\nRules=good;\n\n"
+                        "[good]\nActions=org.example.test;\nResult=yes\n"
+                        "ResultInverse=auth_admin\n",
+                        &error);
+  g_assert_no_error (error);
+  g_assert (file != NULL);
+  policy_file_free (file);
+}
+
+static void
+test_pruned (void)
+{
+  const struct
+  {
+    const gchar *id;
+    PolicyRuleStatus status;
+    guint shadowed_by;
+  } expected[] = {
+    { "udisks", POLICY_RULE_LIVE, G_MAXUINT },
+    { "udisks-eject", POLICY_RULE_SHADOWED, 0 },
+    { "udisks-mount", POLICY_RULE_LIVE, G_MAXUINT },
+    { "inactive", POLICY_RULE_LIVE, G_MAXUINT },
+    { "after-inactive", POLICY_RULE_LIVE, G_MAXUINT },
+    { "no-result", POLICY_RULE_INERT, G_MAXUINT },
+    { "inverse-only", POLICY_RULE_INERT, G_MAXUINT },
+    { "no-actions", POLICY_RULE_INERT, G_MAXUINT },
+    { "contains-broad", POLICY_RULE_LIVE, G_MAXUINT },
+    { "contains-narrow", POLICY_RULE_SHADOWED, 8 },
+    { "exact-after-contains", POLICY_RULE_SHADOWED, 8 },
+  };
+  const struct
+  {
+    const gchar *action_id;
+    const gchar *username;
+    PolkitImplicitAuthorization expected_result;
+  } checks[] = {
+    { "org.freedesktop.udisks2.eject", "john",
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED },
+    { "org.example.mount", "john", POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    /* SubjectActive= never falls back on ResultInverse=, so the next rule
+     * is still reachable */
+    { "net.company.inactive", "john",
+      POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    { "net.company.z.exact", "john", POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    { "net.company.z.exact", "jane",
+      POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED },
+  };
+  PolicyRuleset *ruleset = NULL;
+  PolicyFile *legacy = NULL;
+  PolicyContext context = { 0 };
+  GError *error = NULL;
+  const gchar *contents = NULL;
+  guint n;
+
+  contents = "[Policy]\n"
+             "Rules=udisks;udisks-eject;udisks-mount;inactive;after-inactive;"
+             "no-result;inverse-only;no-actions;contains-broad;"
+             "contains-narrow;exact-after-contains;\n\n"
+             "[udisks]\nActions=org.freedesktop.udisks2.*;\n"
+             "Result=auth_admin\n\n"
+             "[udisks-eject]\nActions=org.freedesktop.udisks2.eject;\n"
+             "InUserNames=john;\nResult=yes\n\n"
+             "[udisks-mount]\n"
+             "Actions=org.freedesktop.udisks2.filesystem.*;org.example.mount;\n"
+             "Result=yes\n\n"
+             "[inactive]\nActions=net.company.inactive;\n"
+             "SubjectActive=false\nResult=no\nResultInverse=no\n\n"
+             "[after-inactive]\nActions=net.company.inactive;\n"
+             "Result=yes\n\n"
+             "[no-result]\nActions=net.company.x;\nInUserNames=john;\n\n"
+             "[inverse-only]\nActions=net.company.y;\nResultInverse=no\n\n"
+             "[no-actions]\nInUserNames=john;\nResult=yes\n\n"
+             "[contains-broad]\nActionContains=.company.;\n"
+             "InUserNames=jane;\nResult=no\nResultInverse=yes\n\n"
+             "[contains-narrow]\nActionContains=net.company.z;\n"
+             "Result=auth_self\n\n"
+             "[exact-after-contains]\nActions=net.company.z.exact;\n"
+             "Result=auth_self\n";
+  ruleset = policy_ruleset_new (load_contents (contents, &error));
+  g_assert_no_error (error);
+  legacy = load_contents (contents, &error);
+  g_assert_no_error (error);
+
+  g_assert_cmpuint (ruleset->rules->len, ==, G_N_ELEMENTS (expected));
+  g_assert_cmpuint (ruleset->n_pruned, ==, 6);
+  for (n = 0; n < G_N_ELEMENTS (expected); n++)
+    {
+      const PolicyRulesetEntry *entry
+          = &g_array_index (ruleset->rules, PolicyRulesetEntry, n);
+
+      g_assert_cmpstr (policy_file_get_id (entry->file, entry->policy), ==,
+                       expected[n].id);
+      g_assert_cmpint (entry->status, ==, expected[n].status);
+      if (expected[n].status == POLICY_RULE_SHADOWED)
+        g_assert_cmpuint (entry->shadowed_by, ==, expected[n].shadowed_by);
+    }
+
+  /* Pruned rules are left out of the index */
+  g_assert (g_hash_table_lookup (ruleset->exact,
+                                 "org.freedesktop.udisks2.eject") == NULL);
+  g_assert (g_hash_table_lookup (ruleset->exact, "net.company.x") == NULL);
+  g_assert (g_hash_table_lookup (ruleset->exact, "net.company.inactive")
+            != NULL);
+
+  /* and doing so doesn't change a single answer */
+  context.subject_is_active = TRUE;
+  for (n = 0; n < G_N_ELEMENTS (checks); n++)
+    {
+      context.username = (gchar *)checks[n].username;
+      g_assert_cmpint (
+          policy_ruleset_test (ruleset, checks[n].action_id, &context), ==,
+          checks[n].expected_result);
+      g_assert_cmpint (policy_file_test (legacy, checks[n].action_id, &context),
+                       ==, checks[n].expected_result);
+    }
+
+  policy_file_free (legacy);
+  policy_ruleset_unref (ruleset);
+}
+
+static void
+test_static_decisions (void)
+{
+  PolicyRuleset *ruleset = NULL;
+  PolicyRulesetTrace trace = { 0 };
+  PolicyContext context = { 0 };
+  PolkitImplicitAuthorization result;
+  GError *error = NULL;
+
+  ruleset = policy_ruleset_new (load_contents (
+      "[Policy]\nRules=john;plain;late;\n\n"
+      "[john]\nActions=net.static.c;\nInUserNames=john;\nResult=no\n\n"
+      "[plain]\nActions=net.static.a;net.static.b;\nResult=yes\n\n"
+      "[late]\nActions=net.static.*;net.static.d;net.static.c;\n"
+      "Result=auth_admin\n",
+      &error));
+  g_assert_no_error (error);
+
+  /* net.static.c depends on the subject, the others don't */
+  g_assert_cmpuint (g_hash_table_size (ruleset->decisions), ==, 3);
+  g_assert (policy_ruleset_test_static (ruleset, "net.static.a", &trace,
+                                        &result));
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_assert_cmpuint (trace.n_tested, ==, 1);
+  g_assert_cmpstr (policy_file_get_id (trace.matched->file,
+                                       trace.matched->policy),
+                   ==, "plain");
+  g_assert_cmpuint (ruleset->stats[1].decided, ==, 1);
+
+  g_assert (policy_ruleset_test_static (ruleset, "net.static.d", NULL,
+                                        &result));
+  g_assert_cmpint (
+      result, ==,
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED);
+  g_assert (!policy_ruleset_test_static (ruleset, "net.static.c", NULL,
+                                         &result));
+  /* only action IDs named in Actions= are folded */
+  g_assert (!policy_ruleset_test_static (ruleset, "net.static.other", NULL,
+                                         &result));
+
+  /* The full test takes the same shortcut, and falls back on the rules */
+  g_assert_cmpint (policy_ruleset_test (ruleset, "net.static.b", NULL), ==,
+                   POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  context.username = "john";
+  g_assert_cmpint (policy_ruleset_test (ruleset, "net.static.c", &context),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+  context.username = "jane";
+  g_assert_cmpint (
+      policy_ruleset_test (ruleset, "net.static.c", &context), ==,
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED);
+  g_assert_cmpint (
+      policy_ruleset_test (ruleset, "net.static.other", &context), ==,
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED);
+
+  policy_ruleset_unref (ruleset);
+}
+
+static void
+test_details (void)
+{
+  const struct
+  {
+    const gchar *unit;
+    PolkitImplicitAuthorization expected_result;
+  } checks[] = {
+    { "a.service", POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    { "b.service", POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    { "user@1000.service", POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    { "c.service", POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED },
+    { "a.service.d", POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED },
+    { NULL, POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED },
+  };
+  const gchar *contents
+      = "[Policy]\nRules=units;\n\n"
+        "[units]\nActions=org.freedesktop.systemd1.manage-units;\n"
+        "DetailKey=unit\nInDetailValues=a.service;b.service;user@*;\n"
+        "Result=yes\nResultInverse=no\n";
+  PolicyRuleset *ruleset = NULL;
+  PolicyFile *legacy = NULL;
+  PolicyRulesetTrace trace = { 0 };
+  PolicyContext context = { 0 };
+  PolkitImplicitAuthorization result;
+  GError *error = NULL;
+  guint n;
+
+  ruleset = policy_ruleset_new (load_contents (contents, &error));
+  g_assert_no_error (error);
+  legacy = load_contents (contents, &error);
+  g_assert_no_error (error);
+
+  /* Depending on the details, the answer can't be folded */
+  g_assert (!policy_ruleset_test_static (
+      ruleset, "org.freedesktop.systemd1.manage-units", NULL, &result));
+
+  for (n = 0; n < G_N_ELEMENTS (checks); n++)
+    {
+      PolkitDetails *details = polkit_details_new ();
+
+      if (checks[n].unit)
+        {
+          polkit_details_insert (details, "unit", checks[n].unit);
+        }
+      context.details = details;
+      g_assert_cmpint (policy_ruleset_test_full (
+                           ruleset, "org.freedesktop.systemd1.manage-units",
+                           &context, &trace),
+                       ==, checks[n].expected_result);
+      g_assert (trace.used_details);
+      g_assert_cmpint (
+          policy_file_test (legacy, "org.freedesktop.systemd1.manage-units",
+                            &context),
+          ==, checks[n].expected_result);
+      g_object_unref (details);
+    }
+
+  /* Checks without any details at all never match either */
+  context.details = NULL;
+  g_assert_cmpint (
+      policy_ruleset_test (ruleset, "org.freedesktop.systemd1.manage-units",
+                           &context),
+      ==, POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+
+  policy_file_free (legacy);
+  policy_ruleset_unref (ruleset);
+
+  /* Both keys are needed */
+  g_test_expect_message ("polkitd-1", G_LOG_LEVEL_WARNING, "*DetailKey*");
+  g_assert (load_contents ("[Policy]\nRules=bad;\n\n"
+                           "[bad]\nActions=org.example.a;\n"
+                           "DetailKey=unit\nResult=yes\n",
+                           &error)
+            == NULL);
+  g_test_assert_expected_messages ();
+  g_assert_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND);
+  g_clear_error (&error);
+}
+
+static void
+test_session_state (void)
+{
+  const struct
+  {
+    const gchar *seat;
+    const gchar *session_class;
+    const gchar *session_type;
+    PolkitImplicitAuthorization expected_result;
+  } checks[] = {
+    { "seat0", "user", "wayland", POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    { "seat0", "user", "x11", POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    /* the greeter rule comes later, and any type will do */
+    { "seat0", "greeter", "x11",
+      POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED },
+    { "seat0", "user", "tty",
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED },
+    { "seat1", "user", "wayland",
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED },
+    /* remote sessions are on no seat */
+    { NULL, "user", "tty",
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED },
+    { NULL, NULL, NULL,
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED },
+  };
+  const gchar *contents
+      = "[Policy]\nRules=graphical;greeter;other;\n\n"
+        "[graphical]\nActions=org.freedesktop.login1.reboot;\n"
+        "InSeats=seat0;\nSessionClass=user;\nSessionType=x11;wayland;\n"
+        "Result=yes\n\n"
+        "[greeter]\nActions=org.freedesktop.login1.reboot;\n"
+        "InSeats=seat0;\nSessionClass=greeter;\nResult=auth_self\n\n"
+        "[other]\nActions=org.freedesktop.login1.reboot;\n"
+        "Result=auth_admin\n";
+  PolicyRuleset *ruleset = NULL;
+  PolicyFile *legacy = NULL;
+  PolicyContext context = { 0 };
+  PolkitImplicitAuthorization result;
+  GError *error = NULL;
+  guint n;
+
+  ruleset = policy_ruleset_new (load_contents (contents, &error));
+  g_assert_no_error (error);
+  legacy = load_contents (contents, &error);
+  g_assert_no_error (error);
+
+  g_assert (!policy_ruleset_test_static (
+      ruleset, "org.freedesktop.login1.reboot", NULL, &result));
+
+  for (n = 0; n < G_N_ELEMENTS (checks); n++)
+    {
+      context.seat = checks[n].seat;
+      context.session_class = checks[n].session_class;
+      context.session_type = checks[n].session_type;
+      g_assert_cmpint (policy_ruleset_test (
+                           ruleset, "org.freedesktop.login1.reboot", &context),
+                       ==, checks[n].expected_result);
+      g_assert_cmpint (
+          policy_file_test (legacy, "org.freedesktop.login1.reboot", &context),
+          ==, checks[n].expected_result);
+    }
+
+  policy_file_free (legacy);
+  policy_ruleset_unref (ruleset);
+}
+
+static void
+test_lists (void)
+{
+  const struct
+  {
+    const gchar *action_id;
+    const gchar *username;
+    PolkitImplicitAuthorization expected_result;
+  } checks[] = {
+    { "org.freedesktop.udisks2.filesystem-mount", "john",
+      POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED },
+    { "org.freedesktop.udisks2.encrypted-unlock", "jane",
+      POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED },
+    { "org.example.other", "bob",
+      POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED },
+    { "org.example.other", "john", POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN },
+  };
+  PolicyFile *file = NULL;
+  PolicyRuleset *ruleset = NULL;
+  PolicyContext context = { 0 };
+  const Policy *rules = NULL;
+  GError *error = NULL;
+  gchar *fragment = NULL;
+  gchar *basename = NULL;
+  gchar *contents = NULL;
+  gint fd;
+  guint n;
+
+  fd = g_file_open_tmp ("polkit-test-XXXXXX.keylist", &fragment, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  g_assert (g_file_set_contents (
+      fragment,
+      "[List admins]\nValues=john;%sudo%;\n\n"
+      "[List mounts]\nValues=org.freedesktop.udisks2.filesystem-mount;"
+      "org.freedesktop.udisks2.encrypted-unlock;\n",
+      -1, NULL));
+
+  /* Included relative to the rules file, both live in the same directory */
+  basename = g_path_get_basename (fragment);
+  contents = g_strdup_printf (
+      "[Policy]\nInclude=%s;\nRules=admins;users;mixed;groups;\n\n"
+      "[List users]\nValues=jane;\n\n"
+      "[admins]\nActions=@mounts;\nInUserNames=@admins;\nResult=yes\n\n"
+      "[users]\nActions=@mounts;\nInUserNames=@users;\n"
+      "Result=auth_admin\n\n"
+      "[mixed]\nActions=@mounts;org.example.other;\n"
+      "InUserNames=@users;bob;\nResult=no\n\n"
+      "[groups]\nActions=@mounts;\nInUnixGroups=@admins;\nResult=yes\n",
+      basename);
+  file = load_contents (contents, &error);
+  g_assert_no_error (error);
+  g_assert (file->has_includes);
+
+  /* Rules naming a lone list share its strings */
+  rules = file->rules.normal;
+  g_assert_cmpuint (file->rules.n_normal, ==, 4);
+  g_assert_cmpuint (rules[0].actions.start, ==, rules[1].actions.start);
+  g_assert_cmpuint (rules[0].actions.n, ==, 2);
+  g_assert_cmpuint (rules[3].actions.start, ==, rules[0].actions.start);
+  g_assert_cmpuint (rules[2].actions.n, ==, 3);
+  g_assert_cmpuint (rules[2].unix_names.n, ==, 2);
+  g_assert_cmpstr (policy_file_get_string (file, rules[2].unix_names, 1), ==,
+                   "bob");
+  /* though groups get the wheel substituted, unlike names */
+  g_assert_cmpuint (rules[3].unix_groups.start, !=, rules[0].unix_names.start);
+  g_assert_cmpstr (policy_file_get_string (file, rules[0].unix_names, 1), ==,
+                   POLICY_MATCH_WHEEL);
+  g_assert_cmpstr (policy_file_get_string (file, rules[3].unix_groups, 1), ==,
+                   POLICY_WHEEL_GROUP);
+
+  ruleset = policy_ruleset_new (policy_file_copy (file));
+  for (n = 0; n < G_N_ELEMENTS (checks); n++)
+    {
+      context.username = (gchar *)checks[n].username;
+      g_assert_cmpint (
+          policy_ruleset_test (ruleset, checks[n].action_id, &context), ==,
+          checks[n].expected_result);
+      g_assert_cmpint (policy_file_test (file, checks[n].action_id, &context),
+                       ==, checks[n].expected_result);
+    }
+  policy_ruleset_unref (ruleset);
+  policy_file_free (file);
+  g_free (contents);
+
+  /* Every list named has to exist */
+  g_test_expect_message ("polkitd-1", G_LOG_LEVEL_WARNING, "*Unknown list*");
+  g_assert (load_contents ("[Policy]\nRules=bad;\n\n"
+                           "[bad]\nActions=@nope;\nResult=yes\n",
+                           &error)
+            == NULL);
+  g_test_assert_expected_messages ();
+  g_assert_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE);
+  g_clear_error (&error);
+
+  /* Lists are flat */
+  g_assert (load_contents ("[Policy]\nRules=any;\n\n"
+                           "[List a]\nValues=@b;\n\n[List b]\nValues=x;\n\n"
+                           "[any]\nActions=@a;\nResult=yes\n",
+                           &error)
+            == NULL);
+  g_assert_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE);
+  g_clear_error (&error);
+
+  /* and a missing fragment fails the whole file */
+  g_unlink (fragment);
+  contents = g_strdup_printf ("[Policy]\nInclude=%s;\nRules=any;\n\n"
+                              "[any]\nActions=@mounts;\nResult=yes\n",
+                              fragment);
+  g_assert (load_contents (contents, &error) == NULL);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+  g_clear_error (&error);
+
+  g_free (contents);
+  g_free (basename);
+  g_free (fragment);
+}
+
+static guint lazy_resolved[3];
+
+static void
+lazy_resolve (PolicyContext *context, PolicyContextFact fact)
+{
+  gid_t gid = 100; /* users */
+
+  switch (fact)
+    {
+    case POLICY_CONTEXT_USERNAME:
+      lazy_resolved[0]++;
+      context->username = g_strdup ("jane");
+      break;
+
+    case POLICY_CONTEXT_GIDS:
+      lazy_resolved[1]++;
+      g_assert_cmpstr (policy_context_get_username (context), ==, "jane");
+      context->gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+      g_array_append_val (context->gids, gid);
+      break;
+
+    default:
+      lazy_resolved[2]++;
+      break;
+    }
+}
+
+static void
+test_lazy_context (void)
+{
+  PolicyRuleset *ruleset = NULL;
+  PolicyContext context = { 0 };
+
+  ruleset = policy_ruleset_new (load_files ());
+  context.subject_is_local = TRUE;
+  context.subject_is_active = TRUE;
+  context.resolve = lazy_resolve;
+
+  /* Unconditional rules need no facts about the subject at all */
+  g_assert_cmpint (policy_ruleset_test (ruleset, "org.hers", &context), ==,
+                   POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED_RETAINED);
+  g_assert_cmpuint (lazy_resolved[0], ==, 0);
+  g_assert_cmpuint (lazy_resolved[1], ==, 0);
+
+  /* Username only, once */
+  g_assert_cmpint (
+      policy_ruleset_test (ruleset, "net.company.john_action", &context), ==,
+      POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+  g_assert_cmpint (
+      policy_ruleset_test (ruleset, "net.company.john_action", &context), ==,
+      POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+  g_assert_cmpuint (lazy_resolved[0], ==, 1);
+  g_assert_cmpuint (lazy_resolved[1], ==, 0);
+
+  /* Groups build on the username without resolving it again */
+  g_assert_cmpint (policy_ruleset_test (ruleset,
+                                        "net.company.group.only_group_users",
+                                        &context),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_assert_cmpuint (lazy_resolved[0], ==, 1);
+  g_assert_cmpuint (lazy_resolved[1], ==, 1);
+  g_assert_cmpuint (lazy_resolved[2], ==, 0);
+
+  g_free (context.username);
+  g_array_unref (context.gids);
+  policy_ruleset_unref (ruleset);
+}
+
+static void
+test_trace (void)
+{
+  PolicyRuleset *ruleset = NULL;
+  PolicyContext context = { 0 };
+  PolicyRulesetTrace trace = { 0 };
+
+  ruleset = policy_ruleset_new (load_files ());
+  context.subject_is_local = TRUE;
+  context.subject_is_active = TRUE;
+  context.username = "jane";
+  context.gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+  add_gid (&context, 100);
+
+  /* Candidates are visited in priority order until one has an opinion */
+  g_assert_cmpint (policy_ruleset_test_full (ruleset, "org.she.thing",
+                                             &context, &trace),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHENTICATION_REQUIRED);
+  g_assert_cmpuint (trace.n_tested, ==, 2);
+  g_assert (trace.matched != NULL);
+  g_assert_cmpstr (
+      policy_file_get_id (trace.matched->file, trace.matched->policy), ==,
+      "contains-she");
+
+  /* ResultInverse= is an opinion too */
+  g_assert_cmpint (policy_ruleset_test_full (ruleset,
+                                             "net.company.john_action",
+                                             &context, &trace),
+                   ==, POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+  g_assert_cmpuint (trace.n_tested, ==, 1);
+  g_assert_cmpstr (
+      policy_file_get_id (trace.matched->file, trace.matched->policy), ==,
+      "john-action");
+
+  /* Only the wildcard rule is a candidate, and it has no opinion */
+  g_assert_cmpint (
+      policy_ruleset_test_full (ruleset, "org.nobody", &context, &trace), ==,
+      POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  g_assert_cmpuint (trace.n_tested, ==, 1);
+  g_assert (trace.matched == NULL);
+
+  g_array_unref (context.gids);
+  policy_ruleset_unref (ruleset);
+}
+
+static void
+test_rule_stats (void)
+{
+  PolicyRuleset *ruleset = NULL;
+  PolicyContext context = { 0 };
+  const PolicyRulesetEntry *entry = NULL;
+
+  ruleset = policy_ruleset_new (load_files ());
+  context.subject_is_local = TRUE;
+  context.subject_is_active = TRUE;
+  context.username = "jane";
+  context.gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+  add_gid (&context, 100);
+
+  /* Rules keep the file they came from, so counters can be attributed */
+  entry = &g_array_index (ruleset->rules, PolicyRulesetEntry, 0);
+  g_assert (g_str_has_suffix (entry->file->path, "/10-testing.keyrules"));
+  g_assert_cmpstr (policy_file_get_id (entry->file, entry->policy), ==,
+                   "john-action");
+
+  /* inactive-denied is tested but doesn't match before contains-she */
+  policy_ruleset_test (ruleset, "org.she.thing", &context);
+  g_assert_cmpuint (ruleset->stats[2].evaluated, ==, 1);
+  g_assert_cmpuint (ruleset->stats[2].matched, ==, 0);
+  g_assert_cmpuint (ruleset->stats[2].decided, ==, 0);
+  g_assert_cmpuint (ruleset->stats[5].evaluated, ==, 1);
+  g_assert_cmpuint (ruleset->stats[5].matched, ==, 1);
+  g_assert_cmpuint (ruleset->stats[5].decided, ==, 1);
+  g_assert_cmpuint (ruleset->stats[6].evaluated, ==, 0);
+
+  /* jane isn't john, so john-action answers with its ResultInverse= */
+  policy_ruleset_test (ruleset, "net.company.john_action", &context);
+  policy_ruleset_test (ruleset, "net.company.john_action", &context);
+  g_assert_cmpuint (ruleset->stats[0].evaluated, ==, 2);
+  g_assert_cmpuint (ruleset->stats[0].matched, ==, 0);
+  g_assert_cmpuint (ruleset->stats[0].decided, ==, 0);
+  g_assert_cmpuint (ruleset->stats[0].inverse_decided, ==, 2);
+
+  g_array_unref (context.gids);
+  policy_ruleset_unref (ruleset);
+}
+
+/* Builds a ruleset of the files in @dir, written with @contents first */
+static PolicyRuleset *
+load_ruleset_in (const gchar *dir, const gchar *const *names,
+                 const gchar *const *contents)
+{
+  PolicyFile *first = NULL;
+  PolicyFile *last = NULL;
+
+  for (guint n = 0; names[n]; n++)
+    {
+      gchar *path = g_build_filename (dir, names[n], NULL);
+      PolicyFile *file = NULL;
+      GError *error = NULL;
+
+      g_assert (g_file_set_contents (path, contents[n], -1, NULL));
+      file = policy_file_new_from_path (path, &error);
+      g_assert_no_error (error);
+      g_unlink (path);
+      g_free (path);
+
+      if (last)
+        last->next = file;
+      else
+        first = file;
+      last = file;
+    }
+
+  return policy_ruleset_new (first);
+}
+
+static void
+test_diff_actions (void)
+{
+  const gchar *names[] = { "10-a.keyrules", "20-b.keyrules", NULL };
+  const gchar *first[] = {
+    "[Policy]\nRules=a;\n\n[a]\nActions=net.diff.a;\nResult=yes\n",
+    "[Policy]\nRules=b;\n\n[b]\nActions=net.diff.b;\nResult=no\n",
+  };
+  const gchar *changed[] = {
+    first[0],
+    "[Policy]\nRules=b;\n\n[b]\nActions=net.diff.c;\nResult=no\n",
+  };
+  const gchar *wildcard[] = {
+    first[0],
+    "[Policy]\nRules=b;\n\n[b]\nActions=net.diff.*;\nResult=no\n",
+  };
+  const gchar *admin[] = {
+    first[0],
+    "[Policy]\nRules=b;\nAdminRules=admin;\n\n"
+    "[b]\nActions=net.diff.b;\nResult=no\n\n"
+    "[admin]\nInUnixGroups=admin;\n",
+  };
+  gchar *dir = g_dir_make_tmp ("polkit-diff-XXXXXX", NULL);
+  PolicyRuleset *old_ruleset = NULL;
+  PolicyRuleset *new_ruleset = NULL;
+  gchar **actions = NULL;
+
+  old_ruleset = load_ruleset_in (dir, names, first);
+
+  /* Nothing changed, nothing to tell */
+  new_ruleset = load_ruleset_in (dir, names, first);
+  actions = policy_ruleset_diff_actions (old_ruleset, new_ruleset);
+  g_assert (actions != NULL);
+  g_assert_cmpuint (g_strv_length (actions), ==, 0);
+  g_strfreev (actions);
+  policy_ruleset_unref (new_ruleset);
+
+  /* Rules of the changed file, before and after, the other file is left */
+  new_ruleset = load_ruleset_in (dir, names, changed);
+  actions = policy_ruleset_diff_actions (old_ruleset, new_ruleset);
+  g_assert (actions != NULL);
+  g_assert_cmpuint (g_strv_length (actions), ==, 2);
+  g_assert_cmpstr (actions[0], ==, "net.diff.b");
+  g_assert_cmpstr (actions[1], ==, "net.diff.c");
+  g_strfreev (actions);
+  policy_ruleset_unref (new_ruleset);
+
+  /* A removed file is the same as a changed one */
+  new_ruleset = load_ruleset_in (dir, names + 1, first + 1);
+  actions = policy_ruleset_diff_actions (old_ruleset, new_ruleset);
+  g_assert (actions != NULL);
+  g_assert_cmpuint (g_strv_length (actions), ==, 1);
+  g_assert_cmpstr (actions[0], ==, "net.diff.a");
+  g_strfreev (actions);
+  policy_ruleset_unref (new_ruleset);
+
+  /* Patterns and administrator rules can concern any action */
+  new_ruleset = load_ruleset_in (dir, names, wildcard);
+  g_assert (policy_ruleset_diff_actions (old_ruleset, new_ruleset) == NULL);
+  policy_ruleset_unref (new_ruleset);
+  new_ruleset = load_ruleset_in (dir, names, admin);
+  g_assert (policy_ruleset_diff_actions (old_ruleset, new_ruleset) == NULL);
+  policy_ruleset_unref (new_ruleset);
+
+  policy_ruleset_unref (old_ruleset);
+  g_rmdir (dir);
+  g_free (dir);
+}
+
+static void
+test_memory_usage (void)
+{
+  PolicyRuleset *ruleset = NULL;
+  guint64 bytes = 0;
+  guint64 objects = 0;
+  gsize file_sizes = 0;
+
+  ruleset = policy_ruleset_new (load_files ());
+  for (const PolicyFile *file = ruleset->files; file; file = file->next)
+    {
+      g_assert_cmpuint (policy_file_get_memory_size (file), >=,
+                        file->pool_size);
+      file_sizes += policy_file_get_memory_size (file);
+    }
+
+  /* Every file and compiled rule, and more than the files alone */
+  policy_ruleset_get_memory_usage (ruleset, &bytes, &objects);
+  g_assert_cmpuint (objects, ==, ruleset->n_files + ruleset->rules->len);
+  g_assert_cmpuint (bytes, >, file_sizes);
+
+  /* Usage is added to what is passed in */
+  policy_ruleset_get_memory_usage (ruleset, &bytes, &objects);
+  g_assert_cmpuint (objects, ==, 2 * (ruleset->n_files + ruleset->rules->len));
+
+  policy_ruleset_unref (ruleset);
+}
+
+static void
+test_load_profile (void)
+{
+  gchar *rules_dirs[3] = { NULL };
+  PolicyLoader *loader = NULL;
+  PolicyRuleset *ruleset = NULL;
+  const PolicyLoaderProfile *profile = NULL;
+  const PolicyFile *file = NULL;
+  guint i;
+
+  rules_dirs[0] = polkit_test_get_data_path ("etc/polkit-1/rules.d");
+  rules_dirs[1] = polkit_test_get_data_path ("usr/share/polkit-1/rules.d");
+  g_assert (rules_dirs[0] != NULL && rules_dirs[1] != NULL);
+
+  loader = policy_loader_new ((const gchar *const *)rules_dirs, NULL, FALSE,
+                              NULL, NULL);
+  profile = policy_loader_get_profile (loader);
+  g_assert_cmpuint (profile->files->len, ==, 0);
+
+  /* Every file is parsed the first time, in load order */
+  ruleset = policy_loader_compile (loader);
+  g_assert_cmpuint (profile->files->len, ==, ruleset->n_files);
+  for (i = 0, file = ruleset->files; file; i++, file = file->next)
+    {
+      const PolicyLoaderFileProfile *p
+          = &g_array_index (profile->files, PolicyLoaderFileProfile, i);
+
+      g_assert_cmpstr (p->path, ==, file->path);
+      g_assert (p->parsed && !p->failed);
+      g_assert_cmpuint (p->n_rules, ==, file->rules.n_normal);
+      g_assert_cmpuint (p->n_admin_rules, ==, file->rules.n_admin);
+      g_assert_cmpuint (p->string_bytes, ==, file->pool_size);
+    }
+  g_assert_cmpint (profile->total_usec, >=,
+                   profile->scan_usec + profile->parse_usec
+                       + profile->ruleset_usec);
+  policy_ruleset_unref (ruleset);
+
+  /* and reused, costing nothing, when unchanged */
+  ruleset = policy_loader_compile (loader);
+  g_assert_cmpuint (profile->files->len, ==, ruleset->n_files);
+  for (i = 0; i < profile->files->len; i++)
+    {
+      const PolicyLoaderFileProfile *p
+          = &g_array_index (profile->files, PolicyLoaderFileProfile, i);
+
+      g_assert (!p->parsed && !p->failed);
+      g_assert_cmpint (p->times.read_usec + p->times.parse_usec
+                           + p->times.compile_usec,
+                       ==, 0);
+      g_assert_cmpuint (p->n_rules + p->n_admin_rules, >, 0);
+    }
+  policy_ruleset_unref (ruleset);
+
+  policy_loader_free (loader);
+  g_free (rules_dirs[0]);
+  g_free (rules_dirs[1]);
+}
+
+static void
+test_bundle (void)
+{
+  static const gchar key_data[] = "0123456789abcdef";
+  PolicyFile *files = NULL;
+  PolicyFile *read_files = NULL;
+  const PolicyFile *file = NULL;
+  const PolicyFile *orig = NULL;
+  PolicyLoader *loader = NULL;
+  PolicyRuleset *ruleset = NULL;
+  GBytes *key = NULL;
+  GBytes *other_key = NULL;
+  GError *error = NULL;
+  gchar *dir = NULL;
+  gchar *path = NULL;
+  gchar *key_path = NULL;
+  gchar *contents = NULL;
+  gsize length = 0;
+  guint64 serial = 0;
+
+  dir = g_dir_make_tmp ("polkit-bundle-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (dir, "rules.bundle", NULL);
+  key_path = g_build_filename (dir, "rules.key", NULL);
+
+  /* Short keys are refused */
+  g_assert (g_file_set_contents (key_path, key_data, 8, &error));
+  g_assert_no_error (error);
+  key = policy_bundle_read_key (key_path, &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_assert (key == NULL);
+  g_clear_error (&error);
+
+  g_assert (g_file_set_contents (key_path, key_data, -1, &error));
+  g_assert_no_error (error);
+  key = policy_bundle_read_key (key_path, &error);
+  g_assert_no_error (error);
+  other_key = g_bytes_new_static ("fedcba9876543210", 16);
+
+  files = load_files ();
+  g_assert (policy_bundle_write (path, files, 42, key, &error));
+  g_assert_no_error (error);
+
+  g_assert (policy_bundle_read (path, key, &read_files, &serial, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (serial, ==, 42);
+  for (file = read_files, orig = files; orig;
+       file = file->next, orig = orig->next)
+    {
+      g_assert (file != NULL);
+      g_assert_cmpstr (file->path, ==, orig->path);
+      g_assert_cmpuint (file->rules.n_normal, ==, orig->rules.n_normal);
+      g_assert_cmpuint (file->rules.n_admin, ==, orig->rules.n_admin);
+    }
+  g_assert (file == NULL);
+  policy_file_free (read_files);
+  read_files = NULL;
+
+  /* Nobody without the key can produce a bundle that is accepted */
+  g_assert (!policy_bundle_read (path, other_key, &read_files, NULL, &error));
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_assert (read_files == NULL);
+  g_clear_error (&error);
+
+  /* The loader prefers the bundle over the directories */
+  loader = policy_loader_new (NULL, NULL, FALSE, NULL, NULL);
+  policy_loader_set_bundle (loader, path, key_path);
+  ruleset = policy_loader_compile (loader);
+  g_assert_cmpuint (ruleset->n_files, ==, 2);
+  g_assert_cmpuint (policy_loader_get_profile (loader)->files->len, ==, 2);
+  policy_ruleset_unref (ruleset);
+
+  /* An older bundle never replaces the one that was loaded, however validly
+   * signed... */
+  g_assert (policy_bundle_write (path, files, 41, key, &error));
+  g_assert_no_error (error);
+  ruleset = policy_loader_compile (loader);
+  g_assert_cmpuint (ruleset->n_files, ==, 0);
+  policy_ruleset_unref (ruleset);
+
+  /* ...while the same one or a newer one does */
+  g_assert (policy_bundle_write (path, files, 42, key, &error));
+  g_assert_no_error (error);
+  ruleset = policy_loader_compile (loader);
+  g_assert_cmpuint (ruleset->n_files, ==, 2);
+  policy_ruleset_unref (ruleset);
+  g_assert (policy_bundle_write (path, files, 43, key, &error));
+  g_assert_no_error (error);
+  ruleset = policy_loader_compile (loader);
+  g_assert_cmpuint (ruleset->n_files, ==, 2);
+  policy_ruleset_unref (ruleset);
+
+  /* and falls back to them once it was tampered with */
+  g_assert (g_file_get_contents (path, &contents, &length, &error));
+  g_assert_no_error (error);
+  contents[length - 1] = ~contents[length - 1];
+  g_assert (g_file_set_contents (path, contents, length, &error));
+  g_assert_no_error (error);
+  g_assert (!policy_bundle_read (path, key, &read_files, NULL, &error));
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_clear_error (&error);
+  ruleset = policy_loader_compile (loader);
+  g_assert_cmpuint (ruleset->n_files, ==, 0);
+  policy_ruleset_unref (ruleset);
+  policy_loader_free (loader);
+
+  g_unlink (path);
+  g_unlink (key_path);
+  g_rmdir (dir);
+  g_free (contents);
+  g_free (key_path);
+  g_free (path);
+  g_free (dir);
+  g_bytes_unref (other_key);
+  g_bytes_unref (key);
+  policy_file_free (files);
+}
+
+static void
+test_builtin (void)
+{
+  static const guint64 junk[4] = { 0 };
+  gchar *rules_dirs[3] = { NULL };
+  PolicyFile *files = NULL;
+  PolicyImageEntry entries[2];
+  PolicyLoader *loader = NULL;
+  PolicyRuleset *ruleset = NULL;
+  const PolicyFile *file = NULL;
+  const PolicyLoaderFileProfile *p = NULL;
+  GBytes *image = NULL;
+  gsize length = 0;
+  const gchar *data = NULL;
+
+  rules_dirs[0] = polkit_test_get_data_path ("etc/polkit-1/rules.d");
+  rules_dirs[1] = polkit_test_get_data_path ("usr/share/polkit-1/rules.d");
+  g_assert (rules_dirs[0] != NULL && rules_dirs[1] != NULL);
+
+  /* One built-in file is replaced by the directories, the other is not */
+  files = load_files ();
+  memset (entries, 0, sizeof (entries));
+  entries[0].path = POLICY_LOADER_BUILTIN_RULES_DIR "/10-testing.keyrules";
+  entries[0].file = files;
+  entries[1].path = POLICY_LOADER_BUILTIN_RULES_DIR "/30-testing.keyrules";
+  entries[1].file = files->next;
+  image = policy_image_serialize (entries, G_N_ELEMENTS (entries));
+  data = g_bytes_get_data (image, &length);
+
+  loader = policy_loader_new ((const gchar *const *)rules_dirs, NULL, FALSE,
+                              NULL, NULL);
+  policy_loader_set_builtin (loader, data, length);
+  g_bytes_unref (image);
+
+  /* Compiled in load order, as if the file was in the directories */
+  ruleset = policy_loader_compile (loader);
+  g_assert_cmpuint (ruleset->n_files, ==, 3);
+  file = ruleset->files;
+  g_assert (g_str_has_prefix (file->path, rules_dirs[0]));
+  file = file->next;
+  g_assert (g_str_has_prefix (file->path, rules_dirs[1]));
+  file = file->next;
+  g_assert_cmpstr (file->path, ==, entries[1].path);
+  g_assert_cmpuint (file->rules.n_normal, ==, files->next->rules.n_normal);
+  g_assert_cmpuint (file->rules.n_admin, ==, files->next->rules.n_admin);
+
+  /* and never parsed */
+  p = &g_array_index (policy_loader_get_profile (loader)->files,
+                      PolicyLoaderFileProfile, 2);
+  g_assert_cmpstr (p->path, ==, entries[1].path);
+  g_assert (!p->parsed && !p->failed);
+  policy_ruleset_unref (ruleset);
+
+  /* A broken image is ignored */
+  policy_loader_set_builtin (loader, (const gchar *)junk, sizeof (junk));
+  ruleset = policy_loader_compile (loader);
+  g_assert_cmpuint (ruleset->n_files, ==, 2);
+  policy_ruleset_unref (ruleset);
+
+  policy_loader_free (loader);
+  policy_file_free (files);
+  g_free (rules_dirs[0]);
+  g_free (rules_dirs[1]);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/PolkitBackendPolicyRuleset/file_table", test_file_table);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/file_copy", test_file_copy);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/image", test_image);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/index", test_ruleset_index);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/group_atoms", test_group_atoms);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/prefix_patterns",
+                   test_prefix_patterns);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/invalid_results",
+                   test_invalid_results);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/pruned", test_pruned);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/static_decisions",
+                   test_static_decisions);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/details", test_details);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/session_state",
+                   test_session_state);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/lists", test_lists);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/lazy_context",
+                   test_lazy_context);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/trace", test_trace);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/rule_stats", test_rule_stats);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/diff_actions",
+                   test_diff_actions);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/load_profile",
+                   test_load_profile);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/builtin", test_builtin);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/bundle", test_bundle);
+  g_test_add_func ("/PolkitBackendPolicyRuleset/memory_usage",
+                   test_memory_usage);
+  add_ruleset_tests ();
+
+  return g_test_run ();
+}